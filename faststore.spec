@@ -121,6 +121,8 @@ mkdir -p /opt/fastcfs/fstore
 /usr/bin/fs_read
 /usr/bin/fs_write
 /usr/bin/fstore_list_servers
+/usr/bin/fs_rebalance_plan
+/usr/bin/fs_bench
 
 %files -n %{FastStoreDevel}
 %defattr(-,root,root,-)
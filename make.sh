@@ -108,6 +108,16 @@ if [ $have_pthread -eq 0 ] && [ "$uname" != "Darwin" ]; then
    fi
 fi
 
+COMPRESS_LIBS=''
+if [ -f /usr/include/lz4.h ] || [ -f /usr/local/include/lz4.h ]; then
+  CFLAGS="$CFLAGS -DFS_WITH_LZ4"
+  COMPRESS_LIBS="$COMPRESS_LIBS -llz4"
+fi
+if [ -f /usr/include/zstd.h ] || [ -f /usr/local/include/zstd.h ]; then
+  CFLAGS="$CFLAGS -DFS_WITH_ZSTD"
+  COMPRESS_LIBS="$COMPRESS_LIBS -lzstd"
+fi
+
 sed_replace()
 {
     sed_cmd=$1
@@ -124,6 +134,7 @@ replace_makefile()
     cp Makefile.in Makefile
     sed_replace "s#\\\$(CFLAGS)#$CFLAGS#g" Makefile
     sed_replace "s#\\\$(LIBS)#$LIBS#g" Makefile
+    sed_replace "s#\\\$(COMPRESS_LIBS)#$COMPRESS_LIBS#g" Makefile
     sed_replace "s#\\\$(TARGET_PREFIX)#$TARGET_PREFIX#g" Makefile
     sed_replace "s#\\\$(LIB_VERSION)#$LIB_VERSION#g" Makefile
     sed_replace "s#\\\$(TARGET_CONF_PATH)#$TARGET_CONF_PATH#g" Makefile
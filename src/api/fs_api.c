@@ -20,6 +20,9 @@
 #include "write_combine/combine_handler.h"
 #include "read_ahead/otid_htable.h"
 #include "read_ahead/obid_htable.h"
+#include "read_ahead/preread_handler.h"
+#include "write_back/block_htable.h"
+#include "write_back/flush_handler.h"
 #include "fs_api.h"
 
 FSAPIContext g_fs_api_ctx;
@@ -90,8 +93,21 @@ FSAPIContext g_fs_api_ctx;
 #define FS_API_MAX_PREREAD_SHARED_LOCK_COUNT      5614657
 #define FS_API_DEFAULT_PREREAD_SHARED_LOCK_COUNT     1361
 
+#define FS_API_MIN_WRITE_BACK_MAX_MEMORY      ( 16 * 1024 * 1024)
+#define FS_API_MAX_WRITE_BACK_MAX_MEMORY      (64LL * 1024 * 1024 * 1024)
+#define FS_API_DEFAULT_WRITE_BACK_MAX_MEMORY  (256 * 1024 * 1024)
+
+#define FS_API_MIN_WRITE_BACK_FLUSH_THREADS      1
+#define FS_API_MAX_WRITE_BACK_FLUSH_THREADS     64
+#define FS_API_DEFAULT_WRITE_BACK_FLUSH_THREADS  4
+
+#define FS_API_MIN_WRITE_BACK_MAX_DIRTY_TIME_MS       10
+#define FS_API_MAX_WRITE_BACK_MAX_DIRTY_TIME_MS    60000
+#define FS_API_DEFAULT_WRITE_BACK_MAX_DIRTY_TIME_MS 1000
+
 #define FS_API_WRITE_COMBINE_SECTION_NAME   "write-combine"
 #define FS_API_READ_AHEAD_SECTION_NAME      "read-ahead"
+#define FS_API_WRITE_BACK_SECTION_NAME      "write-back"
 
 #define SET_VARS_AND_CHECK_CONFLICT_AND_WAIT(op_ctx, operation) \
     do {  \
@@ -238,6 +254,56 @@ static void fs_api_config_load_read_ahead(FSAPIContext *api_ctx,
             FS_API_DEFAULT_PREREAD_SHARED_LOCK_COUNT,
             FS_API_MIN_PREREAD_SHARED_LOCK_COUNT,
             FS_API_MAX_PREREAD_SHARED_LOCK_COUNT);
+
+    api_ctx->read_ahead.thread_pool_max_threads = iniGetIntCorrectValue(
+            ini_ctx, "thread_pool_max_threads",
+            FS_API_DEFAULT_THREAD_POOL_MAX_THREADS,
+            FS_API_MIN_THREAD_POOL_MAX_THREADS,
+            FS_API_MAX_THREAD_POOL_MAX_THREADS);
+
+    api_ctx->read_ahead.thread_pool_min_idle_count = iniGetIntCorrectValue(
+            ini_ctx, "thread_pool_min_idle_count",
+            FS_API_DEFAULT_THREAD_POOL_MIN_IDLE_COUNT,
+            FS_API_MIN_THREAD_POOL_MIN_IDLE_COUNT,
+            FS_API_MAX_THREAD_POOL_MIN_IDLE_COUNT);
+
+    api_ctx->read_ahead.thread_pool_max_idle_time = iniGetIntCorrectValue(
+            ini_ctx, "thread_pool_max_idle_time",
+            FS_API_DEFAULT_THREAD_POOL_MAX_IDLE_TIME,
+            FS_API_MIN_THREAD_POOL_MAX_IDLE_TIME,
+            FS_API_MAX_THREAD_POOL_MAX_IDLE_TIME);
+}
+
+static void fs_api_config_load_write_back(FSAPIContext *api_ctx,
+        IniFullContext *ini_ctx)
+{
+    ini_ctx->section_name = FS_API_WRITE_BACK_SECTION_NAME;
+    api_ctx->write_back.enabled = iniGetBoolValue(ini_ctx->section_name,
+            "enabled", ini_ctx->context, false);
+
+    api_ctx->write_back.max_memory = iniGetByteCorrectValue(
+            ini_ctx, "max_memory",
+            FS_API_DEFAULT_WRITE_BACK_MAX_MEMORY,
+            FS_API_MIN_WRITE_BACK_MAX_MEMORY,
+            FS_API_MAX_WRITE_BACK_MAX_MEMORY);
+
+    api_ctx->write_back.flush_threads = iniGetIntCorrectValue(
+            ini_ctx, "flush_threads",
+            FS_API_DEFAULT_WRITE_BACK_FLUSH_THREADS,
+            FS_API_MIN_WRITE_BACK_FLUSH_THREADS,
+            FS_API_MAX_WRITE_BACK_FLUSH_THREADS);
+
+    api_ctx->write_back.max_dirty_time_ms = iniGetIntCorrectValue(
+            ini_ctx, "max_dirty_time_ms",
+            FS_API_DEFAULT_WRITE_BACK_MAX_DIRTY_TIME_MS,
+            FS_API_MIN_WRITE_BACK_MAX_DIRTY_TIME_MS,
+            FS_API_MAX_WRITE_BACK_MAX_DIRTY_TIME_MS);
+
+    api_ctx->write_back.shared_lock_count = iniGetIntCorrectValue(
+            ini_ctx, "shared_lock_count",
+            FS_API_DEFAULT_PREREAD_SHARED_LOCK_COUNT,
+            FS_API_MIN_PREREAD_SHARED_LOCK_COUNT,
+            FS_API_MAX_PREREAD_SHARED_LOCK_COUNT);
 }
 
 static void fs_api_config_load(FSAPIContext *api_ctx, IniFullContext *ini_ctx)
@@ -245,6 +311,7 @@ static void fs_api_config_load(FSAPIContext *api_ctx, IniFullContext *ini_ctx)
     fs_api_config_load_common(api_ctx, ini_ctx);
     fs_api_config_load_write_combine(api_ctx, ini_ctx);
     fs_api_config_load_read_ahead(api_ctx, ini_ctx);
+    fs_api_config_load_write_back(api_ctx, ini_ctx);
 }
 
 void fs_api_config_to_string_ex(FSAPIContext *api_ctx,
@@ -295,12 +362,37 @@ void fs_api_config_to_string_ex(FSAPIContext *api_ctx,
                 "min_buffer_size: %d KB, "
                 "max_buffer_size: %d KB, "
                 "skip_preread_on_slice_size: %d KB, "
-                "shared_lock_count: %d",
+                "shared_lock_count: %d, "
+                "thread_pool_max_threads: %d, "
+                "thread_pool_min_idle_count: %d, "
+                "thread_pool_max_idle_time: %d s",
                 api_ctx->read_ahead.cache_ttl_ms,
                 api_ctx->read_ahead.min_buffer_size / 1024,
                 api_ctx->read_ahead.max_buffer_size / 1024,
                 api_ctx->read_ahead.skip_preread_on_slice_size / 1024,
-                api_ctx->read_ahead.shared_lock_count);
+                api_ctx->read_ahead.shared_lock_count,
+                api_ctx->read_ahead.thread_pool_max_threads,
+                api_ctx->read_ahead.thread_pool_min_idle_count,
+                api_ctx->read_ahead.thread_pool_max_idle_time);
+        if (len > size) {
+            len = size;
+        }
+    }
+    len += snprintf(output + len, size - len, " }");
+
+    len += snprintf(output + len, size - len,
+            ", write_back { enabled: %d",
+            api_ctx->write_back.enabled);
+    if (api_ctx->write_back.enabled) {
+        len += snprintf(output + len, size - len, ", "
+                "max_memory: %"PRId64" MB, "
+                "flush_threads: %d, "
+                "max_dirty_time_ms: %d ms, "
+                "shared_lock_count: %d",
+                api_ctx->write_back.max_memory / (1024 * 1024),
+                api_ctx->write_back.flush_threads,
+                api_ctx->write_back.max_dirty_time_ms,
+                api_ctx->write_back.shared_lock_count);
         if (len > size) {
             len = size;
         }
@@ -364,6 +456,20 @@ static int read_ahead_init(FSAPIContext *api_ctx)
     return 0;
 }
 
+static int write_back_init(FSAPIContext *api_ctx)
+{
+    int result;
+
+    if ((result=wback_block_htable_init(api_ctx->common.
+                    hashtable_total_capacity, api_ctx->write_back.
+                    shared_lock_count)) != 0)
+    {
+        return result;
+    }
+
+    return wback_flush_handler_init(api_ctx);
+}
+
 int fs_api_init_ex(FSAPIContext *api_ctx, IniFullContext *ini_ctx,
         fs_api_write_done_callback write_done_callback,
         const int write_done_arg_extra_size)
@@ -373,7 +479,8 @@ int fs_api_init_ex(FSAPIContext *api_ctx, IniFullContext *ini_ctx,
 
     fs_api_config_load(api_ctx, ini_ctx);
     if (!(api_ctx->write_combine.enabled ||
-                api_ctx->read_ahead.enabled))
+                api_ctx->read_ahead.enabled ||
+                api_ctx->write_back.enabled))
     {
         return 0;
     }
@@ -405,6 +512,12 @@ int fs_api_init_ex(FSAPIContext *api_ctx, IniFullContext *ini_ctx,
         }
     }
 
+    if (api_ctx->write_back.enabled) {
+        if ((result=write_back_init(api_ctx)) != 0) {
+            return result;
+        }
+    }
+
     return 0;
 }
 
@@ -413,7 +526,8 @@ int fs_api_start_ex(FSAPIContext *api_ctx)
     int result;
 
     if (!(api_ctx->write_combine.enabled ||
-                api_ctx->read_ahead.enabled))
+                api_ctx->read_ahead.enabled ||
+                api_ctx->write_back.enabled))
     {
         return 0;
     }
@@ -432,6 +546,22 @@ int fs_api_start_ex(FSAPIContext *api_ctx)
         }
     }
 
+    if (api_ctx->read_ahead.enabled) {
+        if ((result=preread_handler_init(api_ctx->read_ahead.
+                        thread_pool_max_threads, api_ctx->read_ahead.
+                        thread_pool_min_idle_count, api_ctx->read_ahead.
+                        thread_pool_max_idle_time)) != 0)
+        {
+            return result;
+        }
+    }
+
+    if (api_ctx->write_back.enabled) {
+        if ((result=wback_flush_handler_start()) != 0) {
+            return result;
+        }
+    }
+
     return 0;
 }
 
@@ -441,11 +571,21 @@ void fs_api_destroy_ex(FSAPIContext *api_ctx)
 
 void fs_api_terminate_ex(FSAPIContext *api_ctx)
 {
+    if (api_ctx->write_back.enabled) {
+        wback_flush_handler_terminate();
+        api_ctx->write_back.enabled = false;
+    }
+
     if (api_ctx->write_combine.enabled) {
         api_ctx->write_combine.enabled = false;
         timeout_handler_terminate();
         combine_handler_terminate();
     }
+
+    if (api_ctx->read_ahead.enabled) {
+        api_ctx->read_ahead.enabled = false;
+        preread_handler_terminate();
+    }
 }
 
 int fs_api_slice_write(FSAPIOperationContext *op_ctx,
@@ -456,6 +596,26 @@ int fs_api_slice_write(FSAPIOperationContext *op_ctx,
 
     op_ctx->op_type = 'w';
     do {
+        if (op_ctx->api_ctx->write_back.enabled) {
+            FS_API_SET_BID_AND_ALLOCATOR_CTX(op_ctx);
+            if (wback_block_htable_write(op_ctx, wbuffer) == 0) {
+                wbuffer->combined = true;
+            } else {
+                /* flush the cached data before write through, the cached
+                 * data left when sync fail will overwrite the newer data
+                 * written through when flushed later */
+                SFTwoIdsHashKey key;
+                key.oid = op_ctx->bs_key.block.oid;
+                key.bid = op_ctx->bid;
+                if ((result=wback_block_htable_sync(&key)) != 0) {
+                    return result;
+                }
+                wbuffer->combined = false;
+            }
+            result = 0;
+            break;
+        }
+
         if (!op_ctx->api_ctx->write_combine.enabled) {
             wbuffer->combined = false;
             result = 0;
@@ -498,12 +658,35 @@ int fs_api_slice_write(FSAPIOperationContext *op_ctx,
 int fs_api_slice_read(FSAPIOperationContext *op_ctx,
         char *buff, int *read_bytes)
 {
+    int result;
+
+    if (op_ctx->api_ctx->write_back.enabled) {
+        FS_API_SET_BID_AND_ALLOCATOR_CTX(op_ctx);
+        op_ctx->op_type = 'r';
+        result = wback_block_htable_read(op_ctx, buff, read_bytes);
+        if (result != ENOENT) {
+            return result;
+        }
+    }
+
     if (op_ctx->api_ctx->read_ahead.enabled) {
         op_ctx->op_type = 'r';
         FS_API_SET_BID_AND_ALLOCATOR_CTX(op_ctx);
         return preread_slice_read(op_ctx, buff, read_bytes);
     } else {
-        SET_VARS_AND_CHECK_CONFLICT_AND_WAIT(op_ctx, 'r');
+        if (op_ctx->api_ctx->write_combine.enabled) {
+            int conflict_count;
+
+            FS_API_SET_BID_AND_ALLOCATOR_CTX(op_ctx);
+            op_ctx->op_type = 'r';
+            /* the data of the conflict slices is lost when its write fail */
+            if ((result=wcombine_obid_htable_check_conflict_and_wait(
+                            op_ctx, &conflict_count)) != 0)
+            {
+                *read_bytes = 0;
+                return result;
+            }
+        }
         return fs_client_slice_read(op_ctx->api_ctx->fs,
                 &op_ctx->bs_key, buff, read_bytes);
     }
@@ -521,6 +704,17 @@ int fs_api_slice_delete_ex(FSAPIOperationContext *op_ctx,
         const int enoent_log_level, int *dec_alloc)
 {
     SET_VARS_AND_CHECK_CONFLICT_AND_WAIT(op_ctx, 'd');
+    if (op_ctx->api_ctx->write_back.enabled) {
+        const bool whole_block = false;
+        int result;
+
+        /* the cached data left when discard fail
+         * will overwrite the deleted range when flushed later */
+        FS_API_SET_BID_AND_ALLOCATOR_CTX(op_ctx);
+        if ((result=wback_block_htable_discard(op_ctx, whole_block)) != 0) {
+            return result;
+        }
+    }
     return fs_client_slice_delete_ex(op_ctx->api_ctx->fs,
             &op_ctx->bs_key, enoent_log_level, dec_alloc);
 }
@@ -529,6 +723,17 @@ int fs_api_block_delete_ex(FSAPIOperationContext *op_ctx,
         const int enoent_log_level, int *dec_alloc)
 {
     SET_VARS_AND_CHECK_CONFLICT_AND_WAIT(op_ctx, 'D');
+    if (op_ctx->api_ctx->write_back.enabled) {
+        const bool whole_block = true;
+        int result;
+
+        /* the cached data left when discard fail
+         * will overwrite the deleted range when flushed later */
+        FS_API_SET_BID_AND_ALLOCATOR_CTX(op_ctx);
+        if ((result=wback_block_htable_discard(op_ctx, whole_block)) != 0) {
+            return result;
+        }
+    }
     return fs_client_block_delete_ex(op_ctx->api_ctx->fs,
             &op_ctx->bs_key.block, enoent_log_level, dec_alloc);
 }
@@ -574,3 +779,12 @@ int fs_api_unlink_file(FSAPIContext *api_ctx, const int64_t oid,
 
     return result;
 }
+
+int fs_api_flush_file(FSAPIContext *api_ctx, const int64_t oid)
+{
+    if (api_ctx->write_back.enabled) {
+        return wback_flush_handler_sync(oid);
+    } else {
+        return 0;
+    }
+}
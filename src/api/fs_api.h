@@ -73,6 +73,10 @@ void fs_api_terminate_ex(FSAPIContext *api_ctx);
 int fs_api_unlink_file(FSAPIContext *api_ctx, const int64_t oid,
         const int64_t file_size, const uint64_t tid);
 
+/* flush the write back cache of the file, should be called
+ * on fsync and close (barrier) */
+int fs_api_flush_file(FSAPIContext *api_ctx, const int64_t oid);
+
 int fs_api_slice_write(FSAPIOperationContext *op_ctx,
         FSAPIWriteBuffer *wbuffer, int *write_bytes, int *inc_alloc);
 
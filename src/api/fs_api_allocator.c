@@ -37,6 +37,7 @@ static int waiting_task_alloc_init(FSAPIWaitingTask *task,
     }
 
     FC_INIT_LIST_HEAD(&task->waitings.head);
+    task->result = 0;
     task->allocator = allocator;
     return 0;
 }
@@ -78,6 +79,20 @@ static int pread_slice_entry_alloc_init(FSPrereadSliceEntry *slice,
     return 0;
 }
 
+static int wback_block_entry_alloc_init(FSWBackBlockEntry *block,
+        struct fast_mblock_man *allocator)
+{
+    block->allocator = allocator;
+    return 0;
+}
+
+static int wback_extent_alloc_init(FSWBackExtent *extent,
+        struct fast_mblock_man *allocator)
+{
+    extent->allocator = allocator;
+    return 0;
+}
+
 static int init_write_combine_allocators(FSAPIContext *api_ctx,
         FSAPIAllocatorContext *ctx)
 {
@@ -122,6 +137,13 @@ static int init_write_combine_allocators(FSAPIContext *api_ctx,
     return 0;
 }
 
+static int pread_task_alloc_init(FSPrereadTask *task,
+        struct fast_mblock_man *allocator)
+{
+    task->allocator = allocator;
+    return 0;
+}
+
 static int init_read_ahead_allocators(FSAPIContext *api_ctx,
         FSAPIAllocatorContext *ctx)
 {
@@ -150,6 +172,49 @@ static int init_read_ahead_allocators(FSAPIContext *api_ctx,
         return result;
     }
 
+    if ((result=fast_mblock_init_ex1(&ctx->read_ahead.task,
+                    "preread-task", sizeof(FSPrereadTask), 1024, 0,
+                    (fast_mblock_alloc_init_func)pread_task_alloc_init,
+                    &ctx->read_ahead.task, true)) != 0)
+    {
+        return result;
+    }
+
+    return 0;
+}
+
+static int init_write_back_allocators(FSAPIContext *api_ctx,
+        FSAPIAllocatorContext *ctx)
+{
+    int result;
+    int element_size;
+
+    if ((result=fast_mblock_init_ex1(&ctx->write_back.block,
+                    "wback-block", sizeof(FSWBackBlockEntry), 1024, 0,
+                    (fast_mblock_alloc_init_func)wback_block_entry_alloc_init,
+                    &ctx->write_back.block, true)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=fast_mblock_init_ex1(&ctx->write_back.extent,
+                    "wback-extent", sizeof(FSWBackExtent), 4096, 0,
+                    (fast_mblock_alloc_init_func)wback_extent_alloc_init,
+                    &ctx->write_back.extent, true)) != 0)
+    {
+        return result;
+    }
+
+    element_size = sizeof(FSAPIWriteDoneCallbackArg) +
+        api_ctx->write_done_callback.arg_extra_size;
+    if ((result=fast_mblock_init_ex1(&ctx->write_back.callback_arg,
+                    "wback-callback-arg", element_size, 1024, 0,
+                    (fast_mblock_alloc_init_func)callback_arg_alloc_init,
+                    &ctx->write_back.callback_arg, true)) != 0)
+    {
+        return result;
+    }
+
     return 0;
 }
 
@@ -170,6 +235,12 @@ static int init_allocator_context(FSAPIContext *api_ctx,
         }
     }
 
+    if (api_ctx->write_back.enabled) {
+        if ((result=init_write_back_allocators(api_ctx, ctx)) != 0) {
+            return result;
+        }
+    }
+
     return 0;
 }
 
@@ -36,9 +36,16 @@ typedef struct fs_api_allocator_context {
     struct {
         struct fast_mblock_man block; //element: FSPrereadBlockHEntry
         struct fast_mblock_man slice; //element: FSPrereadSliceEntry
+        struct fast_mblock_man task;  //element: FSPrereadTask
         FSAPIBufferPool buffer_pool;
     } read_ahead;
 
+    struct {
+        struct fast_mblock_man block;   //element: FSWBackBlockEntry
+        struct fast_mblock_man extent;  //element: FSWBackExtent
+        struct fast_mblock_man callback_arg; //element: FSAPIWriteDoneCallbackArg
+    } write_back;
+
 } FSAPIAllocatorContext;
 
 typedef struct fs_api_allocator_ctx_array {
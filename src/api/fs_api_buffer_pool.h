@@ -24,7 +24,7 @@ struct fs_api_buffer_allocator;
 typedef struct fs_api_buffer {
     int64_t create_time_ms;
     int64_t bid;   //block id
-    int offset;
+    int start;     //the slice offset of buff[0] in the block
     int length;    //data length
     bool deleted;  //set to true when deleted from otid_hashtable
     bool dirty;    //set to false when async read successfully
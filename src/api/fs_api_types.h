@@ -67,6 +67,7 @@ typedef struct fs_api_waiting_task_slice_pair {
 
 typedef struct fs_api_waiting_task {
     pthread_lock_cond_pair_t lcp;  //for notify
+    int result;  //the write error of the waiting slices
     struct {
         FSAPIWaitingTaskSlicePair fixed_pair; //for only one writer
         struct fc_list_head head;   //element: FSAPIWaitingTaskSlicePair
@@ -77,6 +78,7 @@ typedef struct fs_api_waiting_task {
 typedef struct fs_api_write_done_callback_arg {
     const FSBlockSliceKeyInfo *bs_key;
     struct fast_mblock_man *allocator;  //for free
+    int result;  //0 for success, the write error when the data discarded
     int write_bytes;
     int inc_alloc;
     char extra_data[0];
@@ -90,6 +92,11 @@ typedef struct fs_api_slice_entry {
     int stage;
     int merged_slices;
     int64_t start_time;
+    struct {
+        int count;           //the retry count of the failed write
+        int last_errno;      //the error of the last write
+        int64_t expires_ms;  //the time to retry
+    } retry;
     FSBlockSliceKeyInfo bs_key;
     char *buff;
     struct {
@@ -104,6 +111,7 @@ typedef struct fs_api_slice_entry {
 
 typedef struct fs_preread_slice_entry {
     uint64_t tid;
+    int stream;  //the read stream index of the thread
     FSSliceSize ssize;
     struct fs_api_buffer *buffer;
     struct fast_mblock_man *allocator;  //for free
@@ -119,6 +127,34 @@ typedef struct fs_preread_block_hentry {
     struct fs_preread_block_hentry *next;
 } FSPrereadBlockHEntry;    //for read ahead
 
+typedef struct fs_wback_extent {
+    FSSliceSize ssize;
+    int alloc_size;
+    char *buff;
+    struct fast_mblock_man *allocator;  //for free
+    struct fs_wback_extent *next;
+} FSWBackExtent;  //for write back
+
+typedef struct fs_wback_block_entry {
+    SFTwoIdsHashKey key;
+    struct {
+        FSWBackExtent *head;  //sorted by offset and no overlap
+    } dirty;
+    struct {
+        FSWBackExtent *head;  //detached from dirty, being written
+    } flushing;
+    int64_t version;          //change when flush done
+    int64_t dirty_time_ms;    //the time of enter flush queue
+    bool in_flush;
+    bool queued;
+    int last_errno;
+    FSAPIWriteDoneCallbackArg *done_callback_arg;
+    struct fast_mblock_man *allocator;  //for free
+    struct fc_list_head dlink;          //for all blocks chain
+    struct fs_wback_block_entry *next;  //for hashtable
+    struct fs_wback_block_entry *qnext; //for flush queue
+} FSWBackBlockEntry;  //for write back
+
 typedef struct fs_api_operation_context {
     uint64_t tid;  //thread id
     uint64_t bid;  //file block id
@@ -128,6 +164,12 @@ typedef struct fs_api_operation_context {
     struct fs_api_context *api_ctx;
 } FSAPIOperationContext;
 
+typedef struct fs_preread_task {
+    FSAPIOperationContext op_ctx;  //the read ahead slice
+    struct fs_api_buffer *buffer;
+    struct fast_mblock_man *allocator;  //for free
+} FSPrereadTask;  //for async read ahead
+
 typedef struct fs_api_write_buffer {
     const char *buff;
     void *extra_data;  //for write done callback
@@ -162,8 +204,19 @@ typedef struct fs_api_context {
         int max_buffer_size;
         int skip_preread_on_slice_size;
         int shared_lock_count;
+        int thread_pool_max_threads;
+        int thread_pool_min_idle_count;
+        int thread_pool_max_idle_time;
     } read_ahead;
 
+    struct {
+        volatile bool enabled;
+        int64_t max_memory;
+        int flush_threads;
+        int max_dirty_time_ms;
+        int shared_lock_count;
+    } write_back;
+
     FSClientContext *fs;
     struct {
         fs_api_write_done_callback func;
@@ -0,0 +1,867 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/ini_file_reader.h"
+#include "faststore/client/fs_client.h"
+#include "fs_api.h"
+
+#define BENCH_OP_READ       0
+#define BENCH_OP_WRITE      1
+#define BENCH_OP_ALLOCATE   2
+#define BENCH_OP_DELETE     3
+#define BENCH_OP_COUNT      4
+
+#define BENCH_ENGINE_CLIENT  'c'  //fs_client_slice_*
+#define BENCH_ENGINE_API     'a'  //fs_api_* with the write combine etc.
+
+#define BENCH_PATTERN_SEQUENTIAL  's'
+#define BENCH_PATTERN_RANDOM      'r'
+#define BENCH_PATTERN_ZIPFIAN     'z'
+
+/* the log-linear latency histogram in microseconds, the relative
+ * error of the percentiles is less than 1 / LATENCY_SUB_BUCKETS */
+#define LATENCY_SUB_BUCKET_BITS   6
+#define LATENCY_SUB_BUCKETS       (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKET_COUNT      ((64 - LATENCY_SUB_BUCKET_BITS + 1) * \
+        LATENCY_SUB_BUCKETS)
+
+typedef struct {
+    int64_t count;
+    int64_t errors;
+    int64_t bytes;
+    int64_t total_us;
+    int64_t max_us;
+    int64_t buckets[LATENCY_BUCKET_COUNT];
+} BenchOpStat;
+
+typedef struct {
+    int index;
+    uint64_t rand_state;
+    int64_t cursor;    //for the sequential pattern
+    char *buff;
+    BenchOpStat stats[BENCH_OP_COUNT];
+} BenchWorker;
+
+typedef struct {
+    const char *config_filename;
+    char engine;
+    char pattern;
+    bool prefill;
+    bool text_output;
+    int threads;
+    int iodepth;
+    int worker_count;
+    int duration;       //in seconds
+    int64_t max_ops;    //0 for no limit
+    int mix[BENCH_OP_COUNT];   //percentage of the operations
+    int min_slice_size;
+    int max_slice_size;
+    int64_t object_count;
+    int64_t object_size;
+    int64_t oid_base;
+    int64_t units_per_object;  //in max slice size
+    int64_t unit_count;
+
+    struct {
+        double theta;
+        double alpha;
+        double zetan;
+        double eta;
+    } zipf;
+
+    volatile bool continue_flag;
+    volatile int running_count;
+    volatile int64_t done_ops;
+    int64_t start_time_us;
+    int64_t end_time_us;
+    BenchWorker *workers;
+} BenchContext;
+
+static const char *op_captions[BENCH_OP_COUNT] = {
+    "read", "write", "allocate", "delete"
+};
+
+static BenchContext bench_ctx;
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-c config_filename=%s]\n"
+            "\t[-e engine=client, client or api]\n"
+            "\t[-t threads=4] [-q iodepth=1, the blocking workers per "
+            "thread]\n"
+            "\t[-m mix=read:70,write:30, the percentage of read, write, "
+            "allocate and delete]\n"
+            "\t[-s slice_size=4K, or a range such as 4K-64K]\n"
+            "\t[-p pattern=random, sequential, random or zipfian]\n"
+            "\t[-z zipfian_theta=0.99]\n"
+            "\t[-o object_count=1024] [-S object_size=64M]\n"
+            "\t[-i oid_base=1000000000] [-d duration=60 seconds]\n"
+            "\t[-N max_operations=0 for no limit] [-P prefill before run]\n"
+            "\t[-T text output, default is JSON]\n"
+            "\t[-n namespace or poolname=fs]\n",
+            argv[0], FS_CLIENT_DEFAULT_CONFIG_FILENAME);
+}
+
+static inline uint64_t next_rand(BenchWorker *worker)
+{
+    /* xorshift64* */
+    worker->rand_state ^= worker->rand_state >> 12;
+    worker->rand_state ^= worker->rand_state << 25;
+    worker->rand_state ^= worker->rand_state >> 27;
+    return worker->rand_state * 2685821657736338717ULL;
+}
+
+static inline double next_rand_double(BenchWorker *worker)
+{
+    return (next_rand(worker) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline int latency_index(const int64_t us)
+{
+    int shift;
+
+    if (us < LATENCY_SUB_BUCKETS) {
+        return us < 0 ? 0 : us;
+    }
+
+    shift = 63 - __builtin_clzll(us) - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS +
+        ((us >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+static inline int64_t latency_value(const int index)
+{
+    int level;
+
+    level = index / LATENCY_SUB_BUCKETS;
+    if (level == 0) {
+        return index;
+    }
+    return (int64_t)(index - (level - 1) * LATENCY_SUB_BUCKETS) <<
+        (level - 1);
+}
+
+static inline void stat_add(BenchOpStat *stat, const int result,
+        const int bytes, const int64_t time_used_us)
+{
+    stat->count++;
+    if (result != 0) {
+        stat->errors++;
+    } else {
+        stat->bytes += bytes;
+    }
+    stat->total_us += time_used_us;
+    if (time_used_us > stat->max_us) {
+        stat->max_us = time_used_us;
+    }
+    stat->buckets[latency_index(time_used_us)]++;
+}
+
+static double zeta(const int64_t n, const double theta)
+{
+    double sum;
+    int64_t i;
+
+    sum = 0.0;
+    for (i=1; i<=n; i++) {
+        sum += 1.0 / pow((double)i, theta);
+    }
+    return sum;
+}
+
+static void zipf_init()
+{
+    double zeta2;
+
+    zeta2 = zeta(2, bench_ctx.zipf.theta);
+    bench_ctx.zipf.alpha = 1.0 / (1.0 - bench_ctx.zipf.theta);
+    bench_ctx.zipf.zetan = zeta(bench_ctx.unit_count, bench_ctx.zipf.theta);
+    bench_ctx.zipf.eta = (1.0 - pow(2.0 / bench_ctx.unit_count,
+                1.0 - bench_ctx.zipf.theta)) /
+        (1.0 - zeta2 / bench_ctx.zipf.zetan);
+}
+
+static inline int64_t next_zipf_unit(BenchWorker *worker)
+{
+    double u;
+    double uz;
+    int64_t rank;
+
+    u = next_rand_double(worker);
+    uz = u * bench_ctx.zipf.zetan;
+    if (uz < 1.0) {
+        rank = 0;
+    } else if (uz < 1.0 + pow(0.5, bench_ctx.zipf.theta)) {
+        rank = 1;
+    } else {
+        rank = (int64_t)(bench_ctx.unit_count * pow(bench_ctx.zipf.eta *
+                    u - bench_ctx.zipf.eta + 1.0, bench_ctx.zipf.alpha));
+        if (rank >= bench_ctx.unit_count) {
+            rank = bench_ctx.unit_count - 1;
+        }
+    }
+
+    /* scatter the hot units over the objects */
+    return (int64_t)(((uint64_t)rank * 11400714819323198485ULL) %
+            (uint64_t)bench_ctx.unit_count);
+}
+
+static inline int64_t next_unit(BenchWorker *worker)
+{
+    int64_t unit;
+
+    switch (bench_ctx.pattern) {
+        case BENCH_PATTERN_SEQUENTIAL:
+            unit = worker->cursor++;
+            if (worker->cursor >= bench_ctx.unit_count) {
+                worker->cursor = 0;
+            }
+            return unit;
+        case BENCH_PATTERN_ZIPFIAN:
+            return next_zipf_unit(worker);
+        default:
+            return next_rand(worker) % bench_ctx.unit_count;
+    }
+}
+
+static inline int next_op(BenchWorker *worker)
+{
+    int value;
+    int op;
+
+    value = next_rand(worker) % 100;
+    for (op=0; op<BENCH_OP_COUNT - 1; op++) {
+        if (value < bench_ctx.mix[op]) {
+            return op;
+        }
+        value -= bench_ctx.mix[op];
+    }
+    return op;
+}
+
+static inline void set_block_slice(BenchWorker *worker, const int64_t unit,
+        const int slice_size, FSBlockSliceKeyInfo *bs_key)
+{
+    int64_t oid;
+    int64_t offset;
+
+    oid = bench_ctx.oid_base + unit / bench_ctx.units_per_object;
+    offset = (unit % bench_ctx.units_per_object) *
+        (int64_t)bench_ctx.max_slice_size;
+    fs_set_block_slice(bs_key, oid, offset, slice_size);
+}
+
+static inline int next_slice_size(BenchWorker *worker)
+{
+    if (bench_ctx.min_slice_size == bench_ctx.max_slice_size) {
+        return bench_ctx.max_slice_size;
+    }
+    return bench_ctx.min_slice_size + next_rand(worker) %
+        (bench_ctx.max_slice_size - bench_ctx.min_slice_size + 1);
+}
+
+static int do_operation(BenchWorker *worker, const int op,
+        FSBlockSliceKeyInfo *bs_key, int *bytes)
+{
+    FSAPIOperationContext op_ctx;
+    FSAPIWriteBuffer wbuffer;
+    int inc_alloc;
+    int result;
+
+    *bytes = 0;
+    if (bench_ctx.engine == BENCH_ENGINE_CLIENT) {
+        switch (op) {
+            case BENCH_OP_READ:
+                result = fs_client_slice_read(&g_fs_client_vars.
+                        client_ctx, bs_key, worker->buff, bytes);
+                break;
+            case BENCH_OP_WRITE:
+                result = fs_client_slice_write(&g_fs_client_vars.
+                        client_ctx, bs_key, worker->buff, bytes,
+                        &inc_alloc);
+                break;
+            case BENCH_OP_ALLOCATE:
+                result = fs_client_slice_allocate(&g_fs_client_vars.
+                        client_ctx, bs_key, &inc_alloc);
+                break;
+            default:
+                result = fs_client_slice_delete(&g_fs_client_vars.
+                        client_ctx, bs_key, &inc_alloc);
+                break;
+        }
+    } else {
+        FS_API_SET_CTX_AND_TID(op_ctx, worker->index + 1);
+        op_ctx.bs_key = *bs_key;
+        switch (op) {
+            case BENCH_OP_READ:
+                result = fs_api_slice_read(&op_ctx, worker->buff, bytes);
+                break;
+            case BENCH_OP_WRITE:
+                wbuffer.buff = worker->buff;
+                wbuffer.extra_data = NULL;
+                result = fs_api_slice_write(&op_ctx, &wbuffer,
+                        bytes, &inc_alloc);
+                break;
+            case BENCH_OP_ALLOCATE:
+                result = fs_api_slice_allocate(&op_ctx, &inc_alloc);
+                break;
+            default:
+                result = fs_api_slice_delete(&op_ctx, &inc_alloc);
+                break;
+        }
+    }
+
+    /* the read of the hole and the delete of the empty slice */
+    if (result == ENODATA || result == ENOENT) {
+        result = 0;
+    }
+    return result;
+}
+
+static void *bench_worker_thread_func(void *arg)
+{
+    BenchWorker *worker;
+    FSBlockSliceKeyInfo bs_key;
+    int64_t start_time_us;
+    int op;
+    int bytes;
+    int result;
+
+    worker = (BenchWorker *)arg;
+    while (bench_ctx.continue_flag) {
+        if (bench_ctx.max_ops > 0 && __sync_add_and_fetch(
+                    &bench_ctx.done_ops, 1) > bench_ctx.max_ops)
+        {
+            break;
+        }
+
+        op = next_op(worker);
+        set_block_slice(worker, next_unit(worker),
+                next_slice_size(worker), &bs_key);
+        start_time_us = get_current_time_us();
+        result = do_operation(worker, op, &bs_key, &bytes);
+        stat_add(worker->stats + op, result, bytes,
+                get_current_time_us() - start_time_us);
+    }
+
+    __sync_sub_and_fetch(&bench_ctx.running_count, 1);
+    return NULL;
+}
+
+static int prefill_objects()
+{
+    BenchWorker *worker;
+    FSBlockSliceKeyInfo bs_key;
+    int64_t unit;
+    int bytes;
+    int inc_alloc;
+    int result;
+
+    worker = bench_ctx.workers;
+    for (unit=0; unit<bench_ctx.unit_count; unit++) {
+        set_block_slice(worker, unit, bench_ctx.max_slice_size, &bs_key);
+        if ((result=fs_client_slice_write(&g_fs_client_vars.client_ctx,
+                        &bs_key, worker->buff, &bytes, &inc_alloc)) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "prefill oid: %"PRId64", block offset: %"PRId64" "
+                    "fail, errno: %d, error info: %s", __LINE__,
+                    bs_key.block.oid, bs_key.block.offset,
+                    result, STRERROR(result));
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int64_t get_percentile(const BenchOpStat *stat, const double percent)
+{
+    int64_t target;
+    int64_t sum;
+    int i;
+
+    if (stat->count == 0) {
+        return 0;
+    }
+
+    target = (int64_t)ceil(stat->count * percent / 100.0);
+    sum = 0;
+    for (i=0; i<LATENCY_BUCKET_COUNT; i++) {
+        sum += stat->buckets[i];
+        if (sum >= target) {
+            return FC_MIN(latency_value(i), stat->max_us);
+        }
+    }
+    return stat->max_us;
+}
+
+static void merge_stats(BenchOpStat *stats)
+{
+    BenchWorker *worker;
+    BenchWorker *end;
+    BenchOpStat *dest;
+    BenchOpStat *src;
+    int op;
+    int i;
+
+    memset(stats, 0, sizeof(BenchOpStat) * BENCH_OP_COUNT);
+    end = bench_ctx.workers + bench_ctx.worker_count;
+    for (worker=bench_ctx.workers; worker<end; worker++) {
+        for (op=0; op<BENCH_OP_COUNT; op++) {
+            dest = stats + op;
+            src = worker->stats + op;
+            dest->count += src->count;
+            dest->errors += src->errors;
+            dest->bytes += src->bytes;
+            dest->total_us += src->total_us;
+            if (src->max_us > dest->max_us) {
+                dest->max_us = src->max_us;
+            }
+            for (i=0; i<LATENCY_BUCKET_COUNT; i++) {
+                dest->buckets[i] += src->buckets[i];
+            }
+        }
+    }
+}
+
+static void output_result()
+{
+    BenchOpStat stats[BENCH_OP_COUNT];
+    BenchOpStat *stat;
+    double seconds;
+    int op;
+    bool first;
+
+    merge_stats(stats);
+    seconds = (bench_ctx.end_time_us - bench_ctx.start_time_us) / 1000000.0;
+    if (seconds <= 0.0) {
+        seconds = 0.000001;
+    }
+
+    if (bench_ctx.text_output) {
+        printf("engine: %s, pattern: %c, workers: %d, elapsed: %.3f s\n",
+                bench_ctx.engine == BENCH_ENGINE_API ? "api" : "client",
+                bench_ctx.pattern, bench_ctx.worker_count, seconds);
+        for (op=0; op<BENCH_OP_COUNT; op++) {
+            stat = stats + op;
+            if (stat->count == 0) {
+                continue;
+            }
+            printf("%-8s ops: %"PRId64", errors: %"PRId64", IOPS: %.1f, "
+                    "throughput: %.2f MB/s, avg: %"PRId64" us, "
+                    "p50: %"PRId64" us, p99: %"PRId64" us, "
+                    "p99.9: %"PRId64" us, max: %"PRId64" us\n",
+                    op_captions[op], stat->count, stat->errors,
+                    stat->count / seconds, stat->bytes / seconds /
+                    (1024 * 1024), stat->total_us / stat->count,
+                    get_percentile(stat, 50.0), get_percentile(stat, 99.0),
+                    get_percentile(stat, 99.9), stat->max_us);
+        }
+        return;
+    }
+
+    printf("{\"engine\": \"%s\", \"pattern\": \"%s\", \"threads\": %d, "
+            "\"iodepth\": %d, \"min_slice_size\": %d, "
+            "\"max_slice_size\": %d, \"object_count\": %"PRId64", "
+            "\"object_size\": %"PRId64", \"elapsed_seconds\": %.3f, "
+            "\"operations\": {",
+            bench_ctx.engine == BENCH_ENGINE_API ? "api" : "client",
+            bench_ctx.pattern == BENCH_PATTERN_SEQUENTIAL ? "sequential" :
+            (bench_ctx.pattern == BENCH_PATTERN_ZIPFIAN ? "zipfian" :
+             "random"), bench_ctx.threads, bench_ctx.iodepth,
+            bench_ctx.min_slice_size, bench_ctx.max_slice_size,
+            bench_ctx.object_count, bench_ctx.object_size, seconds);
+
+    first = true;
+    for (op=0; op<BENCH_OP_COUNT; op++) {
+        stat = stats + op;
+        if (stat->count == 0) {
+            continue;
+        }
+
+        printf("%s\"%s\": {\"ops\": %"PRId64", \"errors\": %"PRId64", "
+                "\"iops\": %.1f, \"bytes_per_second\": %.0f, "
+                "\"latency_us\": {\"avg\": %"PRId64", \"p50\": %"PRId64", "
+                "\"p99\": %"PRId64", \"p99.9\": %"PRId64", "
+                "\"max\": %"PRId64"}}", first ? "" : ", ",
+                op_captions[op], stat->count, stat->errors,
+                stat->count / seconds, stat->bytes / seconds,
+                stat->total_us / stat->count, get_percentile(stat, 50.0),
+                get_percentile(stat, 99.0), get_percentile(stat, 99.9),
+                stat->max_us);
+        first = false;
+    }
+    printf("}}\n");
+}
+
+static int parse_mix(const char *str)
+{
+    char buff[256];
+    char *parts[BENCH_OP_COUNT];
+    char *value;
+    int count;
+    int total;
+    int op;
+    int i;
+
+    memset(bench_ctx.mix, 0, sizeof(bench_ctx.mix));
+    snprintf(buff, sizeof(buff), "%s", str);
+    count = splitEx(buff, ',', parts, BENCH_OP_COUNT);
+    for (i=0; i<count; i++) {
+        if ((value=strchr(parts[i], ':')) == NULL) {
+            fprintf(stderr, "invalid mix item: %s\n", parts[i]);
+            return EINVAL;
+        }
+        *value++ = '\0';
+
+        for (op=0; op<BENCH_OP_COUNT; op++) {
+            if (strcmp(fc_trim(parts[i]), op_captions[op]) == 0) {
+                break;
+            }
+        }
+        if (op == BENCH_OP_COUNT) {
+            fprintf(stderr, "unknown operation: %s\n", parts[i]);
+            return EINVAL;
+        }
+        bench_ctx.mix[op] = atoi(value);
+    }
+
+    total = 0;
+    for (op=0; op<BENCH_OP_COUNT; op++) {
+        if (bench_ctx.mix[op] < 0) {
+            fprintf(stderr, "invalid percentage of %s: %d\n",
+                    op_captions[op], bench_ctx.mix[op]);
+            return EINVAL;
+        }
+        total += bench_ctx.mix[op];
+    }
+    if (total != 100) {
+        fprintf(stderr, "the sum of the mix: %d != 100\n", total);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int parse_slice_size(const char *str)
+{
+    char buff[64];
+    char *max_str;
+    int64_t min_size;
+    int64_t max_size;
+    int result;
+
+    snprintf(buff, sizeof(buff), "%s", str);
+    if ((max_str=strchr(buff, '-')) != NULL) {
+        *max_str++ = '\0';
+    }
+
+    if ((result=parse_bytes(buff, 1, &min_size)) != 0) {
+        return result;
+    }
+    if (max_str != NULL) {
+        if ((result=parse_bytes(max_str, 1, &max_size)) != 0) {
+            return result;
+        }
+    } else {
+        max_size = min_size;
+    }
+
+    if (min_size <= 0 || max_size < min_size ||
+            max_size > FS_FILE_BLOCK_SIZE)
+    {
+        fprintf(stderr, "invalid slice size: %s\n", str);
+        return EINVAL;
+    }
+
+    bench_ctx.min_slice_size = min_size;
+    bench_ctx.max_slice_size = max_size;
+    return 0;
+}
+
+static void write_done_callback(FSAPIWriteDoneCallbackArg *callback_arg)
+{
+}
+
+static int init_api()
+{
+    IniContext ini_context;
+    IniFullContext ini_ctx;
+    int result;
+
+    if ((result=iniLoadFromFile(bench_ctx.config_filename,
+                    &ini_context)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "load conf file \"%s\" fail, ret code: %d",
+                __LINE__, bench_ctx.config_filename, result);
+        return result;
+    }
+
+    g_fs_api_ctx.fs = &g_fs_client_vars.client_ctx;
+    FAST_INI_SET_FULL_CTX_EX(ini_ctx, bench_ctx.config_filename,
+            NULL, &ini_context);
+    result = fs_api_init_ex(&g_fs_api_ctx, &ini_ctx,
+            write_done_callback, 0);
+    iniFreeContext(&ini_context);
+    if (result != 0) {
+        return result;
+    }
+
+    return fs_api_start_ex(&g_fs_api_ctx);
+}
+
+static int init_workers()
+{
+    BenchWorker *worker;
+    BenchWorker *end;
+    int bytes;
+    int64_t seed;
+
+    bytes = sizeof(BenchWorker) * bench_ctx.worker_count;
+    bench_ctx.workers = (BenchWorker *)fc_malloc(bytes);
+    if (bench_ctx.workers == NULL) {
+        return ENOMEM;
+    }
+    memset(bench_ctx.workers, 0, bytes);
+
+    seed = get_current_time_us();
+    end = bench_ctx.workers + bench_ctx.worker_count;
+    for (worker=bench_ctx.workers; worker<end; worker++) {
+        worker->index = worker - bench_ctx.workers;
+        worker->rand_state = (seed + worker->index) *
+            0x9E3779B97F4A7C15ULL | 1;
+        worker->cursor = bench_ctx.unit_count * worker->index /
+            bench_ctx.worker_count;
+        if ((worker->buff=(char *)fc_malloc(bench_ctx.
+                        max_slice_size)) == NULL)
+        {
+            return ENOMEM;
+        }
+        memset(worker->buff, 'a' + worker->index % 26,
+                bench_ctx.max_slice_size);
+    }
+
+    return 0;
+}
+
+static int run_workers()
+{
+    BenchWorker *worker;
+    BenchWorker *end;
+    pthread_t tid;
+    int64_t deadline_us;
+    int result;
+
+    bench_ctx.continue_flag = true;
+    bench_ctx.start_time_us = get_current_time_us();
+    end = bench_ctx.workers + bench_ctx.worker_count;
+    for (worker=bench_ctx.workers; worker<end; worker++) {
+        __sync_add_and_fetch(&bench_ctx.running_count, 1);
+        if ((result=fc_create_thread(&tid, bench_worker_thread_func,
+                        worker, 256 * 1024)) != 0)
+        {
+            __sync_sub_and_fetch(&bench_ctx.running_count, 1);
+            bench_ctx.continue_flag = false;
+            break;
+        }
+    }
+
+    deadline_us = bench_ctx.start_time_us +
+        (int64_t)bench_ctx.duration * 1000000;
+    while (__sync_add_and_fetch(&bench_ctx.running_count, 0) > 0) {
+        if (bench_ctx.continue_flag && get_current_time_us() >= deadline_us) {
+            bench_ctx.continue_flag = false;
+        }
+        fc_sleep_ms(10);
+    }
+    bench_ctx.end_time_us = get_current_time_us();
+
+    if (bench_ctx.engine == BENCH_ENGINE_API) {
+        fs_api_terminate_ex(&g_fs_api_ctx);
+    }
+    return worker == end ? 0 : EBUSY;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool publish = false;
+    string_t poolname;
+    char *ns;
+    int ch;
+    int result;
+
+    bench_ctx.config_filename = FS_CLIENT_DEFAULT_CONFIG_FILENAME;
+    bench_ctx.engine = BENCH_ENGINE_CLIENT;
+    bench_ctx.pattern = BENCH_PATTERN_RANDOM;
+    bench_ctx.threads = 4;
+    bench_ctx.iodepth = 1;
+    bench_ctx.duration = 60;
+    bench_ctx.mix[BENCH_OP_READ] = 70;
+    bench_ctx.mix[BENCH_OP_WRITE] = 30;
+    bench_ctx.min_slice_size = bench_ctx.max_slice_size = 4 * 1024;
+    bench_ctx.zipf.theta = 0.99;
+    bench_ctx.object_count = 1024;
+    bench_ctx.object_size = 64 * 1024 * 1024;
+    bench_ctx.oid_base = 1000000000;
+    ns = "fs";
+
+    while ((ch=getopt(argc, argv, "hc:e:t:q:m:s:p:z:o:S:i:d:N:PTn:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'c':
+                bench_ctx.config_filename = optarg;
+                break;
+            case 'e':
+                if (strcmp(optarg, "client") == 0) {
+                    bench_ctx.engine = BENCH_ENGINE_CLIENT;
+                } else if (strcmp(optarg, "api") == 0) {
+                    bench_ctx.engine = BENCH_ENGINE_API;
+                } else {
+                    fprintf(stderr, "invalid engine: %s\n", optarg);
+                    return EINVAL;
+                }
+                break;
+            case 't':
+                bench_ctx.threads = strtol(optarg, NULL, 10);
+                break;
+            case 'q':
+                bench_ctx.iodepth = strtol(optarg, NULL, 10);
+                break;
+            case 'm':
+                if ((result=parse_mix(optarg)) != 0) {
+                    return result;
+                }
+                break;
+            case 's':
+                if ((result=parse_slice_size(optarg)) != 0) {
+                    return result;
+                }
+                break;
+            case 'p':
+                if (strcmp(optarg, "sequential") == 0) {
+                    bench_ctx.pattern = BENCH_PATTERN_SEQUENTIAL;
+                } else if (strcmp(optarg, "random") == 0) {
+                    bench_ctx.pattern = BENCH_PATTERN_RANDOM;
+                } else if (strcmp(optarg, "zipfian") == 0) {
+                    bench_ctx.pattern = BENCH_PATTERN_ZIPFIAN;
+                } else {
+                    fprintf(stderr, "invalid pattern: %s\n", optarg);
+                    return EINVAL;
+                }
+                break;
+            case 'z':
+                bench_ctx.zipf.theta = strtod(optarg, NULL);
+                break;
+            case 'o':
+                bench_ctx.object_count = strtoll(optarg, NULL, 10);
+                break;
+            case 'S':
+                if ((result=parse_bytes(optarg, 1, &bench_ctx.
+                                object_size)) != 0)
+                {
+                    return result;
+                }
+                break;
+            case 'i':
+                bench_ctx.oid_base = strtoll(optarg, NULL, 10);
+                break;
+            case 'd':
+                bench_ctx.duration = strtol(optarg, NULL, 10);
+                break;
+            case 'N':
+                bench_ctx.max_ops = strtoll(optarg, NULL, 10);
+                break;
+            case 'P':
+                bench_ctx.prefill = true;
+                break;
+            case 'T':
+                bench_ctx.text_output = true;
+                break;
+            case 'n':
+                ns = optarg;
+                break;
+            default:
+                usage(argv);
+                return EINVAL;
+        }
+    }
+
+    if (bench_ctx.threads <= 0 || bench_ctx.iodepth <= 0 ||
+            bench_ctx.duration <= 0 || bench_ctx.object_count <= 0 ||
+            bench_ctx.oid_base <= 0 || bench_ctx.object_size <
+            bench_ctx.max_slice_size)
+    {
+        fprintf(stderr, "invalid parameters\n");
+        usage(argv);
+        return EINVAL;
+    }
+    if (bench_ctx.pattern == BENCH_PATTERN_ZIPFIAN &&
+            (bench_ctx.zipf.theta <= 0.0 || bench_ctx.zipf.theta >= 1.0))
+    {
+        fprintf(stderr, "invalid zipfian theta: %.3f, "
+                "expect (0, 1)\n", bench_ctx.zipf.theta);
+        return EINVAL;
+    }
+
+    log_init();
+    bench_ctx.worker_count = bench_ctx.threads * bench_ctx.iodepth;
+    bench_ctx.units_per_object = bench_ctx.object_size /
+        bench_ctx.max_slice_size;
+    bench_ctx.unit_count = bench_ctx.object_count *
+        bench_ctx.units_per_object;
+    if (bench_ctx.pattern == BENCH_PATTERN_ZIPFIAN) {
+        zipf_init();
+    }
+
+    FC_SET_STRING(poolname, ns);
+    if ((result=fs_client_init_with_auth_ex1(&g_fs_client_vars.client_ctx,
+                    &g_fcfs_auth_client_vars.client_ctx, bench_ctx.
+                    config_filename, NULL, NULL, false, &poolname,
+                    publish)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=init_workers()) != 0) {
+        return result;
+    }
+
+    if (bench_ctx.prefill && (result=prefill_objects()) != 0) {
+        return result;
+    }
+
+    if (bench_ctx.engine == BENCH_ENGINE_API && (result=init_api()) != 0) {
+        return result;
+    }
+
+    result = run_workers();
+    output_result();
+    return result;
+}
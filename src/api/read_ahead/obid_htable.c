@@ -44,6 +44,9 @@ typedef struct fs_preread_obid_context {
 
 static FSPrereadOBIDContext obid_ctx;
 
+//the shared buffers of the other threads to check for one read
+#define FS_PREREAD_MAX_SHARED_BUFFERS  16
+
 #define OBID_SET_HASHTABLE_KEY(op_ctx, key) \
     SFTwoIdsHashKey key;   \
     key.oid = op_ctx->bs_key.block.oid;  \
@@ -125,13 +128,13 @@ static inline int obid_htable_find_block(const SFTwoIdsHashKey *key,
 }
 
 static inline int obid_htable_find_slice(const SFTwoIdsHashKey *key,
-        const uint64_t tid, FSPrereadBlockHEntry *block,
+        const uint64_t tid, const int stream, FSPrereadBlockHEntry *block,
         FSPrereadSlicePair *slice)
 {
     slice->previous = NULL;
     slice->current = block->slices.head;
     while (slice->current != NULL) {
-        if (tid == slice->current->tid) {
+        if (tid == slice->current->tid && stream == slice->current->stream) {
             return 0;
         }
 
@@ -143,14 +146,14 @@ static inline int obid_htable_find_slice(const SFTwoIdsHashKey *key,
 }
 
 static inline int obid_htable_find_block_and_slice(const SFTwoIdsHashKey
-        *key, const uint64_t tid, FSPrereadBlockPair *block,
-        FSPrereadSlicePair *slice)
+        *key, const uint64_t tid, const int stream,
+        FSPrereadBlockPair *block, FSPrereadSlicePair *slice)
 {
     if (obid_htable_find_block(key, block) != 0) {
         return ENOENT;
     }
 
-    return obid_htable_find_slice(key, tid, block->current, slice);
+    return obid_htable_find_slice(key, tid, stream, block->current, slice);
 }
 
 static inline void check_remove_block(FSPrereadBlockHEntry **bucket,
@@ -251,7 +254,7 @@ static inline void obid_htable_free_slice_and_block(FSPrereadBlockHEntry
 }
 
 int preread_obid_htable_insert(FSAPIOperationContext *op_ctx,
-        const FSSliceSize *ssize, FSAPIBuffer *buffer)
+        const int stream, const FSSliceSize *ssize, FSAPIBuffer *buffer)
 {
     int result;
     bool found;
@@ -269,6 +272,7 @@ int preread_obid_htable_insert(FSAPIOperationContext *op_ctx,
         return ENOMEM;
     }
     se->tid = op_ctx->tid;
+    se->stream = stream;
     se->ssize = *ssize;
     se->buffer = buffer;
 
@@ -281,7 +285,7 @@ int preread_obid_htable_insert(FSAPIOperationContext *op_ctx,
             if (obid_htable_find_block(&key, &block) == 0) {
                 be = block.current;
                 if (obid_htable_find_slice(&key, op_ctx->tid,
-                            block.current, &slice) == 0)
+                            stream, block.current, &slice) == 0)
                 {
                     found = true;
                     obid_htable_remove(bucket, &block,
@@ -325,9 +329,10 @@ int preread_obid_htable_insert(FSAPIOperationContext *op_ctx,
 
     if (found) {
         logWarning("file: "__FILE__", line: %d, "
-                "slice tid: %"PRId64" block {oid: %"PRId64", "
+                "slice tid: %"PRId64", stream: %d, block {oid: %"PRId64", "
                 "bid: %"PRId64"}, slice {offset: %d, length: %d} "
                 "duplicate!", __LINE__, slice.current->tid,
+                slice.current->stream,
                 block.current->key.oid, block.current->key.bid,
                 slice.current->ssize.offset, slice.current->ssize.length);
 
@@ -338,8 +343,8 @@ int preread_obid_htable_insert(FSAPIOperationContext *op_ctx,
     return result;
 }
 
-int preread_obid_htable_delete(const int64_t oid,
-        const int64_t bid, const int64_t tid)
+int preread_obid_htable_delete(const int64_t oid, const int64_t bid,
+        const int64_t tid, const int stream)
 {
     int result;
     bool release_block;
@@ -356,7 +361,7 @@ int preread_obid_htable_delete(const int64_t oid,
         if (*bucket != NULL) {
             block.current = *bucket;
             if ((result=obid_htable_find_block_and_slice(&key,
-                            tid, &block, &slice)) == 0)
+                            tid, stream, &block, &slice)) == 0)
             {
                 obid_htable_remove(bucket, &block,
                         &slice, &release_block);
@@ -425,3 +430,63 @@ int preread_invalidate_conflict_slices(FSAPIOperationContext *op_ctx)
 
     return count;
 }
+
+int preread_obid_htable_read(FSAPIOperationContext *op_ctx,
+        char *buff, int *read_bytes)
+{
+    int result;
+    int count;
+    int i;
+    FSPrereadBlockPair block;
+    FSPrereadSliceEntry *slice;
+    FSAPIBuffer *buffers[FS_PREREAD_MAX_SHARED_BUFFERS];
+    FSAPIBuffer *buffer;
+    const FSSliceSize *ssize;
+    OBID_SET_HASHTABLE_KEY(op_ctx, key);
+
+    /* hold the buffers under the bucket lock, and check them under their
+     * own lock which the preread handler updates the buffer with */
+    ssize = &op_ctx->bs_key.slice;
+    count = 0;
+    do {
+        OBID_SET_BUCKET_AND_LOCK(key);
+
+        PTHREAD_MUTEX_LOCK(lock);
+        if (*bucket != NULL) {
+            block.current = *bucket;
+            if (obid_htable_find_block(&key, &block) == 0) {
+                for (slice=block.current->slices.head; slice!=NULL &&
+                        count<FS_PREREAD_MAX_SHARED_BUFFERS;
+                        slice=slice->next)
+                {
+                    if (fs_slice_is_overlap(ssize, &slice->ssize)) {
+                        fs_api_buffer_hold(slice->buffer);
+                        buffers[count++] = slice->buffer;
+                    }
+                }
+            }
+        }
+        PTHREAD_MUTEX_UNLOCK(lock);
+    } while (0);
+
+    result = ENOENT;
+    for (i=0; i<count; i++) {
+        buffer = buffers[i];
+        if (result != 0) {
+            PTHREAD_MUTEX_LOCK(buffer->lock);
+            if (!buffer->deleted && PREREAD_IS_BUFFER_VALID(
+                        op_ctx->api_ctx, buffer) &&
+                    PREREAD_BUFFER_COVER_SLICE(buffer, ssize))
+            {
+                memcpy(buff, buffer->buff + (ssize->offset -
+                            buffer->start), ssize->length);
+                *read_bytes = ssize->length;
+                result = 0;
+            }
+            PTHREAD_MUTEX_UNLOCK(buffer->lock);
+        }
+        fs_api_buffer_release(buffer);
+    }
+
+    return result;
+}
@@ -18,6 +18,16 @@
 #define _READ_AHEAD_OBID_HTABLE_H
 
 #include "../fs_api_types.h"
+#include "../fs_api_buffer_pool.h"
+#include "../write_combine/timeout_handler.h"
+
+#define PREREAD_IS_BUFFER_VALID(api_ctx, buffer)  \
+    (!buffer->dirty && !buffer->conflict && g_timer_ms_ctx.current_time_ms - \
+     buffer->create_time_ms <= api_ctx->read_ahead.cache_ttl_ms)
+
+#define PREREAD_BUFFER_COVER_SLICE(buffer, ssize)  \
+    ((buffer)->start <= (ssize)->offset && (ssize)->offset + \
+     (ssize)->length <= (buffer)->start + (buffer)->length)
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,14 +36,19 @@ extern "C" {
     int preread_obid_htable_init(const int64_t htable_capacity,
             const int shared_lock_count);
 
+    /* the slice entry is keyed by the pair (tid, stream) in the block */
     int preread_obid_htable_insert(FSAPIOperationContext *op_ctx,
-            const FSSliceSize *ssize, FSAPIBuffer *buffer);
+            const int stream, const FSSliceSize *ssize, FSAPIBuffer *buffer);
 
-    int preread_obid_htable_delete(const int64_t oid,
-            const int64_t bid, const int64_t tid);
+    int preread_obid_htable_delete(const int64_t oid, const int64_t bid,
+            const int64_t tid, const int stream);
 
     int preread_invalidate_conflict_slices(FSAPIOperationContext *op_ctx);
 
+    /* read from the read ahead buffers of any thread (shared buffer) */
+    int preread_obid_htable_read(FSAPIOperationContext *op_ctx,
+            char *buff, int *read_bytes);
+
 #ifdef __cplusplus
 }
 #endif
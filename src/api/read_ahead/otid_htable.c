@@ -19,90 +19,269 @@
 #include "../write_combine/obid_htable.h"
 #include "../write_combine/timeout_handler.h"
 #include "obid_htable.h"
+#include "preread_handler.h"
 #include "otid_htable.h"
 
-typedef struct fs_preread_otid_entry {
-    SFShardingHashEntry hentry;  //must be the first
+/* the interleaved streams per file and thread, such as
+ * forward, backward and strided sequential reading */
+#define FS_PREREAD_MAX_STREAMS   4
+#define FS_PREREAD_MAX_STRIDE    FS_FILE_BLOCK_SIZE
+
+typedef struct fs_preread_stream {
+    int64_t last_offset;  //the file offset of the last read
+    int64_t access_time_ms;
+    int last_length;
+    int stride;           //the offset distance of the successive reads
     int successive_count;
-    int64_t last_read_offset;
+    int window_size;      //adaptive by the hits of read ahead buffer
+    int buffer_hits;
     FSAPIBuffer *buffer;
+} FSPrereadStream;
+
+typedef struct fs_preread_otid_entry {
+    SFShardingHashEntry hentry;  //must be the first
+    FSPrereadStream streams[FS_PREREAD_MAX_STREAMS];
 } FSPrereadOTIDEntry;
 
 typedef struct fs_api_insert_buffer_context {
     FSAPIOperationContext *op_ctx;
-    FSAPIBuffer *buffer;
     char *out_buff;
     int *read_bytes;
-    int ahead_bytes;
+    FSPrereadTask *task;
 } FSAPIInsertBufferContext;
 
 static SFHtableShardingContext otid_ctx;
 
-#define IS_BUFFER_VALID(api_ctx, buffer)  \
-    (!buffer->dirty && !buffer->conflict && g_timer_ms_ctx.current_time_ms - \
-     buffer->create_time_ms <= api_ctx->read_ahead.cache_ttl_ms)
-
-static void release_entry_buffer(FSPrereadOTIDEntry *entry)
+static void release_stream_buffer(FSPrereadOTIDEntry *entry,
+        FSPrereadStream *stream)
 {
-    entry->buffer->deleted = true;
-    if (!entry->buffer->conflict) {
+    FSAPIContext *api_ctx;
+
+    api_ctx = g_fs_api_allocator_array.api_ctx;
+    if (stream->buffer_hits > 0) {
+        if (stream->window_size < api_ctx->read_ahead.max_buffer_size) {
+            stream->window_size *= 2;
+        }
+    } else if (stream->window_size > api_ctx->read_ahead.min_buffer_size) {
+        stream->window_size /= 2;  //the read ahead buffer is wasted
+    }
+
+    stream->buffer->deleted = true;
+    if (!stream->buffer->conflict) {
         preread_obid_htable_delete(entry->hentry.key.oid,
-                entry->buffer->bid, entry->hentry.key.tid);
+                stream->buffer->bid, entry->hentry.key.tid,
+                stream - entry->streams);
     }
-    fs_api_buffer_release(entry->buffer);
-    entry->buffer = NULL;
+    fs_api_buffer_release(stream->buffer);
+    stream->buffer = NULL;
+    stream->buffer_hits = 0;
 }
 
-static void process_on_successive(FSAPIInsertBufferContext *ictx,
-        FSPrereadOTIDEntry *entry, bool *release_buffer)
+static inline void reset_stream(FSPrereadOTIDEntry *entry,
+        FSPrereadStream *stream, const int min_buffer_size)
 {
-    int bytes;
-    int block_remain;
-    int max_size;
-    int i;
+    if (stream->buffer != NULL) {
+        release_stream_buffer(entry, stream);
+    }
+    stream->stride = 0;
+    stream->successive_count = 0;
+    stream->window_size = min_buffer_size;
+}
 
-    if (entry->buffer != NULL && IS_BUFFER_VALID(ictx->op_ctx->api_ctx,
-                entry->buffer) && (ictx->op_ctx->bs_key.slice.length <=
-                    (entry->buffer->length - entry->buffer->offset)))
-    {
-        *(ictx->read_bytes) = ictx->op_ctx->bs_key.slice.length;
-        memcpy(ictx->out_buff, entry->buffer->buff +
-                entry->buffer->offset, *(ictx->read_bytes));
-        entry->buffer->offset += *(ictx->read_bytes);
-        *release_buffer = (entry->buffer->length -
-                entry->buffer->offset == 0);
-    } else {
-        *release_buffer = (entry->buffer != NULL);
-        if (ictx->op_ctx->bs_key.slice.length < ictx->op_ctx->
-                api_ctx->read_ahead.skip_preread_on_slice_size &&
-                FS_FILE_BLOCK_SIZE - ictx->op_ctx->bs_key.slice.offset > 0)
+static FSPrereadStream *match_stream(FSPrereadOTIDEntry *entry,
+        const int64_t offset, bool *reset)
+{
+    FSPrereadStream *stream;
+    FSPrereadStream *end;
+    FSPrereadStream *candidate;
+    FSPrereadStream *lru;
+    int64_t distance;
+    int64_t min_distance;
+
+    *reset = false;
+    end = entry->streams + FS_PREREAD_MAX_STREAMS;
+    for (stream=entry->streams; stream<end; stream++) {
+        if (stream->successive_count > 0 && offset ==
+                stream->last_offset + stream->stride)
         {
-            block_remain = FS_FILE_BLOCK_SIZE -
-                ictx->op_ctx->bs_key.slice.offset;
-            max_size = FC_MIN(block_remain, ictx->op_ctx->
-                    api_ctx->read_ahead.max_buffer_size);
-            if (entry->buffer != NULL) {
-                bytes = entry->buffer->allocator->buffer_size * 2;
-            } else {
-                bytes = 512;
-                while (bytes < ictx->op_ctx->bs_key.slice.length) {
-                    bytes *= 2;
-                }
-
-                i = 0;
-                while (i++ < entry->successive_count && bytes < max_size) {
-                    bytes *= 2;
-                }
-
-                if (bytes < ictx->op_ctx->api_ctx->read_ahead.min_buffer_size) {
-                    bytes = ictx->op_ctx->api_ctx->read_ahead.min_buffer_size;
-                }
+            stream->successive_count++;
+            return stream;
+        }
+    }
+
+    /* the second read of the stream determines the stride */
+    candidate = NULL;
+    min_distance = FS_PREREAD_MAX_STRIDE + 1;
+    lru = entry->streams;
+    for (stream=entry->streams; stream<end; stream++) {
+        if (stream->access_time_ms < lru->access_time_ms) {
+            lru = stream;
+        }
+        if (stream->access_time_ms == 0 || stream->successive_count > 0) {
+            continue;
+        }
+
+        distance = offset - stream->last_offset;
+        if (distance < 0) {
+            distance = -1 * distance;
+        }
+        if (distance > 0 && distance < min_distance) {
+            min_distance = distance;
+            candidate = stream;
+        }
+    }
+
+    if (candidate != NULL) {
+        candidate->stride = offset - candidate->last_offset;
+        candidate->successive_count = 1;
+        return candidate;
+    }
+
+    *reset = true;
+    return lru;
+}
+
+static bool copy_from_buffers(FSAPIInsertBufferContext *ictx,
+        FSPrereadOTIDEntry *entry, FSPrereadStream *matched)
+{
+    FSPrereadStream *stream;
+    FSAPIBuffer *buffer;
+    const FSSliceSize *ssize;
+    int i;
+
+    ssize = &ictx->op_ctx->bs_key.slice;
+    for (i=0; i<=FS_PREREAD_MAX_STREAMS; i++) {
+        if (i == 0) {
+            stream = matched;
+        } else {
+            stream = entry->streams + (i - 1);
+            if (stream == matched) {
+                continue;
             }
+        }
 
-            ictx->ahead_bytes = FC_MIN(bytes, max_size) -
-                ictx->op_ctx->bs_key.slice.length;
+        if ((buffer=stream->buffer) == NULL) {
+            continue;
         }
+        if (buffer->bid == ictx->op_ctx->bid &&
+                PREREAD_IS_BUFFER_VALID(ictx->op_ctx->api_ctx, buffer) &&
+                PREREAD_BUFFER_COVER_SLICE(buffer, ssize))
+        {
+            memcpy(ictx->out_buff, buffer->buff + (ssize->offset -
+                        buffer->start), ssize->length);
+            *(ictx->read_bytes) = ssize->length;
+            stream->buffer_hits++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static inline bool buffer_in_flight_or_valid(FSAPIContext *api_ctx,
+        FSAPIBuffer *buffer, const int64_t bid, const FSSliceSize *ssize)
+{
+    if (buffer->bid != bid || buffer->conflict ||
+            !PREREAD_BUFFER_COVER_SLICE(buffer, ssize))
+    {
+        return false;
+    }
+
+    return buffer->dirty || PREREAD_IS_BUFFER_VALID(api_ctx, buffer);
+}
+
+/* calculate the range to read ahead by the stream pattern */
+static bool calc_ahead_range(FSAPIOperationContext *op_ctx,
+        FSPrereadStream *stream, int64_t *bid, FSSliceSize *range,
+        FSSliceSize *next)
+{
+    int64_t next_offset;
+    int64_t start;
+    int size;
+
+    next_offset = stream->last_offset + stream->stride;
+    if (next_offset < 0) {
+        return false;
+    }
+
+    size = FC_MAX(stream->last_length, stream->window_size);
+    if (size > op_ctx->api_ctx->read_ahead.max_buffer_size) {
+        size = op_ctx->api_ctx->read_ahead.max_buffer_size;
+    }
+    if (stream->stride > 0) {
+        start = next_offset;
+    } else {
+        start = next_offset + stream->last_length - size;
+    }
+
+    *bid = next_offset - next_offset % FS_FILE_BLOCK_SIZE;
+    if (start < *bid) {
+        size -= *bid - start;
+        start = *bid;
+    }
+    if (start + size > *bid + FS_FILE_BLOCK_SIZE) {
+        size = *bid + FS_FILE_BLOCK_SIZE - start;
+    }
+
+    next->offset = next_offset - *bid;
+    next->length = stream->last_length;
+    range->offset = start - *bid;
+    range->length = size;
+    return (range->length > 0 && range->offset <= next->offset &&
+            next->offset + next->length <= range->offset + range->length);
+}
+
+static int create_ahead_task(FSAPIInsertBufferContext *ictx,
+        FSPrereadOTIDEntry *entry, FSPrereadStream *stream,
+        const int64_t bid, const FSSliceSize *range)
+{
+    FSAPIOperationContext *op_ctx;
+    FSPrereadTask *task;
+    FSAPIBuffer *buffer;
+
+    op_ctx = ictx->op_ctx;
+    if ((task=(FSPrereadTask *)fast_mblock_alloc_object(
+                    &op_ctx->allocator_ctx->read_ahead.task)) == NULL)
+    {
+        return ENOMEM;
+    }
+
+    //refered by the stream, obid htable and the task
+    if ((buffer=fs_api_buffer_alloc(&op_ctx->allocator_ctx->
+                    read_ahead.buffer_pool, range->length, 3)) == NULL)
+    {
+        fast_mblock_free_object(task->allocator, task);
+        return ENOMEM;
     }
+
+    buffer->bid = bid;
+    buffer->start = range->offset;
+    buffer->length = range->length;
+    buffer->create_time_ms = g_timer_ms_ctx.current_time_ms;
+    buffer->deleted = false;
+    buffer->dirty = true;
+    buffer->conflict = false;
+    buffer->lock = &entry->hentry.sharding->lock;
+
+    task->op_ctx = *op_ctx;
+    task->op_ctx.op_type = 'r';
+    task->op_ctx.bid = bid;
+    task->op_ctx.bs_key.block.offset = bid;
+    task->op_ctx.bs_key.slice = *range;
+    task->buffer = buffer;
+
+    /* insert into obid htable before reading for write conflict detection
+     * and sharing the buffer with other threads */
+    if (preread_obid_htable_insert(&task->op_ctx, stream - entry->streams,
+                range, buffer) != 0)
+    {
+        fs_api_buffer_release(buffer);
+    }
+
+    stream->buffer = buffer;
+    stream->buffer_hits = 0;
+    ictx->task = task;
+    return 0;
 }
 
 static int otid_htable_insert_callback(SFShardingHashEntry *he,
@@ -110,74 +289,76 @@ static int otid_htable_insert_callback(SFShardingHashEntry *he,
 {
     FSPrereadOTIDEntry *entry;
     FSAPIInsertBufferContext *ictx;
+    FSAPIContext *api_ctx;
+    FSPrereadStream *stream;
+    FSSliceSize range;
+    FSSliceSize next;
     int64_t offset;
-    bool release_buffer;
+    int64_t bid;
+    bool reset;
 
     entry = (FSPrereadOTIDEntry *)he;
     ictx = (FSAPIInsertBufferContext *)arg;
-    offset = ictx->op_ctx->bs_key.block.offset +
-        ictx->op_ctx->bs_key.slice.offset;
+    api_ctx = ictx->op_ctx->api_ctx;
     if (new_create) {
-        entry->buffer = NULL;
-        entry->successive_count = 0;
-        release_buffer = false;
-    } else {
-        if (offset == entry->last_read_offset) {
-            entry->successive_count++;
-            process_on_successive(ictx, entry, &release_buffer);
-        } else {
-            entry->successive_count = 0;
-            release_buffer = (entry->buffer != NULL);
-        }
+        memset(entry->streams, 0, sizeof(entry->streams));
     }
 
-    /*
-    logInfo("file: "__FILE__", line: %d, "
-            "tid: %"PRId64", block {oid: %"PRId64", offset: %"PRId64"}, "
-            "slice {offset: %d, length: %d}, successive_count: %d, "
-            "ahead_bytes: %d, buffer: %p, release_buffer: %d", __LINE__, ictx->op_ctx->tid,
-            ictx->op_ctx->bs_key.block.oid, ictx->op_ctx->bs_key.block.offset,
-            ictx->op_ctx->bs_key.slice.offset, ictx->op_ctx->bs_key.slice.length,
-            entry->successive_count, ictx->ahead_bytes, entry->buffer, release_buffer);
-            */
+    offset = ictx->op_ctx->bs_key.block.offset +
+        ictx->op_ctx->bs_key.slice.offset;
+    stream = match_stream(entry, offset, &reset);
+    if (reset) {
+        reset_stream(entry, stream, api_ctx->read_ahead.min_buffer_size);
+    }
+    copy_from_buffers(ictx, entry, stream);
 
-    entry->last_read_offset = offset + ictx->op_ctx->bs_key.slice.length;
-    if (release_buffer) {
-        release_entry_buffer(entry);
+    stream->last_offset = offset;
+    stream->last_length = ictx->op_ctx->bs_key.slice.length;
+    stream->access_time_ms = g_timer_ms_ctx.current_time_ms;
+    if (stream->successive_count == 0 || stream->last_length >=
+            api_ctx->read_ahead.skip_preread_on_slice_size)
+    {
+        return 0;
     }
 
-    if (ictx->ahead_bytes > 0) {
-        int read_bytes;
+    if (!calc_ahead_range(ictx->op_ctx, stream, &bid, &range, &next)) {
+        return 0;
+    }
 
-        read_bytes = ictx->op_ctx->bs_key.slice.length +
-            ictx->ahead_bytes;
-        entry->buffer = fs_api_buffer_alloc(&ictx->op_ctx->
-                allocator_ctx->read_ahead.buffer_pool, read_bytes, 2);
-        if (entry->buffer == NULL) {
-            ictx->ahead_bytes = 0;
-            return ENOMEM;
+    if (stream->buffer != NULL) {
+        if (buffer_in_flight_or_valid(api_ctx,
+                    stream->buffer, bid, &next))
+        {
+            return 0;  //already read ahead
         }
-
-        entry->buffer->bid = ictx->op_ctx->bid;
-        entry->buffer->deleted = false;
-        entry->buffer->dirty = true;
-        entry->buffer->conflict = false;
-        entry->buffer->offset = ictx->op_ctx->bs_key.slice.length;
-        entry->buffer->length = read_bytes;
-        entry->buffer->lock = &he->sharding->lock;
-        ictx->buffer = entry->buffer;
+        release_stream_buffer(entry, stream);
     }
 
-    return 0;
+    /*
+    logInfo("file: "__FILE__", line: %d, "
+            "tid: %"PRId64", oid: %"PRId64", offset: %"PRId64", "
+            "stride: %d, successive_count: %d, window_size: %d, "
+            "read ahead {bid: %"PRId64", offset: %d, length: %d}",
+            __LINE__, ictx->op_ctx->tid, ictx->op_ctx->bs_key.block.oid,
+            offset, stream->stride, stream->successive_count,
+            stream->window_size, bid, range.offset, range.length);
+            */
+
+    return create_ahead_task(ictx, entry, stream, bid, &range);
 }
 
 static bool otid_htable_accept_reclaim_callback(SFShardingHashEntry *he)
 {
     FSPrereadOTIDEntry *entry;
+    FSPrereadStream *stream;
+    FSPrereadStream *end;
 
     entry = (FSPrereadOTIDEntry *)he;
-    if (entry->buffer != NULL) {
-        release_entry_buffer(entry);
+    end = entry->streams + FS_PREREAD_MAX_STREAMS;
+    for (stream=entry->streams; stream<end; stream++) {
+        if (stream->buffer != NULL) {
+            release_stream_buffer(entry, stream);
+        }
     }
 
     return true;
@@ -200,11 +381,6 @@ int preread_otid_htable_init(const int sharding_count,
 int preread_slice_read(FSAPIOperationContext *op_ctx,
             char *buff, int *read_bytes)
 {
-    int result;
-    int old_slice_len;
-    int bytes;
-    bool release_buffer;
-    FSSliceSize ssize;
     SFTwoIdsHashKey key;
     FSAPIInsertBufferContext ictx;
 
@@ -214,70 +390,22 @@ int preread_slice_read(FSAPIOperationContext *op_ctx,
     ictx.op_ctx = op_ctx;
     ictx.out_buff = buff;
     ictx.read_bytes = read_bytes;
-    ictx.ahead_bytes = 0;
-    ictx.buffer = NULL;
+    ictx.task = NULL;
 
     sf_sharding_htable_insert(&otid_ctx, &key, &ictx);
-    if (*read_bytes > 0) {  //copy from read-ahead cache
-        /*
-        logInfo("file: "__FILE__", line: %d, "
-                "read from cache, tid: %"PRId64", "
-                "buffer: %p, block {oid: %"PRId64", offset: %"PRId64"}, "
-                "slice {offset: %d, length: %d}", __LINE__, op_ctx->tid,
-                ictx.buffer, op_ctx->bs_key.block.oid,
-                op_ctx->bs_key.block.offset, op_ctx->bs_key.slice.offset,
-                op_ctx->bs_key.slice.length);
-                */
+    if (ictx.task != NULL) {  //read ahead in background
+        preread_handler_push(ictx.task);
+    }
 
+    if (*read_bytes > 0) {  //copy from read-ahead cache
         return 0;
     }
 
-    if (ictx.buffer == NULL) {
-        FS_API_CHECK_CONFLICT_AND_WAIT(op_ctx);
-        return fs_client_slice_read(op_ctx->api_ctx->fs,
-                &op_ctx->bs_key, buff, read_bytes);
+    if (preread_obid_htable_read(op_ctx, buff, read_bytes) == 0) {
+        return 0;  //copy from the buffer of other thread
     }
 
-    old_slice_len = op_ctx->bs_key.slice.length;
-    op_ctx->bs_key.slice.length = ictx.buffer->length;
-
     FS_API_CHECK_CONFLICT_AND_WAIT(op_ctx);
-    result = fs_client_slice_read(op_ctx->api_ctx->fs,
-            &op_ctx->bs_key, ictx.buffer->buff, &bytes);
-    release_buffer = true;
-    if (result == 0) {
-        *read_bytes = FC_MIN(bytes, old_slice_len);
-        memcpy(buff, ictx.buffer->buff, *read_bytes);
-        if (bytes > old_slice_len) {
-            PTHREAD_MUTEX_LOCK(ictx.buffer->lock);
-            if (!ictx.buffer->deleted) {
-                ictx.buffer->dirty = false;
-                ictx.buffer->create_time_ms = g_timer_ms_ctx.current_time_ms;
-                if (bytes < ictx.buffer->length) {
-                    ictx.buffer->length = bytes;
-                }
-
-                ssize.offset = op_ctx->bs_key.slice.offset + old_slice_len;
-                ssize.length = bytes - old_slice_len;
-                if (preread_obid_htable_insert(op_ctx,
-                            &ssize, ictx.buffer) == 0)
-                {
-                    release_buffer = false;
-                }
-            }
-            PTHREAD_MUTEX_UNLOCK(ictx.buffer->lock);
-        }
-    } else {
-        *read_bytes = 0;
-    }
-
-    if (release_buffer) {
-        PTHREAD_MUTEX_LOCK(ictx.buffer->lock);
-        ictx.buffer->conflict = true;
-        PTHREAD_MUTEX_UNLOCK(ictx.buffer->lock);
-
-        fs_api_buffer_release(ictx.buffer);
-    }
-    op_ctx->bs_key.slice.length = old_slice_len;  //restore length
-    return result;
+    return fs_client_slice_read(op_ctx->api_ctx->fs,
+            &op_ctx->bs_key, buff, read_bytes);
 }
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "sf/sf_global.h"
+#include "../fs_api.h"
+#include "../write_combine/obid_htable.h"
+#include "../write_combine/timeout_handler.h"
+#include "preread_handler.h"
+
+PrereadHandlerContext g_preread_handler_ctx = {0};
+
+static inline void release_task(FSPrereadTask *task)
+{
+    fs_api_buffer_release(task->buffer);
+    fast_mblock_free_object(task->allocator, task);
+    __sync_sub_and_fetch(&g_preread_handler_ctx.waiting_task_count, 1);
+}
+
+static void preread_handler_run(void *arg, void *thread_data)
+{
+    FSPrereadTask *task;
+    FSAPIOperationContext *op_ctx;
+    FSAPIBuffer *buffer;
+    int result;
+    int read_bytes;
+
+    task = (FSPrereadTask *)arg;
+    op_ctx = &task->op_ctx;
+    buffer = task->buffer;
+
+    FS_API_CHECK_CONFLICT_AND_WAIT(op_ctx);
+    result = fs_client_slice_read(op_ctx->api_ctx->fs,
+            &op_ctx->bs_key, buffer->buff, &read_bytes);
+
+    PTHREAD_MUTEX_LOCK(buffer->lock);
+    if (result == 0 && read_bytes > 0 && !buffer->deleted &&
+            !buffer->conflict)
+    {
+        if (read_bytes < buffer->length) {
+            buffer->length = read_bytes;
+        }
+        buffer->create_time_ms = g_timer_ms_ctx.current_time_ms;
+        buffer->dirty = false;
+    } else {
+        buffer->conflict = true;
+    }
+    PTHREAD_MUTEX_UNLOCK(buffer->lock);
+
+    release_task(task);
+}
+
+int preread_handler_push(FSPrereadTask *task)
+{
+    int result;
+
+    __sync_add_and_fetch(&g_preread_handler_ctx.waiting_task_count, 1);
+    if ((result=fc_thread_pool_run(&g_preread_handler_ctx.thread_pool,
+                    preread_handler_run, task)) != 0)
+    {
+        PTHREAD_MUTEX_LOCK(task->buffer->lock);
+        task->buffer->conflict = true;
+        PTHREAD_MUTEX_UNLOCK(task->buffer->lock);
+        release_task(task);
+    }
+
+    return result;
+}
+
+void preread_handler_terminate()
+{
+    int i;
+
+    i = 0;
+    while (__sync_add_and_fetch(&g_preread_handler_ctx.
+                waiting_task_count, 0) > 0 && i++ < 1000)
+    {
+        fc_sleep_ms(10);
+    }
+
+    g_preread_handler_ctx.continue_flag = false;
+    logInfo("file: "__FILE__", line: %d, "
+            "preread_handler_terminate, running: %d, "
+            "waiting_task_count: %d", __LINE__,
+            fc_thread_pool_running_count(
+                &g_preread_handler_ctx.thread_pool),
+            __sync_add_and_fetch(&g_preread_handler_ctx.
+                waiting_task_count, 0));
+}
+
+int preread_handler_init(const int thread_limit,
+        const int min_idle_count, const int max_idle_time)
+{
+    g_preread_handler_ctx.continue_flag = true;
+    return fc_thread_pool_init(&g_preread_handler_ctx.thread_pool,
+            "read-ahead", thread_limit, SF_G_THREAD_STACK_SIZE,
+            max_idle_time, min_idle_count, (bool *)
+            &g_preread_handler_ctx.continue_flag);
+}
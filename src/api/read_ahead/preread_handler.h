@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PREREAD_HANDLER_H
+#define _PREREAD_HANDLER_H
+
+#include "fastcommon/thread_pool.h"
+#include "../fs_api_types.h"
+
+typedef struct {
+    volatile int waiting_task_count;
+    FCThreadPool thread_pool;
+    volatile bool continue_flag;
+} PrereadHandlerContext;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    extern PrereadHandlerContext g_preread_handler_ctx;
+
+    int preread_handler_init(const int thread_limit,
+            const int min_idle_count, const int max_idle_time);
+
+    void preread_handler_terminate();
+
+    /* issue the read ahead task asynchronously */
+    int preread_handler_push(FSPrereadTask *task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
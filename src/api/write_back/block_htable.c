@@ -0,0 +1,742 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "../fs_api_allocator.h"
+#include "../read_ahead/obid_htable.h"
+#include "flush_handler.h"
+#include "block_htable.h"
+
+typedef struct fs_wback_block_hashtable {
+    FSWBackBlockEntry **buckets;
+    int64_t capacity;
+} FSWBackBlockHashtable;
+
+typedef struct fs_wback_shared_lcp_array {
+    pthread_lock_cond_pair_t *lcps;
+    int count;
+} FSWBackSharedLCPArray;
+
+typedef struct fs_wback_block_context {
+    FSWBackBlockHashtable htable;
+    FSWBackSharedLCPArray larray;
+    volatile int64_t current_version;
+} FSWBackBlockContext;
+
+static FSWBackBlockContext wback_ctx;
+
+#define WBACK_SET_HASHTABLE_KEY(op_ctx, key) \
+    SFTwoIdsHashKey key;   \
+    key.oid = op_ctx->bs_key.block.oid;  \
+    key.bid = op_ctx->bid;
+
+#define WBACK_SET_BUCKET_AND_LCP(key) \
+    uint64_t hash_code;    \
+    int64_t bucket_index;  \
+    FSWBackBlockEntry **bucket;    \
+    pthread_lock_cond_pair_t *lcp; \
+    hash_code = (key).oid + (key).bid; \
+    bucket_index = hash_code % wback_ctx.htable.capacity; \
+    bucket = wback_ctx.htable.buckets + bucket_index;     \
+    lcp = wback_ctx.larray.lcps + bucket_index % wback_ctx.larray.count
+
+#define WBACK_NEXT_VERSION() \
+    __sync_add_and_fetch(&wback_ctx.current_version, 1)
+
+#define WBACK_BLOCK_IS_EMPTY(block) \
+    ((block)->dirty.head == NULL && (block)->flushing.head == NULL)
+
+int wback_block_htable_init(const int64_t htable_capacity,
+        const int shared_lock_count)
+{
+    int result;
+    int bytes;
+    pthread_lock_cond_pair_t *lcp;
+    pthread_lock_cond_pair_t *end;
+
+    wback_ctx.htable.capacity = fc_ceil_prime(htable_capacity);
+    bytes = sizeof(FSWBackBlockEntry *) * wback_ctx.htable.capacity;
+    wback_ctx.htable.buckets = (FSWBackBlockEntry **)fc_malloc(bytes);
+    if (wback_ctx.htable.buckets == NULL) {
+        return ENOMEM;
+    }
+    memset(wback_ctx.htable.buckets, 0, bytes);
+
+    wback_ctx.larray.count = fc_ceil_prime(shared_lock_count);
+    wback_ctx.larray.lcps = (pthread_lock_cond_pair_t *)fc_malloc(
+            sizeof(pthread_lock_cond_pair_t) * wback_ctx.larray.count);
+    if (wback_ctx.larray.lcps == NULL) {
+        return ENOMEM;
+    }
+
+    end = wback_ctx.larray.lcps + wback_ctx.larray.count;
+    for (lcp=wback_ctx.larray.lcps; lcp<end; lcp++) {
+        if ((result=init_pthread_lock_cond_pair(lcp)) != 0) {
+            return result;
+        }
+    }
+
+    wback_ctx.current_version = 0;
+    return 0;
+}
+
+static inline FSWBackBlockEntry *find_block(FSWBackBlockEntry **bucket,
+        const SFTwoIdsHashKey *key, FSWBackBlockEntry **previous)
+{
+    FSWBackBlockEntry *current;
+
+    *previous = NULL;
+    current = *bucket;
+    while (current != NULL) {
+        if (current->key.oid == key->oid && current->key.bid == key->bid) {
+            return current;
+        }
+
+        *previous = current;
+        current = current->next;
+    }
+
+    return NULL;
+}
+
+static inline FSWBackExtent *alloc_extent(FSAPIAllocatorContext *
+        allocator_ctx, const int offset, const int length,
+        const int alloc_size)
+{
+    FSWBackExtent *extent;
+
+    if ((extent=(FSWBackExtent *)fast_mblock_alloc_object(
+                    &allocator_ctx->write_back.extent)) == NULL)
+    {
+        return NULL;
+    }
+
+    if ((extent->buff=(char *)fc_malloc(alloc_size)) == NULL) {
+        fast_mblock_free_object(extent->allocator, extent);
+        return NULL;
+    }
+
+    extent->ssize.offset = offset;
+    extent->ssize.length = length;
+    extent->alloc_size = alloc_size;
+    extent->next = NULL;
+    __sync_add_and_fetch(&g_wback_flush_ctx.dirty_bytes, alloc_size);
+    return extent;
+}
+
+static inline void free_extent(FSWBackExtent *extent)
+{
+    __sync_sub_and_fetch(&g_wback_flush_ctx.dirty_bytes, extent->alloc_size);
+    free(extent->buff);
+    fast_mblock_free_object(extent->allocator, extent);
+}
+
+static int free_extent_chain(FSWBackExtent *head)
+{
+    FSWBackExtent *extent;
+    int count;
+
+    count = 0;
+    while (head != NULL) {
+        extent = head;
+        head = head->next;
+        free_extent(extent);
+        ++count;
+    }
+
+    return count;
+}
+
+static void free_block(FSWBackBlockEntry *block)
+{
+    free_extent_chain(block->dirty.head);
+    free_extent_chain(block->flushing.head);
+    if (block->done_callback_arg != NULL) {
+        fast_mblock_free_object(block->done_callback_arg->allocator,
+                block->done_callback_arg);
+    }
+    fast_mblock_free_object(block->allocator, block);
+}
+
+static inline void remove_block(FSWBackBlockEntry **bucket,
+        FSWBackBlockEntry *block)
+{
+    FSWBackBlockEntry *previous;
+
+    if (find_block(bucket, &block->key, &previous) != block) {
+        return;
+    }
+
+    if (previous == NULL) {
+        *bucket = block->next;
+    } else {
+        previous->next = block->next;
+    }
+    wback_flush_handler_remove_block(block);
+}
+
+/* the block can be freed only when it is NOT referenced by the flush queue */
+static inline bool check_requeue_or_remove(FSWBackBlockEntry **bucket,
+        FSWBackBlockEntry *block)
+{
+    if (!WBACK_BLOCK_IS_EMPTY(block)) {
+        if (!block->queued && !block->in_flush) {
+            wback_flush_handler_push(block);
+        }
+        return false;
+    }
+
+    if (block->queued || block->in_flush) {
+        return false;
+    }
+
+    remove_block(bucket, block);
+    return true;
+}
+
+static FSWBackBlockEntry *create_block(FSAPIOperationContext *op_ctx,
+        const SFTwoIdsHashKey *key, void *extra_data)
+{
+    FSWBackBlockEntry *block;
+    FSAPIContext *api_ctx;
+
+    if ((block=(FSWBackBlockEntry *)fast_mblock_alloc_object(
+                    &op_ctx->allocator_ctx->write_back.block)) == NULL)
+    {
+        return NULL;
+    }
+
+    api_ctx = op_ctx->api_ctx;
+    if (api_ctx->write_done_callback.func != NULL) {
+        if ((block->done_callback_arg=(FSAPIWriteDoneCallbackArg *)
+                    fast_mblock_alloc_object(&op_ctx->allocator_ctx->
+                        write_back.callback_arg)) == NULL)
+        {
+            fast_mblock_free_object(block->allocator, block);
+            return NULL;
+        }
+
+        if (extra_data != NULL && api_ctx->write_done_callback.
+                arg_extra_size > 0)
+        {
+            memcpy(block->done_callback_arg->extra_data, extra_data,
+                    api_ctx->write_done_callback.arg_extra_size);
+        }
+    } else {
+        block->done_callback_arg = NULL;
+    }
+
+    block->key = *key;
+    block->dirty.head = NULL;
+    block->flushing.head = NULL;
+    block->version = WBACK_NEXT_VERSION();
+    block->dirty_time_ms = 0;
+    block->in_flush = false;
+    block->queued = false;
+    block->last_errno = 0;
+    block->next = NULL;
+    block->qnext = NULL;
+    return block;
+}
+
+static inline int calc_alloc_size(const int offset, const int length)
+{
+    int alloc_size;
+
+    /* reserve space for the successive appending */
+    alloc_size = 2 * length;
+    if (offset + alloc_size > FS_FILE_BLOCK_SIZE) {
+        alloc_size = FS_FILE_BLOCK_SIZE - offset;
+    }
+    return alloc_size;
+}
+
+/* merge the new slice with the overlapped and adjacent dirty extents,
+ * the extents of the block keep sorted by offset and without overlap */
+static int absorb_slice(FSAPIAllocatorContext *allocator_ctx,
+        FSWBackBlockEntry *block, const FSSliceSize *ssize,
+        const char *buff)
+{
+    FSWBackExtent **pp;
+    FSWBackExtent *first;
+    FSWBackExtent *after;
+    FSWBackExtent *extent;
+    FSWBackExtent *target;
+    FSWBackExtent *current;
+    int start;
+    int end;
+    int count;
+
+    start = ssize->offset;
+    end = ssize->offset + ssize->length;
+    pp = &block->dirty.head;
+    while (*pp != NULL && (*pp)->ssize.offset + (*pp)->ssize.length < start) {
+        pp = &(*pp)->next;
+    }
+
+    first = *pp;
+    count = 0;
+    for (extent=first; extent != NULL && extent->ssize.offset <= end;
+            extent=extent->next)
+    {
+        if (extent->ssize.offset < start) {
+            start = extent->ssize.offset;
+        }
+        if (extent->ssize.offset + extent->ssize.length > end) {
+            end = extent->ssize.offset + extent->ssize.length;
+        }
+        ++count;
+    }
+    after = extent;
+
+    if (count > 0 && first->ssize.offset == start &&
+            first->alloc_size >= end - start)
+    {
+        target = first;  //append in place
+    } else {
+        if ((target=alloc_extent(allocator_ctx, start, end - start,
+                        calc_alloc_size(start, end - start))) == NULL)
+        {
+            return ENOMEM;
+        }
+    }
+
+    current = first;
+    while (count-- > 0) {
+        extent = current;
+        current = current->next;
+        if (extent != target) {
+            memcpy(target->buff + (extent->ssize.offset - start),
+                    extent->buff, extent->ssize.length);
+            free_extent(extent);
+        }
+    }
+
+    memcpy(target->buff + (ssize->offset - start), buff, ssize->length);
+    target->ssize.offset = start;
+    target->ssize.length = end - start;
+    target->next = after;
+    *pp = target;
+    return 0;
+}
+
+/* remove the range of the slice from the extent chain */
+static int trim_extents(FSAPIAllocatorContext *allocator_ctx,
+        FSWBackExtent **head, const FSSliceSize *ssize)
+{
+    FSWBackExtent **pp;
+    FSWBackExtent *extent;
+    FSWBackExtent *tail;
+    int start;
+    int end;
+    int extent_end;
+
+    start = ssize->offset;
+    end = ssize->offset + ssize->length;
+    pp = head;
+    while ((extent=*pp) != NULL && extent->ssize.offset < end) {
+        extent_end = extent->ssize.offset + extent->ssize.length;
+        if (extent_end <= start) {
+            pp = &extent->next;
+            continue;
+        }
+
+        if (start <= extent->ssize.offset && end >= extent_end) {
+            *pp = extent->next;
+            free_extent(extent);
+            continue;
+        }
+
+        if (start > extent->ssize.offset && end < extent_end) {
+            if ((tail=alloc_extent(allocator_ctx, end, extent_end - end,
+                            extent_end - end)) == NULL)
+            {
+                return ENOMEM;
+            }
+            memcpy(tail->buff, extent->buff + (end - extent->ssize.offset),
+                    extent_end - end);
+            tail->next = extent->next;
+            extent->next = tail;
+            extent->ssize.length = start - extent->ssize.offset;
+            break;
+        }
+
+        if (start <= extent->ssize.offset) {  //cut the head
+            memmove(extent->buff, extent->buff + (end - extent->
+                        ssize.offset), extent_end - end);
+            extent->ssize.offset = end;
+            extent->ssize.length = extent_end - end;
+        } else {  //cut the tail
+            extent->ssize.length = start - extent->ssize.offset;
+        }
+        pp = &extent->next;
+    }
+
+    return 0;
+}
+
+static inline FSWBackExtent *find_cover_extent(FSWBackExtent *head,
+        const FSSliceSize *ssize)
+{
+    FSWBackExtent *extent;
+
+    for (extent=head; extent != NULL; extent=extent->next) {
+        if (extent->ssize.offset > ssize->offset) {
+            break;
+        }
+        if (extent->ssize.offset + extent->ssize.length >=
+                ssize->offset + ssize->length)
+        {
+            return extent;
+        }
+    }
+
+    return NULL;
+}
+
+/* copy the cached data which overlapped with the slice,
+ * return the end position relative to the slice offset */
+static int overlay_extents(FSWBackExtent *head,
+        const FSSliceSize *ssize, char *buff)
+{
+    FSWBackExtent *extent;
+    int start;
+    int end;
+    int max_end;
+
+    max_end = 0;
+    for (extent=head; extent != NULL; extent=extent->next) {
+        if (extent->ssize.offset >= ssize->offset + ssize->length) {
+            break;
+        }
+
+        start = FC_MAX(extent->ssize.offset, ssize->offset);
+        end = FC_MIN(extent->ssize.offset + extent->ssize.length,
+                ssize->offset + ssize->length);
+        if (end <= start) {
+            continue;
+        }
+
+        memcpy(buff + (start - ssize->offset), extent->buff +
+                (start - extent->ssize.offset), end - start);
+        if (end - ssize->offset > max_end) {
+            max_end = end - ssize->offset;
+        }
+    }
+
+    return max_end;
+}
+
+int wback_block_htable_write(FSAPIOperationContext *op_ctx,
+        FSAPIWriteBuffer *wbuffer)
+{
+    int result;
+    FSWBackBlockEntry *block;
+    FSWBackBlockEntry *previous;
+    WBACK_SET_HASHTABLE_KEY(op_ctx, key);
+
+    wback_flush_handler_throttle();
+    do {
+        WBACK_SET_BUCKET_AND_LCP(key);
+
+        PTHREAD_MUTEX_LOCK(&lcp->lock);
+        if ((block=find_block(bucket, &key, &previous)) == NULL) {
+            if ((block=create_block(op_ctx, &key,
+                            wbuffer->extra_data)) == NULL)
+            {
+                result = ENOMEM;
+                PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+                break;
+            }
+
+            block->next = *bucket;
+            *bucket = block;
+            wback_flush_handler_add_block(block);
+        }
+
+        if ((result=absorb_slice(op_ctx->allocator_ctx, block,
+                        &op_ctx->bs_key.slice, wbuffer->buff)) == 0)
+        {
+            if (!block->queued && !block->in_flush) {
+                wback_flush_handler_push(block);
+            }
+        } else if (check_requeue_or_remove(bucket, block)) {
+            free_block(block);
+        }
+        PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+    } while (0);
+
+    return result;
+}
+
+int wback_block_htable_read(FSAPIOperationContext *op_ctx,
+        char *buff, int *read_bytes)
+{
+    int result;
+    int end;
+    int64_t version;
+    FSWBackBlockEntry *block;
+    FSWBackBlockEntry *previous;
+    const FSSliceSize *ssize;
+    WBACK_SET_HASHTABLE_KEY(op_ctx, key);
+    WBACK_SET_BUCKET_AND_LCP(key);
+
+    ssize = &op_ctx->bs_key.slice;
+    while (1) {
+        PTHREAD_MUTEX_LOCK(&lcp->lock);
+        if ((block=find_block(bucket, &key, &previous)) == NULL ||
+                WBACK_BLOCK_IS_EMPTY(block))
+        {
+            PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+            return ENOENT;
+        }
+
+        if (find_cover_extent(block->dirty.head, ssize) != NULL ||
+                find_cover_extent(block->flushing.head, ssize) != NULL)
+        {
+            overlay_extents(block->flushing.head, ssize, buff);
+            overlay_extents(block->dirty.head, ssize, buff);
+            PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+            *read_bytes = ssize->length;
+            return 0;
+        }
+        version = block->version;
+        PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+
+        result = fs_client_slice_read(op_ctx->api_ctx->fs,
+                &op_ctx->bs_key, buff, read_bytes);
+        if (result == ENOENT) {
+            *read_bytes = 0;
+        } else if (result != 0) {
+            return result;
+        }
+
+        PTHREAD_MUTEX_LOCK(&lcp->lock);
+        if ((block=find_block(bucket, &key, &previous)) == NULL ||
+                block->version != version)
+        {
+            /* flush done during reading, the data maybe stale */
+            PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+            continue;
+        }
+
+        if (*read_bytes < ssize->length) {
+            memset(buff + *read_bytes, 0, ssize->length - *read_bytes);
+        }
+        end = overlay_extents(block->flushing.head, ssize, buff);
+        if (end > *read_bytes) {
+            *read_bytes = end;
+        }
+        end = overlay_extents(block->dirty.head, ssize, buff);
+        if (end > *read_bytes) {
+            *read_bytes = end;
+        }
+        PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+        return 0;
+    }
+}
+
+int wback_block_htable_discard(FSAPIOperationContext *op_ctx,
+        const bool whole_block)
+{
+    int result;
+    bool removed;
+    FSWBackBlockEntry *block;
+    FSWBackBlockEntry *previous;
+    WBACK_SET_HASHTABLE_KEY(op_ctx, key);
+    WBACK_SET_BUCKET_AND_LCP(key);
+
+    result = 0;
+    removed = false;
+    PTHREAD_MUTEX_LOCK(&lcp->lock);
+    while ((block=find_block(bucket, &key, &previous)) != NULL &&
+            block->in_flush)
+    {
+        pthread_cond_wait(&lcp->cond, &lcp->lock);
+    }
+
+    if (block != NULL) {
+        if (whole_block) {
+            free_extent_chain(block->dirty.head);
+            free_extent_chain(block->flushing.head);
+            block->dirty.head = block->flushing.head = NULL;
+        } else {
+            if ((result=trim_extents(op_ctx->allocator_ctx, &block->
+                            flushing.head, &op_ctx->bs_key.slice)) == 0)
+            {
+                result = trim_extents(op_ctx->allocator_ctx, &block->
+                        dirty.head, &op_ctx->bs_key.slice);
+            }
+        }
+
+        block->version = WBACK_NEXT_VERSION();
+        removed = check_requeue_or_remove(bucket, block);
+    }
+    PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+
+    if (removed) {
+        free_block(block);
+    }
+    wback_flush_handler_notify();
+    return result;
+}
+
+static int write_extents(FSAPIContext *api_ctx,
+        FSWBackBlockEntry *block)
+{
+    FSAPIOperationContext op_ctx;
+    FSWBackExtent *extent;
+    int result;
+    int write_bytes;
+    int inc_alloc;
+
+    op_ctx.api_ctx = api_ctx;
+    op_ctx.op_type = 'w';
+    op_ctx.bid = block->key.bid;
+    fs_set_block_key(&op_ctx.bs_key.block, block->key.oid, block->key.bid);
+    for (extent=block->flushing.head; extent!=NULL; extent=extent->next) {
+        op_ctx.bs_key.slice = extent->ssize;
+        if ((result=fs_client_slice_write(api_ctx->fs, &op_ctx.bs_key,
+                        extent->buff, &write_bytes, &inc_alloc)) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "slice write fail, block {oid: %"PRId64", "
+                    "offset: %"PRId64"}, slice {offset: %d, length: %d}, "
+                    "errno: %d, error info: %s", __LINE__,
+                    block->key.oid, block->key.bid,
+                    extent->ssize.offset, extent->ssize.length,
+                    result, STRERROR(result));
+            return result;
+        }
+
+        if (block->done_callback_arg != NULL) {
+            block->done_callback_arg->bs_key = &op_ctx.bs_key;
+            block->done_callback_arg->result = 0;
+            block->done_callback_arg->write_bytes = write_bytes;
+            block->done_callback_arg->inc_alloc = inc_alloc;
+            api_ctx->write_done_callback.func(block->done_callback_arg);
+        }
+
+        if (api_ctx->read_ahead.enabled) {
+            preread_invalidate_conflict_slices(&op_ctx);
+        }
+    }
+
+    return 0;
+}
+
+/* the caller MUST hold the lock and the block MUST not in flush,
+ * the lock will be released during writing to the servers */
+static int flush_block(pthread_lock_cond_pair_t *lcp,
+        FSWBackBlockEntry *block, bool *dirty_flushed)
+{
+    int result;
+    FSWBackExtent *flushing;
+
+    if (block->flushing.head == NULL) {  //retry the failed first
+        block->flushing.head = block->dirty.head;
+        block->dirty.head = NULL;
+        *dirty_flushed = true;
+    } else {
+        *dirty_flushed = false;
+    }
+    if (block->flushing.head == NULL) {
+        return 0;
+    }
+
+    block->in_flush = true;
+    PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+
+    result = write_extents(g_wback_flush_ctx.api_ctx, block);
+
+    PTHREAD_MUTEX_LOCK(&lcp->lock);
+    block->in_flush = false;
+    if (result == 0) {
+        flushing = block->flushing.head;
+        block->flushing.head = NULL;
+        block->version = WBACK_NEXT_VERSION();
+        block->last_errno = 0;
+        free_extent_chain(flushing);
+    } else {
+        block->last_errno = result;
+    }
+    pthread_cond_broadcast(&lcp->cond);
+
+    return result;
+}
+
+int wback_block_htable_flush_queued(FSWBackBlockEntry *block)
+{
+    int result;
+    bool dirty_flushed;
+    bool removed;
+    WBACK_SET_BUCKET_AND_LCP(block->key);
+
+    PTHREAD_MUTEX_LOCK(&lcp->lock);
+    block->queued = false;
+    if (block->in_flush) {  //the flusher will requeue or remove it
+        PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+        return 0;
+    }
+
+    result = flush_block(lcp, block, &dirty_flushed);
+    removed = check_requeue_or_remove(bucket, block);
+    PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+
+    if (removed) {
+        free_block(block);
+    }
+    wback_flush_handler_notify();
+    return result;
+}
+
+int wback_block_htable_sync(const SFTwoIdsHashKey *key)
+{
+    int result;
+    bool dirty_flushed;
+    bool removed;
+    FSWBackBlockEntry *block;
+    FSWBackBlockEntry *previous;
+    WBACK_SET_BUCKET_AND_LCP(*key);
+
+    result = 0;
+    removed = false;
+    PTHREAD_MUTEX_LOCK(&lcp->lock);
+    while ((block=find_block(bucket, key, &previous)) != NULL) {
+        if (block->in_flush) {
+            pthread_cond_wait(&lcp->cond, &lcp->lock);
+            continue;
+        }
+
+        if ((result=flush_block(lcp, block, &dirty_flushed)) != 0) {
+            removed = check_requeue_or_remove(bucket, block);
+            break;
+        }
+
+        if (dirty_flushed) {
+            removed = check_requeue_or_remove(bucket, block);
+            break;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+
+    if (removed) {
+        free_block(block);
+    }
+    wback_flush_handler_notify();
+    return result;
+}
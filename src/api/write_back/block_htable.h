@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WRITE_BACK_BLOCK_HTABLE_H
+#define _WRITE_BACK_BLOCK_HTABLE_H
+
+#include "../fs_api_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int wback_block_htable_init(const int64_t htable_capacity,
+            const int shared_lock_count);
+
+    /* absorb the slice data into the dirty extents of the block */
+    int wback_block_htable_write(FSAPIOperationContext *op_ctx,
+            FSAPIWriteBuffer *wbuffer);
+
+    /* return ENOENT when the block has no cached data */
+    int wback_block_htable_read(FSAPIOperationContext *op_ctx,
+            char *buff, int *read_bytes);
+
+    /* drop the cached data of the slice (or the whole block) for delete */
+    int wback_block_htable_discard(FSAPIOperationContext *op_ctx,
+            const bool whole_block);
+
+    /* called by the flush thread for the block popped from flush queue */
+    int wback_block_htable_flush_queued(FSWBackBlockEntry *block);
+
+    /* flush the dirty data of the block and wait for done (barrier) */
+    int wback_block_htable_sync(const SFTwoIdsHashKey *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
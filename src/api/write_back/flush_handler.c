@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <sys/time.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "sf/sf_global.h"
+#include "block_htable.h"
+#include "flush_handler.h"
+
+#define WBACK_BACKGROUND_FLUSH_RATIO  0.50
+
+WBackFlushHandlerContext g_wback_flush_ctx;
+
+#define WBACK_DIRTY_BYTES  \
+    __sync_add_and_fetch(&g_wback_flush_ctx.dirty_bytes, 0)
+
+#define WBACK_NEED_FLUSH_NOW  \
+    (WBACK_DIRTY_BYTES >= g_wback_flush_ctx.background_bytes || \
+     __sync_add_and_fetch(&g_wback_flush_ctx.throttle_count, 0) > 0)
+
+static inline void flush_handler_timedwait_ms(const int timeout_ms)
+{
+    struct timeval tv;
+    struct timespec ts;
+    int64_t nsec;
+
+    gettimeofday(&tv, NULL);
+    nsec = (int64_t)tv.tv_usec * 1000 + (int64_t)(timeout_ms % 1000) *
+        1000 * 1000;
+    ts.tv_sec = tv.tv_sec + timeout_ms / 1000 + nsec / (1000 * 1000 * 1000);
+    ts.tv_nsec = nsec % (1000 * 1000 * 1000);
+    pthread_cond_timedwait(&g_wback_flush_ctx.lcp.cond,
+            &g_wback_flush_ctx.lcp.lock, &ts);
+}
+
+void wback_flush_handler_push(FSWBackBlockEntry *block)
+{
+    block->queued = true;
+    block->qnext = NULL;
+
+    PTHREAD_MUTEX_LOCK(&g_wback_flush_ctx.lcp.lock);
+    block->dirty_time_ms = get_current_time_ms();
+    if (g_wback_flush_ctx.queue.tail == NULL) {
+        g_wback_flush_ctx.queue.head = block;
+    } else {
+        g_wback_flush_ctx.queue.tail->qnext = block;
+    }
+    g_wback_flush_ctx.queue.tail = block;
+    pthread_cond_broadcast(&g_wback_flush_ctx.lcp.cond);
+    PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.lcp.lock);
+}
+
+void wback_flush_handler_throttle()
+{
+    if (WBACK_DIRTY_BYTES < g_wback_flush_ctx.api_ctx->write_back.max_memory) {
+        return;
+    }
+
+    PTHREAD_MUTEX_LOCK(&g_wback_flush_ctx.lcp.lock);
+    g_wback_flush_ctx.throttle_count++;
+    pthread_cond_broadcast(&g_wback_flush_ctx.lcp.cond);
+    while (WBACK_DIRTY_BYTES >= g_wback_flush_ctx.api_ctx->
+            write_back.max_memory && g_wback_flush_ctx.continue_flag)
+    {
+        flush_handler_timedwait_ms(100);
+    }
+    g_wback_flush_ctx.throttle_count--;
+    PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.lcp.lock);
+}
+
+void wback_flush_handler_notify()
+{
+    if (__sync_add_and_fetch(&g_wback_flush_ctx.throttle_count, 0) > 0) {
+        PTHREAD_MUTEX_LOCK(&g_wback_flush_ctx.lcp.lock);
+        pthread_cond_broadcast(&g_wback_flush_ctx.lcp.cond);
+        PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.lcp.lock);
+    }
+}
+
+static FSWBackBlockEntry *pop_block()
+{
+    FSWBackBlockEntry *block;
+    int64_t wait_ms;
+
+    PTHREAD_MUTEX_LOCK(&g_wback_flush_ctx.lcp.lock);
+    while (1) {
+        if (!g_wback_flush_ctx.continue_flag) {
+            block = NULL;
+            break;
+        }
+
+        if ((block=g_wback_flush_ctx.queue.head) == NULL) {
+            pthread_cond_wait(&g_wback_flush_ctx.lcp.cond,
+                    &g_wback_flush_ctx.lcp.lock);
+            continue;
+        }
+
+        wait_ms = block->dirty_time_ms + g_wback_flush_ctx.api_ctx->
+            write_back.max_dirty_time_ms - get_current_time_ms();
+        if (wait_ms > 0 && !WBACK_NEED_FLUSH_NOW) {
+            flush_handler_timedwait_ms(wait_ms);
+            continue;
+        }
+
+        g_wback_flush_ctx.queue.head = block->qnext;
+        if (g_wback_flush_ctx.queue.head == NULL) {
+            g_wback_flush_ctx.queue.tail = NULL;
+        }
+        block->qnext = NULL;
+        break;
+    }
+    PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.lcp.lock);
+
+    return block;
+}
+
+static void *flush_thread_func(void *arg)
+{
+    FSWBackBlockEntry *block;
+
+#ifdef OS_LINUX
+    prctl(PR_SET_NAME, "write-back");
+#endif
+
+    __sync_add_and_fetch(&g_wback_flush_ctx.running_threads, 1);
+    while (g_wback_flush_ctx.continue_flag) {
+        if ((block=pop_block()) == NULL) {
+            continue;
+        }
+
+        if (wback_block_htable_flush_queued(block) != 0) {
+            fc_sleep_ms(100);  //avoid busy retry when server error
+        }
+    }
+    __sync_sub_and_fetch(&g_wback_flush_ctx.running_threads, 1);
+
+    return NULL;
+}
+
+static int collect_block_keys(const int64_t oid, const bool all,
+        SFTwoIdsHashKey **keys, int *count)
+{
+    FSWBackBlockEntry *block;
+    SFTwoIdsHashKey *new_keys;
+    int alloc;
+
+    *keys = NULL;
+    *count = 0;
+    alloc = 0;
+    PTHREAD_MUTEX_LOCK(&g_wback_flush_ctx.blocks.lock);
+    fc_list_for_each_entry(block, &g_wback_flush_ctx.blocks.head, dlink) {
+        if (!(all || block->key.oid == oid)) {
+            continue;
+        }
+
+        if (*count == alloc) {
+            alloc = (alloc == 0) ? 16 : 2 * alloc;
+            new_keys = (SFTwoIdsHashKey *)fc_realloc(*keys,
+                    sizeof(SFTwoIdsHashKey) * alloc);
+            if (new_keys == NULL) {
+                PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.blocks.lock);
+                free(*keys);
+                *keys = NULL;
+                *count = 0;
+                return ENOMEM;
+            }
+            *keys = new_keys;
+        }
+        (*keys)[(*count)++] = block->key;
+    }
+    PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.blocks.lock);
+
+    return 0;
+}
+
+static int sync_blocks(const int64_t oid, const bool all, int *count)
+{
+    SFTwoIdsHashKey *keys;
+    SFTwoIdsHashKey *key;
+    SFTwoIdsHashKey *end;
+    int result;
+    int sync_result;
+
+    if ((result=collect_block_keys(oid, all, &keys, count)) != 0) {
+        return result;
+    }
+
+    end = keys + *count;
+    for (key=keys; key<end; key++) {
+        if ((sync_result=wback_block_htable_sync(key)) != 0) {
+            if (result == 0) {
+                result = sync_result;
+            }
+        }
+    }
+
+    if (keys != NULL) {
+        free(keys);
+    }
+    return result;
+}
+
+int wback_flush_handler_sync(const int64_t oid)
+{
+    const bool all = false;
+    int count;
+
+    return sync_blocks(oid, all, &count);
+}
+
+int wback_flush_handler_init(FSAPIContext *api_ctx)
+{
+    int result;
+
+    if ((result=init_pthread_lock_cond_pair(&g_wback_flush_ctx.lcp)) != 0) {
+        return result;
+    }
+    if ((result=init_pthread_lock(&g_wback_flush_ctx.blocks.lock)) != 0) {
+        return result;
+    }
+    FC_INIT_LIST_HEAD(&g_wback_flush_ctx.blocks.head);
+
+    g_wback_flush_ctx.queue.head = NULL;
+    g_wback_flush_ctx.queue.tail = NULL;
+    g_wback_flush_ctx.dirty_bytes = 0;
+    g_wback_flush_ctx.background_bytes = api_ctx->write_back.
+        max_memory * WBACK_BACKGROUND_FLUSH_RATIO;
+    g_wback_flush_ctx.throttle_count = 0;
+    g_wback_flush_ctx.running_threads = 0;
+    g_wback_flush_ctx.api_ctx = api_ctx;
+    return 0;
+}
+
+int wback_flush_handler_start()
+{
+    int result;
+    int i;
+    pthread_t tid;
+
+    g_wback_flush_ctx.continue_flag = true;
+    for (i=0; i<g_wback_flush_ctx.api_ctx->write_back.flush_threads; i++) {
+        if ((result=fc_create_thread(&tid, flush_thread_func,
+                        NULL, SF_G_THREAD_STACK_SIZE)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+void wback_flush_handler_terminate()
+{
+    const bool all = true;
+    const int64_t oid = 0;
+    int count;
+    int i;
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&g_wback_flush_ctx.lcp.lock);
+    g_wback_flush_ctx.continue_flag = false;
+    pthread_cond_broadcast(&g_wback_flush_ctx.lcp.cond);
+    PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.lcp.lock);
+
+    i = 0;
+    while (__sync_add_and_fetch(&g_wback_flush_ctx.
+                running_threads, 0) > 0 && i++ < 1000)
+    {
+        fc_sleep_ms(10);
+    }
+
+    result = sync_blocks(oid, all, &count);
+    logInfo("file: "__FILE__", line: %d, "
+            "wback_flush_handler_terminate, flush block count: %d, "
+            "dirty bytes: %"PRId64", result: %d", __LINE__, count,
+            WBACK_DIRTY_BYTES, result);
+}
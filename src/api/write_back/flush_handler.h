@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WRITE_BACK_FLUSH_HANDLER_H
+#define _WRITE_BACK_FLUSH_HANDLER_H
+
+#include "../fs_api_types.h"
+
+typedef struct {
+    pthread_lock_cond_pair_t lcp;  //for flush queue and write throttle
+    struct {
+        FSWBackBlockEntry *head;
+        FSWBackBlockEntry *tail;
+    } queue;
+    struct {
+        pthread_mutex_t lock;
+        struct fc_list_head head;  //element: FSWBackBlockEntry
+    } blocks;
+    volatile int64_t dirty_bytes;
+    int64_t background_bytes;   //flush without waiting for dirty time
+    volatile int throttle_count; //the writers waiting for memory
+    volatile int running_threads;
+    volatile bool continue_flag;
+    FSAPIContext *api_ctx;
+} WBackFlushHandlerContext;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    extern WBackFlushHandlerContext g_wback_flush_ctx;
+
+    int wback_flush_handler_init(FSAPIContext *api_ctx);
+
+    int wback_flush_handler_start();
+
+    /* flush all dirty data then stop the flush threads */
+    void wback_flush_handler_terminate();
+
+    /* the caller MUST hold the sharding lock of the block */
+    void wback_flush_handler_push(FSWBackBlockEntry *block);
+
+    /* block the writer when the dirty memory reaches max_memory */
+    void wback_flush_handler_throttle();
+
+    /* wakeup the throttled writers after dirty memory released */
+    void wback_flush_handler_notify();
+
+    /* flush the dirty data of the file (oid) for fsync / close */
+    int wback_flush_handler_sync(const int64_t oid);
+
+    static inline void wback_flush_handler_add_block(FSWBackBlockEntry *block)
+    {
+        PTHREAD_MUTEX_LOCK(&g_wback_flush_ctx.blocks.lock);
+        fc_list_add_tail(&block->dlink, &g_wback_flush_ctx.blocks.head);
+        PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.blocks.lock);
+    }
+
+    static inline void wback_flush_handler_remove_block(
+            FSWBackBlockEntry *block)
+    {
+        PTHREAD_MUTEX_LOCK(&g_wback_flush_ctx.blocks.lock);
+        fc_list_del_init(&block->dlink);
+        PTHREAD_MUTEX_UNLOCK(&g_wback_flush_ctx.blocks.lock);
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* the write back cache test against a running cluster, the client config
+ * file MUST enable the write back cache ([write-back] enabled = true),
+ * the cached data is checked through fs_api_slice_read, then flushed and
+ * checked through the client directly */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/ini_file_reader.h"
+#include "faststore/client/fs_client.h"
+#include "../fs_api.h"
+
+#define TEST_RANGE_SIZE  (64 * 1024)
+
+typedef struct {
+    int64_t oid;
+    char *expect;    //the expected data of the range
+    bool *written;   //the bytes of the range written
+    char *buff;
+} WBackTestContext;
+
+static WBackTestContext test_ctx;
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-c config_filename=%s] "
+            "[-n namespace or poolname=fs]\n", argv[0],
+            FS_CLIENT_DEFAULT_CONFIG_FILENAME);
+}
+
+static void write_done_callback(FSAPIWriteDoneCallbackArg *callback_arg)
+{
+}
+
+static inline void set_op_ctx(FSAPIOperationContext *op_ctx,
+        const int offset, const int length)
+{
+    FS_API_SET_CTX_AND_TID(*op_ctx, getpid());
+    fs_set_block_key(&op_ctx->bs_key.block, test_ctx.oid, 0);
+    op_ctx->bs_key.slice.offset = offset;
+    op_ctx->bs_key.slice.length = length;
+}
+
+static int test_write(const int offset, const int length, const char ch)
+{
+    FSAPIOperationContext op_ctx;
+    FSAPIWriteBuffer wbuffer;
+    int write_bytes;
+    int inc_alloc;
+    int result;
+
+    memset(test_ctx.buff, ch, length);
+    wbuffer.buff = test_ctx.buff;
+    wbuffer.extra_data = NULL;
+    set_op_ctx(&op_ctx, offset, length);
+    if ((result=fs_api_slice_write(&op_ctx, &wbuffer,
+                    &write_bytes, &inc_alloc)) != 0)
+    {
+        fprintf(stderr, "write {offset: %d, length: %d} fail, "
+                "errno: %d\n", offset, length, result);
+        return result;
+    }
+
+    memset(test_ctx.expect + offset, ch, length);
+    memset(test_ctx.written + offset, 1, length);
+    return 0;
+}
+
+static int test_delete(const int offset, const int length)
+{
+    FSAPIOperationContext op_ctx;
+    int dec_alloc;
+    int result;
+
+    set_op_ctx(&op_ctx, offset, length);
+    result = fs_api_slice_delete(&op_ctx, &dec_alloc);
+    if (!(result == 0 || result == ENOENT)) {
+        fprintf(stderr, "delete {offset: %d, length: %d} fail, "
+                "errno: %d\n", offset, length, result);
+        return result;
+    }
+
+    memset(test_ctx.expect + offset, 0, length);
+    memset(test_ctx.written + offset, 0, length);
+    return 0;
+}
+
+/* the bytes beyond the read length MUST NOT be written */
+static int check_data(const char *caption, const int offset,
+        const int length, const int read_bytes)
+{
+    int i;
+
+    for (i=0; i<length; i++) {
+        if (i < read_bytes) {
+            if (test_ctx.buff[i] == test_ctx.expect[offset + i]) {
+                continue;
+            }
+        } else if (!test_ctx.written[offset + i]) {
+            continue;
+        }
+
+        fprintf(stderr, "%s {offset: %d, length: %d}, read bytes: %d, "
+                "the data mismatch at offset %d\n", caption, offset,
+                length, read_bytes, offset + i);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int test_cached_read(const int offset, const int length)
+{
+    FSAPIOperationContext op_ctx;
+    int read_bytes;
+    int result;
+
+    set_op_ctx(&op_ctx, offset, length);
+    if ((result=fs_api_slice_read(&op_ctx, test_ctx.buff,
+                    &read_bytes)) != 0)
+    {
+        if (result == ENOENT) {
+            read_bytes = 0;
+        } else {
+            fprintf(stderr, "cached read {offset: %d, length: %d} fail, "
+                    "errno: %d\n", offset, length, result);
+            return result;
+        }
+    }
+
+    return check_data("cached read", offset, length, read_bytes);
+}
+
+static int test_client_read(const int offset, const int length)
+{
+    FSBlockSliceKeyInfo bs_key;
+    int read_bytes;
+    int result;
+
+    fs_set_block_key(&bs_key.block, test_ctx.oid, 0);
+    bs_key.slice.offset = offset;
+    bs_key.slice.length = length;
+    if ((result=fs_client_slice_read(&g_fs_client_vars.client_ctx,
+                    &bs_key, test_ctx.buff, &read_bytes)) != 0)
+    {
+        if (result == ENOENT) {
+            read_bytes = 0;
+        } else {
+            fprintf(stderr, "client read {offset: %d, length: %d} fail, "
+                    "errno: %d\n", offset, length, result);
+            return result;
+        }
+    }
+
+    return check_data("client read", offset, length, read_bytes);
+}
+
+static int test_flush_and_check()
+{
+    int result;
+
+    if ((result=fs_api_flush_file(&g_fs_api_ctx, test_ctx.oid)) != 0) {
+        fprintf(stderr, "flush file fail, errno: %d\n", result);
+        return result;
+    }
+
+    if ((result=test_client_read(0, TEST_RANGE_SIZE)) != 0) {
+        return result;
+    }
+    return test_cached_read(0, TEST_RANGE_SIZE);
+}
+
+static int run_tests()
+{
+    int result;
+
+    /* the overlapped and adjacent writes merge in the cache */
+    if ((result=test_write(0, 8 * 1024, 'a')) != 0 ||
+            (result=test_write(4 * 1024, 8 * 1024, 'b')) != 0 ||
+            (result=test_write(12 * 1024, 4 * 1024, 'c')) != 0 ||
+            (result=test_write(32 * 1024, 4 * 1024, 'd')) != 0)
+    {
+        return result;
+    }
+    if ((result=test_cached_read(0, 16 * 1024)) != 0 ||
+            (result=test_cached_read(2 * 1024, 4 * 1024)) != 0 ||
+            (result=test_cached_read(0, TEST_RANGE_SIZE)) != 0)
+    {
+        return result;
+    }
+
+    /* the delete trims the cached extents */
+    if ((result=test_delete(6 * 1024, 4 * 1024)) != 0) {
+        return result;
+    }
+    if ((result=test_cached_read(0, TEST_RANGE_SIZE)) != 0) {
+        return result;
+    }
+
+    /* the flushed data MUST equal to the cached data */
+    if ((result=test_flush_and_check()) != 0) {
+        return result;
+    }
+
+    /* overwrite the flushed data, the cache keeps the newer data */
+    if ((result=test_write(8 * 1024, 16 * 1024, 'e')) != 0) {
+        return result;
+    }
+    if ((result=test_cached_read(0, TEST_RANGE_SIZE)) != 0) {
+        return result;
+    }
+    return test_flush_and_check();
+}
+
+static int init_api(const char *config_filename)
+{
+    IniContext ini_context;
+    IniFullContext ini_ctx;
+    int result;
+
+    if ((result=iniLoadFromFile(config_filename, &ini_context)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "load conf file \"%s\" fail, ret code: %d",
+                __LINE__, config_filename, result);
+        return result;
+    }
+
+    g_fs_api_ctx.fs = &g_fs_client_vars.client_ctx;
+    FAST_INI_SET_FULL_CTX_EX(ini_ctx, config_filename, NULL, &ini_context);
+    result = fs_api_init_ex(&g_fs_api_ctx, &ini_ctx,
+            write_done_callback, 0);
+    iniFreeContext(&ini_context);
+    if (result != 0) {
+        return result;
+    }
+
+    if (!g_fs_api_ctx.write_back.enabled) {
+        fprintf(stderr, "ERROR: write back NOT enabled in %s!\n",
+                config_filename);
+        return EINVAL;
+    }
+
+    return fs_api_start_ex(&g_fs_api_ctx);
+}
+
+int main(int argc, char *argv[])
+{
+    const bool publish = false;
+    const char *config_filename = FS_CLIENT_DEFAULT_CONFIG_FILENAME;
+    FSAPIOperationContext op_ctx;
+    string_t poolname;
+    char *ns;
+    int dec_alloc;
+    int ch;
+    int result;
+
+    ns = "fs";
+    while ((ch=getopt(argc, argv, "hc:n:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'c':
+                config_filename = optarg;
+                break;
+            case 'n':
+                ns = optarg;
+                break;
+            default:
+                usage(argv);
+                return 1;
+        }
+    }
+
+    log_init();
+    FC_SET_STRING(poolname, ns);
+    if ((result=fs_client_init_with_auth_ex1(&g_fs_client_vars.client_ctx,
+                    &g_fcfs_auth_client_vars.client_ctx, config_filename,
+                    NULL, NULL, false, &poolname, publish)) != 0)
+    {
+        return result;
+    }
+    if ((result=init_api(config_filename)) != 0) {
+        return result;
+    }
+
+    test_ctx.oid = 100000000 + (int64_t)time(NULL);
+    test_ctx.expect = (char *)fc_malloc(TEST_RANGE_SIZE);
+    test_ctx.written = (bool *)fc_malloc(TEST_RANGE_SIZE);
+    test_ctx.buff = (char *)fc_malloc(TEST_RANGE_SIZE);
+    if (test_ctx.expect == NULL || test_ctx.written == NULL ||
+            test_ctx.buff == NULL)
+    {
+        return ENOMEM;
+    }
+    memset(test_ctx.expect, 0, TEST_RANGE_SIZE);
+    memset(test_ctx.written, 0, TEST_RANGE_SIZE);
+
+    result = run_tests();
+
+    set_op_ctx(&op_ctx, 0, TEST_RANGE_SIZE);
+    fs_api_block_delete(&op_ctx, &dec_alloc);
+    fs_api_terminate_ex(&g_fs_api_ctx);
+
+    printf("%s: %s\n", argv[0], result == 0 ? "OK" : "FAIL");
+    return result == 0 ? 0 : 1;
+}
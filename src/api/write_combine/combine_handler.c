@@ -25,7 +25,8 @@
 
 CombineHandlerContext g_combine_handler_ctx = {0};
 
-static inline void notify_and_release_slice(FSAPISliceEntry *slice)
+static inline void notify_and_release_slice(
+        FSAPISliceEntry *slice, const int result)
 {
     FSAPIBlockEntry *block;
     FSWCombineOTIDEntry *otid;
@@ -42,7 +43,7 @@ static inline void notify_and_release_slice(FSAPISliceEntry *slice)
     PTHREAD_MUTEX_LOCK(&block->hentry.sharding->lock);
     slice->stage = FS_API_COMBINED_WRITER_STAGE_CLEANUP;
     if (slice->waitings.head != NULL) {
-        fs_api_notify_waiting_tasks(slice);
+        fs_api_notify_waiting_tasks(slice, result);
     }
 
     fc_list_del_init(&slice->dlink); //remove from block
@@ -53,55 +54,240 @@ static inline void notify_and_release_slice(FSAPISliceEntry *slice)
             write_combine.slice.allocator, slice);
 }
 
+static void add_to_retry_list(FSAPISliceEntry *slice, const int result)
+{
+    int64_t interval_ms;
+
+    interval_ms = (int64_t)FS_API_COMBINE_RETRY_MIN_INTERVAL_MS <<
+        FC_MIN(slice->retry.count, 10);
+    if (interval_ms > FS_API_COMBINE_RETRY_MAX_INTERVAL_MS) {
+        interval_ms = FS_API_COMBINE_RETRY_MAX_INTERVAL_MS;
+    }
+    slice->retry.count++;
+    slice->retry.last_errno = result;
+    slice->retry.expires_ms = g_timer_ms_ctx.current_time_ms + interval_ms;
+
+    logWarning("file: "__FILE__", line: %d, "
+            "slice write fail, block {oid: %"PRId64", offset: %"PRId64"}, "
+            "slice {offset: %d, length: %d}, errno: %d, error info: %s, "
+            "retry count: %d, retry after %"PRId64" ms", __LINE__,
+            slice->bs_key.block.oid, slice->bs_key.block.offset,
+            slice->bs_key.slice.offset, slice->bs_key.slice.length,
+            result, STRERROR(result), slice->retry.count, interval_ms);
+
+    PTHREAD_MUTEX_LOCK(&g_combine_handler_ctx.retry.lock);
+    slice->next = g_combine_handler_ctx.retry.head;
+    g_combine_handler_ctx.retry.head = slice;
+    __sync_add_and_fetch(&g_combine_handler_ctx.retry.count, 1);
+    PTHREAD_MUTEX_UNLOCK(&g_combine_handler_ctx.retry.lock);
+}
+
+static FSAPISliceEntry *fetch_retry_slices(const int64_t current_time_ms)
+{
+    FSAPISliceEntry *slice;
+    FSAPISliceEntry *previous;
+    FSAPISliceEntry *head;
+
+    head = NULL;
+    PTHREAD_MUTEX_LOCK(&g_combine_handler_ctx.retry.lock);
+    previous = NULL;
+    slice = g_combine_handler_ctx.retry.head;
+    while (slice != NULL) {
+        if (slice->retry.expires_ms > current_time_ms) {
+            previous = slice;
+            slice = slice->next;
+            continue;
+        }
+
+        if (previous == NULL) {
+            g_combine_handler_ctx.retry.head = slice->next;
+        } else {
+            previous->next = slice->next;
+        }
+        __sync_sub_and_fetch(&g_combine_handler_ctx.retry.count, 1);
+
+        slice->next = head;
+        head = slice;
+        slice = (previous == NULL) ? g_combine_handler_ctx.
+            retry.head : previous->next;
+    }
+    PTHREAD_MUTEX_UNLOCK(&g_combine_handler_ctx.retry.lock);
+
+    return head;
+}
+
+void combine_handler_check_retries(const int64_t current_time_ms)
+{
+    FSAPISliceEntry *head;
+    FSAPISliceEntry *slice;
+
+    if (__sync_add_and_fetch(&g_combine_handler_ctx.retry.count, 0) == 0) {
+        return;
+    }
+
+    head = fetch_retry_slices(current_time_ms);
+    while (head != NULL) {
+        slice = head;
+        head = head->next;
+
+        __sync_add_and_fetch(&g_combine_handler_ctx.waiting_slice_count, 1);
+        fc_queue_push(&g_combine_handler_ctx.queue, slice);
+    }
+}
+
+static void write_done(FSAPISliceEntry *slice,
+        FSClientSliceWriteEntry *entry)
+{
+    FSAPIWriteDoneCallbackArg *callback_arg;
+
+    callback_arg = slice->done_callback_arg;
+    if (entry->result == 0) {
+        callback_arg->result = 0;
+        callback_arg->write_bytes = entry->write_bytes;
+        callback_arg->inc_alloc = entry->inc_alloc;
+    } else {
+        if (g_combine_handler_ctx.continue_flag &&
+                SF_IS_SERVER_RETRIABLE_ERROR(entry->result) &&
+                slice->retry.count < FS_API_COMBINE_RETRY_MAX_COUNT)
+        {
+            add_to_retry_list(slice, entry->result);
+            return;
+        }
+
+        logError("file: "__FILE__", line: %d, "
+                "slice write fail, block {oid: %"PRId64", "
+                "offset: %"PRId64"}, slice {offset: %d, length: %d}, "
+                "errno: %d, error info: %s, retry count: %d, "
+                "terminating: %d, the data is discarded", __LINE__,
+                slice->bs_key.block.oid, slice->bs_key.block.offset,
+                slice->bs_key.slice.offset, slice->bs_key.slice.length,
+                entry->result, STRERROR(entry->result), slice->retry.count,
+                !g_combine_handler_ctx.continue_flag);
+        callback_arg->result = entry->result;
+        callback_arg->write_bytes = 0;
+        callback_arg->inc_alloc = 0;
+    }
+
+    slice->api_ctx->write_done_callback.func(callback_arg);
+    fast_mblock_free_object(callback_arg->allocator, callback_arg);
+    notify_and_release_slice(slice, entry->result);
+}
+
 static void combine_handler_run(void *arg, void *thread_data)
 {
+    FSAPISliceEntry *slices[FS_API_COMBINE_FLUSH_PIPELINE_DEPTH];
+    FSClientSliceWriteEntry entries[FS_API_COMBINE_FLUSH_PIPELINE_DEPTH];
     FSAPISliceEntry *slice;
-    int result;
+    int count;
+    int i;
 
+    count = 0;
     slice = (FSAPISliceEntry *)arg;
-    result = fs_client_slice_write(slice->api_ctx->fs, &slice->bs_key,
-            slice->buff, &slice->done_callback_arg->write_bytes,
-            &slice->done_callback_arg->inc_alloc);
+    do {
+        slices[count] = slice;
+        entries[count].bs_key = &slice->bs_key;
+        entries[count].data = slice->buff;
+        count++;
+        slice = slice->next;
+    } while (slice != NULL);
+
+    fs_client_slice_write_pipeline(slices[0]->api_ctx->fs, entries, count);
 
     /*
-       slice = (FSAPISliceEntry *)arg;
-       logInfo("slice write block {oid: %"PRId64", offset: %"PRId64"}, "
-            "slice {offset: %d, length: %d}, merged slices: %d, "
-            "stage: %d, result: %d",
-            slice->bs_key.block.oid, slice->bs_key.block.offset,
-            slice->bs_key.slice.offset, slice->bs_key.slice.length,
-            slice->merged_slices, slice->stage, result);
+       logInfo("slice write count: %d, block {oid: %"PRId64", "
+            "offset: %"PRId64"}, slice {offset: %d, length: %d}, "
+            "merged slices: %d, result: %d", count,
+            slices[0]->bs_key.block.oid, slices[0]->bs_key.block.offset,
+            slices[0]->bs_key.slice.offset, slices[0]->bs_key.slice.length,
+            slices[0]->merged_slices, entries[0].result);
        */
 
-    if (result == 0) {
-        slice->api_ctx->write_done_callback.func(slice->done_callback_arg);
+    for (i=0; i<count; i++) {
+        write_done(slices[i], entries + i);
     }
-    fast_mblock_free_object(slice->done_callback_arg->allocator,
-            slice->done_callback_arg);
-    notify_and_release_slice(slice);
+}
 
-    if (result != 0) {
-        sf_terminate_myself();
-    }
+typedef struct {
+    FSClientContext *fs;
+    int data_group_index;
+    int count;
+    FSAPISliceEntry *head;
+    FSAPISliceEntry *tail;
+} CombineFlushBatch;
+
+#define COMBINE_FLUSH_MAX_BATCHES  16
+
+static inline void run_batch(CombineFlushBatch *batch)
+{
+    batch->tail->next = NULL;
+    fc_thread_pool_run(&g_combine_handler_ctx.thread_pool,
+            combine_handler_run, batch->head);
 }
 
-static inline void deal_slices(FSAPISliceEntry *head)
+static void deal_slices(FSAPISliceEntry *head)
 {
+    CombineFlushBatch batches[COMBINE_FLUSH_MAX_BATCHES];
+    CombineFlushBatch *batch;
+    CombineFlushBatch *end;
     FSAPISliceEntry *current;
+    FSClientContext *fs;
+    int data_group_index;
+    int batch_count;
 
+    /* group the slices by the data group for the pipelined write */
+    batch_count = 0;
     do {
         current = head;
         head = head->next;
-
         __sync_sub_and_fetch(&g_combine_handler_ctx.waiting_slice_count, 1);
-        fc_thread_pool_run(&g_combine_handler_ctx.thread_pool,
-                combine_handler_run, current);
+
+        fs = current->api_ctx->fs;
+        data_group_index = FS_CLIENT_DATA_GROUP_INDEX(fs,
+                current->bs_key.block.hash_code);
+        end = batches + batch_count;
+        for (batch=batches; batch<end; batch++) {
+            if (batch->data_group_index == data_group_index &&
+                    batch->fs == fs)
+            {
+                break;
+            }
+        }
+
+        if (batch == end) {
+            if (batch_count == COMBINE_FLUSH_MAX_BATCHES) {
+                for (batch=batches; batch<end; batch++) {
+                    run_batch(batch);
+                }
+                batch_count = 0;
+                batch = batches;
+            }
+            batch->fs = fs;
+            batch->data_group_index = data_group_index;
+            batch->count = 0;
+            batch->head = current;
+            batch_count++;
+        } else {
+            batch->tail->next = current;
+        }
+        batch->tail = current;
+
+        if (++batch->count == FS_API_COMBINE_FLUSH_PIPELINE_DEPTH) {
+            run_batch(batch);
+            *batch = batches[--batch_count];
+        }
     } while (head != NULL);
+
+    end = batches + batch_count;
+    for (batch=batches; batch<end; batch++) {
+        run_batch(batch);
+    }
 }
 
 void combine_handler_terminate()
 {
     FSAPISliceEntry *head;
+    FSAPISliceEntry *slice;
+    FSClientSliceWriteEntry entry;
     int i;
 
     head = (FSAPISliceEntry *)fc_queue_try_pop_all(
@@ -120,7 +306,25 @@ void combine_handler_terminate()
         fc_sleep_ms(30);
     }
 
-    //waiting for thread finish
+    //waiting for thread finish and retry the failed slices
+    for (i=0; i<3; i++) {
+        while (fc_thread_pool_dealing_count(
+                    &g_combine_handler_ctx.thread_pool) > 0)
+        {
+            fc_sleep_ms(10);
+        }
+
+        if ((head=fetch_retry_slices(INT64_MAX)) == NULL) {
+            break;
+        }
+        fc_sleep_ms(FS_API_COMBINE_RETRY_MIN_INTERVAL_MS);
+        for (slice=head; slice!=NULL; slice=slice->next) {
+            __sync_add_and_fetch(&g_combine_handler_ctx.
+                    waiting_slice_count, 1);
+        }
+        deal_slices(head);
+    }
+
     g_combine_handler_ctx.continue_flag = false;
     while (fc_thread_pool_dealing_count(
                 &g_combine_handler_ctx.thread_pool) > 0)
@@ -128,6 +332,15 @@ void combine_handler_terminate()
         fc_sleep_ms(10);
     }
 
+    head = fetch_retry_slices(INT64_MAX);
+    while (head != NULL) {
+        slice = head;
+        head = head->next;
+
+        entry.result = slice->retry.last_errno;
+        write_done(slice, &entry);
+    }
+
     fc_sleep_ms(100);
     logInfo("file: "__FILE__", line: %d, "
             "combine_handler_terminate, running: %d, "
@@ -169,6 +382,12 @@ int combine_handler_init(const int thread_limit,
         return result;
     }
 
+    if ((result=init_pthread_lock(&g_combine_handler_ctx.
+                    retry.lock)) != 0)
+    {
+        return result;
+    }
+
     g_combine_handler_ctx.continue_flag = true;
     if ((result=fc_thread_pool_init(&g_combine_handler_ctx.
                     thread_pool, "slice-merge",
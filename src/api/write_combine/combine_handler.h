@@ -22,11 +22,26 @@
 #include "timeout_handler.h"
 #include "obid_htable.h"
 
+/* the max combined slices of the same data group to write in pipeline */
+#define FS_API_COMBINE_FLUSH_PIPELINE_DEPTH       8
+
+#define FS_API_COMBINE_RETRY_MIN_INTERVAL_MS    100
+#define FS_API_COMBINE_RETRY_MAX_INTERVAL_MS  10000
+
+/* the data is discarded when the write still fail after these retries */
+#define FS_API_COMBINE_RETRY_MAX_COUNT            10
+
 typedef struct {
     volatile int waiting_slice_count;
     struct fc_queue queue;
     FCThreadPool thread_pool;
     volatile bool continue_flag;
+
+    struct {
+        pthread_mutex_t lock;
+        volatile int count;
+        FSAPISliceEntry *head;  //the failed slices to write again
+    } retry;
 } CombineHandlerContext;
 
 #ifdef __cplusplus
@@ -40,6 +55,10 @@ extern "C" {
 
     void combine_handler_terminate();
 
+    /* push the failed slices which retry time expired to the queue,
+     * called by the timeout handler thread */
+    void combine_handler_check_retries(const int64_t current_time_ms);
+
     static inline int combine_handler_push(FSAPISliceEntry *slice)
     {
         int result;
@@ -348,6 +348,8 @@ static int obid_htable_insert_callback(SFShardingHashEntry *he,
             ictx->op_ctx->bs_key.slice.length);
     ictx->slice->bs_key = ictx->op_ctx->bs_key;
     ictx->slice->merged_slices = 1;
+    ictx->slice->retry.count = 0;
+    ictx->slice->retry.last_errno = 0;
     ictx->slice->start_time = g_timer_ms_ctx.current_time_ms;
     ictx->slice->stage = FS_API_COMBINED_WRITER_STAGE_MERGING;
     if (previous == NULL) {
@@ -482,7 +484,7 @@ int wcombine_obid_htable_check_conflict_and_wait(FSAPIOperationContext
     }
 
     if (callback_arg.waiting_task != NULL) {
-        fs_api_wait_write_done_and_release(callback_arg.waiting_task);
+        return fs_api_wait_write_done_and_release(callback_arg.waiting_task);
     }
 
     return 0;
@@ -500,6 +502,8 @@ int wcombine_obid_htable_check_combine_slice(FSAPIInsertSliceContext *ictx)
         if (ictx->waiting_task != NULL) {
             ictx->wbuffer->combined = false;
             ictx->wbuffer->reason = FS_NOT_COMBINED_REASON_WAITING_TIMEOUT;
+            /* the error of the previous write is surfaced to its own
+             * writer, this write goes on */
             fs_api_wait_write_done_and_release(ictx->waiting_task);
         }
     } while (result == 0 && ictx->waiting_task != NULL && count++ < 3);
@@ -71,7 +71,8 @@ extern "C" {
         return result;
     }
 
-    static inline void fs_api_notify_waiting_tasks(FSAPISliceEntry *slice)
+    static inline void fs_api_notify_waiting_tasks(
+            FSAPISliceEntry *slice, const int result)
     {
         FSAPIWaitingTaskSlicePair *ts_pair;
         FSAPIWaitingTask *task;
@@ -82,6 +83,9 @@ extern "C" {
 
             task = (FSAPIWaitingTask *)__sync_add_and_fetch(&ts_pair->task, 0);
             PTHREAD_MUTEX_LOCK(&task->lcp.lock);
+            if (result != 0) {
+                task->result = result;
+            }
             fc_list_del_init(&ts_pair->dlink);
             pthread_cond_signal(&task->lcp.cond);
             PTHREAD_MUTEX_UNLOCK(&task->lcp.lock);
@@ -112,10 +116,12 @@ extern "C" {
         slice->waitings.head = ts_pair;
     }
 
-    static inline void fs_api_wait_write_done_and_release(
+    /* return the write error of the waiting slices */
+    static inline int fs_api_wait_write_done_and_release(
             FSAPIWaitingTask *waiting_task)
     {
         FSAPIWaitingTaskSlicePair *ts_pair;
+        int result;
 
         PTHREAD_MUTEX_LOCK(&waiting_task->lcp.lock);
         while ((ts_pair=fc_list_first_entry(&waiting_task->waitings.head,
@@ -124,8 +130,11 @@ extern "C" {
             pthread_cond_wait(&waiting_task->lcp.cond,
                     &waiting_task->lcp.lock);
         }
+        result = waiting_task->result;
+        waiting_task->result = 0;  //reset for reuse
         PTHREAD_MUTEX_UNLOCK(&waiting_task->lcp.lock);
         fast_mblock_free_object(waiting_task->allocator, waiting_task);
+        return result;
     }
 
 #ifdef __cplusplus
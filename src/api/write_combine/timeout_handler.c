@@ -14,13 +14,17 @@
  */
 
 #include <stdlib.h>
+#include <unistd.h>
+#ifdef OS_LINUX
+#include <sys/timerfd.h>
+#endif
 #include "fastcommon/shared_func.h"
 #include "fastcommon/pthread_func.h"
 #include "sf/sf_global.h"
 #include "combine_handler.h"
 #include "timeout_handler.h"
 
-TimeHandlerContext g_timer_ms_ctx = {10, 0};
+TimeHandlerContext g_timer_ms_ctx = {10, -1, 0};
 
 #define SET_CURRENT_TIME_TICKS()  \
     g_timer_ms_ctx.current_time_ms = get_current_time_ms(); \
@@ -71,6 +75,23 @@ void timeout_handler_terminate()
     }
 }
 
+static inline void wait_next_tick()
+{
+#ifdef OS_LINUX
+    uint64_t expirations;
+
+    if (g_timer_ms_ctx.timer_fd >= 0) {
+        if (read(g_timer_ms_ctx.timer_fd, &expirations,
+                    sizeof(expirations)) > 0)
+        {
+            return;
+        }
+    }
+#endif
+
+    fc_sleep_ms(1);
+}
+
 static void *timeout_handler_thread_func(void *arg)
 {
     int64_t last_time_ticks;
@@ -96,9 +117,11 @@ static void *timeout_handler_thread_func(void *arg)
                         */
                 deal_timeouts(&head);
             }
+
+            combine_handler_check_retries(g_timer_ms_ctx.current_time_ms);
         }
 
-        fc_sleep_ms(1);
+        wait_next_tick();
     }
 
     __sync_sub_and_fetch(&g_timer_ms_ctx.running_threads, 1);
@@ -125,9 +148,43 @@ int timeout_handler_init(const int precision_ms, const int max_timeout_ms,
     return 0;
 }
 
+static void timer_fd_init()
+{
+#ifdef OS_LINUX
+    struct itimerspec its;
+    int result;
+
+    /* tick by the precision instead of polling every millisecond */
+    if ((g_timer_ms_ctx.timer_fd=timerfd_create(
+                    CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+    {
+        result = errno != 0 ? errno : EPERM;
+        logWarning("file: "__FILE__", line: %d, "
+                "timerfd_create fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        return;
+    }
+
+    its.it_interval.tv_sec = g_timer_ms_ctx.precision_ms / 1000;
+    its.it_interval.tv_nsec = (g_timer_ms_ctx.precision_ms % 1000) *
+        1000 * 1000;
+    its.it_value = its.it_interval;
+    if (timerfd_settime(g_timer_ms_ctx.timer_fd, 0, &its, NULL) != 0) {
+        result = errno != 0 ? errno : EPERM;
+        logWarning("file: "__FILE__", line: %d, "
+                "timerfd_settime fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        close(g_timer_ms_ctx.timer_fd);
+        g_timer_ms_ctx.timer_fd = -1;
+    }
+#endif
+}
+
 int timeout_handler_start()
 {
     pthread_t tid;
+
+    timer_fd_init();
     return fc_create_thread(&tid, timeout_handler_thread_func,
             NULL, SF_G_THREAD_STACK_SIZE);
 }
@@ -20,6 +20,7 @@
 
 typedef struct {
     int precision_ms;
+    int timer_fd;  //the timerfd for the tick, -1 for sleep polling
     volatile char running_threads;
     volatile int64_t current_time_ms;
     volatile int64_t current_time_ticks;  //unit: precision_ms
@@ -153,6 +153,7 @@ int fs_client_init_ex1(FSClientContext *client_ctx,
         const SFConnectionManager *cm, const bool bg_thread_enabled)
 {
     int result;
+    int bytes;
 
     client_ctx->cluster_cfg.ptr = &client_ctx->cluster_cfg.holder;
     if ((result=fs_client_load_from_file_ex1(client_ctx,
@@ -161,6 +162,15 @@ int fs_client_init_ex1(FSClientContext *client_ctx,
         return result;
     }
 
+    bytes = sizeof(uint64_t) * FS_DATA_GROUP_COUNT(
+            *client_ctx->cluster_cfg.ptr);
+    client_ctx->session.data_versions = (volatile uint64_t *)
+        fc_malloc(bytes);
+    if (client_ctx->session.data_versions == NULL) {
+        return ENOMEM;
+    }
+    memset((void *)client_ctx->session.data_versions, 0, bytes);
+
     if (cm == NULL) {
         if ((result=fs_simple_connection_manager_init(client_ctx,
                         &client_ctx->cm, bg_thread_enabled)) != 0)
@@ -188,5 +198,8 @@ void fs_client_destroy_ex(FSClientContext *client_ctx)
     if (client_ctx->is_simple_conn_mananger) {
         fs_simple_connection_manager_destroy(&client_ctx->cm);
     }
+    if (client_ctx->session.data_versions != NULL) {
+        free((void *)client_ctx->session.data_versions);
+    }
     memset(client_ctx, 0, sizeof(FSClientContext));
 }
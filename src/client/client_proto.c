@@ -31,10 +31,43 @@ static inline void proto_pack_block_key(const FSBlockKey *
     long2buff(bkey->offset, proto_bkey->offset);
 }
 
-int fs_client_proto_slice_write(FSClientContext *client_ctx,
+static inline void session_update_data_version(FSClientContext *client_ctx,
+        const uint32_t hash_code, const char *data_version)
+{
+    volatile uint64_t *session_version;
+    uint64_t old_version;
+    uint64_t new_version;
+
+    if (client_ctx->session.data_versions == NULL) {
+        return;
+    }
+
+    new_version = buff2long(data_version);
+    session_version = client_ctx->session.data_versions +
+        FS_CLIENT_DATA_GROUP_INDEX(client_ctx, hash_code);
+    do {
+        old_version = FC_ATOMIC_GET(*session_version);
+        if (new_version <= old_version) {
+            break;
+        }
+    } while (!__sync_bool_compare_and_swap(session_version,
+                old_version, new_version));
+}
+
+static inline uint64_t session_get_data_version(
+        FSClientContext *client_ctx, const uint32_t hash_code)
+{
+    if (client_ctx->session.data_versions == NULL) {
+        return 0;
+    }
+
+    return FC_ATOMIC_GET(client_ctx->session.data_versions[
+            FS_CLIENT_DATA_GROUP_INDEX(client_ctx, hash_code)]);
+}
+
+int fs_client_proto_slice_write_send(FSClientContext *client_ctx,
         ConnectionInfo *conn, const uint64_t req_id,
-        const FSBlockSliceKeyInfo *bs_key, const char *data,
-        int *inc_alloc)
+        const FSBlockSliceKeyInfo *bs_key, const char *data)
 {
     char out_buff[sizeof(FSProtoHeader) +
         SF_PROTO_UPDATE_EXTRA_BODY_SIZE +
@@ -42,44 +75,48 @@ int fs_client_proto_slice_write(FSClientContext *client_ctx,
     FSProtoHeader *proto_header;
     FSProtoSliceWriteReqHeader *req_header;
     SFResponseInfo response;
-    FSProtoSliceUpdateResp resp;
     int result;
     int front_bytes;
 
     SF_PROTO_CLIENT_SET_REQ(client_ctx, out_buff, proto_header,
             req_header, req_id, front_bytes);
     proto_pack_block_key(&bs_key->block, &req_header->bs.bkey);
+    SF_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_WRITE_REQ,
+            front_bytes + bs_key->slice.length - sizeof(FSProtoHeader));
+    int2buff(bs_key->slice.offset, req_header->bs.slice_size.offset);
+    int2buff(bs_key->slice.length, req_header->bs.slice_size.length);
 
-    response.error.length = 0;
-    do {
-        SF_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_WRITE_REQ,
-                front_bytes + bs_key->slice.length - sizeof(FSProtoHeader));
-        int2buff(bs_key->slice.offset, req_header->bs.slice_size.offset);
-        int2buff(bs_key->slice.length, req_header->bs.slice_size.length);
-
-        if ((result=tcpsenddata_nb(conn->sock, out_buff, front_bytes,
-                        client_ctx->common_cfg.network_timeout)) != 0)
-        {
-            break;
-        }
+    if ((result=tcpsenddata_nb(conn->sock, out_buff, front_bytes,
+                    client_ctx->common_cfg.network_timeout)) == 0)
+    {
+        result = tcpsenddata_nb(conn->sock, (char *)data, bs_key->slice.
+                length, client_ctx->common_cfg.network_timeout);
+    }
 
-        if ((result=tcpsenddata_nb(conn->sock, (char *)data, bs_key->slice.
-                        length, client_ctx->common_cfg.network_timeout)) != 0)
-        {
-            break;
-        }
+    if (result != 0) {
+        response.error.length = 0;
+        sf_log_network_error_for_update(&response, conn, result);
+    }
+    return result;
+}
 
-        if ((result=sf_recv_response(conn, &response, client_ctx->common_cfg.
-                        network_timeout, FS_SERVICE_PROTO_SLICE_WRITE_RESP,
-                        (char *)&resp, sizeof(FSProtoSliceUpdateResp))) != 0)
-        {
-            break;
-        }
+int fs_client_proto_slice_write_recv(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const FSBlockSliceKeyInfo *bs_key,
+        int *inc_alloc)
+{
+    SFResponseInfo response;
+    FSProtoSliceUpdateResp resp;
+    int result;
 
+    response.error.length = 0;
+    if ((result=sf_recv_response(conn, &response, client_ctx->common_cfg.
+                    network_timeout, FS_SERVICE_PROTO_SLICE_WRITE_RESP,
+                    (char *)&resp, sizeof(FSProtoSliceUpdateResp))) == 0)
+    {
         *inc_alloc = buff2int(resp.inc_alloc);
-    } while (0);
-
-    if (result != 0) {
+        session_update_data_version(client_ctx,
+                bs_key->block.hash_code, resp.data_version);
+    } else {
         *inc_alloc = 0;
         sf_log_network_error_for_update(&response, conn, result);
     }
@@ -87,6 +124,24 @@ int fs_client_proto_slice_write(FSClientContext *client_ctx,
     return result;
 }
 
+int fs_client_proto_slice_write(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const uint64_t req_id,
+        const FSBlockSliceKeyInfo *bs_key, const char *data,
+        int *inc_alloc)
+{
+    int result;
+
+    if ((result=fs_client_proto_slice_write_send(client_ctx,
+                    conn, req_id, bs_key, data)) != 0)
+    {
+        *inc_alloc = 0;
+        return result;
+    }
+
+    return fs_client_proto_slice_write_recv(client_ctx,
+            conn, bs_key, inc_alloc);
+}
+
 int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
         ConnectionInfo *conn, const int slave_id, const int req_cmd,
         const int resp_cmd, const FSBlockSliceKeyInfo *bs_key,
@@ -102,6 +157,7 @@ int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
     FSProtoServiceSliceReadReq *sreq;
     FSProtoReplicaSliceReadReq *rreq;
     FSProtoBlockSlice *proto_bs;
+    uint64_t data_version;
     int out_bytes;
     int hole_start;
     int hole_len;
@@ -114,11 +170,15 @@ int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
     if (req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ) {
         SF_PROTO_CLIENT_SET_REQ(client_ctx, out_buff,
                 header, sreq, 0, out_bytes);
+        data_version = session_get_data_version(client_ctx,
+                bs_key->block.hash_code);
+        long2buff(data_version, sreq->data_version);
         proto_bs = &sreq->bs;
     } else {
         SF_PROTO_CLIENT_SET_REQ(client_ctx, out_buff,
                 header, rreq, 0, out_bytes);
         int2buff(slave_id, rreq->slave_id);
+        data_version = 0;
         proto_bs = &rreq->bs;
     }
     SF_PROTO_SET_HEADER(header, req_cmd,
@@ -197,7 +257,9 @@ int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
         remain -= curr_len;
     }
 
-    if (result != 0) {
+    /* EAGAIN for the server behind the session data version,
+     * the caller will read from the master */
+    if (result != 0 && !(result == EAGAIN && data_version > 0)) {
         sf_log_network_error(&response, conn, result);
     }
 
@@ -229,6 +291,11 @@ int fs_client_proto_bs_operate(FSClientContext *client_ctx,
         return fs_client_proto_block_delete(client_ctx, conn, req_id,
                 (const FSBlockKey *)key, enoent_log_level, inc_alloc);
     }
+    if (req_cmd == FS_SERVICE_PROTO_BLOCK_CLONE_REQ) {
+        return fs_client_proto_block_clone(client_ctx, conn, req_id,
+                (const FSClientBlockCloneKey *)key,
+                enoent_log_level, inc_alloc);
+    }
 
     SF_PROTO_CLIENT_SET_REQ(client_ctx, out_buff,
             header, req, req_id, out_bytes);
@@ -247,6 +314,8 @@ int fs_client_proto_bs_operate(FSClientContext *client_ctx,
                     sizeof(FSProtoSliceUpdateResp))) == 0)
     {
         *inc_alloc = buff2int(resp.inc_alloc);
+        session_update_data_version(client_ctx,
+                bs_key->block.hash_code, resp.data_version);
     } else {
         *inc_alloc = 0;
         sf_log_network_error_for_delete(&response, conn,
@@ -284,6 +353,8 @@ int fs_client_proto_block_delete(FSClientContext *client_ctx,
                     sizeof(FSProtoSliceUpdateResp))) == 0)
     {
         *dec_alloc = buff2int(resp.inc_alloc);
+        session_update_data_version(client_ctx,
+                bkey->hash_code, resp.data_version);
     } else {
         *dec_alloc = 0;
         sf_log_network_error_for_delete(&response, conn,
@@ -293,6 +364,46 @@ int fs_client_proto_block_delete(FSClientContext *client_ctx,
     return result;
 }
 
+int fs_client_proto_block_clone(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const uint64_t req_id,
+        const FSClientBlockCloneKey *key, const int enoent_log_level,
+        int *inc_alloc)
+{
+    char out_buff[sizeof(FSProtoHeader) +
+        SF_PROTO_UPDATE_EXTRA_BODY_SIZE +
+        sizeof(FSProtoBlockCloneReq)];
+    FSProtoHeader *header;
+    FSProtoBlockCloneReq *req;
+    SFResponseInfo response;
+    FSProtoSliceUpdateResp resp;
+    int result;
+    int out_bytes;
+
+    SF_PROTO_CLIENT_SET_REQ(client_ctx, out_buff,
+            header, req, req_id, out_bytes);
+    SF_PROTO_SET_HEADER(header, FS_SERVICE_PROTO_BLOCK_CLONE_REQ,
+            out_bytes - sizeof(FSProtoHeader));
+    proto_pack_block_key(&key->bkey, &req->bkey);
+    long2buff(key->src_oid, req->src_oid);
+
+    response.error.length = 0;
+    if ((result=sf_send_and_recv_response(conn, out_buff, out_bytes,
+                    &response, client_ctx->common_cfg.network_timeout,
+                    FS_SERVICE_PROTO_BLOCK_CLONE_RESP, (char *)&resp,
+                    sizeof(FSProtoSliceUpdateResp))) == 0)
+    {
+        *inc_alloc = buff2int(resp.inc_alloc);
+        session_update_data_version(client_ctx,
+                key->bkey.hash_code, resp.data_version);
+    } else {
+        *inc_alloc = 0;
+        sf_log_network_error_for_delete(&response, conn,
+                result, enoent_log_level);
+    }
+
+    return result;
+}
+
 int fs_client_proto_join_server(FSClientContext *client_ctx,
         ConnectionInfo *conn, SFConnectionParameters *conn_params)
 {
@@ -626,6 +737,26 @@ int fs_client_proto_server_group_space_stat(FSClientContext *client_ctx,
     return result;
 }
 
+static void unpack_data_thread_stat(const FSProtoDataThreadStat *proto_stat,
+        FSDataThreadStat *stat)
+{
+    stat->thread_count = buff2int(proto_stat->thread_count);
+    stat->busy_count = buff2int(proto_stat->busy_count);
+    stat->waiting_count = buff2int(proto_stat->waiting_count);
+    stat->max_waiting_count = buff2int(proto_stat->max_waiting_count);
+    stat->done_count = buff2long(proto_stat->done_count);
+    stat->stolen_count = buff2long(proto_stat->stolen_count);
+    stat->donated_count = buff2long(proto_stat->donated_count);
+}
+
+static inline void unpack_throttle_rate_stat(
+        const FSProtoThrottleRateStat *proto_stat,
+        FSThrottleRateStat *stat)
+{
+    stat->current = buff2long(proto_stat->current);
+    stat->target = buff2long(proto_stat->target);
+}
+
 int fs_client_proto_service_stat(FSClientContext *client_ctx,
         const ConnectionInfo *spec_conn, const int data_group_id,
         FSClientServiceStat *stat)
@@ -687,5 +818,200 @@ int fs_client_proto_service_stat(FSClientContext *client_ctx,
     stat->data.ob_count = buff2long(stat_resp.data.ob_count);
     stat->data.slice_count = buff2long(stat_resp.data.slice_count);
 
+    unpack_data_thread_stat(&stat_resp.data_thread.master,
+            &stat->data_thread.master);
+    unpack_data_thread_stat(&stat_resp.data_thread.slave,
+            &stat->data_thread.slave);
+
+    stat->background_throttle.latency_p99 = buff2int(
+            stat_resp.background_throttle.latency_p99);
+    stat->background_throttle.queue_depth = buff2int(
+            stat_resp.background_throttle.queue_depth);
+    unpack_throttle_rate_stat(&stat_resp.background_throttle.recovery,
+            &stat->background_throttle.recovery);
+    unpack_throttle_rate_stat(&stat_resp.background_throttle.reclaim,
+            &stat->background_throttle.reclaim);
+
     return 0;
 }
+
+int fs_client_proto_latency_stat(FSClientContext *client_ctx,
+        const ConnectionInfo *spec_conn, FSLatencyStatEntry *entries,
+        const int size, int *count)
+{
+    char out_buff[sizeof(FSProtoHeader) +
+        SF_PROTO_QUERY_EXTRA_BODY_SIZE];
+    char in_buff[4 * 1024];
+    FSProtoHeader *proto_header;
+    SFProtoEmptyBodyReq *req;
+    FSProtoLatencyStatRespBodyHeader *body_header;
+    FSProtoLatencyStatRespBodyPart *body_part;
+    FSLatencyStatEntry *entry;
+    FSLatencyStatEntry *end;
+    ConnectionInfo *conn;
+    SFResponseInfo response;
+    int out_bytes;
+    int body_len;
+    int expect_len;
+    int result;
+
+    if ((conn=client_ctx->cm.ops.get_spec_connection(&client_ctx->cm,
+                    spec_conn, &result)) == NULL)
+    {
+        return result;
+    }
+
+    SF_PROTO_CLIENT_SET_REQ(client_ctx, out_buff,
+            proto_header, req, 0, out_bytes);
+    SF_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_LATENCY_STAT_REQ,
+            out_bytes - sizeof(FSProtoHeader));
+    response.error.length = 0;
+    do {
+        if ((result=sf_send_and_recv_response_ex1(conn, out_buff, out_bytes,
+                        &response, client_ctx->common_cfg.network_timeout,
+                        FS_SERVICE_PROTO_LATENCY_STAT_RESP, in_buff,
+                        sizeof(in_buff), &body_len)) != 0)
+        {
+            break;
+        }
+
+        if (body_len < sizeof(FSProtoLatencyStatRespBodyHeader)) {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message), "invalid response "
+                    "body length: %d < min length: %d", body_len,
+                    (int)sizeof(FSProtoLatencyStatRespBodyHeader));
+            result = EINVAL;
+            break;
+        }
+
+        body_header = (FSProtoLatencyStatRespBodyHeader *)in_buff;
+        *count = buff2int(body_header->count);
+        expect_len = sizeof(*body_header) + sizeof(*body_part) * (*count);
+        if (body_len != expect_len) {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message), "invalid response "
+                    "body length: %d != expect length: %d",
+                    body_len, expect_len);
+            result = EINVAL;
+            break;
+        }
+
+        if (*count > size) {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message), "response entry "
+                    "count: %d exceeds entry size: %d", *count, size);
+            result = ENOSPC;
+            break;
+        }
+
+        body_part = (FSProtoLatencyStatRespBodyPart *)(body_header + 1);
+        end = entries + *count;
+        for (entry=entries; entry<end; entry++, body_part++) {
+            entry->stage = body_part->stage;
+            entry->op_type = body_part->op_type;
+            entry->count = buff2long(body_part->count);
+            entry->avg = buff2int(body_part->avg);
+            entry->max = buff2int(body_part->max);
+            entry->p50 = buff2int(body_part->p50);
+            entry->p90 = buff2int(body_part->p90);
+            entry->p99 = buff2int(body_part->p99);
+            entry->p999 = buff2int(body_part->p999);
+        }
+    } while (0);
+
+    if (result != 0) {
+        *count = 0;
+        sf_log_network_error(&response, conn, result);
+    }
+
+    SF_CLIENT_RELEASE_CONNECTION(&client_ctx->cm, conn, result);
+    return result;
+}
+
+int fs_client_proto_dg_space_stat(FSClientContext *client_ctx,
+        ConnectionInfo *conn, FSClientDataGroupSpaceStat *stats,
+        const int size, int *count)
+{
+    char out_buff[sizeof(FSProtoHeader) +
+        SF_PROTO_QUERY_EXTRA_BODY_SIZE];
+    char fixed_buff[16 * 1024];
+    char *in_buff;
+    FSProtoHeader *proto_header;
+    SFProtoEmptyBodyReq *req;
+    FSProtoDGSpaceStatRespBodyHeader *body_header;
+    FSProtoDGSpaceStatRespBodyPart *body_part;
+    FSClientDataGroupSpaceStat *stat;
+    FSClientDataGroupSpaceStat *end;
+    SFResponseInfo response;
+    int out_bytes;
+    int expect_len;
+    int result;
+
+    SF_PROTO_CLIENT_SET_REQ(client_ctx, out_buff,
+            proto_header, req, 0, out_bytes);
+    SF_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_DG_SPACE_STAT_REQ,
+            out_bytes - sizeof(FSProtoHeader));
+
+    in_buff = fixed_buff;
+    response.error.length = 0;
+    if ((result=sf_send_and_check_response_header(conn, out_buff, out_bytes,
+                    &response, client_ctx->common_cfg.network_timeout,
+                    FS_SERVICE_PROTO_DG_SPACE_STAT_RESP)) == 0)
+    {
+        if (response.header.body_len > sizeof(fixed_buff)) {
+            in_buff = (char *)fc_malloc(response.header.body_len);
+            if (in_buff == NULL) {
+                response.error.length = sprintf(response.error.message,
+                        "malloc %d bytes fail", response.header.body_len);
+                result = ENOMEM;
+            }
+        }
+
+        if (result == 0) {
+            result = tcprecvdata_nb(conn->sock, in_buff, response.header.
+                    body_len, client_ctx->common_cfg.network_timeout);
+        }
+    }
+
+    body_header = (FSProtoDGSpaceStatRespBodyHeader *)in_buff;
+    if (result == 0) {
+        if (response.header.body_len < sizeof(*body_header)) {
+            response.error.length = sprintf(response.error.message,
+                    "invalid response body length: %d < min length: %d",
+                    response.header.body_len, (int)sizeof(*body_header));
+            result = EINVAL;
+        } else {
+            *count = buff2int(body_header->count);
+            expect_len = sizeof(*body_header) +
+                sizeof(*body_part) * (*count);
+            if (response.header.body_len != expect_len) {
+                response.error.length = sprintf(response.error.message,
+                        "response body length: %d != expect length: %d",
+                        response.header.body_len, expect_len);
+                result = EINVAL;
+            } else if (*count > size) {
+                response.error.length = sprintf(response.error.message,
+                        "response entry count: %d exceeds entry size: %d",
+                        *count, size);
+                result = ENOSPC;
+            }
+        }
+    }
+
+    if (result != 0) {
+        *count = 0;
+        sf_log_network_error(&response, conn, result);
+    } else {
+        body_part = (FSProtoDGSpaceStatRespBodyPart *)(body_header + 1);
+        end = stats + *count;
+        for (stat=stats; stat<end; stat++, body_part++) {
+            stat->data_group_id = buff2int(body_part->data_group_id);
+            stat->used = buff2long(body_part->used);
+        }
+    }
+
+    if (in_buff != fixed_buff && in_buff != NULL) {
+        free(in_buff);
+    }
+    return result;
+}
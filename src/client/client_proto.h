@@ -41,6 +41,13 @@ typedef struct fs_client_service_stat {
         int64_t slice_count;
     } data;
 
+    struct {
+        FSDataThreadStat master;
+        FSDataThreadStat slave;
+    } data_thread;
+
+    FSBackgroundThrottleStat background_throttle;
+
 } FSClientServiceStat;
 
 #ifdef __cplusplus
@@ -58,6 +65,16 @@ extern "C" {
             const FSBlockSliceKeyInfo *bs_key, const char *data,
             int *inc_alloc);
 
+    /* the send and receive halves of fs_client_proto_slice_write
+     * for the pipelined writes */
+    int fs_client_proto_slice_write_send(FSClientContext *client_ctx,
+            ConnectionInfo *conn, const uint64_t req_id,
+            const FSBlockSliceKeyInfo *bs_key, const char *data);
+
+    int fs_client_proto_slice_write_recv(FSClientContext *client_ctx,
+            ConnectionInfo *conn, const FSBlockSliceKeyInfo *bs_key,
+            int *inc_alloc);
+
     int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
             ConnectionInfo *conn, const int slave_id, const int req_cmd,
             const int resp_cmd, const FSBlockSliceKeyInfo *bs_key,
@@ -73,6 +90,11 @@ extern "C" {
             const FSBlockKey *bkey, const int enoent_log_level,
             int *dec_alloc);
 
+    int fs_client_proto_block_clone(FSClientContext *client_ctx,
+            ConnectionInfo *conn, const uint64_t req_id,
+            const FSClientBlockCloneKey *key, const int enoent_log_level,
+            int *inc_alloc);
+
     int fs_client_proto_join_server(FSClientContext *client_ctx,
             ConnectionInfo *conn, SFConnectionParameters *conn_params);
 
@@ -94,6 +116,14 @@ extern "C" {
             const ConnectionInfo *spec_conn, const int data_group_id,
             FSClientServiceStat *stat);
 
+    int fs_client_proto_latency_stat(FSClientContext *client_ctx,
+            const ConnectionInfo *spec_conn, FSLatencyStatEntry *entries,
+            const int size, int *count);
+
+    int fs_client_proto_dg_space_stat(FSClientContext *client_ctx,
+            ConnectionInfo *conn, FSClientDataGroupSpaceStat *stats,
+            const int size, int *count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -58,6 +58,25 @@ typedef struct fs_client_server_space_stat {
     FSClusterSpaceStat stat;
 } FSClientServerSpaceStat;
 
+typedef struct fs_client_data_group_space_stat {
+    int data_group_id;
+    int64_t used;  //the trunk space used by the data group on the server
+} FSClientDataGroupSpaceStat;
+
+typedef struct fs_client_slice_write_entry {
+    const FSBlockSliceKeyInfo *bs_key;
+    const char *data;
+    uint64_t req_id;
+    int write_bytes;
+    int inc_alloc;
+    int result;
+} FSClientSliceWriteEntry;
+
+typedef struct fs_client_block_clone_key {
+    FSBlockKey bkey;  //the dest block
+    int64_t src_oid;  //the source object ID with the same block offset
+} FSClientBlockCloneKey;
+
 typedef struct fs_client_context {
     struct {
         FSClusterConfig *ptr;
@@ -71,6 +90,11 @@ typedef struct fs_client_context {
     SFClientCommonConfig common_cfg;
     SFConnectionManager cm;
     FCFSAuthClientFullContext auth;
+    struct {
+        /* the max data version of the updates per data group for read
+         * your writes from the slaves, NULL for disabled */
+        volatile uint64_t *data_versions;
+    } session;
 } FSClientContext;
 
 
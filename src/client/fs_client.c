@@ -59,6 +59,51 @@ int fs_unlink_file(FSClientContext *client_ctx, const int64_t oid,
     return result;
 }
 
+int fs_clone_file(FSClientContext *client_ctx, const int64_t src_oid,
+        const int64_t dest_oid, const int64_t file_size)
+{
+    FSClientBlockCloneKey key;
+    FSBlockKey src_bkey;
+    int64_t remain;
+    int result;
+    int inc_alloc;
+
+    if (file_size == 0) {
+        return 0;
+    }
+
+    fs_set_block_key(&key.bkey, dest_oid, 0);
+    fs_set_block_key(&src_bkey, src_oid, 0);
+    if (FS_CLIENT_DATA_GROUP_INDEX(client_ctx, key.bkey.hash_code) !=
+            FS_CLIENT_DATA_GROUP_INDEX(client_ctx, src_bkey.hash_code))
+    {
+        logError("file: "__FILE__", line: %d, "
+                "the data groups of source oid: %"PRId64" and dest oid: "
+                "%"PRId64" are different", __LINE__, src_oid, dest_oid);
+        return EXDEV;
+    }
+
+    key.src_oid = src_oid;
+    remain = file_size;
+    while (1) {
+        result = fs_client_block_clone(client_ctx, &key, &inc_alloc);
+        if (result == ENOENT) {  //both blocks are empty
+            result = 0;
+        } else if (result != 0) {
+            break;
+        }
+
+        remain -= FS_FILE_BLOCK_SIZE;
+        if (remain <= 0) {
+            break;
+        }
+
+        fs_next_block_key(&key.bkey);
+    }
+
+    return result;
+}
+
 static int stat_data_group_by_addresses(FSClientContext *client_ctx,
         const FSClusterStatFilter *filter, FCAddressPtrArray *addr_ptr_array,
         FSIdArray *gid_array, FSClientClusterStatEntryArray *cs_array)
@@ -384,6 +429,118 @@ int fs_client_slice_write(FSClientContext *client_ctx,
     return SF_UNIX_ERRNO(result, EIO);
 }
 
+int fs_client_slice_write_pipeline(FSClientContext *client_ctx,
+        FSClientSliceWriteEntry *entries, const int count)
+{
+    const SFConnectionParameters *connection_params;
+    ConnectionInfo *conn;
+    FSClientSliceWriteEntry *entry;
+    FSClientSliceWriteEntry *end;
+    FSClientSliceWriteEntry *sent_end;
+    FSClientSliceWriteEntry *recv_end;
+    bool dirty;
+    int result;
+
+    end = entries + count;
+    for (entry=entries; entry<end; entry++) {
+        entry->write_bytes = entry->inc_alloc = 0;
+        entry->result = EAGAIN;
+    }
+
+    if ((conn=client_ctx->cm.ops.get_master_connection(&client_ctx->cm,
+                    FS_CLIENT_DATA_GROUP_INDEX(client_ctx, entries->
+                        bs_key->block.hash_code), &result)) != NULL)
+    {
+        connection_params = client_ctx->cm.ops.get_connection_params(
+                &client_ctx->cm, conn);
+        if (client_ctx->idempotency_enabled) {
+            result = idempotency_client_channel_check_wait(
+                    connection_params->channel);
+        } else {
+            result = 0;
+        }
+
+        dirty = false;
+        sent_end = recv_end = entries;
+        if (result == 0) {
+            for (entry=entries; entry<end; entry++) {
+                /* the large slice need split, write it one by one */
+                if (entry->bs_key->slice.length >
+                        connection_params->buffer_size)
+                {
+                    continue;
+                }
+
+                if (client_ctx->idempotency_enabled) {
+                    entry->req_id = idempotency_client_channel_next_seq_id(
+                            connection_params->channel);
+                } else {
+                    entry->req_id = 0;
+                }
+                if ((result=fs_client_proto_slice_write_send(client_ctx,
+                                conn, entry->req_id, entry->bs_key,
+                                entry->data)) != 0)
+                {
+                    dirty = true;  //maybe partial sent
+                    break;
+                }
+                entry->result = EINPROGRESS;
+                sent_end = entry + 1;
+            }
+
+            for (entry=entries; entry<sent_end; entry++) {
+                if (entry->result != EINPROGRESS) {
+                    continue;
+                }
+
+                entry->result = fs_client_proto_slice_write_recv(client_ctx,
+                        conn, entry->bs_key, &entry->inc_alloc);
+                if (client_ctx->idempotency_enabled &&
+                        !SF_IS_SERVER_RETRIABLE_ERROR(entry->result))
+                {
+                    idempotency_client_channel_push(
+                            connection_params->channel, entry->req_id);
+                }
+                if (entry->result != 0) {
+                    result = entry->result;
+                    entry++;
+                    break;
+                }
+                entry->write_bytes = entry->bs_key->slice.length;
+            }
+            recv_end = entry;
+        }
+
+        /* the responses of the pipeline left, the connection is dirty */
+        for (entry=recv_end; entry<sent_end; entry++) {
+            if (entry->result == EINPROGRESS) {
+                entry->result = EAGAIN;
+                dirty = true;
+            }
+        }
+
+        if (dirty) {
+            client_ctx->cm.ops.close_connection(&client_ctx->cm, conn);
+        } else {
+            SF_CLIENT_RELEASE_CONNECTION(&client_ctx->cm, conn, result);
+        }
+    }
+
+    result = 0;
+    for (entry=entries; entry<end; entry++) {
+        if (entry->result != 0) {
+            entry->result = fs_client_slice_write(client_ctx,
+                    entry->bs_key, entry->data, &entry->write_bytes,
+                    &entry->inc_alloc);
+            if (entry->result != 0 && result == 0) {
+                result = entry->result;
+            }
+        }
+    }
+
+    return result;
+}
+
 int fs_client_slice_read_ex(FSClientContext *client_ctx,
         const int slave_id, const int req_cmd, const int resp_cmd,
         const FSBlockSliceKeyInfo *bs_key, char *buff, int *read_bytes)
@@ -394,6 +551,7 @@ int fs_client_slice_read_ex(FSClientContext *client_ctx,
     int remain;
     int bytes;
     int i;
+    bool from_master;
     SFNetRetryIntervalContext net_retry_ctx;
 
     if ((conn=client_ctx->cm.ops.get_readable_connection(&client_ctx->cm,
@@ -410,6 +568,7 @@ int fs_client_slice_read_ex(FSClientContext *client_ctx,
     *read_bytes = 0;
     new_key = *bs_key;
     remain = bs_key->slice.length;
+    from_master = false;
     i = 0;
     while (remain > 0) {
         if ((result=fs_client_proto_slice_read_ex(client_ctx, conn,
@@ -420,21 +579,35 @@ int fs_client_slice_read_ex(FSClientContext *client_ctx,
             break;
         }
 
-        SF_NET_RETRY_CHECK_AND_SLEEP(net_retry_ctx, client_ctx->common_cfg.
-                net_retry_cfg.network.times, ++i, result);
+        if (result == EAGAIN && !from_master &&
+                req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ)
+        {
+            /* the server is behind the data version of the session */
+            SF_CLIENT_RELEASE_CONNECTION(&client_ctx->cm, conn, result);
+            if ((conn=client_ctx->cm.ops.get_master_connection(&client_ctx->
+                            cm, FS_CLIENT_DATA_GROUP_INDEX(client_ctx,
+                                bs_key->block.hash_code), &result)) == NULL)
+            {
+                break;
+            }
+            from_master = true;
+        } else {
+            SF_NET_RETRY_CHECK_AND_SLEEP(net_retry_ctx, client_ctx->
+                    common_cfg.net_retry_cfg.network.times, ++i, result);
 
-        /*
-        logInfo("file: "__FILE__", line: %d, func: %s, "
-                "net retry result: %d, retry count: %d",
-                __LINE__, __FUNCTION__, result, i);
-                */
+            /*
+            logInfo("file: "__FILE__", line: %d, func: %s, "
+                    "net retry result: %d, retry count: %d",
+                    __LINE__, __FUNCTION__, result, i);
+                    */
 
-        SF_CLIENT_RELEASE_CONNECTION(&client_ctx->cm, conn, result);
-        if ((conn=client_ctx->cm.ops.get_readable_connection(&client_ctx->cm,
-                        FS_CLIENT_DATA_GROUP_INDEX(client_ctx, bs_key->block.
-                            hash_code), &result)) == NULL)
-        {
-            break;
+            SF_CLIENT_RELEASE_CONNECTION(&client_ctx->cm, conn, result);
+            if ((conn=client_ctx->cm.ops.get_readable_connection(&client_ctx->
+                            cm, FS_CLIENT_DATA_GROUP_INDEX(client_ctx,
+                                bs_key->block.hash_code), &result)) == NULL)
+            {
+                break;
+            }
         }
 
         *read_bytes += bytes;
@@ -491,6 +664,16 @@ int fs_client_server_group_space_stat(FSClientContext *client_ctx,
             stats, size, count);
 }
 
+int fs_client_server_dg_space_stat(FSClientContext *client_ctx,
+        FCServerInfo *server, FSClientDataGroupSpaceStat *stats,
+        const int size, int *count)
+{
+    SF_CLIENT_IDEMPOTENCY_QUERY_WRAPPER(client_ctx, &client_ctx->cm,
+            GET_LEADER_CONNECTION, server,
+            fs_client_proto_dg_space_stat,
+            stats, size, count);
+}
+
 static int cluster_space_stat(FSClientContext *client_ctx,
         SkiplistSet *sl, FSClusterSpaceStat *stat)
 {
@@ -78,6 +78,12 @@ static inline void fs_next_block_slice_key(FSBlockSliceKeyInfo *bs_key,
 int fs_unlink_file(FSClientContext *client_ctx, const int64_t oid,
         const int64_t file_size);
 
+/* clone the object as a snapshot by sharing the slices (copy on write),
+ * the dest_oid MUST be congruent with src_oid modulo the data group count,
+ * return EXDEV when the blocks belong to the different data groups */
+int fs_clone_file(FSClientContext *client_ctx, const int64_t src_oid,
+        const int64_t dest_oid, const int64_t file_size);
+
 int fs_cluster_stat(FSClientContext *client_ctx, const ConnectionInfo
         *spec_conn, const FSClusterStatFilter *filter,
         FSClientClusterStatEntry *stats, const int size, int *count);
@@ -86,6 +92,13 @@ int fs_client_slice_write(FSClientContext *client_ctx,
         const FSBlockSliceKeyInfo *bs_key, const char *data,
         int *write_bytes, int *inc_alloc);
 
+/* write the slices of the same data group in pipeline: send all requests
+ * through one master connection then receive the responses, the failed
+ * entries are written again one by one by fs_client_slice_write.
+ * return the first error of the entries, 0 for all success */
+int fs_client_slice_write_pipeline(FSClientContext *client_ctx,
+        FSClientSliceWriteEntry *entries, const int count);
+
 int fs_client_slice_read_ex(FSClientContext *client_ctx,
         const int slave_id, const int req_cmd, const int resp_cmd,
         const FSBlockSliceKeyInfo *bs_key, char *buff, int *read_bytes);
@@ -130,6 +143,14 @@ int fs_client_bs_operate(FSClientContext *client_ctx,
             enoent_log_level, dec_alloc)
 
 
+#define fs_client_block_clone_ex(client_ctx, clone_key, \
+        enoent_log_level, inc_alloc)   \
+    fs_client_bs_operate(client_ctx, clone_key,   \
+            (clone_key)->bkey.hash_code,          \
+            FS_SERVICE_PROTO_BLOCK_CLONE_REQ,     \
+            FS_SERVICE_PROTO_BLOCK_CLONE_RESP,    \
+            enoent_log_level, inc_alloc)
+
 #define fs_client_slice_allocate(client_ctx, bs_key, inc_alloc) \
     fs_client_slice_allocate_ex(client_ctx, bs_key, LOG_DEBUG, inc_alloc)
 
@@ -139,10 +160,18 @@ int fs_client_bs_operate(FSClientContext *client_ctx,
 #define fs_client_block_delete(client_ctx, bkey, dec_alloc) \
     fs_client_block_delete_ex(client_ctx, bkey, LOG_DEBUG, dec_alloc)
 
+#define fs_client_block_clone(client_ctx, clone_key, inc_alloc) \
+    fs_client_block_clone_ex(client_ctx, clone_key, LOG_DEBUG, inc_alloc)
+
 int fs_client_server_group_space_stat(FSClientContext *client_ctx,
         FCServerInfo *server, FSClientServerSpaceStat *stats,
         const int size, int *count);
 
+/* the space used by the data groups of the server */
+int fs_client_server_dg_space_stat(FSClientContext *client_ctx,
+        FCServerInfo *server, FSClientDataGroupSpaceStat *stats,
+        const int size, int *count);
+
 int fs_client_cluster_space_stat(FSClientContext *client_ctx,
         FSClusterSpaceStat *stat);
 
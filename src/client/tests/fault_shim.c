@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* the fault injection shim for the HA test harness, preload it into
+ * fs_serverd with LD_PRELOAD and point FS_FAULT_CONTROL to the control
+ * file, which is reloaded when changed, such as:
+ *
+ *   # cut off the connections to these peer ports (network partition)
+ *   partition_ports = 31024, 31025, 31026
+ *
+ *   # the delay of each disk IO in microseconds (slow disk)
+ *   disk_delay_us = 20000
+ *
+ * the partition is one-way, so the harness writes the ports of the peers
+ * to the control files of both sides for a symmetric partition
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define FAULT_MAX_FD_COUNT          65536
+#define FAULT_RELOAD_INTERVAL_MS    100
+
+#define FD_FLAG_SOCKET      1
+#define FD_FLAG_PARTITIONED 2
+
+typedef int (*connect_func)(int, const struct sockaddr *, socklen_t);
+typedef int (*accept_func)(int, struct sockaddr *, socklen_t *);
+typedef int (*accept4_func)(int, struct sockaddr *, socklen_t *, int);
+typedef int (*socket_func)(int, int, int);
+typedef int (*close_func)(int);
+typedef ssize_t (*read_func)(int, void *, size_t);
+typedef ssize_t (*write_func)(int, const void *, size_t);
+typedef ssize_t (*readv_func)(int, const struct iovec *, int);
+typedef ssize_t (*writev_func)(int, const struct iovec *, int);
+typedef ssize_t (*recv_func)(int, void *, size_t, int);
+typedef ssize_t (*send_func)(int, const void *, size_t, int);
+typedef ssize_t (*pread_func)(int, void *, size_t, off_t);
+typedef ssize_t (*pwrite_func)(int, const void *, size_t, off_t);
+typedef int (*fsync_func)(int);
+typedef int (*io_submit_func)(void *, long, void **);
+
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t lock;
+    const char *control_filename;
+    time_t control_mtime;
+    int64_t next_check_ms;
+
+    volatile int disk_delay_us;
+    volatile unsigned char blocked_ports[FAULT_MAX_FD_COUNT / 8];
+    volatile unsigned char fd_flags[FAULT_MAX_FD_COUNT];
+    volatile unsigned short fd_ports[FAULT_MAX_FD_COUNT];  //the peer ports
+
+    struct {
+        connect_func connect;
+        accept_func accept;
+        accept4_func accept4;
+        socket_func socket;
+        close_func close;
+        read_func read;
+        write_func write;
+        readv_func readv;
+        writev_func writev;
+        recv_func recv;
+        send_func send;
+        pread_func pread;
+        pwrite_func pwrite;
+        fsync_func fsync;
+        fsync_func fdatasync;
+        io_submit_func io_submit;
+    } real;
+} fault_ctx = {PTHREAD_ONCE_INIT, PTHREAD_MUTEX_INITIALIZER};
+
+static void fault_init_real_funcs()
+{
+    fault_ctx.real.connect = (connect_func)dlsym(RTLD_NEXT, "connect");
+    fault_ctx.real.accept = (accept_func)dlsym(RTLD_NEXT, "accept");
+    fault_ctx.real.accept4 = (accept4_func)dlsym(RTLD_NEXT, "accept4");
+    fault_ctx.real.socket = (socket_func)dlsym(RTLD_NEXT, "socket");
+    fault_ctx.real.close = (close_func)dlsym(RTLD_NEXT, "close");
+    fault_ctx.real.read = (read_func)dlsym(RTLD_NEXT, "read");
+    fault_ctx.real.write = (write_func)dlsym(RTLD_NEXT, "write");
+    fault_ctx.real.readv = (readv_func)dlsym(RTLD_NEXT, "readv");
+    fault_ctx.real.writev = (writev_func)dlsym(RTLD_NEXT, "writev");
+    fault_ctx.real.recv = (recv_func)dlsym(RTLD_NEXT, "recv");
+    fault_ctx.real.send = (send_func)dlsym(RTLD_NEXT, "send");
+    fault_ctx.real.pread = (pread_func)dlsym(RTLD_NEXT, "pread");
+    fault_ctx.real.pwrite = (pwrite_func)dlsym(RTLD_NEXT, "pwrite");
+    fault_ctx.real.fsync = (fsync_func)dlsym(RTLD_NEXT, "fsync");
+    fault_ctx.real.fdatasync = (fsync_func)dlsym(RTLD_NEXT, "fdatasync");
+
+    /* NULL when libaio not linked */
+    fault_ctx.real.io_submit = (io_submit_func)dlsym(RTLD_NEXT, "io_submit");
+
+    fault_ctx.control_filename = getenv("FS_FAULT_CONTROL");
+}
+
+static inline int64_t get_current_time_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline bool is_port_blocked(const int port)
+{
+    return (fault_ctx.blocked_ports[port / 8] & (1 << (port % 8))) != 0;
+}
+
+static void parse_control_line(char *line, unsigned char *blocked_ports,
+        int *disk_delay_us)
+{
+    char *value;
+    char *port_str;
+    char *saveptr;
+    int port;
+
+    if ((value=strchr(line, '=')) == NULL) {
+        return;
+    }
+    *value++ = '\0';
+
+    if (strstr(line, "partition_ports") != NULL) {
+        for (port_str=strtok_r(value, ", \t\r\n", &saveptr); port_str != NULL;
+                port_str=strtok_r(NULL, ", \t\r\n", &saveptr))
+        {
+            port = atoi(port_str);
+            if (port > 0 && port < FAULT_MAX_FD_COUNT) {
+                blocked_ports[port / 8] |= (1 << (port % 8));
+            }
+        }
+    } else if (strstr(line, "disk_delay_us") != NULL) {
+        *disk_delay_us = atoi(value);
+    }
+}
+
+static void reload_control_file()
+{
+    unsigned char blocked_ports[FAULT_MAX_FD_COUNT / 8];
+    char line[1024];
+    struct stat st;
+    FILE *fp;
+    int disk_delay_us;
+    int fd;
+
+    if (stat(fault_ctx.control_filename, &st) != 0) {
+        st.st_mtime = 0;
+    }
+    if (st.st_mtime == fault_ctx.control_mtime) {
+        return;
+    }
+    fault_ctx.control_mtime = st.st_mtime;
+
+    memset(blocked_ports, 0, sizeof(blocked_ports));
+    disk_delay_us = 0;
+    if (st.st_mtime != 0 && (fp=fopen(fault_ctx.
+                    control_filename, "r")) != NULL)
+    {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (*line != '#') {
+                parse_control_line(line, blocked_ports, &disk_delay_us);
+            }
+        }
+        fclose(fp);
+    }
+
+    memcpy((void *)fault_ctx.blocked_ports, blocked_ports,
+            sizeof(blocked_ports));
+    fault_ctx.disk_delay_us = disk_delay_us;
+
+    /* mark the established connections to the blocked peers */
+    for (fd=0; fd<FAULT_MAX_FD_COUNT; fd++) {
+        if ((fault_ctx.fd_flags[fd] & FD_FLAG_SOCKET) == 0) {
+            continue;
+        }
+        if (fault_ctx.fd_ports[fd] != 0 && is_port_blocked(
+                    fault_ctx.fd_ports[fd]))
+        {
+            fault_ctx.fd_flags[fd] |= FD_FLAG_PARTITIONED;
+        } else {
+            fault_ctx.fd_flags[fd] &= ~FD_FLAG_PARTITIONED;
+        }
+    }
+}
+
+static inline void fault_check_reload()
+{
+    int64_t current_ms;
+
+    pthread_once(&fault_ctx.once, fault_init_real_funcs);
+    if (fault_ctx.control_filename == NULL) {
+        return;
+    }
+
+    current_ms = get_current_time_ms();
+    if (current_ms < fault_ctx.next_check_ms) {
+        return;
+    }
+
+    pthread_mutex_lock(&fault_ctx.lock);
+    if (current_ms >= fault_ctx.next_check_ms) {
+        reload_control_file();
+        fault_ctx.next_check_ms = current_ms + FAULT_RELOAD_INTERVAL_MS;
+    }
+    pthread_mutex_unlock(&fault_ctx.lock);
+}
+
+static inline bool is_fd_partitioned(const int fd)
+{
+    fault_check_reload();
+    return (fd >= 0 && fd < FAULT_MAX_FD_COUNT &&
+            (fault_ctx.fd_flags[fd] & FD_FLAG_PARTITIONED) != 0);
+}
+
+/* the regular file only, exclude the pipes and the eventfds etc. */
+static inline bool is_disk_fd(const int fd)
+{
+    struct stat st;
+
+    if (fd < 0 || fd >= FAULT_MAX_FD_COUNT ||
+            (fault_ctx.fd_flags[fd] & FD_FLAG_SOCKET) != 0)
+    {
+        return false;
+    }
+    return (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+}
+
+static inline void disk_delay(const int fd)
+{
+    int delay_us;
+
+    fault_check_reload();
+    if ((delay_us=fault_ctx.disk_delay_us) > 0 && is_disk_fd(fd)) {
+        usleep(delay_us);
+    }
+}
+
+static int get_peer_port(const struct sockaddr *addr)
+{
+    if (addr == NULL) {
+        return 0;
+    }
+    if (addr->sa_family == AF_INET) {
+        return ntohs(((const struct sockaddr_in *)addr)->sin_port);
+    } else if (addr->sa_family == AF_INET6) {
+        return ntohs(((const struct sockaddr_in6 *)addr)->sin6_port);
+    }
+    return 0;
+}
+
+static inline void set_socket_fd(const int fd, const int peer_port)
+{
+    if (fd >= 0 && fd < FAULT_MAX_FD_COUNT) {
+        fault_ctx.fd_ports[fd] = peer_port;
+        fault_ctx.fd_flags[fd] = FD_FLAG_SOCKET;
+    }
+}
+
+int socket(int domain, int type, int protocol)
+{
+    int fd;
+
+    fault_check_reload();
+    if ((fd=fault_ctx.real.socket(domain, type, protocol)) >= 0) {
+        set_socket_fd(fd, 0);
+    }
+    return fd;
+}
+
+int connect(int fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    int port;
+
+    fault_check_reload();
+    port = get_peer_port(addr);
+    if (port != 0 && is_port_blocked(port)) {
+        errno = ENETUNREACH;
+        return -1;
+    }
+
+    set_socket_fd(fd, port);
+    return fault_ctx.real.connect(fd, addr, addrlen);
+}
+
+int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
+{
+    int fd;
+
+    fault_check_reload();
+    if ((fd=fault_ctx.real.accept(sockfd, addr, addrlen)) >= 0) {
+        set_socket_fd(fd, 0);
+    }
+    return fd;
+}
+
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+{
+    int fd;
+
+    fault_check_reload();
+    if ((fd=fault_ctx.real.accept4(sockfd, addr, addrlen, flags)) >= 0) {
+        set_socket_fd(fd, 0);
+    }
+    return fd;
+}
+
+int close(int fd)
+{
+    pthread_once(&fault_ctx.once, fault_init_real_funcs);
+    if (fd >= 0 && fd < FAULT_MAX_FD_COUNT) {
+        fault_ctx.fd_flags[fd] = 0;
+        fault_ctx.fd_ports[fd] = 0;
+    }
+    return fault_ctx.real.close(fd);
+}
+
+#define FAULT_CHECK_PARTITIONED(fd) \
+    do { \
+        if (is_fd_partitioned(fd)) { \
+            errno = ECONNRESET; \
+            return -1; \
+        } \
+    } while (0)
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    FAULT_CHECK_PARTITIONED(fd);
+    return fault_ctx.real.read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+    FAULT_CHECK_PARTITIONED(fd);
+    disk_delay(fd);
+    return fault_ctx.real.write(fd, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    FAULT_CHECK_PARTITIONED(fd);
+    return fault_ctx.real.readv(fd, iov, iovcnt);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    FAULT_CHECK_PARTITIONED(fd);
+    disk_delay(fd);
+    return fault_ctx.real.writev(fd, iov, iovcnt);
+}
+
+ssize_t recv(int fd, void *buf, size_t len, int flags)
+{
+    FAULT_CHECK_PARTITIONED(fd);
+    return fault_ctx.real.recv(fd, buf, len, flags);
+}
+
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+    FAULT_CHECK_PARTITIONED(fd);
+    return fault_ctx.real.send(fd, buf, len, flags);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+    disk_delay(fd);
+    return fault_ctx.real.pread(fd, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+    disk_delay(fd);
+    return fault_ctx.real.pwrite(fd, buf, count, offset);
+}
+
+int fsync(int fd)
+{
+    disk_delay(fd);
+    return fault_ctx.real.fsync(fd);
+}
+
+int fdatasync(int fd)
+{
+    disk_delay(fd);
+    return fault_ctx.real.fdatasync(fd);
+}
+
+int io_submit(void *ctx, long nr, void **iocbpp)
+{
+    fault_check_reload();
+    if (fault_ctx.real.io_submit == NULL) {
+        errno = ENOSYS;
+        return -ENOSYS;
+    }
+
+    if (fault_ctx.disk_delay_us > 0) {
+        usleep(fault_ctx.disk_delay_us);
+    }
+    return fault_ctx.real.io_submit(ctx, nr, iocbpp);
+}
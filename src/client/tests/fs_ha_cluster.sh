@@ -0,0 +1,164 @@
+#!/bin/sh
+
+# set up and control a local faststore cluster for the HA tests, each
+# server runs as a separate fs_serverd process on 127.0.0.1 with its own
+# base path and ports, and preloads libfsfaultshim.so for fault injection
+#
+# Usage: fs_ha_cluster.sh <base_path> setup [server_count=3]
+#        fs_ha_cluster.sh <base_path> start|stop [server_id]
+#        fs_ha_cluster.sh <base_path> clean
+#
+# env:
+#   FS_CONF_TEMPLATE: the template config path, default: ../../../conf/full
+#   FS_AUTH_CONF_PATH: the auth config path, default: /etc/fastcfs/auth
+#   FS_SERVERD: the server program, default: fs_serverd
+#   FS_FAULT_SHIM: the fault shim library, default: ./libfsfaultshim.so
+#
+# node ports: cluster 31004 + 10 * id, replica 31005 + 10 * id,
+#             service 31006 + 10 * id
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <base_path> <setup [server_count] | start [server_id] |" \
+    "stop [server_id] | clean>"
+  exit 1
+fi
+
+BASE_PATH=$(realpath -m $1)
+CMD=$2
+TESTS_PATH=$(cd $(dirname $0) && pwd)
+CONF_TEMPLATE=${FS_CONF_TEMPLATE:-$TESTS_PATH/../../../conf/full}
+AUTH_CONF_PATH=${FS_AUTH_CONF_PATH:-/etc/fastcfs/auth}
+FS_SERVERD=${FS_SERVERD:-fs_serverd}
+FAULT_SHIM=$(realpath -m ${FS_FAULT_SHIM:-$TESTS_PATH/libfsfaultshim.so})
+DATA_GROUP_COUNT=16
+PORT_BASE=31000
+
+node_port() {
+  echo $((PORT_BASE + 10 * $1 + $2))
+}
+
+node_ids() {
+  if [ -n "$1" ]; then
+    echo $1
+  else
+    ls -d $BASE_PATH/node-* 2>/dev/null | sed 's/.*node-//' | sort -n
+  fi
+}
+
+# set the port of the section, $1: filename, $2: section, $3: port
+set_section_port() {
+  awk -v section="[$2]" -v port=$3 '
+    /^\[/ { in_section = ($0 == section) }
+    in_section && /^port *=/ { print "port = " port; next }
+    { print }' $1 > $1.tmp && mv $1.tmp $1
+}
+
+setup() {
+  server_count=${1:-3}
+  if [ ! -f $CONF_TEMPLATE/server.conf ]; then
+    echo "config template $CONF_TEMPLATE/server.conf not exist"
+    exit 2
+  fi
+  if [ ! -f $AUTH_CONF_PATH/auth.conf ]; then
+    echo "auth config $AUTH_CONF_PATH/auth.conf not exist"
+    exit 2
+  fi
+
+  mkdir -p $BASE_PATH/conf || exit $?
+  cp -rf $AUTH_CONF_PATH $BASE_PATH/auth || exit $?
+
+  cluster_conf=$BASE_PATH/conf/cluster.conf
+  sed -e 's#^auth_config_filename *=.*#auth_config_filename = '$BASE_PATH'/auth/auth.conf#' \
+      -e 's#^data_group_count *=.*#data_group_count = '$DATA_GROUP_COUNT'#' \
+      -e '/^\[server-group-1\]/,$d' $CONF_TEMPLATE/cluster.conf > $cluster_conf
+  cat >> $cluster_conf <<CLUSTER_EOF
+[server-group-1]
+server_ids = [1, $server_count]
+data_group_ids = [1, $DATA_GROUP_COUNT]
+
+CLUSTER_EOF
+
+  id=1
+  while [ $id -le $server_count ]; do
+    cat >> $cluster_conf <<SERVER_EOF
+[server-$id]
+host = 127.0.0.1
+cluster-port = $(node_port $id 4)
+replica-port = $(node_port $id 5)
+service-port = $(node_port $id 6)
+
+SERVER_EOF
+    id=$((id + 1))
+  done
+
+  sed -e 's#^base_path *=.*#base_path = '$BASE_PATH'/client#' \
+      -e 's#^cluster_config_filename *=.*#cluster_config_filename = '$cluster_conf'#' \
+      $CONF_TEMPLATE/client.conf > $BASE_PATH/client.conf
+  mkdir -p $BASE_PATH/client || exit $?
+
+  id=1
+  while [ $id -le $server_count ]; do
+    node=$BASE_PATH/node-$id
+    mkdir -p $node/conf $node/data || exit $?
+    server_conf=$node/conf/server.conf
+    sed -e 's#^base_path *=.*#base_path = '$node'#' \
+        -e 's#^session_config_filename *=.*#session_config_filename = '$BASE_PATH'/auth/session.conf#' \
+        -e 's#^cluster_config_filename *=.*#cluster_config_filename = '$cluster_conf'#' \
+        $CONF_TEMPLATE/server.conf > $server_conf
+    set_section_port $server_conf cluster $(node_port $id 4)
+    set_section_port $server_conf replica $(node_port $id 5)
+    set_section_port $server_conf service $(node_port $id 6)
+    set_section_port $server_conf metrics $(node_port $id 9)
+
+    sed -e 's#^path *=.*#path = '$node'/data#' \
+        -e 's#^trunk_file_size *=.*#trunk_file_size = 64MB#' \
+        $CONF_TEMPLATE/storage.conf > $node/conf/storage.conf
+    for f in qos.conf; do
+      [ -f $CONF_TEMPLATE/$f ] && cp -f $CONF_TEMPLATE/$f $node/conf/
+    done
+
+    touch $node/fault.ctl
+    cat > $node/start.sh <<START_EOF
+#!/bin/sh
+FS_FAULT_CONTROL=$node/fault.ctl LD_PRELOAD=$FAULT_SHIM \\
+  $FS_SERVERD $server_conf start
+START_EOF
+    chmod +x $node/start.sh
+    id=$((id + 1))
+  done
+
+  echo "$server_count servers setup in $BASE_PATH"
+}
+
+start() {
+  for id in $(node_ids $1); do
+    : > $BASE_PATH/node-$id/fault.ctl
+    $BASE_PATH/node-$id/start.sh || exit $?
+  done
+}
+
+stop() {
+  for id in $(node_ids $1); do
+    $FS_SERVERD $BASE_PATH/node-$id/conf/server.conf stop
+  done
+}
+
+case "$CMD" in
+  setup)
+    setup $3
+    ;;
+  start)
+    start $3
+    ;;
+  stop)
+    stop $3
+    ;;
+  clean)
+    stop
+    rm -rf $BASE_PATH
+    ;;
+  *)
+    echo "unknown command: $CMD"
+    exit 1
+    ;;
+esac
@@ -0,0 +1,696 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* the failover and recovery test against the local cluster set up by
+ * fs_ha_cluster.sh, it writes continuously, injects one fault to one
+ * server, heals it after the fault duration and reports the time to
+ * the new master, the write unavailability windows, the replication lag
+ * and the recovery throughput as JSON */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "faststore/client/fs_client.h"
+
+#define HA_FAULT_KILL       'k'
+#define HA_FAULT_PAUSE      'p'
+#define HA_FAULT_PARTITION  'n'
+#define HA_FAULT_SLOW_DISK  'd'
+
+#define HA_MAX_DATA_GROUPS    1024
+#define HA_MAX_STAT_COUNT     (5 * HA_MAX_DATA_GROUPS)
+#define HA_OIDS_PER_THREAD    64
+#define HA_BLOCKS_PER_OID     64
+#define HA_POLL_INTERVAL_MS   10
+
+typedef struct {
+    int index;
+    char *buff;
+    int64_t ops;
+    int64_t errors;
+    int64_t bytes;
+    int64_t outage_bytes;  //written during the fault
+    int64_t last_success_us;
+
+    struct {
+        int count;
+        int64_t max_us;
+        int64_t total_us;
+    } unavailable;
+} HAWriter;
+
+typedef struct {
+    const char *base_path;
+    char fault;
+    int fault_server_id;
+    int warmup_seconds;
+    int fault_seconds;
+    int recovery_timeout;
+    int thread_count;
+    int slice_size;
+    int disk_delay_us;
+    int unavailable_threshold_ms;
+    int64_t oid_base;
+
+    volatile bool continue_flag;
+    volatile bool in_fault;
+    volatile int running_count;
+    HAWriter *writers;
+
+    struct {
+        int count;
+        int masters[HA_MAX_DATA_GROUPS + 1];  //index by data group id
+        bool mastered[HA_MAX_DATA_GROUPS + 1];  //by the fault server
+        int64_t max_replication_lag;
+    } cluster;
+
+    int64_t start_time_us;
+    int64_t fault_time_us;
+    int64_t new_master_time_us;
+    int64_t heal_time_us;
+    int64_t recovered_time_us;
+} HATestContext;
+
+static HATestContext ha_ctx;
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s -b <harness base path> "
+            "[-c config_filename=$base/client.conf]\n"
+            "\t[-f fault=kill, kill, pause, partition or slow_disk]\n"
+            "\t[-s server_id=0 for the master of data group 1]\n"
+            "\t[-w warmup seconds=5] [-d fault seconds=10] "
+            "[-r recovery timeout seconds=300]\n"
+            "\t[-t writer threads=4] [-l slice_size=64K] "
+            "[-D disk delay us=50000]\n"
+            "\t[-u unavailable threshold ms=100] [-i oid_base=2000000000] "
+            "[-n namespace or poolname=fs]\n", argv[0]);
+}
+
+static inline int64_t elapsed_ms(const int64_t start_us, const int64_t end_us)
+{
+    if (start_us == 0 || end_us == 0) {
+        return -1;
+    }
+    return (end_us - start_us) / 1000;
+}
+
+static void *writer_thread_func(void *arg)
+{
+    HAWriter *writer;
+    FSBlockSliceKeyInfo bs_key;
+    int64_t offset;
+    int64_t current_us;
+    int64_t gap_us;
+    int64_t i;
+    int64_t n;
+    int slices_per_block;
+    int write_bytes;
+    int inc_alloc;
+    int result;
+
+    writer = (HAWriter *)arg;
+    slices_per_block = FS_FILE_BLOCK_SIZE / ha_ctx.slice_size;
+    writer->last_success_us = get_current_time_us();
+    for (i=0; ha_ctx.continue_flag; i++) {
+        /* the slice MUST NOT cross the block boundary */
+        n = i / HA_OIDS_PER_THREAD;
+        offset = (n / slices_per_block % HA_BLOCKS_PER_OID) *
+            FS_FILE_BLOCK_SIZE + (n % slices_per_block) * ha_ctx.slice_size;
+        fs_set_block_slice(&bs_key, ha_ctx.oid_base + writer->index *
+                HA_OIDS_PER_THREAD + i % HA_OIDS_PER_THREAD,
+                offset, ha_ctx.slice_size);
+        result = fs_client_slice_write(&g_fs_client_vars.client_ctx,
+                &bs_key, writer->buff, &write_bytes, &inc_alloc);
+
+        writer->ops++;
+        if (result != 0) {
+            writer->errors++;
+            continue;
+        }
+
+        current_us = get_current_time_us();
+        writer->bytes += write_bytes;
+        if (ha_ctx.in_fault) {
+            writer->outage_bytes += write_bytes;
+        }
+
+        gap_us = current_us - writer->last_success_us;
+        if (gap_us > ha_ctx.unavailable_threshold_ms * 1000LL) {
+            writer->unavailable.count++;
+            writer->unavailable.total_us += gap_us;
+            if (gap_us > writer->unavailable.max_us) {
+                writer->unavailable.max_us = gap_us;
+            }
+        }
+        writer->last_success_us = current_us;
+    }
+
+    __sync_sub_and_fetch(&ha_ctx.running_count, 1);
+    return NULL;
+}
+
+static int start_writers()
+{
+    HAWriter *writer;
+    HAWriter *end;
+    pthread_t tid;
+    int bytes;
+    int result;
+
+    bytes = sizeof(HAWriter) * ha_ctx.thread_count;
+    ha_ctx.writers = (HAWriter *)fc_malloc(bytes);
+    if (ha_ctx.writers == NULL) {
+        return ENOMEM;
+    }
+    memset(ha_ctx.writers, 0, bytes);
+
+    ha_ctx.continue_flag = true;
+    end = ha_ctx.writers + ha_ctx.thread_count;
+    for (writer=ha_ctx.writers; writer<end; writer++) {
+        writer->index = writer - ha_ctx.writers;
+        if ((writer->buff=(char *)fc_malloc(ha_ctx.slice_size)) == NULL) {
+            return ENOMEM;
+        }
+        memset(writer->buff, 'A' + writer->index % 26, ha_ctx.slice_size);
+
+        __sync_add_and_fetch(&ha_ctx.running_count, 1);
+        if ((result=fc_create_thread(&tid, writer_thread_func,
+                        writer, 256 * 1024)) != 0)
+        {
+            __sync_sub_and_fetch(&ha_ctx.running_count, 1);
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+/* poll the cluster status, return true when the data servers of
+ * the fault server are all ACTIVE */
+static bool poll_cluster_stat(bool *all_active)
+{
+    FSClusterStatFilter filter;
+    FSClientClusterStatEntry stats[HA_MAX_STAT_COUNT];
+    FSClientClusterStatEntry *stat;
+    FSClientClusterStatEntry *end;
+    int64_t master_versions[HA_MAX_DATA_GROUPS + 1];
+    int64_t min_versions[HA_MAX_DATA_GROUPS + 1];
+    int count;
+    int dg_id;
+
+    memset(&filter, 0, sizeof(filter));
+    if (fs_cluster_stat(&g_fs_client_vars.client_ctx, NULL, &filter,
+                stats, HA_MAX_STAT_COUNT, &count) != 0)
+    {
+        return false;
+    }
+
+    memset(master_versions, 0, sizeof(master_versions));
+    memset(min_versions, 0, sizeof(min_versions));
+    memset(ha_ctx.cluster.masters, 0, sizeof(ha_ctx.cluster.masters));
+    *all_active = true;
+    ha_ctx.cluster.count = 0;
+    end = stats + count;
+    for (stat=stats; stat<end; stat++) {
+        dg_id = stat->data_group_id;
+        if (dg_id <= 0 || dg_id > HA_MAX_DATA_GROUPS) {
+            continue;
+        }
+        if (dg_id > ha_ctx.cluster.count) {
+            ha_ctx.cluster.count = dg_id;
+        }
+
+        if (stat->server_id == ha_ctx.fault_server_id &&
+                stat->status != FS_DS_STATUS_ACTIVE)
+        {
+            *all_active = false;
+        }
+        if (stat->status != FS_DS_STATUS_ACTIVE) {
+            continue;
+        }
+
+        if (stat->is_master) {
+            ha_ctx.cluster.masters[dg_id] = stat->server_id;
+            master_versions[dg_id] = stat->data_version;
+        } else if (min_versions[dg_id] == 0 ||
+                stat->data_version < min_versions[dg_id])
+        {
+            min_versions[dg_id] = stat->data_version;
+        }
+    }
+
+    for (dg_id=1; dg_id<=ha_ctx.cluster.count; dg_id++) {
+        if (master_versions[dg_id] > 0 && min_versions[dg_id] > 0 &&
+                master_versions[dg_id] - min_versions[dg_id] >
+                ha_ctx.cluster.max_replication_lag)
+        {
+            ha_ctx.cluster.max_replication_lag =
+                master_versions[dg_id] - min_versions[dg_id];
+        }
+    }
+
+    return true;
+}
+
+static bool check_new_masters()
+{
+    int dg_id;
+
+    for (dg_id=1; dg_id<=ha_ctx.cluster.count; dg_id++) {
+        if (ha_ctx.cluster.mastered[dg_id] && (ha_ctx.cluster.masters[dg_id]
+                    == 0 || ha_ctx.cluster.masters[dg_id] ==
+                    ha_ctx.fault_server_id))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int get_server_pid(pid_t *pid)
+{
+    char filename[PATH_MAX];
+    char *content;
+    int64_t file_size;
+    int result;
+
+    snprintf(filename, sizeof(filename), "%s/node-%d/serverd.pid",
+            ha_ctx.base_path, ha_ctx.fault_server_id);
+    if ((result=getFileContent(filename, &content, &file_size)) != 0) {
+        return result;
+    }
+
+    *pid = strtol(content, NULL, 10);
+    free(content);
+    return *pid > 0 ? 0 : EINVAL;
+}
+
+static int write_fault_control(const int server_id, const char *content)
+{
+    char filename[PATH_MAX];
+
+    snprintf(filename, sizeof(filename), "%s/node-%d/fault.ctl",
+            ha_ctx.base_path, server_id);
+    return writeToFile(filename, content, strlen(content));
+}
+
+static int append_server_ports(FCServerInfo *server, char *buff,
+        const int size)
+{
+    FSClusterConfig *cluster_cfg;
+    int group_indexes[3];
+    int len;
+    int i;
+
+    cluster_cfg = g_fs_client_vars.client_ctx.cluster_cfg.ptr;
+    group_indexes[0] = cluster_cfg->cluster_group_index;
+    group_indexes[1] = cluster_cfg->replica_group_index;
+    group_indexes[2] = cluster_cfg->service_group_index;
+    len = strlen(buff);
+    for (i=0; i<3; i++) {
+        len += snprintf(buff + len, size - len, "%s%u",
+                (len > 0 && buff[len - 1] != ' ') ? ", " : "",
+                server->group_addrs[group_indexes[i]].
+                address_array.addrs[0]->conn.port);
+    }
+    return len;
+}
+
+/* the symmetric partition between the fault server and the others */
+static int set_partition(const bool enabled)
+{
+    FCServerConfig *server_cfg;
+    FCServerInfo *server;
+    FCServerInfo *end;
+    FCServerInfo *fault_server;
+    char fault_ports[256];
+    char peer_ports[4096];
+    char content[4096];
+    int result;
+
+    server_cfg = &g_fs_client_vars.client_ctx.cluster_cfg.ptr->server_cfg;
+    if ((fault_server=fc_server_get_by_id(server_cfg,
+                    ha_ctx.fault_server_id)) == NULL)
+    {
+        return ENOENT;
+    }
+
+    *fault_ports = *peer_ports = '\0';
+    append_server_ports(fault_server, fault_ports, sizeof(fault_ports));
+    end = FC_SID_SERVERS(*server_cfg) + FC_SID_SERVER_COUNT(*server_cfg);
+    for (server=FC_SID_SERVERS(*server_cfg); server<end; server++) {
+        if (server->id == ha_ctx.fault_server_id) {
+            continue;
+        }
+
+        append_server_ports(server, peer_ports, sizeof(peer_ports));
+        snprintf(content, sizeof(content), "partition_ports = %s\n",
+                enabled ? fault_ports : "");
+        if ((result=write_fault_control(server->id, content)) != 0) {
+            return result;
+        }
+    }
+
+    snprintf(content, sizeof(content), "partition_ports = %s\n",
+            enabled ? peer_ports : "");
+    return write_fault_control(ha_ctx.fault_server_id, content);
+}
+
+static int run_node_script(const char *script)
+{
+    char cmd[PATH_MAX + 64];
+    int status;
+
+    snprintf(cmd, sizeof(cmd), "%s/node-%d/%s", ha_ctx.base_path,
+            ha_ctx.fault_server_id, script);
+    if ((status=system(cmd)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "execute %s fail, exit status: %d",
+                __LINE__, cmd, status);
+        return EIO;
+    }
+    return 0;
+}
+
+static int inject_fault(pid_t pid)
+{
+    char content[64];
+
+    switch (ha_ctx.fault) {
+        case HA_FAULT_KILL:
+            return kill(pid, SIGKILL) == 0 ? 0 : errno;
+        case HA_FAULT_PAUSE:
+            return kill(pid, SIGSTOP) == 0 ? 0 : errno;
+        case HA_FAULT_PARTITION:
+            return set_partition(true);
+        default:
+            snprintf(content, sizeof(content), "disk_delay_us = %d\n",
+                    ha_ctx.disk_delay_us);
+            return write_fault_control(ha_ctx.fault_server_id, content);
+    }
+}
+
+static int heal_fault(pid_t pid)
+{
+    switch (ha_ctx.fault) {
+        case HA_FAULT_KILL:
+            return run_node_script("start.sh");
+        case HA_FAULT_PAUSE:
+            return kill(pid, SIGCONT) == 0 ? 0 : errno;
+        case HA_FAULT_PARTITION:
+            return set_partition(false);
+        default:
+            return write_fault_control(ha_ctx.fault_server_id, "");
+    }
+}
+
+static void wait_and_poll(const int64_t until_us,
+        const bool stop_when_active)
+{
+    bool all_active;
+
+    while (get_current_time_us() < until_us) {
+        if (poll_cluster_stat(&all_active)) {
+            if (ha_ctx.fault_time_us > 0 && ha_ctx.new_master_time_us == 0
+                    && check_new_masters())
+            {
+                ha_ctx.new_master_time_us = get_current_time_us();
+            }
+
+            if (stop_when_active && all_active) {
+                ha_ctx.recovered_time_us = get_current_time_us();
+                break;
+            }
+        }
+        fc_sleep_ms(HA_POLL_INTERVAL_MS);
+    }
+}
+
+static int run_test()
+{
+    pid_t pid;
+    bool all_active;
+    int dg_id;
+    int result;
+
+    if (!poll_cluster_stat(&all_active)) {
+        logError("file: "__FILE__", line: %d, "
+                "get cluster stat fail", __LINE__);
+        return EIO;
+    }
+    if (ha_ctx.fault_server_id == 0) {
+        ha_ctx.fault_server_id = ha_ctx.cluster.masters[1];
+    }
+    if (ha_ctx.fault_server_id == 0) {
+        logError("file: "__FILE__", line: %d, "
+                "the master of data group 1 not exist", __LINE__);
+        return ENOENT;
+    }
+    if ((result=get_server_pid(&pid)) != 0) {
+        return result;
+    }
+
+    ha_ctx.start_time_us = get_current_time_us();
+    if ((result=start_writers()) != 0) {
+        return result;
+    }
+    wait_and_poll(ha_ctx.start_time_us + ha_ctx.warmup_seconds *
+            1000000LL, false);
+
+    for (dg_id=1; dg_id<=ha_ctx.cluster.count; dg_id++) {
+        ha_ctx.cluster.mastered[dg_id] = (ha_ctx.cluster.masters[dg_id] ==
+                ha_ctx.fault_server_id);
+    }
+    ha_ctx.cluster.max_replication_lag = 0;
+
+    ha_ctx.in_fault = true;
+    ha_ctx.fault_time_us = get_current_time_us();
+    if ((result=inject_fault(pid)) != 0) {
+        return result;
+    }
+    wait_and_poll(ha_ctx.fault_time_us + ha_ctx.fault_seconds *
+            1000000LL, false);
+
+    if ((result=heal_fault(pid)) != 0) {
+        return result;
+    }
+    ha_ctx.heal_time_us = get_current_time_us();
+    ha_ctx.in_fault = false;
+    wait_and_poll(ha_ctx.heal_time_us + ha_ctx.recovery_timeout *
+            1000000LL, true);
+
+    ha_ctx.continue_flag = false;
+    while (__sync_add_and_fetch(&ha_ctx.running_count, 0) > 0) {
+        fc_sleep_ms(10);
+    }
+    return 0;
+}
+
+static void output_result()
+{
+    HAWriter *writer;
+    HAWriter *end;
+    int64_t ops;
+    int64_t errors;
+    int64_t bytes;
+    int64_t outage_bytes;
+    int64_t max_unavailable_us;
+    int64_t total_unavailable_us;
+    int unavailable_count;
+    int64_t recovery_ms;
+    double seconds;
+    const char *fault_caption;
+
+    ops = errors = bytes = outage_bytes = 0;
+    max_unavailable_us = total_unavailable_us = 0;
+    unavailable_count = 0;
+    end = ha_ctx.writers + ha_ctx.thread_count;
+    for (writer=ha_ctx.writers; writer<end; writer++) {
+        ops += writer->ops;
+        errors += writer->errors;
+        bytes += writer->bytes;
+        outage_bytes += writer->outage_bytes;
+        unavailable_count += writer->unavailable.count;
+        total_unavailable_us += writer->unavailable.total_us;
+        if (writer->unavailable.max_us > max_unavailable_us) {
+            max_unavailable_us = writer->unavailable.max_us;
+        }
+    }
+
+    switch (ha_ctx.fault) {
+        case HA_FAULT_KILL:
+            fault_caption = "kill";
+            break;
+        case HA_FAULT_PAUSE:
+            fault_caption = "pause";
+            break;
+        case HA_FAULT_PARTITION:
+            fault_caption = "partition";
+            break;
+        default:
+            fault_caption = "slow_disk";
+            break;
+    }
+
+    seconds = (get_current_time_us() - ha_ctx.start_time_us) / 1000000.0;
+    recovery_ms = elapsed_ms(ha_ctx.heal_time_us, ha_ctx.recovered_time_us);
+    printf("{\"fault\": \"%s\", \"server_id\": %d, \"fault_seconds\": %d, "
+            "\"time_to_new_master_ms\": %"PRId64", "
+            "\"write\": {\"ops\": %"PRId64", \"errors\": %"PRId64", "
+            "\"bytes_per_second\": %.0f}, "
+            "\"unavailable\": {\"threshold_ms\": %d, \"windows\": %d, "
+            "\"max_ms\": %"PRId64", \"total_ms\": %"PRId64"}, "
+            "\"max_replication_lag\": %"PRId64", "
+            "\"recovery\": {\"recovered\": %s, \"seconds\": %.3f, "
+            "\"outage_bytes\": %"PRId64", \"mb_per_second\": %.2f}}\n",
+            fault_caption, ha_ctx.fault_server_id, ha_ctx.fault_seconds,
+            elapsed_ms(ha_ctx.fault_time_us, ha_ctx.new_master_time_us),
+            ops, errors, bytes / seconds, ha_ctx.unavailable_threshold_ms,
+            unavailable_count, max_unavailable_us / 1000,
+            total_unavailable_us / 1000, ha_ctx.cluster.max_replication_lag,
+            recovery_ms >= 0 ? "true" : "false", recovery_ms / 1000.0,
+            outage_bytes, recovery_ms > 0 ? (outage_bytes / (1024.0 *
+                    1024.0)) / (recovery_ms / 1000.0) : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    const bool publish = false;
+    char config_filename[PATH_MAX];
+    const char *config;
+    string_t poolname;
+    char *ns;
+    int64_t slice_size;
+    int ch;
+    int result;
+
+    config = NULL;
+    ns = "fs";
+    ha_ctx.fault = HA_FAULT_KILL;
+    ha_ctx.warmup_seconds = 5;
+    ha_ctx.fault_seconds = 10;
+    ha_ctx.recovery_timeout = 300;
+    ha_ctx.thread_count = 4;
+    ha_ctx.slice_size = 64 * 1024;
+    ha_ctx.disk_delay_us = 50000;
+    ha_ctx.unavailable_threshold_ms = 100;
+    ha_ctx.oid_base = 2000000000;
+    while ((ch=getopt(argc, argv, "hb:c:f:s:w:d:r:t:l:D:u:i:n:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'b':
+                ha_ctx.base_path = optarg;
+                break;
+            case 'c':
+                config = optarg;
+                break;
+            case 'f':
+                if (strcmp(optarg, "kill") == 0) {
+                    ha_ctx.fault = HA_FAULT_KILL;
+                } else if (strcmp(optarg, "pause") == 0) {
+                    ha_ctx.fault = HA_FAULT_PAUSE;
+                } else if (strcmp(optarg, "partition") == 0) {
+                    ha_ctx.fault = HA_FAULT_PARTITION;
+                } else if (strcmp(optarg, "slow_disk") == 0) {
+                    ha_ctx.fault = HA_FAULT_SLOW_DISK;
+                } else {
+                    fprintf(stderr, "invalid fault: %s\n", optarg);
+                    return EINVAL;
+                }
+                break;
+            case 's':
+                ha_ctx.fault_server_id = strtol(optarg, NULL, 10);
+                break;
+            case 'w':
+                ha_ctx.warmup_seconds = strtol(optarg, NULL, 10);
+                break;
+            case 'd':
+                ha_ctx.fault_seconds = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                ha_ctx.recovery_timeout = strtol(optarg, NULL, 10);
+                break;
+            case 't':
+                ha_ctx.thread_count = strtol(optarg, NULL, 10);
+                break;
+            case 'l':
+                if ((result=parse_bytes(optarg, 1, &slice_size)) != 0) {
+                    return result;
+                }
+                ha_ctx.slice_size = slice_size;
+                break;
+            case 'D':
+                ha_ctx.disk_delay_us = strtol(optarg, NULL, 10);
+                break;
+            case 'u':
+                ha_ctx.unavailable_threshold_ms = strtol(optarg, NULL, 10);
+                break;
+            case 'i':
+                ha_ctx.oid_base = strtoll(optarg, NULL, 10);
+                break;
+            case 'n':
+                ns = optarg;
+                break;
+            default:
+                usage(argv);
+                return EINVAL;
+        }
+    }
+
+    if (ha_ctx.base_path == NULL || ha_ctx.thread_count <= 0 ||
+            ha_ctx.slice_size <= 0 || ha_ctx.slice_size >
+            FS_FILE_BLOCK_SIZE || ha_ctx.fault_seconds <= 0)
+    {
+        usage(argv);
+        return EINVAL;
+    }
+
+    if (config == NULL) {
+        snprintf(config_filename, sizeof(config_filename),
+                "%s/client.conf", ha_ctx.base_path);
+        config = config_filename;
+    }
+
+    log_init();
+    FC_SET_STRING(poolname, ns);
+    if ((result=fs_client_init_with_auth_ex1(&g_fs_client_vars.client_ctx,
+                    &g_fcfs_auth_client_vars.client_ctx, config,
+                    NULL, NULL, false, &poolname, publish)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=run_test()) != 0) {
+        ha_ctx.continue_flag = false;
+        return result;
+    }
+
+    output_result();
+    return 0;
+}
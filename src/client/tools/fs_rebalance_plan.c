@@ -0,0 +1,646 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "faststore/client/fs_client.h"
+
+typedef struct rebalance_server_group {
+    FSServerGroup *server_group;
+    int64_t total;  //the min total space of the servers
+    int64_t used;   //the used space of the data groups
+    double rate;    //the update rate of the data groups
+    int dg_count;
+    double score;
+} RebalanceServerGroup;
+
+typedef struct {
+    int data_group_id;
+    bool moved;
+    int64_t space;  //the trunk space used by the data group
+    int64_t data_version;  //the data version of the master at the first stat
+    double rate;    //the updates per second in the sampling interval
+    RebalanceServerGroup *sg;   //the current server group
+    RebalanceServerGroup *src;  //the server group before rebalance
+} RebalanceDataGroup;
+
+typedef struct {
+    int space_weight;   //percentage
+    int tolerance;      //percentage
+    int max_moves;
+    int interval;       //the sampling interval in seconds
+    int64_t sample_time_ms;  //the time of the first data version stat
+    int sg_count;
+    int dg_count;
+    int64_t total;
+    int64_t used;
+    double rate;
+    RebalanceServerGroup *sgroups;
+    RebalanceDataGroup *dgroups;
+} RebalanceContext;
+
+static RebalanceContext rebalance_ctx;
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-c config_filename=%s]\n"
+            "\t[-w space_weight=50] the weight percentage of the space, "
+            "the weight of the update rate is 100 - space_weight\n"
+            "\t[-t tolerance=10] the tolerance percentage of "
+            "the score difference\n"
+            "\t[-m max_moves=0] the max data groups to move, "
+            "0 for no limit\n"
+            "\t[-i interval=10] the sampling interval in seconds "
+            "for the update rate\n\n"
+            "the space of the data group is the trunk space used by "
+            "its slices, the update rate is the data version increase "
+            "per second of its master in the sampling interval.\n"
+            "this tool only plans the moves, the data groups are "
+            "migrated by the printed steps and the new cluster.conf\n\n",
+            argv[0], FS_CLIENT_DEFAULT_CONFIG_FILENAME);
+}
+
+static double calc_score(const int64_t used, const double rate,
+        const int64_t total)
+{
+    double capacity_ratio;
+    double space_ratio;
+    double rate_ratio;
+
+    if (total <= 0 || rebalance_ctx.total <= 0) {
+        return 0.00;
+    }
+
+    /* the share of the demand divided by the share of the capacity,
+     * 1.00 for the perfect balance */
+    capacity_ratio = (double)total / (double)rebalance_ctx.total;
+    space_ratio = (rebalance_ctx.used > 0) ? (double)used /
+        (double)rebalance_ctx.used : 0.00;
+    rate_ratio = (rebalance_ctx.rate > 0.00) ? rate /
+        rebalance_ctx.rate : 0.00;
+    return (space_ratio * rebalance_ctx.space_weight + rate_ratio *
+            (100 - rebalance_ctx.space_weight)) / 100.00 / capacity_ratio;
+}
+
+static inline void calc_sg_score(RebalanceServerGroup *sg)
+{
+    sg->score = calc_score(sg->used, sg->rate, sg->total);
+}
+
+static int init_rebalance_ctx(FSClusterConfig *cluster_cfg)
+{
+    FSServerGroup *server_group;
+    RebalanceServerGroup *sg;
+    RebalanceDataGroup *dg;
+    int bytes;
+    int i;
+
+    rebalance_ctx.sg_count = FS_SERVER_GROUP_COUNT(*cluster_cfg);
+    rebalance_ctx.dg_count = FS_DATA_GROUP_COUNT(*cluster_cfg);
+
+    bytes = sizeof(RebalanceServerGroup) * rebalance_ctx.sg_count;
+    if ((rebalance_ctx.sgroups=fc_malloc(bytes)) == NULL) {
+        return ENOMEM;
+    }
+    memset(rebalance_ctx.sgroups, 0, bytes);
+
+    bytes = sizeof(RebalanceDataGroup) * rebalance_ctx.dg_count;
+    if ((rebalance_ctx.dgroups=fc_malloc(bytes)) == NULL) {
+        return ENOMEM;
+    }
+    memset(rebalance_ctx.dgroups, 0, bytes);
+
+    for (i=0; i<rebalance_ctx.sg_count; i++) {
+        rebalance_ctx.sgroups[i].server_group =
+            cluster_cfg->server_groups.groups + i;
+    }
+
+    for (i=0; i<rebalance_ctx.dg_count; i++) {
+        dg = rebalance_ctx.dgroups + i;
+        dg->data_group_id = cluster_cfg->data_groups.
+            mappings[i].data_group_id;
+        server_group = cluster_cfg->data_groups.mappings[i].server_group;
+        sg = rebalance_ctx.sgroups + (server_group -
+                cluster_cfg->server_groups.groups);
+        dg->sg = dg->src = sg;
+        sg->dg_count++;
+    }
+
+    return 0;
+}
+
+/* the first call records the data versions, the second call
+ * calculates the update rates since the first call */
+static int load_data_group_stats(FSClientContext *client_ctx,
+        const bool calc_rate)
+{
+    RebalanceDataGroup *dg;
+    FSClusterStatFilter filter;
+    FSClientClusterStatEntry *stats;
+    FSClientClusterStatEntry *stat;
+    FSClientClusterStatEntry *end;
+    double seconds;
+    int alloc_size;
+    int count;
+    int index;
+    int result;
+
+    memset(&filter, 0, sizeof(filter));
+    filter.filter_by = FS_CLUSTER_STAT_FILTER_BY_IS_MASTER;
+    filter.is_master = true;
+
+    alloc_size = rebalance_ctx.dg_count;
+    stats = (FSClientClusterStatEntry *)fc_malloc(
+            sizeof(FSClientClusterStatEntry) * alloc_size);
+    if (stats == NULL) {
+        return ENOMEM;
+    }
+
+    if ((result=fs_cluster_stat(client_ctx, NULL, &filter,
+                    stats, alloc_size, &count)) != 0)
+    {
+        fprintf(stderr, "fs_cluster_stat fail, "
+                "errno: %d, error info: %s\n", result, STRERROR(result));
+        free(stats);
+        return result;
+    }
+
+    if (calc_rate) {
+        seconds = (double)(get_current_time_ms() -
+                rebalance_ctx.sample_time_ms) / 1000.00;
+    } else {
+        seconds = 0.00;
+        rebalance_ctx.sample_time_ms = get_current_time_ms();
+    }
+
+    end = stats + count;
+    for (stat=stats; stat<end; stat++) {
+        index = stat->data_group_id - 1;
+        if (index < 0 || index >= rebalance_ctx.dg_count) {
+            continue;
+        }
+
+        dg = rebalance_ctx.dgroups + index;
+        if (!calc_rate) {
+            dg->data_version = stat->data_version;
+        } else if (stat->data_version > dg->data_version &&
+                seconds > 0.00)
+        {
+            dg->rate = (double)(stat->data_version -
+                    dg->data_version) / seconds;
+        }
+    }
+
+    free(stats);
+    return 0;
+}
+
+static int load_data_group_space(FSClientContext *client_ctx,
+        RebalanceServerGroup *sg)
+{
+    FSClientDataGroupSpaceStat *stats;
+    FSClientDataGroupSpaceStat *stat;
+    FSClientDataGroupSpaceStat *end;
+    FCServerInfo *server;
+    int index;
+    int count;
+    int result;
+    int i;
+
+    stats = (FSClientDataGroupSpaceStat *)fc_malloc(
+            sizeof(FSClientDataGroupSpaceStat) * rebalance_ctx.dg_count);
+    if (stats == NULL) {
+        return ENOMEM;
+    }
+
+    /* the servers of the server group hold the same data groups */
+    result = ENOENT;
+    for (i=0; i<sg->server_group->server_array.count; i++) {
+        server = sg->server_group->server_array.servers[i];
+        if ((result=fs_client_server_dg_space_stat(client_ctx, server,
+                        stats, rebalance_ctx.dg_count, &count)) == 0)
+        {
+            break;
+        }
+        fprintf(stderr, "server id: %d, data group space stat fail, "
+                "errno: %d, error info: %s\n", server->id,
+                result, STRERROR(result));
+    }
+
+    if (result == 0) {
+        end = stats + count;
+        for (stat=stats; stat<end; stat++) {
+            index = stat->data_group_id - 1;
+            if (index >= 0 && index < rebalance_ctx.dg_count &&
+                    rebalance_ctx.dgroups[index].sg == sg)
+            {
+                rebalance_ctx.dgroups[index].space = stat->used;
+            }
+        }
+    }
+
+    free(stats);
+    return result;
+}
+
+static int load_server_group_space(FSClientContext *client_ctx,
+        RebalanceServerGroup *sg)
+{
+    FSClientServerSpaceStat stats[FS_MAX_GROUP_SERVERS];
+    FSClientServerSpaceStat *stat;
+    FSClientServerSpaceStat *end;
+    int count;
+    int result;
+
+    if (sg->server_group->server_array.count == 0) {
+        return ENOENT;
+    }
+
+    if ((result=fs_client_server_group_space_stat(client_ctx,
+                    sg->server_group->server_array.servers[0],
+                    stats, FS_MAX_GROUP_SERVERS, &count)) != 0)
+    {
+        fprintf(stderr, "server group id: %d, space stat fail, "
+                "errno: %d, error info: %s\n", sg->server_group->
+                server_group_id, result, STRERROR(result));
+        return result;
+    }
+
+    /* the capacity of the server group is limited by the smallest server */
+    end = stats + count;
+    for (stat=stats; stat<end; stat++) {
+        if (stat->stat.total <= 0) {
+            continue;
+        }
+        if (sg->total == 0 || stat->stat.total < sg->total) {
+            sg->total = stat->stat.total;
+        }
+    }
+
+    return load_data_group_space(client_ctx, sg);
+}
+
+static void sum_server_group_stats()
+{
+    RebalanceDataGroup *dg;
+    RebalanceDataGroup *end;
+
+    end = rebalance_ctx.dgroups + rebalance_ctx.dg_count;
+    for (dg=rebalance_ctx.dgroups; dg<end; dg++) {
+        dg->sg->used += dg->space;
+        dg->sg->rate += dg->rate;
+        rebalance_ctx.used += dg->space;
+        rebalance_ctx.rate += dg->rate;
+    }
+}
+
+static int load_stats(FSClientContext *client_ctx)
+{
+    RebalanceServerGroup *sg;
+    RebalanceServerGroup *end;
+    int result;
+
+    if ((result=load_data_group_stats(client_ctx, false)) != 0) {
+        return result;
+    }
+
+    end = rebalance_ctx.sgroups + rebalance_ctx.sg_count;
+    for (sg=rebalance_ctx.sgroups; sg<end; sg++) {
+        if ((result=load_server_group_space(client_ctx, sg)) != 0) {
+            return result;
+        }
+        rebalance_ctx.total += sg->total;
+    }
+
+    printf("sampling the update rate of the data groups in %d seconds "
+            "...\n", rebalance_ctx.interval);
+    sleep(rebalance_ctx.interval);
+    if ((result=load_data_group_stats(client_ctx, true)) != 0) {
+        return result;
+    }
+
+    sum_server_group_stats();
+    for (sg=rebalance_ctx.sgroups; sg<end; sg++) {
+        calc_sg_score(sg);
+    }
+    return 0;
+}
+
+static void get_min_max_groups(RebalanceServerGroup **min_sg,
+        RebalanceServerGroup **max_sg)
+{
+    RebalanceServerGroup *sg;
+    RebalanceServerGroup *end;
+
+    *min_sg = *max_sg = NULL;
+    end = rebalance_ctx.sgroups + rebalance_ctx.sg_count;
+    for (sg=rebalance_ctx.sgroups; sg<end; sg++) {
+        if (sg->total <= 0) {  //unknown capacity
+            continue;
+        }
+
+        if (*min_sg == NULL || sg->score < (*min_sg)->score) {
+            *min_sg = sg;
+        }
+        if (*max_sg == NULL || sg->score > (*max_sg)->score) {
+            *max_sg = sg;
+        }
+    }
+}
+
+/* select the data group which makes the two server groups most balanced */
+static RebalanceDataGroup *select_data_group(RebalanceServerGroup *from,
+        RebalanceServerGroup *to)
+{
+    RebalanceDataGroup *dg;
+    RebalanceDataGroup *end;
+    RebalanceDataGroup *selected;
+    double from_score;
+    double to_score;
+    double max_score;
+    double min_max_score;
+
+    if (from->dg_count <= 1) {
+        return NULL;
+    }
+
+    selected = NULL;
+    min_max_score = from->score;
+    end = rebalance_ctx.dgroups + rebalance_ctx.dg_count;
+    for (dg=rebalance_ctx.dgroups; dg<end; dg++) {
+        if (dg->sg != from || dg->moved) {
+            continue;
+        }
+
+        from_score = calc_score(from->used - dg->space,
+                from->rate - dg->rate, from->total);
+        to_score = calc_score(to->used + dg->space,
+                to->rate + dg->rate, to->total);
+        max_score = (from_score > to_score) ? from_score : to_score;
+        if (max_score < min_max_score) {
+            min_max_score = max_score;
+            selected = dg;
+        }
+    }
+
+    return selected;
+}
+
+static int rebalance()
+{
+    RebalanceServerGroup *min_sg;
+    RebalanceServerGroup *max_sg;
+    RebalanceDataGroup *dg;
+    int moves;
+
+    moves = 0;
+    while (rebalance_ctx.max_moves == 0 ||
+            moves < rebalance_ctx.max_moves)
+    {
+        get_min_max_groups(&min_sg, &max_sg);
+        if (min_sg == NULL || min_sg == max_sg || (max_sg->score -
+                    min_sg->score) * 100.00 <= rebalance_ctx.tolerance)
+        {
+            break;
+        }
+
+        if ((dg=select_data_group(max_sg, min_sg)) == NULL) {
+            break;
+        }
+
+        max_sg->used -= dg->space;
+        max_sg->rate -= dg->rate;
+        max_sg->dg_count--;
+        min_sg->used += dg->space;
+        min_sg->rate += dg->rate;
+        min_sg->dg_count++;
+        calc_sg_score(max_sg);
+        calc_sg_score(min_sg);
+
+        dg->sg = min_sg;
+        dg->moved = true;
+        moves++;
+    }
+
+    return moves;
+}
+
+static void output_server_groups(const char *caption)
+{
+    RebalanceServerGroup *sg;
+    RebalanceServerGroup *end;
+
+    printf("%s:\n", caption);
+    end = rebalance_ctx.sgroups + rebalance_ctx.sg_count;
+    for (sg=rebalance_ctx.sgroups; sg<end; sg++) {
+        printf("\tserver_group_id: %d, data group count: %d, "
+                "total: %"PRId64" MB, used: %"PRId64" MB, "
+                "update rate: %.1f/s, score: %.2f\n",
+                sg->server_group->server_group_id, sg->dg_count,
+                sg->total / (1024 * 1024), sg->used / (1024 * 1024),
+                sg->rate, sg->score);
+    }
+    printf("\n");
+}
+
+static void output_server_ids(FSServerGroup *server_group)
+{
+    int i;
+
+    for (i=0; i<server_group->server_array.count; i++) {
+        printf("%s%d", (i > 0 ? ", " : ""),
+                server_group->server_array.servers[i]->id);
+    }
+}
+
+static void output_moves(const int moves)
+{
+    RebalanceDataGroup *dg;
+    RebalanceDataGroup *end;
+    int step;
+
+    if (moves == 0) {
+        printf("the cluster is balanced, no data group to move\n\n");
+        return;
+    }
+
+    printf("data group moves: %d\n", moves);
+    step = 0;
+    end = rebalance_ctx.dgroups + rebalance_ctx.dg_count;
+    for (dg=rebalance_ctx.dgroups; dg<end; dg++) {
+        if (dg->sg == dg->src) {
+            continue;
+        }
+
+        printf("\t%d. data_group_id: %d, server group %d => %d, "
+                "space: %"PRId64" MB, update rate: %.1f/s\n",
+                ++step, dg->data_group_id,
+                dg->src->server_group->server_group_id,
+                dg->sg->server_group->server_group_id,
+                dg->space / (1024 * 1024), dg->rate);
+        printf("\t   a) add the servers [");
+        output_server_ids(dg->sg->server_group);
+        printf("] to the data group as the new replicas, "
+                "they recover the data from the master\n");
+        printf("\t   b) wait until the new replicas are ACTIVE: "
+                "fs_cluster_stat -g %d -N shows nothing\n",
+                dg->data_group_id);
+        printf("\t   c) retire the old replicas [");
+        output_server_ids(dg->src->server_group);
+        printf("] from the data group\n");
+    }
+    printf("\n");
+}
+
+static inline void output_id_range(const int start_id, const int last_id)
+{
+    if (start_id == last_id) {
+        printf("data_group_ids = %d\n", start_id);
+    } else {
+        printf("data_group_ids = [%d, %d]\n", start_id, last_id);
+    }
+}
+
+static void output_cluster_config()
+{
+    RebalanceServerGroup *sg;
+    RebalanceServerGroup *sgend;
+    RebalanceDataGroup *dg;
+    RebalanceDataGroup *end;
+    int start_id;
+    int last_id;
+
+    printf("the data group mapping of cluster.conf after rebalance:\n\n");
+    sgend = rebalance_ctx.sgroups + rebalance_ctx.sg_count;
+    end = rebalance_ctx.dgroups + rebalance_ctx.dg_count;
+    for (sg=rebalance_ctx.sgroups; sg<sgend; sg++) {
+        printf("[server-group-%d]\nserver_ids = ",
+                sg->server_group->server_group_id);
+        output_server_ids(sg->server_group);
+        printf("\n");
+
+        start_id = last_id = 0;
+        for (dg=rebalance_ctx.dgroups; dg<end; dg++) {
+            if (dg->sg != sg) {
+                continue;
+            }
+
+            if (start_id > 0 && dg->data_group_id == last_id + 1) {
+                last_id = dg->data_group_id;
+                continue;
+            }
+
+            if (start_id > 0) {
+                output_id_range(start_id, last_id);
+            }
+            start_id = last_id = dg->data_group_id;
+        }
+
+        if (start_id > 0) {
+            output_id_range(start_id, last_id);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+#define EMPTY_POOL_NAME SF_G_EMPTY_STRING
+
+    const bool publish = false;
+    const char *config_filename = FS_CLIENT_DEFAULT_CONFIG_FILENAME;
+    int ch;
+    int moves;
+    int result;
+
+    rebalance_ctx.space_weight = 50;
+    rebalance_ctx.tolerance = 10;
+    rebalance_ctx.interval = 10;
+    while ((ch=getopt(argc, argv, "hc:w:t:m:i:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'c':
+                config_filename = optarg;
+                break;
+            case 'w':
+                rebalance_ctx.space_weight = strtol(optarg, NULL, 10);
+                break;
+            case 't':
+                rebalance_ctx.tolerance = strtol(optarg, NULL, 10);
+                break;
+            case 'm':
+                rebalance_ctx.max_moves = strtol(optarg, NULL, 10);
+                break;
+            case 'i':
+                rebalance_ctx.interval = strtol(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv);
+                return 1;
+        }
+    }
+
+    if (rebalance_ctx.space_weight < 0 || rebalance_ctx.space_weight > 100) {
+        fprintf(stderr, "invalid space weight: %d, "
+                "the valid range is [0, 100]\n", rebalance_ctx.space_weight);
+        return EINVAL;
+    }
+    if (rebalance_ctx.tolerance < 0 || rebalance_ctx.max_moves < 0 ||
+            rebalance_ctx.interval <= 0)
+    {
+        usage(argv);
+        return EINVAL;
+    }
+
+    log_init();
+    if ((result=fs_client_init_with_auth_ex1(&g_fs_client_vars.
+                    client_ctx, &g_fcfs_auth_client_vars.client_ctx,
+                    config_filename, NULL, NULL, false, &EMPTY_POOL_NAME,
+                    publish)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=init_rebalance_ctx(g_fs_client_vars.
+                    client_ctx.cluster_cfg.ptr)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=load_stats(&g_fs_client_vars.client_ctx)) != 0) {
+        return result;
+    }
+
+    printf("\n");
+    output_server_groups("server groups before rebalance");
+    moves = rebalance();
+    output_moves(moves);
+    if (moves > 0) {
+        output_server_groups("server groups after rebalance");
+        output_cluster_config();
+    }
+
+    return 0;
+}
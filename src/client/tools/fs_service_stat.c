@@ -27,8 +27,30 @@
 static void usage(char *argv[])
 {
     fprintf(stderr, "Usage: %s [-c config_filename=%s] "
-            "[-s server_id] [-g data_group_id=0] host[:port]\n",
-            argv[0], FS_CLIENT_DEFAULT_CONFIG_FILENAME);
+            "[-s server_id] [-g data_group_id=0] [-l for latency stat] "
+            "host[:port]\n", argv[0], FS_CLIENT_DEFAULT_CONFIG_FILENAME);
+}
+
+static void output_data_thread(const char *caption,
+        const FSDataThreadStat *stat)
+{
+    printf("%s: {threads: %d, busy: %d, waiting: %d, max_waiting: %d, "
+            "done: %"PRId64", stolen: %"PRId64", donated: %"PRId64"}",
+            caption, stat->thread_count, stat->busy_count,
+            stat->waiting_count, stat->max_waiting_count,
+            stat->done_count, stat->stolen_count, stat->donated_count);
+}
+
+static void output_throttle_rate(const char *caption,
+        const FSThrottleRateStat *stat)
+{
+    if (stat->target > 0) {
+        printf("%s: {current: %"PRId64" KB/s, target: %"PRId64" KB/s}",
+                caption, stat->current / 1024, stat->target / 1024);
+    } else {
+        printf("%s: {current: %"PRId64" KB/s, target: unlimited}",
+                caption, stat->current / 1024);
+    }
 }
 
 static void output(FSClientServiceStat *stat)
@@ -49,7 +71,7 @@ static void output(FSClientServiceStat *stat)
             "writer: {next_version: %"PRId64", total_count: %"PRId64", "
             "waiting_count: %d, max_waitings: %d}}\n"
             "\tdata : {ob_count: %"PRId64", slice_count: %"PRId64", "
-            "avg slices/OB: %.2f}\n\n", stat->server_id,
+            "avg slices/OB: %.2f}\n", stat->server_id,
             stat->is_leader ?  "true" : "false",
             stat->connection.current_count,
             stat->connection.max_count,
@@ -60,6 +82,41 @@ static void output(FSClientServiceStat *stat)
             stat->binlog.writer.max_waitings,
             stat->data.ob_count, stat->data.slice_count,
             avg_slices);
+
+    printf("\tdata_thread : {");
+    output_data_thread("master", &stat->data_thread.master);
+    printf(", ");
+    output_data_thread("slave", &stat->data_thread.slave);
+    printf("}\n");
+
+    printf("\tbackground_throttle : {latency_p99: %d us, "
+            "queue_depth: %d, ", stat->background_throttle.latency_p99,
+            stat->background_throttle.queue_depth);
+    output_throttle_rate("recovery", &stat->background_throttle.recovery);
+    printf(", ");
+    output_throttle_rate("reclaim", &stat->background_throttle.reclaim);
+    printf("}\n\n");
+}
+
+static void output_latency(const FSLatencyStatEntry *entries,
+        const int count)
+{
+    const FSLatencyStatEntry *entry;
+    const FSLatencyStatEntry *end;
+
+    printf("latency stat in microseconds:\n");
+    printf("%-8s %-9s %12s %8s %8s %8s %8s %8s %10s\n", "stage",
+            "op_type", "count", "avg", "p50", "p90", "p99",
+            "p999", "max");
+    end = entries + count;
+    for (entry=entries; entry<end; entry++) {
+        printf("%-8s %-9s %12"PRId64" %8d %8d %8d %8d %8d %10d\n",
+                fs_get_latency_stage_caption(entry->stage),
+                fs_get_latency_op_caption(entry->op_type),
+                entry->count, entry->avg, entry->p50, entry->p90,
+                entry->p99, entry->p999, entry->max);
+    }
+    printf("\n");
 }
 
 int main(int argc, char *argv[])
@@ -71,11 +128,15 @@ int main(int argc, char *argv[])
 	int ch;
     int server_id;
     int data_group_id;
+    int latency_count;
+    bool latency_stat;
     char *host;
     FCServerInfo *server;
     ConnectionInfo *spec_conn;
     ConnectionInfo conn;
     FSClientServiceStat stat;
+    FSLatencyStatEntry latency_entries[FS_LATENCY_STAGE_COUNT *
+        FS_LATENCY_OP_COUNT];
 	int result;
 
     if (argc < 2) {
@@ -85,7 +146,8 @@ int main(int argc, char *argv[])
 
     server_id = 0;
     data_group_id = 0;
-    while ((ch=getopt(argc, argv, "hc:s:g:")) != -1) {
+    latency_stat = false;
+    while ((ch=getopt(argc, argv, "hc:s:g:l")) != -1) {
         switch (ch) {
             case 'h':
                 usage(argv);
@@ -99,6 +161,9 @@ int main(int argc, char *argv[])
             case 'g':
                 data_group_id = strtol(optarg, NULL, 10);
                 break;
+            case 'l':
+                latency_stat = true;
+                break;
             default:
                 usage(argv);
                 return 1;
@@ -149,6 +214,19 @@ int main(int argc, char *argv[])
         spec_conn = &addr_parray->addrs[0]->conn;
     }
 
+    if (latency_stat) {
+        if ((result=fs_client_proto_latency_stat(&g_fs_client_vars.
+                        client_ctx, spec_conn, latency_entries,
+                        sizeof(latency_entries) / sizeof(latency_entries[0]),
+                        &latency_count)) != 0)
+        {
+            return result;
+        }
+
+        output_latency(latency_entries, latency_count);
+        return 0;
+    }
+
     if ((result=fs_client_proto_service_stat(&g_fs_client_vars.
                     client_ctx, spec_conn, data_group_id, &stat)) != 0)
     {
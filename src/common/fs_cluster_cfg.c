@@ -756,6 +756,217 @@ static int load_groups(FSClusterConfig *cluster_cfg,
     return check_server_data_mappings(cluster_cfg, cluster_filename);
 }
 
+static int set_data_group_compress_type(FSClusterConfig *cluster_cfg,
+        const char *cluster_filename, IniContext *ini_context,
+        const char *item_name, const char compress_type)
+{
+    const char *section_name = "compression";
+    FSIdArray data_group_ids;
+    FSDataServerMapping *mapping;
+    IniItem *items;
+    int item_count;
+    int result;
+    int i;
+
+    if ((items=iniGetValuesEx(section_name, item_name,
+                    ini_context, &item_count)) == NULL ||
+            (item_count == 1 && *items[0].value == '\0'))
+    {
+        return 0;  //not set or empty
+    }
+
+    INIT_ID_ARRAY(data_group_ids);
+    if ((result=get_ids(cluster_filename, ini_context, section_name,
+                    item_name, &data_group_ids)) != 0)
+    {
+        return result;
+    }
+
+    for (i=0; i<data_group_ids.count; i++) {
+        if (data_group_ids.ids[i] > cluster_cfg->data_groups.count) {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s, section: %s, item: %s, "
+                    "data group id: %d > data group count: %d",
+                    __LINE__, cluster_filename, section_name, item_name,
+                    data_group_ids.ids[i], cluster_cfg->data_groups.count);
+            result = EOVERFLOW;
+            break;
+        }
+
+        mapping = cluster_cfg->data_groups.mappings +
+            (data_group_ids.ids[i] - 1);
+        if (mapping->compress_type != FS_COMPRESS_TYPE_NONE) {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s, section: %s, item: %s, "
+                    "data group id: %d already use compression %s",
+                    __LINE__, cluster_filename, section_name, item_name,
+                    data_group_ids.ids[i], fs_get_compress_caption(
+                        mapping->compress_type));
+            result = EEXIST;
+            break;
+        }
+        mapping->compress_type = compress_type;
+    }
+
+    free(data_group_ids.ids);
+    return result;
+}
+
+static int load_compression(FSClusterConfig *cluster_cfg,
+        const char *cluster_filename, IniContext *ini_context)
+{
+    int result;
+
+    if ((result=set_data_group_compress_type(cluster_cfg,
+                    cluster_filename, ini_context,
+                    "lz4_data_group_ids", FS_COMPRESS_TYPE_LZ4)) != 0)
+    {
+        return result;
+    }
+
+    return set_data_group_compress_type(cluster_cfg,
+            cluster_filename, ini_context,
+            "zstd_data_group_ids", FS_COMPRESS_TYPE_ZSTD);
+}
+
+static int set_data_group_write_ack_policy(FSClusterConfig *cluster_cfg,
+        const char *cluster_filename, IniContext *ini_context,
+        const char *item_name, const char policy, char *policies)
+{
+    const char *section_name = "write-ack";
+    FSIdArray data_group_ids;
+    IniItem *items;
+    int item_count;
+    int result;
+    int i;
+
+    if ((items=iniGetValuesEx(section_name, item_name,
+                    ini_context, &item_count)) == NULL ||
+            (item_count == 1 && *items[0].value == '\0'))
+    {
+        return 0;  //not set or empty
+    }
+
+    INIT_ID_ARRAY(data_group_ids);
+    if ((result=get_ids(cluster_filename, ini_context, section_name,
+                    item_name, &data_group_ids)) != 0)
+    {
+        return result;
+    }
+
+    for (i=0; i<data_group_ids.count; i++) {
+        if (data_group_ids.ids[i] > cluster_cfg->data_groups.count) {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s, section: %s, item: %s, "
+                    "data group id: %d > data group count: %d",
+                    __LINE__, cluster_filename, section_name, item_name,
+                    data_group_ids.ids[i], cluster_cfg->data_groups.count);
+            result = EOVERFLOW;
+            break;
+        }
+
+        if (policies[data_group_ids.ids[i] - 1] != 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s, section: %s, item: %s, "
+                    "data group id: %d already use write ack policy %s",
+                    __LINE__, cluster_filename, section_name, item_name,
+                    data_group_ids.ids[i], fs_get_write_ack_policy_caption(
+                        policies[data_group_ids.ids[i] - 1]));
+            result = EEXIST;
+            break;
+        }
+        policies[data_group_ids.ids[i] - 1] = policy;
+    }
+
+    free(data_group_ids.ids);
+    return result;
+}
+
+static int calc_write_ack_quorum(const char policy,
+        const int quorum, const int server_count)
+{
+    switch (policy) {
+        case FS_WRITE_ACK_POLICY_MAJORITY:
+            return server_count / 2 + 1;
+        case FS_WRITE_ACK_POLICY_QUORUM:
+            return FC_MIN(quorum, server_count);
+        default:
+            return server_count;
+    }
+}
+
+static int load_write_ack(FSClusterConfig *cluster_cfg,
+        const char *cluster_filename, IniContext *ini_context)
+{
+    const char *section_name = "write-ack";
+    char *policy_str;
+    char *endptr;
+    char *policies;
+    char default_policy;
+    int default_quorum;
+    FSDataServerMapping *mapping;
+    FSDataServerMapping *mend;
+    int result;
+
+    default_quorum = 0;
+    policy_str = iniGetStrValue(section_name, "policy", ini_context);
+    if (policy_str == NULL || *policy_str == '\0' || strcasecmp(
+                policy_str, FS_WRITE_ACK_POLICY_ALL_STR) == 0)
+    {
+        default_policy = FS_WRITE_ACK_POLICY_ALL;
+    } else if (strcasecmp(policy_str,
+                FS_WRITE_ACK_POLICY_MAJORITY_STR) == 0)
+    {
+        default_policy = FS_WRITE_ACK_POLICY_MAJORITY;
+    } else {
+        default_policy = FS_WRITE_ACK_POLICY_QUORUM;
+        default_quorum = strtol(policy_str, &endptr, 10);
+        if (*endptr != '\0' || default_quorum <= 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s, section: %s, item: policy, "
+                    "invalid value: %s, expect %s, %s or a number > 0",
+                    __LINE__, cluster_filename, section_name, policy_str,
+                    FS_WRITE_ACK_POLICY_ALL_STR,
+                    FS_WRITE_ACK_POLICY_MAJORITY_STR);
+            return EINVAL;
+        }
+    }
+
+    policies = (char *)fc_malloc(cluster_cfg->data_groups.count);
+    if (policies == NULL) {
+        return ENOMEM;
+    }
+    memset(policies, 0, cluster_cfg->data_groups.count);
+
+    if ((result=set_data_group_write_ack_policy(cluster_cfg,
+                    cluster_filename, ini_context, "all_data_group_ids",
+                    FS_WRITE_ACK_POLICY_ALL, policies)) == 0)
+    {
+        result = set_data_group_write_ack_policy(cluster_cfg,
+                cluster_filename, ini_context, "majority_data_group_ids",
+                FS_WRITE_ACK_POLICY_MAJORITY, policies);
+    }
+
+    if (result == 0) {
+        mend = cluster_cfg->data_groups.mappings +
+            cluster_cfg->data_groups.count;
+        for (mapping=cluster_cfg->data_groups.mappings;
+                mapping<mend; mapping++)
+        {
+            mapping->write_ack.policy = policies[mapping->data_group_id - 1];
+            if (mapping->write_ack.policy == 0) {
+                mapping->write_ack.policy = default_policy;
+            }
+            mapping->write_ack.quorum = calc_write_ack_quorum(
+                    mapping->write_ack.policy, default_quorum,
+                    mapping->server_group->server_array.count);
+        }
+    }
+
+    free(policies);
+    return result;
+}
+
 static int find_group_indexes_in_cluster_config(FSClusterConfig *cluster_cfg,
         const char *filename)
 {
@@ -840,7 +1051,16 @@ int fs_cluster_cfg_load(FSClusterConfig *cluster_cfg,
         return result;
     }
 
-    result = load_groups(cluster_cfg, cluster_filename, &ini_context);
+    if ((result=load_groups(cluster_cfg, cluster_filename,
+                    &ini_context)) == 0)
+    {
+        if ((result=load_compression(cluster_cfg, cluster_filename,
+                        &ini_context)) == 0)
+        {
+            result = load_write_ack(cluster_cfg,
+                    cluster_filename, &ini_context);
+        }
+    }
     iniFreeContext(&ini_context);
     if (result != 0) {
         return result;
@@ -904,10 +1124,16 @@ void fs_cluster_cfg_to_log(FSClusterConfig *cluster_cfg)
 {
     FSServerGroup *sgroup;
     FSServerGroup *send;
+    FSDataServerMapping *mapping;
+    FSDataServerMapping *mend;
     char server_id_buff[1024];
     char group_id_buff[1024];
     char *p;
     char *buff_end;
+    int lz4_count;
+    int zstd_count;
+    int majority_count;
+    int quorum_count;
     int i;
 
     logInfo("server_group_count = %d", cluster_cfg->server_groups.count);
@@ -931,6 +1157,33 @@ void fs_cluster_cfg_to_log(FSClusterConfig *cluster_cfg)
         logInfo("server_ids = %s", server_id_buff);
         logInfo("data_group_ids = %s", group_id_buff);
     }
+
+    lz4_count = zstd_count = 0;
+    mend = cluster_cfg->data_groups.mappings + cluster_cfg->data_groups.count;
+    for (mapping=cluster_cfg->data_groups.mappings; mapping<mend; mapping++) {
+        if (mapping->compress_type == FS_COMPRESS_TYPE_LZ4) {
+            lz4_count++;
+        } else if (mapping->compress_type == FS_COMPRESS_TYPE_ZSTD) {
+            zstd_count++;
+        }
+    }
+    if (lz4_count > 0 || zstd_count > 0) {
+        logInfo("[compression] lz4 data group count: %d, "
+                "zstd data group count: %d", lz4_count, zstd_count);
+    }
+
+    majority_count = quorum_count = 0;
+    for (mapping=cluster_cfg->data_groups.mappings; mapping<mend; mapping++) {
+        if (mapping->write_ack.policy == FS_WRITE_ACK_POLICY_MAJORITY) {
+            majority_count++;
+        } else if (mapping->write_ack.policy == FS_WRITE_ACK_POLICY_QUORUM) {
+            quorum_count++;
+        }
+    }
+    if (majority_count > 0 || quorum_count > 0) {
+        logInfo("[write-ack] majority data group count: %d, "
+                "quorum data group count: %d", majority_count, quorum_count);
+    }
 }
 
 int fs_cluster_cfg_to_string(FSClusterConfig *cluster_cfg, FastBuffer *buffer)
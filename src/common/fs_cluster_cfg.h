@@ -36,6 +36,11 @@ typedef struct {
 typedef struct {
     int data_group_id;
     uint32_t hash_code;   //for master election
+    char compress_type;   //FS_COMPRESS_TYPE_xxx for the slices
+    struct {
+        char policy;      //FS_WRITE_ACK_POLICY_xxx
+        int quorum;       //the data servers to persist including the master
+    } write_ack;
     FSServerGroup *server_group;
 } FSDataServerMapping;
 
@@ -113,6 +118,55 @@ extern "C" {
 
     void fs_cluster_cfg_destroy(FSClusterConfig *cluster_cfg);
 
+    static inline char fs_cluster_cfg_get_dg_compress_type(
+            FSClusterConfig *cluster_cfg, const int data_group_index)
+    {
+        if (data_group_index < 0 || data_group_index >=
+                cluster_cfg->data_groups.count)
+        {
+            return FS_COMPRESS_TYPE_NONE;
+        }
+
+        return cluster_cfg->data_groups.mappings[
+            data_group_index].compress_type;
+    }
+
+    static inline const char *fs_get_compress_caption(const char type)
+    {
+        switch (type) {
+            case FS_COMPRESS_TYPE_LZ4:
+                return FS_COMPRESS_TYPE_LZ4_STR;
+            case FS_COMPRESS_TYPE_ZSTD:
+                return FS_COMPRESS_TYPE_ZSTD_STR;
+            default:
+                return FS_COMPRESS_TYPE_NONE_STR;
+        }
+    }
+
+    static inline const char *fs_get_write_ack_policy_caption(const char policy)
+    {
+        switch (policy) {
+            case FS_WRITE_ACK_POLICY_MAJORITY:
+                return FS_WRITE_ACK_POLICY_MAJORITY_STR;
+            case FS_WRITE_ACK_POLICY_QUORUM:
+                return FS_WRITE_ACK_POLICY_QUORUM_STR;
+            default:
+                return FS_WRITE_ACK_POLICY_ALL_STR;
+        }
+    }
+
+    static inline FSDataServerMapping *fs_cluster_cfg_get_dg_mapping(
+            FSClusterConfig *cluster_cfg, const int data_group_index)
+    {
+        if (data_group_index < 0 || data_group_index >=
+                cluster_cfg->data_groups.count)
+        {
+            return NULL;
+        }
+
+        return cluster_cfg->data_groups.mappings + data_group_index;
+    }
+
     static inline FSServerGroup *fs_cluster_cfg_get_server_group(
             FSClusterConfig *cluster_cfg, const int data_group_index)
     {
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include "fs_crc32c.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FS_CRC32C_HW_X86
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define FS_CRC32C_HW_ARM
+#include <arm_acle.h>
+#endif
+
+#define FS_CRC32C_POLY  0x82F63B78   //reversed Castagnoli polynomial
+
+typedef uint32_t (*crc32c_update_func)(uint32_t crc,
+        const unsigned char *p, size_t len);
+
+static uint32_t crc32c_table[8][256];
+static crc32c_update_func crc32c_update = NULL;
+
+static void crc32c_init_table()
+{
+    uint32_t crc;
+    int i;
+    int j;
+
+    for (i=0; i<256; i++) {
+        crc = i;
+        for (j=0; j<8; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ FS_CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    for (i=0; i<256; i++) {
+        crc = crc32c_table[0][i];
+        for (j=1; j<8; j++) {
+            crc = crc32c_table[0][crc & 0xFF] ^ (crc >> 8);
+            crc32c_table[j][i] = crc;
+        }
+    }
+}
+
+/* slicing-by-8, little endian only */
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 8) {
+        uint64_t word;
+
+        word = *(const uint64_t *)p ^ crc;
+        crc = crc32c_table[7][word & 0xFF] ^
+            crc32c_table[6][(word >> 8) & 0xFF] ^
+            crc32c_table[5][(word >> 16) & 0xFF] ^
+            crc32c_table[4][(word >> 24) & 0xFF] ^
+            crc32c_table[3][(word >> 32) & 0xFF] ^
+            crc32c_table[2][(word >> 40) & 0xFF] ^
+            crc32c_table[1][(word >> 48) & 0xFF] ^
+            crc32c_table[0][word >> 56];
+        p += 8;
+        len -= 8;
+    }
+#endif
+
+    while (len > 0) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    return crc;
+}
+
+#ifdef FS_CRC32C_HW_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t crc64;
+
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+
+    crc64 = crc;
+    while (len >= 8) {
+        crc64 = _mm_crc32_u64(crc64, *(const uint64_t *)p);
+        p += 8;
+        len -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+    return crc;
+}
+#elif defined(FS_CRC32C_HW_ARM)
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = __crc32cb(crc, *p++);
+        len--;
+    }
+
+    while (len >= 8) {
+        crc = __crc32cd(crc, *(const uint64_t *)p);
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0) {
+        crc = __crc32cb(crc, *p++);
+        len--;
+    }
+    return crc;
+}
+#endif
+
+void fs_crc32c_init()
+{
+    if (crc32c_update != NULL) {
+        return;
+    }
+
+#if defined(FS_CRC32C_HW_X86)
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_update = crc32c_hw;
+        return;
+    }
+#elif defined(FS_CRC32C_HW_ARM)
+    crc32c_update = crc32c_hw;
+    return;
+#endif
+
+    crc32c_init_table();
+    crc32c_update = crc32c_sw;
+}
+
+bool fs_crc32c_is_hw_accelerated()
+{
+    return crc32c_update != crc32c_sw;
+}
+
+uint32_t fs_crc32c_update(uint32_t crc, const void *buff, const int len)
+{
+    return ~crc32c_update(~crc, (const unsigned char *)buff, len);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _FS_CRC32C_H
+#define _FS_CRC32C_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* must be called once before use, select the hardware
+     * implementation (SSE4.2 or ARMv8 CRC) when supported */
+    void fs_crc32c_init();
+
+    bool fs_crc32c_is_hw_accelerated();
+
+    /* the crc is the result of the previous call for chaining,
+     * 0 for the first call */
+    uint32_t fs_crc32c_update(uint32_t crc, const void *buff, const int len);
+
+    static inline uint32_t fs_crc32c(const void *buff, const int len)
+    {
+        return fs_crc32c_update(0, buff, len);
+    }
+
+    static inline uint32_t fs_crc32c_iovec(const struct iovec *iov,
+            const int iovcnt)
+    {
+        const struct iovec *iob;
+        const struct iovec *end;
+        uint32_t crc;
+
+        crc = 0;
+        end = iov + iovcnt;
+        for (iob=iov; iob<end; iob++) {
+            crc = fs_crc32c_update(crc, iob->iov_base, iob->iov_len);
+        }
+        return crc;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
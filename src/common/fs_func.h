@@ -41,6 +41,40 @@ extern "C" {
         }
     }
 
+    static inline const char *fs_get_latency_stage_caption(const int stage)
+    {
+        switch (stage) {
+            case FS_LATENCY_STAGE_QUEUE:
+                return "queue";
+            case FS_LATENCY_STAGE_IO:
+                return "io";
+            case FS_LATENCY_STAGE_BINLOG:
+                return "binlog";
+            case FS_LATENCY_STAGE_REPLICA:
+                return "replica";
+            case FS_LATENCY_STAGE_TOTAL:
+                return "total";
+            default:
+                return "unkown";
+        }
+    }
+
+    static inline const char *fs_get_latency_op_caption(const int op_type)
+    {
+        switch (op_type) {
+            case FS_LATENCY_OP_READ:
+                return "read";
+            case FS_LATENCY_OP_WRITE:
+                return "write";
+            case FS_LATENCY_OP_ALLOCATE:
+                return "allocate";
+            case FS_LATENCY_OP_DELETE:
+                return "delete";
+            default:
+                return "unkown";
+        }
+    }
+
 #ifdef __cplusplus
 }
 #endif
@@ -64,6 +64,14 @@ const char *fs_get_cmd_caption(const int cmd)
             return "DISK_SPACE_STAT_REQ";
         case FS_SERVICE_PROTO_DISK_SPACE_STAT_RESP:
             return "DISK_SPACE_STAT_RESP";
+        case FS_SERVICE_PROTO_LATENCY_STAT_REQ:
+            return "LATENCY_STAT_REQ";
+        case FS_SERVICE_PROTO_LATENCY_STAT_RESP:
+            return "LATENCY_STAT_RESP";
+        case FS_SERVICE_PROTO_DG_SPACE_STAT_REQ:
+            return "DG_SPACE_STAT_REQ";
+        case FS_SERVICE_PROTO_DG_SPACE_STAT_RESP:
+            return "DG_SPACE_STAT_RESP";
         case FS_SERVICE_PROTO_SLICE_WRITE_REQ:
             return "SLICE_WRITE_REQ";
         case FS_SERVICE_PROTO_SLICE_WRITE_RESP:
@@ -84,6 +92,10 @@ const char *fs_get_cmd_caption(const int cmd)
             return "BLOCK_DELETE_REQ";
         case FS_SERVICE_PROTO_BLOCK_DELETE_RESP:
             return "BLOCK_DELETE_RESP";
+        case FS_SERVICE_PROTO_BLOCK_CLONE_REQ:
+            return "BLOCK_CLONE_REQ";
+        case FS_SERVICE_PROTO_BLOCK_CLONE_RESP:
+            return "BLOCK_CLONE_RESP";
         case FS_SERVICE_PROTO_GET_MASTER_REQ:
             return "GET_MASTER_REQ";
         case FS_SERVICE_PROTO_GET_MASTER_RESP:
@@ -42,6 +42,8 @@
 #define FS_SERVICE_PROTO_SLICE_DELETE_RESP       32
 #define FS_SERVICE_PROTO_BLOCK_DELETE_REQ        33
 #define FS_SERVICE_PROTO_BLOCK_DELETE_RESP       34
+#define FS_SERVICE_PROTO_BLOCK_CLONE_REQ         35
+#define FS_SERVICE_PROTO_BLOCK_CLONE_RESP        36
 
 #define FS_SERVICE_PROTO_SERVICE_STAT_REQ        41
 #define FS_SERVICE_PROTO_SERVICE_STAT_RESP       42
@@ -49,6 +51,10 @@
 #define FS_SERVICE_PROTO_CLUSTER_STAT_RESP       44
 #define FS_SERVICE_PROTO_DISK_SPACE_STAT_REQ     45
 #define FS_SERVICE_PROTO_DISK_SPACE_STAT_RESP    46
+#define FS_SERVICE_PROTO_LATENCY_STAT_REQ        47
+#define FS_SERVICE_PROTO_LATENCY_STAT_RESP       48
+#define FS_SERVICE_PROTO_DG_SPACE_STAT_REQ       49  //data group space stat
+#define FS_SERVICE_PROTO_DG_SPACE_STAT_RESP      50
 
 #define FS_SERVICE_PROTO_GET_MASTER_REQ           51
 #define FS_SERVICE_PROTO_GET_MASTER_RESP          52
@@ -131,6 +137,7 @@ typedef struct fs_proto_slice_write_req_header {
 typedef struct fs_proto_slice_update_resp {
     char inc_alloc[4];   //increase alloc space in bytes
     char padding[4];
+    char data_version[8];  //the data version of this update
 } FSProtoSliceUpdateResp;
 
 typedef struct fs_proto_slice_allocate_req {
@@ -145,8 +152,14 @@ typedef struct fs_proto_block_delete_req {
     FSProtoBlockKey bkey;
 } FSProtoBlockDeleteReq;
 
+typedef struct fs_proto_block_clone_req {
+    FSProtoBlockKey bkey;  //the dest block
+    char src_oid[8];       //the source object ID with the same block offset
+} FSProtoBlockCloneReq;
+
 typedef struct fs_proto_service_slice_read_req{
     FSProtoBlockSlice bs;
+    char data_version[8];  //the min data version to read, 0 for any
 } FSProtoServiceSliceReadReq;
 
 typedef struct fs_proto_replica_slice_read_req {
@@ -190,6 +203,21 @@ typedef struct fs_proto_service_stat_req {
     char data_group_id[4];   //0 for slice binlog
 } FSProtoServiceStatReq;
 
+typedef struct fs_proto_data_thread_stat {
+    char thread_count[4];
+    char busy_count[4];
+    char waiting_count[4];
+    char max_waiting_count[4];
+    char done_count[8];
+    char stolen_count[8];
+    char donated_count[8];
+} FSProtoDataThreadStat;
+
+typedef struct fs_proto_throttle_rate_stat {
+    char current[8];
+    char target[8];
+} FSProtoThrottleRateStat;
+
 typedef struct fs_proto_service_stat_resp {
     char server_id[4];
     char is_leader;
@@ -214,6 +242,18 @@ typedef struct fs_proto_service_stat_resp {
         char slice_count[8];
     } data;
 
+    struct {
+        FSProtoDataThreadStat master;
+        FSProtoDataThreadStat slave;
+    } data_thread;
+
+    struct {
+        char latency_p99[4];
+        char queue_depth[4];
+        FSProtoThrottleRateStat recovery;
+        FSProtoThrottleRateStat reclaim;
+    } background_throttle;
+
 } FSProtoServiceStatResp;
 
 typedef struct fs_proto_cluster_stat_req {
@@ -254,6 +294,35 @@ typedef struct fs_proto_disk_space_stat_resp_body_part {
     char avail[8];
 } FSProtoDiskSpaceStatRespBodyPart;
 
+typedef struct fs_proto_latency_stat_resp_body_header {
+    char count[4];
+    char padding[4];
+} FSProtoLatencyStatRespBodyHeader;
+
+typedef struct fs_proto_latency_stat_resp_body_part {
+    char stage;
+    char op_type;
+    char padding[6];
+    char count[8];
+    char avg[4];
+    char max[4];
+    char p50[4];
+    char p90[4];
+    char p99[4];
+    char p999[4];
+} FSProtoLatencyStatRespBodyPart;
+
+typedef struct fs_proto_dg_space_stat_resp_body_header {
+    char count[4];
+    char padding[4];
+} FSProtoDGSpaceStatRespBodyHeader;
+
+typedef struct fs_proto_dg_space_stat_resp_body_part {
+    char data_group_id[4];
+    char padding[4];
+    char used[8];
+} FSProtoDGSpaceStatRespBodyPart;
+
 typedef struct fs_proto_get_readable_server_req {
     char data_group_id[4];
     char read_rule;
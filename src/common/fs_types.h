@@ -49,6 +49,38 @@
 
 #define FS_CLIENT_JOIN_FLAGS_IDEMPOTENCY_REQUEST    1
 
+//the slice compression algorithm
+#define FS_COMPRESS_TYPE_NONE     0
+#define FS_COMPRESS_TYPE_LZ4     'L'
+#define FS_COMPRESS_TYPE_ZSTD    'Z'
+
+#define FS_COMPRESS_TYPE_NONE_STR   "none"
+#define FS_COMPRESS_TYPE_LZ4_STR    "lz4"
+#define FS_COMPRESS_TYPE_ZSTD_STR   "zstd"
+
+//the write ack policy of the data group
+#define FS_WRITE_ACK_POLICY_ALL       'A'  //all active data servers
+#define FS_WRITE_ACK_POLICY_MAJORITY  'M'  //the majority of the data servers
+#define FS_WRITE_ACK_POLICY_QUORUM    'Q'  //the specified data server count
+
+#define FS_WRITE_ACK_POLICY_ALL_STR       "all"
+#define FS_WRITE_ACK_POLICY_MAJORITY_STR  "majority"
+#define FS_WRITE_ACK_POLICY_QUORUM_STR    "quorum"
+
+//the stages of the request pipeline for latency stat
+#define FS_LATENCY_STAGE_QUEUE     0  //wait in the data thread queue
+#define FS_LATENCY_STAGE_IO        1  //trunk read / write
+#define FS_LATENCY_STAGE_BINLOG    2  //replica and slice binlog write
+#define FS_LATENCY_STAGE_REPLICA   3  //wait for the RPC results of slaves
+#define FS_LATENCY_STAGE_TOTAL     4  //from receipt to response
+#define FS_LATENCY_STAGE_COUNT     5
+
+#define FS_LATENCY_OP_READ         0
+#define FS_LATENCY_OP_WRITE        1
+#define FS_LATENCY_OP_ALLOCATE     2
+#define FS_LATENCY_OP_DELETE       3
+#define FS_LATENCY_OP_COUNT        4
+
 #define FS_FILE_BLOCK_ALIGN(offset) \
     (offset & (~(FS_FILE_BLOCK_SIZE - 1)))
 
@@ -95,6 +127,40 @@ typedef struct {
     int data_group_id;
 } FSClusterStatFilter;
 
+typedef struct {
+    int thread_count;
+    int busy_count;
+    int waiting_count;     //operations waiting to deal
+    int max_waiting_count; //max waiting count of threads
+    int64_t done_count;
+    int64_t stolen_count;  //work units stolen by idle threads
+    int64_t donated_count; //work units donated to idle threads
+} FSDataThreadStat;
+
+typedef struct {
+    int64_t current;  //the done bytes per second in the last interval
+    int64_t target;   //the limit bytes per second, 0 for unlimited
+} FSThrottleRateStat;
+
+typedef struct {
+    int latency_p99;  //the foreground latency p99 in microseconds
+    int queue_depth;  //the IO requests in queue of the trunk threads
+    FSThrottleRateStat recovery;
+    FSThrottleRateStat reclaim;
+} FSBackgroundThrottleStat;
+
+typedef struct {
+    char stage;    //FS_LATENCY_STAGE_xxx
+    char op_type;  //FS_LATENCY_OP_xxx
+    int64_t count;
+    int avg;       //the latencies in microseconds
+    int max;
+    int p50;
+    int p90;
+    int p99;
+    int p999;
+} FSLatencyStatEntry;
+
 typedef SFSpaceStat FSClusterSpaceStat;
 typedef SFBinlogWriterStat FSBinlogWriterStat;
 
@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fc_atomic.h"
+#include "sf/sf_global.h"
+#include "dio/trunk_read_thread.h"
+#include "dio/trunk_write_thread.h"
+#include "server_global.h"
+#include "server_qos.h"
+#include "latency_stat.h"
+#include "background_throttle.h"
+
+#define THROTTLE_MAX_SLEEP_MS  100
+
+typedef struct {
+    const char *caption;
+    struct {
+        int64_t max_bandwidth;  //0 for unlimited
+        int64_t min_bandwidth;
+        int64_t max_iops;       //0 for unlimited
+    } cfg;
+
+    pthread_mutex_t lock;
+    FSQoSBuckets buckets;
+
+    volatile int64_t done_bytes;  //reset per adjust interval
+    int64_t current_rate;
+} BackgroundThrottleLimiter;
+
+typedef struct {
+    bool enabled;
+    int target_latency_p99;  //in ms
+    int target_queue_depth;
+    int adjust_interval;     //in ms
+
+    BackgroundThrottleLimiter limiters[BACKGROUND_THROTTLE_TYPE_COUNT];
+
+    FSLatencyHistogram last_latency;  //the total stage of last adjust
+    volatile int latency_p99;  //in microseconds
+    volatile int queue_depth;
+} BackgroundThrottleContext;
+
+static BackgroundThrottleContext throttle_ctx = {
+    .limiters = {{.caption = "recovery"}, {.caption = "reclaim"}}
+};
+
+static int load_bandwidth(IniContext *ini_context, const char *filename,
+        const char *item_name, const int64_t default_value, int64_t *bytes)
+{
+    int result;
+    char *value;
+
+    value = iniGetStrValue("background-throttle", item_name, ini_context);
+    if (value == NULL || *value == '\0') {
+        *bytes = default_value;
+        return 0;
+    }
+    if ((result=parse_bytes(value, 1, bytes)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, section: background-throttle, "
+                "item: %s, value: %s is invalid", __LINE__,
+                filename, item_name, value);
+    }
+    return result;
+}
+
+static int load_limiter_config(IniContext *ini_context,
+        const char *filename, BackgroundThrottleLimiter *limiter,
+        const int64_t default_max_bandwidth,
+        const int64_t default_min_bandwidth)
+{
+    char max_item_name[64];
+    char min_item_name[64];
+    char iops_item_name[64];
+    int result;
+
+    sprintf(max_item_name, "%s_max_bandwidth", limiter->caption);
+    sprintf(min_item_name, "%s_min_bandwidth", limiter->caption);
+    sprintf(iops_item_name, "%s_max_iops", limiter->caption);
+    if ((result=load_bandwidth(ini_context, filename, max_item_name,
+                    default_max_bandwidth, &limiter->
+                    cfg.max_bandwidth)) != 0)
+    {
+        return result;
+    }
+    if ((result=load_bandwidth(ini_context, filename, min_item_name,
+                    default_min_bandwidth, &limiter->
+                    cfg.min_bandwidth)) != 0)
+    {
+        return result;
+    }
+
+    if (limiter->cfg.max_bandwidth <= 0) {
+        limiter->cfg.max_bandwidth = 0;
+        limiter->cfg.min_bandwidth = 0;
+    } else if ((limiter->cfg.min_bandwidth <= 0
+                || limiter->cfg.min_bandwidth > limiter->cfg.max_bandwidth))
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, %s: %"PRId64" is invalid, "
+                "set it to %s: %"PRId64, __LINE__, filename,
+                min_item_name, limiter->cfg.min_bandwidth,
+                max_item_name, limiter->cfg.max_bandwidth);
+        limiter->cfg.min_bandwidth = limiter->cfg.max_bandwidth;
+    }
+
+    limiter->cfg.max_iops = iniGetInt64Value("background-throttle",
+            iops_item_name, ini_context, 0);
+    if (limiter->cfg.max_iops < 0) {
+        limiter->cfg.max_iops = 0;
+    }
+    return 0;
+}
+
+int background_throttle_load_config(IniContext *ini_context,
+        const char *filename)
+{
+    IniFullContext ini_ctx;
+    int result;
+
+    FAST_INI_SET_FULL_CTX_EX(ini_ctx, filename,
+            "background-throttle", ini_context);
+    throttle_ctx.enabled = iniGetBoolValue(ini_ctx.section_name,
+            "enabled", ini_context, true);
+    throttle_ctx.target_latency_p99 = iniGetIntCorrectValue(&ini_ctx,
+            "target_latency_p99", FS_DEFAULT_THROTTLE_TARGET_LATENCY_P99,
+            1, 60 * 1000);
+    throttle_ctx.target_queue_depth = iniGetIntCorrectValue(&ini_ctx,
+            "target_queue_depth", FS_DEFAULT_THROTTLE_TARGET_QUEUE_DEPTH,
+            1, 1024 * 1024);
+    throttle_ctx.adjust_interval = iniGetIntCorrectValue(&ini_ctx,
+            "adjust_interval", FS_DEFAULT_THROTTLE_ADJUST_INTERVAL,
+            100, 60 * 1000);
+
+    if ((result=load_limiter_config(ini_context, filename,
+                    throttle_ctx.limiters + BACKGROUND_THROTTLE_TYPE_RECOVERY,
+                    FS_DEFAULT_RECOVERY_MAX_BANDWIDTH,
+                    FS_DEFAULT_RECOVERY_MIN_BANDWIDTH)) != 0)
+    {
+        return result;
+    }
+
+    return load_limiter_config(ini_context, filename,
+            throttle_ctx.limiters + BACKGROUND_THROTTLE_TYPE_RECLAIM,
+            FS_DEFAULT_RECLAIM_MAX_BANDWIDTH,
+            FS_DEFAULT_RECLAIM_MIN_BANDWIDTH);
+}
+
+static inline bool limiter_enabled(BackgroundThrottleLimiter *limiter)
+{
+    return throttle_ctx.enabled && (limiter->cfg.max_bandwidth > 0 ||
+            limiter->cfg.max_iops > 0);
+}
+
+/* the iops limit changes with the bandwidth proportionally */
+static void limiter_set_rate(BackgroundThrottleLimiter *limiter,
+        const int64_t bandwidth)
+{
+    int64_t iops;
+
+    if (limiter->cfg.max_iops > 0 && limiter->cfg.max_bandwidth > 0) {
+        iops = limiter->cfg.max_iops * bandwidth /
+            limiter->cfg.max_bandwidth;
+        if (iops <= 0) {
+            iops = 1;
+        }
+    } else {
+        iops = limiter->cfg.max_iops;
+    }
+
+    PTHREAD_MUTEX_LOCK(&limiter->lock);
+    fs_token_bucket_set_rate(&limiter->buckets.bytes, bandwidth, 1);
+    fs_token_bucket_set_rate(&limiter->buckets.iops, iops, 1);
+    PTHREAD_MUTEX_UNLOCK(&limiter->lock);
+}
+
+void background_throttle_acquire(const int type, const int64_t bytes)
+{
+    BackgroundThrottleLimiter *limiter;
+    int64_t current_time_us;
+    int64_t wait_us;
+    int64_t bytes_wait_us;
+
+    limiter = throttle_ctx.limiters + type;
+    FC_ATOMIC_INC_EX(limiter->done_bytes, bytes);
+    if (!limiter_enabled(limiter)) {
+        return;
+    }
+
+    while (SF_G_CONTINUE_FLAG) {
+        current_time_us = get_current_time_us();
+        PTHREAD_MUTEX_LOCK(&limiter->lock);
+        if (fs_token_bucket_available(&limiter->buckets.iops,
+                    current_time_us) && fs_token_bucket_available(
+                        &limiter->buckets.bytes, current_time_us))
+        {
+            fs_token_bucket_consume(&limiter->buckets.iops, 1);
+            fs_token_bucket_consume(&limiter->buckets.bytes, bytes);
+            PTHREAD_MUTEX_UNLOCK(&limiter->lock);
+            return;
+        }
+
+        wait_us = fs_token_bucket_wait_us(&limiter->buckets.iops);
+        bytes_wait_us = fs_token_bucket_wait_us(&limiter->buckets.bytes);
+        PTHREAD_MUTEX_UNLOCK(&limiter->lock);
+
+        if (bytes_wait_us > wait_us) {
+            wait_us = bytes_wait_us;
+        }
+        if (wait_us < 1000) {
+            fc_sleep_ms(1);
+        } else if (wait_us > THROTTLE_MAX_SLEEP_MS * 1000) {
+            fc_sleep_ms(THROTTLE_MAX_SLEEP_MS);  //for the rate change
+        } else {
+            fc_sleep_ms(wait_us / 1000);
+        }
+    }
+}
+
+/* return the p99 latency in microseconds of the foreground operations
+ * (service read and update) and the operation count since last call,
+ * calculated by the total stage histograms of the latency stat */
+static int fetch_latency_p99(int64_t *count)
+{
+    FSLatencyHistogram current;
+    FSLatencyHistogram hist;
+    int64_t p99;
+    int op_type;
+    int i;
+
+    memset(&current, 0, sizeof(current));
+    for (op_type=0; op_type<FS_LATENCY_OP_COUNT; op_type++) {
+        latency_stat_merge(FS_LATENCY_STAGE_TOTAL, op_type, &hist);
+        current.count += hist.count;
+        current.sum += hist.sum;
+        if (hist.max > current.max) {
+            current.max = hist.max;
+        }
+        for (i=0; i<LATENCY_BUCKET_COUNT; i++) {
+            current.buckets[i] += hist.buckets[i];
+        }
+    }
+
+    /* the histograms are cumulative, so take the delta of this interval */
+    hist.count = current.count - throttle_ctx.last_latency.count;
+    hist.sum = current.sum - throttle_ctx.last_latency.sum;
+    hist.max = current.max;
+    for (i=0; i<LATENCY_BUCKET_COUNT; i++) {
+        hist.buckets[i] = current.buckets[i] -
+            throttle_ctx.last_latency.buckets[i];
+        if (hist.buckets[i] < 0) {  //the shards are merged without lock
+            hist.buckets[i] = 0;
+        }
+    }
+    throttle_ctx.last_latency = current;
+
+    *count = hist.count;
+    p99 = latency_stat_percentile(&hist, 0.99);
+    return (int)FC_MIN(p99, INT_MAX);
+}
+
+/* AIMD: halve the rate when the foreground is busy, go to the max rate
+ * when the foreground idle, otherwise increase the rate step by step */
+static void adjust_limiter(BackgroundThrottleLimiter *limiter,
+        const bool busy, const bool idle)
+{
+    int64_t bandwidth;
+    int64_t done_bytes;
+
+    done_bytes = FC_ATOMIC_GET(limiter->done_bytes);
+    FC_ATOMIC_DEC_EX(limiter->done_bytes, done_bytes);
+    limiter->current_rate = done_bytes * 1000 / throttle_ctx.adjust_interval;
+    if (!limiter_enabled(limiter) || limiter->cfg.max_bandwidth == 0) {
+        return;
+    }
+
+    bandwidth = limiter->buckets.bytes.rate;
+    if (busy) {
+        bandwidth /= 2;
+        if (bandwidth < limiter->cfg.min_bandwidth) {
+            bandwidth = limiter->cfg.min_bandwidth;
+        }
+    } else if (idle) {
+        bandwidth = limiter->cfg.max_bandwidth;
+    } else {
+        bandwidth += limiter->cfg.max_bandwidth / 10;
+        if (bandwidth > limiter->cfg.max_bandwidth) {
+            bandwidth = limiter->cfg.max_bandwidth;
+        }
+    }
+
+    if (bandwidth != limiter->buckets.bytes.rate) {
+        limiter_set_rate(limiter, bandwidth);
+    }
+}
+
+static void *background_throttle_thread_func(void *arg)
+{
+    BackgroundThrottleLimiter *limiter;
+    BackgroundThrottleLimiter *end;
+    int64_t fg_count;
+    int latency_p99;
+    int queue_depth;
+    bool busy;
+    bool idle;
+
+#ifdef OS_LINUX
+    prctl(PR_SET_NAME, "bg-throttle");
+#endif
+
+    end = throttle_ctx.limiters + BACKGROUND_THROTTLE_TYPE_COUNT;
+    while (SF_G_CONTINUE_FLAG) {
+        fc_sleep_ms(throttle_ctx.adjust_interval);
+
+        latency_p99 = fetch_latency_p99(&fg_count);
+        queue_depth = trunk_read_thread_get_waiting_count() +
+            trunk_write_thread_get_waiting_count();
+        FC_ATOMIC_SET(throttle_ctx.latency_p99, latency_p99);
+        FC_ATOMIC_SET(throttle_ctx.queue_depth, queue_depth);
+
+        busy = (latency_p99 > throttle_ctx.target_latency_p99 * 1000 ||
+                queue_depth > throttle_ctx.target_queue_depth);
+        idle = (fg_count == 0);
+        for (limiter=throttle_ctx.limiters; limiter<end; limiter++) {
+            adjust_limiter(limiter, busy, idle);
+        }
+    }
+
+    return NULL;
+}
+
+int background_throttle_init()
+{
+    BackgroundThrottleLimiter *limiter;
+    BackgroundThrottleLimiter *end;
+    int result;
+    pthread_t tid;
+
+    end = throttle_ctx.limiters + BACKGROUND_THROTTLE_TYPE_COUNT;
+    for (limiter=throttle_ctx.limiters; limiter<end; limiter++) {
+        if ((result=init_pthread_lock(&limiter->lock)) != 0) {
+            return result;
+        }
+
+        /* start from the min rate and ramp up when the foreground idle */
+        fs_token_bucket_init(&limiter->buckets.bytes, 0, 1);
+        fs_token_bucket_init(&limiter->buckets.iops, 0, 1);
+        limiter_set_rate(limiter, limiter->cfg.min_bandwidth);
+    }
+
+    return fc_create_thread(&tid, background_throttle_thread_func,
+            NULL, SF_G_THREAD_STACK_SIZE);
+}
+
+void background_throttle_stat(FSBackgroundThrottleStat *stat)
+{
+    BackgroundThrottleLimiter *limiter;
+
+    stat->latency_p99 = FC_ATOMIC_GET(throttle_ctx.latency_p99);
+    stat->queue_depth = FC_ATOMIC_GET(throttle_ctx.queue_depth);
+
+    limiter = throttle_ctx.limiters + BACKGROUND_THROTTLE_TYPE_RECOVERY;
+    stat->recovery.current = limiter->current_rate;
+    stat->recovery.target = limiter_enabled(limiter) ?
+        limiter->buckets.bytes.rate : 0;
+
+    limiter = throttle_ctx.limiters + BACKGROUND_THROTTLE_TYPE_RECLAIM;
+    stat->reclaim.current = limiter->current_rate;
+    stat->reclaim.target = limiter_enabled(limiter) ?
+        limiter->buckets.bytes.rate : 0;
+}
+
+static void limiter_to_string(BackgroundThrottleLimiter *limiter,
+        char *buff, const int size)
+{
+    snprintf(buff, size, "%s_max_bandwidth: %"PRId64" MB, "
+            "%s_min_bandwidth: %"PRId64" MB, %s_max_iops: %"PRId64,
+            limiter->caption, limiter->cfg.max_bandwidth / (1024 * 1024),
+            limiter->caption, limiter->cfg.min_bandwidth / (1024 * 1024),
+            limiter->caption, limiter->cfg.max_iops);
+}
+
+void background_throttle_config_to_log()
+{
+    char recovery_config[256];
+    char reclaim_config[256];
+
+    limiter_to_string(throttle_ctx.limiters +
+            BACKGROUND_THROTTLE_TYPE_RECOVERY,
+            recovery_config, sizeof(recovery_config));
+    limiter_to_string(throttle_ctx.limiters +
+            BACKGROUND_THROTTLE_TYPE_RECLAIM,
+            reclaim_config, sizeof(reclaim_config));
+    logInfo("background-throttle {enabled: %d, target_latency_p99: %d ms, "
+            "target_queue_depth: %d, adjust_interval: %d ms, %s, %s}",
+            throttle_ctx.enabled, throttle_ctx.target_latency_p99,
+            throttle_ctx.target_queue_depth, throttle_ctx.adjust_interval,
+            recovery_config, reclaim_config);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//background_throttle.h
+
+#ifndef _BACKGROUND_THROTTLE_H_
+#define _BACKGROUND_THROTTLE_H_
+
+#include "fastcommon/common_define.h"
+#include "fastcommon/ini_file_reader.h"
+#include "common/fs_types.h"
+
+#define BACKGROUND_THROTTLE_TYPE_RECOVERY   0  //the data fetch of recovery
+#define BACKGROUND_THROTTLE_TYPE_RECLAIM    1  //the slice migrate of reclaim
+#define BACKGROUND_THROTTLE_TYPE_COUNT      2
+
+#define FS_DEFAULT_RECOVERY_MAX_BANDWIDTH  (256 * 1024 * 1024)
+#define FS_DEFAULT_RECOVERY_MIN_BANDWIDTH   (16 * 1024 * 1024)
+#define FS_DEFAULT_RECLAIM_MAX_BANDWIDTH   (128 * 1024 * 1024)
+#define FS_DEFAULT_RECLAIM_MIN_BANDWIDTH     (8 * 1024 * 1024)
+#define FS_DEFAULT_THROTTLE_TARGET_LATENCY_P99        20  //in ms
+#define FS_DEFAULT_THROTTLE_TARGET_QUEUE_DEPTH       128
+#define FS_DEFAULT_THROTTLE_ADJUST_INTERVAL         1000  //in ms
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int background_throttle_load_config(IniContext *ini_context,
+            const char *filename);
+
+    int background_throttle_init();
+
+    void background_throttle_config_to_log();
+
+    /* wait until the background operation can go on, the tokens
+     * can be overdrawn and the debt will be paid by the next call */
+    void background_throttle_acquire(const int type, const int64_t bytes);
+
+    void background_throttle_stat(FSBackgroundThrottleStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -83,7 +83,7 @@ static int get_replica_last_timestamp(time_t *last_timestamp)
     return 0;
 }
 
-static int binlog_check_get_last_timestamp(time_t *last_timestamp)
+int binlog_check_get_last_timestamp(time_t *last_timestamp)
 {
     int last_index;
     int result;
@@ -59,6 +59,9 @@ int binlog_compare_dg_version(const BinlogDataGroupVersion *p1,
 
 int binlog_consistency_init(BinlogConsistencyContext *ctx);
 
+/* get the max last timestamp of the slice and replica binlogs */
+int binlog_check_get_last_timestamp(time_t *last_timestamp);
+
 int binlog_consistency_check(BinlogConsistencyContext *ctx, int *flags);
 
 void binlog_consistency_destroy(BinlogConsistencyContext *ctx);
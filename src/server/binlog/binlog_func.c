@@ -129,10 +129,12 @@ static int get_start_binlog_index_by_timestamp(const char *subdir_name,
         const time_t from_timestamp, int *binlog_index)
 {
     char filename[PATH_MAX];
+    int start_index;
     int result;
     time_t timestamp;
 
-    while (*binlog_index >= 0) {
+    start_index = binlog_get_start_index(subdir_name);
+    while (*binlog_index >= start_index) {
         binlog_reader_get_filename(subdir_name, *binlog_index,
                 filename, sizeof(filename));
         result = binlog_get_first_timestamp(filename, &timestamp);
@@ -144,7 +146,7 @@ static int get_start_binlog_index_by_timestamp(const char *subdir_name,
             return result;
         }
 
-        if (*binlog_index == 0) {
+        if (*binlog_index == start_index) {
             break;
         }
         (*binlog_index)--;
@@ -263,3 +265,39 @@ int binlog_get_position_by_timestamp(const char *subdir_name,
     binlog_reader_destroy(&reader);
     return result;
 }
+
+static inline void get_start_index_filename(const char *subdir_name,
+        char *filename, const int size)
+{
+    snprintf(filename, size, "%s/%s/%s", DATA_PATH_STR,
+            subdir_name, BINLOG_START_INDEX_FILENAME);
+}
+
+int binlog_get_start_index(const char *subdir_name)
+{
+    char filename[PATH_MAX];
+    char buff[32];
+    int64_t file_size;
+
+    get_start_index_filename(subdir_name, filename, sizeof(filename));
+    if (access(filename, F_OK) != 0) {
+        return 0;
+    }
+
+    file_size = sizeof(buff);
+    if (getFileContentEx(filename, buff, 0, &file_size) != 0) {
+        return 0;
+    }
+    return strtol(buff, NULL, 10);
+}
+
+int binlog_set_start_index(const char *subdir_name, const int start_index)
+{
+    char filename[PATH_MAX];
+    char buff[32];
+    int len;
+
+    get_start_index_filename(subdir_name, filename, sizeof(filename));
+    len = sprintf(buff, "%d\n", start_index);
+    return safeWriteToFile(filename, buff, len);
+}
@@ -38,6 +38,12 @@ int binlog_get_position_by_timestamp(const char *subdir_name,
         struct sf_binlog_writer_info *writer, const time_t from_timestamp,
         SFBinlogFilePosition *pos);
 
+/* the binlog files before the start index are purged or compacted,
+ * return 0 when the start index file not exist */
+int binlog_get_start_index(const char *subdir_name);
+
+int binlog_set_start_index(const char *subdir_name, const int start_index);
+
 static inline int binlog_buffer_init(SFBinlogBuffer *buffer)
 {
     const int size = BINLOG_BUFFER_SIZE;
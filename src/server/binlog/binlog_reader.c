@@ -258,7 +258,7 @@ int binlog_reader_init_ex(ServerBinlogReader *reader,
     }
     reader->writer = writer;
     if (pos == NULL) {
-        reader->position.index = 0;
+        reader->position.index = binlog_get_start_index(subdir_name);
         reader->position.offset = 0;
     } else {
         reader->position = *pos;
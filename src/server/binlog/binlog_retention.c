@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fc_atomic.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "../storage/object_block_index.h"
+#include "binlog_func.h"
+#include "binlog_reader.h"
+#include "binlog_check.h"
+#include "slice_binlog.h"
+#include "replica_binlog.h"
+#include "replica_binlog_index.h"
+#include "binlog_retention.h"
+
+typedef struct {
+    bool enabled;
+    int keep_days;
+    int purge_interval;  //in seconds
+    int slice_compact_min_files;
+} BinlogRetentionContext;
+
+static BinlogRetentionContext retention_ctx;
+
+int binlog_retention_load_config(IniContext *ini_context,
+        const char *filename)
+{
+    IniFullContext ini_ctx;
+
+    FAST_INI_SET_FULL_CTX_EX(ini_ctx, filename,
+            "binlog-retention", ini_context);
+    retention_ctx.enabled = iniGetBoolValue(ini_ctx.section_name,
+            "enabled", ini_context, false);
+    retention_ctx.keep_days = iniGetIntCorrectValue(&ini_ctx,
+            "keep_days", FS_DEFAULT_BINLOG_RETENTION_KEEP_DAYS, 0, 3650);
+    retention_ctx.purge_interval = iniGetIntCorrectValue(&ini_ctx,
+            "purge_interval", FS_DEFAULT_BINLOG_PURGE_INTERVAL,
+            60, 86400);
+    retention_ctx.slice_compact_min_files = iniGetIntCorrectValue(&ini_ctx,
+            "slice_compact_min_files",
+            FS_DEFAULT_SLICE_BINLOG_COMPACT_MIN_FILES, 0, 1024 * 1024);
+    return 0;
+}
+
+void binlog_retention_config_to_log()
+{
+    logInfo("binlog-retention {enabled: %d, keep_days: %d, "
+            "purge_interval: %d s, slice_compact_min_files: %d}",
+            retention_ctx.enabled, retention_ctx.keep_days,
+            retention_ctx.purge_interval,
+            retention_ctx.slice_compact_min_files);
+}
+
+/* the binlog records after this timestamp are used by
+ * the binlog consistency check when startup */
+static int get_check_from_timestamp(time_t *last_timestamp,
+        time_t *from_timestamp)
+{
+    int result;
+
+    if ((result=binlog_check_get_last_timestamp(last_timestamp)) != 0) {
+        return result;
+    }
+    if (*last_timestamp <= 0) {
+        return ENOENT;
+    }
+
+    *from_timestamp = *last_timestamp - FC_MAX(
+            LOCAL_BINLOG_CHECK_LAST_SECONDS, 0) + 1;
+    return 0;
+}
+
+static void unlink_binlog_files(const char *subdir_name,
+        const int start_index, const int end_index)
+{
+    char filename[PATH_MAX];
+    char index_filename[PATH_MAX];
+    int binlog_index;
+
+    for (binlog_index=start_index; binlog_index<end_index; binlog_index++) {
+        binlog_reader_get_filename(subdir_name, binlog_index,
+                filename, sizeof(filename));
+        if (unlink(filename) != 0 && errno != ENOENT) {
+            logWarning("file: "__FILE__", line: %d, "
+                    "unlink file %s fail, errno: %d, error info: %s",
+                    __LINE__, filename, errno, STRERROR(errno));
+        }
+
+        snprintf(index_filename, sizeof(index_filename), "%s"
+                REPLICA_BINLOG_INDEX_FILE_SUFFIX, filename);
+        unlink(index_filename);
+    }
+}
+
+int binlog_retention_compact_slice_binlog()
+{
+    char filename[PATH_MAX];
+    int start_index;
+    int current_index;
+    int end_index;
+    int checkpoint_index;
+    time_t last_timestamp;
+    time_t from_timestamp;
+    time_t timestamp;
+    int result;
+
+    /* the checkpoint binlog of the broken compaction must be removed,
+     * otherwise the writer will append to it when rotate */
+    current_index = slice_binlog_get_current_write_index();
+    binlog_reader_get_filename(FS_SLICE_BINLOG_SUBDIR_NAME,
+            current_index + 1, filename, sizeof(filename));
+    if (access(filename, F_OK) == 0) {
+        logWarning("file: "__FILE__", line: %d, "
+                "remove the broken checkpoint binlog %s",
+                __LINE__, filename);
+        unlink(filename);
+    }
+
+    if (!retention_ctx.enabled || retention_ctx.
+            slice_compact_min_files <= 0)
+    {
+        return 0;
+    }
+
+    start_index = binlog_get_start_index(FS_SLICE_BINLOG_SUBDIR_NAME);
+    if (current_index - start_index < retention_ctx.
+            slice_compact_min_files)
+    {
+        return 0;
+    }
+
+    if ((result=get_check_from_timestamp(&last_timestamp,
+                    &from_timestamp)) != 0)
+    {
+        return (result == ENOENT) ? 0 : result;
+    }
+
+    /* keep the binlog files for the consistency check */
+    for (end_index=current_index - 1; end_index>=start_index; end_index--) {
+        binlog_reader_get_filename(FS_SLICE_BINLOG_SUBDIR_NAME,
+                end_index, filename, sizeof(filename));
+        if ((result=binlog_get_last_timestamp(filename, &timestamp)) == 0) {
+            if (timestamp < from_timestamp) {
+                break;
+            }
+        } else if (result != ENOENT) {  //ENOENT for empty file
+            return result;
+        }
+    }
+
+    if ((end_index - start_index) + 1 < retention_ctx.
+            slice_compact_min_files)
+    {
+        return 0;
+    }
+
+    /* the checkpoint is the slice index after all binlog files, so the
+     * kept binlog files MUST be replayed before the checkpoint */
+    if ((result=slice_binlog_checkpoint(last_timestamp,
+                    &checkpoint_index)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=binlog_set_start_index(FS_SLICE_BINLOG_SUBDIR_NAME,
+                    end_index + 1)) != 0)
+    {
+        return result;
+    }
+
+    unlink_binlog_files(FS_SLICE_BINLOG_SUBDIR_NAME,
+            start_index, end_index + 1);
+    logInfo("file: "__FILE__", line: %d, "
+            "compact slice binlog done, remove binlog files "
+            "[%d, %d], checkpoint binlog index: %d", __LINE__,
+            start_index, end_index, checkpoint_index);
+    return 0;
+}
+
+static uint64_t get_min_data_version(FSClusterDataGroupInfo *group)
+{
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+    uint64_t data_version;
+    uint64_t min_data_version;
+
+    min_data_version = UINT64_MAX;
+    end = group->data_server_array.servers + group->data_server_array.count;
+    for (ds=group->data_server_array.servers; ds<end; ds++) {
+        data_version = FC_ATOMIC_GET(ds->data.version);
+        if (data_version < min_data_version) {
+            min_data_version = data_version;
+        }
+    }
+
+    return min_data_version;
+}
+
+/* replace the last purged file with the snapshot of the live slices */
+static int dump_replica_binlog_snapshot(const int data_group_id,
+        const char *subdir_name, const int binlog_index)
+{
+    char filename[PATH_MAX];
+    char tmp_filename[PATH_MAX];
+    char index_filename[PATH_MAX];
+    struct stat stbuf;
+    struct timeval times[2];
+    uint64_t first_data_version;
+    int64_t slice_count;
+    time_t timestamp;
+    int result;
+
+    /* the data version of the snapshot records is the last purged one */
+    binlog_reader_get_filename(subdir_name, binlog_index + 1,
+            filename, sizeof(filename));
+    if ((result=replica_binlog_get_first_data_version(filename,
+                    &first_data_version)) != 0)
+    {
+        return result;
+    }
+
+    /* keep the timestamp and mtime of the replaced file for
+     * the consistency check and the retention by keep_days */
+    binlog_reader_get_filename(subdir_name, binlog_index,
+            filename, sizeof(filename));
+    if (stat(filename, &stbuf) != 0) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "stat file %s fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        return result;
+    }
+    if ((result=binlog_get_last_timestamp(filename, &timestamp)) != 0) {
+        return result;
+    }
+
+    binlog_reader_get_filename_ex(subdir_name, ".tmp", binlog_index,
+            tmp_filename, sizeof(tmp_filename));
+    if ((result=ob_index_dump_replica_binlog_to_file(data_group_id,
+                    first_data_version - 1, timestamp, tmp_filename,
+                    &slice_count)) != 0)
+    {
+        unlink(tmp_filename);
+        return result;
+    }
+
+    times[0].tv_sec = stbuf.st_atime;
+    times[0].tv_usec = 0;
+    times[1].tv_sec = stbuf.st_mtime;
+    times[1].tv_usec = 0;
+    if (utimes(tmp_filename, times) < 0) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "utimes file %s fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, result, STRERROR(result));
+        unlink(tmp_filename);
+        return result;
+    }
+
+    /* the index of the replaced file is invalid */
+    snprintf(index_filename, sizeof(index_filename), "%s"
+            REPLICA_BINLOG_INDEX_FILE_SUFFIX, filename);
+    unlink(index_filename);
+    if (rename(tmp_filename, filename) != 0) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "rename file %s to %s fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, filename, result, STRERROR(result));
+        unlink(tmp_filename);
+        return result;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "data group id: %d, dump %"PRId64" slices to the snapshot "
+            "binlog %s, data version: %"PRIu64, __LINE__, data_group_id,
+            slice_count, filename, first_data_version - 1);
+    return 0;
+}
+
+int binlog_retention_purge_replica_files(const int data_group_id,
+        const int start_index, const int end_index)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    int result;
+
+    /* at least one file removed besides the replaced one */
+    if (end_index - start_index < 2) {
+        return EINVAL;
+    }
+
+    replica_binlog_get_subdir_name(subdir_name, data_group_id);
+    if ((result=dump_replica_binlog_snapshot(data_group_id,
+                    subdir_name, end_index - 1)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=binlog_set_start_index(subdir_name, end_index - 1)) != 0) {
+        return result;
+    }
+
+    unlink_binlog_files(subdir_name, start_index, end_index - 1);
+    return 0;
+}
+
+static void purge_replica_binlog(FSClusterDataGroupInfo *group,
+        const time_t from_timestamp)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    char filename[PATH_MAX];
+    struct stat stbuf;
+    uint64_t min_data_version;
+    uint64_t first_data_version;
+    time_t timestamp;
+    time_t keep_time;
+    int start_index;
+    int current_index;
+    int end_index;
+    int result;
+
+    /* the data version confirmed by all servers of the data group */
+    if ((min_data_version=get_min_data_version(group)) == 0) {
+        return;
+    }
+
+    replica_binlog_get_subdir_name(subdir_name, group->id);
+    start_index = binlog_get_start_index(subdir_name);
+    current_index = replica_binlog_get_current_write_index(group->id);
+    keep_time = g_current_time - retention_ctx.keep_days * 86400;
+    for (end_index=start_index; end_index<current_index; end_index++) {
+        binlog_reader_get_filename(subdir_name, end_index,
+                filename, sizeof(filename));
+        if (stat(filename, &stbuf) != 0 || stbuf.st_mtime > keep_time) {
+            break;
+        }
+
+        /* keep the binlog files for the consistency check */
+        if (binlog_get_last_timestamp(filename, &timestamp) == 0 &&
+                timestamp >= from_timestamp)
+        {
+            break;
+        }
+
+        /* all records of this file are confirmed when the first data
+         * version of the next file <= the min data version + 1 */
+        binlog_reader_get_filename(subdir_name, end_index + 1,
+                filename, sizeof(filename));
+        if (replica_binlog_get_first_data_version(filename,
+                    &first_data_version) != 0 ||
+                first_data_version > min_data_version + 1)
+        {
+            break;
+        }
+    }
+
+    if (end_index - start_index < 2) {
+        return;
+    }
+
+    /* the new or rebuilt slave recovers from the snapshot */
+    if ((result=binlog_retention_purge_replica_files(group->id,
+                    start_index, end_index)) != 0)
+    {
+        return;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "data group id: %d, purge replica binlog files [%d, %d], "
+            "min confirmed data version: %"PRIu64, __LINE__,
+            group->id, start_index, end_index - 2, min_data_version);
+}
+
+static void purge_replica_binlogs()
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *end;
+    time_t last_timestamp;
+    time_t from_timestamp;
+
+    if (get_check_from_timestamp(&last_timestamp, &from_timestamp) != 0) {
+        return;
+    }
+
+    end = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<end &&
+            SF_G_CONTINUE_FLAG; group++)
+    {
+        if (group->myself != NULL) {
+            purge_replica_binlog(group, from_timestamp);
+        }
+    }
+}
+
+static void *binlog_purge_thread_func(void *arg)
+{
+    time_t last_purge_time;
+
+#ifdef OS_LINUX
+    prctl(PR_SET_NAME, "binlog-purge");
+#endif
+
+    last_purge_time = g_current_time;
+    while (SF_G_CONTINUE_FLAG) {
+        sleep(1);
+        if (g_current_time - last_purge_time >=
+                retention_ctx.purge_interval)
+        {
+            purge_replica_binlogs();
+            last_purge_time = g_current_time;
+        }
+    }
+
+    return NULL;
+}
+
+int binlog_retention_init()
+{
+    pthread_t tid;
+
+    if (!retention_ctx.enabled) {
+        return 0;
+    }
+
+    return fc_create_thread(&tid, binlog_purge_thread_func,
+            NULL, SF_G_THREAD_STACK_SIZE);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//binlog_retention.h
+
+#ifndef _BINLOG_RETENTION_H_
+#define _BINLOG_RETENTION_H_
+
+#include "fastcommon/ini_file_reader.h"
+#include "binlog_types.h"
+
+#define FS_DEFAULT_BINLOG_RETENTION_KEEP_DAYS          1
+#define FS_DEFAULT_BINLOG_PURGE_INTERVAL            3600  //in seconds
+#define FS_DEFAULT_SLICE_BINLOG_COMPACT_MIN_FILES      4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int binlog_retention_load_config(IniContext *ini_context,
+            const char *filename);
+
+    void binlog_retention_config_to_log();
+
+    /* compact the history slice binlog files to the checkpoint when startup,
+     * MUST be called after the binlog consistency check and before any update */
+    int binlog_retention_compact_slice_binlog();
+
+    /* purge the replica binlog files [start_index, end_index - 1) and
+     * replace the file end_index - 1 with the snapshot of the live slices
+     * of the data group for the full recovery of the new or rebuilt slave */
+    int binlog_retention_purge_replica_files(const int data_group_id,
+            const int start_index, const int end_index);
+
+    /* start the thread to purge the replica binlog files
+     * which confirmed by all servers of the data group */
+    int binlog_retention_init();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -41,12 +41,16 @@
 #define BINLOG_OP_TYPE_ALLOC_SLICE  'a'
 #define BINLOG_OP_TYPE_DEL_SLICE    'd'
 #define BINLOG_OP_TYPE_DEL_BLOCK    'D'
+#define BINLOG_OP_TYPE_CLONE_BLOCK  'L'
 #define BINLOG_OP_TYPE_NO_OP        'N'
 
 #define BINLOG_SOURCE_RECLAIM       'M'  //by trunk reclaim
 #define BINLOG_SOURCE_RPC_MASTER    'C'  //by user call (master side)
 #define BINLOG_SOURCE_RPC_SLAVE     'c'  //by user call (slave side)
 #define BINLOG_SOURCE_REPLAY        'r'  //by binlog replay  (slave side)
+#define BINLOG_SOURCE_COMPACT       'P'  //by slice binlog compaction
+
+#define BINLOG_START_INDEX_FILENAME  "binlog_start_index.dat"
 
 #define BINLOG_IS_INTERNAL_RECORD(op_type, data_version)  \
     (op_type == BINLOG_OP_TYPE_NO_OP || data_version == 0)
@@ -22,15 +22,20 @@
 #include "../../common/fs_func.h"
 #include "../server_global.h"
 #include "../server_group_info.h"
+#include "../slave_read_waiter.h"
 #include "../storage/storage_allocator.h"
 #include "../storage/trunk_id_info.h"
 #include "binlog_func.h"
 #include "binlog_reader.h"
 #include "binlog_loader.h"
+#include "replica_binlog_index.h"
 #include "replica_binlog.h"
 
 #define SLICE_EXPECT_FIELD_COUNT           8
 #define BLOCK_EXPECT_FIELD_COUNT           6
+#define CLONE_EXPECT_FIELD_COUNT           7
+
+#define CLONE_FIELD_INDEX_SRC_OID          6
 
 #define MAX_BINLOG_FIELD_COUNT  8
 #define MIN_EXPECT_FIELD_COUNT  BLOCK_EXPECT_FIELD_COUNT
@@ -38,11 +43,13 @@
 typedef struct {
     SFBinlogWriterInfo **writers;
     SFBinlogWriterInfo *holders;
+    ReplicaBinlogIndexContext *index_ctxs;  //parallel to holders
+    int holder_count;
     int count;
     int base_id;
 } BinlogWriterArray;
 
-static BinlogWriterArray binlog_writer_array = {NULL, 0};
+static BinlogWriterArray binlog_writer_array = {NULL, NULL, NULL, 0, 0};
 static SFBinlogWriterThread binlog_writer_thread;   //only one write thread
 
 int replica_binlog_get_first_record(const char *filename,
@@ -156,6 +163,8 @@ static inline int get_last_data_version_from_file(const int data_group_id,
 static int alloc_binlog_writer_array(const int my_data_group_count)
 {
     int bytes;
+    int result;
+    int i;
 
     bytes = sizeof(SFBinlogWriterInfo) * my_data_group_count;
     binlog_writer_array.holders = (SFBinlogWriterInfo *)fc_malloc(bytes);
@@ -164,6 +173,21 @@ static int alloc_binlog_writer_array(const int my_data_group_count)
     }
     memset(binlog_writer_array.holders, 0, bytes);
 
+    bytes = sizeof(ReplicaBinlogIndexContext) * my_data_group_count;
+    binlog_writer_array.index_ctxs = (ReplicaBinlogIndexContext *)
+        fc_malloc(bytes);
+    if (binlog_writer_array.index_ctxs == NULL) {
+        return ENOMEM;
+    }
+    for (i=0; i<my_data_group_count; i++) {
+        if ((result=replica_binlog_index_init_ctx(binlog_writer_array.
+                        index_ctxs + i)) != 0)
+        {
+            return result;
+        }
+    }
+    binlog_writer_array.holder_count = my_data_group_count;
+
     bytes = sizeof(SFBinlogWriterInfo *) * CLUSTER_DATA_RGOUP_ARRAY.count;
     binlog_writer_array.writers = (SFBinlogWriterInfo **)fc_malloc(bytes);
     if (binlog_writer_array.writers == NULL) {
@@ -193,6 +217,7 @@ bool replica_binlog_set_data_version(FSClusterDataServerInfo *myself,
                     old_version, new_version))
         {
             sf_binlog_writer_change_next_version(writer, new_version + 1);
+            slave_read_waiter_notify();
             return true;
         }
     }
@@ -375,6 +400,26 @@ static inline int unpack_block_record(string_t *cols, const int count,
     return 0;
 }
 
+static inline int unpack_clone_record(string_t *cols, const int count,
+        ReplicaBinlogRecord *record, char *error_info)
+{
+    char *endptr;
+
+    if (count != CLONE_EXPECT_FIELD_COUNT) {
+        sprintf(error_info, "field count: %d != %d",
+                count, CLONE_EXPECT_FIELD_COUNT);
+        return EINVAL;
+    }
+
+    BINLOG_PARSE_INT_SILENCE(record->bs_key.block.oid, "object ID",
+            BINLOG_COMMON_FIELD_INDEX_BLOCK_OID, ' ', 1);
+    BINLOG_PARSE_INT_SILENCE(record->bs_key.block.offset, "block offset",
+            BINLOG_COMMON_FIELD_INDEX_BLOCK_OFFSET, ' ', 0);
+    BINLOG_PARSE_INT_SILENCE(record->src_oid, "source object ID",
+            CLONE_FIELD_INDEX_SRC_OID, '\n', 1);
+    return 0;
+}
+
 int replica_binlog_record_unpack(const string_t *line,
         ReplicaBinlogRecord *record, char *error_info)
 {
@@ -405,6 +450,9 @@ int replica_binlog_record_unpack(const string_t *line,
         case REPLICA_BINLOG_OP_TYPE_NO_OP:
             result = unpack_block_record(cols, count, record, error_info);
             break;
+        case REPLICA_BINLOG_OP_TYPE_CLONE_BLOCK:
+            result = unpack_clone_record(cols, count, record, error_info);
+            break;
         default:
             sprintf(error_info, "invalid op_type: %c (0x%02x)",
                     record->op_type, (unsigned char)record->op_type);
@@ -469,6 +517,30 @@ int replica_binlog_log_block(const time_t current_time,
     return 0;
 }
 
+int replica_binlog_log_clone_block(const time_t current_time,
+        const int data_group_id, const int64_t data_version,
+        const FSBlockKey *bkey, const FSBlockKey *src_bkey,
+        const int source)
+{
+    SFBinlogWriterInfo *writer;
+    SFBinlogWriterBuffer *wbuffer;
+
+    if ((wbuffer=alloc_binlog_buffer(data_group_id,
+                    data_version, &writer)) == NULL)
+    {
+        return ENOMEM;
+    }
+
+    wbuffer->tag = source;
+    wbuffer->bf.length = sprintf(wbuffer->bf.buff,
+            "%"PRId64" %"PRId64" %c %c %"PRId64" %"PRId64" %"PRId64"\n",
+            (int64_t)current_time, data_version, source,
+            REPLICA_BINLOG_OP_TYPE_CLONE_BLOCK, bkey->oid,
+            bkey->offset, src_bkey->oid);
+    sf_push_to_binlog_thread_queue(writer->thread, wbuffer);
+    return 0;
+}
+
 static int find_position_by_buffer(ServerBinlogReader *reader,
         const uint64_t last_data_version, SFBinlogFilePosition *pos)
 {
@@ -532,10 +604,25 @@ static int find_position_by_reader(ServerBinlogReader *reader,
     return result;
 }
 
+static inline ReplicaBinlogIndexContext *get_index_ctx(
+        SFBinlogWriterInfo *writer)
+{
+    if (writer >= binlog_writer_array.holders && writer <
+            binlog_writer_array.holders + binlog_writer_array.holder_count)
+    {
+        return binlog_writer_array.index_ctxs +
+            (writer - binlog_writer_array.holders);
+    } else {
+        return NULL;  //such as the replay binlog of data recovery
+    }
+}
+
 static int find_position(const char *subdir_name, SFBinlogWriterInfo *writer,
         const uint64_t last_data_version, SFBinlogFilePosition *pos,
         const bool ignore_dv_overflow)
 {
+    ReplicaBinlogIndexContext *index_ctx;
+    int64_t offset;
     int result;
     int record_len;
     uint64_t data_version;
@@ -580,7 +667,21 @@ static int find_position(const char *subdir_name, SFBinlogWriterInfo *writer,
         return EOVERFLOW;
     }
 
+    /* skip to the nearest indexed record to avoid scanning from the start */
     pos->offset = 0;
+    if ((index_ctx=get_index_ctx(writer)) != NULL) {
+        if ((result=replica_binlog_index_find_offset(index_ctx, filename,
+                        pos->index, last_data_version, &offset)) == 0)
+        {
+            pos->offset = offset;
+        } else {
+            logWarning("file: "__FILE__", line: %d, "
+                    "find position by the index of binlog file %s fail, "
+                    "errno: %d, error info: %s, scan from the start",
+                    __LINE__, filename, result, STRERROR(result));
+        }
+    }
+
     if ((result=binlog_reader_init(&reader, subdir_name,
                     writer, pos)) != 0)
     {
@@ -598,11 +699,22 @@ int replica_binlog_get_position_by_dv(const char *subdir_name,
 {
     int result;
     int binlog_index;
+    int start_index;
     char filename[PATH_MAX];
     uint64_t first_data_version;
 
+    start_index = binlog_get_start_index(subdir_name);
+    if (last_data_version == 0 && start_index > 0) {
+        /* the new or rebuilt slave does the full recovery from the
+         * snapshot binlog of the live slices replaced the purged files */
+        pos->index = start_index;
+        pos->offset = 0;
+        return 0;
+    }
+
+    first_data_version = 0;
     binlog_index = sf_binlog_get_current_write_index(writer);
-    while (binlog_index >= 0) {
+    while (binlog_index >= start_index) {
         sf_binlog_writer_get_filename(DATA_PATH_STR, subdir_name,
                 binlog_index, filename, sizeof(filename));
         if ((result=replica_binlog_get_first_data_version(
@@ -626,7 +738,17 @@ int replica_binlog_get_position_by_dv(const char *subdir_name,
         --binlog_index;
     }
 
-    pos->index = 0;
+    /* the binlog files before the start index are purged */
+    if (start_index > 0 && last_data_version + 1 < first_data_version) {
+        logError("file: "__FILE__", line: %d, subdir_name: %s, "
+                "the binlog of data version %"PRId64" is purged, "
+                "the first data version: %"PRId64", the slave MUST "
+                "clear its data for the full recovery", __LINE__,
+                subdir_name, last_data_version + 1, first_data_version);
+        return ENOENT;
+    }
+
+    pos->index = start_index;
     pos->offset = 0;
     return 0;
 }
@@ -641,7 +763,7 @@ int replica_binlog_reader_init(struct server_binlog_reader *reader,
 
     replica_binlog_get_subdir_name(subdir_name, data_group_id);
     writer = replica_binlog_get_writer(data_group_id);
-    if (last_data_version == 0) {
+    if (last_data_version == 0 && binlog_get_start_index(subdir_name) == 0) {
         return binlog_reader_init(reader, subdir_name, writer, NULL);
     }
 
@@ -665,6 +787,8 @@ const char *replica_binlog_get_op_type_caption(const int op_type)
             return "delete slice";
         case REPLICA_BINLOG_OP_TYPE_DEL_BLOCK:
             return "delete block";
+        case REPLICA_BINLOG_OP_TYPE_CLONE_BLOCK:
+            return "clone block";
         case REPLICA_BINLOG_OP_TYPE_NO_OP:
             return "no op";
         default:
@@ -752,6 +876,10 @@ static int compare_record(ReplicaBinlogRecord *r1, ReplicaBinlogRecord *r2)
         return 0;
     }
 
+    if (r1->op_type == REPLICA_BINLOG_OP_TYPE_CLONE_BLOCK) {
+        return fc_compare_int64(r1->src_oid, r2->src_oid);
+    }
+
     if ((sub=(int)r1->bs_key.slice.offset -
                 (int)r2->bs_key.slice.offset) != 0)
     {
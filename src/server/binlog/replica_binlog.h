@@ -26,6 +26,7 @@
 #define REPLICA_BINLOG_OP_TYPE_ALLOC_SLICE  BINLOG_OP_TYPE_ALLOC_SLICE
 #define REPLICA_BINLOG_OP_TYPE_DEL_SLICE    BINLOG_OP_TYPE_DEL_SLICE
 #define REPLICA_BINLOG_OP_TYPE_DEL_BLOCK    BINLOG_OP_TYPE_DEL_BLOCK
+#define REPLICA_BINLOG_OP_TYPE_CLONE_BLOCK  BINLOG_OP_TYPE_CLONE_BLOCK
 #define REPLICA_BINLOG_OP_TYPE_NO_OP        BINLOG_OP_TYPE_NO_OP
 
 struct server_binlog_reader;
@@ -34,6 +35,7 @@ typedef struct replica_binlog_record {
     short op_type;
     short source;
     FSBlockSliceKeyInfo bs_key;
+    int64_t src_oid;  //the source object ID for clone block
     int64_t data_version;
 } ReplicaBinlogRecord;
 
@@ -146,6 +148,11 @@ extern "C" {
                 REPLICA_BINLOG_OP_TYPE_DEL_BLOCK);
     }
 
+    int replica_binlog_log_clone_block(const time_t current_time,
+            const int data_group_id, const int64_t data_version,
+            const FSBlockKey *bkey, const FSBlockKey *src_bkey,
+            const int source);
+
     static inline int replica_binlog_log_no_op(const int data_group_id,
             const int64_t data_version, const FSBlockKey *bkey)
     {
@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "replica_binlog.h"
+#include "replica_binlog_index.h"
+
+#define INDEX_READ_BUFFER_SIZE  (64 * 1024)
+
+int replica_binlog_index_init_ctx(ReplicaBinlogIndexContext *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->binlog_index = -1;
+    if ((ctx->buff=(char *)fc_malloc(INDEX_READ_BUFFER_SIZE)) == NULL) {
+        return ENOMEM;
+    }
+
+    return init_pthread_lock(&ctx->lock);
+}
+
+void replica_binlog_index_destroy_ctx(ReplicaBinlogIndexContext *ctx)
+{
+    if (ctx->array.entries != NULL) {
+        free(ctx->array.entries);
+        ctx->array.entries = NULL;
+    }
+    if (ctx->buff != NULL) {
+        free(ctx->buff);
+        ctx->buff = NULL;
+    }
+    pthread_mutex_destroy(&ctx->lock);
+}
+
+static inline void get_index_filename(const char *binlog_filename,
+        char *index_filename, const int size)
+{
+    snprintf(index_filename, size, "%s"REPLICA_BINLOG_INDEX_FILE_SUFFIX,
+            binlog_filename);
+}
+
+static inline void reset_index_ctx(ReplicaBinlogIndexContext *ctx,
+        const int binlog_index)
+{
+    ctx->binlog_index = binlog_index;
+    ctx->persisted = 0;
+    ctx->next_offset = 0;
+    ctx->record_count = 0;
+    ctx->array.count = 0;
+}
+
+static int check_alloc_index_array(ReplicaBinlogIndexArray *array)
+{
+    ReplicaBinlogIndexEntry *entries;
+    int alloc;
+
+    if (array->count < array->alloc) {
+        return 0;
+    }
+
+    alloc = (array->alloc == 0) ? 256 : array->alloc * 2;
+    entries = (ReplicaBinlogIndexEntry *)fc_malloc(
+            sizeof(ReplicaBinlogIndexEntry) * alloc);
+    if (entries == NULL) {
+        return ENOMEM;
+    }
+
+    if (array->entries != NULL) {
+        memcpy(entries, array->entries, sizeof(
+                    ReplicaBinlogIndexEntry) * array->count);
+        free(array->entries);
+    }
+    array->alloc = alloc;
+    array->entries = entries;
+    return 0;
+}
+
+static int add_index_entry(ReplicaBinlogIndexContext *ctx,
+        const uint64_t data_version, const int64_t offset)
+{
+    int result;
+
+    if ((result=check_alloc_index_array(&ctx->array)) != 0) {
+        return result;
+    }
+
+    ctx->array.entries[ctx->array.count].data_version = data_version;
+    ctx->array.entries[ctx->array.count].offset = offset;
+    ctx->array.count++;
+    return 0;
+}
+
+static int parse_index_content(ReplicaBinlogIndexContext *ctx,
+        const char *content, const uint64_t first_dv)
+{
+    const char *p;
+    const char *line_end;
+    char *endptr;
+    uint64_t data_version;
+    int64_t offset;
+    int result;
+
+    /* the header line: first_data_version interval */
+    if ((line_end=strchr(content, '\n')) == NULL) {
+        return EINVAL;
+    }
+    data_version = strtoull(content, &endptr, 10);
+    if (data_version != first_dv || *endptr != ' ' || strtol(endptr + 1,
+                &endptr, 10) != REPLICA_BINLOG_INDEX_INTERVAL ||
+            endptr != line_end)
+    {
+        return EINVAL;
+    }
+
+    p = line_end + 1;
+    while (*p != '\0') {
+        if ((line_end=strchr(p, '\n')) == NULL) {
+            return EINVAL;  //the last line is incomplete
+        }
+
+        data_version = strtoull(p, &endptr, 10);
+        if (*endptr != ' ') {
+            return EINVAL;
+        }
+        offset = strtoll(endptr + 1, &endptr, 10);
+        if (endptr != line_end || (ctx->array.count > 0 && (offset <=
+                        ctx->array.entries[ctx->array.count - 1].offset ||
+                        data_version <= ctx->array.entries[ctx->array.
+                        count - 1].data_version)))
+        {
+            return EINVAL;
+        }
+
+        if ((result=add_index_entry(ctx, data_version, offset)) != 0) {
+            return result;
+        }
+        p = line_end + 1;
+    }
+
+    return 0;
+}
+
+static int load_index_file(ReplicaBinlogIndexContext *ctx,
+        const char *index_filename, const uint64_t first_dv)
+{
+    char *content;
+    int64_t file_size;
+    int result;
+
+    if (access(index_filename, F_OK) != 0) {
+        return errno != 0 ? errno : ENOENT;
+    }
+
+    if ((result=getFileContent(index_filename, &content, &file_size)) != 0) {
+        return result;
+    }
+
+    result = parse_index_content(ctx, content, first_dv);
+    free(content);
+    if (result != 0) {
+        return result;
+    }
+
+    ctx->persisted = ctx->array.count;
+    if (ctx->array.count > 0) {
+        /* rescan from the last entry which will not be added again */
+        ctx->next_offset = ctx->array.entries[ctx->array.count - 1].offset;
+    }
+    return 0;
+}
+
+static int create_index_file(const char *index_filename,
+        const uint64_t first_dv)
+{
+    char buff[64];
+    int len;
+
+    len = sprintf(buff, "%"PRIu64" %d\n", first_dv,
+            REPLICA_BINLOG_INDEX_INTERVAL);
+    return safeWriteToFile(index_filename, buff, len);
+}
+
+static int rebuild_index(ReplicaBinlogIndexContext *ctx,
+        const char *index_filename, const int binlog_index,
+        const uint64_t first_dv)
+{
+    reset_index_ctx(ctx, binlog_index);
+    return create_index_file(index_filename, first_dv);
+}
+
+static int open_index(ReplicaBinlogIndexContext *ctx,
+        const char *binlog_filename, const char *index_filename,
+        const int binlog_index)
+{
+    uint64_t first_dv;
+    int result;
+
+    ctx->binlog_index = -1;
+    if ((result=replica_binlog_get_first_data_version(
+                    binlog_filename, &first_dv)) != 0)
+    {
+        return result;
+    }
+
+    reset_index_ctx(ctx, binlog_index);
+    if ((result=load_index_file(ctx, index_filename, first_dv)) == 0) {
+        return 0;
+    }
+
+    if (result != ENOENT) {
+        logWarning("file: "__FILE__", line: %d, "
+                "index file %s is invalid, rebuild it",
+                __LINE__, index_filename);
+    }
+    return rebuild_index(ctx, index_filename, binlog_index, first_dv);
+}
+
+static int index_records(ReplicaBinlogIndexContext *ctx,
+        const char *binlog_filename, const int64_t buff_offset,
+        const char *buff, const char *end, const char **last)
+{
+    const char *p;
+    const char *line_end;
+    char error_info[256];
+    string_t line;
+    ReplicaBinlogRecord record;
+    int64_t offset;
+    int result;
+
+    p = buff;
+    while ((line_end=(const char *)memchr(p, '\n', end - p)) != NULL) {
+        ++line_end;   //skip \n
+        offset = buff_offset + (p - buff);
+        if (ctx->record_count == 0 && (ctx->array.count == 0 ||
+                    offset > ctx->array.entries[ctx->array.
+                    count - 1].offset))
+        {
+            line.str = (char *)p;
+            line.len = line_end - p;
+            if ((result=replica_binlog_record_unpack(&line,
+                            &record, error_info)) != 0)
+            {
+                logError("file: "__FILE__", line: %d, "
+                        "binlog file %s, offset: %"PRId64", %s",
+                        __LINE__, binlog_filename, offset, error_info);
+                return result;
+            }
+
+            if ((result=add_index_entry(ctx, record.data_version,
+                            offset)) != 0)
+            {
+                return result;
+            }
+        }
+
+        if (++ctx->record_count == REPLICA_BINLOG_INDEX_INTERVAL) {
+            ctx->record_count = 0;
+        }
+        p = line_end;
+    }
+
+    *last = p;
+    return 0;
+}
+
+/* index the records appended since the last call,
+ * the incomplete last line is left for the next call */
+static int extend_index(ReplicaBinlogIndexContext *ctx,
+        const char *binlog_filename, int fd)
+{
+    const char *last;
+    int64_t offset;
+    int len;
+    int bytes;
+    int result;
+
+    offset = ctx->next_offset;
+    len = 0;
+    while ((bytes=pread(fd, ctx->buff + len, INDEX_READ_BUFFER_SIZE -
+                    len, offset + len)) > 0)
+    {
+        len += bytes;
+        if ((result=index_records(ctx, binlog_filename, offset,
+                        ctx->buff, ctx->buff + len, &last)) != 0)
+        {
+            return result;
+        }
+
+        bytes = last - ctx->buff;
+        offset += bytes;
+        len -= bytes;
+        if (len > 0) {
+            memmove(ctx->buff, last, len);
+        }
+        ctx->next_offset = offset;
+    }
+
+    if (bytes < 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "read binlog file \"%s\" fail, offset: %"PRId64", "
+                "errno: %d, error info: %s", __LINE__,
+                binlog_filename, offset + len, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+static void persist_index(ReplicaBinlogIndexContext *ctx,
+        const char *index_filename)
+{
+    ReplicaBinlogIndexEntry *entry;
+    ReplicaBinlogIndexEntry *end;
+    int fd;
+    int len;
+    int result;
+
+    if (ctx->persisted >= ctx->array.count) {
+        return;
+    }
+
+    /* the index file is created (with the header) when open */
+    if ((fd=open(index_filename, O_WRONLY | O_APPEND)) < 0) {
+        return;
+    }
+
+    len = 0;
+    result = 0;
+    end = ctx->array.entries + ctx->array.count;
+    for (entry=ctx->array.entries + ctx->persisted; entry<end; entry++) {
+        len += sprintf(ctx->buff + len, "%"PRIu64" %"PRId64"\n",
+                entry->data_version, entry->offset);
+        if (len + 64 > INDEX_READ_BUFFER_SIZE || entry + 1 == end) {
+            if (fc_safe_write(fd, ctx->buff, len) != len) {
+                result = errno != 0 ? errno : EIO;
+                break;
+            }
+            len = 0;
+        }
+    }
+    close(fd);
+
+    if (result == 0) {
+        ctx->persisted = ctx->array.count;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "write to index file \"%s\" fail, errno: %d, "
+                "error info: %s", __LINE__, index_filename,
+                result, STRERROR(result));
+
+        /* the index file maybe broken, rebuild it when next open */
+        unlink(index_filename);
+        ctx->persisted = ctx->array.count;
+    }
+}
+
+/* return the last entry which data version <= the given data version */
+static ReplicaBinlogIndexEntry *search_index(ReplicaBinlogIndexArray
+        *array, const uint64_t data_version)
+{
+    int low;
+    int high;
+    int mid;
+
+    low = 0;
+    high = array->count - 1;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if (array->entries[mid].data_version <= data_version) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return (high >= 0) ? array->entries + high : NULL;
+}
+
+static bool check_index_entry(ReplicaBinlogIndexEntry *entry, int fd)
+{
+    char buff[FS_REPLICA_BINLOG_MAX_RECORD_SIZE];
+    char error_info[256];
+    string_t line;
+    ReplicaBinlogRecord record;
+    char *line_end;
+    int bytes;
+
+    if ((bytes=pread(fd, buff, sizeof(buff), entry->offset)) <= 0) {
+        return false;
+    }
+
+    if ((line_end=(char *)memchr(buff, '\n', bytes)) == NULL) {
+        return false;
+    }
+
+    line.str = buff;
+    line.len = (line_end + 1) - buff;
+    if (replica_binlog_record_unpack(&line, &record, error_info) != 0) {
+        return false;
+    }
+    return record.data_version == entry->data_version;
+}
+
+static int find_offset(ReplicaBinlogIndexContext *ctx,
+        const char *binlog_filename, const char *index_filename,
+        const int binlog_index, const uint64_t data_version,
+        int64_t *offset)
+{
+    ReplicaBinlogIndexEntry *entry;
+    struct stat stbuf;
+    int fd;
+    int result;
+
+    if ((fd=open(binlog_filename, O_RDONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, binlog_filename, result, STRERROR(result));
+        return result;
+    }
+
+    do {
+        if (fstat(fd, &stbuf) != 0) {
+            result = errno != 0 ? errno : EIO;
+            break;
+        }
+
+        if (stbuf.st_size < ctx->next_offset) {  //binlog replaced
+            ctx->binlog_index = -1;
+        }
+        if (ctx->binlog_index != binlog_index) {
+            if ((result=open_index(ctx, binlog_filename,
+                            index_filename, binlog_index)) != 0)
+            {
+                break;
+            }
+        }
+
+        if ((result=extend_index(ctx, binlog_filename, fd)) != 0) {
+            break;
+        }
+        persist_index(ctx, index_filename);
+
+        entry = search_index(&ctx->array, data_version);
+        if (entry == NULL) {
+            *offset = 0;
+        } else if (check_index_entry(entry, fd)) {
+            *offset = entry->offset;
+        } else {
+            result = EAGAIN;  //the index is stale
+        }
+    } while (0);
+
+    close(fd);
+    if (result != 0) {
+        ctx->binlog_index = -1;
+    }
+    return result;
+}
+
+int replica_binlog_index_find_offset(ReplicaBinlogIndexContext *ctx,
+        const char *binlog_filename, const int binlog_index,
+        const uint64_t data_version, int64_t *offset)
+{
+    char index_filename[PATH_MAX];
+    int result;
+
+    get_index_filename(binlog_filename, index_filename,
+            sizeof(index_filename));
+    PTHREAD_MUTEX_LOCK(&ctx->lock);
+    if ((result=find_offset(ctx, binlog_filename, index_filename,
+                    binlog_index, data_version, offset)) == EAGAIN)
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "index file %s is stale, rebuild it",
+                __LINE__, index_filename);
+        unlink(index_filename);
+        result = find_offset(ctx, binlog_filename, index_filename,
+                binlog_index, data_version, offset);
+        if (result == EAGAIN) {
+            unlink(index_filename);
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&ctx->lock);
+
+    return result;
+}
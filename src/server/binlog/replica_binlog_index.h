@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//replica_binlog_index.h
+
+#ifndef _REPLICA_BINLOG_INDEX_H_
+#define _REPLICA_BINLOG_INDEX_H_
+
+#include "fastcommon/common_define.h"
+
+#define REPLICA_BINLOG_INDEX_FILE_SUFFIX  ".idx"
+#define REPLICA_BINLOG_INDEX_INTERVAL     1024   //index every N records
+
+typedef struct replica_binlog_index_entry {
+    uint64_t data_version;
+    int64_t offset;   //the record offset in the binlog file
+} ReplicaBinlogIndexEntry;
+
+typedef struct replica_binlog_index_array {
+    int alloc;
+    int count;
+    ReplicaBinlogIndexEntry *entries;
+} ReplicaBinlogIndexArray;
+
+/* the sparse index of one binlog file, the sidecar index file
+ * is the binlog filename with suffix .idx */
+typedef struct replica_binlog_index_context {
+    int binlog_index;  //the binlog file of the index, -1 for none
+    int persisted;     //the entries persisted to the index file
+    int64_t next_offset;  //the next record offset to index
+    int record_count;     //the records since the last entry
+    ReplicaBinlogIndexArray array;
+    char *buff;           //for read the binlog file
+    pthread_mutex_t lock;
+} ReplicaBinlogIndexContext;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int replica_binlog_index_init_ctx(ReplicaBinlogIndexContext *ctx);
+
+    void replica_binlog_index_destroy_ctx(ReplicaBinlogIndexContext *ctx);
+
+    /* find the offset to scan from for the first record which data version
+     * > the given data version, the index is extended from the last indexed
+     * record and rebuilt when missing or stale.
+     * return 0 for success, the offset is 0 when the data version is
+     * less than the first indexed record */
+    int replica_binlog_index_find_offset(ReplicaBinlogIndexContext *ctx,
+            const char *binlog_filename, const int binlog_index,
+            const uint64_t data_version, int64_t *offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
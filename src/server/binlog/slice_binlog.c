@@ -72,6 +72,39 @@ void slice_binlog_destroy()
     sf_binlog_writer_finish(&binlog_writer.writer);
 }
 
+int slice_binlog_pack_add_slice(const OBSliceEntry *slice,
+        const time_t current_time, const uint64_t data_version,
+        const int source, char *buff)
+{
+    int len;
+
+    len = sprintf(buff, "%"PRId64" %"PRId64" %c %c %"PRId64" %"PRId64" %d %d "
+            "%d %"PRId64" %"PRId64" %"PRId64" %"PRId64,
+            (int64_t)current_time, data_version, source,
+            slice->type == OB_SLICE_TYPE_FILE ?
+            SLICE_BINLOG_OP_TYPE_WRITE_SLICE :
+            SLICE_BINLOG_OP_TYPE_ALLOC_SLICE,
+            slice->ob->bkey.oid, slice->ob->bkey.offset,
+            slice->ssize.offset, slice->ssize.length,
+            slice->space.store->index, slice->space.id_info.id,
+            slice->space.id_info.subdir, slice->space.offset,
+            slice->space.size);
+    if (slice->compress.type != FS_COMPRESS_TYPE_NONE) {
+        /* the checksum of the split compressed slice is unknown (-1),
+         * the compress offset locates the slice in the uncompressed data */
+        len += sprintf(buff + len, " %"PRId64" %c %d %d\n",
+                slice->checksum.valid ? (int64_t)slice->checksum.crc32c : -1,
+                slice->compress.type, slice->compress.length,
+                slice->compress.offset);
+    } else if (slice->checksum.valid) {
+        len += sprintf(buff + len, " %u\n", slice->checksum.crc32c);
+    } else {
+        *(buff + len++) = '\n';
+    }
+
+    return len;
+}
+
 int slice_binlog_log_add_slice(const OBSliceEntry *slice,
         const time_t current_time, const uint64_t sn,
         const uint64_t data_version, const int source)
@@ -84,18 +117,8 @@ int slice_binlog_log_add_slice(const OBSliceEntry *slice,
 
     wbuffer->tag = data_version;
     SF_BINLOG_BUFFER_SET_VERSION(wbuffer, sn);
-    wbuffer->bf.length = sprintf(wbuffer->bf.buff,
-            "%"PRId64" %"PRId64" %c %c %"PRId64" %"PRId64" %d %d "
-            "%d %"PRId64" %"PRId64" %"PRId64" %"PRId64"\n",
-            (int64_t)current_time, data_version, source,
-            slice->type == OB_SLICE_TYPE_FILE ?
-            SLICE_BINLOG_OP_TYPE_WRITE_SLICE :
-            SLICE_BINLOG_OP_TYPE_ALLOC_SLICE,
-            slice->ob->bkey.oid, slice->ob->bkey.offset,
-            slice->ssize.offset, slice->ssize.length,
-            slice->space.store->index, slice->space.id_info.id,
-            slice->space.id_info.subdir, slice->space.offset,
-            slice->space.size);
+    wbuffer->bf.length = slice_binlog_pack_add_slice(slice,
+            current_time, data_version, source, wbuffer->bf.buff);
     sf_push_to_binlog_write_queue(&binlog_writer.writer, wbuffer);
     return 0;
 }
@@ -150,3 +173,46 @@ void slice_binlog_writer_stat(FSBinlogWriterStat *stat)
     stat->waiting_count = binlog_writer.writer.version_ctx.ring.waiting_count;
     stat->max_waitings = binlog_writer.writer.version_ctx.ring.max_waitings;
 }
+
+int slice_binlog_checkpoint(const time_t current_time,
+        int *checkpoint_index)
+{
+    char filename[PATH_MAX];
+    char tmp_filename[PATH_MAX];
+    int64_t slice_count;
+    int64_t start_time;
+    char time_buff[32];
+    int result;
+
+    start_time = get_current_time_ms();
+    *checkpoint_index = slice_binlog_get_current_write_index() + 1;
+    sf_binlog_writer_get_filename(DATA_PATH_STR, FS_SLICE_BINLOG_SUBDIR_NAME,
+            *checkpoint_index, filename, sizeof(filename));
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    if ((result=ob_index_dump_slices_to_file(tmp_filename,
+                    current_time, &slice_count)) != 0)
+    {
+        unlink(tmp_filename);
+        return result;
+    }
+
+    if (rename(tmp_filename, filename) != 0) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "rename file %s to %s fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, filename, result, STRERROR(result));
+        return result;
+    }
+
+    if ((result=sf_binlog_writer_set_binlog_index(&binlog_writer.writer,
+                    *checkpoint_index)) != 0)
+    {
+        return result;
+    }
+
+    long_to_comma_str(get_current_time_ms() - start_time, time_buff);
+    logInfo("file: "__FILE__", line: %d, "
+            "dump %"PRId64" slices to the checkpoint binlog %s, "
+            "time used: %s ms", __LINE__, slice_count, filename, time_buff);
+    return 0;
+}
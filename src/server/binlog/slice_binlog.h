@@ -37,6 +37,11 @@ extern "C" {
 
     struct sf_binlog_writer_info *slice_binlog_get_writer();
 
+    /* pack the add slice record, return the record length */
+    int slice_binlog_pack_add_slice(const OBSliceEntry *slice,
+            const time_t current_time, const uint64_t data_version,
+            const int source, char *buff);
+
     int slice_binlog_log_add_slice(const OBSliceEntry *slice,
             const time_t current_time, const uint64_t sn,
             const uint64_t data_version, const int source);
@@ -51,6 +56,11 @@ extern "C" {
 
     void slice_binlog_writer_stat(FSBinlogWriterStat *stat);
 
+    /* dump the slice index as the checkpoint to the next binlog file and
+     * switch the writer to it, MUST be called before any update */
+    int slice_binlog_checkpoint(const time_t current_time,
+            int *checkpoint_index);
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,6 +26,7 @@
 #include "../shared_thread_pool.h"
 #include "../storage/storage_allocator.h"
 #include "../storage/trunk_id_info.h"
+#include "binlog_func.h"
 #include "binlog_loader.h"
 #include "slice_binlog.h"
 #include "slice_loader.h"
@@ -35,12 +36,18 @@
 #define ADD_SLICE_FIELD_INDEX_SPACE_SUBDIR    10
 #define ADD_SLICE_FIELD_INDEX_SPACE_OFFSET    11
 #define ADD_SLICE_FIELD_INDEX_SPACE_SIZE      12
+#define ADD_SLICE_FIELD_INDEX_CHECKSUM        13
+#define ADD_SLICE_FIELD_INDEX_COMPRESS_TYPE   14
+#define ADD_SLICE_FIELD_INDEX_COMPRESS_LENGTH 15
+#define ADD_SLICE_FIELD_INDEX_COMPRESS_OFFSET 16
 #define ADD_SLICE_EXPECT_FIELD_COUNT          13
+#define ADD_SLICE_CHECKSUM_FIELD_COUNT        14  //with checksum
+#define ADD_SLICE_MAX_FIELD_COUNT             17  //with compression
 
 #define DEL_SLICE_EXPECT_FIELD_COUNT           8
 #define DEL_BLOCK_EXPECT_FIELD_COUNT           6
 
-#define MAX_BINLOG_FIELD_COUNT  16
+#define MAX_BINLOG_FIELD_COUNT  17
 #define MIN_EXPECT_FIELD_COUNT  DEL_BLOCK_EXPECT_FIELD_COUNT
 
 #define MBLOCK_BATCH_ALLOC_SIZE  1024
@@ -52,6 +59,15 @@ typedef struct slice_binlog_record {
     OBSliceType slice_type;   //add slice only
     FSBlockSliceKeyInfo bs_key;
     FSTrunkSpaceInfo space;   //add slice only
+    struct {
+        bool valid;
+        uint32_t crc32c;
+    } checksum;               //add slice only
+    struct {
+        char type;
+        int length;
+        int offset;
+    } compress;               //add slice only
     struct fast_mblock_man *allocator;
     struct slice_binlog_record *next;  //for queue
 } SliceBinlogRecord;
@@ -131,6 +147,10 @@ typedef struct slice_loader_context {
     BINLOG_PARSE_INT_EX(FS_SLICE_BINLOG_SUBDIR_NAME, var, #var, \
             index, endchr, min_val)
 
+/* the slices deleted by the binlog records before the checkpoint
+ * maybe not exist when the binlog compacted */
+static bool binlog_compacted = false;
+
 static inline int add_slice_set_fields(SliceBinlogRecord *record,
         BinlogReadThreadResult *r, string_t *line, string_t *cols,
         const int count)
@@ -139,15 +159,21 @@ static inline int add_slice_set_fields(SliceBinlogRecord *record,
     char binlog_filename[PATH_MAX];
     char *endptr;
     int path_index;
+    int64_t crc32c;
 
-    if (count != ADD_SLICE_EXPECT_FIELD_COUNT) {
+    if (!(count == ADD_SLICE_EXPECT_FIELD_COUNT ||
+                count == ADD_SLICE_CHECKSUM_FIELD_COUNT ||
+                count == ADD_SLICE_MAX_FIELD_COUNT))
+    {
         SLICE_GET_FILENAME_LINE_COUNT(r, binlog_filename,
                 line->str, line_count);
         logError("file: "__FILE__", line: %d, "
                 "binlog file %s, line no: %"PRId64", "
-                "field count: %d != %d", __LINE__,
-                binlog_filename, line_count,
-                count, ADD_SLICE_EXPECT_FIELD_COUNT);
+                "field count: %d != %d, %d or %d", __LINE__,
+                binlog_filename, line_count, count,
+                ADD_SLICE_EXPECT_FIELD_COUNT,
+                ADD_SLICE_CHECKSUM_FIELD_COUNT,
+                ADD_SLICE_MAX_FIELD_COUNT);
         return EINVAL;
     }
 
@@ -184,8 +210,53 @@ static inline int add_slice_set_fields(SliceBinlogRecord *record,
             ADD_SLICE_FIELD_INDEX_SPACE_SUBDIR, ' ', 1);
     SLICE_PARSE_INT(record->space.offset,
             ADD_SLICE_FIELD_INDEX_SPACE_OFFSET, ' ', 0);
+    record->compress.type = FS_COMPRESS_TYPE_NONE;
+    record->compress.offset = 0;
+    if (count == ADD_SLICE_EXPECT_FIELD_COUNT) {
+        SLICE_PARSE_INT(record->space.size,
+                ADD_SLICE_FIELD_INDEX_SPACE_SIZE, '\n', 0);
+        record->checksum.valid = false;
+        return 0;
+    }
+
     SLICE_PARSE_INT(record->space.size,
-            ADD_SLICE_FIELD_INDEX_SPACE_SIZE, '\n', 0);
+            ADD_SLICE_FIELD_INDEX_SPACE_SIZE, ' ', 0);
+    if (count == ADD_SLICE_CHECKSUM_FIELD_COUNT) {
+        SLICE_PARSE_INT_EX(crc32c, "checksum",
+                ADD_SLICE_FIELD_INDEX_CHECKSUM, '\n', 0);
+    } else {
+        //-1 for the unknown checksum of the split compressed slice
+        SLICE_PARSE_INT_EX(crc32c, "checksum",
+                ADD_SLICE_FIELD_INDEX_CHECKSUM, ' ', -1);
+
+        record->compress.type = cols[ADD_SLICE_FIELD_INDEX_COMPRESS_TYPE].
+            str[0];
+        if (!(cols[ADD_SLICE_FIELD_INDEX_COMPRESS_TYPE].len == 1 &&
+                    (record->compress.type == FS_COMPRESS_TYPE_LZ4 ||
+                     record->compress.type == FS_COMPRESS_TYPE_ZSTD)))
+        {
+            SLICE_GET_FILENAME_LINE_COUNT(r, binlog_filename,
+                    line->str, line_count);
+            logError("file: "__FILE__", line: %d, "
+                    "binlog file %s, line no: %"PRId64", "
+                    "invalid compress type: %.*s", __LINE__,
+                    binlog_filename, line_count,
+                    cols[ADD_SLICE_FIELD_INDEX_COMPRESS_TYPE].len,
+                    cols[ADD_SLICE_FIELD_INDEX_COMPRESS_TYPE].str);
+            return EINVAL;
+        }
+        SLICE_PARSE_INT_EX(record->compress.length, "compress length",
+                ADD_SLICE_FIELD_INDEX_COMPRESS_LENGTH, ' ', 1);
+        SLICE_PARSE_INT_EX(record->compress.offset, "compress offset",
+                ADD_SLICE_FIELD_INDEX_COMPRESS_OFFSET, '\n', 0);
+    }
+
+    if (crc32c < 0) {
+        record->checksum.valid = false;
+    } else {
+        record->checksum.crc32c = crc32c;
+        record->checksum.valid = true;
+    }
     return 0;
 }
 
@@ -424,6 +495,7 @@ static int slice_parse_buffer(BinlogLoaderContext *ctx)
 static inline int slice_loader_deal_record(SliceBinlogRecord *record)
 {
     OBSliceEntry *slice;
+    int result;
 
     switch (record->op_type) {
         case SLICE_BINLOG_OP_TYPE_WRITE_SLICE:
@@ -435,14 +507,64 @@ static inline int slice_loader_deal_record(SliceBinlogRecord *record)
             slice->type = record->slice_type;
             slice->ssize = record->bs_key.slice;
             slice->space = record->space;
+            slice->checksum.valid = record->checksum.valid;
+            slice->checksum.crc32c = record->checksum.crc32c;
+            slice->compress.type = record->compress.type;
+            slice->compress.length = record->compress.length;
+            slice->compress.offset = record->compress.offset;
             return ob_index_add_slice_by_binlog(slice);
         case SLICE_BINLOG_OP_TYPE_DEL_SLICE:
-            return ob_index_delete_slices_by_binlog(&record->bs_key);
+            result = ob_index_delete_slices_by_binlog(&record->bs_key);
+            break;
         case SLICE_BINLOG_OP_TYPE_DEL_BLOCK:
-            return ob_index_delete_block_by_binlog(&record->bs_key.block);
+            result = ob_index_delete_block_by_binlog(&record->bs_key.block);
+            break;
         default:
             return 0;
     }
+
+    return (result == ENOENT && binlog_compacted) ? 0 : result;
+}
+
+int slice_loader_parse_buffer_ex(BinlogReadThreadResult *r,
+        int64_t *record_count, const bool load_to_index)
+{
+    SliceParseThreadContext thread_ctx;
+    SliceBinlogRecord record;
+    string_t line;
+    char *line_start;
+    char *buff_end;
+    char *line_end;
+    int result;
+
+    memset(&thread_ctx, 0, sizeof(thread_ctx));
+    thread_ctx.r = r;
+    result = 0;
+    line_start = r->buffer.buff;
+    buff_end = r->buffer.buff + r->buffer.length;
+    while (line_start < buff_end) {
+        line_end = (char *)memchr(line_start, '\n', buff_end - line_start);
+        if (line_end == NULL) {
+            break;
+        }
+
+        line.str = line_start;
+        line.len = line_end - line_start;
+        thread_ctx.slices.head = thread_ctx.slices.tail = NULL;
+        if ((result=slice_parse_line(&thread_ctx, r, &line, &record)) != 0) {
+            break;
+        }
+        if (load_to_index && (result=slice_loader_deal_record(
+                        &record)) != 0)
+        {
+            break;
+        }
+
+        line_start = line_end + 1;
+    }
+
+    *record_count = thread_ctx.total_count;
+    return result;
 }
 
 static inline void deal_records(SliceDataThreadContext *thread_ctx,
@@ -990,6 +1112,8 @@ int slice_loader_load(struct sf_binlog_writer_info *slice_writer)
     SliceLoaderContext ctx;
     BinlogLoaderCallbacks callbacks;
 
+    binlog_compacted = (binlog_get_start_index(
+                FS_SLICE_BINLOG_SUBDIR_NAME) > 0);
     ctx.parse_continue_flag = true;
     ctx.data_continue_flag = true;
     ctx.dealing_threads = 0;
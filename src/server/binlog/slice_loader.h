@@ -18,6 +18,7 @@
 #define _SLICE_LOADER_H
 
 #include "sf/sf_binlog_writer.h"
+#include "binlog_read_thread.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,6 +26,15 @@ extern "C" {
 
     int slice_loader_load(struct sf_binlog_writer_info *slice_writer);
 
+    /* parse the slice binlog records in the buffer, and load them to the
+     * object block index when load_to_index is true, such as for the
+     * benchmark and the test */
+    int slice_loader_parse_buffer_ex(BinlogReadThreadResult *r,
+            int64_t *record_count, const bool load_to_index);
+
+#define slice_loader_parse_buffer(r, record_count) \
+    slice_loader_parse_buffer_ex(r, record_count, false)
+
 #ifdef __cplusplus
 }
 #endif
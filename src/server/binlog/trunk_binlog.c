@@ -25,6 +25,7 @@
 #include "../dio/trunk_write_thread.h"
 #include "../storage/storage_allocator.h"
 #include "../storage/trunk_id_info.h"
+#include "../storage/raw_device.h"
 #include "binlog_loader.h"
 #include "trunk_binlog.h"
 
@@ -65,6 +66,7 @@ static int trunk_parse_line(BinlogReadThreadResult *r, string_t *line)
     int path_index;
     FSTrunkIdInfo id_info;
     int64_t trunk_size;
+    FSRawDevice *device;
 
     count = split_string_ex(line, ' ', cols,
             MAX_FIELD_COUNT, false);
@@ -113,6 +115,14 @@ static int trunk_parse_line(BinlogReadThreadResult *r, string_t *line)
             snprintf(error_info, sizeof(error_info),
                     "add trunk fail, errno: %d, error info: %s",
                     result, STRERROR(result));
+        } else if ((device=FS_RAW_DEVICE_BY_PATH_INDEX(path_index)) != NULL) {
+            if ((result=raw_device_mark_extent(device,
+                            FS_RAW_DEVICE_EXTENT_INDEX(&id_info),
+                            true)) != 0)
+            {
+                sprintf(error_info, "invalid extent index: %"PRId64,
+                        FS_RAW_DEVICE_EXTENT_INDEX(&id_info));
+            }
         }
     } else if (op_type == FS_IO_TYPE_DELETE_TRUNK) {
         if ((result=storage_allocator_delete_trunk(path_index,
@@ -121,6 +131,14 @@ static int trunk_parse_line(BinlogReadThreadResult *r, string_t *line)
             snprintf(error_info, sizeof(error_info),
                     "delete trunk fail, errno: %d, error info: %s",
                     result, STRERROR(result));
+        } else if ((device=FS_RAW_DEVICE_BY_PATH_INDEX(path_index)) != NULL) {
+            if ((result=raw_device_mark_extent(device,
+                            FS_RAW_DEVICE_EXTENT_INDEX(&id_info),
+                            false)) != 0)
+            {
+                sprintf(error_info, "invalid extent index: %"PRId64,
+                        FS_RAW_DEVICE_EXTENT_INDEX(&id_info));
+            }
         }
     } else {
         sprintf(error_info, "invalid op_type: %c (0x%02x)",
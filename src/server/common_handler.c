@@ -31,6 +31,7 @@
 #include "fastcommon/shared_func.h"
 #include "fastcommon/pthread_func.h"
 #include "fastcommon/sched_thread.h"
+#include "fastcommon/local_ip_func.h"
 #include "sf/sf_func.h"
 #include "sf/sf_nio.h"
 #include "sf/sf_global.h"
@@ -113,3 +114,9 @@ int handler_check_config_signs(struct fast_task_info *task,
 
     return 0;
 }
+
+bool handler_is_local_client(struct fast_task_info *task)
+{
+    return (strcmp(task->client_ip, "127.0.0.1") == 0 ||
+            is_local_host_ip(task->client_ip));
+}
@@ -34,6 +34,9 @@ void common_handler_init();
 int handler_check_config_signs(struct fast_task_info *task,
         const int server_id, FSProtoConfigSigns *config_signs);
 
+/* if the client runs on this host */
+bool handler_is_local_client(struct fast_task_info *task);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,9 @@
 #include "sf/sf_func.h"
 #include "server_global.h"
 #include "server_replication.h"
+#include "server_qos.h"
+#include "server_numa.h"
+#include "latency_stat.h"
 #include "data_thread.h"
 
 #define DATA_THREAD_ROLE_MASTER  'm'
@@ -60,7 +63,7 @@ static inline int init_thread_ctx(FSDataThreadContext *context)
     }
 
     if ((result=fc_queue_init(&context->queue, (long)
-                    (&((FSDataOperation *)NULL)->next))) != 0)
+                    (&((FSDataWorkUnit *)NULL)->next))) != 0)
     {
         return result;
     }
@@ -68,6 +71,47 @@ static inline int init_thread_ctx(FSDataThreadContext *context)
     return 0;
 }
 
+static int init_work_units(FSDataThreadArray *thread_array)
+{
+    int result;
+    int bytes;
+    int data_group_id;
+    FSDataWorkUnit *unit;
+    FSDataWorkUnit *end;
+
+    thread_array->unit_array.count = CLUSTER_DATA_RGOUP_ARRAY.count;
+    bytes = sizeof(FSDataWorkUnit) * thread_array->unit_array.count;
+    thread_array->unit_array.units = (FSDataWorkUnit *)fc_malloc(bytes);
+    if (thread_array->unit_array.units == NULL) {
+        return ENOMEM;
+    }
+    memset(thread_array->unit_array.units, 0, bytes);
+
+    /* the data group ids are continuous, so unit index is
+       data_group_id % unit count without conflict */
+    for (data_group_id=CLUSTER_DATA_RGOUP_ARRAY.base_id;
+            data_group_id<CLUSTER_DATA_RGOUP_ARRAY.base_id +
+            CLUSTER_DATA_RGOUP_ARRAY.count; data_group_id++)
+    {
+        unit = thread_array->unit_array.units + data_group_id %
+            thread_array->unit_array.count;
+        unit->data_group_id = data_group_id;
+        unit->home = thread_array->contexts +
+            data_group_id % thread_array->count;
+    }
+
+    end = thread_array->unit_array.units + thread_array->unit_array.count;
+    for (unit=thread_array->unit_array.units; unit<end; unit++) {
+        if ((result=fc_queue_init(&unit->queue, (long)
+                        (&((FSDataOperation *)NULL)->next))) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
 static int init_data_thread_array(FSDataThreadArray *thread_array,
         const int count, const int role)
 {
@@ -94,12 +138,19 @@ static int init_data_thread_array(FSDataThreadArray *thread_array,
             context->index = context - thread_array->contexts;
         }
         context->role = role;
+        context->numa_node = server_numa_data_thread_node(
+                context - thread_array->contexts, count);
+        context->thread_array = thread_array;
         if ((result=init_thread_ctx(context)) != 0) {
             return result;
         }
     }
     thread_array->count = count;
 
+    if ((result=init_work_units(thread_array)) != 0) {
+        return result;
+    }
+
     thread_count = thread_array->count;
     return create_work_threads_ex(&thread_count, data_thread_func,
             thread_array->contexts, sizeof(FSDataThreadContext), NULL,
@@ -152,6 +203,20 @@ static void destroy_data_thread_array(FSDataThreadArray *thread_array)
         thread_array->contexts = NULL;
         thread_array->count = 0;
     }
+
+    if (thread_array->unit_array.units != NULL) {
+        FSDataWorkUnit *unit;
+        FSDataWorkUnit *uend;
+
+        uend = thread_array->unit_array.units +
+            thread_array->unit_array.count;
+        for (unit=thread_array->unit_array.units; unit<uend; unit++) {
+            fc_queue_destroy(&unit->queue);
+        }
+        free(thread_array->unit_array.units);
+        thread_array->unit_array.units = NULL;
+        thread_array->unit_array.count = 0;
+    }
 }
 
 void data_thread_destroy()
@@ -185,6 +250,136 @@ void data_thread_terminate()
     terminate_data_thread_array(&g_data_thread_vars.thread_arrays.slave);
 }
 
+static void stat_data_thread_array(FSDataThreadArray *thread_array,
+        FSDataThreadStat *stat)
+{
+    FSDataThreadContext *context;
+    FSDataThreadContext *end;
+    int waiting_count;
+
+    memset(stat, 0, sizeof(*stat));
+    stat->thread_count = thread_array->count;
+    end = thread_array->contexts + thread_array->count;
+    for (context=thread_array->contexts; context<end; context++) {
+        if (FC_ATOMIC_GET(context->busy)) {
+            stat->busy_count++;
+        }
+        waiting_count = FC_ATOMIC_GET(context->stat.waiting_count);
+        if (waiting_count > stat->max_waiting_count) {
+            stat->max_waiting_count = waiting_count;
+        }
+        stat->waiting_count += waiting_count;
+        stat->done_count += FC_ATOMIC_GET(context->stat.done_count);
+        stat->stolen_count += FC_ATOMIC_GET(context->stat.stolen_count);
+        stat->donated_count += FC_ATOMIC_GET(context->stat.donated_count);
+    }
+}
+
+void data_thread_stat(FSDataThreadStat *master, FSDataThreadStat *slave)
+{
+    stat_data_thread_array(&g_data_thread_vars.thread_arrays.master, master);
+    stat_data_thread_array(&g_data_thread_vars.thread_arrays.slave, slave);
+}
+
+static FSDataThreadContext *get_parked_thread(FSDataThreadContext *home)
+{
+    FSDataThreadArray *thread_array;
+    FSDataThreadContext *context;
+    int i;
+
+    thread_array = home->thread_array;
+    context = home;
+    for (i=1; i<thread_array->count; i++) {
+        if (++context == thread_array->contexts + thread_array->count) {
+            context = thread_array->contexts;
+        }
+        if (context->numa_node == home->numa_node &&
+                FC_ATOMIC_GET(context->parked))
+        {
+            return context;
+        }
+    }
+
+    return NULL;
+}
+
+void data_thread_schedule_unit(FSDataWorkUnit *unit)
+{
+    FSDataThreadContext *context;
+
+    /* donate the work unit to an idle thread when the hashed
+       thread is blocked by other data groups */
+    if (DATA_THREAD_WORK_STEALING && FC_ATOMIC_GET(unit->home->busy) &&
+            (context=get_parked_thread(unit->home)) != NULL)
+    {
+        FC_ATOMIC_INC_EX(unit->home->stat.donated_count, 1);
+    } else {
+        context = unit->home;
+    }
+
+    fc_queue_push(&context->queue, unit);
+}
+
+static FSDataWorkUnit *steal_work_unit(FSDataThreadContext *thread_ctx)
+{
+    FSDataThreadArray *thread_array;
+    FSDataThreadContext *context;
+    FSDataThreadContext *end;
+    FSDataThreadContext *victim;
+    FSDataWorkUnit *unit;
+    int waiting_count;
+    int max_waiting_count;
+
+    thread_array = thread_ctx->thread_array;
+    victim = NULL;
+    max_waiting_count = 0;
+    end = thread_array->contexts + thread_array->count;
+    for (context=thread_array->contexts; context<end; context++) {
+        if (context == thread_ctx || context->numa_node !=
+                thread_ctx->numa_node || !FC_ATOMIC_GET(context->busy))
+        {
+            continue;
+        }
+
+        waiting_count = FC_ATOMIC_GET(context->stat.waiting_count);
+        if (waiting_count > max_waiting_count) {
+            max_waiting_count = waiting_count;
+            victim = context;
+        }
+    }
+
+    if (victim == NULL) {
+        return NULL;
+    }
+
+    if ((unit=(FSDataWorkUnit *)fc_queue_try_pop(&victim->queue)) != NULL) {
+        FC_ATOMIC_INC_EX(thread_ctx->stat.stolen_count, 1);
+    }
+    return unit;
+}
+
+static FSDataWorkUnit *fetch_work_unit(FSDataThreadContext *thread_ctx)
+{
+    FSDataWorkUnit *unit;
+
+    if ((unit=(FSDataWorkUnit *)fc_queue_try_pop(
+                    &thread_ctx->queue)) != NULL)
+    {
+        return unit;
+    }
+
+    if (DATA_THREAD_WORK_STEALING && thread_ctx->thread_array->count > 1) {
+        if ((unit=steal_work_unit(thread_ctx)) != NULL) {
+            return unit;
+        }
+    }
+
+    FC_ATOMIC_SET(thread_ctx->parked, 1);
+    unit = (FSDataWorkUnit *)fc_queue_pop(&thread_ctx->queue);
+    FC_ATOMIC_SET(thread_ctx->parked, 0);
+    return unit;
+}
+
 #define DATA_THREAD_COND_WAIT(thread_ctx) \
     do { \
         PTHREAD_MUTEX_LOCK(&thread_ctx->lc_pair.lock);   \
@@ -206,9 +401,35 @@ static void data_thread_rw_done_callback(
     data_thread_notify((FSDataThreadContext *)arg);
 }
 
+/* the latency of the background recovery is not concerned */
+#define DATA_OP_STAT_LATENCY(op) ((op)->source != DATA_SOURCE_SLAVE_RECOVERY)
+
+static inline void log_data_update_with_stat(FSDataOperation *op,
+        const int op_type)
+{
+    int64_t start_time_us;
+
+    if (op->binlog_write_done) {
+        return;
+    }
+
+    if (DATA_OP_STAT_LATENCY(op)) {
+        start_time_us = get_current_time_us();
+        log_data_update(op);
+        latency_stat_add_since(FS_LATENCY_STAGE_BINLOG,
+                op_type, start_time_us);
+    } else {
+        log_data_update(op);
+    }
+}
+
 static void deal_operation_finish(FSDataThreadContext *thread_ctx,
-        FSDataOperation *op, const bool is_update)
+        FSDataOperation *op, const bool is_update, const int op_type)
 {
+    ReplicationRPCEntry *rpc;
+    int64_t start_time_us;
+    int result;
+
     if (op->ctx->result != 0) {
         if (is_update && op->source == DATA_SOURCE_SLAVE_REPLICA) {
             logCrit("file: "__FILE__", line: %d, "
@@ -220,16 +441,30 @@ static void deal_operation_finish(FSDataThreadContext *thread_ctx,
         op->binlog_write_done = false;
         if (op->source == DATA_SOURCE_MASTER_SERVICE) {
             if (!MASTER_ELECTION_FAILOVER) {
-                log_data_update(op);  //log first
+                log_data_update_with_stat(op, op_type);  //log first
             }
 
-            if (replication_caller_push_to_slave_queues(op) ==
-                    TASK_STATUS_CONTINUE)
-            {
+            start_time_us = get_current_time_us();
+            result = replication_caller_push_to_slave_queues(op, &rpc);
+            if (result == TASK_STATUS_CONTINUE) {
                 DATA_THREAD_COND_WAIT(thread_ctx);
+                latency_stat_add_since(FS_LATENCY_STAGE_REPLICA,
+                        op_type, start_time_us);
             }
+        } else {
+            rpc = NULL;
+            result = 0;
+        }
+        log_data_update_with_stat(op, op_type);
+
+        /* the write fails and the client retries when the quorum
+         * of the slaves NOT persist the update */
+        if (rpc != NULL) {
+            result = replication_caller_finish_rpc(rpc);
+        }
+        if (result != 0 && result != TASK_STATUS_CONTINUE) {
+            op->ctx->result = result;
         }
-        log_data_update(op);
 
         /*
            logInfo("file: "__FILE__", line: %d, op ptr: %p, "
@@ -253,7 +488,16 @@ static void deal_one_operation(FSDataThreadContext *thread_ctx,
         FSDataOperation *op)
 {
     bool is_update;
+    int op_type;
     int result;
+    int64_t start_time_us;
+
+    op_type = latency_stat_op_type(op->operation);
+    start_time_us = get_current_time_us();
+    if (DATA_OP_STAT_LATENCY(op)) {
+        latency_stat_add(FS_LATENCY_STAGE_QUEUE, op_type,
+                start_time_us - op->push_time_us);
+    }
 
     op->ctx->arg = thread_ctx;
     switch (op->operation) {
@@ -262,6 +506,10 @@ static void deal_one_operation(FSDataThreadContext *thread_ctx,
             op->ctx->rw_done_callback = data_thread_rw_done_callback;
             if ((op->ctx->result=fs_slice_read(op->ctx)) == 0) {
                 DATA_THREAD_COND_WAIT(thread_ctx);
+                if (DATA_OP_STAT_LATENCY(op)) {
+                    latency_stat_add_since(FS_LATENCY_STAGE_IO,
+                            op_type, start_time_us);
+                }
             }
             break;
         case DATA_OPERATION_SLICE_WRITE:
@@ -272,6 +520,10 @@ static void deal_one_operation(FSDataThreadContext *thread_ctx,
             op->ctx->rw_done_callback = data_thread_rw_done_callback;
             if ((result=fs_slice_write(op->ctx)) == 0) {
                 DATA_THREAD_COND_WAIT(thread_ctx);
+                if (DATA_OP_STAT_LATENCY(op)) {
+                    latency_stat_add_since(FS_LATENCY_STAGE_IO,
+                            op_type, start_time_us);
+                }
             } else {
                 op->ctx->result = result;
             }
@@ -291,6 +543,10 @@ static void deal_one_operation(FSDataThreadContext *thread_ctx,
             is_update = true;
             op->ctx->result = fs_delete_block(op->ctx);
             break;
+        case DATA_OPERATION_BLOCK_CLONE:
+            is_update = true;
+            op->ctx->result = fs_clone_block(op->ctx);
+            break;
         default:
             is_update = false;
             op->ctx->result = EINVAL;
@@ -299,18 +555,53 @@ static void deal_one_operation(FSDataThreadContext *thread_ctx,
             break;
     }
 
-    deal_operation_finish(thread_ctx, op, is_update);
+    deal_operation_finish(thread_ctx, op, is_update, op_type);
+    server_qos_done(op->ctx);
     op->ctx->notify_func(op);
 }
 
-static void *data_thread_func(void *arg)
+static void deal_work_unit(FSDataThreadContext *thread_ctx,
+        FSDataWorkUnit *unit)
 {
     FSDataOperation *op;
     FSDataOperation *current;
+    int count;
+
+    FC_ATOMIC_SET(thread_ctx->busy, 1);
+    count = 0;
+    op = (FSDataOperation *)fc_queue_try_pop_all(&unit->queue);
+    while (op != NULL) {
+        current = op;
+        op = op->next;
+        deal_one_operation(thread_ctx, current);
+        fast_mblock_free_object(current->allocator, current);
+        ++count;
+    }
+    FC_ATOMIC_SET(thread_ctx->busy, 0);
+
+    if (count > 0) {
+        FC_ATOMIC_DEC_EX(unit->home->stat.waiting_count, count);
+        FC_ATOMIC_INC_EX(thread_ctx->stat.done_count, count);
+    }
+
+    /* release the work unit then reschedule it when new operations
+       pushed during dealing, the CAS guarantees only one holder */
+    __sync_bool_compare_and_swap(&unit->in_queue, 1, 0);
+    if (!fc_queue_empty(&unit->queue) && __sync_bool_compare_and_swap(
+                &unit->in_queue, 0, 1))
+    {
+        fc_queue_push(&thread_ctx->queue, unit);
+    }
+}
+
+static void *data_thread_func(void *arg)
+{
+    FSDataWorkUnit *unit;
     FSDataThreadContext *thread_ctx;
 
     __sync_add_and_fetch(&DATA_THREAD_RUNNING_COUNT, 1);
     thread_ctx = (FSDataThreadContext *)arg;
+    server_numa_bind_thread(thread_ctx->numa_node);
 
 #ifdef OS_LINUX
     {
@@ -329,17 +620,11 @@ static void *data_thread_func(void *arg)
 #endif
 
     while (SF_G_CONTINUE_FLAG) {
-        op = (FSDataOperation *)fc_queue_pop_all(&thread_ctx->queue);
-        if (op == NULL) {
+        if ((unit=fetch_work_unit(thread_ctx)) == NULL) {
             continue;
         }
 
-        do {
-            current = op;
-            op = op->next;
-            deal_one_operation(thread_ctx, current);
-            fast_mblock_free_object(&thread_ctx->allocator, current);
-        } while (op != NULL);
+        deal_work_unit(thread_ctx, unit);
     }
 
     __sync_sub_and_fetch(&DATA_THREAD_RUNNING_COUNT, 1);
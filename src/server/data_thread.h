@@ -18,7 +18,9 @@
 #ifndef _DATA_THREAD_H_
 #define _DATA_THREAD_H_
 
+#include "fastcommon/shared_func.h"
 #include "fastcommon/fc_queue.h"
+#include "fastcommon/fc_atomic.h"
 #include "storage/slice_op.h"
 
 #define DATA_OPERATION_NONE           '\0'
@@ -27,6 +29,7 @@
 #define DATA_OPERATION_SLICE_ALLOCATE 'a'
 #define DATA_OPERATION_SLICE_DELETE   'd'
 #define DATA_OPERATION_BLOCK_DELETE   'D'
+#define DATA_OPERATION_BLOCK_CLONE    'L'
 
 #define DATA_SOURCE_MASTER_SERVICE     1
 #define DATA_SOURCE_SLAVE_REPLICA      2
@@ -36,23 +39,53 @@ typedef struct fs_data_operation {
     short operation;
     char source;
     bool binlog_write_done;
+    int64_t push_time_us;  //for the queue latency stat
     FSSliceOpContext *ctx;
     void *arg;
+    struct fast_mblock_man *allocator; //for free
     struct fs_data_operation *next;  //for queue
 } FSDataOperation;
 
+struct fs_data_thread_context;
+struct fs_data_thread_array;
+
+/* the operations of the same data group MUST be dealt in order,
+   so the data group is the unit for scheduling and stealing */
+typedef struct fs_data_work_unit {
+    int data_group_id;
+    volatile char in_queue;  //in ready queue or dealing by a thread
+    struct fc_queue queue;   //element: FSDataOperation
+    struct fs_data_thread_context *home;  //the hashed thread
+    struct fs_data_work_unit *next;  //for ready queue
+} FSDataWorkUnit;
+
 typedef struct fs_data_thread_context {
     short index;
     short role;
+    short numa_node;  //the data groups stay on the node of the home thread
     bool notify_done;
+    volatile char busy;     //dealing operations
+    volatile char parked;   //waiting for work unit
     pthread_lock_cond_pair_t lc_pair;
-    struct fc_queue queue;
+    struct fc_queue queue;  //ready queue, element: FSDataWorkUnit
     struct fast_mblock_man allocator;
+    struct fs_data_thread_array *thread_array;
+
+    struct {
+        volatile int waiting_count; //operations waiting to deal
+        volatile int64_t done_count;
+        volatile int64_t stolen_count;  //work units stolen from others
+        volatile int64_t donated_count; //work units donated to others
+    } stat;
 } FSDataThreadContext;
 
 typedef struct fs_data_thread_array {
     FSDataThreadContext *contexts;
     int count;
+    struct {
+        FSDataWorkUnit *units;
+        int count;
+    } unit_array;
 } FSDataThreadArray;
 
 typedef struct fdir_data_thread_variables {
@@ -73,24 +106,30 @@ extern "C" {
     void data_thread_destroy();
     void data_thread_terminate();
 
+    void data_thread_stat(FSDataThreadStat *master, FSDataThreadStat *slave);
+
+    void data_thread_schedule_unit(FSDataWorkUnit *unit);
+
     static inline int push_to_data_thread_queue(const int operation,
             const int source, void *arg, FSSliceOpContext *op_ctx)
     {
-        FSDataThreadContext *context;
+        FSDataThreadArray *thread_array;
+        FSDataWorkUnit *unit;
         FSDataOperation *op;
         uint32_t hash_code;
 
         /* hash_code = FS_BLOCK_HASH_CODE(op_ctx->info.bs_key.block); */
         hash_code = op_ctx->info.data_group_id;
         if (__sync_add_and_fetch(&op_ctx->info.myself->is_master, 0)) {
-            context = g_data_thread_vars.thread_arrays.master.contexts +
-                 hash_code % g_data_thread_vars.thread_arrays.master.count;
+            thread_array = &g_data_thread_vars.thread_arrays.master;
         } else {
-            context = g_data_thread_vars.thread_arrays.slave.contexts +
-                hash_code % g_data_thread_vars.thread_arrays.slave.count;
+            thread_array = &g_data_thread_vars.thread_arrays.slave;
         }
+        unit = thread_array->unit_array.units +
+            hash_code % thread_array->unit_array.count;
 
-        op = (FSDataOperation *)fast_mblock_alloc_object(&context->allocator);
+        op = (FSDataOperation *)fast_mblock_alloc_object(
+                &unit->home->allocator);
         if (op == NULL) {
             return ENOMEM;
         }
@@ -99,7 +138,13 @@ extern "C" {
         op->source = source;
         op->arg = arg;
         op->ctx = op_ctx;
-        fc_queue_push(&context->queue, op);
+        op->allocator = &unit->home->allocator;
+        op->push_time_us = get_current_time_us();
+        FC_ATOMIC_INC(unit->home->stat.waiting_count);
+        fc_queue_push(&unit->queue, op);
+        if (__sync_bool_compare_and_swap(&unit->in_queue, 0, 1)) {
+            data_thread_schedule_unit(unit);
+        }
         return 0;
     }
 
@@ -124,6 +169,8 @@ extern "C" {
                 return "slice delete";
             case DATA_OPERATION_BLOCK_DELETE:
                 return "block delete";
+            case DATA_OPERATION_BLOCK_CLONE:
+                return "block clone";
             default:
                 return "unkown";
         }
@@ -145,6 +192,8 @@ extern "C" {
                 return fs_log_delete_slices(op->ctx);
             case DATA_OPERATION_BLOCK_DELETE:
                 return fs_log_delete_block(op->ctx);
+            case DATA_OPERATION_BLOCK_CLONE:
+                return fs_log_clone_block(op->ctx);
             default:
                 logError("file: "__FILE__", line: %d, "
                         "invalid operation: %d",
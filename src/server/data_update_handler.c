@@ -47,6 +47,9 @@
 #include "server_func.h"
 #include "server_group_info.h"
 #include "server_storage.h"
+#include "server_qos.h"
+#include "latency_stat.h"
+#include "common_handler.h"
 #include "data_update_handler.h"
 
 static inline int wait_recovery_done(FSClusterDataServerInfo *ds,
@@ -203,11 +206,12 @@ int du_handler_parse_check_block_slice(struct fast_task_info *task,
 }
 
 void du_handler_fill_slice_update_response(struct fast_task_info *task,
-        const int inc_alloc)
+        const int inc_alloc, const uint64_t data_version)
 {
     FSProtoSliceUpdateResp *resp;
     resp = (FSProtoSliceUpdateResp *)SF_PROTO_RESP_BODY(task);
     int2buff(inc_alloc, resp->inc_alloc);
+    long2buff(data_version, resp->data_version);
 
     RESPONSE.header.body_len = sizeof(FSProtoSliceUpdateResp);
     TASK_CTX.common.response_done = true;
@@ -227,6 +231,8 @@ void du_handler_idempotency_request_finish(struct fast_task_info *task,
             IDEMPOTENCY_REQUEST->output.result = result;
             ((FSUpdateOutput *)IDEMPOTENCY_REQUEST->output.response)->
                 inc_alloc = SLICE_OP_CTX.update.space_changed;
+            ((FSUpdateOutput *)IDEMPOTENCY_REQUEST->output.response)->
+                data_version = SLICE_OP_CTX.info.data_version;
         }
         idempotency_request_release(IDEMPOTENCY_REQUEST);
 
@@ -283,12 +289,22 @@ void du_handler_slice_read_done_callback(FSSliceOpContext *op_ctx,
 {
     int log_level;
 
+    server_qos_done(op_ctx);
+    if (op_ctx->start_time_us > 0) {  //the service read
+        latency_stat_add_since(FS_LATENCY_STAGE_IO, FS_LATENCY_OP_READ,
+                op_ctx->io_start_time_us);
+        latency_stat_add_since(FS_LATENCY_STAGE_TOTAL, FS_LATENCY_OP_READ,
+                op_ctx->start_time_us);
+        op_ctx->start_time_us = 0;
+    }
+
     if (op_ctx->result != 0) {
         RESPONSE.error.length = snprintf(RESPONSE.error.message,
                 sizeof(RESPONSE.error.message),
                 "%s", STRERROR(op_ctx->result));
 
-        log_level = (op_ctx->result == ENOENT) ? LOG_DEBUG : LOG_ERR;
+        log_level = (op_ctx->result == ENOENT || op_ctx->result ==
+                EAGAIN) ? LOG_DEBUG : LOG_ERR;
         log_it_ex(&g_log_context, log_level,
                 "file: "__FILE__", line: %d, "
                 "client ip: %s, read slice fail, "
@@ -343,7 +359,10 @@ static void log_data_operation_error(struct fast_task_info *task,
             op->ctx->info.bs_key.block.offset
             );
 
-    if (op->operation != DATA_OPERATION_BLOCK_DELETE) {
+    if (op->operation == DATA_OPERATION_BLOCK_CLONE) {
+        len += sprintf(buff + len, ", source oid: %"PRId64,
+                op->ctx->info.src_block.oid);
+    } else if (op->operation != DATA_OPERATION_BLOCK_DELETE) {
         len += sprintf(buff + len, ", slice offset: %d, length: %d",
                 op->ctx->info.bs_key.slice.offset,
                 op->ctx->info.bs_key.slice.length);
@@ -360,6 +379,8 @@ static void master_data_update_done_notify(FSDataOperation *op)
     struct fast_task_info *task;
 
     task = (struct fast_task_info *)op->arg;
+    latency_stat_add_since(FS_LATENCY_STAGE_TOTAL, latency_stat_op_type(
+                op->operation), op->ctx->start_time_us);
     if (op->ctx->result != 0) {
         RESPONSE.error.length = snprintf(RESPONSE.error.message,
                 sizeof(RESPONSE.error.message),
@@ -381,9 +402,13 @@ static void master_data_update_done_notify(FSDataOperation *op)
             case DATA_OPERATION_BLOCK_DELETE:
                 RESPONSE.header.cmd = FS_SERVICE_PROTO_BLOCK_DELETE_RESP;
                 break;
+            case DATA_OPERATION_BLOCK_CLONE:
+                RESPONSE.header.cmd = FS_SERVICE_PROTO_BLOCK_CLONE_RESP;
+                break;
         }
         du_handler_fill_slice_update_response(task,
-                SLICE_OP_CTX.update.space_changed);
+                SLICE_OP_CTX.update.space_changed,
+                SLICE_OP_CTX.info.data_version);
         /*
            logInfo("file: "__FILE__", line: %d, "
            "which_side: %c, data_group_id: %d, "
@@ -496,18 +521,21 @@ static inline int du_push_to_data_queue(struct fast_task_info *task,
             return result;
         }
         op_ctx->notify_func = slave_data_update_done_notify;
+        op_ctx->start_time_us = 0;
     }
 
     sf_hold_task(task);
     op_ctx->info.write_binlog.log_replica = true;
-    if ((result=push_to_data_thread_queue(operation,
+    if ((result=server_qos_push_to_data_queue(task, operation,
                    TASK_CTX.which_side == FS_WHICH_SIDE_MASTER ?
                    DATA_SOURCE_MASTER_SERVICE : DATA_SOURCE_SLAVE_REPLICA,
                    task, op_ctx)) != 0)
     {
         const char *caption;
         caption = fs_get_data_operation_caption(operation);
-        if (operation == DATA_OPERATION_BLOCK_DELETE) {
+        if (operation == DATA_OPERATION_BLOCK_DELETE ||
+                operation == DATA_OPERATION_BLOCK_CLONE)
+        {
             set_block_op_error_msg(task, op_ctx, caption, result);
         } else {
             du_handler_set_slice_op_error_msg(task, op_ctx, caption, result);
@@ -627,6 +655,51 @@ int du_handler_deal_block_delete(struct fast_task_info *task,
     return du_push_to_data_queue(task, op_ctx, DATA_OPERATION_BLOCK_DELETE);
 }
 
+int du_handler_deal_block_clone(struct fast_task_info *task,
+        FSSliceOpContext *op_ctx)
+{
+    int result;
+    FSProtoBlockCloneReq *req;
+
+    if ((result=sf_server_expect_body_length(&RESPONSE, op_ctx->info.body_len,
+                    sizeof(FSProtoBlockCloneReq))) != 0)
+    {
+        return result;
+    }
+
+    req = (FSProtoBlockCloneReq *)op_ctx->info.body;
+    if ((result=parse_check_block_key_ex(task, op_ctx, &req->bkey,
+                    TASK_CTX.which_side == FS_WHICH_SIDE_MASTER)) != 0)
+    {
+        return result;
+    }
+
+    op_ctx->info.src_block.oid = buff2long(req->src_oid);
+    op_ctx->info.src_block.offset = op_ctx->info.bs_key.block.offset;
+    if (op_ctx->info.src_block.oid == op_ctx->info.bs_key.block.oid) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "the source oid: %"PRId64" is the same as the dest",
+                op_ctx->info.src_block.oid);
+        return EINVAL;
+    }
+
+    /* the slices are shared within the same data group only */
+    fs_calc_block_hashcode(&op_ctx->info.src_block);
+    if (FS_DATA_GROUP_ID(op_ctx->info.src_block) !=
+            op_ctx->info.data_group_id)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "the data group id of source block {oid: %"PRId64", "
+                "offset: %"PRId64"}: %d != the dest: %d",
+                op_ctx->info.src_block.oid, op_ctx->info.src_block.offset,
+                FS_DATA_GROUP_ID(op_ctx->info.src_block),
+                op_ctx->info.data_group_id);
+        return EXDEV;
+    }
+
+    return du_push_to_data_queue(task, op_ctx, DATA_OPERATION_BLOCK_CLONE);
+}
+
 FSServerContext *du_handler_alloc_server_context()
 {
     FSServerContext *server_context;
@@ -733,7 +806,8 @@ int du_handler_deal_client_join(struct fast_task_info *task)
 }
 
 static FSClusterDataServerInfo *get_readable_server(
-        FSClusterDataGroupInfo *group, const SFDataReadRule read_rule)
+        struct fast_task_info *task, FSClusterDataGroupInfo *group,
+        const SFDataReadRule read_rule)
 {
     int index;
     int acc_index;
@@ -747,6 +821,17 @@ static FSClusterDataServerInfo *get_readable_server(
                 &group->master, 0);
     }
 
+    /* the client on this host reads from myself to avoid the network
+     * hop between hosts, the read still goes through the TCP stack */
+    if (SERVICE_LOCAL_READ_FIRST && (ds=group->myself) != NULL &&
+            __sync_add_and_fetch(&ds->status, 0) == FS_DS_STATUS_ACTIVE &&
+            (read_rule != sf_data_read_rule_slave_first ||
+             !__sync_add_and_fetch(&ds->is_master, 0)) &&
+            handler_is_local_client(task))
+    {
+        return ds;
+    }
+
     index = rand() % group->data_server_array.count;
     if (__sync_add_and_fetch(&group->data_server_array.servers[index].
                 status, 0) == FS_DS_STATUS_ACTIVE)
@@ -823,7 +908,7 @@ int du_handler_deal_get_readable_server(struct fast_task_info *task,
         ds = (FSClusterDataServerInfo *)__sync_fetch_and_add(
                 &group->master, 0);
     } else {
-        ds = get_readable_server(group, read_rule);
+        ds = get_readable_server(task, group, read_rule);
     }
 
     if (ds == NULL) {
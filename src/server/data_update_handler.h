@@ -39,7 +39,7 @@ int du_handler_parse_check_block_slice(struct fast_task_info *task,
         const bool master_only);
 
 void du_handler_fill_slice_update_response(struct fast_task_info *task,
-        const int inc_alloc);
+        const int inc_alloc, const uint64_t data_version);
 
 void du_handler_idempotency_request_finish(struct fast_task_info *task,
         const int result);
@@ -61,6 +61,9 @@ int du_handler_deal_slice_delete(struct fast_task_info *task,
 int du_handler_deal_block_delete(struct fast_task_info *task,
         FSSliceOpContext *op_ctx);
 
+int du_handler_deal_block_clone(struct fast_task_info *task,
+        FSSliceOpContext *op_ctx);
+
 int du_handler_deal_client_join(struct fast_task_info *task);
 
 int du_handler_deal_get_readable_server(struct fast_task_info *task,
@@ -22,6 +22,7 @@
 #include "fastcommon/pthread_func.h"
 #include "fastcommon/fc_atomic.h"
 #include "../server_global.h"
+#include "../server_numa.h"
 #include "read_buffer_pool.h"
 
 typedef struct {
@@ -33,6 +34,7 @@ typedef struct {
 typedef struct {
     int block_size;
     short path_index;
+    short numa_node;  //the local node of the store path
 
     struct {
         volatile int64_t alloc;
@@ -165,6 +167,7 @@ int read_buffer_pool_create(const short path_index, const int block_size)
     pool = rbpool_ctx.array.pools + path_index;
     pool->path_index = path_index;
     pool->block_size = block_size;
+    pool->numa_node = PATHS_BY_INDEX_PPTR[path_index]->numa_node;
     pool->memory.alloc = 0;
     pool->memory.used = 0;
 
@@ -292,6 +295,7 @@ static inline AlignedReadBuffer *do_aligned_alloc(ReadBufferPool *pool,
         fast_mblock_free_object(&pool->mblock, buffer);
         return NULL;
     }
+    server_numa_bind_memory(buffer->buff, allocator->size, pool->numa_node);
 
     buffer->size = allocator->size;
     buffer->indexes.allocator = allocator - pool->mpool.allocators;
@@ -448,3 +452,20 @@ int read_buffer_pool_start(const int max_idle_time,
     return fc_create_thread(&tid, reclaim_thread_entrance,
             NULL, SF_G_THREAD_STACK_SIZE);
 }
+
+int read_buffer_pool_memory_stat(const short path_index,
+        int64_t *alloc, int64_t *used)
+{
+    ReadBufferPool **pp;
+
+    for (pp=rbpool_ctx.ptr_array.pools; pp<rbpool_ctx.ptr_array.end; pp++) {
+        if ((*pp)->path_index == path_index) {
+            *alloc = FC_ATOMIC_GET((*pp)->memory.alloc);
+            *used = FC_ATOMIC_GET((*pp)->memory.used);
+            return 0;
+        }
+    }
+
+    *alloc = *used = 0;
+    return ENOENT;
+}
@@ -51,6 +51,11 @@ extern "C" {
 
     void read_buffer_pool_free(AlignedReadBuffer *buffer);
 
+    /* get the memory usage of the pool of the store path,
+     * return ENOENT when the pool not exist */
+    int read_buffer_pool_memory_stat(const short path_index,
+            int64_t *alloc, int64_t *used);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,10 +32,14 @@
 #include "fastcommon/logger.h"
 #include "fastcommon/fast_mblock.h"
 #include "fastcommon/uniq_skiplist.h"
+#include "fastcommon/fc_atomic.h"
 #include "sf/sf_global.h"
 #include "sf/sf_func.h"
 #include "../server_global.h"
+#include "../server_numa.h"
 #include "../binlog/trunk_binlog.h"
+#include "../storage/raw_device.h"
+#include "../storage/slice_compress.h"
 #include "trunk_fd_cache.h"
 #ifdef OS_LINUX
 #include "read_buffer_pool.h"
@@ -51,6 +55,17 @@ typedef struct trunk_read_thread_context {
     struct fc_queue queue;
     struct fast_mblock_man mblock;
     TrunkFDCacheContext fd_cache;
+    struct {
+        FSRawDevice *ptr;  //NULL for the trunk files
+        int fd;
+    } device;
+
+    struct {
+#ifndef OS_LINUX
+        char *input;  //the compressed data
+#endif
+        char *output; //the decompressed data
+    } compress;  //alloced on demand
 
 #ifdef OS_LINUX
     struct {
@@ -86,10 +101,16 @@ typedef struct trunk_io_path_contexts_array {
 
 typedef struct trunk_io_context {
     TrunkReadPathContextArray path_ctx_array;
+    volatile int waiting_count;  //the IO requests in queue or in progress
 } TrunkReadContext;
 
 static TrunkReadContext trunk_io_ctx = {{0, NULL}};
 
+int trunk_read_thread_get_waiting_count()
+{
+    return FC_ATOMIC_GET(trunk_io_ctx.waiting_count);
+}
+
 static void *trunk_read_thread_func(void *arg);
 
 static int alloc_path_contexts()
@@ -145,6 +166,8 @@ static int init_thread_context(TrunkReadThreadContext *ctx,
     {
         return result;
     }
+    ctx->device.ptr = path_info->device;
+    ctx->device.fd = -1;
 
 #ifdef OS_LINUX
     ctx->block_size = path_info->block_size;
@@ -329,6 +352,7 @@ int trunk_read_thread_push(OBSliceEntry *slice, char *buff,
     iob->notify.func = notify_func;
     iob->notify.arg = notify_arg;
 
+    FC_ATOMIC_INC(trunk_io_ctx.waiting_count);
     fc_queue_push(&thread_ctx->queue, iob);
     return 0;
 }
@@ -336,9 +360,28 @@ int trunk_read_thread_push(OBSliceEntry *slice, char *buff,
 static inline void get_trunk_filename(FSTrunkSpaceInfo *space,
         char *trunk_filename, const int size)
 {
-    snprintf(trunk_filename, size, "%s/%04"PRId64"/%06"PRId64,
-            space->store->path.str, space->id_info.subdir,
-            space->id_info.id);
+    FSRawDevice *device;
+
+    if ((device=FS_RAW_DEVICE_BY_PATH_INDEX(space->store->index)) != NULL) {
+        snprintf(trunk_filename, size, "%s[extent %"PRId64"]",
+                device->filename, FS_RAW_DEVICE_EXTENT_INDEX(
+                    &space->id_info));
+    } else {
+        snprintf(trunk_filename, size, "%s/%04"PRId64"/%06"PRId64,
+                space->store->path.str, space->id_info.subdir,
+                space->id_info.id);
+    }
+}
+
+static inline int64_t get_file_offset(TrunkReadThreadContext *ctx,
+        FSTrunkSpaceInfo *space, const int64_t offset)
+{
+    if (ctx->device.ptr != NULL) {
+        return raw_device_space_offset(ctx->device.ptr,
+                &space->id_info, offset);
+    } else {
+        return offset;
+    }
 }
 
 static int get_read_fd(TrunkReadThreadContext *ctx,
@@ -347,13 +390,22 @@ static int get_read_fd(TrunkReadThreadContext *ctx,
     char trunk_filename[PATH_MAX];
     int result;
 
-    if ((*fd=trunk_fd_cache_get(&ctx->fd_cache,
-                    space->id_info.id)) >= 0)
-    {
-        return 0;
+    if (ctx->device.ptr != NULL) {
+        if (ctx->device.fd >= 0) {
+            *fd = ctx->device.fd;
+            return 0;
+        }
+        snprintf(trunk_filename, sizeof(trunk_filename),
+                "%s", ctx->device.ptr->filename);
+    } else {
+        if ((*fd=trunk_fd_cache_get(&ctx->fd_cache,
+                        space->id_info.id)) >= 0)
+        {
+            return 0;
+        }
+        get_trunk_filename(space, trunk_filename, sizeof(trunk_filename));
     }
 
-    get_trunk_filename(space, trunk_filename, sizeof(trunk_filename));
 #ifdef OS_LINUX
     *fd = open(trunk_filename, O_RDONLY | O_DIRECT);
 #else
@@ -367,34 +419,106 @@ static int get_read_fd(TrunkReadThreadContext *ctx,
         return result;
     }
 
-    trunk_fd_cache_add(&ctx->fd_cache, space->id_info.id, *fd);
+    if (ctx->device.ptr != NULL) {
+        ctx->device.fd = *fd;
+    } else {
+        trunk_fd_cache_add(&ctx->fd_cache, space->id_info.id, *fd);
+    }
+    return 0;
+}
+
+static int check_alloc_compress_buffer(char **buff)
+{
+    if (*buff == NULL) {
+        if ((*buff=(char *)fc_malloc(FS_FILE_BLOCK_SIZE)) == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+static int decompress_slice(TrunkReadThreadContext *ctx,
+        OBSliceEntry *slice, const char *src, char *dest)
+{
+    int result;
+
+    if ((result=check_alloc_compress_buffer(&ctx->compress.output)) != 0) {
+        return result;
+    }
+
+    if ((result=fs_decompress_data(slice->compress.type, src,
+                    slice->compress.length, ctx->compress.output,
+                    FS_FILE_BLOCK_SIZE, slice->compress.offset +
+                    slice->ssize.length)) != 0)
+    {
+        char trunk_filename[PATH_MAX];
+
+        get_trunk_filename(&slice->space, trunk_filename,
+                sizeof(trunk_filename));
+        logError("file: "__FILE__", line: %d, "
+                "decompress slice fail, trunk file: %s, "
+                "offset: %"PRId64, __LINE__, trunk_filename,
+                slice->space.offset);
+        return result;
+    }
+
+    memcpy(dest, ctx->compress.output + slice->compress.offset,
+            slice->ssize.length);
     return 0;
 }
 
 #ifdef OS_LINUX
 
+static int decompress_aligned_buffer(TrunkReadThreadContext *ctx,
+        TrunkReadIOBuffer *iob)
+{
+    AlignedReadBuffer *compressed;
+    AlignedReadBuffer *decompressed;
+    int result;
+
+    compressed = *(iob->aligned_buffer);
+    decompressed = aligned_buffer_new(ctx->indexes.path, 0,
+            iob->slice->ssize.length, MEM_ALIGN_CEIL(
+                iob->slice->ssize.length, ctx->block_size));
+    if (decompressed == NULL) {
+        return ENOMEM;
+    }
+
+    if ((result=decompress_slice(ctx, iob->slice, compressed->buff +
+                    compressed->offset, decompressed->buff)) != 0)
+    {
+        read_buffer_pool_free(decompressed);
+        return result;
+    }
+
+    read_buffer_pool_free(compressed);
+    *(iob->aligned_buffer) = decompressed;
+    return 0;
+}
+
 static inline int prepare_read_slice(TrunkReadThreadContext *ctx,
         TrunkReadIOBuffer *iob)
 {
     int64_t new_offset;
     int offset;
+    int data_len;
     int read_bytes;
     int result;
     int fd;
 
+    data_len = FS_SLICE_DATA_LENGTH(iob->slice);
     new_offset = MEM_ALIGN_FLOOR(iob->slice->space.offset, ctx->block_size);
-    read_bytes = MEM_ALIGN_CEIL(iob->slice->ssize.length, ctx->block_size);
+    read_bytes = MEM_ALIGN_CEIL(data_len, ctx->block_size);
     offset = iob->slice->space.offset - new_offset;
     if (offset > 0) {
-        if (new_offset + read_bytes < iob->slice->space.offset +
-                iob->slice->ssize.length)
-        {
+        if (new_offset + read_bytes < iob->slice->space.offset + data_len) {
             read_bytes += ctx->block_size;
         }
     }
 
     *(iob->aligned_buffer) = aligned_buffer_new(ctx->indexes.path,
-            offset, iob->slice->ssize.length, read_bytes);
+            offset, data_len, read_bytes);
     if (*(iob->aligned_buffer) == NULL) {
         return ENOMEM;
     }
@@ -412,7 +536,8 @@ static inline int prepare_read_slice(TrunkReadThreadContext *ctx,
     }
 
     io_prep_pread(&iob->iocb, fd, (*(iob->aligned_buffer))->buff,
-            (*(iob->aligned_buffer))->read_bytes, new_offset);
+            (*(iob->aligned_buffer))->read_bytes, get_file_offset(
+                ctx, &iob->slice->space, new_offset));
     iob->iocb.data = iob;
     ctx->iocbs.pp[ctx->iocbs.count++] = &iob->iocb;
     return 0;
@@ -528,7 +653,11 @@ static int process_aio(TrunkReadThreadContext *ctx)
     for (event=ctx->aio.events; event<end; event++) {
         iob = (TrunkReadIOBuffer *)event->data;
         if (event->res == (*(iob->aligned_buffer))->read_bytes) {
-            result = 0;
+            if (iob->slice->compress.type != FS_COMPRESS_TYPE_NONE) {
+                result = decompress_aligned_buffer(ctx, iob);
+            } else {
+                result = 0;
+            }
         } else {
             trunk_fd_cache_delete(&ctx->fd_cache,
                     iob->slice->space.id_info.id);
@@ -551,6 +680,7 @@ static int process_aio(TrunkReadThreadContext *ctx)
 
         iob->notify.func(iob, result);
         fast_mblock_free_object(&ctx->mblock, iob);
+        FC_ATOMIC_DEC(trunk_io_ctx.waiting_count);
     }
     ctx->aio.doing_count -= count;
 
@@ -581,16 +711,29 @@ static int do_read_slice(TrunkReadThreadContext *ctx, TrunkReadIOBuffer *iob)
     int bytes;
     int data_len;
     int result;
+    char *buff;
 
     if ((result=get_read_fd(ctx, &iob->slice->space, &fd)) != 0) {
         return result;
     }
 
+    if (iob->slice->compress.type != FS_COMPRESS_TYPE_NONE) {
+        if ((result=check_alloc_compress_buffer(
+                        &ctx->compress.input)) != 0)
+        {
+            return result;
+        }
+        buff = ctx->compress.input;
+    } else {
+        buff = iob->data;
+    }
+
     data_len = 0;
-    remain = iob->slice->ssize.length;
+    remain = FS_SLICE_DATA_LENGTH(iob->slice);
     while (remain > 0) {
-        if ((bytes=pread(fd, iob->data + data_len, remain,
-                        iob->slice->space.offset + data_len)) <= 0)
+        if ((bytes=pread(fd, buff + data_len, remain,
+                        get_file_offset(ctx, &iob->slice->space,
+                            iob->slice->space.offset + data_len))) <= 0)
         {
             char trunk_filename[PATH_MAX];
 
@@ -616,6 +759,9 @@ static int do_read_slice(TrunkReadThreadContext *ctx, TrunkReadIOBuffer *iob)
         remain -= bytes;
     }
 
+    if (iob->slice->compress.type != FS_COMPRESS_TYPE_NONE) {
+        return decompress_slice(ctx, iob->slice, buff, iob->data);
+    }
     return 0;
 }
 
@@ -633,6 +779,7 @@ static void *trunk_read_thread_func(void *arg)
 #endif
 
     ctx = (TrunkReadThreadContext *)arg;
+    server_numa_bind_thread(PATHS_BY_INDEX_PPTR[ctx->indexes.path]->numa_node);
 
 #ifdef OS_LINUX
     len = snprintf(thread_name, sizeof(thread_name),
@@ -667,6 +814,7 @@ static void *trunk_read_thread_func(void *arg)
             iob->notify.func(iob, result);
         }
         fast_mblock_free_object(&ctx->mblock, iob);
+        FC_ATOMIC_DEC(trunk_io_ctx.waiting_count);
     }
 #endif
 
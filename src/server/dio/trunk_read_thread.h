@@ -60,6 +60,9 @@ extern "C" {
     int trunk_read_thread_init();
     void trunk_read_thread_terminate();
 
+    /* the IO requests in queue or in progress of all read threads */
+    int trunk_read_thread_get_waiting_count();
+
 #ifdef OS_LINUX
     int trunk_read_thread_push(OBSliceEntry *slice, AlignedReadBuffer
             **aligned_buffer, trunk_read_io_notify_func notify_func,
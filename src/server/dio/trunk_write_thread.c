@@ -21,19 +21,28 @@
 #include "fastcommon/logger.h"
 #include "fastcommon/fast_mblock.h"
 #include "fastcommon/uniq_skiplist.h"
+#include "fastcommon/fc_atomic.h"
 #include "sf/sf_global.h"
 #include "sf/sf_func.h"
 #include "../server_global.h"
+#include "../server_numa.h"
 #include "../binlog/trunk_binlog.h"
+#include "../storage/raw_device.h"
 #include "trunk_write_thread.h"
 
 #define IO_THREAD_IOB_MAX     256
 #define IO_THREAD_BYTES_MAX   (64 * 1024 * 1024)
 
+//the aligned buffer size for O_DIRECT write
+#define IO_THREAD_DIRECT_BUFFER_SIZE  (2 * FS_FILE_BLOCK_SIZE)
+
 typedef struct write_file_handle {
     int64_t trunk_id;
     int64_t offset;
     int fd;
+#ifdef OS_LINUX
+    bool direct;  //current O_DIRECT flag of the fd
+#endif
 } WriteFileHandle;
 
 typedef struct trunk_write_thread_context {
@@ -44,6 +53,7 @@ typedef struct trunk_write_thread_context {
     struct fc_queue queue;
     struct fast_mblock_man mblock;
     WriteFileHandle file_handle;
+    FSRawDevice *device;  //NULL for the trunk files
 
     UniqSkiplistPair *sl_pair;
     struct {
@@ -61,6 +71,14 @@ typedef struct trunk_write_thread_context {
         TrunkWriteIOBuffer **iobs;
     } iob_array;
 
+#ifdef OS_LINUX
+    struct {
+        int block_size;
+        bool zero_copy;  //true when all the iovecs are aligned
+        char *buff;      //aligned by the device block size
+    } direct;
+#endif
+
 } TrunkWriteThreadContext;
 
 typedef struct trunk_write_thread_context_array {
@@ -80,10 +98,17 @@ typedef struct trunk_write_path_contexts_array {
 typedef struct trunk_write_context {
     TrunkWritePathContextArray path_ctx_array;
     UniqSkiplistFactory factory;
+    int open_flags;  //for write trunk files
+    volatile int waiting_count;  //the IO requests in queue or in progress
 } TrunkWriteContext;
 
 static TrunkWriteContext trunk_io_ctx = {{0, NULL}};
 
+int trunk_write_thread_get_waiting_count()
+{
+    return FC_ATOMIC_GET(trunk_io_ctx.waiting_count);
+}
+
 static void *trunk_write_thread_func(void *arg);
 
 static int alloc_path_contexts()
@@ -149,6 +174,28 @@ static int init_write_context(TrunkWriteThreadContext *ctx)
         return result;
     }
 
+#ifdef OS_LINUX
+    if (STORAGE_CFG.trunk_write.direct_io) {
+        ctx->direct.block_size = STORAGE_CFG.paths_by_index.paths[
+            ctx->indexes.path]->block_size;
+        ctx->direct.zero_copy = true;
+        if ((result=posix_memalign((void **)&ctx->direct.buff,
+                        ctx->direct.block_size,
+                        IO_THREAD_DIRECT_BUFFER_SIZE)) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "posix_memalign %d bytes fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    IO_THREAD_DIRECT_BUFFER_SIZE, result,
+                    STRERROR(result));
+            return result;
+        }
+        server_numa_bind_memory(ctx->direct.buff,
+                IO_THREAD_DIRECT_BUFFER_SIZE, PATHS_BY_INDEX_PPTR[
+                ctx->indexes.path]->numa_node);
+    }
+#endif
+
     return 0;
 }
 
@@ -189,6 +236,7 @@ static int init_thread_contexts(TrunkWriteThreadContextArray *ctx_array,
     end = ctx_array->contexts + ctx_array->count;
     for (ctx=ctx_array->contexts; ctx<end; ctx++) {
         ctx->indexes.path = path_index;
+        ctx->device = FS_RAW_DEVICE_BY_PATH_INDEX(path_index);
         if (ctx_array->count == 1) {
             ctx->indexes.thread = -1;
         } else {
@@ -239,6 +287,18 @@ int trunk_write_thread_init()
         return result;
     }
 
+    trunk_io_ctx.open_flags = O_WRONLY;
+#ifdef OS_LINUX
+    if (STORAGE_CFG.trunk_write.direct_io) {
+        trunk_io_ctx.open_flags |= O_DIRECT;
+    }
+#endif
+    if (STORAGE_CFG.trunk_write.durability ==
+            FS_WRITE_DURABILITY_DSYNC_INT)
+    {
+        trunk_io_ctx.open_flags |= O_DSYNC;
+    }
+
     if ((result=init_path_contexts(&STORAGE_CFG.write_cache)) != 0) {
         return result;
     }
@@ -288,6 +348,7 @@ int trunk_write_thread_push(const int type, const int64_t version,
     }
     iob->notify.func = notify_func;
     iob->notify.arg = notify_arg;
+    FC_ATOMIC_INC(trunk_io_ctx.waiting_count);
     fc_queue_push(&thread_ctx->queue, iob);
     return 0;
 }
@@ -295,9 +356,28 @@ int trunk_write_thread_push(const int type, const int64_t version,
 static inline void get_trunk_filename(FSTrunkSpaceInfo *space,
         char *trunk_filename, const int size)
 {
-    snprintf(trunk_filename, size, "%s/%04"PRId64"/%06"PRId64,
-            space->store->path.str, space->id_info.subdir,
-            space->id_info.id);
+    FSRawDevice *device;
+
+    if ((device=FS_RAW_DEVICE_BY_PATH_INDEX(space->store->index)) != NULL) {
+        snprintf(trunk_filename, size, "%s[extent %"PRId64"]",
+                device->filename, FS_RAW_DEVICE_EXTENT_INDEX(
+                    &space->id_info));
+    } else {
+        snprintf(trunk_filename, size, "%s/%04"PRId64"/%06"PRId64,
+                space->store->path.str, space->id_info.subdir,
+                space->id_info.id);
+    }
+}
+
+static inline int64_t get_file_offset(TrunkWriteThreadContext *ctx,
+        FSTrunkSpaceInfo *space)
+{
+    if (ctx->device != NULL) {
+        return raw_device_space_offset(ctx->device,
+                &space->id_info, space->offset);
+    } else {
+        return space->offset;
+    }
 }
 
 static inline void clear_write_fd(TrunkWriteThreadContext *ctx)
@@ -315,13 +395,23 @@ static int get_write_fd(TrunkWriteThreadContext *ctx,
     char trunk_filename[PATH_MAX];
     int result;
 
-    if (space->id_info.id == ctx->file_handle.trunk_id) {
-        *fd = ctx->file_handle.fd;
-        return 0;
+    if (ctx->device != NULL) {
+        //one fd for all extents of the raw device
+        if (ctx->file_handle.fd >= 0) {
+            *fd = ctx->file_handle.fd;
+            return 0;
+        }
+        snprintf(trunk_filename, sizeof(trunk_filename),
+                "%s", ctx->device->filename);
+    } else {
+        if (space->id_info.id == ctx->file_handle.trunk_id) {
+            *fd = ctx->file_handle.fd;
+            return 0;
+        }
+        get_trunk_filename(space, trunk_filename, sizeof(trunk_filename));
     }
 
-    get_trunk_filename(space, trunk_filename, sizeof(trunk_filename));
-    *fd = open(trunk_filename, O_WRONLY, 0644);
+    *fd = open(trunk_filename, trunk_io_ctx.open_flags, 0644);
     if (*fd < 0) {
         result = errno != 0 ? errno : EACCES;
         logError("file: "__FILE__", line: %d, "
@@ -336,7 +426,26 @@ static int get_write_fd(TrunkWriteThreadContext *ctx,
 
     ctx->file_handle.trunk_id = space->id_info.id;
     ctx->file_handle.fd = *fd;
-    ctx->file_handle.offset = 0;
+    ctx->file_handle.offset = (ctx->device != NULL ? -1 : 0);
+#ifdef OS_LINUX
+    ctx->file_handle.direct = STORAGE_CFG.trunk_write.direct_io;
+#endif
+    return 0;
+}
+
+static inline int sync_trunk_data(const int fd)
+{
+    int result;
+
+#ifdef OS_LINUX
+    result = fdatasync(fd);
+#else
+    result = fsync(fd);
+#endif
+    if (result != 0) {
+        return errno != 0 ? errno : EIO;
+    }
+
     return 0;
 }
 
@@ -346,6 +455,12 @@ static int do_create_trunk(TrunkWriteThreadContext *ctx, TrunkWriteIOBuffer *iob
     int fd;
     int result;
 
+    if (ctx->device != NULL) {  //the extent is allocated already
+        return trunk_binlog_write(FS_IO_TYPE_CREATE_TRUNK,
+                iob->space.store->index, &iob->space.id_info,
+                iob->space.size);
+    }
+
     get_trunk_filename(&iob->space, trunk_filename, sizeof(trunk_filename));
     fd = open(trunk_filename, O_WRONLY | O_CREAT, 0644);
     if (fd < 0) {
@@ -378,6 +493,17 @@ static int do_create_trunk(TrunkWriteThreadContext *ctx, TrunkWriteIOBuffer *iob
     }
 
     if (fc_fallocate(fd, iob->space.size) == 0) {
+        if (STORAGE_CFG.trunk_write.durability !=
+                FS_WRITE_DURABILITY_NONE_INT && fsync(fd) != 0)
+        {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "fsync file \"%s\" fail, errno: %d, error info: %s",
+                    __LINE__, trunk_filename, result, STRERROR(result));
+            close(fd);
+            return result;
+        }
+
         result = trunk_binlog_write(FS_IO_TYPE_CREATE_TRUNK,
                 iob->space.store->index, &iob->space.id_info,
                 iob->space.size);
@@ -397,6 +523,19 @@ static int do_delete_trunk(TrunkWriteThreadContext *ctx, TrunkWriteIOBuffer *iob
     char trunk_filename[PATH_MAX];
     int result;
 
+    if (ctx->device != NULL) {
+        /* write the binlog before free the extent for crash recovery,
+           the extent bitmap is rebuilt by the trunk binlog */
+        if ((result=trunk_binlog_write(FS_IO_TYPE_DELETE_TRUNK,
+                        iob->space.store->index, &iob->space.id_info,
+                        iob->space.size)) != 0)
+        {
+            return result;
+        }
+        return raw_device_free_extent(ctx->device,
+                FS_RAW_DEVICE_EXTENT_INDEX(&iob->space.id_info));
+    }
+
     get_trunk_filename(&iob->space, trunk_filename, sizeof(trunk_filename));
     if (unlink(trunk_filename) == 0) {
         result = trunk_binlog_write(FS_IO_TYPE_DELETE_TRUNK,
@@ -461,14 +600,157 @@ static int write_iovec(TrunkWriteThreadContext *ctx, int fd,
     return 0;
 }
 
+static int write_iovec_array(TrunkWriteThreadContext *ctx,
+        const int fd, int *remain_bytes)
+{
+    struct iovec *iovec;
+    int iovcnt;
+    int remain_count;
+    int result;
+
+    if (ctx->iovec_array.count <= IOV_MAX) {
+        return write_iovec(ctx, fd, ctx->iovec_array.iovs,
+                ctx->iovec_array.count, remain_bytes);
+    }
+
+    result = 0;
+    iovec = ctx->iovec_array.iovs;
+    remain_count = ctx->iovec_array.count;
+    while (remain_count > 0) {
+        iovcnt = (remain_count < IOV_MAX ? remain_count : IOV_MAX);
+        if ((result=write_iovec(ctx, fd, iovec, iovcnt,
+                        remain_bytes)) != 0)
+        {
+            break;
+        }
+
+        remain_count -= iovcnt;
+        iovec += iovcnt;
+    }
+
+    return result;
+}
+
+#ifdef OS_LINUX
+
+#define IS_DIRECT_ALIGNED(ctx, n) \
+    (((int64_t)(n) & ((ctx)->direct.block_size - 1)) == 0)
+
+static bool iob_is_direct_aligned(TrunkWriteThreadContext *ctx,
+        TrunkWriteIOBuffer *iob)
+{
+    struct iovec *iov;
+    struct iovec *end;
+    int64_t total;
+
+    if (iob->type == FS_IO_TYPE_WRITE_SLICE_BY_BUFF) {
+        return (FS_SLICE_DATA_LENGTH(iob->slice) ==
+                iob->slice->space.size) &&
+            IS_DIRECT_ALIGNED(ctx, (long)iob->buff) &&
+            IS_DIRECT_ALIGNED(ctx, iob->slice->space.size);
+    }
+
+    total = 0;
+    end = iob->iovec_array.iovs + iob->iovec_array.count;
+    for (iov=iob->iovec_array.iovs; iov<end; iov++) {
+        if (!(IS_DIRECT_ALIGNED(ctx, (long)iov->iov_base) &&
+                    IS_DIRECT_ALIGNED(ctx, iov->iov_len)))
+        {
+            return false;
+        }
+        total += iov->iov_len;
+    }
+
+    return (total == iob->slice->space.size);
+}
+
+static int set_direct_io_flag(TrunkWriteThreadContext *ctx,
+        const int fd, const bool direct)
+{
+    int flags;
+
+    if (ctx->file_handle.direct == direct) {
+        return 0;
+    }
+
+    if ((flags=fcntl(fd, F_GETFL)) < 0) {
+        return errno != 0 ? errno : EIO;
+    }
+
+    if (direct) {
+        flags |= O_DIRECT;
+    } else {
+        flags &= ~O_DIRECT;
+    }
+    if (fcntl(fd, F_SETFL, flags) < 0) {
+        return errno != 0 ? errno : EIO;
+    }
+
+    ctx->file_handle.direct = direct;
+    return 0;
+}
+
+static void copy_to_direct_buffer(TrunkWriteThreadContext *ctx)
+{
+    TrunkWriteIOBuffer **iob;
+    TrunkWriteIOBuffer **end;
+    struct iovec *iov;
+    struct iovec *iend;
+    char *p;
+    int len;
+
+    p = ctx->direct.buff;
+    end = ctx->iob_array.iobs + ctx->iob_array.count;
+    for (iob=ctx->iob_array.iobs; iob<end; iob++) {
+        if ((*iob)->type == FS_IO_TYPE_WRITE_SLICE_BY_BUFF) {
+            len = FS_SLICE_DATA_LENGTH((*iob)->slice);
+            memcpy(p, (*iob)->buff, len);
+        } else {
+            len = 0;
+            iend = (*iob)->iovec_array.iovs + (*iob)->iovec_array.count;
+            for (iov=(*iob)->iovec_array.iovs; iov<iend; iov++) {
+                memcpy(p + len, iov->iov_base, iov->iov_len);
+                len += iov->iov_len;
+            }
+        }
+
+        if (len < (*iob)->slice->space.size) {
+            memset(p + len, 0, (*iob)->slice->space.size - len);
+        }
+        p += (*iob)->slice->space.size;
+    }
+}
+
+static int write_slices_direct(TrunkWriteThreadContext *ctx, const int fd,
+        const int64_t offset, int *remain_bytes)
+{
+    struct iovec iov;
+    int result;
+
+    /* the space of the old trunk files may be NOT aligned,
+       fallback to buffered write for this case */
+    if ((result=set_direct_io_flag(ctx, fd, IS_DIRECT_ALIGNED(ctx, offset)
+                    && IS_DIRECT_ALIGNED(ctx, ctx->iovec_bytes))) != 0)
+    {
+        return result;
+    }
+
+    if (ctx->direct.zero_copy) {
+        return write_iovec_array(ctx, fd, remain_bytes);
+    }
+
+    copy_to_direct_buffer(ctx);
+    FC_SET_IOVEC(iov, ctx->direct.buff, ctx->iovec_bytes);
+    return write_iovec(ctx, fd, &iov, 1, remain_bytes);
+}
+#endif
+
 static int do_write_slices(TrunkWriteThreadContext *ctx)
 {
     char trunk_filename[PATH_MAX];
     TrunkWriteIOBuffer *first;
-    struct iovec *iovec;
-    int iovcnt;
+    int64_t file_offset;
     int fd;
-    int remain_count;
     int remain_bytes;
     int result;
 
@@ -478,15 +760,16 @@ static int do_write_slices(TrunkWriteThreadContext *ctx)
         return result;
     }
 
-    if (ctx->file_handle.offset != first->slice->space.offset) {
-        if (lseek(fd, first->slice->space.offset, SEEK_SET) < 0) {
+    file_offset = get_file_offset(ctx, &first->slice->space);
+    if (ctx->file_handle.offset != file_offset) {
+        if (lseek(fd, file_offset, SEEK_SET) < 0) {
             get_trunk_filename(&first->slice->space, trunk_filename,
                     sizeof(trunk_filename));
             result = errno != 0 ? errno : EIO;
             logError("file: "__FILE__", line: %d, "
                     "lseek file: %s fail, offset: %"PRId64", "
                     "errno: %d, error info: %s", __LINE__, trunk_filename,
-                    first->slice->space.offset, result, STRERROR(result));
+                    file_offset, result, STRERROR(result));
             clear_write_fd(ctx);
             ctx->iob_array.success = 0;
             return result;
@@ -501,24 +784,16 @@ static int do_write_slices(TrunkWriteThreadContext *ctx)
     }
 
     remain_bytes = ctx->iovec_bytes;
-    if (ctx->iovec_array.count <= IOV_MAX) {
-        result = write_iovec(ctx, fd, ctx->iovec_array.iovs,
-                ctx->iovec_array.count, &remain_bytes);
+#ifdef OS_LINUX
+    if (STORAGE_CFG.trunk_write.direct_io) {
+        result = write_slices_direct(ctx, fd,
+                file_offset, &remain_bytes);
     } else {
-        iovec = ctx->iovec_array.iovs;
-        remain_count = ctx->iovec_array.count;
-        while (remain_count > 0) {
-            iovcnt = (remain_count < IOV_MAX ? remain_count : IOV_MAX);
-            if ((result=write_iovec(ctx, fd, iovec, iovcnt,
-                            &remain_bytes)) != 0)
-            {
-                break;
-            }
-
-            remain_count -= iovcnt;
-            iovec += iovcnt;
-        }
+        result = write_iovec_array(ctx, fd, &remain_bytes);
     }
+#else
+    result = write_iovec_array(ctx, fd, &remain_bytes);
+#endif
 
     if (result != 0) {
         clear_write_fd(ctx);
@@ -528,16 +803,34 @@ static int do_write_slices(TrunkWriteThreadContext *ctx)
         logError("file: "__FILE__", line: %d, "
                 "write to trunk file: %s fail, offset: %"PRId64", "
                 "errno: %d, error info: %s", __LINE__, trunk_filename,
-                first->slice->space.offset + (ctx->iovec_bytes -
-                    remain_bytes), result, STRERROR(result));
+                file_offset + (ctx->iovec_bytes - remain_bytes),
+                result, STRERROR(result));
         ctx->file_handle.offset = -1;
         ctx->iob_array.success = 0;
         return result;
     }
 
+    /* batch sync before the notify for the durability,
+       the caller responds to the client after the notify */
+    if (STORAGE_CFG.trunk_write.durability ==
+            FS_WRITE_DURABILITY_FDATASYNC_INT)
+    {
+        if ((result=sync_trunk_data(fd)) != 0) {
+            clear_write_fd(ctx);
+
+            get_trunk_filename(&first->slice->space, trunk_filename,
+                    sizeof(trunk_filename));
+            logError("file: "__FILE__", line: %d, "
+                    "sync trunk file: %s fail, errno: %d, error info: %s",
+                    __LINE__, trunk_filename, result, STRERROR(result));
+            ctx->file_handle.offset = -1;
+            ctx->iob_array.success = 0;
+            return result;
+        }
+    }
+
     ctx->iob_array.success = ctx->iob_array.count;
-    ctx->file_handle.offset = first->slice->space.offset +
-        ctx->iovec_bytes;
+    ctx->file_handle.offset = file_offset + ctx->iovec_bytes;
     return 0;
 }
 
@@ -557,6 +850,7 @@ static int batch_write(TrunkWriteThreadContext *ctx)
             }
 
             fast_mblock_free_object(&ctx->mblock, *iob);
+            FC_ATOMIC_DEC(trunk_io_ctx.waiting_count);
         }
     }
 
@@ -568,6 +862,7 @@ static int batch_write(TrunkWriteThreadContext *ctx)
             }
 
             fast_mblock_free_object(&ctx->mblock, *iob);
+            FC_ATOMIC_DEC(trunk_io_ctx.waiting_count);
         }
     }
 
@@ -582,6 +877,9 @@ static int batch_write(TrunkWriteThreadContext *ctx)
     ctx->iovec_bytes = 0;
     ctx->iovec_array.count = 0;
     ctx->iob_array.count = 0;
+#ifdef OS_LINUX
+    ctx->direct.zero_copy = true;
+#endif
     return result;
 }
 
@@ -622,6 +920,14 @@ static inline int pop_to_request_skiplist(TrunkWriteThreadContext *ctx,
      (last->slice->space.offset + last->slice->space.size ==  \
       current->slice->space.offset))
 
+#ifdef OS_LINUX
+#define IOB_FIT_DIRECT_BUFFER(ctx, iob)  \
+    (!STORAGE_CFG.trunk_write.direct_io || (ctx->iovec_bytes + \
+        iob->slice->space.size <= IO_THREAD_DIRECT_BUFFER_SIZE))
+#else
+#define IOB_FIT_DIRECT_BUFFER(ctx, iob)  true
+#endif
+
 static void deal_request_skiplist(TrunkWriteThreadContext *ctx)
 {
     TrunkWriteIOBuffer *iob;
@@ -665,7 +971,8 @@ static void deal_request_skiplist(TrunkWriteThreadContext *ctx)
                     if (!(IOB_IS_SUCCESSIVE(last, iob) &&
                                 (ctx->iob_array.count < ctx->iob_array.alloc) &&
                                 (ctx->iovec_array.count < IOV_MAX) &&
-                                (ctx->iovec_bytes < IO_THREAD_BYTES_MAX)))
+                                (ctx->iovec_bytes < IO_THREAD_BYTES_MAX) &&
+                                IOB_FIT_DIRECT_BUFFER(ctx, iob)))
                     {
                         batch_write(ctx);
                         ++io_count;
@@ -713,6 +1020,13 @@ static void deal_request_skiplist(TrunkWriteThreadContext *ctx)
                     ctx->iovec_array.count += iob->iovec_array.count;
                 }
 
+#ifdef OS_LINUX
+                if (STORAGE_CFG.trunk_write.direct_io &&
+                        ctx->direct.zero_copy)
+                {
+                    ctx->direct.zero_copy = iob_is_direct_aligned(ctx, iob);
+                }
+#endif
                 ctx->iob_array.iobs[ctx->iob_array.count++] = iob;
                 ctx->iovec_bytes += iob->slice->space.size;
                 break;
@@ -737,6 +1051,7 @@ static void deal_request_skiplist(TrunkWriteThreadContext *ctx)
                 iob->type == FS_IO_TYPE_DELETE_TRUNK)
         {
             fast_mblock_free_object(&ctx->mblock, iob);
+            FC_ATOMIC_DEC(trunk_io_ctx.waiting_count);
         }
     }
 
@@ -753,6 +1068,7 @@ static void *trunk_write_thread_func(void *arg)
     int count;
 
     ctx = (TrunkWriteThreadContext *)arg;
+    server_numa_bind_thread(PATHS_BY_INDEX_PPTR[ctx->indexes.path]->numa_node);
 #ifdef OS_LINUX
     {
         int len;
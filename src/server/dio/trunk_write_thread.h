@@ -63,6 +63,9 @@ extern "C" {
     int trunk_write_thread_init();
     void trunk_write_thread_terminate();
 
+    /* the IO requests in queue or in progress of all write threads */
+    int trunk_write_thread_get_waiting_count();
+
     int trunk_write_thread_push(const int type, const int64_t version,
             const int path_index, const uint64_t hash_code, void *entry,
             void *data, trunk_write_io_notify_func notify_func,
@@ -0,0 +1,907 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* the microbenchmarks of the server internal data structures and the hot
+ * paths, the modules are linked with the stubbed global config and run
+ * without the network, the storage files and the background threads */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/sched_thread.h"
+#include "sf/sf_global.h"
+#include "common/fs_func.h"
+#include "server_global.h"
+#include "storage/object_block_index.h"
+#include "storage/trunk_allocator.h"
+#include "dio/read_buffer_pool.h"
+#include "binlog/slice_binlog.h"
+#include "binlog/slice_loader.h"
+#include "replication/replication_types.h"
+#include "replication/rpc_result_ring.h"
+
+#define BENCH_MAX_THREADS          256
+#define BENCH_SLICE_ALIGN_SIZE     (4 * 1024)
+#define BENCH_MAX_SLICE_SIZE       (128 * 1024)
+#define BENCH_TRUNK_FILE_SIZE      (256 * 1024 * 1024)
+#define BENCH_RPC_RING_SIZE        2048
+#define BENCH_RPC_INFLIGHT_COUNT   256
+#define BENCH_BINLOG_RECORD_COUNT  (64 * 1024)
+
+#define BENCH_DISTRIBUTION_UNIFORM  'u'
+#define BENCH_DISTRIBUTION_ZIPFIAN  'z'
+
+struct bench_thread;
+
+typedef struct bench_case {
+    const char *name;
+    int (*init)();   //called once before the runs, can be NULL
+    int (*prepare)(struct bench_thread *thread);  //can be NULL
+    int (*run)(struct bench_thread *thread);
+    void (*finish)(struct bench_thread *thread);  //can be NULL
+} BenchCase;
+
+typedef struct bench_thread {
+    int index;
+    int thread_count;
+    uint64_t rand_state;
+    int64_t ops;
+    int64_t time_used_ns;
+    int result;
+    void *arg;   //the private data of the case
+} BenchThread;
+
+typedef struct {
+    int max_threads;
+    int64_t ops_per_thread;
+    int64_t block_count;
+    char distribution;
+    bool text_output;
+    const char *case_names;
+
+    struct {
+        double theta;
+        double alpha;
+        double zetan;
+        double eta;
+    } zipf;
+
+    volatile int ready_count;
+    volatile int running_count;
+    volatile bool start_flag;
+    volatile int64_t next_trunk_id;
+    bool ob_index_populated;
+    bool first_output;
+} BenchContext;
+
+static BenchContext bench_ctx;
+static FSStoragePathInfo bench_path_info;
+static FSStoragePathInfo *bench_paths_by_index[1];
+static FSTrunkAllocator bench_trunk_allocator;
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-t max_threads=4] "
+            "[-n operations per thread=1000000]\n"
+            "\t[-b block_count=65536] [-d distribution=zipfian, "
+            "uniform or zipfian]\n"
+            "\t[-c case names separated by comma, default is all]\n"
+            "\t[-T text output, default is JSON]\n"
+            "\tthe cases: ob_index_add, ob_index_get, trunk_alloc, "
+            "rpc_result_ring,\n\t\tread_buffer_pool, slice_binlog_pack, "
+            "slice_loader_parse\n", argv[0]);
+}
+
+static inline int64_t get_monotonic_time_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline uint64_t next_rand(BenchThread *thread)
+{
+    /* xorshift64* */
+    thread->rand_state ^= thread->rand_state >> 12;
+    thread->rand_state ^= thread->rand_state << 25;
+    thread->rand_state ^= thread->rand_state >> 27;
+    return thread->rand_state * 2685821657736338717ULL;
+}
+
+static inline double next_rand_double(BenchThread *thread)
+{
+    return (next_rand(thread) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void zipf_init()
+{
+    double zeta2;
+    int64_t i;
+
+    bench_ctx.zipf.theta = 0.99;
+    zeta2 = 1.0 + 1.0 / pow(2.0, bench_ctx.zipf.theta);
+    bench_ctx.zipf.zetan = 0.0;
+    for (i=1; i<=bench_ctx.block_count; i++) {
+        bench_ctx.zipf.zetan += 1.0 / pow((double)i, bench_ctx.zipf.theta);
+    }
+    bench_ctx.zipf.alpha = 1.0 / (1.0 - bench_ctx.zipf.theta);
+    bench_ctx.zipf.eta = (1.0 - pow(2.0 / bench_ctx.block_count,
+                1.0 - bench_ctx.zipf.theta)) /
+        (1.0 - zeta2 / bench_ctx.zipf.zetan);
+}
+
+/* the block index of the next operation, the hot blocks of the zipfian
+ * distribution are scattered over the objects */
+static inline int64_t next_block_index(BenchThread *thread)
+{
+    double u;
+    double uz;
+    int64_t rank;
+
+    if (bench_ctx.distribution == BENCH_DISTRIBUTION_UNIFORM) {
+        return next_rand(thread) % bench_ctx.block_count;
+    }
+
+    u = next_rand_double(thread);
+    uz = u * bench_ctx.zipf.zetan;
+    if (uz < 1.0) {
+        rank = 0;
+    } else if (uz < 1.0 + pow(0.5, bench_ctx.zipf.theta)) {
+        rank = 1;
+    } else {
+        rank = (int64_t)(bench_ctx.block_count * pow(bench_ctx.zipf.eta *
+                    u - bench_ctx.zipf.eta + 1.0, bench_ctx.zipf.alpha));
+        if (rank >= bench_ctx.block_count) {
+            rank = bench_ctx.block_count - 1;
+        }
+    }
+
+    return (int64_t)(((uint64_t)rank * 11400714819323198485ULL) %
+            (uint64_t)bench_ctx.block_count);
+}
+
+/* 64 blocks per object as the 256MB files */
+static inline void set_block_key(const int64_t block_index, FSBlockKey *bkey)
+{
+    bkey->oid = 1000000 + block_index / 64;
+    bkey->offset = (block_index % 64) * (int64_t)FS_FILE_BLOCK_SIZE;
+    fs_calc_block_hashcode(bkey);
+}
+
+static inline void set_slice_size(BenchThread *thread, FSSliceSize *ssize)
+{
+    ssize->length = BENCH_SLICE_ALIGN_SIZE * (1 + next_rand(thread) %
+            (BENCH_MAX_SLICE_SIZE / BENCH_SLICE_ALIGN_SIZE));
+    ssize->offset = BENCH_SLICE_ALIGN_SIZE * (next_rand(thread) %
+            ((FS_FILE_BLOCK_SIZE - ssize->length) /
+             BENCH_SLICE_ALIGN_SIZE + 1));
+}
+
+static void set_slice_space(BenchThread *thread, OBSliceEntry *slice)
+{
+    slice->space.store = &bench_path_info.store;
+    slice->space.id_info.id = 1 + next_rand(thread) % 10000;
+    slice->space.id_info.subdir = slice->space.id_info.id / 100 + 1;
+    slice->space.offset = BENCH_SLICE_ALIGN_SIZE * (next_rand(thread) %
+            (BENCH_TRUNK_FILE_SIZE / BENCH_SLICE_ALIGN_SIZE));
+    slice->space.size = slice->ssize.length;
+}
+
+static int ob_index_add_one(BenchThread *thread, const int64_t block_index)
+{
+    FSBlockKey bkey;
+    OBSliceEntry *slice;
+    int inc_alloc;
+    int result;
+
+    set_block_key(block_index, &bkey);
+    if ((slice=ob_index_alloc_slice(&bkey)) == NULL) {
+        return ENOMEM;
+    }
+
+    slice->type = OB_SLICE_TYPE_FILE;
+    set_slice_size(thread, &slice->ssize);
+    set_slice_space(thread, slice);
+    result = ob_index_add_slice(slice, NULL, &inc_alloc, false);
+    ob_index_free_slice(slice);
+    return result;
+}
+
+static int ob_index_bench_init()
+{
+    static bool inited = false;
+
+    if (inited) {
+        return 0;
+    }
+    inited = true;
+    return ob_index_init();
+}
+
+static int ob_index_add_run(BenchThread *thread)
+{
+    int result;
+
+    for (thread->ops=0; thread->ops<bench_ctx.ops_per_thread;
+            thread->ops++)
+    {
+        if ((result=ob_index_add_one(thread,
+                        next_block_index(thread))) != 0)
+        {
+            return result;
+        }
+    }
+
+    bench_ctx.ob_index_populated = true;
+    return 0;
+}
+
+static int ob_index_get_init()
+{
+    BenchThread thread;
+    int64_t block_index;
+    int result;
+    int i;
+
+    if ((result=ob_index_bench_init()) != 0) {
+        return result;
+    }
+
+    if (bench_ctx.ob_index_populated) {
+        return 0;
+    }
+
+    memset(&thread, 0, sizeof(thread));
+    thread.rand_state = 0x9E3779B97F4A7C15ULL;
+    for (block_index=0; block_index<bench_ctx.block_count; block_index++) {
+        for (i=0; i<16; i++) {
+            if ((result=ob_index_add_one(&thread, block_index)) != 0) {
+                return result;
+            }
+        }
+    }
+
+    bench_ctx.ob_index_populated = true;
+    return 0;
+}
+
+static int ob_index_get_prepare(BenchThread *thread)
+{
+    OBSlicePtrArray *sarray;
+
+    sarray = (OBSlicePtrArray *)fc_malloc(sizeof(OBSlicePtrArray));
+    if (sarray == NULL) {
+        return ENOMEM;
+    }
+    ob_index_init_slice_ptr_array(sarray);
+    thread->arg = sarray;
+    return 0;
+}
+
+static int ob_index_get_run(BenchThread *thread)
+{
+    OBSlicePtrArray *sarray;
+    FSBlockSliceKeyInfo bs_key;
+    int64_t i;
+    int result;
+
+    sarray = (OBSlicePtrArray *)thread->arg;
+    for (thread->ops=0; thread->ops<bench_ctx.ops_per_thread;
+            thread->ops++)
+    {
+        set_block_key(next_block_index(thread), &bs_key.block);
+        set_slice_size(thread, &bs_key.slice);
+        result = ob_index_get_slices(&bs_key, sarray, false);
+        if (result == 0) {
+            for (i=0; i<sarray->count; i++) {
+                ob_index_free_slice(sarray->slices[i]);
+            }
+            sarray->count = 0;
+        } else if (result != ENOENT) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static void ob_index_get_finish(BenchThread *thread)
+{
+    ob_index_free_slice_ptr_array((OBSlicePtrArray *)thread->arg);
+    free(thread->arg);
+    thread->arg = NULL;
+}
+
+static int trunk_add_to_freelist()
+{
+    FSTrunkIdInfo id_info;
+    FSTrunkFileInfo *trunk;
+    int result;
+
+    id_info.id = __sync_add_and_fetch(&bench_ctx.next_trunk_id, 1);
+    id_info.subdir = id_info.id / 100 + 1;
+    if ((result=trunk_allocator_add(&bench_trunk_allocator, &id_info,
+                    BENCH_TRUNK_FILE_SIZE, &trunk)) != 0)
+    {
+        return result;
+    }
+
+    trunk_freelist_add(&bench_trunk_allocator.freelist, trunk);
+    return 0;
+}
+
+static int trunk_alloc_init()
+{
+    int result;
+    int i;
+
+    if ((result=trunk_allocator_init()) != 0) {
+        return result;
+    }
+    if ((result=trunk_allocator_init_instance(&bench_trunk_allocator,
+                    &bench_path_info)) != 0)
+    {
+        return result;
+    }
+
+    /* disable the trunk maker, the freelist is refilled by the runs */
+    bench_trunk_allocator.freelist.water_mark_trunks = 0;
+    for (i=0; i<2; i++) {
+        if ((result=trunk_add_to_freelist()) != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int trunk_alloc_run(BenchThread *thread)
+{
+    const bool is_normal = false;
+    FSTrunkSpaceWithVersion spaces[FS_MAX_SPLIT_COUNT_PER_SPACE_ALLOC];
+    FSSliceSize ssize;
+    int count;
+    int result;
+
+    for (thread->ops=0; thread->ops<bench_ctx.ops_per_thread;
+            thread->ops++)
+    {
+        set_slice_size(thread, &ssize);
+        while ((result=trunk_freelist_alloc_space(&bench_trunk_allocator,
+                        &bench_trunk_allocator.freelist, next_rand(thread),
+                        ssize.length, spaces, &count, is_normal)) == EAGAIN)
+        {
+            if ((result=trunk_add_to_freelist()) != 0) {
+                return result;
+            }
+        }
+
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+typedef struct {
+    FSReplicaRPCResultContext ctx;
+    ReplicationRPCEntry rpc;
+} RPCResultRingBenchArg;
+
+static int rpc_result_ring_prepare(BenchThread *thread)
+{
+    RPCResultRingBenchArg *arg;
+    int result;
+
+    arg = (RPCResultRingBenchArg *)fc_malloc(sizeof(RPCResultRingBenchArg));
+    if (arg == NULL) {
+        return ENOMEM;
+    }
+    memset(arg, 0, sizeof(RPCResultRingBenchArg));
+
+    /* the base reference prevents the rpc entry from being freed,
+     * and the decided result prevents the data thread from being notified */
+    arg->rpc.reffer_count = 1;
+    arg->rpc.decided = 1;
+    arg->rpc.data_group_id = 1;
+    thread->arg = arg;
+    if ((result=rpc_result_ring_init_ex(&arg->ctx, 1, 1,
+                    BENCH_RPC_RING_SIZE)) != 0)
+    {
+        return result;
+    }
+
+    return 0;
+}
+
+static int rpc_result_ring_run(BenchThread *thread)
+{
+    RPCResultRingBenchArg *arg;
+    uint64_t data_version;
+    int result;
+
+    arg = (RPCResultRingBenchArg *)thread->arg;
+    data_version = 0;
+    for (thread->ops=0; thread->ops<bench_ctx.ops_per_thread;
+            thread->ops++)
+    {
+        ++data_version;
+        __sync_add_and_fetch(&arg->rpc.reffer_count, 1);
+        if ((result=rpc_result_ring_add(&arg->ctx, 1,
+                        data_version, &arg->rpc)) != 0)
+        {
+            return result;
+        }
+
+        /* the push results come back after the inflight window */
+        if (data_version > BENCH_RPC_INFLIGHT_COUNT) {
+            if ((result=rpc_result_ring_remove(&arg->ctx, 1, data_version -
+                            BENCH_RPC_INFLIGHT_COUNT)) != 0)
+            {
+                return result;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void rpc_result_ring_finish(BenchThread *thread)
+{
+    RPCResultRingBenchArg *arg;
+
+    arg = (RPCResultRingBenchArg *)thread->arg;
+    rpc_result_ring_clear_all(&arg->ctx);
+    rpc_result_ring_destroy(&arg->ctx);
+    free(arg);
+    thread->arg = NULL;
+}
+
+#ifdef OS_LINUX
+static int read_buffer_pool_bench_init()
+{
+    SFMemoryWatermark watermark;
+    int result;
+
+    watermark.low = 256 * 1024 * 1024;
+    watermark.high = 1024 * 1024 * 1024;
+    if ((result=read_buffer_pool_init(1, &watermark)) != 0) {
+        return result;
+    }
+
+    return read_buffer_pool_create(bench_path_info.store.index,
+            bench_path_info.block_size);
+}
+
+static int read_buffer_pool_run(BenchThread *thread)
+{
+    AlignedReadBuffer *buffer;
+    FSSliceSize ssize;
+
+    for (thread->ops=0; thread->ops<bench_ctx.ops_per_thread;
+            thread->ops++)
+    {
+        set_slice_size(thread, &ssize);
+        if ((buffer=read_buffer_pool_alloc(bench_path_info.store.index,
+                        ssize.length)) == NULL)
+        {
+            return ENOMEM;
+        }
+        read_buffer_pool_free(buffer);
+    }
+
+    return 0;
+}
+#endif
+
+typedef struct {
+    OBEntry ob;
+    OBSliceEntry slice;
+    BufferInfo buffer;
+} SliceBinlogBenchArg;
+
+static int slice_binlog_prepare(BenchThread *thread)
+{
+    SliceBinlogBenchArg *arg;
+    OBSliceEntry *slice;
+    int64_t i;
+
+    arg = (SliceBinlogBenchArg *)fc_malloc(sizeof(SliceBinlogBenchArg));
+    if (arg == NULL) {
+        return ENOMEM;
+    }
+    memset(arg, 0, sizeof(SliceBinlogBenchArg));
+    thread->arg = arg;
+
+    arg->buffer.alloc_size = BENCH_BINLOG_RECORD_COUNT *
+        FS_SLICE_BINLOG_MAX_RECORD_SIZE;
+    arg->buffer.buff = (char *)fc_malloc(arg->buffer.alloc_size);
+    if (arg->buffer.buff == NULL) {
+        return ENOMEM;
+    }
+
+    slice = &arg->slice;
+    slice->ob = &arg->ob;
+    slice->type = OB_SLICE_TYPE_FILE;
+    slice->compress.type = FS_COMPRESS_TYPE_NONE;
+
+    /* the records for parsing, a quarter of them with the checksum */
+    for (i=0; i<BENCH_BINLOG_RECORD_COUNT; i++) {
+        set_block_key(next_block_index(thread), &arg->ob.bkey);
+        set_slice_size(thread, &slice->ssize);
+        set_slice_space(thread, slice);
+        slice->checksum.valid = (i % 4 == 0);
+        slice->checksum.crc32c = next_rand(thread);
+        arg->buffer.length += slice_binlog_pack_add_slice(slice,
+                g_current_time, i + 1, BINLOG_SOURCE_RPC_MASTER,
+                arg->buffer.buff + arg->buffer.length);
+    }
+
+    return 0;
+}
+
+static int slice_binlog_pack_run(BenchThread *thread)
+{
+    SliceBinlogBenchArg *arg;
+    OBSliceEntry *slice;
+    char buff[FS_SLICE_BINLOG_MAX_RECORD_SIZE];
+
+    arg = (SliceBinlogBenchArg *)thread->arg;
+    slice = &arg->slice;
+    for (thread->ops=0; thread->ops<bench_ctx.ops_per_thread;
+            thread->ops++)
+    {
+        set_block_key(next_block_index(thread), &arg->ob.bkey);
+        set_slice_size(thread, &slice->ssize);
+        slice->space.offset += slice->ssize.length;
+        slice->space.size = slice->ssize.length;
+        slice->checksum.valid = (thread->ops % 4 == 0);
+        slice_binlog_pack_add_slice(slice, g_current_time,
+                thread->ops + 1, BINLOG_SOURCE_RPC_MASTER, buff);
+    }
+
+    return 0;
+}
+
+static int slice_loader_parse_run(BenchThread *thread)
+{
+    SliceBinlogBenchArg *arg;
+    BinlogReadThreadResult r;
+    int64_t record_count;
+    int result;
+
+    arg = (SliceBinlogBenchArg *)thread->arg;
+    memset(&r, 0, sizeof(r));
+    r.buffer = arg->buffer;
+    thread->ops = 0;
+    while (thread->ops < bench_ctx.ops_per_thread) {
+        if ((result=slice_loader_parse_buffer(&r, &record_count)) != 0) {
+            return result;
+        }
+        thread->ops += record_count;
+    }
+
+    return 0;
+}
+
+static void slice_binlog_finish(BenchThread *thread)
+{
+    SliceBinlogBenchArg *arg;
+
+    arg = (SliceBinlogBenchArg *)thread->arg;
+    if (arg->buffer.buff != NULL) {
+        free(arg->buffer.buff);
+    }
+    free(arg);
+    thread->arg = NULL;
+}
+
+static BenchCase bench_cases[] = {
+    {"ob_index_add", ob_index_bench_init, NULL, ob_index_add_run, NULL},
+    {"ob_index_get", ob_index_get_init, ob_index_get_prepare,
+        ob_index_get_run, ob_index_get_finish},
+    {"trunk_alloc", trunk_alloc_init, NULL, trunk_alloc_run, NULL},
+    {"rpc_result_ring", NULL, rpc_result_ring_prepare,
+        rpc_result_ring_run, rpc_result_ring_finish},
+#ifdef OS_LINUX
+    {"read_buffer_pool", read_buffer_pool_bench_init, NULL,
+        read_buffer_pool_run, NULL},
+#endif
+    {"slice_binlog_pack", NULL, slice_binlog_prepare,
+        slice_binlog_pack_run, slice_binlog_finish},
+    {"slice_loader_parse", NULL, slice_binlog_prepare,
+        slice_loader_parse_run, slice_binlog_finish}
+};
+
+static void *bench_thread_func(void *arg)
+{
+    BenchThread *thread;
+    BenchCase *bcase;
+    int64_t start_time;
+
+    thread = (BenchThread *)arg;
+    bcase = (BenchCase *)thread->arg;
+    thread->arg = NULL;
+    if (bcase->prepare != NULL) {
+        thread->result = bcase->prepare(thread);
+    }
+
+    __sync_add_and_fetch(&bench_ctx.ready_count, 1);
+    while (!bench_ctx.start_flag) {
+        fc_sleep_ms(1);
+    }
+
+    if (thread->result == 0) {
+        start_time = get_monotonic_time_ns();
+        thread->result = bcase->run(thread);
+        thread->time_used_ns = get_monotonic_time_ns() - start_time;
+    }
+
+    if (bcase->finish != NULL && thread->arg != NULL) {
+        bcase->finish(thread);
+    }
+    __sync_sub_and_fetch(&bench_ctx.running_count, 1);
+    return NULL;
+}
+
+static void output_result(BenchCase *bcase, const int thread_count,
+        const int64_t total_ops, const int64_t elapsed_ns)
+{
+    double ops_per_second;
+    double ns_per_op;
+
+    ops_per_second = total_ops * 1000000000.0 / elapsed_ns;
+    ns_per_op = (double)elapsed_ns * thread_count / total_ops;
+    if (bench_ctx.text_output) {
+        printf("%-20s threads: %3d, ops: %"PRId64", ops/s: %.0f, "
+                "ns/op: %.1f\n", bcase->name, thread_count,
+                total_ops, ops_per_second, ns_per_op);
+    } else {
+        printf("%s    {\"case\": \"%s\", \"threads\": %d, "
+                "\"ops\": %"PRId64", \"ops_per_second\": %.0f, "
+                "\"ns_per_op\": %.1f}", bench_ctx.first_output ? "" : ",\n",
+                bcase->name, thread_count, total_ops,
+                ops_per_second, ns_per_op);
+        bench_ctx.first_output = false;
+    }
+    fflush(stdout);
+}
+
+static int run_case(BenchCase *bcase, const int thread_count)
+{
+    BenchThread threads[BENCH_MAX_THREADS];
+    BenchThread *thread;
+    BenchThread *end;
+    pthread_t tid;
+    int64_t total_ops;
+    int64_t elapsed_ns;
+    int result;
+
+    memset(threads, 0, sizeof(BenchThread) * thread_count);
+    bench_ctx.ready_count = 0;
+    bench_ctx.running_count = 0;
+    bench_ctx.start_flag = false;
+    result = 0;
+    end = threads + thread_count;
+    for (thread=threads; thread<end; thread++) {
+        thread->index = thread - threads;
+        thread->thread_count = thread_count;
+        thread->rand_state = (get_monotonic_time_ns() + thread->index) *
+            0x9E3779B97F4A7C15ULL | 1;
+        thread->arg = bcase;
+        __sync_add_and_fetch(&bench_ctx.running_count, 1);
+        if ((result=fc_create_thread(&tid, bench_thread_func,
+                        thread, 256 * 1024)) != 0)
+        {
+            __sync_sub_and_fetch(&bench_ctx.running_count, 1);
+            end = thread;
+            break;
+        }
+    }
+
+    while (__sync_add_and_fetch(&bench_ctx.ready_count, 0) <
+            (int)(end - threads))
+    {
+        fc_sleep_ms(1);
+    }
+    bench_ctx.start_flag = true;
+    while (__sync_add_and_fetch(&bench_ctx.running_count, 0) > 0) {
+        fc_sleep_ms(1);
+    }
+
+    if (result != 0) {
+        return result;
+    }
+
+    total_ops = 0;
+    elapsed_ns = 1;
+    for (thread=threads; thread<end; thread++) {
+        if (thread->result != 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "case: %s, thread #%d fail, errno: %d, "
+                    "error info: %s", __LINE__, bcase->name,
+                    thread->index, thread->result,
+                    STRERROR(thread->result));
+            return thread->result;
+        }
+
+        total_ops += thread->ops;
+        if (thread->time_used_ns > elapsed_ns) {
+            elapsed_ns = thread->time_used_ns;
+        }
+    }
+
+    output_result(bcase, thread_count, total_ops, elapsed_ns);
+    return 0;
+}
+
+static bool case_selected(BenchCase *bcase)
+{
+    char names[1024];
+    char *parts[64];
+    int count;
+    int i;
+
+    if (bench_ctx.case_names == NULL) {
+        return true;
+    }
+
+    snprintf(names, sizeof(names), "%s", bench_ctx.case_names);
+    count = splitEx(names, ',', parts, 64);
+    for (i=0; i<count; i++) {
+        if (strcmp(fc_trim(parts[i]), bcase->name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void setup_stub_globals()
+{
+    /* one store path without the trunk files */
+    bench_path_info.store.index = 0;
+    FC_SET_STRING(bench_path_info.store.path, "/tmp/fs_server_bench");
+#ifdef OS_LINUX
+    bench_path_info.block_size = 4096;
+#endif
+    bench_paths_by_index[0] = &bench_path_info;
+    STORAGE_CFG.paths_by_index.paths = bench_paths_by_index;
+    STORAGE_CFG.paths_by_index.count = 1;
+    STORAGE_CFG.max_store_path_index = 0;
+
+    STORAGE_CFG.trunk_file_size = BENCH_TRUNK_FILE_SIZE;
+    STORAGE_CFG.discard_remain_space_size = 4096;
+    STORAGE_CFG.trunk_write.direct_io = false;
+    STORAGE_CFG.space_discard.enabled = false;
+    STORAGE_CFG.object_block.shared_lock_count = 1361;
+    STORAGE_CFG.object_block.shared_allocator_count = 79;
+    STORAGE_CFG.object_block.hashtable_capacity = bench_ctx.block_count * 2;
+
+    g_current_time = time(NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchCase *bcase;
+    BenchCase *end;
+    int thread_count;
+    int ch;
+    int result;
+
+    bench_ctx.max_threads = 4;
+    bench_ctx.ops_per_thread = 1000000;
+    bench_ctx.block_count = 65536;
+    bench_ctx.distribution = BENCH_DISTRIBUTION_ZIPFIAN;
+    bench_ctx.first_output = true;
+    while ((ch=getopt(argc, argv, "ht:n:b:d:c:T")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 't':
+                bench_ctx.max_threads = strtol(optarg, NULL, 10);
+                break;
+            case 'n':
+                bench_ctx.ops_per_thread = strtoll(optarg, NULL, 10);
+                break;
+            case 'b':
+                bench_ctx.block_count = strtoll(optarg, NULL, 10);
+                break;
+            case 'd':
+                if (strcmp(optarg, "uniform") == 0) {
+                    bench_ctx.distribution = BENCH_DISTRIBUTION_UNIFORM;
+                } else if (strcmp(optarg, "zipfian") == 0) {
+                    bench_ctx.distribution = BENCH_DISTRIBUTION_ZIPFIAN;
+                } else {
+                    fprintf(stderr, "invalid distribution: %s\n", optarg);
+                    return EINVAL;
+                }
+                break;
+            case 'c':
+                bench_ctx.case_names = optarg;
+                break;
+            case 'T':
+                bench_ctx.text_output = true;
+                break;
+            default:
+                usage(argv);
+                return EINVAL;
+        }
+    }
+
+    if (bench_ctx.max_threads <= 0 || bench_ctx.max_threads >
+            BENCH_MAX_THREADS || bench_ctx.ops_per_thread <= 0 ||
+            bench_ctx.block_count <= 1)
+    {
+        fprintf(stderr, "invalid parameters\n");
+        usage(argv);
+        return EINVAL;
+    }
+
+    log_init();
+    setup_stub_globals();
+    if (bench_ctx.distribution == BENCH_DISTRIBUTION_ZIPFIAN) {
+        zipf_init();
+    }
+
+    if (!bench_ctx.text_output) {
+        printf("{\"distribution\": \"%s\", \"block_count\": %"PRId64", "
+                "\"ops_per_thread\": %"PRId64", \"results\": [\n",
+                bench_ctx.distribution == BENCH_DISTRIBUTION_UNIFORM ?
+                "uniform" : "zipfian", bench_ctx.block_count,
+                bench_ctx.ops_per_thread);
+    }
+
+    result = 0;
+    end = bench_cases + sizeof(bench_cases) / sizeof(BenchCase);
+    for (bcase=bench_cases; bcase<end && result == 0; bcase++) {
+        if (!case_selected(bcase)) {
+            continue;
+        }
+
+        if (bcase->init != NULL && (result=bcase->init()) != 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "init case: %s fail, errno: %d, error info: %s",
+                    __LINE__, bcase->name, result, STRERROR(result));
+            break;
+        }
+
+        /* 1, 2, 4 ... and the max threads */
+        thread_count = 1;
+        while (result == 0) {
+            result = run_case(bcase, thread_count);
+            if (thread_count == bench_ctx.max_threads) {
+                break;
+            }
+            thread_count = FC_MIN(thread_count * 2, bench_ctx.max_threads);
+        }
+    }
+
+    if (!bench_ctx.text_output) {
+        printf("\n]}\n");
+    }
+    return result;
+}
@@ -51,11 +51,18 @@
 #include "cluster_relationship.h"
 #include "cluster_topology.h"
 #include "data_thread.h"
+#include "server_qos.h"
+#include "slave_read_waiter.h"
+#include "background_throttle.h"
+#include "latency_stat.h"
+#include "metrics_exporter.h"
 #include "server_storage.h"
 #include "server_binlog.h"
+#include "binlog/binlog_retention.h"
 #include "server_replication.h"
 #include "server_recovery.h"
 #include "storage/slice_op.h"
+#include "storage/slice_scrubber.h"
 #include "dio/trunk_write_thread.h"
 #include "dio/trunk_read_thread.h"
 #include "shared_thread_pool.h"
@@ -73,6 +80,8 @@ static int init_nio_task(struct fast_task_info *task)
 
     task->connect_timeout = SF_G_CONNECT_TIMEOUT;
     task->network_timeout = SF_G_NETWORK_TIMEOUT;
+    ((FSServerTaskArg *)task->arg)->context.slice_op_ctx.qos.inflight = false;
+    ((FSServerTaskArg *)task->arg)->context.slice_op_ctx.start_time_us = 0;
     slice_sn_parray = &((FSServerTaskArg *)task->arg)->
         context.slice_op_ctx.update.sarray;
     return fs_init_slice_op_ctx(slice_sn_parray);
@@ -239,6 +248,10 @@ int main(int argc, char *argv[])
             break;
         }
 
+        if ((result=latency_stat_init()) != 0) {
+            break;
+        }
+
         if ((result=trunk_write_thread_init()) != 0) {
             break;
         }
@@ -251,6 +264,18 @@ int main(int argc, char *argv[])
             break;
         }
 
+        if ((result=server_qos_init()) != 0) {
+            break;
+        }
+
+        if ((result=slave_read_waiter_init()) != 0) {
+            break;
+        }
+
+        if ((result=background_throttle_init()) != 0) {
+            break;
+        }
+
         if ((result=cluster_relationship_init()) != 0) {
             break;
         }
@@ -296,6 +321,18 @@ int main(int argc, char *argv[])
             return result;
         }
 
+        if ((result=slice_scrubber_init()) != 0) {
+            break;
+        }
+
+        if ((result=metrics_exporter_init()) != 0) {
+            break;
+        }
+
+        if ((result=binlog_retention_init()) != 0) {
+            break;
+        }
+
         if ((result=fcfs_auth_for_server_start(&AUTH_CTX)) != 0) {
             break;
         }
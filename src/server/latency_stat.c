@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "latency_stat.h"
+
+typedef struct fs_latency_shard {
+    FSLatencyHistogram histograms[FS_LATENCY_STAGE_COUNT][FS_LATENCY_OP_COUNT];
+    struct fs_latency_shard *next;
+} FSLatencyShard;
+
+typedef struct {
+    pthread_mutex_t lock;  //for the shard list
+    FSLatencyShard *head;
+} LatencyStatContext;
+
+static LatencyStatContext latency_ctx;
+
+/* the shard is written by the owner thread only without lock,
+ * and kept after the thread exit for the history stat */
+static __thread FSLatencyShard *thread_shard = NULL;
+
+static inline int latency_bucket_index(const int64_t value)
+{
+    int msb;
+    int shift;
+
+    if (value < 2 * LATENCY_SUB_BUCKET_COUNT) {
+        return value;
+    }
+
+    msb = 63 - __builtin_clzll(value);
+    if (msb > LATENCY_MAX_MSB) {
+        return LATENCY_BUCKET_COUNT - 1;
+    }
+
+    shift = msb - LATENCY_SUB_BUCKET_BITS;
+    return (shift << LATENCY_SUB_BUCKET_BITS) + (int)(value >> shift);
+}
+
+static inline int64_t latency_bucket_upper_bound(const int index)
+{
+    int shift;
+
+    if (index < 2 * LATENCY_SUB_BUCKET_COUNT) {
+        return index;
+    }
+
+    shift = (index >> LATENCY_SUB_BUCKET_BITS) - 1;
+    return ((int64_t)((index & (LATENCY_SUB_BUCKET_COUNT - 1)) +
+                LATENCY_SUB_BUCKET_COUNT + 1) << shift) - 1;
+}
+
+static FSLatencyShard *alloc_shard()
+{
+    FSLatencyShard *shard;
+
+    shard = (FSLatencyShard *)fc_malloc(sizeof(FSLatencyShard));
+    if (shard == NULL) {
+        return NULL;
+    }
+    memset(shard, 0, sizeof(FSLatencyShard));
+
+    PTHREAD_MUTEX_LOCK(&latency_ctx.lock);
+    shard->next = latency_ctx.head;
+    latency_ctx.head = shard;
+    PTHREAD_MUTEX_UNLOCK(&latency_ctx.lock);
+    return shard;
+}
+
+int latency_stat_init()
+{
+    return init_pthread_lock(&latency_ctx.lock);
+}
+
+void latency_stat_add(const int stage, const int op_type,
+        const int64_t time_used)
+{
+    FSLatencyHistogram *hist;
+    int64_t value;
+
+    if (thread_shard == NULL) {
+        if ((thread_shard=alloc_shard()) == NULL) {
+            return;
+        }
+    }
+
+    value = (time_used > 0) ? time_used : 0;  //maybe the clock changed
+    hist = &thread_shard->histograms[stage][op_type];
+    hist->buckets[latency_bucket_index(value)]++;
+    hist->sum += value;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    hist->count++;
+}
+
+void latency_stat_merge(const int stage, const int op_type,
+        FSLatencyHistogram *hist)
+{
+    FSLatencyShard *shard;
+    FSLatencyHistogram *src;
+    int i;
+
+    memset(hist, 0, sizeof(FSLatencyHistogram));
+    PTHREAD_MUTEX_LOCK(&latency_ctx.lock);
+    shard = latency_ctx.head;
+    PTHREAD_MUTEX_UNLOCK(&latency_ctx.lock);
+
+    /* the new shard is inserted at the head, so the list
+     * after the head is immutable */
+    while (shard != NULL) {
+        src = &shard->histograms[stage][op_type];
+        if (src->count > 0) {
+            hist->count += src->count;
+            hist->sum += src->sum;
+            if (src->max > hist->max) {
+                hist->max = src->max;
+            }
+            for (i=0; i<LATENCY_BUCKET_COUNT; i++) {
+                hist->buckets[i] += src->buckets[i];
+            }
+        }
+        shard = shard->next;
+    }
+}
+
+int64_t latency_stat_percentile(const FSLatencyHistogram *hist,
+        const double percentile)
+{
+    int64_t total;
+    int64_t target;
+    int64_t upper;
+    int i;
+
+    /* the count maybe inconsistent with the buckets
+     * because the shards are merged without lock */
+    total = 0;
+    for (i=0; i<LATENCY_BUCKET_COUNT; i++) {
+        total += hist->buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    target = (int64_t)(total * percentile);
+    if (target < 1) {
+        target = 1;
+    }
+    for (i=0; i<LATENCY_BUCKET_COUNT - 1; i++) {
+        if ((target -= hist->buckets[i]) <= 0) {
+            break;
+        }
+    }
+
+    upper = latency_bucket_upper_bound(i);
+    return FC_MIN(upper, hist->max);
+}
+
+static inline int latency_to_int(const int64_t value)
+{
+    return (int)FC_MIN(value, INT_MAX);
+}
+
+int latency_stat_get(FSLatencyStatEntry *entries,
+        const int size, int *count)
+{
+    FSLatencyHistogram hist;
+    FSLatencyStatEntry *entry;
+    int stage;
+    int op_type;
+
+    *count = 0;
+    for (stage=0; stage<FS_LATENCY_STAGE_COUNT; stage++) {
+        for (op_type=0; op_type<FS_LATENCY_OP_COUNT; op_type++) {
+            latency_stat_merge(stage, op_type, &hist);
+            if (hist.count == 0) {
+                continue;
+            }
+
+            if (*count >= size) {
+                return ENOSPC;
+            }
+
+            entry = entries + (*count)++;
+            entry->stage = stage;
+            entry->op_type = op_type;
+            entry->count = hist.count;
+            entry->avg = latency_to_int(hist.sum / hist.count);
+            entry->max = latency_to_int(hist.max);
+            entry->p50 = latency_to_int(latency_stat_percentile(&hist, 0.50));
+            entry->p90 = latency_to_int(latency_stat_percentile(&hist, 0.90));
+            entry->p99 = latency_to_int(latency_stat_percentile(&hist, 0.99));
+            entry->p999 = latency_to_int(latency_stat_percentile(
+                        &hist, 0.999));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//latency_stat.h
+
+#ifndef _LATENCY_STAT_H_
+#define _LATENCY_STAT_H_
+
+#include "fastcommon/common_define.h"
+#include "fastcommon/shared_func.h"
+#include "common/fs_types.h"
+#include "data_thread.h"
+
+/* HDR style log-linear buckets: the values less than 2 * SUB_BUCKET_COUNT
+ * are exact, then each power of two range is split into SUB_BUCKET_COUNT
+ * buckets, so the relative error is less than 1 / SUB_BUCKET_COUNT */
+#define LATENCY_SUB_BUCKET_BITS   4
+#define LATENCY_SUB_BUCKET_COUNT  (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_MSB          31  //the max latency about 35 minutes
+#define LATENCY_BUCKET_COUNT  ((LATENCY_MAX_MSB - LATENCY_SUB_BUCKET_BITS \
+            + 2) * LATENCY_SUB_BUCKET_COUNT)
+
+typedef struct fs_latency_histogram {
+    int64_t count;
+    int64_t sum;  //for average
+    int64_t max;
+    int64_t buckets[LATENCY_BUCKET_COUNT];
+} FSLatencyHistogram;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int latency_stat_init();
+
+    /* record the latency in microseconds to the shard of current thread */
+    void latency_stat_add(const int stage, const int op_type,
+            const int64_t time_used);
+
+    static inline void latency_stat_add_since(const int stage,
+            const int op_type, const int64_t start_time_us)
+    {
+        latency_stat_add(stage, op_type,
+                get_current_time_us() - start_time_us);
+    }
+
+    static inline int latency_stat_op_type(const int operation)
+    {
+        switch (operation) {
+            case DATA_OPERATION_SLICE_READ:
+                return FS_LATENCY_OP_READ;
+            case DATA_OPERATION_SLICE_ALLOCATE:
+                return FS_LATENCY_OP_ALLOCATE;
+            case DATA_OPERATION_SLICE_DELETE:
+            case DATA_OPERATION_BLOCK_DELETE:
+                return FS_LATENCY_OP_DELETE;
+            default:  //slice write and block clone
+                return FS_LATENCY_OP_WRITE;
+        }
+    }
+
+    /* merge the histograms of all thread shards */
+    void latency_stat_merge(const int stage, const int op_type,
+            FSLatencyHistogram *hist);
+
+    /* return the upper bound of the bucket which the percentile falls in */
+    int64_t latency_stat_percentile(const FSLatencyHistogram *hist,
+            const double percentile);
+
+    /* get the summary of the non-empty histograms */
+    int latency_stat_get(FSLatencyStatEntry *entries,
+            const int size, int *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
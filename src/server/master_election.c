@@ -276,6 +276,20 @@ static FSClusterDataServerInfo *select_master(FSClusterDataGroupInfo *group,
         return NULL;
     }
 
+    /* the writes are acknowledged by the quorum of the data servers,
+     * the reported servers must intersect with any quorum to hold them */
+    if (active_count < group->data_server_array.count -
+            group->write_ack.quorum + 1)
+    {
+        if (MASTER_ELECTION_POLICY == FS_MASTER_ELECTION_POLICY_STRICT_INT ||
+                g_current_time - election_start_time <
+                MASTER_ELECTION_TIMEOUTS)
+        {
+            *result = EAGAIN;
+            return NULL;
+        }
+    }
+
     if (group->ds_ptr_array.count > 1) {
         qsort(group->ds_ptr_array.servers,
                 group->ds_ptr_array.count,
@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#ifdef OS_LINUX
+#include <sys/syscall.h>
+#endif
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fastcommon/fast_buffer.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fc_atomic.h"
+#include "sf/sf_global.h"
+#include "common/fs_func.h"
+#include "binlog/slice_binlog.h"
+#include "binlog/replica_binlog.h"
+#include "storage/storage_allocator.h"
+#include "storage/trunk_maker.h"
+#include "dio/read_buffer_pool.h"
+#include "dio/trunk_read_thread.h"
+#include "dio/trunk_write_thread.h"
+#include "server_global.h"
+#include "data_thread.h"
+#include "background_throttle.h"
+#include "latency_stat.h"
+#include "metrics_exporter.h"
+
+#define METRICS_REQUEST_MAX_SIZE   4096
+#define METRICS_NETWORK_TIMEOUT       5  //in seconds
+#define METRICS_CONTENT_TYPE  "text/plain; version=0.0.4; charset=utf-8"
+
+typedef struct {
+    bool enabled;
+    char bind_addr[IP_ADDRESS_SIZE];
+    int port;
+    int sock;
+    FastBuffer buffer;  //for the response body
+} MetricsExporterContext;
+
+static MetricsExporterContext metrics_ctx;
+
+int metrics_exporter_load_config(IniContext *ini_context,
+        const char *filename)
+{
+    IniFullContext ini_ctx;
+    char *bind_addr;
+
+    FAST_INI_SET_FULL_CTX_EX(ini_ctx, filename, "metrics", ini_context);
+    metrics_ctx.enabled = iniGetBoolValue(ini_ctx.section_name,
+            "enabled", ini_context, false);
+    bind_addr = iniGetStrValue(ini_ctx.section_name,
+            "bind_addr", ini_context);
+    snprintf(metrics_ctx.bind_addr, sizeof(metrics_ctx.bind_addr),
+            "%s", (bind_addr != NULL ? bind_addr : ""));
+    metrics_ctx.port = iniGetIntCorrectValue(&ini_ctx, "port",
+            FS_SERVER_DEFAULT_METRICS_PORT, 1, 65535);
+    return 0;
+}
+
+void metrics_exporter_config_to_log()
+{
+    logInfo("metrics {enabled: %d, bind_addr: %s, port: %d}",
+            metrics_ctx.enabled, metrics_ctx.bind_addr, metrics_ctx.port);
+}
+
+static inline void append_metric_header(FastBuffer *buffer,
+        const char *name, const char *type, const char *help)
+{
+    fast_buffer_append(buffer, "# HELP %s %s\n# TYPE %s %s\n",
+            name, help, name, type);
+}
+
+static void collect_data_thread_metrics(FastBuffer *buffer)
+{
+    const char *roles[2] = {"master", "slave"};
+    FSDataThreadStat stats[2];
+    int i;
+
+    data_thread_stat(stats + 0, stats + 1);
+
+    append_metric_header(buffer, "faststore_data_thread_queue_depth",
+            "gauge", "The operations waiting in the data thread queues.");
+    for (i=0; i<2; i++) {
+        fast_buffer_append(buffer, "faststore_data_thread_queue_depth"
+                "{role=\"%s\"} %d\n", roles[i], stats[i].waiting_count);
+    }
+
+    append_metric_header(buffer, "faststore_data_thread_max_queue_depth",
+            "gauge", "The max waiting operations of the data threads.");
+    for (i=0; i<2; i++) {
+        fast_buffer_append(buffer, "faststore_data_thread_max_queue_depth"
+                "{role=\"%s\"} %d\n", roles[i], stats[i].max_waiting_count);
+    }
+
+    append_metric_header(buffer, "faststore_data_thread_busy",
+            "gauge", "The data threads dealing operations.");
+    for (i=0; i<2; i++) {
+        fast_buffer_append(buffer, "faststore_data_thread_busy"
+                "{role=\"%s\"} %d\n", roles[i], stats[i].busy_count);
+    }
+
+    append_metric_header(buffer, "faststore_data_thread_done_total",
+            "counter", "The operations dealt by the data threads.");
+    for (i=0; i<2; i++) {
+        fast_buffer_append(buffer, "faststore_data_thread_done_total"
+                "{role=\"%s\"} %"PRId64"\n", roles[i], stats[i].done_count);
+    }
+}
+
+static void collect_trunk_io_metrics(FastBuffer *buffer)
+{
+    append_metric_header(buffer, "faststore_trunk_read_queue_depth",
+            "gauge", "The IO requests in queue of the trunk read threads.");
+    fast_buffer_append(buffer, "faststore_trunk_read_queue_depth %d\n",
+            trunk_read_thread_get_waiting_count());
+
+    append_metric_header(buffer, "faststore_trunk_write_queue_depth",
+            "gauge", "The IO requests in queue of the trunk write threads.");
+    fast_buffer_append(buffer, "faststore_trunk_write_queue_depth %d\n",
+            trunk_write_thread_get_waiting_count());
+}
+
+#define STORE_PATH_LABELS_FORMAT  "{path_index=\"%d\",path=\"%s\"}"
+
+static void collect_store_path_metrics(FastBuffer *buffer)
+{
+    FSStoragePathInfo **pp;
+    FSStoragePathInfo **end;
+    FSTrunkAllocator *allocator;
+    int64_t alloc_bytes;
+    int64_t used_bytes;
+    int count;
+
+    end = STORAGE_CFG.paths_by_index.paths +
+        STORAGE_CFG.paths_by_index.count;
+
+    append_metric_header(buffer, "faststore_read_buffer_pool_alloc_bytes",
+            "gauge", "The memory allocated by the aligned read buffer pool.");
+    for (pp=STORAGE_CFG.paths_by_index.paths; pp<end; pp++) {
+        if (*pp != NULL && read_buffer_pool_memory_stat((*pp)->store.
+                    index, &alloc_bytes, &used_bytes) == 0)
+        {
+            fast_buffer_append(buffer, "faststore_read_buffer_pool_alloc_bytes"
+                    STORE_PATH_LABELS_FORMAT" %"PRId64"\n", (*pp)->store.index,
+                    (*pp)->store.path.str, alloc_bytes);
+        }
+    }
+
+    append_metric_header(buffer, "faststore_read_buffer_pool_used_bytes",
+            "gauge", "The memory in use of the aligned read buffer pool.");
+    for (pp=STORAGE_CFG.paths_by_index.paths; pp<end; pp++) {
+        if (*pp != NULL && read_buffer_pool_memory_stat((*pp)->store.
+                    index, &alloc_bytes, &used_bytes) == 0)
+        {
+            fast_buffer_append(buffer, "faststore_read_buffer_pool_used_bytes"
+                    STORE_PATH_LABELS_FORMAT" %"PRId64"\n", (*pp)->store.index,
+                    (*pp)->store.path.str, used_bytes);
+        }
+    }
+
+    append_metric_header(buffer, "faststore_trunk_freelist_trunks",
+            "gauge", "The trunks in the freelist of the store path.");
+    for (pp=STORAGE_CFG.paths_by_index.paths; pp<end; pp++) {
+        if (*pp == NULL || (*pp)->store.index >= g_allocator_mgr->
+                allocator_ptr_array.count)
+        {
+            continue;
+        }
+
+        allocator = g_allocator_mgr->allocator_ptr_array.
+            allocators[(*pp)->store.index];
+        if (allocator != NULL) {
+            fast_buffer_append(buffer, "faststore_trunk_freelist_trunks"
+                    STORE_PATH_LABELS_FORMAT" %d\n", (*pp)->store.index,
+                    (*pp)->store.path.str,
+                    trunk_allocator_get_freelist_count(allocator));
+        }
+    }
+
+    PTHREAD_MUTEX_LOCK(&g_allocator_mgr->reclaim_freelist.lcp.lock);
+    count = g_allocator_mgr->reclaim_freelist.count;
+    PTHREAD_MUTEX_UNLOCK(&g_allocator_mgr->reclaim_freelist.lcp.lock);
+    append_metric_header(buffer, "faststore_trunk_reclaim_freelist_trunks",
+            "gauge", "The trunks in the freelist reserved for reclaiming.");
+    fast_buffer_append(buffer, "faststore_trunk_reclaim_freelist_trunks "
+            "%d\n", count);
+}
+
+static void collect_reclaim_metrics(FastBuffer *buffer)
+{
+    FSTrunkReclaimStat reclaim_stat;
+    FSBackgroundThrottleStat throttle_stat;
+
+    trunk_maker_reclaim_stat(&reclaim_stat);
+    append_metric_header(buffer, "faststore_trunk_reclaiming",
+            "gauge", "The trunks in reclaiming.");
+    fast_buffer_append(buffer, "faststore_trunk_reclaiming %d\n",
+            reclaim_stat.reclaiming_count);
+
+    append_metric_header(buffer, "faststore_trunk_reclaimed_total",
+            "counter", "The reclaimed trunks by result.");
+    fast_buffer_append(buffer, "faststore_trunk_reclaimed_total"
+            "{result=\"success\"} %"PRId64"\n", reclaim_stat.success_count);
+    fast_buffer_append(buffer, "faststore_trunk_reclaimed_total"
+            "{result=\"fail\"} %"PRId64"\n", reclaim_stat.fail_count);
+
+    append_metric_header(buffer, "faststore_trunk_reclaim_migrated_bytes_total",
+            "counter", "The used bytes of the reclaimed trunks.");
+    fast_buffer_append(buffer, "faststore_trunk_reclaim_migrated_bytes_total "
+            "%"PRId64"\n", reclaim_stat.migrated_bytes);
+
+    background_throttle_stat(&throttle_stat);
+    append_metric_header(buffer, "faststore_background_throttle_bytes_per_second",
+            "gauge", "The current and target rates of the background "
+            "recovery and reclaim, the target 0 for unlimited.");
+    fast_buffer_append(buffer, "faststore_background_throttle_bytes_per_second"
+            "{type=\"recovery\",kind=\"current\"} %"PRId64"\n",
+            throttle_stat.recovery.current);
+    fast_buffer_append(buffer, "faststore_background_throttle_bytes_per_second"
+            "{type=\"recovery\",kind=\"target\"} %"PRId64"\n",
+            throttle_stat.recovery.target);
+    fast_buffer_append(buffer, "faststore_background_throttle_bytes_per_second"
+            "{type=\"reclaim\",kind=\"current\"} %"PRId64"\n",
+            throttle_stat.reclaim.current);
+    fast_buffer_append(buffer, "faststore_background_throttle_bytes_per_second"
+            "{type=\"reclaim\",kind=\"target\"} %"PRId64"\n",
+            throttle_stat.reclaim.target);
+}
+
+static void collect_replication_metrics(FastBuffer *buffer)
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *gend;
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *send;
+    int64_t my_version;
+    int64_t lag;
+
+    gend = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    append_metric_header(buffer, "faststore_data_version", "gauge",
+            "The data version of the data groups served by this server.");
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) {
+        if (group->myself != NULL) {
+            fast_buffer_append(buffer, "faststore_data_version"
+                    "{data_group=\"%d\",is_master=\"%d\"} %"PRId64"\n",
+                    group->id, FC_ATOMIC_GET(group->myself->is_master),
+                    (int64_t)FC_ATOMIC_GET(group->myself->data.version));
+        }
+    }
+
+    /* the data versions of the slaves are reported by the leader
+     * periodically, so the lag is approximate */
+    append_metric_header(buffer, "faststore_replication_lag_versions",
+            "gauge", "The data version delta between the master "
+            "(this server) and the slave.");
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) {
+        if (group->myself == NULL || !FC_ATOMIC_GET(
+                    group->myself->is_master))
+        {
+            continue;
+        }
+
+        my_version = FC_ATOMIC_GET(group->myself->data.version);
+        send = group->data_server_array.servers +
+            group->data_server_array.count;
+        for (ds=group->data_server_array.servers; ds<send; ds++) {
+            if (ds == group->myself) {
+                continue;
+            }
+
+            lag = my_version - (int64_t)FC_ATOMIC_GET(ds->data.version);
+            fast_buffer_append(buffer, "faststore_replication_lag_versions"
+                    "{data_group=\"%d\",server_id=\"%d\"} %"PRId64"\n",
+                    group->id, ds->cs->server->id, (lag > 0 ? lag : 0));
+        }
+    }
+}
+
+static void collect_binlog_writer_metrics(FastBuffer *buffer)
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *end;
+    FSBinlogWriterStat writer_stat;
+
+    append_metric_header(buffer, "faststore_binlog_writer_waiting_count",
+            "gauge", "The records waiting for the binlog writer.");
+    slice_binlog_writer_stat(&writer_stat);
+    fast_buffer_append(buffer, "faststore_binlog_writer_waiting_count"
+            "{binlog=\"slice\",data_group=\"0\"} %d\n",
+            writer_stat.waiting_count);
+
+    end = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<end; group++) {
+        if (group->myself != NULL) {
+            replica_binlog_writer_stat(group->id, &writer_stat);
+            fast_buffer_append(buffer, "faststore_binlog_writer_waiting_count"
+                    "{binlog=\"replica\",data_group=\"%d\"} %d\n",
+                    group->id, writer_stat.waiting_count);
+        }
+    }
+}
+
+static void collect_latency_metrics(FastBuffer *buffer)
+{
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    FSLatencyHistogram hist;
+    char labels[128];
+    int stage;
+    int op_type;
+    int i;
+
+    append_metric_header(buffer, "faststore_latency_microseconds",
+            "summary", "The latency of the request pipeline stages.");
+    for (stage=0; stage<FS_LATENCY_STAGE_COUNT; stage++) {
+        for (op_type=0; op_type<FS_LATENCY_OP_COUNT; op_type++) {
+            latency_stat_merge(stage, op_type, &hist);
+            if (hist.count == 0) {
+                continue;
+            }
+
+            snprintf(labels, sizeof(labels), "stage=\"%s\",op=\"%s\"",
+                    fs_get_latency_stage_caption(stage),
+                    fs_get_latency_op_caption(op_type));
+            for (i=0; i<sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+                fast_buffer_append(buffer, "faststore_latency_microseconds"
+                        "{%s,quantile=\"%g\"} %"PRId64"\n", labels,
+                        quantiles[i], latency_stat_percentile(
+                            &hist, quantiles[i]));
+            }
+            fast_buffer_append(buffer, "faststore_latency_microseconds_sum"
+                    "{%s} %"PRId64"\n", labels, hist.sum);
+            fast_buffer_append(buffer, "faststore_latency_microseconds_count"
+                    "{%s} %"PRId64"\n", labels, hist.count);
+        }
+    }
+}
+
+static void collect_metrics(FastBuffer *buffer)
+{
+    fast_buffer_reset(buffer);
+    collect_data_thread_metrics(buffer);
+    collect_trunk_io_metrics(buffer);
+    collect_store_path_metrics(buffer);
+    collect_reclaim_metrics(buffer);
+    collect_replication_metrics(buffer);
+    collect_binlog_writer_metrics(buffer);
+    collect_latency_metrics(buffer);
+}
+
+static int recv_request(int sock, char *buff, const int size)
+{
+    struct pollfd pfd;
+    int len;
+    int bytes;
+
+    len = 0;
+    *buff = '\0';
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    while (len < size - 1) {
+        if (poll(&pfd, 1, METRICS_NETWORK_TIMEOUT * 1000) <= 0) {
+            return ETIMEDOUT;
+        }
+
+        if ((bytes=recv(sock, buff + len, size - 1 - len, 0)) <= 0) {
+            return (bytes == 0) ? ECONNRESET : (errno != 0 ? errno : EIO);
+        }
+        len += bytes;
+        buff[len] = '\0';
+        if (strstr(buff, "\r\n\r\n") != NULL) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static int send_response(int sock, const char *status,
+        const char *body, const int body_len)
+{
+    char header[256];
+    int len;
+    int result;
+
+    len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\n"
+            "Content-Type: "METRICS_CONTENT_TYPE"\r\n"
+            "Content-Length: %d\r\nConnection: close\r\n\r\n",
+            status, body_len);
+    if ((result=tcpsenddata_nb(sock, header, len,
+                    METRICS_NETWORK_TIMEOUT)) != 0)
+    {
+        return result;
+    }
+
+    if (body_len > 0) {
+        return tcpsenddata_nb(sock, (void *)body, body_len,
+                METRICS_NETWORK_TIMEOUT);
+    }
+    return 0;
+}
+
+static int deal_request(int sock)
+{
+    char request[METRICS_REQUEST_MAX_SIZE];
+    char *path;
+    char *end;
+    int result;
+
+    if ((result=recv_request(sock, request, sizeof(request))) != 0) {
+        return result;
+    }
+
+    if (memcmp(request, "GET ", 4) != 0) {
+        return send_response(sock, "405 Method Not Allowed", NULL, 0);
+    }
+
+    path = request + 4;
+    if ((end=strchr(path, ' ')) != NULL) {
+        *end = '\0';
+    }
+    if (strcmp(path, "/metrics") != 0) {
+        return send_response(sock, "404 Not Found", NULL, 0);
+    }
+
+    collect_metrics(&metrics_ctx.buffer);
+    return send_response(sock, "200 OK", metrics_ctx.buffer.data,
+            metrics_ctx.buffer.length);
+}
+
+static void *metrics_exporter_thread_func(void *arg)
+{
+    struct pollfd pfd;
+    int sock;
+
+#ifdef OS_LINUX
+    prctl(PR_SET_NAME, "metrics-exporter");
+
+    /* the lowest priority to avoid disturbing the IO path */
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+
+    pfd.fd = metrics_ctx.sock;
+    pfd.events = POLLIN;
+    while (SF_G_CONTINUE_FLAG) {
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+
+        if ((sock=accept(metrics_ctx.sock, NULL, NULL)) < 0) {
+            continue;
+        }
+
+        deal_request(sock);
+        close(sock);
+    }
+
+    close(metrics_ctx.sock);
+    return NULL;
+}
+
+int metrics_exporter_init()
+{
+    int result;
+    pthread_t tid;
+
+    if (!metrics_ctx.enabled) {
+        return 0;
+    }
+
+    if ((result=fast_buffer_init_ex(&metrics_ctx.buffer, 64 * 1024)) != 0) {
+        return result;
+    }
+
+    if ((metrics_ctx.sock=socketServer(metrics_ctx.bind_addr,
+                    metrics_ctx.port, &result)) < 0)
+    {
+        return result;
+    }
+
+    return fc_create_thread(&tid, metrics_exporter_thread_func,
+            NULL, SF_G_THREAD_STACK_SIZE);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//metrics_exporter.h
+
+#ifndef _METRICS_EXPORTER_H_
+#define _METRICS_EXPORTER_H_
+
+#include "fastcommon/common_define.h"
+#include "fastcommon/ini_file_reader.h"
+
+#define FS_SERVER_DEFAULT_METRICS_PORT  21019
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int metrics_exporter_load_config(IniContext *ini_context,
+            const char *filename);
+
+    /* start the HTTP thread which serves the metrics in the
+     * prometheus text exposition format when enabled */
+    int metrics_exporter_init();
+
+    void metrics_exporter_config_to_log();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
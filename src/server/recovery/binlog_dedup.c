@@ -143,6 +143,7 @@ static int deal_binlog_buffer(BinlogDedupContext *dedup_ctx)
                 break;
             case REPLICA_BINLOG_OP_TYPE_DEL_SLICE:
             case REPLICA_BINLOG_OP_TYPE_DEL_BLOCK:
+            case REPLICA_BINLOG_OP_TYPE_CLONE_BLOCK:
                 if (op_type == REPLICA_BINLOG_OP_TYPE_DEL_SLICE) {
                     result = ob_index_delete_slices_ex(&dedup_ctx->
                             htables.create, &dedup_ctx->record.bs_key,
@@ -156,7 +157,7 @@ static int deal_binlog_buffer(BinlogDedupContext *dedup_ctx)
                 }
 
                 if (dec_alloc != target_len) {
-                    if (op_type == REPLICA_BINLOG_OP_TYPE_DEL_BLOCK) {
+                    if (op_type != REPLICA_BINLOG_OP_TYPE_DEL_SLICE) {
                         dedup_ctx->record.bs_key.slice.offset = 0;
                         dedup_ctx->record.bs_key.slice.length =
                             FS_FILE_BLOCK_SIZE;
@@ -179,6 +180,22 @@ static int deal_binlog_buffer(BinlogDedupContext *dedup_ctx)
                     dedup_ctx->rstat.remove.ignore++;
                     result = 0;
                 }
+
+                /* the cloned block is recovered as the whole block
+                   writing because the source slices maybe absent */
+                if (result == 0 && op_type ==
+                        REPLICA_BINLOG_OP_TYPE_CLONE_BLOCK)
+                {
+                    dedup_ctx->record.bs_key.slice.offset = 0;
+                    dedup_ctx->record.bs_key.slice.length =
+                        FS_FILE_BLOCK_SIZE;
+                    result = add_slice(&dedup_ctx->htables.create,
+                            &dedup_ctx->record, OB_SLICE_TYPE_FILE);
+                    dedup_ctx->rstat.create.total++;
+                    if (result == 0) {
+                        dedup_ctx->rstat.create.success++;
+                    }
+                }
                 break;
             default:
                 break;
@@ -35,6 +35,8 @@
 #include "../../client/fs_client.h"
 #include "../server_global.h"
 #include "../data_thread.h"
+#include "../server_qos.h"
+#include "../background_throttle.h"
 #include "../cluster_relationship.h"
 #include "../server_binlog.h"
 #include "../server_replication.h"
@@ -322,7 +324,7 @@ static int deal_task(ReplayThreadContext *thread_ctx, ReplayTaskInfo *task)
     }
 
     if (operation != DATA_OPERATION_NONE) {
-        if ((result=push_to_data_thread_queue(operation,
+        if ((result=server_qos_push_to_data_queue(NULL, operation,
                         DATA_SOURCE_SLAVE_RECOVERY, thread_ctx,
                         &task->op_ctx)) == 0)
         {
@@ -550,6 +552,8 @@ static void fetch_data_run(void *arg, void *thread_data)
             continue;
         }
 
+        background_throttle_acquire(BACKGROUND_THROTTLE_TYPE_RECOVERY,
+                task->op_ctx.info.bs_key.slice.length);
         if ((task->op_ctx.result=fs_client_slice_read_by_slave(
                         &g_fs_client_vars.client_ctx, thread_ctx->
                         replay_ctx->recovery_ctx->is_online ?
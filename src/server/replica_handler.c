@@ -385,6 +385,12 @@ static int replica_deal_fetch_binlog_first(struct fast_task_info *task)
                     "file, my current data version: %"PRId64, data_group_id,
                     server_id, last_data_version, my_data_version);
             TASK_CTX.common.log_level = LOG_WARNING;
+        } else if (result == ENOENT) {
+            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                    "data group id: %d, slave server id: %d 's last data "
+                    "version: %"PRId64" is purged from my binlog, the slave "
+                    "MUST clear its data for the full recovery",
+                    data_group_id, server_id, last_data_version);
         }
 
         replica_release_reader(task, false);
@@ -728,6 +734,9 @@ static int handle_rpc_req(struct fast_task_info *task,
             case FS_SERVICE_PROTO_BLOCK_DELETE_REQ:
                 result = du_handler_deal_block_delete(task, op_ctx);
                 break;
+            case FS_SERVICE_PROTO_BLOCK_CLONE_REQ:
+                result = du_handler_deal_block_clone(task, op_ctx);
+                break;
             default:
                 RESPONSE.error.length = sprintf(RESPONSE.error.message,
                         "unkown cmd: %d", body_part->cmd);
@@ -854,6 +863,9 @@ static int replica_deal_rpc_resp(struct fast_task_info *task)
         data_version = buff2long(body_part->data_version);
         err_no = buff2short(body_part->err_no);
         if (err_no != 0) {
+            /* the failed slave does NOT count toward the quorum */
+            replication_processors_deal_rpc_response(REPLICA_REPLICATION,
+                    data_group_id, data_version, false);
             result = err_no;
             RESPONSE.error.length = sprintf(
                     RESPONSE.error.message,
@@ -864,7 +876,7 @@ static int replica_deal_rpc_resp(struct fast_task_info *task)
 
         if ((result=replication_processors_deal_rpc_response(
                         REPLICA_REPLICATION, data_group_id,
-                        data_version)) != 0)
+                        data_version, true)) != 0)
         {
             RESPONSE.error.length = sprintf(RESPONSE.error.message,
                     "deal_rpc_response fail, data_group_id: %d, "
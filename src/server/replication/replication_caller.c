@@ -30,6 +30,7 @@
 #include "fastcommon/shared_func.h"
 #include "fastcommon/pthread_func.h"
 #include "fastcommon/ioevent_loop.h"
+#include "fastcommon/fc_atomic.h"
 #include "sf/sf_global.h"
 #include "../server_global.h"
 #include "../server_group_info.h"
@@ -78,6 +79,16 @@ static inline ReplicationRPCEntry *replication_caller_alloc_rpc_entry()
     return rpc;
 }
 
+static inline void free_rpc_entry(ReplicationRPCEntry *rpc)
+{
+    if (rpc->body_alloced) {
+        free(rpc->body);
+        rpc->body = NULL;
+        rpc->body_alloced = false;
+    }
+    fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+}
+
 void replication_caller_release_rpc_entry(ReplicationRPCEntry *rpc)
 {
     if (__sync_sub_and_fetch(&rpc->reffer_count, 1) == 0) {
@@ -85,8 +96,72 @@ void replication_caller_release_rpc_entry(ReplicationRPCEntry *rpc)
         logInfo("file: "__FILE__", line: %d, "
                 "free record buffer: %p", __LINE__, rpc);
                 */
-        fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+        free_rpc_entry(rpc);
+    }
+}
+
+/* the success count only increases, so the quorum is decided once the
+ * success reaches the required or the failure makes it unreachable */
+static inline bool rpc_result_decided(ReplicationRPCEntry *rpc,
+        const int success_count, const int fail_count)
+{
+    if (rpc->wait_all) {
+        return success_count + fail_count >= rpc->slave_count;
+    }
+
+    return (success_count >= rpc->required_count) ||
+        (fail_count > rpc->slave_count - rpc->required_count);
+}
+
+static inline bool rpc_check_decide(ReplicationRPCEntry *rpc,
+        const int success_count, const int fail_count)
+{
+    return rpc_result_decided(rpc, success_count, fail_count) &&
+        __sync_bool_compare_and_swap(&rpc->decided, 0, 1);
+}
+
+void replication_caller_rpc_done(ReplicationRPCEntry *rpc,
+        const bool success)
+{
+    int success_count;
+    int fail_count;
+
+    /* the atomic operations are full barriers, one of the concurrent
+     * callers sees both counts at least */
+    if (success) {
+        success_count = __sync_add_and_fetch(&rpc->success_count, 1);
+        fail_count = FC_ATOMIC_GET(rpc->fail_count);
+    } else {
+        fail_count = __sync_add_and_fetch(&rpc->fail_count, 1);
+        success_count = FC_ATOMIC_GET(rpc->success_count);
+    }
+
+    if (rpc_check_decide(rpc, success_count, fail_count)) {
+        data_thread_notify(rpc->thread_ctx);
+    }
+    replication_caller_release_rpc_entry(rpc);
+}
+
+int replication_caller_finish_rpc(ReplicationRPCEntry *rpc)
+{
+    int result;
+
+    if (rpc->wait_all || FC_ATOMIC_GET(rpc->success_count) >=
+            rpc->required_count)
+    {
+        result = 0;
+    } else {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, data_version: %"PRId64", "
+                "the persisted slaves: %d < required: %d, "
+                "failed slaves: %d", __LINE__, rpc->data_group_id,
+                rpc->data_version, FC_ATOMIC_GET(rpc->success_count),
+                rpc->required_count, FC_ATOMIC_GET(rpc->fail_count));
+        result = SF_RETRIABLE_ERROR_NO_SERVER;
     }
+
+    replication_caller_release_rpc_entry(rpc);
+    return result;
 }
 
 static inline void push_to_slave_replica_queue(FSReplication *replication,
@@ -110,14 +185,11 @@ static int push_to_slave_queues(FSClusterDataGroupInfo *group,
     int status;
     int inactive_count;
 
-    __sync_add_and_fetch(&rpc->reffer_count,
-            group->slave_ds_array.count);
-
-    __sync_add_and_fetch(&((FSServerTaskArg *)rpc->task->arg)->context.
-            service.waiting_rpc_count, group->slave_ds_array.count);
+    /* one more for the caller to get the result */
+    __sync_add_and_fetch(&rpc->reffer_count, rpc->slave_count + 1);
 
     inactive_count = 0;
-    end = group->slave_ds_array.servers + group->slave_ds_array.count;
+    end = group->slave_ds_array.servers + rpc->slave_count;
     for (ds=group->slave_ds_array.servers; ds<end; ds++) {
         status = __sync_fetch_and_add(&(*ds)->status, 0);
         if (status == FS_DS_STATUS_ONLINE) {
@@ -130,21 +202,17 @@ static int push_to_slave_queues(FSClusterDataGroupInfo *group,
         replication = (*ds)->cs->repl_ptr_array.replications[hash_code %
             (*ds)->cs->repl_ptr_array.count];
         if (!replication_channel_is_ready(replication)) {
-            int64_t data_version;
-
             if (status == FS_DS_STATUS_ACTIVE) {
                 cluster_relationship_swap_report_ds_status(*ds,
                         FS_DS_STATUS_ACTIVE, FS_DS_STATUS_OFFLINE,
                         FS_EVENT_SOURCE_MASTER_REPORT);
             }
-            data_version = ((FSServerTaskArg *)rpc->task->arg)->
-                context.slice_op_ctx.info.data_version;
             logWarning("file: "__FILE__", line: %d, "
                     "the replica connection for peer id %d %s:%u "
                     "NOT established, skip the RPC call: %"PRId64, __LINE__,
                     (*ds)->cs->server->id, REPLICA_GROUP_ADDRESS_FIRST_IP(
                         (*ds)->cs->server), REPLICA_GROUP_ADDRESS_FIRST_PORT(
-                            (*ds)->cs->server), data_version);
+                            (*ds)->cs->server), rpc->data_version);
 
             inactive_count++;
             continue;
@@ -153,32 +221,31 @@ static int push_to_slave_queues(FSClusterDataGroupInfo *group,
         push_to_slave_replica_queue(replication, rpc);
     }
 
+    /* the skipped slaves never persist the update, count as failures */
     if (inactive_count > 0) {
-        int result;
-        if (__sync_sub_and_fetch(&((FSServerTaskArg *)rpc->task->arg)->
-                    context.service.waiting_rpc_count, inactive_count) == 0)
-        {
-            result = 0;  //rpc finished
-        } else {
-            result = TASK_STATUS_CONTINUE;
-        }
-
-        if (__sync_sub_and_fetch(&rpc->reffer_count, inactive_count) == 0) {
-            fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
-        }
+        __sync_add_and_fetch(&rpc->fail_count, inactive_count);
+        __sync_sub_and_fetch(&rpc->reffer_count, inactive_count);
+    }
 
-        return result;
+    /* the caller decides when the result is decided before the responses,
+     * otherwise the responder who decides notifies the waiting caller */
+    if (rpc_check_decide(rpc, FC_ATOMIC_GET(rpc->success_count),
+                FC_ATOMIC_GET(rpc->fail_count)))
+    {
+        return 0;
     } else {
         return TASK_STATUS_CONTINUE;
     }
 }
 
-int replication_caller_push_to_slave_queues(FSDataOperation *op)
+int replication_caller_push_to_slave_queues(FSDataOperation *op,
+        ReplicationRPCEntry **rpc)
 {
     FSClusterDataGroupInfo *group;
-    ReplicationRPCEntry *rpc;
+    struct fast_task_info *task;
     uint32_t hash_code;
 
+    *rpc = NULL;
     if ((group=fs_get_data_group(op->ctx->info.data_group_id)) == NULL) {
         return ENOENT;
     }
@@ -187,13 +254,45 @@ int replication_caller_push_to_slave_queues(FSDataOperation *op)
         return 0;
     }
 
-    if ((rpc=replication_caller_alloc_rpc_entry()) == NULL) {
+    if ((*rpc=replication_caller_alloc_rpc_entry()) == NULL) {
         return ENOMEM;
     }
 
-    rpc->task = (struct fast_task_info *)op->arg;
-    rpc->body_offset = op->ctx->info.body - rpc->task->data;
-    rpc->body_length = op->ctx->info.body_len;
+    task = (struct fast_task_info *)op->arg;
+    (*rpc)->thread_ctx = (FSDataThreadContext *)op->ctx->arg;
+    (*rpc)->cmd = ((FSProtoHeader *)task->data)->cmd;
+    (*rpc)->data_group_id = op->ctx->info.data_group_id;
+    (*rpc)->data_version = op->ctx->info.data_version;
+    (*rpc)->body_length = op->ctx->info.body_len;
+
+    /* the quorum includes the master, the inactive slaves do NOT
+     * decrease the required count */
+    (*rpc)->slave_count = group->slave_ds_array.count;
+    (*rpc)->wait_all = (group->write_ack.policy == FS_WRITE_ACK_POLICY_ALL);
+    (*rpc)->required_count = FC_MIN(group->write_ack.quorum - 1,
+            (*rpc)->slave_count);
+    if ((*rpc)->required_count < 0) {
+        (*rpc)->required_count = 0;
+    }
+    (*rpc)->success_count = 0;
+    (*rpc)->fail_count = 0;
+    (*rpc)->decided = 0;
+
+    /* the task buffer maybe reused by the next request before
+     * the stragglers send the RPC when not wait for all slaves */
+    if (!(*rpc)->wait_all) {
+        if (((*rpc)->body=(char *)fc_malloc((*rpc)->body_length)) == NULL) {
+            fast_mblock_free_object(&repl_mctx.rpc_allocator, *rpc);
+            *rpc = NULL;
+            return ENOMEM;
+        }
+        memcpy((*rpc)->body, op->ctx->info.body, (*rpc)->body_length);
+        (*rpc)->body_alloced = true;
+    } else {
+        (*rpc)->body = op->ctx->info.body;
+        (*rpc)->body_alloced = false;
+    }
+
     hash_code = op->ctx->info.data_group_id;
-    return push_to_slave_queues(group, hash_code, rpc, op);
+    return push_to_slave_queues(group, hash_code, *rpc, op);
 }
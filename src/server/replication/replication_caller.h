@@ -30,7 +30,20 @@ void replication_caller_destroy();
 
 void replication_caller_release_rpc_entry(ReplicationRPCEntry *rpc);
 
-int replication_caller_push_to_slave_queues(FSDataOperation *op);
+/* the RPC responded (success is true), failed, timeout or discarded */
+void replication_caller_rpc_done(ReplicationRPCEntry *rpc,
+        const bool success);
+
+/* push the update to the slaves, return TASK_STATUS_CONTINUE when the
+ * caller should wait for the notify. *rpc is set when the RPC entry
+ * created, the caller MUST call replication_caller_finish_rpc after
+ * the result decided */
+int replication_caller_push_to_slave_queues(FSDataOperation *op,
+        ReplicationRPCEntry **rpc);
+
+/* get the write result and release the reference of the caller,
+ * return 0 when the quorum of the data servers persisted the update */
+int replication_caller_finish_rpc(ReplicationRPCEntry *rpc);
 
 #ifdef __cplusplus
 }
@@ -308,19 +308,6 @@ static int send_join_server_package(FSReplication *replication)
     return result;
 }
 
-static void decrease_task_waiting_rpc_count(ReplicationRPCEntry *rb)
-{
-    FSServerTaskArg *task_arg;
-
-    task_arg = (FSServerTaskArg *)rb->task->arg;
-    if (__sync_sub_and_fetch(&task_arg->context.service.
-                waiting_rpc_count, 1) == 0)
-    {
-        data_thread_notify((FSDataThreadContext *)
-                task_arg->context.slice_op_ctx.arg);
-    }
-}
-
 static void discard_queue(FSReplication *replication,
         ReplicationRPCEntry *head)
 {
@@ -328,9 +315,7 @@ static void discard_queue(FSReplication *replication,
     while (head != NULL) {
         rb = head;
         head = head->nexts[replication->peer->link_index];
-
-        decrease_task_waiting_rpc_count(rb);
-        replication_caller_release_rpc_entry(rb);
+        replication_caller_rpc_done(rb, false);
     }
 }
 
@@ -455,12 +440,10 @@ static int replication_rpc_from_queue(FSReplication *replication)
 {
     struct fc_queue_info qinfo;
     ReplicationRPCEntry *rb;
-    ReplicationRPCEntry *deleted;
+    ReplicationRPCEntry *current;
     struct fast_task_info *task;
     FSProtoReplicaRPCReqBodyHeader *body_header;
     FSProtoReplicaRPCReqBodyPart *body_part;
-    uint64_t data_version;
-    int data_group_id;
     int count;
     int body_len;
     int pkg_len;
@@ -490,30 +473,25 @@ static int replication_rpc_from_queue(FSReplication *replication)
             break;
         }
 
-        body_part->cmd = ((FSProtoHeader *)rb->task->data)->cmd;
-        data_group_id = ((FSServerTaskArg *)rb->task->arg)->
-            context.slice_op_ctx.info.data_group_id;
-        data_version = ((FSServerTaskArg *)rb->task->arg)->
-            context.slice_op_ctx.info.data_version;
-        memcpy(body_part->body, rb->task->data +
-                rb->body_offset, rb->body_length);
+        body_part->cmd = rb->cmd;
+        memcpy(body_part->body, rb->body, rb->body_length);
 
         ++count;
         task->length = pkg_len;
-        long2buff(data_version, body_part->data_version);
+        long2buff(rb->data_version, body_part->data_version);
         int2buff(rb->body_length, body_part->body_len);
+
+        current = rb;
+        rb = rb->nexts[replication->peer->link_index];
+
+        /* the RPC entry is released when the response arrived */
         if ((result=rpc_result_ring_add(&replication->context.caller.
-                        rpc_result_ctx, data_group_id, data_version,
-                        rb->task)) != 0)
+                        rpc_result_ctx, current->data_group_id,
+                        current->data_version, current)) != 0)
         {
             sf_terminate_myself();
             return result;
         }
-
-        deleted = rb;
-        rb = rb->nexts[replication->peer->link_index];
-
-        replication_caller_release_rpc_entry(deleted);
     } while (rb != NULL);
 
     if (count == 0) {
@@ -43,13 +43,13 @@ void clean_connected_replications(FSServerContext *server_ctx);
 
 static inline int replication_processors_deal_rpc_response(
         FSReplication *replication, const int data_group_id,
-        const uint64_t data_version)
+        const uint64_t data_version, const bool success)
 {
     if (__sync_add_and_fetch(&replication->stage, 0) ==
             FS_REPLICATION_STAGE_SYNCING)
     {
-        return rpc_result_ring_remove(&replication->context.caller.
-                rpc_result_ctx, data_group_id, data_version);
+        return rpc_result_ring_remove_ex(&replication->context.caller.
+                rpc_result_ctx, data_group_id, data_version, success);
     } else {
         return 0;
     }
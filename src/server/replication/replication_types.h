@@ -23,10 +23,21 @@
 #include <pthread.h>
 #include "../server_types.h"
 
+struct fs_data_thread_context;
 typedef struct replication_rpc_entry {
-    struct fast_task_info *task;
+    struct fs_data_thread_context *thread_ctx;  //for notify the waiting
     volatile short reffer_count;
-    short body_offset;
+    volatile short success_count;  //the slaves persisted the update
+    volatile short fail_count;     //the slaves failed, timeout or skipped
+    short slave_count;     //the slaves of the data group
+    short required_count;  //the success count to ack, exclude the master
+    volatile char decided; //the result decided and the caller notified
+    bool wait_all;  //the all policy waits all slaves and never fails
+    char cmd;
+    bool body_alloced;  //the body copied when not wait for all slaves
+    int data_group_id;
+    uint64_t data_version;
+    char *body;
     int body_length;
     struct replication_rpc_entry *nexts[0];  //for slave replications
 } ReplicationRPCEntry;
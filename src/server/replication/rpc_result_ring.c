@@ -32,7 +32,10 @@
 #include "sf/sf_global.h"
 #include "../../common/fs_cluster_cfg.h"
 #include "../server_global.h"
+#include "../server_group_info.h"
+#include "../cluster_relationship.h"
 #include "../data_thread.h"
+#include "replication_caller.h"
 #include "rpc_result_ring.h"
 
 static int init_rpc_result_instance(FSReplicaRPCResultInstance *instance,
@@ -53,31 +56,23 @@ static int init_rpc_result_instance(FSReplicaRPCResultInstance *instance,
     return 0;
 }
 
-int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
-        const int alloc_size)
+int rpc_result_ring_init_ex(FSReplicaRPCResultContext *ctx,
+        const int dg_base_id, const int dg_count, const int alloc_size)
 {
     int bytes;
     int result;
-    FSIdArray *id_array;
     FSReplicaRPCResultInstance *instance;
     FSReplicaRPCResultInstance *end;
 
-    if (ctx->instances != NULL) {
-        return 0;
-    }
-
-    id_array = fs_cluster_cfg_get_my_data_group_ids(&CLUSTER_CONFIG_CTX,
-            CLUSTER_MYSELF_PTR->server->id);
-    ctx->dg_base_id = fs_cluster_cfg_get_min_data_group_id(id_array);
-
-    bytes = sizeof(FSReplicaRPCResultInstance) * id_array->count;
+    bytes = sizeof(FSReplicaRPCResultInstance) * dg_count;
     ctx->instances = (FSReplicaRPCResultInstance *)fc_malloc(bytes);
     if (ctx->instances == NULL) {
         return ENOMEM;
     }
     memset(ctx->instances, 0, bytes);
 
-    ctx->dg_count = id_array->count;
+    ctx->dg_base_id = dg_base_id;
+    ctx->dg_count = dg_count;
     end = ctx->instances + ctx->dg_count;
     for (instance=ctx->instances; instance<end; instance++) {
         instance->data_group_id = ctx->dg_base_id +
@@ -92,26 +87,33 @@ int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
         0, NULL, NULL, false);
 }
 
-static inline void desc_task_waiting_rpc_count(
-        FSReplicaRPCResultInstance *instance,
-        FSReplicaRPCResultEntry *entry)
+int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
+        const int alloc_size)
 {
-    FSServerTaskArg *task_arg;
+    FSIdArray *id_array;
+
+    if (ctx->instances != NULL) {
+        return 0;
+    }
+
+    id_array = fs_cluster_cfg_get_my_data_group_ids(&CLUSTER_CONFIG_CTX,
+            CLUSTER_MYSELF_PTR->server->id);
+    return rpc_result_ring_init_ex(ctx, fs_cluster_cfg_get_min_data_group_id(
+                id_array), id_array->count, alloc_size);
+}
 
-    if (entry->waiting_task == NULL) {
+static inline void rpc_result_entry_done(
+        FSReplicaRPCResultInstance *instance,
+        FSReplicaRPCResultEntry *entry, const bool success)
+{
+    if (entry->rpc == NULL) {
         logWarning("file: "__FILE__", line: %d, "
-                "task is NULL, data group id: %d, data_version: %"PRId64,
+                "rpc is NULL, data group id: %d, data_version: %"PRId64,
                 __LINE__, instance->data_group_id, entry->data_version);
         return;
     }
 
-    task_arg = (FSServerTaskArg *)entry->waiting_task->arg;
-    if (__sync_sub_and_fetch(&task_arg->context.
-                service.waiting_rpc_count, 1) == 0)
-    {
-        data_thread_notify((FSDataThreadContext *)
-                task_arg->context.slice_op_ctx.arg);
-    }
+    replication_caller_rpc_done(entry->rpc, success);
 }
 
 static void rpc_result_instance_clear_queue_all(FSReplicaRPCResultContext *ctx,
@@ -129,7 +131,7 @@ static void rpc_result_instance_clear_queue_all(FSReplicaRPCResultContext *ctx,
         deleted = current;
         current = current->next;
 
-        desc_task_waiting_rpc_count(instance, deleted);
+        rpc_result_entry_done(instance, deleted, false);
         fast_mblock_free_object(&ctx->rentry_allocator, deleted);
     }
 
@@ -148,9 +150,9 @@ static void rpc_result_instance_clear_all(FSReplicaRPCResultContext *ctx,
 
     index = instance->ring.start - instance->ring.entries;
     while (instance->ring.start != instance->ring.end) {
-        desc_task_waiting_rpc_count(instance, instance->ring.start);
+        rpc_result_entry_done(instance, instance->ring.start, false);
         instance->ring.start->data_version = 0;
-        instance->ring.start->waiting_task = NULL;
+        instance->ring.start->rpc = NULL;
 
         instance->ring.start = instance->ring.entries +
             (++index % instance->ring.size);
@@ -195,11 +197,11 @@ static int rpc_result_instance_clear_queue_timeouts(
         logWarning("file: "__FILE__", line: %d, "
                 "waiting push response timeout, "
                 "data group id: %d, peer server id: %d, data_version: "
-                "%"PRId64", task: %p", __LINE__, instance->data_group_id,
+                "%"PRId64", rpc: %p", __LINE__, instance->data_group_id,
                 ctx->replication->peer->server->id,
-                deleted->data_version, deleted->waiting_task);
+                deleted->data_version, deleted->rpc);
 
-        desc_task_waiting_rpc_count(instance, deleted);
+        rpc_result_entry_done(instance, deleted, false);
         fast_mblock_free_object(&ctx->rentry_allocator, deleted);
         ++count;
     }
@@ -212,6 +214,34 @@ static int rpc_result_instance_clear_queue_timeouts(
     return count;
 }
 
+/* the straggler recovers the missing data from the master
+ * when the master does not wait for all slaves */
+static void downgrade_straggler(FSReplicaRPCResultContext *ctx,
+        FSReplicaRPCResultInstance *instance)
+{
+    FSClusterDataServerInfo *ds;
+
+    if ((ds=fs_get_data_server(instance->data_group_id,
+                    ctx->replication->peer->server->id)) == NULL)
+    {
+        return;
+    }
+
+    if (ds->dg->write_ack.policy == FS_WRITE_ACK_POLICY_ALL) {
+        return;
+    }
+
+    if (cluster_relationship_swap_report_ds_status(ds,
+                FS_DS_STATUS_ACTIVE, FS_DS_STATUS_OFFLINE,
+                FS_EVENT_SOURCE_MASTER_REPORT))
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, peer server id: %d, the straggler "
+                "is set to OFFLINE", __LINE__, instance->data_group_id,
+                ctx->replication->peer->server->id);
+    }
+}
+
 static int rpc_result_instance_clear_timeouts(
         FSReplicaRPCResultContext *ctx,
         FSReplicaRPCResultInstance *instance)
@@ -232,9 +262,9 @@ static int rpc_result_instance_clear_timeouts(
                     ctx->replication->peer->server->id,
                     instance->ring.start->data_version);
 
-            desc_task_waiting_rpc_count(instance, instance->ring.start);
+            rpc_result_entry_done(instance, instance->ring.start, false);
             instance->ring.start->data_version = 0;
-            instance->ring.start->waiting_task = NULL;
+            instance->ring.start->rpc = NULL;
 
             instance->ring.start = instance->ring.entries +
                 (++index % instance->ring.size);
@@ -249,6 +279,7 @@ static int rpc_result_instance_clear_timeouts(
                 "push response waiting entries count: %d", __LINE__,
                 instance->data_group_id, ctx->replication->peer->server->id,
                 clear_count);
+        downgrade_straggler(ctx, instance);
     }
 
     return clear_count;
@@ -296,7 +327,7 @@ void rpc_result_ring_destroy(FSReplicaRPCResultContext *ctx)
 
 static int add_to_queue(FSReplicaRPCResultContext *ctx,
         FSReplicaRPCResultInstance *instance, const uint64_t data_version,
-        struct fast_task_info *waiting_task)
+        struct replication_rpc_entry *rpc)
 {
     FSReplicaRPCResultEntry *entry;
     FSReplicaRPCResultEntry *previous;
@@ -309,7 +340,7 @@ static int add_to_queue(FSReplicaRPCResultContext *ctx,
     }
 
     entry->data_version = data_version;
-    entry->waiting_task = waiting_task;
+    entry->rpc = rpc;
     entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
 
     if (instance->queue.tail == NULL) {  //empty queue
@@ -345,7 +376,7 @@ static int add_to_queue(FSReplicaRPCResultContext *ctx,
 
 int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
         const int data_group_id, const uint64_t data_version,
-        struct fast_task_info *waiting_task)
+        struct replication_rpc_entry *rpc)
 {
     FSReplicaRPCResultInstance *instance;
     FSReplicaRPCResultEntry *entry;
@@ -377,7 +408,7 @@ int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
 
     if (matched) {
         entry->data_version = data_version;
-        entry->waiting_task = waiting_task;
+        entry->rpc = rpc;
         entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
         return 0;
     }
@@ -387,11 +418,12 @@ int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
             "data version %"PRId64" in the ring", __LINE__,
             instance->data_group_id, ctx->replication->peer->server->id,
             data_version);
-    return add_to_queue(ctx, instance, data_version, waiting_task);
+    return add_to_queue(ctx, instance, data_version, rpc);
 }
 
 static int remove_from_queue(FSReplicaRPCResultContext *ctx,
-        FSReplicaRPCResultInstance *instance, const uint64_t data_version)
+        FSReplicaRPCResultInstance *instance, const uint64_t data_version,
+        const bool success)
 {
     FSReplicaRPCResultEntry *entry;
     FSReplicaRPCResultEntry *previous;
@@ -426,13 +458,14 @@ static int remove_from_queue(FSReplicaRPCResultContext *ctx,
         }
     }
 
-    desc_task_waiting_rpc_count(instance, entry);
+    rpc_result_entry_done(instance, entry, success);
     fast_mblock_free_object(&ctx->rentry_allocator, entry);
     return 0;
 }
 
-int rpc_result_ring_remove(FSReplicaRPCResultContext *ctx,
-        const int data_group_id, const uint64_t data_version)
+int rpc_result_ring_remove_ex(FSReplicaRPCResultContext *ctx,
+        const int data_group_id, const uint64_t data_version,
+        const bool success)
 {
     FSReplicaRPCResultInstance *instance;
     FSReplicaRPCResultEntry *entry;
@@ -455,12 +488,12 @@ int rpc_result_ring_remove(FSReplicaRPCResultContext *ctx,
                 }
             }
 
-            desc_task_waiting_rpc_count(instance, entry);
+            rpc_result_entry_done(instance, entry, success);
             entry->data_version = 0;
-            entry->waiting_task = NULL;
+            entry->rpc = NULL;
             return 0;
         }
     }
 
-    return remove_from_queue(ctx, instance, data_version);
+    return remove_from_queue(ctx, instance, data_version, success);
 }
@@ -24,6 +24,10 @@
 extern "C" {
 #endif
 
+/* init the ring of the data groups [dg_base_id, dg_base_id + dg_count) */
+int rpc_result_ring_init_ex(FSReplicaRPCResultContext *ctx,
+        const int dg_base_id, const int dg_count, const int alloc_size);
+
 int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
         const int alloc_size);
 
@@ -31,10 +35,16 @@ void rpc_result_ring_destroy(FSReplicaRPCResultContext *ctx);
 
 int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
         const int data_group_id, const uint64_t data_version,
-        struct fast_task_info *waiting_task);
+        struct replication_rpc_entry *rpc);
+
+/* remove the entry when the slave responds, the success is false when
+ * the slave fails to persist the update */
+int rpc_result_ring_remove_ex(FSReplicaRPCResultContext *ctx,
+        const int data_group_id, const uint64_t data_version,
+        const bool success);
 
-int rpc_result_ring_remove(FSReplicaRPCResultContext *ctx,
-        const int data_group_id, const uint64_t data_version);
+#define rpc_result_ring_remove(ctx, data_group_id, data_version) \
+    rpc_result_ring_remove_ex(ctx, data_group_id, data_version, true)
 
 void rpc_result_ring_clear_all(FSReplicaRPCResultContext *ctx);
 
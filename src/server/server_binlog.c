@@ -31,6 +31,7 @@
 #include "server_binlog.h"
 #include "binlog/binlog_check.h"
 #include "binlog/binlog_repair.h"
+#include "binlog/binlog_retention.h"
 
 static int do_binlog_check()
 {
@@ -77,7 +78,11 @@ int server_binlog_init()
     }
 
     //TODO move to first?
-	return do_binlog_check();
+    if ((result=do_binlog_check()) != 0) {
+        return result;
+    }
+
+    return binlog_retention_compact_slice_binlog();
 }
 
 void server_binlog_destroy()
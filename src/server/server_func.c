@@ -30,6 +30,11 @@
 #include "server_global.h"
 #include "server_binlog.h"
 #include "server_group_info.h"
+#include "server_qos.h"
+#include "background_throttle.h"
+#include "server_numa.h"
+#include "metrics_exporter.h"
+#include "binlog/binlog_retention.h"
 #include "server_func.h"
 
 static int get_bytes_item_config(IniContext *ini_context,
@@ -282,23 +287,29 @@ static void server_log_configs()
 
     len = snprintf(sz_server_config, sizeof(sz_server_config),
             "my server id = %d, data_path = %s, data_threads = %d, "
+            "data_thread_work_stealing = %s, "
+            "local_read_first = %s, "
             "replica_channels_between_two_servers = %d, "
             "recovery_threads_per_data_group = %d, "
             "recovery_max_queue_depth = %d, "
             "binlog_buffer_size = %d KB, "
             "local_binlog_check_last_seconds = %d s, "
             "slave_binlog_check_last_rows = %d, "
+            "slave_read_wait_ms = %d, "
             "cluster server count = %d, "
             "idempotency_max_channel_count: %d, "
             "leader-election {leader_lost_timeout: %ds, "
             "max_wait_time: %ds}",
             CLUSTER_MY_SERVER_ID, DATA_PATH_STR, DATA_THREAD_COUNT,
+            (DATA_THREAD_WORK_STEALING ? "true" : "false"),
+            (SERVICE_LOCAL_READ_FIRST ? "true" : "false"),
             REPLICA_CHANNELS_BETWEEN_TWO_SERVERS,
             RECOVERY_THREADS_PER_DATA_GROUP,
             RECOVERY_MAX_QUEUE_DEPTH,
             BINLOG_BUFFER_SIZE / 1024,
             LOCAL_BINLOG_CHECK_LAST_SECONDS,
             SLAVE_BINLOG_CHECK_LAST_ROWS,
+            SLAVE_READ_WAIT_MS,
             FC_SID_SERVER_COUNT(SERVER_CONFIG_CTX),
             SF_IDEMPOTENCY_MAX_CHANNEL_COUNT,
             LEADER_ELECTION_LOST_TIMEOUT,
@@ -376,6 +387,22 @@ static int load_storage_cfg(IniContext *ini_context, const char *filename)
     return storage_config_load(&STORAGE_CFG, full_filename);
 }
 
+static int load_qos_cfg(IniContext *ini_context, const char *filename)
+{
+    char *qos_config_filename;
+    char full_filename[PATH_MAX];
+
+    qos_config_filename = iniGetStrValue(NULL,
+            "qos_config_filename", ini_context);
+    if (qos_config_filename == NULL || *qos_config_filename == '\0') {
+        return 0;  //QoS disabled
+    }
+
+    resolve_path(filename, qos_config_filename,
+            full_filename, sizeof(full_filename));
+    return server_qos_load_config(full_filename);
+}
+
 int server_load_config(const char *filename)
 {
     IniContext ini_context;
@@ -423,6 +450,11 @@ int server_load_config(const char *filename)
     DATA_THREAD_COUNT = iniGetIntCorrectValue(&full_ini_ctx,
             "data_threads", FS_DEFAULT_DATA_THREAD_COUNT,
             FS_MIN_DATA_THREAD_COUNT, FS_MAX_DATA_THREAD_COUNT);
+    DATA_THREAD_WORK_STEALING = iniGetBoolValue(NULL,
+            "data_thread_work_stealing", &ini_context, true);
+
+    SERVICE_LOCAL_READ_FIRST = iniGetBoolValue("service",
+            "local_read_first", &ini_context, false);
 
     REPLICA_CHANNELS_BETWEEN_TWO_SERVERS = iniGetIntCorrectValue(
             &full_ini_ctx, "replica_channels_between_two_servers",
@@ -450,6 +482,12 @@ int server_load_config(const char *filename)
             FS_MIN_SLAVE_BINLOG_CHECK_LAST_ROWS,
             FS_MAX_SLAVE_BINLOG_CHECK_LAST_ROWS);
 
+    SLAVE_READ_WAIT_MS = iniGetIntCorrectValue(
+            &full_ini_ctx, "slave_read_wait_ms",
+            FS_DEFAULT_SLAVE_READ_WAIT_MS,
+            FS_MIN_SLAVE_READ_WAIT_MS,
+            FS_MAX_SLAVE_READ_WAIT_MS);
+
     if ((result=load_binlog_buffer_size(&ini_context, filename)) != 0) {
         return result;
     }
@@ -465,6 +503,32 @@ int server_load_config(const char *filename)
         return result;
     }
 
+    if ((result=server_numa_load_config(&ini_context, filename)) != 0) {
+        return result;
+    }
+
+    if ((result=load_qos_cfg(&ini_context, filename)) != 0) {
+        return result;
+    }
+
+    if ((result=background_throttle_load_config(
+                    &ini_context, filename)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=metrics_exporter_load_config(
+                    &ini_context, filename)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=binlog_retention_load_config(
+                    &ini_context, filename)) != 0)
+    {
+        return result;
+    }
+
     if ((result=sf_load_slow_log_config(filename, &ini_context,
                     &SLOW_LOG_CTX, &SLOW_LOG_CFG)) != 0)
     {
@@ -492,6 +556,11 @@ int server_load_config(const char *filename)
     load_local_host_ip_addrs();
     server_log_configs();
     storage_config_to_log(&STORAGE_CFG);
+    server_qos_config_to_log();
+    background_throttle_config_to_log();
+    metrics_exporter_config_to_log();
+    binlog_retention_config_to_log();
+    server_numa_config_to_log();
 
     return 0;
 }
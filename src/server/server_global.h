@@ -62,9 +62,11 @@ typedef struct server_global_vars {
     struct {
         string_t path;   //data path
         int thread_count;
+        bool thread_work_stealing;
         int binlog_buffer_size;
         int local_binlog_check_last_seconds;
         int slave_binlog_check_last_rows;
+        int slave_read_wait_ms;  //wait for the data version of the session
         volatile uint64_t slice_binlog_sn;  //slice binlog sn
     } data;
 
@@ -72,6 +74,10 @@ typedef struct server_global_vars {
         FSStorageConfig cfg;
     } storage;
 
+    struct {
+        bool local_read_first;
+    } service;
+
     struct {
         int channels_between_two_servers;
         int recovery_threads_per_data_group;
@@ -127,13 +133,20 @@ typedef struct server_global_vars {
 #define SLAVE_BINLOG_CHECK_LAST_ROWS    g_server_global_vars.data. \
     slave_binlog_check_last_rows
 
+#define SLAVE_READ_WAIT_MS  g_server_global_vars.data.slave_read_wait_ms
+
 #define CLUSTER_SF_CTX        g_server_global_vars.cluster.sf_context
 #define REPLICA_SF_CTX        g_server_global_vars.replica.sf_context
 
 #define STORAGE_CFG           g_server_global_vars.storage.cfg
 #define PATHS_BY_INDEX_PPTR   STORAGE_CFG.paths_by_index.paths
+#define SLICE_CHECKSUM_ENABLED STORAGE_CFG.slice_checksum.enabled
+
+#define SERVICE_LOCAL_READ_FIRST  \
+    g_server_global_vars.service.local_read_first
 
 #define DATA_THREAD_COUNT     g_server_global_vars.data.thread_count
+#define DATA_THREAD_WORK_STEALING g_server_global_vars.data.thread_work_stealing
 #define BINLOG_BUFFER_SIZE    g_server_global_vars.data.binlog_buffer_size
 #define DATA_PATH             g_server_global_vars.data.path
 #define DATA_PATH_STR         DATA_PATH.str
@@ -26,6 +26,7 @@
 #include "fastcommon/sched_thread.h"
 #include "fastcommon/local_ip_func.h"
 #include "server_global.h"
+#include "storage/slice_compress.h"
 #include "cluster_topology.h"
 #include "server_group_info.h"
 
@@ -211,6 +212,7 @@ static int init_cluster_data_group_array(const char *filename,
 {
     FSIdArray *id_array;
     FSClusterDataGroupInfo *group;
+    FSDataServerMapping *mapping;
     int result;
     int bytes;
     int count;
@@ -249,6 +251,20 @@ static int init_cluster_data_group_array(const char *filename,
         group->index = data_group_index;
         group->hash_code = fs_cluster_cfg_get_dg_hash_code(
                 &CLUSTER_CONFIG_CTX, data_group_id - 1);
+        group->compress.type = fs_cluster_cfg_get_dg_compress_type(
+                &CLUSTER_CONFIG_CTX, data_group_id - 1);
+        if (!fs_compress_type_supported(group->compress.type)) {
+            logWarning("file: "__FILE__", line: %d, "
+                    "cluster config file: %s, data group id: %d, "
+                    "compression %s is NOT supported by this build, "
+                    "disable it", __LINE__, filename, data_group_id,
+                    fs_get_compress_caption(group->compress.type));
+            group->compress.type = FS_COMPRESS_TYPE_NONE;
+        }
+        mapping = fs_cluster_cfg_get_dg_mapping(
+                &CLUSTER_CONFIG_CTX, data_group_id - 1);
+        group->write_ack.policy = mapping->write_ack.policy;
+        group->write_ack.quorum = mapping->write_ack.quorum;
         if ((result=init_cluster_data_server_array(group)) != 0) {
             return result;
         }
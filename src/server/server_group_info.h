@@ -67,6 +67,19 @@ static inline FSClusterDataGroupInfo *fs_get_data_group(const int data_group_id)
     return CLUSTER_DATA_RGOUP_ARRAY.groups + index;
 }
 
+/* for the space stat of the data group, called by the storage allocator */
+static inline void fs_data_group_add_used_space(
+        const FSBlockKey *bkey, const int64_t bytes)
+{
+    int index;
+
+    index = FS_DATA_GROUP_ID(*bkey) - CLUSTER_DATA_RGOUP_ARRAY.base_id;
+    if (index >= 0 && index < CLUSTER_DATA_RGOUP_ARRAY.count) {
+        __sync_add_and_fetch(&CLUSTER_DATA_RGOUP_ARRAY.
+                groups[index].used_space, bytes);
+    }
+}
+
 static inline FSClusterDataServerInfo *fs_get_data_server(
         const int data_group_id, const int server_id)
 {
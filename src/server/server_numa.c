@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <limits.h>
+#include <sys/stat.h>
+#include "fastcommon/common_define.h"
+#ifdef OS_LINUX
+#include <sched.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "server_global.h"
+#include "storage/raw_device.h"
+#include "server_numa.h"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED  1
+#endif
+
+#define NUMA_SYS_NODE_PATH   "/sys/devices/system/node"
+#define NUMA_SYS_DEVICE_PATH "/sys/devices"
+#define NUMA_NODE_MASK_BITS  (FS_NUMA_MAX_NODE_COUNT + 1)
+
+typedef struct {
+    int node;
+    int cpu_count;
+#ifdef OS_LINUX
+    cpu_set_t cpuset;
+#endif
+} NUMANodeInfo;
+
+typedef struct {
+    bool enabled;
+    bool bind_memory;  //prefer the memory of the local node
+    struct {
+        NUMANodeInfo nodes[FS_NUMA_MAX_NODE_COUNT];  //order by node
+        int count;  //the nodes with CPUs
+    } topology;
+} NUMAContext;
+
+static NUMAContext numa_ctx;
+
+bool server_numa_enabled()
+{
+    return numa_ctx.enabled;
+}
+
+#ifdef OS_LINUX
+static NUMANodeInfo *get_node_info(const int node)
+{
+    NUMANodeInfo *ninfo;
+    NUMANodeInfo *end;
+
+    end = numa_ctx.topology.nodes + numa_ctx.topology.count;
+    for (ninfo=numa_ctx.topology.nodes; ninfo<end; ninfo++) {
+        if (ninfo->node == node) {
+            return ninfo;
+        }
+    }
+    return NULL;
+}
+
+/* parse the cpulist such as: 0-15,32-47 */
+static void parse_cpulist(char *cpulist, NUMANodeInfo *ninfo)
+{
+    char *p;
+    char *endptr;
+    long start;
+    long end;
+    long cpu;
+
+    CPU_ZERO(&ninfo->cpuset);
+    ninfo->cpu_count = 0;
+    p = cpulist;
+    while (*p != '\0') {
+        start = strtol(p, &endptr, 10);
+        if (endptr == p) {
+            break;
+        }
+        end = start;
+        p = endptr;
+        if (*p == '-') {
+            end = strtol(p + 1, &endptr, 10);
+            p = endptr;
+        }
+
+        for (cpu=start; cpu<=end && cpu<CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &ninfo->cpuset);
+            ninfo->cpu_count++;
+        }
+
+        if (*p == ',') {
+            p++;
+        } else {
+            break;
+        }
+    }
+}
+
+static int compare_node_info(const NUMANodeInfo *n1, const NUMANodeInfo *n2)
+{
+    return n1->node - n2->node;
+}
+
+static int load_topology()
+{
+    DIR *dir;
+    struct dirent *ent;
+    NUMANodeInfo *ninfo;
+    char filename[PATH_MAX];
+    char *cpulist;
+    int64_t file_size;
+    int node;
+    int result;
+
+    if ((dir=opendir(NUMA_SYS_NODE_PATH)) == NULL) {
+        result = errno != 0 ? errno : ENOENT;
+        logError("file: "__FILE__", line: %d, "
+                "opendir %s fail, errno: %d, error info: %s",
+                __LINE__, NUMA_SYS_NODE_PATH, result, STRERROR(result));
+        return result;
+    }
+
+    numa_ctx.topology.count = 0;
+    while ((ent=readdir(dir)) != NULL) {
+        if (sscanf(ent->d_name, "node%d", &node) != 1 ||
+                node < 0 || node >= FS_NUMA_MAX_NODE_COUNT)
+        {
+            continue;
+        }
+
+        snprintf(filename, sizeof(filename), "%s/%s/cpulist",
+                NUMA_SYS_NODE_PATH, ent->d_name);
+        if (getFileContent(filename, &cpulist, &file_size) != 0) {
+            continue;
+        }
+
+        ninfo = numa_ctx.topology.nodes + numa_ctx.topology.count;
+        ninfo->node = node;
+        parse_cpulist(cpulist, ninfo);
+        free(cpulist);
+        if (ninfo->cpu_count > 0) {  //skip the memory only node
+            numa_ctx.topology.count++;
+        }
+    }
+    closedir(dir);
+
+    if (numa_ctx.topology.count > 1) {
+        qsort(numa_ctx.topology.nodes, numa_ctx.topology.count,
+                sizeof(NUMANodeInfo), (int (*)(const void *,
+                        const void *))compare_node_info);
+    }
+    return 0;
+}
+
+/* find the numa_node of the device from the sysfs device path upward */
+static int get_node_by_sys_path(char *sys_path)
+{
+    char filename[PATH_MAX];
+    char *content;
+    char *p;
+    int64_t file_size;
+    int node;
+
+    while (strlen(sys_path) > sizeof(NUMA_SYS_DEVICE_PATH) - 1) {
+        snprintf(filename, sizeof(filename), "%s/numa_node", sys_path);
+        if (getFileContent(filename, &content, &file_size) == 0) {
+            node = strtol(content, NULL, 10);
+            free(content);
+            return node;
+        }
+
+        if ((p=strrchr(sys_path, '/')) == NULL) {
+            break;
+        }
+        *p = '\0';
+    }
+
+    return -1;
+}
+
+static int detect_device_node(const char *filename)
+{
+    struct stat buf;
+    dev_t dev;
+    DIR *dir;
+    struct dirent *ent;
+    char link[PATH_MAX];
+    char sys_path[PATH_MAX];
+    int node;
+
+    if (stat(filename, &buf) != 0) {
+        return -1;
+    }
+
+    dev = S_ISBLK(buf.st_mode) ? buf.st_rdev : buf.st_dev;
+    snprintf(link, sizeof(link), "/sys/dev/block/%u:%u",
+            major(dev), minor(dev));
+    if (realpath(link, sys_path) == NULL) {
+        return -1;
+    }
+    if ((node=get_node_by_sys_path(sys_path)) >= 0) {
+        return node;
+    }
+
+    /* the virtual device such as LVM and MD, use the first slave */
+    snprintf(link, sizeof(link), "/sys/dev/block/%u:%u/slaves",
+            major(dev), minor(dev));
+    if ((dir=opendir(link)) == NULL) {
+        return -1;
+    }
+
+    node = -1;
+    while ((ent=readdir(dir)) != NULL) {
+        if (*ent->d_name == '.') {
+            continue;
+        }
+
+        snprintf(link + strlen(link), sizeof(link) - strlen(link),
+                "/%s", ent->d_name);
+        if (realpath(link, sys_path) != NULL) {
+            node = get_node_by_sys_path(sys_path);
+        }
+        break;
+    }
+    closedir(dir);
+    return node;
+}
+
+static int resolve_path_nodes(FSStoragePathArray *parray)
+{
+    FSStoragePathInfo *p;
+    FSStoragePathInfo *end;
+
+    end = parray->paths + parray->count;
+    for (p=parray->paths; p<end; p++) {
+        if (p->numa_node == FS_NUMA_NODE_AUTO) {
+            p->numa_node = detect_device_node(p->device != NULL ?
+                    p->device->filename : p->store.path.str);
+            if (p->numa_node < 0 || get_node_info(p->numa_node) == NULL) {
+                logWarning("file: "__FILE__", line: %d, "
+                        "can't detect the NUMA node of the store path %s",
+                        __LINE__, p->store.path.str);
+                p->numa_node = FS_NUMA_NODE_NONE;
+            }
+        } else if (p->numa_node >= 0 &&
+                get_node_info(p->numa_node) == NULL)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "store path: %s, the NUMA node %d not exist "
+                    "or has no CPU", __LINE__, p->store.path.str,
+                    p->numa_node);
+            return EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+static inline void fill_node_mask(unsigned long *nodemask, const int node)
+{
+    nodemask[0] = 1UL << node;
+    nodemask[1] = 0;
+}
+#endif
+
+static void disable_path_nodes(FSStoragePathArray *parray)
+{
+    FSStoragePathInfo *p;
+    FSStoragePathInfo *end;
+
+    end = parray->paths + parray->count;
+    for (p=parray->paths; p<end; p++) {
+        p->numa_node = FS_NUMA_NODE_NONE;
+    }
+}
+
+int server_numa_load_config(IniContext *ini_context, const char *filename)
+{
+    const char *section_name = "numa";
+#ifdef OS_LINUX
+    int result;
+#endif
+
+    numa_ctx.enabled = iniGetBoolValue(section_name,
+            "enabled", ini_context, false);
+    numa_ctx.bind_memory = iniGetBoolValue(section_name,
+            "bind_memory", ini_context, true);
+
+#ifdef OS_LINUX
+    if (numa_ctx.enabled) {
+        if ((result=load_topology()) != 0) {
+            return result;
+        }
+
+        if (numa_ctx.topology.count <= 1) {
+            logWarning("file: "__FILE__", line: %d, "
+                    "config file: %s, the NUMA node count: %d, "
+                    "disable the NUMA placement", __LINE__,
+                    filename, numa_ctx.topology.count);
+            numa_ctx.enabled = false;
+        }
+    }
+#else
+    if (numa_ctx.enabled) {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, the NUMA placement is only supported "
+                "on Linux, disable it", __LINE__, filename);
+        numa_ctx.enabled = false;
+    }
+#endif
+
+    if (!numa_ctx.enabled) {
+        disable_path_nodes(&STORAGE_CFG.store_path);
+        disable_path_nodes(&STORAGE_CFG.write_cache);
+        return 0;
+    }
+
+#ifdef OS_LINUX
+    if ((result=resolve_path_nodes(&STORAGE_CFG.store_path)) != 0) {
+        return result;
+    }
+    if ((result=resolve_path_nodes(&STORAGE_CFG.write_cache)) != 0) {
+        return result;
+    }
+#endif
+
+    return 0;
+}
+
+static int path_nodes_to_string(FSStoragePathArray *parray,
+        char *buff, const int size)
+{
+    FSStoragePathInfo *p;
+    FSStoragePathInfo *end;
+    int len;
+
+    len = 0;
+    end = parray->paths + parray->count;
+    for (p=parray->paths; p<end && len<size; p++) {
+        len += snprintf(buff + len, size - len, "%s%s: %d",
+                (len > 0 ? ", " : ""), p->store.path.str, p->numa_node);
+    }
+    return len;
+}
+
+void server_numa_config_to_log()
+{
+    char node_buff[512];
+    char path_buff[1024];
+    int len;
+    int i;
+
+    if (!numa_ctx.enabled) {
+        logInfo("numa {enabled: 0}");
+        return;
+    }
+
+    len = 0;
+    *node_buff = '\0';
+    for (i=0; i<numa_ctx.topology.count && len<sizeof(node_buff); i++) {
+        len += snprintf(node_buff + len, sizeof(node_buff) - len,
+                "%snode%d: %d CPUs", (i > 0 ? ", " : ""),
+                numa_ctx.topology.nodes[i].node,
+                numa_ctx.topology.nodes[i].cpu_count);
+    }
+
+    *path_buff = '\0';
+    len = path_nodes_to_string(&STORAGE_CFG.store_path,
+            path_buff, sizeof(path_buff));
+    if (len < sizeof(path_buff) && STORAGE_CFG.write_cache.count > 0) {
+        path_nodes_to_string(&STORAGE_CFG.write_cache,
+                path_buff + len, sizeof(path_buff) - len);
+    }
+
+    logInfo("numa {enabled: 1, bind_memory: %d, nodes: [%s], "
+            "store path nodes: [%s]}", numa_ctx.bind_memory,
+            node_buff, path_buff);
+}
+
+int server_numa_data_thread_node(const int index, const int count)
+{
+    if (!numa_ctx.enabled) {
+        return FS_NUMA_NODE_NONE;
+    }
+
+    if (index < 0) {  //the only thread
+        return numa_ctx.topology.nodes[0].node;
+    }
+    return numa_ctx.topology.nodes[index * numa_ctx.
+        topology.count / count].node;
+}
+
+int server_numa_bind_thread(const int node)
+{
+#ifdef OS_LINUX
+    NUMANodeInfo *ninfo;
+    unsigned long nodemask[2];
+    int result;
+
+    if (!numa_ctx.enabled || (ninfo=get_node_info(node)) == NULL) {
+        return 0;
+    }
+
+    if ((result=pthread_setaffinity_np(pthread_self(),
+                    sizeof(cpu_set_t), &ninfo->cpuset)) != 0)
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "bind thread to the CPUs of NUMA node %d fail, "
+                "errno: %d, error info: %s", __LINE__,
+                node, result, STRERROR(result));
+        return result;
+    }
+
+    if (numa_ctx.bind_memory) {
+        fill_node_mask(nodemask, node);
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED,
+                    nodemask, NUMA_NODE_MASK_BITS) != 0)
+        {
+            result = errno != 0 ? errno : EPERM;
+            logWarning("file: "__FILE__", line: %d, "
+                    "set the memory policy of NUMA node %d fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    node, result, STRERROR(result));
+            return result;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+int server_numa_bind_memory(void *buff, const int64_t size, const int node)
+{
+#ifdef OS_LINUX
+    unsigned long nodemask[2];
+    long page_size;
+    long start;
+    long end;
+    int result;
+
+    if (!(numa_ctx.enabled && numa_ctx.bind_memory) ||
+            get_node_info(node) == NULL)
+    {
+        return 0;
+    }
+
+    page_size = getpagesize();
+    start = ((long)buff + page_size - 1) & (~(page_size - 1));
+    end = ((long)buff + size) & (~(page_size - 1));
+    if (end <= start) {
+        return 0;
+    }
+
+    fill_node_mask(nodemask, node);
+    if (syscall(SYS_mbind, start, end - start, MPOL_PREFERRED,
+                nodemask, NUMA_NODE_MASK_BITS, 0) != 0)
+    {
+        result = errno != 0 ? errno : EPERM;
+        logWarning("file: "__FILE__", line: %d, "
+                "bind the memory to NUMA node %d fail, "
+                "errno: %d, error info: %s", __LINE__,
+                node, result, STRERROR(result));
+        return result;
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+//server_numa.h
+
+#ifndef _SERVER_NUMA_H_
+#define _SERVER_NUMA_H_
+
+#include "fastcommon/common_define.h"
+#include "fastcommon/ini_file_reader.h"
+
+#define FS_NUMA_MAX_NODE_COUNT  64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* load the [numa] section and detect the NUMA topology and the local
+     * node of the store paths, MUST be called after the storage config
+     * loaded */
+    int server_numa_load_config(IniContext *ini_context,
+            const char *filename);
+
+    void server_numa_config_to_log();
+
+    bool server_numa_enabled();
+
+    /* the node for the data thread, the data threads are spread over
+     * the nodes in blocks, return -1 when NUMA disabled */
+    int server_numa_data_thread_node(const int index, const int count);
+
+    /* bind the current thread to the CPUs of the node and prefer
+     * the memory of the node, do nothing when NUMA disabled or node < 0 */
+    int server_numa_bind_thread(const int node);
+
+    /* prefer the memory of the node for the whole pages in the buffer,
+     * MUST be called before the first touch of the buffer */
+    int server_numa_bind_memory(void *buff, const int64_t size,
+            const int node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
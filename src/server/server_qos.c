@@ -0,0 +1,1178 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <sys/stat.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/hash.h"
+#include "fastcommon/ini_file_reader.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fast_mblock.h"
+#include "sf/sf_global.h"
+#include "server_global.h"
+#include "data_thread.h"
+#include "latency_stat.h"
+#include "server_qos.h"
+
+#define FS_QOS_ENTRY_TYPE_PUSH     'P'  //push to the data thread queue
+#define FS_QOS_ENTRY_TYPE_READ     'R'  //slice read by the service
+
+#define FS_QOS_CLIENT_HASHTABLE_CAPACITY  1361
+#define FS_QOS_CLIENT_EXPIRE_SECONDS      3600
+
+/* the max entries to scan in the class queue for the entry which tokens
+ * available, avoid the head client blocking others of the same class */
+#define FS_QOS_MAX_SCAN_COUNT   32
+
+#define FS_QOS_COST_UNIT_BYTES  4096
+#define FS_QOS_VTIME_SCALE      1000
+
+typedef struct {
+    char *buff;
+    char **ips;
+    int count;
+} FSQoSIPArray;
+
+typedef struct {
+    bool enabled;
+    int reload_interval;
+    int max_inflight;
+    int internal_reserved_percent;
+    int burst_seconds;
+    int weights[FS_QOS_PRIORITY_COUNT];
+    FSQoSLimit client;
+    FSQoSLimit data_group;
+    struct {
+        FSQoSLimit *limits;  //index by data group id - 1
+        int count;
+    } groups;
+    FSQoSIPArray high_ips;
+    FSQoSIPArray low_ips;
+} FSQoSConfig;
+
+typedef struct fs_qos_client {
+    char ip_addr[IP_ADDRESS_SIZE];
+    char priority;
+    int refer_count;   //the queued entries
+    time_t last_access_time;
+    FSQoSBuckets buckets;
+    struct fs_qos_client *next;  //for hashtable
+} FSQoSClient;
+
+typedef struct fs_qos_entry {
+    char type;    //FS_QOS_ENTRY_TYPE_xxx
+    char source;
+    short operation;
+    int bytes;
+    void *arg;
+    FSSliceOpContext *op_ctx;
+    FSQoSClient *client;   //NULL for internal
+    FSQoSBuckets *group;   //NULL for internal
+    struct fs_qos_entry *next;
+} FSQoSEntry;
+
+typedef struct {
+    int count;
+    int64_t vtime;  //the virtual time for weighted fair queueing
+    FSQoSEntry *head;
+    FSQoSEntry *tail;
+} FSQoSClassQueue;
+
+typedef struct {
+    char filename[PATH_MAX];
+    time_t mtime;
+    FSQoSConfig cfg;
+    int internal_quota;  //reserved in-flight operations for internal
+
+    pthread_lock_cond_pair_t lcp;
+    struct fast_mblock_man entry_allocator;  //element: FSQoSEntry
+    struct fast_mblock_man client_allocator; //element: FSQoSClient
+    FSQoSClient **clients;  //hashtable
+    FSQoSBuckets *groups;   //index by data group id - 1
+
+    FSQoSClassQueue queues[FS_QOS_PRIORITY_COUNT];
+    int queued_count;
+    int64_t vclock;  //the vtime of the last dispatched class
+    struct {
+        int external;
+        int internal;
+    } inflight;
+
+    struct {
+        int64_t admitted;
+        int64_t deferred;
+    } stat;
+} FSQoSContext;
+
+static FSQoSContext qos_ctx;
+
+static const char *priority_captions[FS_QOS_PRIORITY_COUNT] = {
+    "high", "normal", "low", "internal"
+};
+
+static int parse_ip_array(const char *filename, const char *item_name,
+        const char *value, FSQoSIPArray *array)
+{
+    int count;
+    int i;
+
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+
+    if ((array->buff=fc_strdup(value)) == NULL) {
+        return ENOMEM;
+    }
+
+    count = getOccurCount(value, ',') + 1;
+    array->ips = (char **)fc_malloc(sizeof(char *) * count);
+    if (array->ips == NULL) {
+        return ENOMEM;
+    }
+
+    array->count = splitEx(array->buff, ',', array->ips, count);
+    for (i=0; i<array->count; i++) {
+        array->ips[i] = fc_trim(array->ips[i]);
+        if (*array->ips[i] == '\0') {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s, item: %s, the %dth ip is empty",
+                    __LINE__, filename, item_name, i + 1);
+            return EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+static void free_ip_array(FSQoSIPArray *array)
+{
+    if (array->ips != NULL) {
+        free(array->ips);
+        array->ips = NULL;
+    }
+    if (array->buff != NULL) {
+        free(array->buff);
+        array->buff = NULL;
+    }
+    array->count = 0;
+}
+
+static bool ip_array_exists(const FSQoSIPArray *array, const char *ip_addr)
+{
+    int i;
+
+    for (i=0; i<array->count; i++) {
+        if (strcmp(array->ips[i], ip_addr) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void free_qos_config(FSQoSConfig *cfg)
+{
+    if (cfg->groups.limits != NULL) {
+        free(cfg->groups.limits);
+        cfg->groups.limits = NULL;
+        cfg->groups.count = 0;
+    }
+    free_ip_array(&cfg->high_ips);
+    free_ip_array(&cfg->low_ips);
+}
+
+static int load_bytes_value(IniContext *ini_context, const char *filename,
+        const char *section_name, const char *item_name,
+        const int64_t default_value, int64_t *bytes)
+{
+    int result;
+    char *value;
+
+    value = iniGetStrValue(section_name, item_name, ini_context);
+    if (value == NULL || *value == '\0') {
+        *bytes = default_value;
+        return 0;
+    }
+    if ((result=parse_bytes(value, 1, bytes)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, section: %s, item: %s, "
+                "value: %s is invalid", __LINE__, filename,
+                section_name, item_name, value);
+    }
+    return result;
+}
+
+static int load_limit(IniContext *ini_context, const char *filename,
+        const char *section_name, const FSQoSLimit *default_limit,
+        FSQoSLimit *limit)
+{
+    limit->iops = iniGetInt64Value(section_name, "iops_limit",
+            ini_context, default_limit->iops);
+    if (limit->iops < 0) {
+        limit->iops = 0;
+    }
+    return load_bytes_value(ini_context, filename, section_name,
+            "bandwidth_limit", default_limit->bandwidth,
+            &limit->bandwidth);
+}
+
+static int load_group_limits(IniContext *ini_context,
+        const char *filename, FSQoSConfig *cfg)
+{
+    char section_name[64];
+    FSQoSLimit *limit;
+    int data_group_id;
+    int result;
+
+    cfg->groups.count = FS_DATA_GROUP_COUNT(CLUSTER_CONFIG_CTX);
+    cfg->groups.limits = (FSQoSLimit *)fc_malloc(
+            sizeof(FSQoSLimit) * cfg->groups.count);
+    if (cfg->groups.limits == NULL) {
+        return ENOMEM;
+    }
+
+    for (data_group_id=1; data_group_id<=cfg->groups.count;
+            data_group_id++)
+    {
+        limit = cfg->groups.limits + (data_group_id - 1);
+        sprintf(section_name, "data-group-%d", data_group_id);
+        if ((result=load_limit(ini_context, filename, section_name,
+                        &cfg->data_group, limit)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int load_qos_config(const char *filename, FSQoSConfig *cfg)
+{
+    const FSQoSLimit unlimited = {0, 0};
+    IniContext ini_context;
+    int result;
+    int i;
+
+    memset(cfg, 0, sizeof(*cfg));
+    if ((result=iniLoadFromFile(filename, &ini_context)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "load conf file \"%s\" fail, ret code: %d",
+                __LINE__, filename, result);
+        return result;
+    }
+
+    do {
+        cfg->enabled = iniGetBoolValue(NULL, "enabled",
+                &ini_context, false);
+        cfg->reload_interval = iniGetIntValue(NULL, "reload_interval",
+                &ini_context, FS_QOS_DEFAULT_RELOAD_INTERVAL);
+        if (cfg->reload_interval < 0) {
+            cfg->reload_interval = 0;
+        }
+
+        cfg->max_inflight = iniGetIntValue(NULL, "max_inflight",
+                &ini_context, FS_QOS_DEFAULT_MAX_INFLIGHT);
+        if (cfg->max_inflight < 2) {
+            logWarning("file: "__FILE__", line: %d, "
+                    "config file: %s, max_inflight: %d is too small, "
+                    "set it to 2", __LINE__, filename, cfg->max_inflight);
+            cfg->max_inflight = 2;
+        }
+
+        cfg->internal_reserved_percent = iniGetIntValue(NULL,
+                "internal_reserved_percent", &ini_context,
+                FS_QOS_DEFAULT_INTERNAL_RESERVED_PERCENT);
+        if (cfg->internal_reserved_percent <= 0 ||
+                cfg->internal_reserved_percent >= 100)
+        {
+            logWarning("file: "__FILE__", line: %d, "
+                    "config file: %s, internal_reserved_percent: %d "
+                    "is invalid, set it to %d", __LINE__, filename,
+                    cfg->internal_reserved_percent,
+                    FS_QOS_DEFAULT_INTERNAL_RESERVED_PERCENT);
+            cfg->internal_reserved_percent =
+                FS_QOS_DEFAULT_INTERNAL_RESERVED_PERCENT;
+        }
+
+        cfg->burst_seconds = iniGetIntValue(NULL, "burst_seconds",
+                &ini_context, FS_QOS_DEFAULT_BURST_SECONDS);
+        if (cfg->burst_seconds <= 0) {
+            cfg->burst_seconds = FS_QOS_DEFAULT_BURST_SECONDS;
+        }
+
+        if ((result=load_limit(&ini_context, filename, "client",
+                        &unlimited, &cfg->client)) != 0)
+        {
+            break;
+        }
+        if ((result=load_limit(&ini_context, filename, "data-group",
+                        &unlimited, &cfg->data_group)) != 0)
+        {
+            break;
+        }
+        if ((result=load_group_limits(&ini_context, filename, cfg)) != 0) {
+            break;
+        }
+
+        cfg->weights[FS_QOS_PRIORITY_HIGH] = iniGetIntValue("priority",
+                "high_weight", &ini_context, FS_QOS_DEFAULT_HIGH_WEIGHT);
+        cfg->weights[FS_QOS_PRIORITY_NORMAL] = iniGetIntValue("priority",
+                "normal_weight", &ini_context, FS_QOS_DEFAULT_NORMAL_WEIGHT);
+        cfg->weights[FS_QOS_PRIORITY_LOW] = iniGetIntValue("priority",
+                "low_weight", &ini_context, FS_QOS_DEFAULT_LOW_WEIGHT);
+        cfg->weights[FS_QOS_PRIORITY_INTERNAL] = iniGetIntValue("priority",
+                "internal_weight", &ini_context,
+                FS_QOS_DEFAULT_INTERNAL_WEIGHT);
+        for (i=0; i<FS_QOS_PRIORITY_COUNT; i++) {
+            if (cfg->weights[i] <= 0) {
+                logWarning("file: "__FILE__", line: %d, "
+                        "config file: %s, %s_weight: %d is invalid, "
+                        "set it to 1", __LINE__, filename,
+                        priority_captions[i], cfg->weights[i]);
+                cfg->weights[i] = 1;
+            }
+        }
+
+        if ((result=parse_ip_array(filename, "high_ips", iniGetStrValue(
+                            "priority", "high_ips", &ini_context),
+                        &cfg->high_ips)) != 0)
+        {
+            break;
+        }
+        if ((result=parse_ip_array(filename, "low_ips", iniGetStrValue(
+                            "priority", "low_ips", &ini_context),
+                        &cfg->low_ips)) != 0)
+        {
+            break;
+        }
+    } while (0);
+
+    iniFreeContext(&ini_context);
+    if (result != 0) {
+        free_qos_config(cfg);
+    }
+    return result;
+}
+
+static int get_file_mtime(const char *filename, time_t *mtime)
+{
+    struct stat buf;
+    int result;
+
+    if (stat(filename, &buf) != 0) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "stat file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        return result;
+    }
+
+    *mtime = buf.st_mtime;
+    return 0;
+}
+
+int server_qos_load_config(const char *filename)
+{
+    int result;
+
+    snprintf(qos_ctx.filename, sizeof(qos_ctx.filename), "%s", filename);
+    if ((result=get_file_mtime(filename, &qos_ctx.mtime)) != 0) {
+        return result;
+    }
+    return load_qos_config(filename, &qos_ctx.cfg);
+}
+
+static inline int calc_internal_quota(const FSQoSConfig *cfg)
+{
+    int quota;
+
+    quota = cfg->max_inflight * cfg->internal_reserved_percent / 100;
+    if (quota <= 0) {
+        quota = 1;
+    } else if (quota >= cfg->max_inflight) {
+        quota = cfg->max_inflight - 1;
+    }
+    return quota;
+}
+
+static inline char get_client_priority(const char *ip_addr)
+{
+    if (ip_array_exists(&qos_ctx.cfg.high_ips, ip_addr)) {
+        return FS_QOS_PRIORITY_HIGH;
+    } else if (ip_array_exists(&qos_ctx.cfg.low_ips, ip_addr)) {
+        return FS_QOS_PRIORITY_LOW;
+    } else {
+        return FS_QOS_PRIORITY_NORMAL;
+    }
+}
+
+static inline void set_buckets_rate(FSQoSBuckets *buckets,
+        const FSQoSLimit *limit)
+{
+    fs_token_bucket_set_rate(&buckets->iops, limit->iops,
+            qos_ctx.cfg.burst_seconds);
+    fs_token_bucket_set_rate(&buckets->bytes, limit->bandwidth,
+            qos_ctx.cfg.burst_seconds);
+}
+
+static inline void init_buckets(FSQoSBuckets *buckets,
+        const FSQoSLimit *limit)
+{
+    fs_token_bucket_init(&buckets->iops, limit->iops,
+            qos_ctx.cfg.burst_seconds);
+    fs_token_bucket_init(&buckets->bytes, limit->bandwidth,
+            qos_ctx.cfg.burst_seconds);
+}
+
+static FSQoSClient *get_client(const char *ip_addr)
+{
+    FSQoSClient **bucket;
+    FSQoSClient *client;
+
+    bucket = qos_ctx.clients + ((unsigned int)simple_hash(ip_addr,
+                strlen(ip_addr)) % FS_QOS_CLIENT_HASHTABLE_CAPACITY);
+    client = *bucket;
+    while (client != NULL) {
+        if (strcmp(client->ip_addr, ip_addr) == 0) {
+            client->last_access_time = g_current_time;
+            return client;
+        }
+        client = client->next;
+    }
+
+    client = (FSQoSClient *)fast_mblock_alloc_object(
+            &qos_ctx.client_allocator);
+    if (client == NULL) {
+        return NULL;
+    }
+
+    snprintf(client->ip_addr, sizeof(client->ip_addr), "%s", ip_addr);
+    client->priority = get_client_priority(ip_addr);
+    client->refer_count = 0;
+    client->last_access_time = g_current_time;
+    init_buckets(&client->buckets, &qos_ctx.cfg.client);
+    client->next = *bucket;
+    *bucket = client;
+    return client;
+}
+
+static void expire_clients()
+{
+    FSQoSClient **bucket;
+    FSQoSClient **end;
+    FSQoSClient *previous;
+    FSQoSClient *client;
+    FSQoSClient *deleted;
+
+    end = qos_ctx.clients + FS_QOS_CLIENT_HASHTABLE_CAPACITY;
+    for (bucket=qos_ctx.clients; bucket<end; bucket++) {
+        previous = NULL;
+        client = *bucket;
+        while (client != NULL) {
+            if (client->refer_count == 0 && g_current_time -
+                    client->last_access_time > FS_QOS_CLIENT_EXPIRE_SECONDS)
+            {
+                deleted = client;
+                client = client->next;
+                if (previous == NULL) {
+                    *bucket = client;
+                } else {
+                    previous->next = client;
+                }
+                fast_mblock_free_object(&qos_ctx.client_allocator, deleted);
+            } else {
+                previous = client;
+                client = client->next;
+            }
+        }
+    }
+}
+
+static void apply_config()
+{
+    FSQoSClient **bucket;
+    FSQoSClient **end;
+    FSQoSClient *client;
+    int i;
+
+    qos_ctx.internal_quota = calc_internal_quota(&qos_ctx.cfg);
+    for (i=0; i<qos_ctx.cfg.groups.count; i++) {
+        set_buckets_rate(qos_ctx.groups + i, qos_ctx.cfg.groups.limits + i);
+    }
+
+    end = qos_ctx.clients + FS_QOS_CLIENT_HASHTABLE_CAPACITY;
+    for (bucket=qos_ctx.clients; bucket<end; bucket++) {
+        client = *bucket;
+        while (client != NULL) {
+            client->priority = get_client_priority(client->ip_addr);
+            set_buckets_rate(&client->buckets, &qos_ctx.cfg.client);
+            client = client->next;
+        }
+    }
+}
+
+static void check_reload_config()
+{
+    FSQoSConfig cfg;
+    FSQoSConfig old_cfg;
+    time_t mtime;
+
+    if (get_file_mtime(qos_ctx.filename, &mtime) != 0 ||
+            mtime == qos_ctx.mtime)
+    {
+        return;
+    }
+
+    if (load_qos_config(qos_ctx.filename, &cfg) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "reload QoS config file %s fail, keep the old config",
+                __LINE__, qos_ctx.filename);
+        qos_ctx.mtime = mtime;  //avoid reload again
+        return;
+    }
+
+    PTHREAD_MUTEX_LOCK(&qos_ctx.lcp.lock);
+    old_cfg = qos_ctx.cfg;
+    qos_ctx.cfg = cfg;
+    qos_ctx.mtime = mtime;
+    apply_config();
+    pthread_cond_signal(&qos_ctx.lcp.cond);
+    PTHREAD_MUTEX_UNLOCK(&qos_ctx.lcp.lock);
+
+    free_qos_config(&old_cfg);
+    logInfo("file: "__FILE__", line: %d, "
+            "QoS config file %s reloaded", __LINE__, qos_ctx.filename);
+    server_qos_config_to_log();
+}
+
+static inline bool inflight_available(const int priority)
+{
+    int total;
+
+    total = qos_ctx.inflight.external + qos_ctx.inflight.internal;
+    if (priority == FS_QOS_PRIORITY_INTERNAL) {
+        /* the internal traffic can use the reserved slots anytime,
+         * so the replication never blocked by the client operations */
+        return qos_ctx.inflight.internal < qos_ctx.internal_quota ||
+            total < qos_ctx.cfg.max_inflight;
+    } else {
+        return qos_ctx.inflight.external < qos_ctx.cfg.max_inflight -
+            qos_ctx.internal_quota && total < qos_ctx.cfg.max_inflight;
+    }
+}
+
+static inline bool buckets_available(FSQoSBuckets *buckets,
+        const int64_t current_time_us, int64_t *wait_us)
+{
+    int64_t iops_wait_us;
+    int64_t bytes_wait_us;
+
+    if (fs_token_bucket_available(&buckets->iops, current_time_us) &&
+            fs_token_bucket_available(&buckets->bytes, current_time_us))
+    {
+        return true;
+    }
+
+    iops_wait_us = fs_token_bucket_wait_us(&buckets->iops);
+    bytes_wait_us = fs_token_bucket_wait_us(&buckets->bytes);
+    if (bytes_wait_us > iops_wait_us) {
+        iops_wait_us = bytes_wait_us;
+    }
+    if (*wait_us == 0 || iops_wait_us < *wait_us) {
+        *wait_us = iops_wait_us;
+    }
+    return false;
+}
+
+static inline bool tokens_available(FSQoSEntry *entry,
+        const int64_t current_time_us, int64_t *wait_us)
+{
+    if (entry->client != NULL && !buckets_available(&entry->client->
+                buckets, current_time_us, wait_us))
+    {
+        return false;
+    }
+
+    if (entry->group != NULL && !buckets_available(entry->group,
+                current_time_us, wait_us))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static inline void consume_buckets(FSQoSBuckets *buckets, const int bytes)
+{
+    fs_token_bucket_consume(&buckets->iops, 1);
+    fs_token_bucket_consume(&buckets->bytes, bytes);
+}
+
+static void admit_entry(FSQoSEntry *entry, const int priority)
+{
+    FSQoSClassQueue *queue;
+
+    if (entry->client != NULL) {
+        consume_buckets(&entry->client->buckets, entry->bytes);
+    }
+    if (entry->group != NULL) {
+        consume_buckets(entry->group, entry->bytes);
+    }
+
+    queue = qos_ctx.queues + priority;
+    queue->vtime += (1 + entry->bytes / FS_QOS_COST_UNIT_BYTES) *
+        FS_QOS_VTIME_SCALE / qos_ctx.cfg.weights[priority];
+    qos_ctx.vclock = queue->vtime;
+
+    entry->op_ctx->qos.priority = priority;
+    entry->op_ctx->qos.inflight = true;
+    if (priority == FS_QOS_PRIORITY_INTERNAL) {
+        qos_ctx.inflight.internal++;
+    } else {
+        qos_ctx.inflight.external++;
+    }
+    qos_ctx.stat.admitted++;
+}
+
+static inline void release_inflight(FSSliceOpContext *op_ctx)
+{
+    if (!op_ctx->qos.inflight) {
+        return;
+    }
+
+    op_ctx->qos.inflight = false;
+    if (op_ctx->qos.priority == FS_QOS_PRIORITY_INTERNAL) {
+        qos_ctx.inflight.internal--;
+    } else {
+        qos_ctx.inflight.external--;
+    }
+}
+
+static inline bool check_admit(FSQoSEntry *entry, const int priority,
+        const int64_t current_time_us, int64_t *wait_us)
+{
+    if (!qos_ctx.cfg.enabled) {
+        entry->op_ctx->qos.inflight = false;
+        return true;
+    }
+
+    if (!(inflight_available(priority) && tokens_available(
+                    entry, current_time_us, wait_us)))
+    {
+        return false;
+    }
+
+    admit_entry(entry, priority);
+    return true;
+}
+
+static inline int execute_push(FSQoSEntry *entry)
+{
+    return push_to_data_thread_queue(entry->operation,
+            entry->source, entry->arg, entry->op_ctx);
+}
+
+static void push_fail_notify(FSQoSEntry *entry, const int result)
+{
+    FSDataOperation op;
+
+    logError("file: "__FILE__", line: %d, "
+            "push %s operation to data thread fail, "
+            "errno: %d, error info: %s", __LINE__,
+            fs_get_data_operation_caption(entry->operation),
+            result, STRERROR(result));
+
+    server_qos_done(entry->op_ctx);
+    memset(&op, 0, sizeof(op));
+    op.operation = entry->operation;
+    op.source = entry->source;
+    op.arg = entry->arg;
+    op.ctx = entry->op_ctx;
+    op.ctx->result = result;
+    op.ctx->notify_func(&op);
+}
+
+static void read_fail_notify(FSQoSEntry *entry, const int result)
+{
+    entry->op_ctx->result = result;
+    entry->op_ctx->rw_done_callback(entry->op_ctx, entry->op_ctx->arg);
+}
+
+static void enqueue_entry(FSQoSEntry *entry, const int priority)
+{
+    FSQoSClassQueue *queue;
+
+    queue = qos_ctx.queues + priority;
+    entry->next = NULL;
+    if (queue->tail == NULL) {
+        queue->head = entry;
+        /* the idle class can't accumulate the credit */
+        if (queue->vtime < qos_ctx.vclock) {
+            queue->vtime = qos_ctx.vclock;
+        }
+    } else {
+        queue->tail->next = entry;
+    }
+    queue->tail = entry;
+    queue->count++;
+    if (entry->client != NULL) {
+        entry->client->refer_count++;
+    }
+
+    qos_ctx.queued_count++;
+    qos_ctx.stat.deferred++;
+}
+
+static inline void remove_entry(FSQoSClassQueue *queue,
+        FSQoSEntry *previous, FSQoSEntry *entry)
+{
+    if (previous == NULL) {
+        queue->head = entry->next;
+    } else {
+        previous->next = entry->next;
+    }
+    if (queue->tail == entry) {
+        queue->tail = previous;
+    }
+    queue->count--;
+    if (entry->client != NULL) {
+        entry->client->refer_count--;
+    }
+    qos_ctx.queued_count--;
+}
+
+static FSQoSEntry *select_from_queue(const int priority,
+        const int64_t current_time_us, int64_t *wait_us)
+{
+    FSQoSClassQueue *queue;
+    FSQoSEntry *previous;
+    FSQoSEntry *entry;
+    int scan_count;
+
+    queue = qos_ctx.queues + priority;
+    if (qos_ctx.cfg.enabled && !inflight_available(priority)) {
+        return NULL;
+    }
+
+    /* the internal operations MUST be dealt in order for replication */
+    scan_count = (priority == FS_QOS_PRIORITY_INTERNAL) ?
+        1 : FS_QOS_MAX_SCAN_COUNT;
+    previous = NULL;
+    entry = queue->head;
+    while (entry != NULL && scan_count-- > 0) {
+        if (check_admit(entry, priority, current_time_us, wait_us)) {
+            remove_entry(queue, previous, entry);
+            return entry;
+        }
+        previous = entry;
+        entry = entry->next;
+    }
+
+    return NULL;
+}
+
+/* select the admitted entry from the class queues by weighted fair
+ * queueing, the class with the smallest virtual time first */
+static FSQoSEntry *select_entry(const int64_t current_time_us,
+        int64_t *wait_us)
+{
+    int priorities[FS_QOS_PRIORITY_COUNT];
+    FSQoSEntry *entry;
+    int count;
+    int priority;
+    int tmp;
+    int i;
+    int j;
+
+    count = 0;
+    for (priority=0; priority<FS_QOS_PRIORITY_COUNT; priority++) {
+        if (qos_ctx.queues[priority].head != NULL) {
+            priorities[count++] = priority;
+        }
+    }
+
+    for (i=1; i<count; i++) {
+        for (j=i; j>0 && qos_ctx.queues[priorities[j]].vtime <
+                qos_ctx.queues[priorities[j - 1]].vtime; j--)
+        {
+            tmp = priorities[j];
+            priorities[j] = priorities[j - 1];
+            priorities[j - 1] = tmp;
+        }
+    }
+
+    for (i=0; i<count; i++) {
+        if ((entry=select_from_queue(priorities[i], current_time_us,
+                        wait_us)) != NULL)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static inline int qos_slice_read(FSSliceOpContext *op_ctx)
+{
+    op_ctx->io_start_time_us = get_current_time_us();
+    latency_stat_add(FS_LATENCY_STAGE_QUEUE, FS_LATENCY_OP_READ,
+            op_ctx->io_start_time_us - op_ctx->start_time_us);
+    return fs_slice_read(op_ctx);
+}
+
+static void dispatcher_timedwait_us(const int64_t timeout_us)
+{
+    struct timeval tv;
+    struct timespec ts;
+    int64_t nsec;
+
+    gettimeofday(&tv, NULL);
+    nsec = ((int64_t)tv.tv_usec + timeout_us % 1000000) * 1000;
+    ts.tv_sec = tv.tv_sec + timeout_us / 1000000 + nsec / (1000 * 1000 * 1000);
+    ts.tv_nsec = nsec % (1000 * 1000 * 1000);
+    pthread_cond_timedwait(&qos_ctx.lcp.cond, &qos_ctx.lcp.lock, &ts);
+}
+
+static void dispatch_entries()
+{
+    FSQoSEntry *entry;
+    FSQoSEntry *reads;
+    FSQoSEntry *failed;
+    int64_t wait_us;
+    int dispatched;
+    int result;
+
+    reads = failed = NULL;
+    dispatched = 0;
+    wait_us = 0;
+    PTHREAD_MUTEX_LOCK(&qos_ctx.lcp.lock);
+    while ((entry=select_entry(get_current_time_us(), &wait_us)) != NULL) {
+        dispatched++;
+        if (entry->type == FS_QOS_ENTRY_TYPE_READ) {
+            entry->next = reads;
+            reads = entry;
+        } else if ((result=execute_push(entry)) != 0) {
+            /* push under the lock to keep the order of the operations */
+            entry->op_ctx->result = result;
+            entry->next = failed;
+            failed = entry;
+        } else {
+            fast_mblock_free_object(&qos_ctx.entry_allocator, entry);
+        }
+    }
+
+    if (dispatched == 0 && SF_G_CONTINUE_FLAG) {
+        if (qos_ctx.queued_count == 0) {
+            wait_us = 1000 * 1000;
+        } else if (wait_us <= 0 || wait_us > 100 * 1000) {
+            wait_us = 100 * 1000;  //wait for the in-flight operation done
+        } else if (wait_us < 1000) {
+            wait_us = 1000;
+        }
+        dispatcher_timedwait_us(wait_us);
+    }
+    PTHREAD_MUTEX_UNLOCK(&qos_ctx.lcp.lock);
+
+    while (failed != NULL) {
+        entry = failed;
+        failed = failed->next;
+        push_fail_notify(entry, entry->op_ctx->result);
+        fast_mblock_free_object(&qos_ctx.entry_allocator, entry);
+    }
+
+    while (reads != NULL) {
+        entry = reads;
+        reads = reads->next;
+        if ((result=qos_slice_read(entry->op_ctx)) != 0) {
+            server_qos_done(entry->op_ctx);
+            read_fail_notify(entry, result);
+        }
+        fast_mblock_free_object(&qos_ctx.entry_allocator, entry);
+    }
+}
+
+static void *qos_dispatcher_thread_func(void *arg)
+{
+    time_t last_check_time;
+    time_t last_expire_time;
+    time_t last_log_time;
+
+#ifdef OS_LINUX
+    prctl(PR_SET_NAME, "qos-dispatcher");
+#endif
+
+    last_check_time = last_expire_time = last_log_time = g_current_time;
+    while (SF_G_CONTINUE_FLAG) {
+        dispatch_entries();
+
+        if (qos_ctx.cfg.reload_interval > 0 && g_current_time -
+                last_check_time >= qos_ctx.cfg.reload_interval)
+        {
+            check_reload_config();
+            last_check_time = g_current_time;
+        }
+
+        if (g_current_time - last_expire_time >= 60) {
+            PTHREAD_MUTEX_LOCK(&qos_ctx.lcp.lock);
+            expire_clients();
+            PTHREAD_MUTEX_UNLOCK(&qos_ctx.lcp.lock);
+            last_expire_time = g_current_time;
+        }
+
+        if (g_current_time - last_log_time >= 3600) {
+            if (qos_ctx.stat.deferred > 0) {
+                logInfo("file: "__FILE__", line: %d, "
+                        "QoS admitted count: %"PRId64", "
+                        "deferred count: %"PRId64, __LINE__,
+                        qos_ctx.stat.admitted, qos_ctx.stat.deferred);
+                qos_ctx.stat.admitted = 0;
+                qos_ctx.stat.deferred = 0;
+            }
+            last_log_time = g_current_time;
+        }
+    }
+
+    return NULL;
+}
+
+int server_qos_init()
+{
+    int result;
+    int i;
+    pthread_t tid;
+
+    if (*qos_ctx.filename == '\0') {
+        return 0;   //no QoS config
+    }
+
+    if ((result=init_pthread_lock_cond_pair(&qos_ctx.lcp)) != 0) {
+        return result;
+    }
+
+    if ((result=fast_mblock_init_ex1(&qos_ctx.entry_allocator,
+                    "qos_entry", sizeof(FSQoSEntry),
+                    4096, 0, NULL, NULL, false)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=fast_mblock_init_ex1(&qos_ctx.client_allocator,
+                    "qos_client", sizeof(FSQoSClient),
+                    1024, 0, NULL, NULL, false)) != 0)
+    {
+        return result;
+    }
+
+    qos_ctx.clients = (FSQoSClient **)fc_malloc(sizeof(FSQoSClient *) *
+            FS_QOS_CLIENT_HASHTABLE_CAPACITY);
+    if (qos_ctx.clients == NULL) {
+        return ENOMEM;
+    }
+    memset(qos_ctx.clients, 0, sizeof(FSQoSClient *) *
+            FS_QOS_CLIENT_HASHTABLE_CAPACITY);
+
+    qos_ctx.groups = (FSQoSBuckets *)fc_malloc(sizeof(FSQoSBuckets) *
+            qos_ctx.cfg.groups.count);
+    if (qos_ctx.groups == NULL) {
+        return ENOMEM;
+    }
+    for (i=0; i<qos_ctx.cfg.groups.count; i++) {
+        init_buckets(qos_ctx.groups + i, qos_ctx.cfg.groups.limits + i);
+    }
+    qos_ctx.internal_quota = calc_internal_quota(&qos_ctx.cfg);
+
+    return fc_create_thread(&tid, qos_dispatcher_thread_func,
+            NULL, SF_G_THREAD_STACK_SIZE);
+}
+
+/* the operations of the slave data groups and the recovery
+ * belong to the internal class without token buckets */
+static inline void init_entry(FSQoSEntry *entry,
+        struct fast_task_info *task, int *priority)
+{
+    int data_group_id;
+
+    if (entry->source == DATA_SOURCE_MASTER_SERVICE && task != NULL) {
+        entry->client = get_client(task->client_ip);
+        data_group_id = entry->op_ctx->info.data_group_id;
+        if (data_group_id > 0 && data_group_id <=
+                qos_ctx.cfg.groups.count)
+        {
+            entry->group = qos_ctx.groups + (data_group_id - 1);
+        } else {
+            entry->group = NULL;
+        }
+        *priority = (entry->client != NULL) ? entry->client->priority :
+            FS_QOS_PRIORITY_NORMAL;
+    } else {
+        entry->client = NULL;
+        entry->group = NULL;
+        *priority = FS_QOS_PRIORITY_INTERNAL;
+    }
+}
+
+static int qos_submit(FSQoSEntry *entry, struct fast_task_info *task,
+        bool *admitted)
+{
+    FSQoSEntry *qentry;
+    int64_t wait_us;
+    int priority;
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&qos_ctx.lcp.lock);
+    init_entry(entry, task, &priority);
+    wait_us = 0;
+    if (qos_ctx.queued_count == 0 && check_admit(entry, priority,
+                get_current_time_us(), &wait_us))
+    {
+        *admitted = true;
+        if (entry->type == FS_QOS_ENTRY_TYPE_PUSH) {
+            if ((result=execute_push(entry)) != 0) {
+                release_inflight(entry->op_ctx);
+            }
+        } else {
+            result = 0;
+        }
+    } else {
+        *admitted = false;
+        if ((qentry=(FSQoSEntry *)fast_mblock_alloc_object(
+                        &qos_ctx.entry_allocator)) == NULL)
+        {
+            result = ENOMEM;
+        } else {
+            *qentry = *entry;
+            enqueue_entry(qentry, priority);
+            pthread_cond_signal(&qos_ctx.lcp.cond);
+            result = 0;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&qos_ctx.lcp.lock);
+
+    return result;
+}
+
+int server_qos_push_to_data_queue(struct fast_task_info *task,
+        const int operation, const int source, void *arg,
+        FSSliceOpContext *op_ctx)
+{
+    FSQoSEntry entry;
+    bool admitted;
+
+    op_ctx->qos.inflight = false;
+    if (qos_ctx.clients == NULL) {  //QoS not configured
+        return push_to_data_thread_queue(operation, source, arg, op_ctx);
+    }
+
+    entry.type = FS_QOS_ENTRY_TYPE_PUSH;
+    entry.operation = operation;
+    entry.source = source;
+    entry.arg = arg;
+    entry.op_ctx = op_ctx;
+    entry.bytes = (operation == DATA_OPERATION_SLICE_WRITE) ?
+        op_ctx->info.bs_key.slice.length : 0;
+    return qos_submit(&entry, task, &admitted);
+}
+
+int server_qos_slice_read(struct fast_task_info *task,
+        FSSliceOpContext *op_ctx)
+{
+    FSQoSEntry entry;
+    bool admitted;
+    int result;
+
+    op_ctx->qos.inflight = false;
+    if (qos_ctx.clients == NULL) {  //QoS not configured
+        return qos_slice_read(op_ctx);
+    }
+
+    entry.type = FS_QOS_ENTRY_TYPE_READ;
+    entry.operation = DATA_OPERATION_SLICE_READ;
+    entry.source = DATA_SOURCE_MASTER_SERVICE;
+    entry.arg = task;
+    entry.op_ctx = op_ctx;
+    entry.bytes = op_ctx->info.bs_key.slice.length;
+    if ((result=qos_submit(&entry, task, &admitted)) != 0) {
+        return result;
+    }
+
+    if (admitted && (result=qos_slice_read(op_ctx)) != 0) {
+        server_qos_done(op_ctx);
+    }
+    return result;
+}
+
+void server_qos_done(FSSliceOpContext *op_ctx)
+{
+    if (!op_ctx->qos.inflight) {
+        return;
+    }
+
+    PTHREAD_MUTEX_LOCK(&qos_ctx.lcp.lock);
+    release_inflight(op_ctx);
+    if (qos_ctx.queued_count > 0) {
+        pthread_cond_signal(&qos_ctx.lcp.cond);
+    }
+    PTHREAD_MUTEX_UNLOCK(&qos_ctx.lcp.lock);
+}
+
+static void limit_to_string(const FSQoSLimit *limit,
+        char *buff, const int size)
+{
+    int len;
+
+    if (limit->iops > 0) {
+        len = snprintf(buff, size, "iops_limit: %"PRId64, limit->iops);
+    } else {
+        len = snprintf(buff, size, "iops_limit: unlimited");
+    }
+
+    if (limit->bandwidth > 0) {
+        snprintf(buff + len, size - len, ", bandwidth_limit: %"PRId64" KB",
+                limit->bandwidth / 1024);
+    } else {
+        snprintf(buff + len, size - len, ", bandwidth_limit: unlimited");
+    }
+}
+
+void server_qos_config_to_log()
+{
+    char client_limit[128];
+    char group_limit[128];
+
+    if (*qos_ctx.filename == '\0') {
+        logInfo("QoS config file not set, QoS disabled");
+        return;
+    }
+
+    limit_to_string(&qos_ctx.cfg.client, client_limit,
+            sizeof(client_limit));
+    limit_to_string(&qos_ctx.cfg.data_group, group_limit,
+            sizeof(group_limit));
+    logInfo("QoS config, config file: %s, enabled: %d, "
+            "reload_interval: %d s, max_inflight: %d, "
+            "internal_reserved_percent: %d%%, burst_seconds: %d, "
+            "client {%s}, data-group {%s}, priority weight "
+            "{high: %d, normal: %d, low: %d, internal: %d}, "
+            "high_ips count: %d, low_ips count: %d",
+            qos_ctx.filename, qos_ctx.cfg.enabled,
+            qos_ctx.cfg.reload_interval, qos_ctx.cfg.max_inflight,
+            qos_ctx.cfg.internal_reserved_percent,
+            qos_ctx.cfg.burst_seconds, client_limit, group_limit,
+            qos_ctx.cfg.weights[FS_QOS_PRIORITY_HIGH],
+            qos_ctx.cfg.weights[FS_QOS_PRIORITY_NORMAL],
+            qos_ctx.cfg.weights[FS_QOS_PRIORITY_LOW],
+            qos_ctx.cfg.weights[FS_QOS_PRIORITY_INTERNAL],
+            qos_ctx.cfg.high_ips.count, qos_ctx.cfg.low_ips.count);
+}
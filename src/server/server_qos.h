@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//server_qos.h
+
+#ifndef _SERVER_QOS_H_
+#define _SERVER_QOS_H_
+
+#include "fastcommon/common_define.h"
+#include "fastcommon/shared_func.h"
+#include "sf/sf_types.h"
+#include "storage/storage_types.h"
+
+#define FS_QOS_PRIORITY_HIGH       0
+#define FS_QOS_PRIORITY_NORMAL     1
+#define FS_QOS_PRIORITY_LOW        2
+#define FS_QOS_PRIORITY_INTERNAL   3  //recovery and replication
+#define FS_QOS_PRIORITY_COUNT      4
+
+#define FS_QOS_DEFAULT_RELOAD_INTERVAL         10
+#define FS_QOS_DEFAULT_MAX_INFLIGHT          1024
+#define FS_QOS_DEFAULT_INTERNAL_RESERVED_PERCENT 20
+#define FS_QOS_DEFAULT_BURST_SECONDS            1
+
+#define FS_QOS_DEFAULT_HIGH_WEIGHT              8
+#define FS_QOS_DEFAULT_NORMAL_WEIGHT            4
+#define FS_QOS_DEFAULT_LOW_WEIGHT               1
+#define FS_QOS_DEFAULT_INTERNAL_WEIGHT          2
+
+typedef struct fs_token_bucket {
+    int64_t rate;      //tokens per second, 0 for unlimited
+    int64_t capacity;  //the max tokens for burst
+    int64_t tokens;    //maybe negative as the debt of the large request
+    int64_t last_time_us;
+} FSTokenBucket;
+
+typedef struct fs_qos_limit {
+    int64_t iops;       //0 for unlimited
+    int64_t bandwidth;  //bytes per second, 0 for unlimited
+} FSQoSLimit;
+
+typedef struct fs_qos_buckets {
+    FSTokenBucket iops;
+    FSTokenBucket bytes;
+} FSQoSBuckets;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    static inline void fs_token_bucket_init(FSTokenBucket *bucket,
+            const int64_t rate, const int burst_seconds)
+    {
+        bucket->rate = rate;
+        bucket->capacity = rate * burst_seconds;
+        bucket->tokens = bucket->capacity;
+        bucket->last_time_us = get_current_time_us();
+    }
+
+    /* keep the current tokens when the rate changed */
+    static inline void fs_token_bucket_set_rate(FSTokenBucket *bucket,
+            const int64_t rate, const int burst_seconds)
+    {
+        bucket->rate = rate;
+        bucket->capacity = rate * burst_seconds;
+        if (bucket->tokens > bucket->capacity) {
+            bucket->tokens = bucket->capacity;
+        }
+    }
+
+    static inline void fs_token_bucket_refill(FSTokenBucket *bucket,
+            const int64_t current_time_us)
+    {
+        int64_t elapsed;
+        int64_t tokens;
+
+        if (bucket->rate <= 0) {
+            return;
+        }
+
+        elapsed = current_time_us - bucket->last_time_us;
+        if (elapsed <= 0) {
+            return;
+        }
+
+        tokens = bucket->rate * elapsed / 1000000;
+        if (tokens == 0) {
+            return;  //keep last_time_us to accumulate the fraction
+        }
+
+        bucket->tokens += tokens;
+        if (bucket->tokens > bucket->capacity) {
+            bucket->tokens = bucket->capacity;
+        }
+        bucket->last_time_us = current_time_us;
+    }
+
+    static inline bool fs_token_bucket_available(FSTokenBucket *bucket,
+            const int64_t current_time_us)
+    {
+        if (bucket->rate <= 0) {
+            return true;
+        }
+
+        fs_token_bucket_refill(bucket, current_time_us);
+        return bucket->tokens > 0;
+    }
+
+    /* the tokens can be overdrawn by one request, so the large request
+     * will not be starved and the debt paid by the later requests */
+    static inline void fs_token_bucket_consume(FSTokenBucket *bucket,
+            const int64_t tokens)
+    {
+        if (bucket->rate > 0) {
+            bucket->tokens -= tokens;
+        }
+    }
+
+    /* the microseconds to wait for the tokens available */
+    static inline int64_t fs_token_bucket_wait_us(FSTokenBucket *bucket)
+    {
+        if (bucket->rate <= 0 || bucket->tokens > 0) {
+            return 0;
+        }
+        return (1 - bucket->tokens) * 1000000 / bucket->rate + 1;
+    }
+
+    int server_qos_load_config(const char *filename);
+
+    int server_qos_init();
+
+    void server_qos_config_to_log();
+
+    /* push the data update operation to the data thread queue with QoS,
+     * the operation maybe deferred by the QoS scheduler, the caller MUST
+     * call server_qos_done when the operation done */
+    int server_qos_push_to_data_queue(struct fast_task_info *task,
+            const int operation, const int source, void *arg,
+            FSSliceOpContext *op_ctx);
+
+    /* the slice read of the service with QoS, the rw_done_callback
+     * of the op_ctx will be called when the slice read done or fail */
+    int server_qos_slice_read(struct fast_task_info *task,
+            FSSliceOpContext *op_ctx);
+
+    /* release the in-flight slot of the admitted operation */
+    void server_qos_done(FSSliceOpContext *op_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
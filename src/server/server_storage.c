@@ -21,13 +21,22 @@
 #include "fastcommon/logger.h"
 #include "fastcommon/sockopt.h"
 #include "fastcommon/shared_func.h"
+#include "../common/fs_crc32c.h"
 #include "binlog/trunk_binlog.h"
+#include "storage/raw_device.h"
+#include "storage/space_discarder.h"
+#include "storage/slice_dedup.h"
 #include "server_storage.h"
 
 int server_storage_init()
 {
     int result;
 
+    fs_crc32c_init();
+    if ((result=raw_device_init()) != 0) {
+        return result;
+    }
+
     if ((result=storage_allocator_init()) != 0) {
         return result;
     }
@@ -36,6 +45,10 @@ int server_storage_init()
         return result;
     }
 
+    if ((result=raw_device_flush_bitmaps()) != 0) {
+        return result;
+    }
+
     if ((result=ob_index_init()) != 0) {
         return result;
     }
@@ -44,6 +57,14 @@ int server_storage_init()
         return result;
     }
 
+    if ((result=space_discarder_init()) != 0) {
+        return result;
+    }
+
+    if ((result=slice_dedup_init()) != 0) {
+        return result;
+    }
+
     return 0;
 }
 
@@ -83,6 +83,10 @@
 #define FS_MIN_SLAVE_BINLOG_CHECK_LAST_ROWS              0
 #define FS_MAX_SLAVE_BINLOG_CHECK_LAST_ROWS            128
 
+#define FS_DEFAULT_SLAVE_READ_WAIT_MS                   50
+#define FS_MIN_SLAVE_READ_WAIT_MS                        0
+#define FS_MAX_SLAVE_READ_WAIT_MS                     5000
+
 #define FS_DEFAULT_TRUNK_FILE_SIZE  (256 * 1024 * 1024LL)
 #define FS_TRUNK_FILE_MIN_SIZE      ( 64 * 1024 * 1024LL)
 #define FS_TRUNK_FILE_MAX_SIZE      (  4 * 1024 * 1024 * 1024LL)
@@ -91,6 +95,20 @@
 #define FS_DISCARD_REMAIN_SPACE_MIN_SIZE       256
 #define FS_DISCARD_REMAIN_SPACE_MAX_SIZE      (256 * 1024)
 
+#define FS_DEFAULT_SCRUB_READ_BYTES_PER_SECOND  (32 * 1024 * 1024)
+#define FS_DEFAULT_SCRUB_ROUND_INTERVAL         (7 * 86400)
+#define FS_DEFAULT_SPACE_DISCARD_DELAY_SECONDS  10
+#define FS_DEFAULT_DEDUP_MIN_SLICE_SIZE         (64 * 1024)
+#define FS_DEFAULT_DEDUP_INDEX_MEMORY_LIMIT     (256 * 1024 * 1024)
+
+#define FS_WRITE_DURABILITY_NONE_INT        'N'
+#define FS_WRITE_DURABILITY_FDATASYNC_INT   'F'
+#define FS_WRITE_DURABILITY_DSYNC_INT       'D'
+
+#define FS_WRITE_DURABILITY_NONE_STR        "none"
+#define FS_WRITE_DURABILITY_FDATASYNC_STR   "fdatasync"
+#define FS_WRITE_DURABILITY_DSYNC_STR       "dsync"
+
 #define TASK_STATUS_CONTINUE   12345
 
 #define FS_SERVER_STATUS_OFFLINE    0
@@ -142,7 +160,6 @@
 #define REPLICA_READER       TASK_CTX.shared.replica.reader
 #define IDEMPOTENCY_CHANNEL  TASK_CTX.shared.service.idempotency_channel
 #define IDEMPOTENCY_REQUEST  TASK_CTX.service.idempotency_request
-#define WAITING_RPC_COUNT    TASK_CTX.service.waiting_rpc_count
 #define SERVER_TASK_TYPE  TASK_CTX.task_type
 #define SLICE_OP_CTX      TASK_CTX.slice_op_ctx
 #define OP_CTX_INFO       TASK_CTX.slice_op_ctx.info
@@ -155,6 +172,7 @@ typedef void (*server_free_func_ex)(void *ctx, void *ptr);
 
 typedef struct {
     int inc_alloc;
+    uint64_t data_version;
 } FSUpdateOutput;  //for idempotency
 
 struct fs_replication;
@@ -271,6 +289,21 @@ typedef struct fs_cluster_data_group_info {
     FSClusterDataServerPtrArray slave_ds_array;
     FSClusterDataServerInfo *myself;
     volatile FSClusterDataServerInfo *master;
+
+    struct {
+        char type;       //FS_COMPRESS_TYPE_xxx
+        int skip_count;  //skip the slices when the data does not compress
+        int backoff;     //the next skip count
+    } compress;
+
+    struct {
+        char policy;     //FS_WRITE_ACK_POLICY_xxx
+        int quorum;      //the data servers to persist including the master
+    } write_ack;
+
+    /* the trunk space used by the slices of this data group on myself,
+       the space shared by the slices is counted to the first referrer */
+    volatile int64_t used_space;
 } FSClusterDataGroupInfo;
 
 typedef struct fs_cluster_data_group_array {
@@ -279,10 +312,11 @@ typedef struct fs_cluster_data_group_array {
     int base_id;
 } FSClusterDataGroupArray;
 
+struct replication_rpc_entry;
 typedef struct fs_rpc_result_entry {
     uint64_t data_version;
     time_t expires;
-    struct fast_task_info *waiting_task;
+    struct replication_rpc_entry *rpc;  //waiting for the response
     struct fs_rpc_result_entry *next;
 } FSReplicaRPCResultEntry;
 
@@ -367,7 +401,6 @@ typedef struct {
 
     struct {
         struct idempotency_request *idempotency_request;
-        volatile int waiting_rpc_count;
     } service;
 
     int which_side;   //master or slave
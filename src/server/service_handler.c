@@ -49,6 +49,10 @@
 #include "server_func.h"
 #include "server_group_info.h"
 #include "server_storage.h"
+#include "server_qos.h"
+#include "slave_read_waiter.h"
+#include "background_throttle.h"
+#include "latency_stat.h"
 #include "server_binlog.h"
 #include "data_thread.h"
 #include "common_handler.h"
@@ -99,6 +103,25 @@ void service_task_finish_cleanup(struct fast_task_info *task)
     sf_task_finish_clean_up(task);
 }
 
+static void pack_data_thread_stat(const FSDataThreadStat *stat,
+        FSProtoDataThreadStat *proto_stat)
+{
+    int2buff(stat->thread_count, proto_stat->thread_count);
+    int2buff(stat->busy_count, proto_stat->busy_count);
+    int2buff(stat->waiting_count, proto_stat->waiting_count);
+    int2buff(stat->max_waiting_count, proto_stat->max_waiting_count);
+    long2buff(stat->done_count, proto_stat->done_count);
+    long2buff(stat->stolen_count, proto_stat->stolen_count);
+    long2buff(stat->donated_count, proto_stat->donated_count);
+}
+
+static inline void pack_throttle_rate_stat(const FSThrottleRateStat *stat,
+        FSProtoThrottleRateStat *proto_stat)
+{
+    long2buff(stat->current, proto_stat->current);
+    long2buff(stat->target, proto_stat->target);
+}
+
 static int service_deal_service_stat(struct fast_task_info *task)
 {
     int result;
@@ -107,6 +130,9 @@ static int service_deal_service_stat(struct fast_task_info *task)
     int64_t ob_count;
     int64_t slice_count;
     FSBinlogWriterStat writer_stat;
+    FSDataThreadStat master_thread_stat;
+    FSDataThreadStat slave_thread_stat;
+    FSBackgroundThrottleStat throttle_stat;
     FSClusterDataGroupInfo *group;
     FSProtoServiceStatReq *req;
     FSProtoServiceStatResp *stat_resp;
@@ -135,6 +161,8 @@ static int service_deal_service_stat(struct fast_task_info *task)
         replica_binlog_writer_stat(data_group_id, &writer_stat);
     }
     ob_index_get_ob_and_slice_counts(&ob_count, &slice_count);
+    data_thread_stat(&master_thread_stat, &slave_thread_stat);
+    background_throttle_stat(&throttle_stat);
 
     stat_resp = (FSProtoServiceStatResp *)SF_PROTO_RESP_BODY(task);
     stat_resp->is_leader  = CLUSTER_MYSELF_PTR == CLUSTER_LEADER_PTR ? 1 : 0;
@@ -151,6 +179,20 @@ static int service_deal_service_stat(struct fast_task_info *task)
     long2buff(ob_count, stat_resp->data.ob_count);
     long2buff(slice_count, stat_resp->data.slice_count);
 
+    pack_data_thread_stat(&master_thread_stat,
+            &stat_resp->data_thread.master);
+    pack_data_thread_stat(&slave_thread_stat,
+            &stat_resp->data_thread.slave);
+
+    int2buff(throttle_stat.latency_p99,
+            stat_resp->background_throttle.latency_p99);
+    int2buff(throttle_stat.queue_depth,
+            stat_resp->background_throttle.queue_depth);
+    pack_throttle_rate_stat(&throttle_stat.recovery,
+            &stat_resp->background_throttle.recovery);
+    pack_throttle_rate_stat(&throttle_stat.reclaim,
+            &stat_resp->background_throttle.reclaim);
+
     RESPONSE.header.body_len = sizeof(FSProtoServiceStatResp);
     RESPONSE.header.cmd = FS_SERVICE_PROTO_SERVICE_STAT_RESP;
     TASK_CTX.common.response_done = true;
@@ -160,6 +202,7 @@ static int service_deal_service_stat(struct fast_task_info *task)
 static int service_deal_slice_read(struct fast_task_info *task)
 {
     int result;
+    uint64_t data_version;
     FSProtoServiceSliceReadReq *req;
 
     OP_CTX_INFO.deal_done = false;
@@ -186,13 +229,39 @@ static int service_deal_slice_read(struct fast_task_info *task)
         return EOVERFLOW;
     }
 
+    /* the data version of the client session for read your writes */
+    data_version = buff2long(req->data_version);
+    if (data_version > 0 && SLAVE_READ_WAIT_MS == 0 && FC_ATOMIC_GET(
+                OP_CTX_INFO.myself->data.version) < data_version)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "data group id: %d, my data version: %"PRIu64" < "
+                "the session data version: %"PRIu64, OP_CTX_INFO.
+                data_group_id, FC_ATOMIC_GET(OP_CTX_INFO.myself->
+                    data.version), data_version);
+        TASK_CTX.common.log_level = LOG_DEBUG;
+        return EAGAIN;
+    }
+
     sf_hold_task(task);
     OP_CTX_INFO.source = BINLOG_SOURCE_RPC_MASTER;
     OP_CTX_INFO.buff = SF_PROTO_RESP_BODY(task);
     SLICE_OP_CTX.rw_done_callback = (fs_rw_done_callback_func)
         du_handler_slice_read_done_callback;
     SLICE_OP_CTX.arg = task;
-    if ((result=fs_slice_read(&SLICE_OP_CTX)) != 0) {
+    if (data_version > 0 && FC_ATOMIC_GET(OP_CTX_INFO.
+                myself->data.version) < data_version)
+    {
+        if ((result=slave_read_waiter_push(task, &SLICE_OP_CTX,
+                        data_version)) != 0)
+        {
+            sf_release_task(task);
+            return result;
+        }
+        return TASK_STATUS_CONTINUE;
+    }
+
+    if ((result=server_qos_slice_read(task, &SLICE_OP_CTX)) != 0) {
         TASK_CTX.common.log_level = result == ENOENT ? LOG_DEBUG : LOG_ERR;
         du_handler_set_slice_op_error_msg(task, &SLICE_OP_CTX,
                 "slice read", result);
@@ -425,6 +494,79 @@ static int service_deal_disk_space_stat(struct fast_task_info *task)
     return 0;
 }
 
+static int service_deal_latency_stat(struct fast_task_info *task)
+{
+    int result;
+    int count;
+    FSLatencyStatEntry entries[FS_LATENCY_STAGE_COUNT * FS_LATENCY_OP_COUNT];
+    FSLatencyStatEntry *entry;
+    FSLatencyStatEntry *end;
+    FSProtoLatencyStatRespBodyHeader *body_header;
+    FSProtoLatencyStatRespBodyPart *body_part;
+
+    if ((result=server_expect_body_length(0)) != 0) {
+        return result;
+    }
+
+    if ((result=latency_stat_get(entries, sizeof(entries) /
+                    sizeof(entries[0]), &count)) != 0)
+    {
+        return result;
+    }
+
+    body_header = (FSProtoLatencyStatRespBodyHeader *)
+        SF_PROTO_RESP_BODY(task);
+    body_part = (FSProtoLatencyStatRespBodyPart *)(body_header + 1);
+    end = entries + count;
+    for (entry=entries; entry<end; entry++, body_part++) {
+        body_part->stage = entry->stage;
+        body_part->op_type = entry->op_type;
+        long2buff(entry->count, body_part->count);
+        int2buff(entry->avg, body_part->avg);
+        int2buff(entry->max, body_part->max);
+        int2buff(entry->p50, body_part->p50);
+        int2buff(entry->p90, body_part->p90);
+        int2buff(entry->p99, body_part->p99);
+        int2buff(entry->p999, body_part->p999);
+    }
+
+    int2buff(count, body_header->count);
+    RESPONSE.header.body_len = (char *)body_part - SF_PROTO_RESP_BODY(task);
+    RESPONSE.header.cmd = FS_SERVICE_PROTO_LATENCY_STAT_RESP;
+    TASK_CTX.common.response_done = true;
+    return 0;
+}
+
+static int service_deal_dg_space_stat(struct fast_task_info *task)
+{
+    int result;
+    FSProtoDGSpaceStatRespBodyHeader *body_header;
+    FSProtoDGSpaceStatRespBodyPart *body_part;
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *end;
+
+    if ((result=server_expect_body_length(0)) != 0) {
+        return result;
+    }
+
+    body_header = (FSProtoDGSpaceStatRespBodyHeader *)
+        SF_PROTO_RESP_BODY(task);
+    body_part = (FSProtoDGSpaceStatRespBodyPart *)(body_header + 1);
+    end = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<end;
+            group++, body_part++)
+    {
+        int2buff(group->id, body_part->data_group_id);
+        long2buff(FC_ATOMIC_GET(group->used_space), body_part->used);
+    }
+
+    int2buff(CLUSTER_DATA_RGOUP_ARRAY.count, body_header->count);
+    RESPONSE.header.body_len = (char *)body_part - SF_PROTO_RESP_BODY(task);
+    RESPONSE.header.cmd = FS_SERVICE_PROTO_DG_SPACE_STAT_RESP;
+    TASK_CTX.common.response_done = true;
+    return 0;
+}
+
 static int service_update_prepare_and_check(struct fast_task_info *task,
         const int resp_cmd)
 {
@@ -447,7 +589,8 @@ static int service_update_prepare_and_check(struct fast_task_info *task,
                     if (result == 0) {
                         du_handler_fill_slice_update_response(task,
                                 ((FSUpdateOutput *)request->output.
-                                 response)->inc_alloc);
+                                 response)->inc_alloc, ((FSUpdateOutput *)
+                                    request->output.response)->data_version);
                         RESPONSE.header.cmd = resp_cmd;
                     } else {
                         TASK_CTX.common.log_level = LOG_WARNING;
@@ -554,6 +697,24 @@ static inline int service_deal_block_delete(struct fast_task_info *task)
     return result;
 }
 
+static inline int service_deal_block_clone(struct fast_task_info *task)
+{
+    int result;
+
+    result = service_update_prepare_and_check(task,
+            FS_SERVICE_PROTO_BLOCK_CLONE_RESP);
+    if (result != 0 || OP_CTX_INFO.deal_done) {
+        return result;
+    }
+
+    if ((result=du_handler_deal_block_clone(task, &SLICE_OP_CTX)) !=
+            TASK_STATUS_CONTINUE)
+    {
+        du_handler_idempotency_request_finish(task, result);
+    }
+    return result;
+}
+
 static int service_check_priv(struct fast_task_info *task)
 {
     FCFSAuthValidatePriviledgeType priv_type;
@@ -578,6 +739,7 @@ static int service_check_priv(struct fast_task_info *task)
             case FS_SERVICE_PROTO_SLICE_ALLOCATE_REQ:
             case FS_SERVICE_PROTO_SLICE_DELETE_REQ:
             case FS_SERVICE_PROTO_BLOCK_DELETE_REQ:
+            case FS_SERVICE_PROTO_BLOCK_CLONE_REQ:
                 priv_type = fcfs_auth_validate_priv_type_pool_fstore;
                 the_priv = FCFS_AUTH_POOL_ACCESS_WRITE;
                 break;
@@ -590,6 +752,8 @@ static int service_check_priv(struct fast_task_info *task)
             case FS_SERVICE_PROTO_SERVICE_STAT_REQ:
             case FS_SERVICE_PROTO_CLUSTER_STAT_REQ:
             case FS_SERVICE_PROTO_DISK_SPACE_STAT_REQ:
+            case FS_SERVICE_PROTO_LATENCY_STAT_REQ:
+            case FS_SERVICE_PROTO_DG_SPACE_STAT_REQ:
                 priv_type = fcfs_auth_validate_priv_type_user;
                 the_priv = FCFS_AUTH_USER_PRIV_MONITOR_CLUSTER;
                 break;
@@ -629,6 +793,9 @@ static int service_process(struct fast_task_info *task)
         case FS_SERVICE_PROTO_BLOCK_DELETE_REQ:
             result = service_deal_block_delete(task);
             break;
+        case FS_SERVICE_PROTO_BLOCK_CLONE_REQ:
+            result = service_deal_block_clone(task);
+            break;
         case FS_SERVICE_PROTO_SLICE_READ_REQ:
             result = service_deal_slice_read(task);
             break;
@@ -648,6 +815,12 @@ static int service_process(struct fast_task_info *task)
         case FS_SERVICE_PROTO_DISK_SPACE_STAT_REQ:
             result = service_deal_disk_space_stat(task);
             break;
+        case FS_SERVICE_PROTO_LATENCY_STAT_REQ:
+            result = service_deal_latency_stat(task);
+            break;
+        case FS_SERVICE_PROTO_DG_SPACE_STAT_REQ:
+            result = service_deal_dg_space_stat(task);
+            break;
         case SF_SERVICE_PROTO_SETUP_CHANNEL_REQ:
             if ((result=sf_server_deal_setup_channel(task,
                             &SERVER_TASK_TYPE, &IDEMPOTENCY_CHANNEL,
@@ -705,6 +878,7 @@ int service_deal_task(struct fast_task_info *task, const int stage)
         }
     } else {
         sf_proto_init_task_context(task, &TASK_CTX.common);
+        SLICE_OP_CTX.start_time_us = get_current_time_us();  //the receipt
         if (AUTH_ENABLED) {
             if ((result=service_check_priv(task)) == 0) {
                 result = service_process(task);
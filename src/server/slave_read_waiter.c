@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fast_mblock.h"
+#include "fastcommon/sched_thread.h"
+#include "sf/sf_global.h"
+#include "server_global.h"
+#include "server_qos.h"
+#include "slave_read_waiter.h"
+
+typedef struct slave_read_wait_entry {
+    struct fast_task_info *task;
+    FSSliceOpContext *op_ctx;
+    uint64_t data_version;  //the min data version to serve the read
+    int64_t expires_ms;
+    struct slave_read_wait_entry *next;
+} SlaveReadWaitEntry;
+
+typedef struct {
+    struct fast_mblock_man allocator; //element: SlaveReadWaitEntry
+    pthread_lock_cond_pair_t lcp;     //for the pushed reads and the notify
+    SlaveReadWaitEntry *pushed;   //the new reads, protected by lcp
+    bool notified;                //data version changed, protected by lcp
+    SlaveReadWaitEntry *waiting;  //the parked reads, owned by the thread
+
+    struct {
+        int64_t done_count;
+        int64_t timeout_count;
+    } stat;
+} SlaveReadWaiterContext;
+
+static SlaveReadWaiterContext waiter_ctx;
+volatile int g_slave_read_waiting_count = 0;
+
+int slave_read_waiter_push(struct fast_task_info *task,
+        FSSliceOpContext *op_ctx, const uint64_t data_version)
+{
+    SlaveReadWaitEntry *entry;
+
+    entry = (SlaveReadWaitEntry *)fast_mblock_alloc_object(
+            &waiter_ctx.allocator);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    op_ctx->qos.inflight = false;
+    entry->task = task;
+    entry->op_ctx = op_ctx;
+    entry->data_version = data_version;
+    entry->expires_ms = get_current_time_ms() + SLAVE_READ_WAIT_MS;
+
+    PTHREAD_MUTEX_LOCK(&waiter_ctx.lcp.lock);
+    entry->next = waiter_ctx.pushed;
+    waiter_ctx.pushed = entry;
+    __sync_add_and_fetch(&g_slave_read_waiting_count, 1);
+    pthread_cond_signal(&waiter_ctx.lcp.cond);
+    PTHREAD_MUTEX_UNLOCK(&waiter_ctx.lcp.lock);
+    return 0;
+}
+
+void slave_read_waiter_wakeup()
+{
+    PTHREAD_MUTEX_LOCK(&waiter_ctx.lcp.lock);
+    waiter_ctx.notified = true;
+    pthread_cond_signal(&waiter_ctx.lcp.cond);
+    PTHREAD_MUTEX_UNLOCK(&waiter_ctx.lcp.lock);
+}
+
+static inline void read_fail_notify(FSSliceOpContext *op_ctx,
+        const int result)
+{
+    op_ctx->io_start_time_us = get_current_time_us();
+    op_ctx->result = result;
+    op_ctx->rw_done_callback(op_ctx, op_ctx->arg);
+}
+
+/* return the min expire time of the parked reads */
+static int64_t deal_waiting_entries()
+{
+    SlaveReadWaitEntry *entry;
+    SlaveReadWaitEntry *previous;
+    SlaveReadWaitEntry *next;
+    int64_t current_time_ms;
+    int64_t min_expires_ms;
+    int result;
+
+    current_time_ms = get_current_time_ms();
+    min_expires_ms = INT64_MAX;
+    previous = NULL;
+    entry = waiter_ctx.waiting;
+    while (entry != NULL) {
+        next = entry->next;
+        if (FC_ATOMIC_GET(entry->op_ctx->info.myself->data.version) >=
+                entry->data_version)
+        {
+            if ((result=server_qos_slice_read(entry->task,
+                            entry->op_ctx)) != 0)
+            {
+                read_fail_notify(entry->op_ctx, result);
+            }
+            waiter_ctx.stat.done_count++;
+        } else if (current_time_ms >= entry->expires_ms ||
+                !SF_G_CONTINUE_FLAG)
+        {
+            /* the client will fallback to read from the master */
+            read_fail_notify(entry->op_ctx, EAGAIN);
+            waiter_ctx.stat.timeout_count++;
+        } else {
+            if (entry->expires_ms < min_expires_ms) {
+                min_expires_ms = entry->expires_ms;
+            }
+            previous = entry;
+            entry = next;
+            continue;
+        }
+
+        if (previous == NULL) {
+            waiter_ctx.waiting = next;
+        } else {
+            previous->next = next;
+        }
+        fast_mblock_free_object(&waiter_ctx.allocator, entry);
+        __sync_sub_and_fetch(&g_slave_read_waiting_count, 1);
+        entry = next;
+    }
+
+    return min_expires_ms;
+}
+
+static inline void waiter_timedwait_ms(const int64_t timeout_ms)
+{
+    struct timeval tv;
+    struct timespec ts;
+    int64_t nsec;
+
+    gettimeofday(&tv, NULL);
+    nsec = (int64_t)tv.tv_usec * 1000 + (timeout_ms % 1000) * 1000 * 1000;
+    ts.tv_sec = tv.tv_sec + timeout_ms / 1000 + nsec / (1000 * 1000 * 1000);
+    ts.tv_nsec = nsec % (1000 * 1000 * 1000);
+    pthread_cond_timedwait(&waiter_ctx.lcp.cond,
+            &waiter_ctx.lcp.lock, &ts);
+}
+
+/* wait for the new reads, the data version change or the read expired */
+static SlaveReadWaitEntry *fetch_pushed_entries(const int64_t expires_ms)
+{
+    SlaveReadWaitEntry *head;
+    int64_t timeout_ms;
+
+    PTHREAD_MUTEX_LOCK(&waiter_ctx.lcp.lock);
+    if (waiter_ctx.pushed == NULL && !waiter_ctx.notified) {
+        /* wakeup every second for the quit check */
+        timeout_ms = expires_ms - get_current_time_ms();
+        if (timeout_ms > 1000) {
+            timeout_ms = 1000;
+        }
+        if (timeout_ms > 0) {
+            waiter_timedwait_ms(timeout_ms);
+        }
+    }
+    head = waiter_ctx.pushed;
+    waiter_ctx.pushed = NULL;
+    waiter_ctx.notified = false;
+    PTHREAD_MUTEX_UNLOCK(&waiter_ctx.lcp.lock);
+
+    return head;
+}
+
+static void *slave_read_waiter_thread_func(void *arg)
+{
+    SlaveReadWaitEntry *head;
+    SlaveReadWaitEntry *tail;
+    int64_t expires_ms;
+    time_t last_log_time;
+
+#ifdef OS_LINUX
+    prctl(PR_SET_NAME, "slave-read-waiter");
+#endif
+
+    expires_ms = INT64_MAX;
+    last_log_time = g_current_time;
+    while (SF_G_CONTINUE_FLAG) {
+        if ((head=fetch_pushed_entries(expires_ms)) != NULL) {
+            tail = head;
+            while (tail->next != NULL) {
+                tail = tail->next;
+            }
+            tail->next = waiter_ctx.waiting;
+            waiter_ctx.waiting = head;
+        }
+
+        if (waiter_ctx.waiting != NULL) {
+            expires_ms = deal_waiting_entries();
+        } else {
+            expires_ms = INT64_MAX;
+        }
+
+        if (g_current_time - last_log_time >= 3600) {
+            if (waiter_ctx.stat.timeout_count > 0) {
+                logInfo("file: "__FILE__", line: %d, "
+                        "slave read wait done count: %"PRId64", "
+                        "timeout count: %"PRId64, __LINE__,
+                        waiter_ctx.stat.done_count,
+                        waiter_ctx.stat.timeout_count);
+            }
+            waiter_ctx.stat.done_count = 0;
+            waiter_ctx.stat.timeout_count = 0;
+            last_log_time = g_current_time;
+        }
+    }
+
+    return NULL;
+}
+
+int slave_read_waiter_init()
+{
+    int result;
+    pthread_t tid;
+
+    if (SLAVE_READ_WAIT_MS == 0) {
+        return 0;
+    }
+
+    if ((result=fast_mblock_init_ex1(&waiter_ctx.allocator,
+                    "slave_read_wait_entry", sizeof(SlaveReadWaitEntry),
+                    1024, 0, NULL, NULL, true)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=init_pthread_lock_cond_pair(&waiter_ctx.lcp)) != 0) {
+        return result;
+    }
+
+    return fc_create_thread(&tid, slave_read_waiter_thread_func,
+            NULL, SF_G_THREAD_STACK_SIZE);
+}
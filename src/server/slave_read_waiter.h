@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+//slave_read_waiter.h
+
+#ifndef _SLAVE_READ_WAITER_H_
+#define _SLAVE_READ_WAITER_H_
+
+#include "fastcommon/common_define.h"
+#include "sf/sf_types.h"
+#include "storage/storage_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    extern volatile int g_slave_read_waiting_count;
+
+    int slave_read_waiter_init();
+
+    /* park the service read until my data version of the data group
+     * reaches the data version of the client session, or fail it with
+     * EAGAIN when SLAVE_READ_WAIT_MS expires. the task MUST be held and
+     * the op_ctx MUST be ready for server_qos_slice_read */
+    int slave_read_waiter_push(struct fast_task_info *task,
+            FSSliceOpContext *op_ctx, const uint64_t data_version);
+
+    void slave_read_waiter_wakeup();
+
+    /* called after my data version advanced to serve the parked reads */
+    static inline void slave_read_waiter_notify()
+    {
+        if (__sync_add_and_fetch(&g_slave_read_waiting_count, 0) > 0) {
+            slave_read_waiter_wakeup();
+        }
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
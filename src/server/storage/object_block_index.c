@@ -14,6 +14,7 @@
  */
 
 #include <limits.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
@@ -22,6 +23,7 @@
 #include "../server_global.h"
 #include "../binlog/slice_binlog.h"
 #include "storage_allocator.h"
+#include "space_discarder.h"
 #include "object_block_index.h"
 
 #define SLICE_ARRAY_FIXED_COUNT  64
@@ -205,6 +207,8 @@ OBSliceEntry *ob_index_alloc_slice_ex(OBHashtable *htable,
                 &allocator->slice);
         if (slice != NULL) {
             slice->ob = ob;
+            slice->checksum.valid = false;
+            slice->compress.type = FS_COMPRESS_TYPE_NONE;
             if (init_refer > 0) {
                 __sync_add_and_fetch(&slice->ref_count, init_refer);
             }
@@ -415,10 +419,47 @@ void ob_index_destroy()
 {
 }
 
-static inline int do_delete_slice(OBHashtable *htable,
-        OBEntry *ob, OBSliceEntry *slice)
+/* discard the space of the slice range [start, end) */
+static void discard_slice_space(OBSliceEntry *slice,
+        const int start, const int end)
+{
+    int slice_end;
+    int range_start;
+    int range_end;
+
+    if (slice->type != OB_SLICE_TYPE_FILE) {
+        return;
+    }
+
+    /* the compressed space may be shared by the split slices,
+       the space discarder skips the range still referred */
+    if (slice->compress.type != FS_COMPRESS_TYPE_NONE) {
+        space_discarder_push(&slice->space, slice->space.offset,
+                slice->compress.length);
+        return;
+    }
+
+    slice_end = slice->ssize.offset + slice->ssize.length;
+    if (start <= slice->ssize.offset && end >= slice_end) {
+        space_discarder_push(&slice->space, slice->space.offset,
+                slice->space.size);  //including the align padding
+    } else {
+        range_start = FC_MAX(start, slice->ssize.offset);
+        range_end = FC_MIN(end, slice_end);
+        space_discarder_push(&slice->space, slice->space.offset +
+                (range_start - slice->ssize.offset),
+                range_end - range_start);
+    }
+}
+
+static inline int do_delete_slice(OBHashtable *htable, OBEntry *ob,
+        OBSliceEntry *slice, const int start, const int end)
 {
     if (htable->modify_sallocator) {
+        if (STORAGE_CFG.space_discard.enabled) {
+            //must before the space free for the trunk generation
+            discard_slice_space(slice, start, end);
+        }
         storage_allocator_delete_slice(slice,
                 htable->modify_used_space);
     }
@@ -456,14 +497,26 @@ static inline OBSliceEntry *slice_dup(const OBSliceEntry *src,
     slice->ob = src->ob;
     slice->type = src->type;
     slice->space = src->space;
+    slice->compress = src->compress;
     extra_offset = offset - src->ssize.offset;
     if (extra_offset > 0) {
-        slice->space.offset += extra_offset;
+        if (src->compress.type == FS_COMPRESS_TYPE_NONE) {
+            slice->space.offset += extra_offset;
+        } else {  //the compressed data can't be split
+            slice->compress.offset += extra_offset;
+        }
         slice->ssize.offset = offset;
     } else {
         slice->ssize.offset = src->ssize.offset;
     }
     slice->ssize.length = length;
+    if (slice->ssize.offset == src->ssize.offset &&
+            length == src->ssize.length)
+    {
+        slice->checksum = src->checksum;
+    } else {
+        slice->checksum.valid = false;
+    }
     __sync_add_and_fetch(&slice->ref_count, 1);
     return slice;
 }
@@ -506,7 +559,13 @@ static inline int dup_slice_to_smart_array(const OBSliceEntry *src_slice,
         return ENOMEM;
     }
 
-    new_slice->space.size = length;  //for calculating trunk used bytes correctly
+    //for calculating trunk used bytes correctly
+    if (src_slice->compress.type == FS_COMPRESS_TYPE_NONE) {
+        new_slice->space.size = length;
+    } else {
+        new_slice->space.size = src_slice->space.size *
+            length / src_slice->ssize.length;
+    }
     return add_to_slice_ptr_smart_array(array, new_slice);
 }
 
@@ -623,7 +682,8 @@ static int add_slice(OBHashtable *htable, OBEntry *ob,
     }
 
     for (i=0; i<del_slice_array.count; i++) {
-        do_delete_slice(htable, ob, del_slice_array.slices[i]);
+        do_delete_slice(htable, ob, del_slice_array.slices[i],
+                slice->ssize.offset, slice_end);
     }
     FREE_SLICE_PTR_ARRAY(del_slice_array);
 
@@ -785,7 +845,8 @@ static int delete_slices(OBHashtable *htable, OBEntry *ob,
 
     *count = del_slice_array.count;
     for (i=0; i<del_slice_array.count; i++) {
-        do_delete_slice(htable, ob, del_slice_array.slices[i]);
+        do_delete_slice(htable, ob, del_slice_array.slices[i],
+                bs_key->slice.offset, slice_end);
     }
     FREE_SLICE_PTR_ARRAY(del_slice_array);
 
@@ -866,6 +927,9 @@ int ob_index_delete_block_ex(OBHashtable *htable,
         while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
             *dec_alloc += slice->ssize.length;
             if (htable->modify_sallocator) {
+                if (STORAGE_CFG.space_discard.enabled) {
+                    discard_slice_space(slice, 0, INT_MAX);
+                }
                 storage_allocator_delete_slice(slice,
                         htable->modify_used_space);
             }
@@ -1121,6 +1185,230 @@ int ob_index_get_slices_ex(OBHashtable *htable,
     return result;
 }
 
+static inline FSTrunkAllocator *get_slice_trunk_allocator(
+        const OBSliceEntry *slice)
+{
+    return g_allocator_mgr->allocator_ptr_array.
+        allocators[slice->space.store->index];
+}
+
+static int pin_slice_trunk(const OBSliceEntry *slice)
+{
+    FSTrunkAllocator *allocator;
+    int64_t generation;
+
+    allocator = get_slice_trunk_allocator(slice);
+    if (trunk_allocator_get_trunk(allocator, slice->space.
+                id_info.id, &generation) == NULL)
+    {
+        return ENOENT;
+    }
+
+    /* the trunk generation is stable because the slice is alive,
+       the pin fails only when the trunk is reclaiming */
+    if (trunk_allocator_pin_trunk(allocator, slice->space.id_info.id,
+                generation, slice->space.offset,
+                FS_SLICE_DATA_LENGTH(slice)) == NULL)
+    {
+        return EAGAIN;
+    }
+    return 0;
+}
+
+static void unpin_slice_trunk(const OBSliceEntry *slice)
+{
+    FSTrunkAllocator *allocator;
+    FSTrunkFileInfo *trunk;
+    int64_t generation;
+
+    allocator = get_slice_trunk_allocator(slice);
+    if ((trunk=trunk_allocator_get_trunk(allocator, slice->space.
+                    id_info.id, &generation)) != NULL)
+    {
+        trunk_allocator_unpin_trunk(allocator, trunk);
+    }
+}
+
+void ob_index_release_clone_slices(OBSlicePtrArray *sarray)
+{
+    OBSliceEntry **pp;
+    OBSliceEntry **end;
+
+    end = sarray->slices + sarray->count;
+    for (pp=sarray->slices; pp<end; pp++) {
+        unpin_slice_trunk(*pp);
+        ob_index_free_slice(*pp);
+    }
+    sarray->count = 0;
+}
+
+int ob_index_get_clone_slices(const FSBlockKey *bkey,
+        OBSlicePtrArray *sarray)
+{
+    const bool is_reclaim = false;
+    OBEntry *ob;
+    OBSliceEntry *slice;
+    UniqSkiplistIterator it;
+    int result;
+
+    OB_INDEX_SET_BUCKET_AND_LOCK(&g_ob_hashtable, *bkey);
+    sarray->count = 0;
+    result = 0;
+    PTHREAD_MUTEX_LOCK(&lcp->lock);
+    ob = get_ob_entry(bucket, bkey, false);
+    if (ob != NULL) {
+        CHECK_AND_WAIT_RECLAIM_DONE(lcp, ob);
+        uniq_skiplist_iterator(ob->slices, &it);
+        while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+            if ((result=pin_slice_trunk(slice)) != 0) {
+                break;
+            }
+            if ((result=add_to_slice_ptr_array(sarray, slice)) != 0) {
+                unpin_slice_trunk(slice);
+                break;
+            }
+            __sync_add_and_fetch(&slice->ref_count, 1);
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+
+    if (result != 0) {
+        ob_index_release_clone_slices(sarray);
+        return result;
+    }
+    return sarray->count > 0 ? 0 : ENOENT;
+}
+
+int ob_index_replace_block_slices(FSSliceSNPairArray *sarray,
+        uint64_t *del_sn, int *dec_alloc, int *inc_alloc)
+{
+    const bool is_reclaim = false;
+    const int init_level_count = 2;
+    OBHashtable *htable;
+    OBEntry *ob;
+    OBSliceEntry *slice;
+    UniqSkiplist *slices;
+    FSSliceSNPair *slice_sn_pair;
+    FSSliceSNPair *slice_sn_end;
+    UniqSkiplistIterator it;
+    int result;
+
+    *del_sn = 0;
+    *dec_alloc = *inc_alloc = 0;
+    if (sarray->count == 0) {
+        return EINVAL;
+    }
+
+    htable = &g_ob_hashtable;
+    ob = sarray->slice_sn_pairs[0].slice->ob;
+    slice_sn_end = sarray->slice_sn_pairs + sarray->count;
+    OB_INDEX_SET_HASHTABLE_LOCK(htable, ob->bkey);
+    OB_INDEX_SET_HASHTABLE_ALLOCATOR(ob->bkey);
+    PTHREAD_MUTEX_LOCK(&lcp->lock);
+    do {
+        CHECK_AND_WAIT_RECLAIM_DONE(lcp, ob);
+        if ((slices=uniq_skiplist_new(&allocator->factory,
+                        init_level_count)) == NULL)
+        {
+            result = ENOMEM;
+            break;
+        }
+
+        result = 0;
+        for (slice_sn_pair=sarray->slice_sn_pairs; slice_sn_pair<
+                slice_sn_end; slice_sn_pair++)
+        {
+            if ((result=uniq_skiplist_insert(slices,
+                            slice_sn_pair->slice)) != 0)
+            {
+                break;
+            }
+            __sync_add_and_fetch(&slice_sn_pair->slice->ref_count, 1);
+        }
+        if (result != 0) {
+            uniq_skiplist_free(slices);  //release the refs of the slices
+            break;
+        }
+
+        uniq_skiplist_iterator(ob->slices, &it);
+        while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+            *dec_alloc += slice->ssize.length;
+            if (htable->modify_sallocator) {
+                if (STORAGE_CFG.space_discard.enabled) {
+                    discard_slice_space(slice, 0, INT_MAX);
+                }
+                storage_allocator_delete_slice(slice,
+                        htable->modify_used_space);
+            }
+        }
+        if (*dec_alloc > 0) {
+            *del_sn = __sync_add_and_fetch(&SLICE_BINLOG_SN, 1);
+        }
+        uniq_skiplist_free(ob->slices);
+        ob->slices = slices;
+
+        for (slice_sn_pair=sarray->slice_sn_pairs; slice_sn_pair<
+                slice_sn_end; slice_sn_pair++)
+        {
+            *inc_alloc += slice_sn_pair->slice->ssize.length;
+            /* the trunk is pinned by the clone, the error is out of
+               memory only and the slice is in the index already */
+            if (htable->modify_sallocator && storage_allocator_add_slice(
+                        slice_sn_pair->slice, htable->modify_used_space) != 0)
+            {
+                logError("file: "__FILE__", line: %d, "
+                        "block {oid: %"PRId64", offset: %"PRId64"}, "
+                        "add the cloned slice to the trunk fail",
+                        __LINE__, ob->bkey.oid, ob->bkey.offset);
+            }
+            slice_sn_pair->sn = __sync_add_and_fetch(&SLICE_BINLOG_SN, 1);
+        }
+    } while (0);
+    PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+
+    return result;
+}
+
+int ob_index_get_checksum_slices(const int64_t bucket_index,
+        OBSlicePtrArray *sarray)
+{
+    int result;
+    OBEntry *ob;
+    OBSliceEntry *slice;
+    UniqSkiplistIterator it;
+    pthread_lock_cond_pair_t *lcp;
+
+    result = 0;
+    sarray->count = 0;
+    lcp = ob_shared_ctx.lock_array.pairs + bucket_index %
+        ob_shared_ctx.lock_array.count;
+    PTHREAD_MUTEX_LOCK(&lcp->lock);
+    ob = g_ob_hashtable.buckets[bucket_index];
+    while (ob != NULL && result == 0) {
+        uniq_skiplist_iterator(ob->slices, &it);
+        while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+            if (!(slice->type == OB_SLICE_TYPE_FILE &&
+                        slice->checksum.valid))
+            {
+                continue;
+            }
+
+            if ((result=add_to_slice_ptr_array(sarray, slice)) != 0) {
+                break;
+            }
+            __sync_add_and_fetch(&slice->ref_count, 1);
+        }
+
+        ob = ob->next;
+    }
+    PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+
+    if (result != 0) {
+        free_slices(sarray);
+    }
+    return result;
+}
+
 void ob_index_get_ob_and_slice_counts(int64_t *ob_count, int64_t *slice_count)
 {
     OBSharedAllocator *allocator;
@@ -1261,3 +1549,185 @@ int ob_index_dump_slices_to_trunk_ex(OBHashtable *htable,
     free(sarray.slices);
     return result;
 }
+
+static int write_dump_buffer(int fd, const char *filename,
+        const char *buff, const int len)
+{
+    int result;
+
+    if (fc_safe_write(fd, buff, len) != len) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "write to file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+int ob_index_dump_slices_to_file(const char *filename,
+        const time_t current_time, int64_t *slice_count)
+{
+    const int buffer_size = 1024 * 1024;
+    OBEntry **bucket;
+    OBEntry **end;
+    OBEntry *ob;
+    OBSliceEntry *slice;
+    UniqSkiplistIterator it;
+    char *buff;
+    int fd;
+    int len;
+    int result;
+
+    *slice_count = 0;
+    if ((buff=(char *)fc_malloc(buffer_size)) == NULL) {
+        return ENOMEM;
+    }
+
+    if ((fd=open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        free(buff);
+        return result;
+    }
+
+    len = 0;
+    result = 0;
+    end = g_ob_hashtable.buckets + g_ob_hashtable.capacity;
+    for (bucket=g_ob_hashtable.buckets; bucket<end &&
+            result == 0; bucket++)
+    {
+        if (*bucket == NULL) {
+            continue;
+        }
+
+        ob = *bucket;
+        do {
+            uniq_skiplist_iterator(ob->slices, &it);
+            while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+                if (buffer_size - len < FS_SLICE_BINLOG_MAX_RECORD_SIZE) {
+                    if ((result=write_dump_buffer(fd, filename,
+                                    buff, len)) != 0)
+                    {
+                        break;
+                    }
+                    len = 0;
+                }
+
+                /* the data version 0 as the internal record */
+                len += slice_binlog_pack_add_slice(slice, current_time,
+                        0, BINLOG_SOURCE_COMPACT, buff + len);
+                (*slice_count)++;
+            }
+
+            ob = ob->next;
+        } while (ob != NULL && result == 0);
+    }
+
+    if (result == 0 && len > 0) {
+        result = write_dump_buffer(fd, filename, buff, len);
+    }
+    if (result == 0 && fsync(fd) != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "fsync file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+    }
+
+    close(fd);
+    free(buff);
+    return result;
+}
+
+int ob_index_dump_replica_binlog_to_file(const int data_group_id,
+        const uint64_t data_version, const time_t current_time,
+        const char *filename, int64_t *slice_count)
+{
+    const int buffer_size = 1024 * 1024;
+    const int record_max_size = 128;
+    int64_t bucket_index;
+    pthread_lock_cond_pair_t *lcp;
+    OBEntry *ob;
+    OBSliceEntry *slice;
+    UniqSkiplistIterator it;
+    char *buff;
+    int fd;
+    int len;
+    int op_type;
+    int result;
+
+    *slice_count = 0;
+    if ((buff=(char *)fc_malloc(buffer_size)) == NULL) {
+        return ENOMEM;
+    }
+
+    if ((fd=open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        free(buff);
+        return result;
+    }
+
+    len = 0;
+    result = 0;
+    for (bucket_index=0; bucket_index<g_ob_hashtable.capacity &&
+            result == 0; bucket_index++)
+    {
+        lcp = ob_shared_ctx.lock_array.pairs + bucket_index %
+            ob_shared_ctx.lock_array.count;
+        PTHREAD_MUTEX_LOCK(&lcp->lock);
+        ob = g_ob_hashtable.buckets[bucket_index];
+        while (ob != NULL && result == 0) {
+            if (FS_DATA_GROUP_ID(ob->bkey) != data_group_id) {
+                ob = ob->next;
+                continue;
+            }
+
+            uniq_skiplist_iterator(ob->slices, &it);
+            while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+                if (buffer_size - len < record_max_size) {
+                    if ((result=write_dump_buffer(fd, filename,
+                                    buff, len)) != 0)
+                    {
+                        break;
+                    }
+                    len = 0;
+                }
+
+                if (slice->type == OB_SLICE_TYPE_FILE) {
+                    op_type = BINLOG_OP_TYPE_WRITE_SLICE;
+                } else {
+                    op_type = BINLOG_OP_TYPE_ALLOC_SLICE;
+                }
+                len += sprintf(buff + len, "%"PRId64" %"PRId64" %c %c "
+                        "%"PRId64" %"PRId64" %d %d\n", (int64_t)current_time,
+                        data_version, BINLOG_SOURCE_COMPACT, op_type,
+                        ob->bkey.oid, ob->bkey.offset, slice->ssize.offset,
+                        slice->ssize.length);
+                (*slice_count)++;
+            }
+
+            ob = ob->next;
+        }
+        PTHREAD_MUTEX_UNLOCK(&lcp->lock);
+    }
+
+    if (result == 0 && len > 0) {
+        result = write_dump_buffer(fd, filename, buff, len);
+    }
+    if (result == 0 && fsync(fd) != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "fsync file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+    }
+
+    close(fd);
+    free(buff);
+    return result;
+}
@@ -135,10 +135,43 @@ extern "C" {
     void ob_index_get_ob_and_slice_counts(int64_t *ob_count,
             int64_t *slice_count);
 
+    /* get the in file slices with checksum of the bucket, the caller
+     * should call ob_index_free_slice for each slice */
+    int ob_index_get_checksum_slices(const int64_t bucket_index,
+            OBSlicePtrArray *sarray);
+
+    /* get all slices of the block for clone and pin their trunks to
+     * avoid reclaiming before the cloned slices added to the trunks,
+     * the caller MUST call ob_index_release_clone_slices after clone */
+    int ob_index_get_clone_slices(const FSBlockKey *bkey,
+            OBSlicePtrArray *sarray);
+
+    void ob_index_release_clone_slices(OBSlicePtrArray *sarray);
+
+    /* replace all slices of the block with the cloned slices, the new
+     * slice list is built before the old slices deleted, so the index
+     * keeps untouched on failure. the slices MUST be allocated by
+     * ob_index_alloc_slice with the same block key and not overlapped.
+     * del_sn is 0 when the block has no slice before */
+    int ob_index_replace_block_slices(FSSliceSNPairArray *sarray,
+            uint64_t *del_sn, int *dec_alloc, int *inc_alloc);
+
     int ob_index_dump_slices_to_trunk_ex(OBHashtable *htable,
             const int64_t start_index, const int64_t end_index,
             int64_t *slice_count);
 
+    /* dump all slices as the slice binlog records for the binlog
+     * compaction, MUST be called before any update */
+    int ob_index_dump_slices_to_file(const char *filename,
+            const time_t current_time, int64_t *slice_count);
+
+    /* dump the slices of the data group as the replica binlog records
+     * with the same data version, for the full recovery of the slave
+     * after the replica binlog purged */
+    int ob_index_dump_replica_binlog_to_file(const int data_group_id,
+            const uint64_t data_version, const time_t current_time,
+            const char *filename, int64_t *slice_count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,568 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef OS_LINUX
+#include <linux/fs.h>
+#endif
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "sf/sf_global.h"
+#include "../../common/fs_crc32c.h"
+#include "../server_global.h"
+#include "raw_device.h"
+
+#define BITMAP_PAGE_SIZE  4096
+
+FSRawDevice *raw_device_new(const char *filename,
+        const int64_t create_size)
+{
+    FSRawDevice *device;
+
+    device = (FSRawDevice *)fc_malloc(sizeof(FSRawDevice));
+    if (device == NULL) {
+        return NULL;
+    }
+    memset(device, 0, sizeof(FSRawDevice));
+
+    device->filename = fc_strdup(filename);
+    if (device->filename == NULL) {
+        free(device);
+        return NULL;
+    }
+    device->create_size = create_size;
+    device->fd = -1;
+    return device;
+}
+
+static int open_device(FSRawDevice *device)
+{
+    struct stat stbuf;
+    int result;
+
+    device->fd = open(device->filename, O_RDWR);
+    if (device->fd < 0 && errno == ENOENT && device->create_size > 0) {
+        device->fd = open(device->filename, O_RDWR | O_CREAT, 0644);
+        if (device->fd >= 0 && fc_fallocate(device->fd,
+                    device->create_size) != 0)
+        {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "fallocate file \"%s\" to %"PRId64" bytes fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    device->filename, device->create_size,
+                    result, STRERROR(result));
+            return result;
+        }
+    }
+
+    if (device->fd < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open device \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, device->filename, result, STRERROR(result));
+        return result;
+    }
+
+    if (fstat(device->fd, &stbuf) != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "stat device \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, device->filename, result, STRERROR(result));
+        return result;
+    }
+
+    if (S_ISREG(stbuf.st_mode)) {
+        device->size = stbuf.st_size;
+#ifdef OS_LINUX
+    } else if (S_ISBLK(stbuf.st_mode)) {
+        uint64_t size;
+        if (ioctl(device->fd, BLKGETSIZE64, &size) != 0) {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "get size of the block device \"%s\" fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    device->filename, result, STRERROR(result));
+            return result;
+        }
+        device->size = size;
+        device->is_block = true;
+#endif
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "device \"%s\" is not a block device or a regular file",
+                __LINE__, device->filename);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int do_pread(FSRawDevice *device, char *buff,
+        const int size, const int64_t offset)
+{
+    int result;
+
+    if (pread(device->fd, buff, size, offset) != size) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "read from device \"%s\" fail, offset: %"PRId64", "
+                "size: %d, errno: %d, error info: %s", __LINE__,
+                device->filename, offset, size, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+static int do_pwrite(FSRawDevice *device, const char *buff,
+        const int size, const int64_t offset)
+{
+    int result;
+
+    if (pwrite(device->fd, buff, size, offset) != size) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "write to device \"%s\" fail, offset: %"PRId64", "
+                "size: %d, errno: %d, error info: %s", __LINE__,
+                device->filename, offset, size, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+static int sync_device(FSRawDevice *device)
+{
+    int result;
+
+    if (fdatasync(device->fd) != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "sync device \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, device->filename, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+static inline int alloc_bitmap(FSRawDevice *device)
+{
+    device->bitmap = (unsigned char *)fc_malloc(device->bitmap_bytes);
+    if (device->bitmap == NULL) {
+        return ENOMEM;
+    }
+    memset(device->bitmap, 0, device->bitmap_bytes);
+
+    device->disk_bitmap = (unsigned char *)fc_malloc(device->bitmap_bytes);
+    if (device->disk_bitmap == NULL) {
+        return ENOMEM;
+    }
+    memset(device->disk_bitmap, 0, device->bitmap_bytes);
+    return 0;
+}
+
+static int format_device(FSRawDevice *device, FSRawDeviceSuperBlock *sb)
+{
+    int64_t extent_count;
+    int result;
+
+    extent_count = device->size / device->trunk_size;
+    device->bitmap_bytes = MEM_ALIGN_CEIL((extent_count + 7) / 8,
+            BITMAP_PAGE_SIZE);
+    device->data_offset = MEM_ALIGN_CEIL(FS_RAW_DEVICE_SUPERBLOCK_SIZE +
+            device->bitmap_bytes, FS_RAW_DEVICE_DATA_ALIGN_SIZE);
+    if (device->size <= device->data_offset) {
+        device->extent_count = 0;
+    } else {
+        device->extent_count = (device->size - device->data_offset) /
+            device->trunk_size;
+    }
+    if (device->extent_count == 0) {
+        logError("file: "__FILE__", line: %d, "
+                "device \"%s\" is too small, size: %"PRId64", "
+                "trunk size: %"PRId64, __LINE__, device->filename,
+                device->size, device->trunk_size);
+        return ENOSPC;
+    }
+
+    if ((result=alloc_bitmap(device)) != 0) {
+        return result;
+    }
+    if ((result=do_pwrite(device, (char *)device->disk_bitmap, device->
+                    bitmap_bytes, FS_RAW_DEVICE_SUPERBLOCK_SIZE)) != 0)
+    {
+        return result;
+    }
+
+    memcpy(sb->magic, FS_RAW_DEVICE_MAGIC_STR, FS_RAW_DEVICE_MAGIC_LEN);
+    int2buff(FS_RAW_DEVICE_VERSION, sb->version);
+    int2buff(device->bitmap_bytes, sb->bitmap_bytes);
+    long2buff(device->trunk_size, sb->trunk_size);
+    long2buff(device->extent_count, sb->extent_count);
+    long2buff(device->data_offset, sb->data_offset);
+    int2buff(fs_crc32c(sb, (char *)sb->crc32 - (char *)sb), sb->crc32);
+    if ((result=do_pwrite(device, (char *)sb, sizeof(*sb), 0)) != 0) {
+        return result;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "format device \"%s\" done, size: %"PRId64" MB, "
+            "extent count: %"PRId64", data offset: %"PRId64,
+            __LINE__, device->filename, device->size / (1024 * 1024),
+            device->extent_count, device->data_offset);
+    return sync_device(device);
+}
+
+static int load_superblock(FSRawDevice *device, FSRawDeviceSuperBlock *sb)
+{
+    uint32_t crc32;
+    int version;
+    int result;
+
+    crc32 = fs_crc32c(sb, (char *)sb->crc32 - (char *)sb);
+    if ((uint32_t)buff2int(sb->crc32) != crc32) {
+        logError("file: "__FILE__", line: %d, "
+                "the superblock of device \"%s\" is corrupted, "
+                "checksum: %08x != expect: %08x", __LINE__,
+                device->filename, (uint32_t)buff2int(sb->crc32), crc32);
+        return EINVAL;
+    }
+
+    version = buff2int(sb->version);
+    if (version != FS_RAW_DEVICE_VERSION) {
+        logError("file: "__FILE__", line: %d, "
+                "device \"%s\", unsupported version: %d",
+                __LINE__, device->filename, version);
+        return EINVAL;
+    }
+
+    if (buff2long(sb->trunk_size) != device->trunk_size) {
+        logError("file: "__FILE__", line: %d, "
+                "device \"%s\", the trunk size: %"PRId64" in the "
+                "superblock != trunk_file_size: %"PRId64" of the config",
+                __LINE__, device->filename, buff2long(sb->trunk_size),
+                device->trunk_size);
+        return EINVAL;
+    }
+
+    device->bitmap_bytes = buff2int(sb->bitmap_bytes);
+    device->extent_count = buff2long(sb->extent_count);
+    device->data_offset = buff2long(sb->data_offset);
+    if (device->data_offset + device->extent_count *
+            device->trunk_size > device->size)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "device \"%s\", the device size: %"PRId64" is too small, "
+                "extent count: %"PRId64, __LINE__, device->filename,
+                device->size, device->extent_count);
+        return EINVAL;
+    }
+
+    if ((result=alloc_bitmap(device)) != 0) {
+        return result;
+    }
+    return do_pread(device, (char *)device->disk_bitmap, device->
+            bitmap_bytes, FS_RAW_DEVICE_SUPERBLOCK_SIZE);
+}
+
+static inline bool is_all_zero(const char *buff, const int size)
+{
+    const char *p;
+    const char *end;
+
+    end = buff + size;
+    for (p=buff; p<end; p++) {
+        if (*p != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+#define BITMAP_IS_SET(bitmap, index) \
+    ((bitmap[(index) / 8] & (1 << ((index) % 8))) != 0)
+
+#define EXTENT_IS_USED(device, index) BITMAP_IS_SET(device->bitmap, index)
+
+static int64_t count_used_extents(FSRawDevice *device,
+        const unsigned char *bitmap)
+{
+    int64_t index;
+    int64_t count;
+
+    count = 0;
+    for (index=0; index<device->extent_count; index++) {
+        if (BITMAP_IS_SET(bitmap, index)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int open_or_format(FSStoragePathInfo *path_info)
+{
+    FSRawDevice *device;
+    char buff[FS_RAW_DEVICE_SUPERBLOCK_SIZE];
+    FSRawDeviceSuperBlock *sb;
+    int result;
+
+    device = path_info->device;
+    device->trunk_size = STORAGE_CFG.trunk_file_size;
+    if ((result=open_device(device)) != 0) {
+        return result;
+    }
+
+    if ((result=do_pread(device, buff, sizeof(buff), 0)) != 0) {
+        return result;
+    }
+
+    sb = (FSRawDeviceSuperBlock *)buff;
+    if (memcmp(sb->magic, FS_RAW_DEVICE_MAGIC_STR,
+                FS_RAW_DEVICE_MAGIC_LEN) == 0)
+    {
+        result = load_superblock(device, sb);
+    } else if (is_all_zero(buff, sizeof(buff))) {
+        result = format_device(device, sb);
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "device \"%s\" is in use by others, clear the first "
+                "%d bytes to format it", __LINE__, device->filename,
+                FS_RAW_DEVICE_SUPERBLOCK_SIZE);
+        result = EEXIST;
+    }
+    if (result != 0) {
+        return result;
+    }
+
+    /* the bitmap in memory is rebuilt by the trunk binlog,
+       then compared with the on-device bitmap */
+    device->used_count = count_used_extents(device, device->disk_bitmap);
+
+    if ((result=init_pthread_lock(&device->lock)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "init_pthread_lock fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        return result;
+    }
+
+    return storage_config_calc_path_spaces(path_info);
+}
+
+static int init_devices(FSStoragePathArray *parray)
+{
+    FSStoragePathInfo *p;
+    FSStoragePathInfo *end;
+    int result;
+
+    end = parray->paths + parray->count;
+    for (p=parray->paths; p<end; p++) {
+        if (p->device != NULL) {
+            if ((result=open_or_format(p)) != 0) {
+                return result;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int raw_device_init()
+{
+    int result;
+
+    if ((result=init_devices(&STORAGE_CFG.write_cache)) != 0) {
+        return result;
+    }
+    return init_devices(&STORAGE_CFG.store_path);
+}
+
+static int write_bitmap_page(FSRawDevice *device, const int64_t index)
+{
+    int offset;
+    int result;
+
+    offset = MEM_ALIGN_FLOOR(index / 8, BITMAP_PAGE_SIZE);
+    if ((result=do_pwrite(device, (char *)device->bitmap + offset,
+                    BITMAP_PAGE_SIZE, FS_RAW_DEVICE_SUPERBLOCK_SIZE +
+                    offset)) != 0)
+    {
+        return result;
+    }
+
+    return sync_device(device);
+}
+
+int raw_device_alloc_extent(FSRawDevice *device, int64_t *index)
+{
+    int64_t i;
+    int64_t current;
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&device->lock);
+    result = ENOSPC;
+    for (i=0; i<device->extent_count; i++) {
+        current = (device->alloc_hint + i) % device->extent_count;
+        if (!EXTENT_IS_USED(device, current)) {
+            device->bitmap[current / 8] |= (1 << (current % 8));
+            if ((result=write_bitmap_page(device, current)) != 0) {
+                device->bitmap[current / 8] &= ~(1 << (current % 8));
+                break;
+            }
+
+            __sync_add_and_fetch(&device->used_count, 1);
+            device->alloc_hint = current + 1;
+            *index = current;
+            break;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&device->lock);
+
+    if (result == ENOSPC) {
+        logError("file: "__FILE__", line: %d, "
+                "device \"%s\", no free extent, extent count: %"PRId64,
+                __LINE__, device->filename, device->extent_count);
+    }
+    return result;
+}
+
+int raw_device_free_extent(FSRawDevice *device, const int64_t index)
+{
+    int result;
+
+    if (index < 0 || index >= device->extent_count) {
+        return EINVAL;
+    }
+
+    PTHREAD_MUTEX_LOCK(&device->lock);
+    if (EXTENT_IS_USED(device, index)) {
+        device->bitmap[index / 8] &= ~(1 << (index % 8));
+        result = write_bitmap_page(device, index);
+        __sync_sub_and_fetch(&device->used_count, 1);
+    } else {
+        result = 0;
+    }
+    PTHREAD_MUTEX_UNLOCK(&device->lock);
+
+    return result;
+}
+
+int raw_device_mark_extent(FSRawDevice *device,
+        const int64_t index, const bool used)
+{
+    if (index < 0 || index >= device->extent_count) {
+        logError("file: "__FILE__", line: %d, "
+                "device \"%s\", extent index: %"PRId64" is out of "
+                "bounds, extent count: %"PRId64, __LINE__,
+                device->filename, index, device->extent_count);
+        return EINVAL;
+    }
+
+    if (used) {
+        device->bitmap[index / 8] |= (1 << (index % 8));
+    } else {
+        device->bitmap[index / 8] &= ~(1 << (index % 8));
+    }
+    return 0;
+}
+
+int raw_device_discard(FSRawDevice *device, const FSTrunkIdInfo
+        *id_info, const int64_t offset, const int64_t length)
+{
+#ifdef OS_LINUX
+    int result;
+    uint64_t range[2];
+
+    range[0] = raw_device_space_offset(device, id_info, offset);
+    range[1] = length;
+    if (device->is_block) {
+        result = ioctl(device->fd, BLKDISCARD, range);
+    } else {
+        result = fallocate(device->fd, FALLOC_FL_PUNCH_HOLE |
+                FALLOC_FL_KEEP_SIZE, range[0], range[1]);
+    }
+    if (result != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "discard device \"%s\" fail, offset: %"PRId64", "
+                "length: %"PRId64", errno: %d, error info: %s",
+                __LINE__, device->filename, (int64_t)range[0],
+                length, result, STRERROR(result));
+    }
+    return result;
+#else
+    return EOPNOTSUPP;
+#endif
+}
+
+static int flush_bitmaps(FSStoragePathArray *parray)
+{
+    FSStoragePathInfo *p;
+    FSStoragePathInfo *end;
+    int result;
+
+    end = parray->paths + parray->count;
+    for (p=parray->paths; p<end; p++) {
+        if (p->device == NULL) {
+            continue;
+        }
+
+        p->device->used_count = count_used_extents(
+                p->device, p->device->bitmap);
+        if (memcmp(p->device->bitmap, p->device->disk_bitmap,
+                    p->device->bitmap_bytes) == 0)
+        {
+            free(p->device->disk_bitmap);
+            p->device->disk_bitmap = NULL;
+            continue;
+        }
+
+        logWarning("file: "__FILE__", line: %d, "
+                "the extent bitmap of device \"%s\" is inconsistent "
+                "with the trunk binlog, repair it", __LINE__,
+                p->device->filename);
+        if ((result=do_pwrite(p->device, (char *)p->device->bitmap,
+                        p->device->bitmap_bytes,
+                        FS_RAW_DEVICE_SUPERBLOCK_SIZE)) != 0)
+        {
+            return result;
+        }
+        if ((result=sync_device(p->device)) != 0) {
+            return result;
+        }
+
+        free(p->device->disk_bitmap);
+        p->device->disk_bitmap = NULL;
+        if ((result=storage_config_calc_path_spaces(p)) != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int raw_device_flush_bitmaps()
+{
+    int result;
+
+    if ((result=flush_bitmaps(&STORAGE_CFG.write_cache)) != 0) {
+        return result;
+    }
+    return flush_bitmaps(&STORAGE_CFG.store_path);
+}
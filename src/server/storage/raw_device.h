@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _RAW_DEVICE_H
+#define _RAW_DEVICE_H
+
+#include <pthread.h>
+#include "../../common/fs_types.h"
+#include "storage_config.h"
+
+#define FS_RAW_DEVICE_MAGIC_STR    "FSRAWDEV"
+#define FS_RAW_DEVICE_MAGIC_LEN    (sizeof(FS_RAW_DEVICE_MAGIC_STR) - 1)
+#define FS_RAW_DEVICE_VERSION      1
+
+#define FS_RAW_DEVICE_SUPERBLOCK_SIZE   4096
+#define FS_RAW_DEVICE_DATA_ALIGN_SIZE   (1024 * 1024)
+
+/* the layout of the raw device (or the large preallocated file):
+ *   superblock (4KB) + extent bitmap (4KB aligned) + extents (1MB aligned)
+ * the extent size is the trunk file size, the trunk maps to an extent
+ * and FSTrunkIdInfo.subdir is the extent index + 1 (the subdir starts from 1)
+ */
+typedef struct fs_raw_device_superblock {
+    char magic[8];
+    char version[4];
+    char bitmap_bytes[4];
+    char trunk_size[8];
+    char extent_count[8];
+    char data_offset[8];
+    char crc32[4];
+} FSRawDeviceSuperBlock;
+
+typedef struct fs_raw_device {
+    char *filename;        //the block device or the regular file
+    int64_t create_size;   //for the regular file which not exist
+    int fd;                //for superblock and bitmap
+    bool is_block;         //if the block device
+    int bitmap_bytes;      //aligned by 4KB
+    int64_t size;          //device size
+    int64_t trunk_size;
+    int64_t extent_count;
+    int64_t data_offset;   //the offset of the first extent
+    volatile int64_t used_count;
+    int64_t alloc_hint;    //the next extent index to search
+    unsigned char *bitmap;
+    unsigned char *disk_bitmap;  //for check after the trunk binlog loaded
+    pthread_mutex_t lock;
+} FSRawDevice;
+
+#define FS_RAW_DEVICE_BY_PATH_INDEX(path_index) \
+    STORAGE_CFG.paths_by_index.paths[path_index]->device
+
+#define FS_RAW_DEVICE_EXTENT_INDEX(id_info)  ((id_info)->subdir - 1)
+#define FS_RAW_DEVICE_EXTENT_SUBDIR(index)   ((index) + 1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    FSRawDevice *raw_device_new(const char *filename,
+            const int64_t create_size);
+
+    /* open or format the raw devices of all the store paths,
+     * must be called after fs_crc32c_init */
+    int raw_device_init();
+
+    /* alloc an extent for trunk create */
+    int raw_device_alloc_extent(FSRawDevice *device, int64_t *index);
+
+    int raw_device_free_extent(FSRawDevice *device, const int64_t index);
+
+    /* set the extent status in memory when load the trunk binlog */
+    int raw_device_mark_extent(FSRawDevice *device,
+            const int64_t index, const bool used);
+
+    /* discard (TRIM) the freed range of the extent */
+    int raw_device_discard(FSRawDevice *device, const FSTrunkIdInfo
+            *id_info, const int64_t offset, const int64_t length);
+
+    /* compare with the on-device bitmaps and persist when changed,
+     * must be called after the trunk binlog loaded */
+    int raw_device_flush_bitmaps();
+
+    static inline int64_t raw_device_space_offset(FSRawDevice *device,
+            const FSTrunkIdInfo *id_info, const int64_t offset)
+    {
+        return device->data_offset + FS_RAW_DEVICE_EXTENT_INDEX(id_info) *
+            device->trunk_size + offset;
+    }
+
+    static inline void raw_device_get_space_stat(FSRawDevice *device,
+            int64_t *total, int64_t *avail)
+    {
+        int64_t used_count;
+
+        used_count = __sync_add_and_fetch(&device->used_count, 0);
+        *total = device->extent_count * device->trunk_size;
+        *avail = (device->extent_count - used_count) * device->trunk_size;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
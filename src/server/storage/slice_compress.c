@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#ifdef FS_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef FS_WITH_ZSTD
+#include <zstd.h>
+#endif
+#include "../../common/fs_cluster_cfg.h"
+#include "slice_compress.h"
+
+bool fs_compress_type_supported(const char type)
+{
+    switch (type) {
+        case FS_COMPRESS_TYPE_NONE:
+            return true;
+#ifdef FS_WITH_LZ4
+        case FS_COMPRESS_TYPE_LZ4:
+            return true;
+#endif
+#ifdef FS_WITH_ZSTD
+        case FS_COMPRESS_TYPE_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+int fs_compress_bound(const char type, const int length)
+{
+    switch (type) {
+#ifdef FS_WITH_LZ4
+        case FS_COMPRESS_TYPE_LZ4:
+            return LZ4_compressBound(length);
+#endif
+#ifdef FS_WITH_ZSTD
+        case FS_COMPRESS_TYPE_ZSTD:
+            return ZSTD_compressBound(length);
+#endif
+        default:
+            return length;
+    }
+}
+
+int fs_compress_data(const char type, const char *src,
+        const int src_len, char *dest, const int dest_size,
+        int *dest_len)
+{
+    switch (type) {
+#ifdef FS_WITH_LZ4
+        case FS_COMPRESS_TYPE_LZ4:
+            *dest_len = LZ4_compress_default(src, dest, src_len, dest_size);
+            return (*dest_len > 0) ? 0 : EOVERFLOW;
+#endif
+#ifdef FS_WITH_ZSTD
+        case FS_COMPRESS_TYPE_ZSTD:
+        {
+            size_t len;
+            len = ZSTD_compress(dest, dest_size, src, src_len,
+                    FS_COMPRESS_ZSTD_LEVEL);
+            if (ZSTD_isError(len)) {
+                *dest_len = 0;
+                return (ZSTD_getErrorCode(len) == ZSTD_error_dstSize_tooSmall)
+                    ? EOVERFLOW : EINVAL;
+            }
+            *dest_len = len;
+            return 0;
+        }
+#endif
+        default:
+            *dest_len = 0;
+            return EOPNOTSUPP;
+    }
+}
+
+int fs_decompress_data(const char type, const char *src,
+        const int src_len, char *dest, const int dest_size,
+        const int target_len)
+{
+    int len;
+
+    switch (type) {
+#ifdef FS_WITH_LZ4
+        case FS_COMPRESS_TYPE_LZ4:
+            len = LZ4_decompress_safe_partial(src, dest,
+                    src_len, target_len, dest_size);
+            break;
+#endif
+#ifdef FS_WITH_ZSTD
+        case FS_COMPRESS_TYPE_ZSTD:
+        {
+            size_t result;
+            result = ZSTD_decompress(dest, dest_size, src, src_len);
+            len = ZSTD_isError(result) ? -1 : (int)result;
+            break;
+        }
+#endif
+        default:
+            logError("file: "__FILE__", line: %d, "
+                    "unsupported compression: %s (0x%02x)", __LINE__,
+                    fs_get_compress_caption(type), (unsigned char)type);
+            return EOPNOTSUPP;
+    }
+
+    if (len < target_len) {
+        logError("file: "__FILE__", line: %d, "
+                "%s decompress fail, compressed length: %d, "
+                "expect length: %d, return: %d", __LINE__,
+                fs_get_compress_caption(type), src_len,
+                target_len, len);
+        return EIO;
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _SLICE_COMPRESS_H
+#define _SLICE_COMPRESS_H
+
+#include "../../common/fs_types.h"
+
+//do NOT compress the small slice
+#define FS_COMPRESS_MIN_SLICE_LENGTH   4096
+
+//skip the next slices at most when the data does not compress
+#define FS_COMPRESS_MAX_SKIP_COUNT     64
+
+#define FS_COMPRESS_ZSTD_LEVEL          1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    bool fs_compress_type_supported(const char type);
+
+    //the max compressed length of the input length
+    int fs_compress_bound(const char type, const int length);
+
+    /* compress the data
+     * return 0 for success, EOVERFLOW when the compressed data is larger
+     * than dest_size, others for error */
+    int fs_compress_data(const char type, const char *src,
+            const int src_len, char *dest, const int dest_size,
+            int *dest_len);
+
+    /* decompress the data at least target_len bytes (the prefix)
+     * return 0 for success, EIO for the corrupted data */
+    int fs_decompress_data(const char type, const char *src,
+            const int src_len, char *dest, const int dest_size,
+            const int target_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fast_mblock.h"
+#include "fastcommon/fc_list.h"
+#include "fastcommon/md5.h"
+#include "../server_global.h"
+#include "storage_allocator.h"
+#include "slice_dedup.h"
+
+#define SLICE_DEDUP_PARTITION_COUNT  64
+
+typedef struct slice_dedup_entry {
+    FSSliceFingerprint fp;
+    FSTrunkSpaceInfo space;
+    int64_t generation;  //the trunk generation when the slice written
+    struct {
+        bool valid;
+        uint32_t crc32c;
+    } checksum;
+    struct {
+        char type;
+        int length;
+    } compress;
+    struct fc_list_head dlink;  //for LRU
+    struct slice_dedup_entry *next;  //for hashtable
+} SliceDedupEntry;
+
+typedef struct {
+    int64_t capacity;  //the max entry count
+    int64_t count;
+    SliceDedupEntry **buckets;
+    struct fc_list_head lru;  //the least recently used entry first
+    struct fast_mblock_man allocator; //element: SliceDedupEntry
+    pthread_mutex_t lock;
+} SliceDedupPartition;
+
+typedef struct {
+    int count;
+    SliceDedupPartition *partitions;
+} SliceDedupContext;
+
+static SliceDedupContext dedup_ctx;
+
+static int init_partition(SliceDedupPartition *partition,
+        const int64_t capacity)
+{
+    int result;
+    int64_t bytes;
+
+    partition->capacity = capacity;
+    bytes = sizeof(SliceDedupEntry *) * capacity;
+    partition->buckets = (SliceDedupEntry **)fc_malloc(bytes);
+    if (partition->buckets == NULL) {
+        return ENOMEM;
+    }
+    memset(partition->buckets, 0, bytes);
+
+    if ((result=fast_mblock_init_ex1(&partition->allocator,
+                    "slice_dedup_entry", sizeof(SliceDedupEntry),
+                    1024, 0, NULL, NULL, false)) != 0)
+    {
+        return result;
+    }
+
+    FC_INIT_LIST_HEAD(&partition->lru);
+    return init_pthread_lock(&partition->lock);
+}
+
+int slice_dedup_init()
+{
+    int result;
+    int64_t capacity;
+    SliceDedupPartition *partition;
+    SliceDedupPartition *end;
+
+    if (!STORAGE_CFG.slice_dedup.enabled) {
+        return 0;
+    }
+
+    dedup_ctx.count = SLICE_DEDUP_PARTITION_COUNT;
+    dedup_ctx.partitions = (SliceDedupPartition *)fc_malloc(
+            sizeof(SliceDedupPartition) * dedup_ctx.count);
+    if (dedup_ctx.partitions == NULL) {
+        return ENOMEM;
+    }
+
+    //one bucket pointer per entry
+    capacity = STORAGE_CFG.slice_dedup.index_memory_limit /
+        (sizeof(SliceDedupEntry) + sizeof(SliceDedupEntry *)) /
+        dedup_ctx.count;
+    if (capacity < 1024) {
+        capacity = 1024;
+    }
+
+    end = dedup_ctx.partitions + dedup_ctx.count;
+    for (partition=dedup_ctx.partitions; partition<end; partition++) {
+        if ((result=init_partition(partition, capacity)) != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+void slice_dedup_calc_fingerprint(const char *buff,
+        const int length, FSSliceFingerprint *fp)
+{
+    fp->length = length;
+    my_md5_buffer((char *)buff, length, fp->digest);
+}
+
+#define SLICE_DEDUP_SET_PARTITION_AND_BUCKET(fp) \
+    uint64_t hash_code;  \
+    SliceDedupPartition *partition; \
+    SliceDedupEntry **bucket;  \
+    \
+    hash_code = buff2long((const char *)(fp)->digest);  \
+    partition = dedup_ctx.partitions + hash_code % dedup_ctx.count; \
+    bucket = partition->buckets + (hash_code / dedup_ctx.count) % \
+        partition->capacity
+
+static inline bool fingerprint_equals(const FSSliceFingerprint *fp1,
+        const FSSliceFingerprint *fp2)
+{
+    return fp1->length == fp2->length && memcmp(fp1->digest,
+            fp2->digest, sizeof(fp1->digest)) == 0;
+}
+
+static SliceDedupEntry *find_entry(SliceDedupEntry **bucket,
+        const FSSliceFingerprint *fp, SliceDedupEntry **previous)
+{
+    SliceDedupEntry *entry;
+
+    *previous = NULL;
+    entry = *bucket;
+    while (entry != NULL) {
+        if (fingerprint_equals(&entry->fp, fp)) {
+            return entry;
+        }
+
+        *previous = entry;
+        entry = entry->next;
+    }
+
+    return NULL;
+}
+
+static void remove_entry(SliceDedupPartition *partition,
+        SliceDedupEntry **bucket, SliceDedupEntry *entry,
+        SliceDedupEntry *previous)
+{
+    if (previous == NULL) {
+        *bucket = entry->next;
+    } else {
+        previous->next = entry->next;
+    }
+
+    fc_list_del_init(&entry->dlink);
+    fast_mblock_free_object(&partition->allocator, entry);
+    partition->count--;
+}
+
+static void evict_lru_entry(SliceDedupPartition *partition)
+{
+    SliceDedupEntry *entry;
+    SliceDedupEntry *previous;
+    SliceDedupEntry **bucket;
+    uint64_t hash_code;
+
+    entry = fc_list_first_entry(&partition->lru, SliceDedupEntry, dlink);
+    hash_code = buff2long((const char *)entry->fp.digest);
+    bucket = partition->buckets + (hash_code / dedup_ctx.count) %
+        partition->capacity;
+    find_entry(bucket, &entry->fp, &previous);
+    remove_entry(partition, bucket, entry, previous);
+}
+
+int slice_dedup_lookup(const FSSliceFingerprint *fp,
+        FSSliceDedupInfo *info)
+{
+    SliceDedupEntry *entry;
+    SliceDedupEntry *previous;
+    FSTrunkAllocator *allocator;
+    int64_t generation;
+    SLICE_DEDUP_SET_PARTITION_AND_BUCKET(fp);
+
+    PTHREAD_MUTEX_LOCK(&partition->lock);
+    if ((entry=find_entry(bucket, fp, &previous)) != NULL) {
+        info->space = entry->space;
+        info->checksum.valid = entry->checksum.valid;
+        info->checksum.crc32c = entry->checksum.crc32c;
+        info->compress.type = entry->compress.type;
+        info->compress.length = entry->compress.length;
+        generation = entry->generation;
+        fc_list_move_tail(&entry->dlink, &partition->lru);
+    }
+    PTHREAD_MUTEX_UNLOCK(&partition->lock);
+
+    if (entry == NULL) {
+        return ENOENT;
+    }
+
+    allocator = g_allocator_mgr->allocator_ptr_array.
+        allocators[info->space.store->index];
+    if ((info->trunk=trunk_allocator_pin_trunk(allocator, info->
+                    space.id_info.id, generation, info->space.offset,
+                    (info->compress.type != FS_COMPRESS_TYPE_NONE ?
+                     info->compress.length : fp->length))) != NULL)
+    {
+        return 0;
+    }
+
+    //the trunk space is reclaiming, reused or freed, remove the stale entry
+    PTHREAD_MUTEX_LOCK(&partition->lock);
+    if ((entry=find_entry(bucket, fp, &previous)) != NULL &&
+            entry->generation == generation && entry->space.
+            id_info.id == info->space.id_info.id && entry->
+            space.offset == info->space.offset)
+    {
+        remove_entry(partition, bucket, entry, previous);
+    }
+    PTHREAD_MUTEX_UNLOCK(&partition->lock);
+
+    return ENOENT;
+}
+
+void slice_dedup_unpin(FSTrunkFileInfo *trunk)
+{
+    trunk_allocator_unpin_trunk(trunk->allocator, trunk);
+}
+
+int slice_dedup_add(const FSSliceFingerprint *fp,
+        const OBSliceEntry *slice, const int64_t generation)
+{
+    SliceDedupEntry *entry;
+    SliceDedupEntry *previous;
+    int result;
+    SLICE_DEDUP_SET_PARTITION_AND_BUCKET(fp);
+
+    PTHREAD_MUTEX_LOCK(&partition->lock);
+    do {
+        if ((entry=find_entry(bucket, fp, &previous)) == NULL) {
+            if (partition->count >= partition->capacity) {
+                evict_lru_entry(partition);
+            }
+
+            entry = (SliceDedupEntry *)fast_mblock_alloc_object(
+                    &partition->allocator);
+            if (entry == NULL) {
+                result = ENOMEM;
+                break;
+            }
+
+            entry->fp = *fp;
+            entry->next = *bucket;
+            *bucket = entry;
+            partition->count++;
+            fc_list_add_tail(&entry->dlink, &partition->lru);
+        } else {  //replace the old one, such as the slice migrated
+            fc_list_move_tail(&entry->dlink, &partition->lru);
+        }
+
+        entry->space = slice->space;
+        entry->generation = generation;
+        entry->checksum.valid = slice->checksum.valid;
+        entry->checksum.crc32c = slice->checksum.crc32c;
+        entry->compress.type = slice->compress.type;
+        entry->compress.length = slice->compress.length;
+        result = 0;
+    } while (0);
+    PTHREAD_MUTEX_UNLOCK(&partition->lock);
+
+    return result;
+}
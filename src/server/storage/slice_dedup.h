@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _SLICE_DEDUP_H
+#define _SLICE_DEDUP_H
+
+#include "storage_types.h"
+
+typedef struct fs_slice_dedup_info {
+    FSTrunkSpaceInfo space;
+    struct {
+        bool valid;
+        uint32_t crc32c;
+    } checksum;
+    struct {
+        char type;
+        int length;
+    } compress;
+    FSTrunkFileInfo *trunk;  //the pinned trunk
+} FSSliceDedupInfo;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int slice_dedup_init();
+
+    void slice_dedup_calc_fingerprint(const char *buff,
+            const int length, FSSliceFingerprint *fp);
+
+    /* find the space of the slice with the same fingerprint and pin the
+     * trunk, the caller MUST compare the data before sharing the space
+     * return 0 for found, ENOENT for not found */
+    int slice_dedup_lookup(const FSSliceFingerprint *fp,
+            FSSliceDedupInfo *info);
+
+    void slice_dedup_unpin(FSTrunkFileInfo *trunk);
+
+    //register the slice after the data written
+    int slice_dedup_add(const FSSliceFingerprint *fp,
+            const OBSliceEntry *slice, const int64_t generation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
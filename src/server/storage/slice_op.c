@@ -20,15 +20,22 @@
 #include "fastcommon/pthread_func.h"
 #include "sf/sf_global.h"
 #include "../common/fs_proto.h"
+#include "../common/fs_crc32c.h"
 #include "../server_global.h"
+#include "../server_group_info.h"
 #include "../data_thread.h"
+#include "../slave_read_waiter.h"
 #include "../dio/trunk_write_thread.h"
 #include "../dio/trunk_read_thread.h"
 #include "../binlog/slice_binlog.h"
 #include "../binlog/replica_binlog.h"
 #include "storage_allocator.h"
+#include "slice_compress.h"
+#include "slice_dedup.h"
 #include "slice_op.h"
 
+#define FS_COMPRESS_BUFFER_ALIGN_SIZE  (64 * 1024)
+
 static int realloc_slice_sn_pairs(FSSliceSNPairArray *parray,
         const int capacity)
 {
@@ -72,6 +79,8 @@ static inline void set_data_version(FSSliceOpContext *op_ctx)
             }
         }
     }
+
+    slave_read_waiter_notify();
 }
 
 static inline void free_slice_array(FSSliceSNPairArray *array)
@@ -153,6 +162,15 @@ void fs_write_finish(FSSliceOpContext *op_ctx)
         }
     } while (0);
 
+    if (op_ctx->dedup.pinned_trunk != NULL) {
+        slice_dedup_unpin(op_ctx->dedup.pinned_trunk);
+        op_ctx->dedup.pinned_trunk = NULL;
+    } else if (op_ctx->dedup.registering && op_ctx->result == 0) {
+        slice_dedup_add(&op_ctx->dedup.fp, op_ctx->update.sarray.
+                slice_sn_pairs[0].slice, op_ctx->dedup.generation);
+    }
+    op_ctx->dedup.registering = false;
+
     if (op_ctx->result != 0) {
         free_slice_array(&op_ctx->update.sarray);
     }
@@ -181,6 +199,14 @@ static void slice_write_done(struct trunk_write_io_buffer
     }
 }
 
+static inline void set_slice_checksum(OBSliceEntry *slice, const char *buff)
+{
+    if (SLICE_CHECKSUM_ENABLED) {
+        slice->checksum.crc32c = fs_crc32c(buff, slice->ssize.length);
+        slice->checksum.valid = true;
+    }
+}
+
 static inline OBSliceEntry *alloc_init_slice(const FSBlockKey *bkey,
         FSTrunkSpaceInfo *space, const OBSliceType slice_type,
         const int offset, const int length)
@@ -193,35 +219,37 @@ static inline OBSliceEntry *alloc_init_slice(const FSBlockKey *bkey,
     }
 
     slice->type = slice_type;
+    slice->compress.type = FS_COMPRESS_TYPE_NONE;
     slice->space = *space;
     slice->ssize.offset = offset;
     slice->ssize.length = length;
     return slice;
 }
 
-static int fs_slice_alloc(const FSBlockSliceKeyInfo *bs_key,
-        const OBSliceType slice_type, const bool reclaim_alloc,
+static int fs_slice_alloc_ex(const FSBlockSliceKeyInfo *bs_key,
+        const int alloc_size, const OBSliceType slice_type,
+        const bool reclaim_alloc, const bool allow_split,
         FSSliceSNPair *slice_sn_pairs, int *slice_count)
 {
+    const bool is_normal = true;
     int result;
     FSTrunkSpaceWithVersion spaces[FS_MAX_SPLIT_COUNT_PER_SPACE_ALLOC];
 
     if (reclaim_alloc) {
-        result = storage_allocator_reclaim_alloc(
-                FS_BLOCK_HASH_CODE(bs_key->block),
-                bs_key->slice.length, spaces, slice_count);
+        result = storage_allocator_reclaim_alloc_ex(
+                FS_BLOCK_HASH_CODE(bs_key->block), alloc_size,
+                spaces, slice_count, allow_split);
     } else {
-        result = storage_allocator_normal_alloc(
-                FS_BLOCK_HASH_CODE(bs_key->block),
-                bs_key->slice.length, spaces, slice_count);
+        result = storage_allocator_normal_alloc_ex(
+                FS_BLOCK_HASH_CODE(bs_key->block), alloc_size,
+                spaces, slice_count, is_normal, allow_split);
     }
 
     if (result != 0) {
         logError("file: "__FILE__", line: %d, "
                 "alloc disk space %d bytes fail, "
                 "errno: %d, error info: %s",
-                __LINE__, bs_key->slice.length,
-                result, STRERROR(result));
+                __LINE__, alloc_size, result, STRERROR(result));
         return result;
     }
 
@@ -276,6 +304,11 @@ static int fs_slice_alloc(const FSBlockSliceKeyInfo *bs_key,
     return result;
 }
 
+#define fs_slice_alloc(bs_key, slice_type, reclaim_alloc, \
+        slice_sn_pairs, slice_count) \
+    fs_slice_alloc_ex(bs_key, (bs_key)->slice.length, slice_type, \
+            reclaim_alloc, true, slice_sn_pairs, slice_count)
+
 #ifdef OS_LINUX
 
 void fs_release_task_aio_buffers(struct fast_task_info *task)
@@ -283,6 +316,16 @@ void fs_release_task_aio_buffers(struct fast_task_info *task)
     fs_release_aio_buffers(&SLICE_OP_CTX);
 }
 
+static inline void set_slice_checksum_by_iovec(OBSliceEntry *slice,
+        const iovec_array_t *iov_arr)
+{
+    if (SLICE_CHECKSUM_ENABLED) {
+        slice->checksum.crc32c = fs_crc32c_iovec(
+                iov_arr->iovs, iov_arr->count);
+        slice->checksum.valid = true;
+    }
+}
+
 static int write_iovec_array(FSSliceOpContext *op_ctx)
 {
     FSSliceSNPair *slice_sn_pair;
@@ -310,6 +353,8 @@ static int write_iovec_array(FSSliceOpContext *op_ctx)
                     (*aligned_buffer)->length);
         }
         op_ctx->iovec_array.count = op_ctx->aio_buffer_parray.count;
+        set_slice_checksum_by_iovec(op_ctx->update.sarray.
+                slice_sn_pairs[0].slice, &op_ctx->iovec_array);
 
         result = trunk_write_thread_push_slice_by_iovec(
                 op_ctx->update.sarray.slice_sn_pairs[0].version,
@@ -369,6 +414,7 @@ static int write_iovec_array(FSSliceOpContext *op_ctx)
             }
 
             iov_arr.count = iovc - iov_arr.iovs;
+            set_slice_checksum_by_iovec(slice_sn_pair->slice, &iov_arr);
             if ((result=trunk_write_thread_push_slice_by_iovec(
                             slice_sn_pair->version, slice_sn_pair->slice,
                             &iov_arr, slice_write_done, op_ctx)) != 0)
@@ -384,6 +430,348 @@ static int write_iovec_array(FSSliceOpContext *op_ctx)
 }
 #endif
 
+static int check_alloc_compress_buffer(BufferInfo *buffer, const int size)
+{
+    char *buff;
+    int alloc_size;
+
+    if (buffer->alloc_size >= size) {
+        return 0;
+    }
+
+    alloc_size = MEM_ALIGN_CEIL(size, FS_COMPRESS_BUFFER_ALIGN_SIZE);
+    if ((buff=(char *)fc_malloc(alloc_size)) == NULL) {
+        return ENOMEM;
+    }
+
+    if (buffer->buff != NULL) {
+        free(buffer->buff);
+    }
+    buffer->buff = buff;
+    buffer->alloc_size = alloc_size;
+    return 0;
+}
+
+static const char *get_slice_input_buff(FSSliceOpContext *op_ctx)
+{
+#ifdef OS_LINUX
+    AlignedReadBuffer **aligned_buffer;
+    AlignedReadBuffer **aligned_bend;
+    char *p;
+
+    if (op_ctx->info.buffer_type != fs_buffer_type_array) {
+        return op_ctx->info.buff;
+    }
+
+    if (check_alloc_compress_buffer(&op_ctx->compress.input,
+                op_ctx->info.bs_key.slice.length) != 0)
+    {
+        return NULL;
+    }
+
+    p = op_ctx->compress.input.buff;
+    aligned_bend = op_ctx->aio_buffer_parray.buffers +
+        op_ctx->aio_buffer_parray.count;
+    for (aligned_buffer=op_ctx->aio_buffer_parray.buffers;
+            aligned_buffer<aligned_bend; aligned_buffer++)
+    {
+        memcpy(p, (*aligned_buffer)->buff + (*aligned_buffer)->offset,
+                (*aligned_buffer)->length);
+        p += (*aligned_buffer)->length;
+    }
+    op_ctx->compress.input.length = p - op_ctx->compress.input.buff;
+    return op_ctx->compress.input.buff;
+#else
+    return op_ctx->info.buff;
+#endif
+}
+
+static void dedup_prepare_register(FSSliceOpContext *op_ctx)
+{
+    FSTrunkAllocator *allocator;
+    OBSliceEntry *slice;
+
+    if (!op_ctx->dedup.registering) {
+        return;
+    }
+
+    //the split slice can't be shared
+    if (op_ctx->update.sarray.count != 1) {
+        op_ctx->dedup.registering = false;
+        return;
+    }
+
+    slice = op_ctx->update.sarray.slice_sn_pairs[0].slice;
+    allocator = g_allocator_mgr->allocator_ptr_array.
+        allocators[slice->space.store->index];
+    if (trunk_allocator_get_trunk(allocator, slice->space.id_info.id,
+                &op_ctx->dedup.generation) == NULL)
+    {
+        op_ctx->dedup.registering = false;
+    }
+}
+
+typedef struct dedup_verify_context {
+    int result;
+    bool finished;
+    pthread_lock_cond_pair_t lcp;
+} DedupVerifyContext;
+
+static void dedup_verify_read_done(struct trunk_read_io_buffer
+        *record, const int result)
+{
+    DedupVerifyContext *vctx;
+
+    vctx = (DedupVerifyContext *)record->notify.arg;
+    PTHREAD_MUTEX_LOCK(&vctx->lcp.lock);
+    vctx->result = result;
+    vctx->finished = true;
+    pthread_cond_signal(&vctx->lcp.cond);
+    PTHREAD_MUTEX_UNLOCK(&vctx->lcp.lock);
+}
+
+/* the fingerprint (MD5 and length) is a hint only, read back the data
+ * of the shared space and compare with the input before sharing it
+ * return 0 for the same data, EEXIST for the fingerprint collision */
+static int dedup_verify_slice(FSSliceOpContext *op_ctx,
+        OBSliceEntry *slice, const char *input)
+{
+    DedupVerifyContext vctx;
+    const char *data;
+#ifdef OS_LINUX
+    AlignedReadBuffer *aligned_buffer;
+#endif
+    int result;
+
+    if ((result=init_pthread_lock_cond_pair(&vctx.lcp)) != 0) {
+        return result;
+    }
+    vctx.result = 0;
+    vctx.finished = false;
+
+#ifdef OS_LINUX
+    aligned_buffer = NULL;
+    result = trunk_read_thread_push(slice, &aligned_buffer,
+            dedup_verify_read_done, &vctx);
+#else
+    if ((result=check_alloc_compress_buffer(&op_ctx->compress.output,
+                    slice->ssize.length)) == 0)
+    {
+        result = trunk_read_thread_push(slice, op_ctx->compress.
+                output.buff, dedup_verify_read_done, &vctx);
+    }
+#endif
+
+    if (result == 0) {
+        //the context is on the stack, MUST wait the read done
+        PTHREAD_MUTEX_LOCK(&vctx.lcp.lock);
+        while (!vctx.finished) {
+            pthread_cond_wait(&vctx.lcp.cond, &vctx.lcp.lock);
+        }
+        PTHREAD_MUTEX_UNLOCK(&vctx.lcp.lock);
+        result = vctx.result;
+    }
+
+    if (result == 0) {
+#ifdef OS_LINUX
+        data = aligned_buffer->buff + aligned_buffer->offset;
+#else
+        data = op_ctx->compress.output.buff;
+#endif
+        if (memcmp(data, input, slice->ssize.length) != 0) {
+            logWarning("file: "__FILE__", line: %d, "
+                    "slice dedup fingerprint collision, length: %d, "
+                    "trunk {path index: %d, id: %"PRId64", offset: "
+                    "%"PRId64"}", __LINE__, slice->ssize.length,
+                    slice->space.store->index, slice->space.id_info.id,
+                    slice->space.offset);
+            result = EEXIST;
+        }
+    }
+
+#ifdef OS_LINUX
+    if (aligned_buffer != NULL) {
+        read_buffer_pool_free(aligned_buffer);
+    }
+#endif
+    destroy_pthread_lock_cond_pair(&vctx.lcp);
+    return result;
+}
+
+/* share the space of the slice with the same data
+ * return EAGAIN when not found */
+static int dedup_slice_write(FSSliceOpContext *op_ctx, const char *input)
+{
+    FSSliceDedupInfo info;
+    OBSliceEntry *slice;
+
+    if (slice_dedup_lookup(&op_ctx->dedup.fp, &info) != 0) {
+        return EAGAIN;
+    }
+
+    slice = alloc_init_slice(&op_ctx->info.bs_key.block, &info.space,
+            OB_SLICE_TYPE_FILE, op_ctx->info.bs_key.slice.offset,
+            op_ctx->info.bs_key.slice.length);
+    if (slice == NULL) {
+        slice_dedup_unpin(info.trunk);
+        return EAGAIN;
+    }
+
+    slice->checksum.valid = info.checksum.valid;
+    slice->checksum.crc32c = info.checksum.crc32c;
+    slice->compress.type = info.compress.type;
+    slice->compress.length = info.compress.length;
+    slice->compress.offset = 0;
+
+    //write the raw data when the read fails or the data differs
+    if (dedup_verify_slice(op_ctx, slice, input) != 0) {
+        ob_index_free_slice(slice);
+        slice_dedup_unpin(info.trunk);
+        return EAGAIN;
+    }
+
+    //unpin the trunk after the slice added to the trunk by fs_write_finish
+    op_ctx->dedup.pinned_trunk = info.trunk;
+    op_ctx->update.sarray.slice_sn_pairs[0].slice = slice;
+    op_ctx->update.sarray.slice_sn_pairs[0].version = 0;
+    op_ctx->update.sarray.count = 1;
+    op_ctx->done_bytes = op_ctx->info.bs_key.slice.length;
+    op_ctx->result = 0;
+    op_ctx->counter = 0;
+    op_ctx->rw_done_callback(op_ctx, op_ctx->arg);
+    return 0;
+}
+
+static inline void compress_backoff(FSClusterDataGroupInfo *group)
+{
+    if (group->compress.backoff == 0) {
+        group->compress.backoff = 1;
+    } else if (group->compress.backoff < FS_COMPRESS_MAX_SKIP_COUNT) {
+        group->compress.backoff *= 2;
+    }
+    group->compress.skip_count = group->compress.backoff;
+}
+
+/* write the compressed slice
+ * return EAGAIN for writing the raw data */
+static int compress_slice_write(FSSliceOpContext *op_ctx,
+        FSClusterDataGroupInfo *group, const char *input)
+{
+    FSSliceSNPair *slice_sn_pair;
+    OBSliceEntry *slice;
+    int length;
+    int max_length;
+    int compressed_len;
+    int result;
+
+    length = op_ctx->info.bs_key.slice.length;
+    if (check_alloc_compress_buffer(&op_ctx->compress.output, length) != 0) {
+        return EAGAIN;
+    }
+
+    //the compressed data should save 1/8 space at least
+    max_length = length - length / 8;
+    if ((result=fs_compress_data(group->compress.type, input, length,
+                    op_ctx->compress.output.buff, max_length,
+                    &compressed_len)) != 0)
+    {
+        if (result == EOVERFLOW) {  //incompressible data
+            compress_backoff(group);
+        }
+        return EAGAIN;
+    }
+    group->compress.backoff = 0;
+    op_ctx->compress.output.length = compressed_len;
+
+    //the compressed data can't be split
+    if ((result=fs_slice_alloc_ex(&op_ctx->info.bs_key, compressed_len,
+                    OB_SLICE_TYPE_FILE, op_ctx->info.source ==
+                    BINLOG_SOURCE_RECLAIM, false, op_ctx->update.sarray.
+                    slice_sn_pairs, &op_ctx->update.sarray.count)) != 0)
+    {
+        op_ctx->result = result;
+        op_ctx->rw_done_callback(op_ctx, op_ctx->arg);
+        return result;
+    }
+
+    dedup_prepare_register(op_ctx);
+    slice_sn_pair = op_ctx->update.sarray.slice_sn_pairs;
+    slice = slice_sn_pair->slice;
+    slice->compress.type = group->compress.type;
+    slice->compress.length = compressed_len;
+    slice->compress.offset = 0;
+
+    //the checksum of the raw data is required by the slice binlog
+    slice->checksum.crc32c = fs_crc32c(input, length);
+    slice->checksum.valid = true;
+
+    op_ctx->result = 0;
+    op_ctx->counter = 1;
+    return trunk_write_thread_push_slice_by_buff(slice_sn_pair->version,
+            slice, op_ctx->compress.output.buff, slice_write_done, op_ctx);
+}
+
+static FSClusterDataGroupInfo *get_compress_data_group(
+        FSSliceOpContext *op_ctx)
+{
+    FSClusterDataGroupInfo *group;
+
+    if (op_ctx->info.bs_key.slice.length < FS_COMPRESS_MIN_SLICE_LENGTH) {
+        return NULL;
+    }
+
+    group = fs_get_data_group(op_ctx->info.data_group_id);
+    if (group == NULL || group->compress.type == FS_COMPRESS_TYPE_NONE) {
+        return NULL;
+    }
+
+    /* the skip count and backoff are hints only,
+       so they are modified without lock */
+    if (group->compress.skip_count > 0) {
+        group->compress.skip_count--;
+        return NULL;
+    }
+
+    return group;
+}
+
+/* dedup or compress the slice
+ * return EAGAIN for writing the raw data */
+static int dedup_compress_write(FSSliceOpContext *op_ctx)
+{
+    FSClusterDataGroupInfo *group;
+    const char *input;
+    bool dedup;
+    int result;
+
+    dedup = STORAGE_CFG.slice_dedup.enabled && op_ctx->info.bs_key.
+        slice.length >= STORAGE_CFG.slice_dedup.min_slice_size;
+    group = get_compress_data_group(op_ctx);
+    if (!dedup && group == NULL) {
+        return EAGAIN;
+    }
+
+    if ((input=get_slice_input_buff(op_ctx)) == NULL) {
+        return EAGAIN;
+    }
+
+    if (dedup) {
+        slice_dedup_calc_fingerprint(input, op_ctx->info.
+                bs_key.slice.length, &op_ctx->dedup.fp);
+        if (!op_ctx->dedup.lookup_disabled) {
+            if ((result=dedup_slice_write(op_ctx, input)) != EAGAIN) {
+                return result;
+            }
+        }
+        op_ctx->dedup.registering = true;
+    }
+
+    if (group != NULL) {
+        return compress_slice_write(op_ctx, group, input);
+    }
+    return EAGAIN;
+}
+
 int fs_slice_write(FSSliceOpContext *op_ctx)
 {
     FSSliceSNPair *slice_sn_pair;
@@ -392,6 +780,12 @@ int fs_slice_write(FSSliceOpContext *op_ctx)
 
     op_ctx->done_bytes = 0;
     op_ctx->update.space_changed = 0;
+    op_ctx->dedup.registering = false;
+    op_ctx->dedup.pinned_trunk = NULL;
+    if ((result=dedup_compress_write(op_ctx)) != EAGAIN) {
+        return result;
+    }
+
     if ((result=fs_slice_alloc(&op_ctx->info.bs_key, OB_SLICE_TYPE_FILE,
                     op_ctx->info.source == BINLOG_SOURCE_RECLAIM,
                     op_ctx->update.sarray.slice_sn_pairs,
@@ -402,6 +796,7 @@ int fs_slice_write(FSSliceOpContext *op_ctx)
         return result;
     }
 
+    dedup_prepare_register(op_ctx);
     op_ctx->result = 0;
     op_ctx->counter = op_ctx->update.sarray.count;
 #ifdef OS_LINUX
@@ -411,6 +806,8 @@ int fs_slice_write(FSSliceOpContext *op_ctx)
 #endif
 
     if (op_ctx->update.sarray.count == 1) {
+        set_slice_checksum(op_ctx->update.sarray.slice_sn_pairs[0].
+                slice, op_ctx->info.buff);
         result = trunk_write_thread_push_slice_by_buff(
                 op_ctx->update.sarray.slice_sn_pairs[0].version,
                 op_ctx->update.sarray.slice_sn_pairs[0].slice,
@@ -426,6 +823,7 @@ int fs_slice_write(FSSliceOpContext *op_ctx)
                 slice_sn_pair<slice_sn_end; slice_sn_pair++)
         {
             length = slice_sn_pair->slice->ssize.length;
+            set_slice_checksum(slice_sn_pair->slice, ps);
             if ((result=trunk_write_thread_push_slice_by_buff(
                             slice_sn_pair->version, slice_sn_pair->slice,
                             ps, slice_write_done, op_ctx)) != 0)
@@ -675,11 +1073,48 @@ static void do_read_done(OBSliceEntry *slice, FSSliceOpContext *op_ctx,
     }
 }
 
+static int verify_slice_checksum(OBSliceEntry *slice, const char *buff)
+{
+    uint32_t crc32c;
+
+    crc32c = fs_crc32c(buff, slice->ssize.length);
+    if (crc32c == slice->checksum.crc32c) {
+        return 0;
+    }
+
+    logError("file: "__FILE__", line: %d, "
+            "slice checksum mismatch, block {oid: %"PRId64", "
+            "offset: %"PRId64"}, slice {offset: %d, length: %d}, "
+            "trunk {path index: %d, id: %"PRId64", offset: %"PRId64"}, "
+            "expect crc32c: %08x, actual: %08x", __LINE__,
+            slice->ob->bkey.oid, slice->ob->bkey.offset,
+            slice->ssize.offset, slice->ssize.length,
+            slice->space.store->index, slice->space.id_info.id,
+            slice->space.offset, slice->checksum.crc32c, crc32c);
+    return EIO;
+}
+
 static void slice_read_done(struct trunk_read_io_buffer
         *record, const int result)
 {
+    int r;
+
+    if (result == 0 && record->slice->checksum.valid &&
+            SLICE_CHECKSUM_ENABLED)
+    {
+#ifdef OS_LINUX
+        r = verify_slice_checksum(record->slice,
+                (*record->aligned_buffer)->buff +
+                (*record->aligned_buffer)->offset);
+#else
+        r = verify_slice_checksum(record->slice, record->data);
+#endif
+    } else {
+        r = result;
+    }
+
     do_read_done(record->slice, (FSSliceOpContext *)
-            record->notify.arg, result);
+            record->notify.arg, r);
 }
 
 #ifdef OS_LINUX
@@ -951,3 +1386,131 @@ int fs_log_delete_block(FSSliceOpContext *op_ctx)
 
     return 0;
 }
+
+/* log the changes of the dest block applied to the object block index */
+static int log_clone_slice_binlog(FSSliceOpContext *op_ctx,
+        const time_t current_time)
+{
+    FSSliceSNPair *slice_sn_pair;
+    FSSliceSNPair *slice_sn_end;
+    int result;
+
+    result = 0;
+    if (op_ctx->info.sn != 0) {  //the old slices of dest block deleted
+        result = slice_binlog_log_del_block(&op_ctx->info.bs_key.block,
+                current_time, op_ctx->info.sn, op_ctx->info.data_version,
+                op_ctx->info.source);
+    }
+
+    slice_sn_end = op_ctx->update.sarray.slice_sn_pairs +
+        op_ctx->update.sarray.count;
+    for (slice_sn_pair=op_ctx->update.sarray.slice_sn_pairs; result == 0 &&
+            slice_sn_pair<slice_sn_end; slice_sn_pair++)
+    {
+        result = slice_binlog_log_add_slice(slice_sn_pair->slice,
+                current_time, slice_sn_pair->sn, op_ctx->info.
+                data_version, op_ctx->info.source);
+    }
+
+    return result;
+}
+
+static int alloc_clone_slices(FSSliceOpContext *op_ctx)
+{
+    OBSliceEntry **pp;
+    OBSliceEntry **end;
+    OBSliceEntry *slice;
+    int result;
+
+    if (op_ctx->update.sarray.alloc < op_ctx->slice_ptr_array.count) {
+        if ((result=realloc_slice_sn_pairs(&op_ctx->update.sarray,
+                        op_ctx->slice_ptr_array.count)) != 0)
+        {
+            return result;
+        }
+    }
+
+    /* the cloned slice shares the trunk space with the source slice,
+       the later write of either block allocates the new space */
+    end = op_ctx->slice_ptr_array.slices + op_ctx->slice_ptr_array.count;
+    for (pp=op_ctx->slice_ptr_array.slices; pp<end; pp++) {
+        if ((slice=ob_index_alloc_slice(&op_ctx->info.
+                        bs_key.block)) == NULL)
+        {
+            return ENOMEM;
+        }
+
+        slice->type = (*pp)->type;
+        slice->ssize = (*pp)->ssize;
+        slice->space = (*pp)->space;
+        slice->checksum = (*pp)->checksum;
+        slice->compress = (*pp)->compress;
+        op_ctx->update.sarray.slice_sn_pairs[op_ctx->
+            update.sarray.count++].slice = slice;
+    }
+
+    return 0;
+}
+
+int fs_clone_block(FSSliceOpContext *op_ctx)
+{
+    int result;
+    int dec_alloc;
+    int inc_alloc;
+
+    op_ctx->info.sn = 0;
+    op_ctx->update.sarray.count = 0;
+    op_ctx->update.space_changed = 0;
+    if ((result=ob_index_get_clone_slices(&op_ctx->info.src_block,
+                    &op_ctx->slice_ptr_array)) != 0)
+    {
+        if (result != ENOENT) {
+            return result;
+        }
+
+        //the source block is empty, delete the dest block only
+        if ((result=ob_index_delete_block(&op_ctx->info.bs_key.block,
+                        &op_ctx->info.sn, &dec_alloc, false)) == 0)
+        {
+            op_ctx->update.space_changed -= dec_alloc;
+            set_data_version(op_ctx);
+        }
+        return result;
+    }
+
+    /* all cloned slices are allocated before the old slices of the dest
+       block are replaced, so the index keeps untouched on failure */
+    if ((result=alloc_clone_slices(op_ctx)) == 0) {
+        if ((result=ob_index_replace_block_slices(&op_ctx->update.sarray,
+                        &op_ctx->info.sn, &dec_alloc, &inc_alloc)) == 0)
+        {
+            op_ctx->update.space_changed += inc_alloc - dec_alloc;
+        }
+    }
+    ob_index_release_clone_slices(&op_ctx->slice_ptr_array);
+
+    if (result == 0) {
+        set_data_version(op_ctx);
+    } else {
+        free_slice_array(&op_ctx->update.sarray);
+    }
+    return result;
+}
+
+int fs_log_clone_block(FSSliceOpContext *op_ctx)
+{
+    int result;
+    time_t current_time;
+
+    current_time = g_current_time;
+    result = log_clone_slice_binlog(op_ctx, current_time);
+    if (result == 0 && op_ctx->info.write_binlog.log_replica) {
+        result = replica_binlog_log_clone_block(current_time,
+                op_ctx->info.data_group_id, op_ctx->info.data_version,
+                &op_ctx->info.bs_key.block, &op_ctx->info.src_block,
+                op_ctx->info.source);
+    }
+
+    free_slice_array(&op_ctx->update.sarray);
+    return result;
+}
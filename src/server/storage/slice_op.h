@@ -81,10 +81,15 @@ extern "C" {
     int fs_delete_slices(FSSliceOpContext *op_ctx);
     int fs_delete_block(FSSliceOpContext *op_ctx);
 
+    /* clone the slices of op_ctx->info.src_block to the block
+       op_ctx->info.bs_key.block by sharing the trunk space */
+    int fs_clone_block(FSSliceOpContext *op_ctx);
+
     int fs_log_slice_write(FSSliceOpContext *op_ctx);
     int fs_log_slice_allocate(FSSliceOpContext *op_ctx);
     int fs_log_delete_slices(FSSliceOpContext *op_ctx);
     int fs_log_delete_block(FSSliceOpContext *op_ctx);
+    int fs_log_clone_block(FSSliceOpContext *op_ctx);
 
 #ifdef __cplusplus
 }
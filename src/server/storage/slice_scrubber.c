@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <sys/stat.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "fastcommon/fc_atomic.h"
+#include "sf/sf_global.h"
+#include "../../common/fs_crc32c.h"
+#include "../../client/fs_client.h"
+#include "../server_global.h"
+#include "../server_group_info.h"
+#include "../binlog/binlog_types.h"
+#include "slice_op.h"
+#include "slice_scrubber.h"
+
+#define SLICE_SCRUB_START_DELAY  300
+
+typedef struct slice_scrub_context {
+    FSSliceOpContext op_ctx;
+    OBSlicePtrArray sarray;
+    struct {
+        bool finished;
+        pthread_lock_cond_pair_t lcp; //for notify
+    } notify;
+
+    struct {
+        int64_t start_time_ms;
+        int64_t read_bytes;
+    } rate;  //for read speed limit
+
+    struct {
+        int64_t slice_count;
+        int64_t corrupt_count;
+        int64_t repair_count;
+    } stat;  //for the current round
+} SliceScrubContext;
+
+static SliceScrubContext scrub_ctx;
+
+static void scrub_rw_done_callback(FSSliceOpContext *op_ctx,
+        SliceScrubContext *ctx)
+{
+    PTHREAD_MUTEX_LOCK(&ctx->notify.lcp.lock);
+    ctx->notify.finished = true;
+    pthread_cond_signal(&ctx->notify.lcp.cond);
+    PTHREAD_MUTEX_UNLOCK(&ctx->notify.lcp.lock);
+}
+
+static int wait_rw_done(SliceScrubContext *ctx)
+{
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&ctx->notify.lcp.lock);
+    while (!ctx->notify.finished && SF_G_CONTINUE_FLAG) {
+        pthread_cond_wait(&ctx->notify.lcp.cond,
+                &ctx->notify.lcp.lock);
+    }
+    result = ctx->notify.finished ? ctx->op_ctx.result : EINTR;
+    ctx->notify.finished = false;  /* reset for next call */
+    PTHREAD_MUTEX_UNLOCK(&ctx->notify.lcp.lock);
+
+    return result;
+}
+
+static int init_scrub_ctx(SliceScrubContext *ctx)
+{
+    int result;
+
+    ob_index_init_slice_ptr_array(&ctx->sarray);
+    ob_index_init_slice_ptr_array(&ctx->op_ctx.slice_ptr_array);
+    ctx->op_ctx.info.source = BINLOG_SOURCE_RECLAIM;
+    ctx->op_ctx.info.write_binlog.log_replica = false;
+    ctx->op_ctx.info.data_version = 0;
+    ctx->op_ctx.info.myself = NULL;
+    ctx->op_ctx.dedup.lookup_disabled = true;  //the shared space may be bad
+
+#ifdef OS_LINUX
+    ctx->op_ctx.info.buffer_type = fs_buffer_type_direct;
+#endif
+    ctx->op_ctx.info.buff = (char *)fc_malloc(FS_FILE_BLOCK_SIZE);
+    if (ctx->op_ctx.info.buff == NULL) {
+        return ENOMEM;
+    }
+
+    if ((result=init_pthread_lock_cond_pair(&ctx->notify.lcp)) != 0) {
+        return result;
+    }
+
+    ctx->notify.finished = false;
+    ctx->op_ctx.rw_done_callback = (fs_rw_done_callback_func)
+        scrub_rw_done_callback;
+    ctx->op_ctx.arg = ctx;
+    return fs_init_slice_op_ctx(&ctx->op_ctx.update.sarray);
+}
+
+static void scrub_rate_limit(SliceScrubContext *ctx, const int read_bytes)
+{
+    int64_t expect_time_ms;
+    int64_t elapsed_ms;
+
+    ctx->rate.read_bytes += read_bytes;
+    expect_time_ms = ctx->rate.read_bytes * 1000 / STORAGE_CFG.
+        slice_checksum.scrub.read_bytes_per_second;
+    while (SF_G_CONTINUE_FLAG) {
+        elapsed_ms = get_current_time_ms() - ctx->rate.start_time_ms;
+        if (elapsed_ms >= expect_time_ms) {
+            break;
+        }
+        fc_sleep_ms(FC_MIN(expect_time_ms - elapsed_ms, 1000));
+    }
+}
+
+static inline void set_op_ctx_bs_key(SliceScrubContext *ctx,
+        const OBSliceEntry *slice)
+{
+    ctx->op_ctx.info.bs_key.block = slice->ob->bkey;
+    ctx->op_ctx.info.bs_key.slice = slice->ssize;
+    ctx->op_ctx.info.data_group_id = FS_DATA_GROUP_ID(slice->ob->bkey);
+}
+
+static int read_slice(SliceScrubContext *ctx)
+{
+    int result;
+
+    if ((result=fs_slice_read(&ctx->op_ctx)) == 0) {
+        result = wait_rw_done(ctx);
+    }
+
+#ifdef OS_LINUX
+    fs_release_aio_buffers(&ctx->op_ctx);
+#endif
+    return result;
+}
+
+/* the slice must be the same one in the object block index */
+static bool slice_is_current(SliceScrubContext *ctx, OBSliceEntry *slice)
+{
+    bool is_current;
+    OBSliceEntry **pp;
+    OBSliceEntry **end;
+
+    if (ob_index_get_slices(&ctx->op_ctx.info.bs_key,
+                &ctx->op_ctx.slice_ptr_array, true) != 0)
+    {
+        return false;
+    }
+
+    is_current = (ctx->op_ctx.slice_ptr_array.count == 1 &&
+            ctx->op_ctx.slice_ptr_array.slices[0] == slice);
+    end = ctx->op_ctx.slice_ptr_array.slices +
+        ctx->op_ctx.slice_ptr_array.count;
+    for (pp=ctx->op_ctx.slice_ptr_array.slices; pp<end; pp++) {
+        ob_index_free_slice(*pp);
+    }
+    ctx->op_ctx.slice_ptr_array.count = 0;
+    return is_current;
+}
+
+/* fetch the slice from the other servers of the data group, the data
+ * MUST match the checksum to avoid the stale or corrupted copy */
+static int fetch_slice_from_peers(SliceScrubContext *ctx,
+        const OBSliceEntry *slice)
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+    ConnectionInfo *conn;
+    int read_bytes;
+    int result;
+
+    if ((group=fs_get_data_group(ctx->op_ctx.info.data_group_id)) == NULL) {
+        return ENOENT;
+    }
+
+    result = ENOENT;
+    end = group->data_server_array.servers + group->data_server_array.count;
+    for (ds=group->data_server_array.servers; ds<end; ds++) {
+        if (ds == group->myself || FC_ATOMIC_GET(ds->status) !=
+                FS_DS_STATUS_ACTIVE)
+        {
+            continue;
+        }
+
+        if ((conn=g_fs_client_vars.client_ctx.cm.ops.get_spec_connection(
+                        &g_fs_client_vars.client_ctx.cm,
+                        &REPLICA_GROUP_ADDRESS_FIRST_PTR(ds->cs->server)->
+                        conn, &result)) == NULL)
+        {
+            continue;
+        }
+
+        result = fs_client_proto_slice_read_ex(&g_fs_client_vars.client_ctx,
+                conn, 0, FS_REPLICA_PROTO_SLICE_READ_REQ,
+                FS_REPLICA_PROTO_SLICE_READ_RESP, &ctx->op_ctx.info.bs_key,
+                ctx->op_ctx.info.buff, &read_bytes);
+        SF_CLIENT_RELEASE_CONNECTION(&g_fs_client_vars.client_ctx.cm,
+                conn, result);
+        if (result != 0) {
+            continue;
+        }
+
+        if (read_bytes == slice->ssize.length && fs_crc32c(ctx->op_ctx.
+                    info.buff, read_bytes) == slice->checksum.crc32c)
+        {
+            return 0;
+        }
+
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, block {oid: %"PRId64", "
+                "offset: %"PRId64"}, slice {offset: %d, length: %d}, "
+                "the data from server id: %d not match the checksum",
+                __LINE__, ctx->op_ctx.info.data_group_id,
+                ctx->op_ctx.info.bs_key.block.oid,
+                ctx->op_ctx.info.bs_key.block.offset,
+                ctx->op_ctx.info.bs_key.slice.offset,
+                ctx->op_ctx.info.bs_key.slice.length, ds->cs->server->id);
+        result = EIO;
+    }
+
+    return result;
+}
+
+static int write_slice(SliceScrubContext *ctx)
+{
+    int result;
+
+    if ((result=fs_slice_write(&ctx->op_ctx)) == 0) {
+        result = wait_rw_done(ctx);
+    } else {
+        ctx->op_ctx.result = result;
+        ctx->notify.finished = false;  //called by fs_slice_write
+    }
+
+    fs_write_finish(&ctx->op_ctx);  //for add slice index and cleanup
+    if (ctx->op_ctx.result != 0) {
+        return ctx->op_ctx.result;
+    }
+
+    return fs_log_slice_write(&ctx->op_ctx);
+}
+
+static int repair_slice(SliceScrubContext *ctx, OBSliceEntry *slice)
+{
+    OBEntry *ob;
+    int result;
+
+    /* block the normal update of this block during the repair */
+    if ((ob=ob_index_reclaim_lock(&slice->ob->bkey)) == NULL) {
+        return ENOENT;
+    }
+
+    do {
+        if (!slice_is_current(ctx, slice)) {
+            result = ENOENT;
+            break;
+        }
+
+        if ((result=read_slice(ctx)) != EIO) {
+            break;  //recheck the slice under lock
+        }
+
+        if ((result=fetch_slice_from_peers(ctx, slice)) != 0) {
+            break;
+        }
+
+        result = write_slice(ctx);
+    } while (0);
+
+    ob_index_reclaim_unlock(ob);
+    return result;
+}
+
+static void scrub_slice(SliceScrubContext *ctx, OBSliceEntry *slice)
+{
+    int result;
+
+    set_op_ctx_bs_key(ctx, slice);
+    result = read_slice(ctx);
+    scrub_rate_limit(ctx, slice->ssize.length);
+    ctx->stat.slice_count++;
+    if (result != EIO) {
+        return;
+    }
+
+    ctx->stat.corrupt_count++;
+    if ((result=repair_slice(ctx, slice)) == 0) {
+        ctx->stat.repair_count++;
+        logInfo("file: "__FILE__", line: %d, "
+                "data group id: %d, block {oid: %"PRId64", "
+                "offset: %"PRId64"}, slice {offset: %d, length: %d}, "
+                "repair the corrupted slice successfully", __LINE__,
+                ctx->op_ctx.info.data_group_id,
+                ctx->op_ctx.info.bs_key.block.oid,
+                ctx->op_ctx.info.bs_key.block.offset,
+                ctx->op_ctx.info.bs_key.slice.offset,
+                ctx->op_ctx.info.bs_key.slice.length);
+    } else if (result != ENOENT) {
+        logError("file: "__FILE__", line: %d, "
+                "data group id: %d, block {oid: %"PRId64", "
+                "offset: %"PRId64"}, slice {offset: %d, length: %d}, "
+                "repair the corrupted slice fail, errno: %d, "
+                "error info: %s", __LINE__, ctx->op_ctx.info.data_group_id,
+                ctx->op_ctx.info.bs_key.block.oid,
+                ctx->op_ctx.info.bs_key.block.offset,
+                ctx->op_ctx.info.bs_key.slice.offset,
+                ctx->op_ctx.info.bs_key.slice.length,
+                result, STRERROR(result));
+    }
+}
+
+static void scrub_one_round(SliceScrubContext *ctx)
+{
+    int64_t bucket_index;
+    int64_t start_time;
+    OBSliceEntry **pp;
+    OBSliceEntry **end;
+
+    start_time = get_current_time_ms();
+    ctx->rate.start_time_ms = start_time;
+    ctx->rate.read_bytes = 0;
+    memset(&ctx->stat, 0, sizeof(ctx->stat));
+
+    for (bucket_index=0; bucket_index<g_ob_hashtable.capacity &&
+            SF_G_CONTINUE_FLAG; bucket_index++)
+    {
+        if (ob_index_get_checksum_slices(bucket_index, &ctx->sarray) != 0) {
+            continue;
+        }
+
+        end = ctx->sarray.slices + ctx->sarray.count;
+        for (pp=ctx->sarray.slices; pp<end; pp++) {
+            if (SF_G_CONTINUE_FLAG) {
+                scrub_slice(ctx, *pp);
+            }
+            ob_index_free_slice(*pp);
+        }
+        ctx->sarray.count = 0;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "slice scrub round done, slice count: %"PRId64", "
+            "corrupted count: %"PRId64", repaired count: %"PRId64", "
+            "time used: %"PRId64" s", __LINE__, ctx->stat.slice_count,
+            ctx->stat.corrupt_count, ctx->stat.repair_count,
+            (get_current_time_ms() - start_time) / 1000);
+}
+
+static void *slice_scrubber_thread_func(void *arg)
+{
+    SliceScrubContext *ctx;
+    time_t next_time;
+
+    ctx = (SliceScrubContext *)arg;
+#ifdef OS_LINUX
+    prctl(PR_SET_NAME, "slice-scrubber");
+#endif
+
+    next_time = g_current_time + SLICE_SCRUB_START_DELAY;
+    while (SF_G_CONTINUE_FLAG) {
+        if (g_current_time < next_time) {
+            sleep(1);
+            continue;
+        }
+
+        scrub_one_round(ctx);
+        next_time = g_current_time + STORAGE_CFG.
+            slice_checksum.scrub.round_interval;
+    }
+
+    return NULL;
+}
+
+int slice_scrubber_init()
+{
+    int result;
+    pthread_t tid;
+
+    if (!STORAGE_CFG.slice_checksum.scrub.enabled) {
+        return 0;
+    }
+
+    if ((result=init_scrub_ctx(&scrub_ctx)) != 0) {
+        return result;
+    }
+
+    return fc_create_thread(&tid, slice_scrubber_thread_func,
+            &scrub_ctx, SF_G_THREAD_STACK_SIZE);
+}
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fast_mblock.h"
+#include "fastcommon/fc_queue.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "storage_allocator.h"
+#include "raw_device.h"
+#include "space_discarder.h"
+
+typedef struct space_discard_entry {
+    FSTrunkFileInfo *trunk;
+    int64_t generation;  //the trunk generation when the slice deleted
+    int64_t offset;
+    int64_t length;
+    time_t expires;
+    struct space_discard_entry *next;
+} SpaceDiscardEntry;
+
+typedef struct {
+    int alloc;
+    int count;
+    SpaceDiscardEntry **entries;
+} SpaceDiscardEntryArray;
+
+typedef struct {
+    struct fast_mblock_man allocator; //element: SpaceDiscardEntry
+    struct fc_queue queue;
+
+    struct {
+        SpaceDiscardEntry *head;
+        SpaceDiscardEntry *tail;
+    } waiting;  //order by expires
+
+    SpaceDiscardEntryArray array;  //for sort and merge
+
+    struct {
+        int64_t discard_count;
+        int64_t discard_bytes;
+    } stat;
+} SpaceDiscardContext;
+
+static SpaceDiscardContext discard_ctx;
+
+int space_discarder_push(const FSTrunkSpaceInfo *space,
+        const int64_t offset, const int64_t length)
+{
+    FSTrunkAllocator *allocator;
+    SpaceDiscardEntry *entry;
+    FSTrunkFileInfo *trunk;
+    int64_t generation;
+
+    allocator = g_allocator_mgr->allocator_ptr_array.
+        allocators[space->store->index];
+    if ((trunk=trunk_allocator_get_trunk(allocator, space->
+                    id_info.id, &generation)) == NULL)
+    {
+        return ENOENT;
+    }
+
+    entry = (SpaceDiscardEntry *)fast_mblock_alloc_object(
+            &discard_ctx.allocator);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    entry->trunk = trunk;
+    entry->generation = generation;
+    entry->offset = offset;
+    entry->length = length;
+    entry->expires = g_current_time + STORAGE_CFG.
+        space_discard.delay_seconds;
+    fc_queue_push(&discard_ctx.queue, entry);
+    return 0;
+}
+
+static int check_alloc_entry_array(SpaceDiscardEntryArray *array)
+{
+    SpaceDiscardEntry **entries;
+    int alloc;
+
+    if (array->count < array->alloc) {
+        return 0;
+    }
+
+    alloc = (array->alloc == 0) ? 1024 : array->alloc * 2;
+    entries = (SpaceDiscardEntry **)fc_malloc(
+            sizeof(SpaceDiscardEntry *) * alloc);
+    if (entries == NULL) {
+        return ENOMEM;
+    }
+
+    if (array->entries != NULL) {
+        memcpy(entries, array->entries, sizeof(
+                    SpaceDiscardEntry *) * array->count);
+        free(array->entries);
+    }
+    array->alloc = alloc;
+    array->entries = entries;
+    return 0;
+}
+
+static int compare_entry(SpaceDiscardEntry **e1, SpaceDiscardEntry **e2)
+{
+    int sub;
+
+    if ((sub=(*e1)->trunk->allocator->path_info->store.index -
+                (*e2)->trunk->allocator->path_info->store.index) != 0)
+    {
+        return sub;
+    }
+
+    if ((sub=fc_compare_int64((*e1)->trunk->id_info.id,
+                    (*e2)->trunk->id_info.id)) != 0)
+    {
+        return sub;
+    }
+
+    if ((sub=fc_compare_int64((*e1)->generation,
+                    (*e2)->generation)) != 0)
+    {
+        return sub;
+    }
+
+    return fc_compare_int64((*e1)->offset, (*e2)->offset);
+}
+
+static int punch_trunk_file(FSTrunkFileInfo *trunk,
+        const int64_t offset, const int64_t length)
+{
+#ifdef OS_LINUX
+    char trunk_filename[PATH_MAX];
+    int fd;
+    int result;
+
+    snprintf(trunk_filename, sizeof(trunk_filename),
+            "%s/%04"PRId64"/%06"PRId64, trunk->allocator->path_info->
+            store.path.str, trunk->id_info.subdir, trunk->id_info.id);
+    if ((fd=open(trunk_filename, O_WRONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        if (result == ENOENT) {  //the trunk file not created yet
+            return 0;
+        }
+
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, trunk_filename, result, STRERROR(result));
+        return result;
+    }
+
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                offset, length) != 0)
+    {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "punch hole for file \"%s\" fail, offset: %"PRId64", "
+                "length: %"PRId64", errno: %d, error info: %s",
+                __LINE__, trunk_filename, offset, length,
+                result, STRERROR(result));
+    } else {
+        result = 0;
+    }
+
+    close(fd);
+    return result;
+#else
+    return EOPNOTSUPP;
+#endif
+}
+
+static int discard_trunk_space(FSTrunkFileInfo *trunk,
+        const int64_t offset, const int64_t length)
+{
+    if (trunk->allocator->path_info->device != NULL) {
+        return raw_device_discard(trunk->allocator->path_info->device,
+                &trunk->id_info, offset, length);
+    } else {
+        return punch_trunk_file(trunk, offset, length);
+    }
+}
+
+static void discard_space(SpaceDiscardEntry *entry,
+        const int64_t end_offset)
+{
+    int64_t discard_bytes;
+
+    /* the space of the deleted slice maybe still shared by the alive
+     * slices (such as the cloned and dedup slices), the trunk allocator
+     * checks the live space and discards the free blocks with its lock */
+    discard_bytes = trunk_allocator_discard_space(entry->trunk->allocator,
+            entry->trunk, entry->generation, entry->offset,
+            end_offset - entry->offset, discard_trunk_space);
+    if (discard_bytes > 0) {
+        discard_ctx.stat.discard_count++;
+        discard_ctx.stat.discard_bytes += discard_bytes;
+    }
+}
+
+static void discard_entries(SpaceDiscardEntryArray *array)
+{
+    SpaceDiscardEntry **entry;
+    SpaceDiscardEntry **current;
+    SpaceDiscardEntry **end;
+    int64_t end_offset;
+
+    if (array->count > 1) {
+        qsort(array->entries, array->count, sizeof(SpaceDiscardEntry *),
+                (int (*)(const void *, const void *))compare_entry);
+    }
+
+    /* merge the adjacent ranges of the same trunk */
+    end = array->entries + array->count;
+    current = array->entries;
+    end_offset = (*current)->offset + (*current)->length;
+    for (entry=array->entries + 1; entry<end; entry++) {
+        if ((*entry)->trunk == (*current)->trunk && (*entry)->generation ==
+                (*current)->generation && (*entry)->offset <= end_offset)
+        {
+            if ((*entry)->offset + (*entry)->length > end_offset) {
+                end_offset = (*entry)->offset + (*entry)->length;
+            }
+            continue;
+        }
+
+        discard_space(*current, end_offset);
+        current = entry;
+        end_offset = (*current)->offset + (*current)->length;
+    }
+    discard_space(*current, end_offset);
+
+    for (entry=array->entries; entry<end; entry++) {
+        fast_mblock_free_object(&discard_ctx.allocator, *entry);
+    }
+    array->count = 0;
+}
+
+static void deal_expired_entries()
+{
+    SpaceDiscardEntry *head;
+    SpaceDiscardEntry *entry;
+
+    if ((head=(SpaceDiscardEntry *)fc_queue_try_pop_all(
+                    &discard_ctx.queue)) != NULL)
+    {
+        if (discard_ctx.waiting.head == NULL) {
+            discard_ctx.waiting.head = head;
+        } else {
+            discard_ctx.waiting.tail->next = head;
+        }
+
+        entry = head;
+        while (entry->next != NULL) {
+            entry = entry->next;
+        }
+        discard_ctx.waiting.tail = entry;
+    }
+
+    while (discard_ctx.waiting.head != NULL && discard_ctx.
+            waiting.head->expires <= g_current_time)
+    {
+        entry = discard_ctx.waiting.head;
+        if (check_alloc_entry_array(&discard_ctx.array) != 0) {
+            break;
+        }
+        discard_ctx.array.entries[discard_ctx.array.count++] = entry;
+        discard_ctx.waiting.head = entry->next;
+    }
+    if (discard_ctx.waiting.head == NULL) {
+        discard_ctx.waiting.tail = NULL;
+    }
+
+    if (discard_ctx.array.count > 0) {
+        discard_entries(&discard_ctx.array);
+    }
+}
+
+static void *space_discarder_thread_func(void *arg)
+{
+    time_t last_log_time;
+
+#ifdef OS_LINUX
+    prctl(PR_SET_NAME, "space-discarder");
+#endif
+
+    last_log_time = g_current_time;
+    while (SF_G_CONTINUE_FLAG) {
+        sleep(1);
+        deal_expired_entries();
+
+        if (g_current_time - last_log_time >= 3600) {
+            if (discard_ctx.stat.discard_count > 0) {
+                logInfo("file: "__FILE__", line: %d, "
+                        "space discard count: %"PRId64", "
+                        "bytes: %"PRId64" MB", __LINE__,
+                        discard_ctx.stat.discard_count,
+                        discard_ctx.stat.discard_bytes / (1024 * 1024));
+                discard_ctx.stat.discard_count = 0;
+                discard_ctx.stat.discard_bytes = 0;
+            }
+            last_log_time = g_current_time;
+        }
+    }
+
+    return NULL;
+}
+
+int space_discarder_init()
+{
+    int result;
+    pthread_t tid;
+
+    if (!STORAGE_CFG.space_discard.enabled) {
+        return 0;
+    }
+
+    if ((result=fast_mblock_init_ex1(&discard_ctx.allocator,
+                    "space_discard_entry", sizeof(SpaceDiscardEntry),
+                    8 * 1024, 0, NULL, NULL, true)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=fc_queue_init(&discard_ctx.queue, (long)
+                    (&((SpaceDiscardEntry *)NULL)->next))) != 0)
+    {
+        return result;
+    }
+
+    return fc_create_thread(&tid, space_discarder_thread_func,
+            NULL, SF_G_THREAD_STACK_SIZE);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _SPACE_DISCARDER_H
+#define _SPACE_DISCARDER_H
+
+#include "storage_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int space_discarder_init();
+
+    /* release the space of the deleted slice range to the disk
+     * (punch hole for the trunk file or discard for the raw device)
+     * asynchronously after STORAGE_CFG.space_discard.delay_seconds */
+    int space_discarder_push(const FSTrunkSpaceInfo *space,
+            const int64_t offset, const int64_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,6 +20,7 @@
 #include "trunk_id_info.h"
 #include "trunk_freelist.h"
 #include "trunk_allocator.h"
+#include "../server_group_info.h"
 
 typedef struct {
     int count;
@@ -91,8 +92,8 @@ extern "C" {
 
     static inline int storage_allocator_normal_alloc_ex(
             const uint32_t blk_hc, const int size,
-            FSTrunkSpaceWithVersion *spaces,
-            int *count, const bool is_normal)
+            FSTrunkSpaceWithVersion *spaces, int *count,
+            const bool is_normal, const bool allow_split)
     {
         FSTrunkAllocatorPtrArray *avail_array;
         FSTrunkAllocator **allocator;
@@ -108,60 +109,79 @@ extern "C" {
 
             allocator = avail_array->allocators +
                 blk_hc % avail_array->count;
-            result = trunk_freelist_alloc_space(*allocator,
+            result = trunk_freelist_alloc_space_ex(*allocator,
                     &(*allocator)->freelist, blk_hc, size,
-                    spaces, count, is_normal);
+                    spaces, count, is_normal, allow_split);
         } while ((result == ENOSPC || result == EAGAIN) && is_normal);
 
         return result;
     }
 
-    static inline int storage_allocator_reclaim_alloc(const uint32_t blk_hc,
-            const int size, FSTrunkSpaceWithVersion *spaces, int *count)
+    static inline int storage_allocator_reclaim_alloc_ex(
+            const uint32_t blk_hc, const int size,
+            FSTrunkSpaceWithVersion *spaces, int *count,
+            const bool allow_split)
     {
         const bool is_normal = false;
         int result;
 
-        if ((result=storage_allocator_normal_alloc_ex(blk_hc,
-                        size, spaces, count, is_normal)) == 0)
+        if ((result=storage_allocator_normal_alloc_ex(blk_hc, size,
+                        spaces, count, is_normal, allow_split)) == 0)
         {
             return result;
         }
 
-        return trunk_freelist_alloc_space(NULL,
-                &g_allocator_mgr->reclaim_freelist, blk_hc,
-                size, spaces, count, is_normal);
+        return trunk_freelist_alloc_space_ex(NULL,
+                &g_allocator_mgr->reclaim_freelist, blk_hc, size,
+                spaces, count, is_normal, allow_split);
     }
 
+#define storage_allocator_reclaim_alloc(blk_hc, size, spaces, count) \
+    storage_allocator_reclaim_alloc_ex(blk_hc, size, spaces, count, true)
+
 #define storage_allocator_normal_alloc(blk_hc, size, spaces, count) \
-    storage_allocator_normal_alloc_ex(blk_hc, size, spaces, count, true)
+    storage_allocator_normal_alloc_ex(blk_hc, size, spaces, count, true, true)
 
+    /* the space shared by the slices (such as the cloned and dedup slices)
+       is counted once, so modify the used space by the trunk returned */
     static inline int storage_allocator_add_slice(OBSliceEntry *slice,
             const bool modify_used_space)
     {
         FSTrunkAllocator *allocator;
+        int64_t inc_bytes;
+        int result;
 
         allocator = g_allocator_mgr->allocator_ptr_array.
             allocators[slice->space.store->index];
-        if (modify_used_space) {
-            __sync_add_and_fetch(&allocator->path_info->
-                    trunk_stat.used, slice->space.size);
+        result = trunk_allocator_add_slice(allocator, slice, &inc_bytes);
+        if (inc_bytes > 0) {
+            if (modify_used_space) {
+                __sync_add_and_fetch(&allocator->path_info->
+                        trunk_stat.used, inc_bytes);
+            }
+            fs_data_group_add_used_space(&slice->ob->bkey, inc_bytes);
         }
-        return trunk_allocator_add_slice(allocator, slice);
+        return result;
     }
 
     static inline int storage_allocator_delete_slice(OBSliceEntry *slice,
             const bool modify_used_space)
     {
         FSTrunkAllocator *allocator;
+        int64_t dec_bytes;
+        int result;
 
         allocator = g_allocator_mgr->allocator_ptr_array.
             allocators[slice->space.store->index];
-        if (modify_used_space) {
-            __sync_sub_and_fetch(&allocator->path_info->
-                    trunk_stat.used, slice->space.size);
+        result = trunk_allocator_delete_slice(allocator, slice, &dec_bytes);
+        if (dec_bytes > 0) {
+            if (modify_used_space) {
+                __sync_sub_and_fetch(&allocator->path_info->
+                        trunk_stat.used, dec_bytes);
+            }
+            fs_data_group_add_used_space(&slice->ob->bkey, -1 * dec_bytes);
         }
-        return trunk_allocator_delete_slice(allocator, slice);
+        return result;
     }
 
     int fs_move_allocator_ptr_array(FSTrunkAllocatorPtrArray **src_array,
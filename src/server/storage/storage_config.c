@@ -25,6 +25,7 @@
 #include "../server_types.h"
 #include "../server_global.h"
 #include "store_path_index.h"
+#include "raw_device.h"
 #include "storage_config.h"
 
 static int load_one_path(FSStorageConfig *storage_cfg,
@@ -83,10 +84,16 @@ static int load_one_path(FSStorageConfig *storage_cfg,
     return 0;
 }
 
-static int storage_config_calc_path_spaces(FSStoragePathInfo *path_info)
+static int get_path_space_stat(FSStoragePathInfo *path_info,
+        int64_t *total, int64_t *avail)
 {
     struct statvfs sbuf;
 
+    if (path_info->device != NULL) {
+        raw_device_get_space_stat(path_info->device, total, avail);
+        return 0;
+    }
+
     if (statvfs(path_info->store.path.str, &sbuf) != 0) {
         logError("file: "__FILE__", line: %d, "
                 "statfs path %s fail, errno: %d, error info: %s.",
@@ -94,8 +101,23 @@ static int storage_config_calc_path_spaces(FSStoragePathInfo *path_info)
         return errno != 0 ? errno : EPERM;
     }
 
-    path_info->space_stat.total = (int64_t)(sbuf.f_blocks) * sbuf.f_frsize;
-    path_info->space_stat.avail = (int64_t)(sbuf.f_bavail) * sbuf.f_frsize;
+    *total = (int64_t)(sbuf.f_blocks) * sbuf.f_frsize;
+    *avail = (int64_t)(sbuf.f_bavail) * sbuf.f_frsize;
+    return 0;
+}
+
+int storage_config_calc_path_spaces(FSStoragePathInfo *path_info)
+{
+    int64_t total;
+    int64_t avail;
+    int result;
+
+    if ((result=get_path_space_stat(path_info, &total, &avail)) != 0) {
+        return result;
+    }
+
+    path_info->space_stat.total = total;
+    path_info->space_stat.avail = avail;
     path_info->reserved_space.value = path_info->space_stat.total *
         path_info->reserved_space.ratio;
     path_info->prealloc_space.value = path_info->space_stat.total *
@@ -103,9 +125,9 @@ static int storage_config_calc_path_spaces(FSStoragePathInfo *path_info)
     path_info->prealloc_space.trunk_count = (path_info->prealloc_space.
             value + STORAGE_CFG.trunk_file_size - 1) /
         STORAGE_CFG.trunk_file_size;
-    if (sbuf.f_blocks > 0) {
-        path_info->space_stat.used_ratio = (double)(sbuf.f_blocks -
-                sbuf.f_bavail) / (double)sbuf.f_blocks;
+    if (total > 0) {
+        path_info->space_stat.used_ratio = (double)(total -
+                avail) / (double)total;
     }
 
     /*
@@ -121,8 +143,10 @@ static int storage_config_calc_path_spaces(FSStoragePathInfo *path_info)
 
 int storage_config_calc_path_avail_space(FSStoragePathInfo *path_info)
 {
-    struct statvfs sbuf;
+    int64_t total;
+    int64_t avail;
     time_t last_stat_time;
+    int result;
 
     last_stat_time = __sync_add_and_fetch(&path_info->
             space_stat.last_stat_time, 0);
@@ -132,17 +156,14 @@ int storage_config_calc_path_avail_space(FSStoragePathInfo *path_info)
     __sync_bool_compare_and_swap(&path_info->space_stat.
             last_stat_time, last_stat_time, g_current_time);
 
-    if (statvfs(path_info->store.path.str, &sbuf) != 0) {
-        logError("file: "__FILE__", line: %d, "
-                "statfs path %s fail, errno: %d, error info: %s.",
-                __LINE__, path_info->store.path.str, errno, STRERROR(errno));
-        return errno != 0 ? errno : EPERM;
+    if ((result=get_path_space_stat(path_info, &total, &avail)) != 0) {
+        return result;
     }
 
-    path_info->space_stat.avail = (int64_t)(sbuf.f_bavail) * sbuf.f_frsize;
-    if (sbuf.f_blocks > 0) {
-        path_info->space_stat.used_ratio = (double)(sbuf.f_blocks -
-                sbuf.f_bavail) / (double)sbuf.f_blocks;
+    path_info->space_stat.avail = avail;
+    if (total > 0) {
+        path_info->space_stat.used_ratio = (double)(total -
+                avail) / (double)total;
     }
 
     return 0;
@@ -188,6 +209,63 @@ void storage_config_stat_path_spaces(FSClusterServerSpaceStat *ss)
     *ss = stat;
 }
 
+static int load_raw_device(IniFullContext *ini_ctx,
+        FSStoragePathInfo *path_info)
+{
+    char *device;
+    char *device_size;
+    int64_t create_size;
+    int result;
+
+    device = iniGetStrValue(ini_ctx->section_name,
+            "device", ini_ctx->context);
+    if (device == NULL || *device == '\0') {
+        path_info->device = NULL;
+        return 0;
+    }
+
+    device_size = iniGetStrValue(ini_ctx->section_name,
+            "device_size", ini_ctx->context);
+    if (device_size == NULL || *device_size == '\0') {
+        create_size = 0;
+    } else if ((result=parse_bytes(device_size, 1, &create_size)) != 0) {
+        return result;
+    }
+
+    if ((path_info->device=raw_device_new(device, create_size)) == NULL) {
+        return ENOMEM;
+    }
+    return 0;
+}
+
+static int load_numa_node(IniFullContext *ini_ctx,
+        FSStoragePathInfo *path_info)
+{
+    char *value;
+    char *endptr;
+
+    value = iniGetStrValue(ini_ctx->section_name,
+            "numa_node", ini_ctx->context);
+    if (value == NULL || *value == '\0' || strcasecmp(value, "auto") == 0) {
+        path_info->numa_node = FS_NUMA_NODE_AUTO;
+        return 0;
+    }
+    if (strcasecmp(value, "none") == 0) {
+        path_info->numa_node = FS_NUMA_NODE_NONE;
+        return 0;
+    }
+
+    path_info->numa_node = strtol(value, &endptr, 10);
+    if (*endptr != '\0' || path_info->numa_node < 0) {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, section: %s, item: numa_node, "
+                "invalid value: %s", __LINE__, ini_ctx->filename,
+                ini_ctx->section_name, value);
+        return EINVAL;
+    }
+    return 0;
+}
+
 static int load_paths(FSStorageConfig *storage_cfg, IniFullContext *ini_ctx,
         const char *section_name_prefix, const char *item_name,
         FSStoragePathArray *parray, const bool required)
@@ -263,6 +341,19 @@ static int load_paths(FSStorageConfig *storage_cfg, IniFullContext *ini_ctx,
             return result;
         }
 
+        if ((result=load_numa_node(ini_ctx, parray->paths + i)) != 0) {
+            return result;
+        }
+
+        if ((result=load_raw_device(ini_ctx, parray->paths + i)) != 0) {
+            return result;
+        }
+
+        //calculate after the raw device opened
+        if (parray->paths[i].device != NULL) {
+            continue;
+        }
+
         if ((result=storage_config_calc_path_spaces(
                         parray->paths + i)) != 0)
         {
@@ -325,6 +416,141 @@ static int load_aio_read_buffer_params(FSStorageConfig *storage_cfg,
 }
 #endif
 
+static int load_slice_scrub_params(FSStorageConfig *storage_cfg,
+        IniFullContext *ini_ctx)
+{
+    int result;
+    char *value;
+
+    ini_ctx->section_name = "slice-scrub";
+    storage_cfg->slice_checksum.scrub.enabled = iniGetBoolValue(
+            ini_ctx->section_name, "enabled", ini_ctx->context, false);
+    if (storage_cfg->slice_checksum.scrub.enabled &&
+            !storage_cfg->slice_checksum.enabled)
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, slice_checksum is false, "
+                "disable the slice scrub", __LINE__, ini_ctx->filename);
+        storage_cfg->slice_checksum.scrub.enabled = false;
+    }
+
+    value = iniGetStrValue(ini_ctx->section_name,
+            "read_bytes_per_second", ini_ctx->context);
+    if (value == NULL || *value == '\0') {
+        storage_cfg->slice_checksum.scrub.read_bytes_per_second =
+            FS_DEFAULT_SCRUB_READ_BYTES_PER_SECOND;
+    } else if ((result=parse_bytes(value, 1, &storage_cfg->slice_checksum.
+                    scrub.read_bytes_per_second)) != 0)
+    {
+        return result;
+    }
+    if (storage_cfg->slice_checksum.scrub.read_bytes_per_second <
+            FS_FILE_BLOCK_SIZE)
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "read_bytes_per_second: %"PRId64" is too small, set to %d",
+                __LINE__, storage_cfg->slice_checksum.scrub.
+                read_bytes_per_second, FS_FILE_BLOCK_SIZE);
+        storage_cfg->slice_checksum.scrub.read_bytes_per_second =
+            FS_FILE_BLOCK_SIZE;
+    }
+
+    storage_cfg->slice_checksum.scrub.round_interval = iniGetIntValue(
+            ini_ctx->section_name, "round_interval",
+            ini_ctx->context, FS_DEFAULT_SCRUB_ROUND_INTERVAL);
+    if (storage_cfg->slice_checksum.scrub.round_interval <= 0) {
+        storage_cfg->slice_checksum.scrub.round_interval =
+            FS_DEFAULT_SCRUB_ROUND_INTERVAL;
+    }
+
+    return 0;
+}
+
+static void load_space_discard_params(FSStorageConfig *storage_cfg,
+        IniFullContext *ini_ctx)
+{
+    ini_ctx->section_name = "space-discard";
+    storage_cfg->space_discard.enabled = iniGetBoolValue(
+            ini_ctx->section_name, "enabled", ini_ctx->context, false);
+#ifndef OS_LINUX
+    if (storage_cfg->space_discard.enabled) {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, space discard is supported "
+                "on Linux only, disable it", __LINE__, ini_ctx->filename);
+        storage_cfg->space_discard.enabled = false;
+    }
+#endif
+
+    storage_cfg->space_discard.delay_seconds = iniGetIntValue(
+            ini_ctx->section_name, "delay_seconds", ini_ctx->context,
+            FS_DEFAULT_SPACE_DISCARD_DELAY_SECONDS);
+    if (storage_cfg->space_discard.delay_seconds < 0) {
+        storage_cfg->space_discard.delay_seconds =
+            FS_DEFAULT_SPACE_DISCARD_DELAY_SECONDS;
+    }
+}
+
+static int load_slice_dedup_params(FSStorageConfig *storage_cfg,
+        IniFullContext *ini_ctx)
+{
+    int result;
+    char *value;
+    int64_t min_slice_size;
+
+    ini_ctx->section_name = "slice-dedup";
+    storage_cfg->slice_dedup.enabled = iniGetBoolValue(
+            ini_ctx->section_name, "enabled", ini_ctx->context, false);
+    if (storage_cfg->slice_dedup.enabled &&
+            storage_cfg->space_discard.enabled)
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, the trunk space may be shared "
+                "when slice dedup enabled, disable the space discard",
+                __LINE__, ini_ctx->filename);
+        storage_cfg->space_discard.enabled = false;
+    }
+
+    value = iniGetStrValue(ini_ctx->section_name,
+            "min_slice_size", ini_ctx->context);
+    if (value == NULL || *value == '\0') {
+        min_slice_size = FS_DEFAULT_DEDUP_MIN_SLICE_SIZE;
+    } else if ((result=parse_bytes(value, 1, &min_slice_size)) != 0) {
+        return result;
+    }
+    if (min_slice_size < 4096) {
+        logWarning("file: "__FILE__", line: %d, "
+                "min_slice_size: %"PRId64" is too small, set to %d",
+                __LINE__, min_slice_size, 4096);
+        min_slice_size = 4096;
+    } else if (min_slice_size > FS_FILE_BLOCK_SIZE) {
+        logWarning("file: "__FILE__", line: %d, "
+                "min_slice_size: %"PRId64" is too large, set to %d",
+                __LINE__, min_slice_size, FS_FILE_BLOCK_SIZE);
+        min_slice_size = FS_FILE_BLOCK_SIZE;
+    }
+    storage_cfg->slice_dedup.min_slice_size = min_slice_size;
+
+    value = iniGetStrValue(ini_ctx->section_name,
+            "index_memory_limit", ini_ctx->context);
+    if (value == NULL || *value == '\0') {
+        storage_cfg->slice_dedup.index_memory_limit =
+            FS_DEFAULT_DEDUP_INDEX_MEMORY_LIMIT;
+    } else if ((result=parse_bytes(value, 1, &storage_cfg->
+                    slice_dedup.index_memory_limit)) != 0)
+    {
+        return result;
+    }
+    if (storage_cfg->slice_dedup.index_memory_limit < 1024 * 1024) {
+        logWarning("file: "__FILE__", line: %d, "
+                "index_memory_limit: %"PRId64" is too small, set to %d",
+                __LINE__, storage_cfg->slice_dedup.index_memory_limit,
+                1024 * 1024);
+        storage_cfg->slice_dedup.index_memory_limit = 1024 * 1024;
+    }
+
+    return 0;
+}
+
 static int load_global_items(FSStorageConfig *storage_cfg,
         IniFullContext *ini_ctx)
 {
@@ -520,9 +746,67 @@ static int load_global_items(FSStorageConfig *storage_cfg,
         return result;
     }
 
+    storage_cfg->slice_checksum.enabled = iniGetBoolValue(NULL,
+            "slice_checksum", ini_ctx->context, false);
+
+    return 0;
+}
+
+static int load_trunk_write_params(FSStorageConfig *storage_cfg,
+        IniFullContext *ini_ctx)
+{
+    char *durability;
+
+    storage_cfg->trunk_write.direct_io = iniGetBoolValue(NULL,
+            "write_direct_io", ini_ctx->context, false);
+#ifndef OS_LINUX
+    if (storage_cfg->trunk_write.direct_io) {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, item \"write_direct_io\" "
+                "is supported on Linux only, set to false",
+                __LINE__, ini_ctx->filename);
+        storage_cfg->trunk_write.direct_io = false;
+    }
+#endif
+
+    durability = iniGetStrValue(NULL, "write_durability", ini_ctx->context);
+    if (durability == NULL || *durability == '\0' || strcasecmp(durability,
+                FS_WRITE_DURABILITY_NONE_STR) == 0)
+    {
+        storage_cfg->trunk_write.durability = FS_WRITE_DURABILITY_NONE_INT;
+    } else if (strcasecmp(durability,
+                FS_WRITE_DURABILITY_FDATASYNC_STR) == 0)
+    {
+        storage_cfg->trunk_write.durability =
+            FS_WRITE_DURABILITY_FDATASYNC_INT;
+    } else if (strcasecmp(durability, FS_WRITE_DURABILITY_DSYNC_STR) == 0) {
+        storage_cfg->trunk_write.durability = FS_WRITE_DURABILITY_DSYNC_INT;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, item \"write_durability\": %s "
+                "is invalid, expect: %s, %s or %s", __LINE__,
+                ini_ctx->filename, durability,
+                FS_WRITE_DURABILITY_NONE_STR,
+                FS_WRITE_DURABILITY_FDATASYNC_STR,
+                FS_WRITE_DURABILITY_DSYNC_STR);
+        return EINVAL;
+    }
+
     return 0;
 }
 
+static const char *get_write_durability_caption(const char durability)
+{
+    switch (durability) {
+        case FS_WRITE_DURABILITY_FDATASYNC_INT:
+            return FS_WRITE_DURABILITY_FDATASYNC_STR;
+        case FS_WRITE_DURABILITY_DSYNC_INT:
+            return FS_WRITE_DURABILITY_DSYNC_STR;
+        default:
+            return FS_WRITE_DURABILITY_NONE_STR;
+    }
+}
+
 static int load_from_config_file(FSStorageConfig *storage_cfg,
         IniFullContext *ini_ctx)
 {
@@ -530,6 +814,10 @@ static int load_from_config_file(FSStorageConfig *storage_cfg,
     if ((result=load_global_items(storage_cfg, ini_ctx)) != 0) {
         return result;
     }
+
+    if ((result=load_trunk_write_params(storage_cfg, ini_ctx)) != 0) {
+        return result;
+    }
   
 #ifdef OS_LINUX
     if ((result=load_aio_read_buffer_params(storage_cfg, ini_ctx)) != 0) {
@@ -537,6 +825,14 @@ static int load_from_config_file(FSStorageConfig *storage_cfg,
     }
 #endif
 
+    if ((result=load_slice_scrub_params(storage_cfg, ini_ctx)) != 0) {
+        return result;
+    }
+    load_space_discard_params(storage_cfg, ini_ctx);
+    if ((result=load_slice_dedup_params(storage_cfg, ini_ctx)) != 0) {
+        return result;
+    }
+
     if ((result=load_paths(storage_cfg, ini_ctx,
                     "store-path", "store_path_count",
                     &storage_cfg->store_path, true)) != 0)
@@ -741,6 +1037,10 @@ static void log_paths(FSStoragePathArray *parray, const char *caption)
                 reserved_space_buff
 #endif
                 );
+        if (p->device != NULL) {
+            logInfo("  path %d: raw device: %s",
+                    (int)(p - parray->paths + 1), p->device->filename);
+        }
     }
 }
 
@@ -765,6 +1065,12 @@ void storage_config_to_log(FSStorageConfig *storage_cfg)
             "end_time: %02d:%02d }, "  */
 #endif
             "reclaim_trunks_on_path_usage: %.2f%%, "
+            "slice_checksum: %s, slice_scrub: {enabled: %s, "
+            "read_bytes_per_second: %"PRId64" KB, round_interval: %d}, "
+            "write_direct_io: %s, write_durability: %s, "
+            "space_discard: {enabled: %s, delay_seconds: %d}, "
+            "slice_dedup: {enabled: %s, min_slice_size: %d KB, "
+            "index_memory_limit: %"PRId64" MB}, "
 #ifdef OS_LINUX
             "never_reclaim_on_trunk_usage: %.2f%%, "
             "memory_watermark_low: %.2f%%, "
@@ -799,6 +1105,17 @@ void storage_config_to_log(FSStorageConfig *storage_cfg)
             storage_cfg->write_cache_to_hd.end_time.minute,
             */
             storage_cfg->reclaim_trunks_on_path_usage * 100.00,
+            storage_cfg->slice_checksum.enabled ? "true" : "false",
+            storage_cfg->slice_checksum.scrub.enabled ? "true" : "false",
+            storage_cfg->slice_checksum.scrub.read_bytes_per_second / 1024,
+            storage_cfg->slice_checksum.scrub.round_interval,
+            storage_cfg->trunk_write.direct_io ? "true" : "false",
+            get_write_durability_caption(storage_cfg->trunk_write.durability),
+            storage_cfg->space_discard.enabled ? "true" : "false",
+            storage_cfg->space_discard.delay_seconds,
+            storage_cfg->slice_dedup.enabled ? "true" : "false",
+            storage_cfg->slice_dedup.min_slice_size / 1024,
+            storage_cfg->slice_dedup.index_memory_limit / (1024 * 1024),
 #ifdef OS_LINUX
             storage_cfg->never_reclaim_on_trunk_usage * 100.00,
             storage_cfg->aio_read_buffer.memory_watermark_low.ratio * 100.00,
@@ -20,6 +20,11 @@
 #include "../../common/fs_types.h"
 #include "../server_types.h"
 
+#define FS_NUMA_NODE_NONE  -1  //no NUMA placement
+#define FS_NUMA_NODE_AUTO  -2  //detect by the device of the store path
+
+struct fs_raw_device;
+
 typedef struct {
     volatile int64_t total;
     volatile int64_t avail;  //current available space
@@ -32,10 +37,12 @@ typedef struct {
     int block_size;
 #endif
     FSStorePath store;
+    struct fs_raw_device *device;  //NULL for the trunk files in the path
     int write_thread_count;
     int read_thread_count;
     int prealloc_trunks;
     int read_io_depth;
+    int numa_node;  //the local NUMA node of the device
     struct {
         int64_t value;
         double ratio;
@@ -96,6 +103,31 @@ typedef struct {
     double reclaim_trunks_on_path_usage;
     double never_reclaim_on_trunk_usage;
 
+    struct {
+        bool direct_io;   //write the trunk files with O_DIRECT
+        char durability;  //FS_WRITE_DURABILITY_xxx_INT
+    } trunk_write;
+
+    struct {
+        bool enabled;  //calculate and verify the CRC32C of the slices
+        struct {
+            bool enabled;
+            int64_t read_bytes_per_second;
+            int round_interval;  //in seconds
+        } scrub;
+    } slice_checksum;
+
+    struct {
+        bool enabled;  //punch hole or discard the space of deleted slices
+        int delay_seconds;
+    } space_discard;
+
+    struct {
+        bool enabled;  //share the trunk space of the slices with same data
+        int min_slice_size;
+        int64_t index_memory_limit;  //the memory limit of fingerprint index
+    } slice_dedup;
+
     struct {
         double ratio_per_path;
         TimeInfo start_time;
@@ -128,6 +160,8 @@ extern "C" {
     int storage_config_load(FSStorageConfig *storage_cfg,
             const char *storage_filename);
 
+    int storage_config_calc_path_spaces(FSStoragePathInfo *path_info);
+
     int storage_config_calc_path_avail_space(FSStoragePathInfo *path_info);
 
     void storage_config_stat_path_spaces(FSClusterServerSpaceStat *ss);
@@ -95,10 +95,28 @@ typedef struct ob_slice_entry {
     volatile int ref_count;
     FSSliceSize ssize;
     FSTrunkSpaceInfo space;
+    struct {
+        bool valid;   //false for unknown, such as a part of the split slice
+        uint32_t crc32c;
+    } checksum;
+    struct {
+        char type;   //FS_COMPRESS_TYPE_xxx
+        int length;  //the compressed data length stored in the trunk
+        int offset;  //the slice offset within the uncompressed data
+    } compress;
     struct fc_list_head dlink;  //used in trunk entry for trunk reclaiming
     struct fast_mblock_man *allocator; //for free
 } OBSliceEntry;
 
+#define FS_SLICE_DATA_LENGTH(slice) \
+    ((slice)->compress.type != FS_COMPRESS_TYPE_NONE ? \
+     (slice)->compress.length : (slice)->ssize.length)
+
+typedef struct fs_slice_fingerprint {
+    int length;
+    unsigned char digest[16];  //MD5 of the slice data
+} FSSliceFingerprint;
+
 typedef struct ob_slice_ptr_array {
     int64_t alloc;
     int64_t count;
@@ -139,6 +157,7 @@ typedef struct fs_slice_op_context {
         uint64_t data_version;  //for replica binlog
         uint64_t sn;            //for slice binlog
         FSBlockSliceKeyInfo bs_key;
+        FSBlockKey src_block;   //the source block for block clone
         struct fs_cluster_data_server_info *myself;
         int body_len;
 #ifdef OS_LINUX
@@ -155,6 +174,27 @@ typedef struct fs_slice_op_context {
 
     struct ob_slice_ptr_array slice_ptr_array;
 
+    struct {
+        bool inflight;  //admitted by the QoS scheduler and not done
+        char priority;  //the QoS priority class
+    } qos;
+
+    int64_t start_time_us;  //for the foreground latency, 0 for others
+    int64_t io_start_time_us;  //for the latency stat of the service read
+
+    struct {
+        BufferInfo input;   //for gather the iovec array
+        BufferInfo output;  //the compressed data
+    } compress;  //for slice write, alloced on demand
+
+    struct {
+        bool lookup_disabled; //such as the slice repairing
+        bool registering;     //register the written slice to dedup index
+        int64_t generation;   //the trunk generation of the written slice
+        FSSliceFingerprint fp;
+        struct fs_trunk_file_info *pinned_trunk;  //for the dedup hit
+    } dedup;  //for slice write
+
 #ifdef OS_LINUX
     iovec_array_t iovec_array;
     AIOBufferPtrArray aio_buffer_parray;
@@ -175,9 +215,12 @@ typedef struct fs_trunk_file_info {
         int count;  //slice count
         volatile int64_t bytes;
         struct fc_list_head slice_head; //OBSliceEntry double link
+        UniqSkiplist *segments; //FSTrunkSpaceSegment order by offset
     } used;
     int64_t size;        //file size
     int64_t free_start;  //free space offset
+    int64_t generation;  //increase when reuse the trunk space from start
+    int dedup_pins;      //the in-progress slice dedups refer to this trunk
 
     struct {
         struct fs_trunk_file_info *next;
@@ -42,6 +42,17 @@ int compare_trunk_by_size_id(const FSTrunkFileInfo *t1,
             last_used_bytes, t2->id_info.id);
 }
 
+static int compare_segment(const FSTrunkSpaceSegment *s1,
+        const FSTrunkSpaceSegment *s2)
+{
+    return fc_compare_int64(s1->offset, s2->offset);
+}
+
+static void segment_free_func(void *ptr, const int delay_seconds)
+{
+    fast_mblock_free_object(&g_trunk_allocator_vars.segment_allocator, ptr);
+}
+
 static void trunk_free_func(void *ptr, const int delay_seconds)
 {
     FSTrunkFileInfo *trunk_info;
@@ -67,6 +78,11 @@ static inline void push_trunk_util_change_event(FSTrunkAllocator *allocator,
 
 int trunk_allocator_init()
 {
+    const int alloc_skiplist_once = 4 * 1024;
+    const int min_alloc_elements_once = 2;
+    const int delay_free_seconds = 0;
+    const bool bidirection = true;  //need previous link
+    const bool allocator_use_lock = true;
     int result;
 
     if ((result=fast_mblock_init_ex1(&G_TRUNK_ALLOCATOR,
@@ -76,6 +92,23 @@ int trunk_allocator_init()
         return result;
     }
 
+    if ((result=fast_mblock_init_ex1(&g_trunk_allocator_vars.
+                    segment_allocator, "trunk_space_segment",
+                    sizeof(FSTrunkSpaceSegment), 16 * 1024,
+                    0, NULL, NULL, true)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=uniq_skiplist_init_ex2(&g_trunk_allocator_vars.
+                    segment_factory, FS_TRUNK_SEGMENT_SKIPLIST_MAX_LEVEL_COUNT,
+                    (skiplist_compare_func)compare_segment, segment_free_func,
+                    alloc_skiplist_once, min_alloc_elements_once,
+                    delay_free_seconds, bidirection, allocator_use_lock)) != 0)
+    {
+        return result;
+    }
+
     return 0;
 }
 
@@ -129,6 +162,7 @@ int trunk_allocator_add(FSTrunkAllocator *allocator,
         FSTrunkFileInfo **pp_trunk)
 {
     FSTrunkFileInfo *trunk_info;
+    UniqSkiplist *segments;
     int result;
 
     trunk_info = (FSTrunkFileInfo *)fast_mblock_alloc_object(
@@ -140,6 +174,16 @@ int trunk_allocator_add(FSTrunkAllocator *allocator,
         return ENOMEM;
     }
 
+    if ((segments=uniq_skiplist_new(&g_trunk_allocator_vars.segment_factory,
+                    FS_TRUNK_SEGMENT_SKIPLIST_INIT_LEVEL_COUNT)) == NULL)
+    {
+        fast_mblock_free_object(&G_TRUNK_ALLOCATOR, trunk_info);
+        if (pp_trunk != NULL) {
+            *pp_trunk = NULL;
+        }
+        return ENOMEM;
+    }
+
     fs_set_trunk_status(trunk_info, FS_TRUNK_STATUS_NONE);
 
     PTHREAD_MUTEX_LOCK(&allocator->freelist.lcp.lock);
@@ -149,10 +193,13 @@ int trunk_allocator_add(FSTrunkAllocator *allocator,
     trunk_info->used.bytes = 0;
     trunk_info->used.count = 0;
     trunk_info->free_start = 0;
+    trunk_info->generation = 0;
     PTHREAD_MUTEX_UNLOCK(&allocator->freelist.lcp.lock);
 
     PTHREAD_MUTEX_LOCK(&allocator->trunks.lock);
+    trunk_info->dedup_pins = 0;
     FC_INIT_LIST_HEAD(&trunk_info->used.slice_head);
+    trunk_info->used.segments = segments;
     result = uniq_skiplist_insert(allocator->
             trunks.by_id.skiplist, trunk_info);
     PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
@@ -162,6 +209,7 @@ int trunk_allocator_add(FSTrunkAllocator *allocator,
                 "add trunk fail, trunk id: %"PRId64", "
                 "errno: %d, error info: %s", __LINE__,
                 id_info->id, result, STRERROR(result));
+        uniq_skiplist_free(segments);
         fast_mblock_free_object(&G_TRUNK_ALLOCATOR, trunk_info);
         trunk_info = NULL;
     }
@@ -174,16 +222,346 @@ int trunk_allocator_add(FSTrunkAllocator *allocator,
 int trunk_allocator_delete(FSTrunkAllocator *allocator, const int64_t id)
 {
     FSTrunkFileInfo target;
+    FSTrunkFileInfo *trunk_info;
     int result;
 
     target.id_info.id = id;
     PTHREAD_MUTEX_LOCK(&allocator->trunks.lock);
+    if ((trunk_info=(FSTrunkFileInfo *)uniq_skiplist_find(allocator->
+                    trunks.by_id.skiplist, &target)) != NULL)
+    {
+        /* the trunk info is delay freed, the pending space
+           discard checks the segments with the trunks lock */
+        uniq_skiplist_free(trunk_info->used.segments);
+        trunk_info->used.segments = NULL;
+    }
     result = uniq_skiplist_delete(allocator->trunks.by_id.skiplist, &target);
     PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
 
     return result;
 }
 
+static inline int64_t get_slice_space_end(const OBSliceEntry *slice)
+{
+    /* the compressed space is shared by the split slices as a whole,
+       the uncompressed split slice refers to its own part only */
+    return slice->space.offset + FS_SLICE_DATA_LENGTH(slice);
+}
+
+static int insert_segment(FSTrunkFileInfo *trunk_info, const int64_t offset,
+        const int64_t length, const int refs)
+{
+    FSTrunkSpaceSegment *segment;
+    int result;
+
+    segment = (FSTrunkSpaceSegment *)fast_mblock_alloc_object(
+            &g_trunk_allocator_vars.segment_allocator);
+    if (segment == NULL) {
+        return ENOMEM;
+    }
+
+    segment->offset = offset;
+    segment->length = length;
+    segment->refs = refs;
+    if ((result=uniq_skiplist_insert(trunk_info->
+                    used.segments, segment)) != 0)
+    {
+        fast_mblock_free_object(&g_trunk_allocator_vars.
+                segment_allocator, segment);
+    }
+    return result;
+}
+
+/* find the first segment which end > offset,
+   return the skiplist tail node when not found */
+static UniqSkiplistNode *find_segment_node(FSTrunkFileInfo *trunk_info,
+        const int64_t offset)
+{
+    FSTrunkSpaceSegment target;
+    FSTrunkSpaceSegment *segment;
+    UniqSkiplistNode *node;
+    UniqSkiplistNode *previous;
+
+    target.offset = offset;
+    node = uniq_skiplist_find_ge_node(trunk_info->used.segments, &target);
+    if (node == NULL) {
+        node = trunk_info->used.segments->factory->tail;
+        previous = UNIQ_SKIPLIST_LEVEL0_TAIL_NODE(trunk_info->used.segments);
+    } else {
+        previous = UNIQ_SKIPLIST_LEVEL0_PREV_NODE(node);
+    }
+
+    if (previous != trunk_info->used.segments->top) {
+        segment = (FSTrunkSpaceSegment *)previous->data;
+        if (segment->offset + segment->length > offset) {
+            return previous;
+        }
+    }
+    return node;
+}
+
+/* make sure the segment boundary at the offset */
+static int split_segment(FSTrunkFileInfo *trunk_info, const int64_t offset)
+{
+    UniqSkiplistNode *node;
+    FSTrunkSpaceSegment *segment;
+    int64_t end;
+
+    node = find_segment_node(trunk_info, offset);
+    if (node == trunk_info->used.segments->factory->tail) {
+        return 0;
+    }
+
+    segment = (FSTrunkSpaceSegment *)node->data;
+    if (segment->offset >= offset) {
+        return 0;
+    }
+
+    end = segment->offset + segment->length;
+    segment->length = offset - segment->offset;
+    return insert_segment(trunk_info, offset, end - offset, segment->refs);
+}
+
+static int add_space_ref(FSTrunkFileInfo *trunk_info, const int64_t start,
+        const int64_t end, int64_t *inc_bytes)
+{
+    UniqSkiplistNode *node;
+    FSTrunkSpaceSegment *segment;
+    int64_t pos;
+    int64_t gap_end;
+    int result;
+
+    *inc_bytes = 0;
+    if ((result=split_segment(trunk_info, start)) != 0 ||
+            (result=split_segment(trunk_info, end)) != 0)
+    {
+        return result;
+    }
+
+    pos = start;
+    node = find_segment_node(trunk_info, start);
+    while (pos < end) {
+        if (node == trunk_info->used.segments->factory->tail) {
+            segment = NULL;
+            gap_end = end;
+        } else {
+            segment = (FSTrunkSpaceSegment *)node->data;
+            gap_end = FC_MIN(segment->offset, end);
+        }
+
+        if (gap_end > pos) {
+            if ((result=insert_segment(trunk_info, pos,
+                            gap_end - pos, 1)) != 0)
+            {
+                return result;
+            }
+            *inc_bytes += gap_end - pos;
+            pos = gap_end;
+        }
+
+        if (segment == NULL || pos >= end) {
+            break;
+        }
+
+        //the segment within [start, end) after split
+        segment->refs++;
+        pos = segment->offset + segment->length;
+        node = UNIQ_SKIPLIST_LEVEL0_NEXT_NODE(node);
+    }
+
+    return 0;
+}
+
+static int remove_space_ref(FSTrunkFileInfo *trunk_info, const int64_t start,
+        const int64_t end, int64_t *dec_bytes)
+{
+    UniqSkiplistNode *node;
+    UniqSkiplistNode *next;
+    FSTrunkSpaceSegment *segment;
+    int result;
+
+    *dec_bytes = 0;
+    if ((result=split_segment(trunk_info, start)) != 0 ||
+            (result=split_segment(trunk_info, end)) != 0)
+    {
+        return result;
+    }
+
+    node = find_segment_node(trunk_info, start);
+    while (node != trunk_info->used.segments->factory->tail) {
+        segment = (FSTrunkSpaceSegment *)node->data;
+        if (segment->offset >= end) {
+            break;
+        }
+
+        next = UNIQ_SKIPLIST_LEVEL0_NEXT_NODE(node);
+        if (--segment->refs == 0) {
+            *dec_bytes += segment->length;
+            uniq_skiplist_delete(trunk_info->used.segments, segment);
+        }
+        node = next;
+    }
+
+    return 0;
+}
+
+static bool is_space_referred(FSTrunkFileInfo *trunk_info,
+        const int64_t start, const int64_t end)
+{
+    UniqSkiplistNode *node;
+    FSTrunkSpaceSegment *segment;
+    int64_t pos;
+
+    pos = start;
+    node = find_segment_node(trunk_info, start);
+    while (pos < end) {
+        if (node == trunk_info->used.segments->factory->tail) {
+            return false;
+        }
+
+        segment = (FSTrunkSpaceSegment *)node->data;
+        if (segment->offset > pos) {
+            return false;
+        }
+        pos = segment->offset + segment->length;
+        node = UNIQ_SKIPLIST_LEVEL0_NEXT_NODE(node);
+    }
+
+    return true;
+}
+
+FSTrunkFileInfo *trunk_allocator_get_trunk(FSTrunkAllocator *allocator,
+        const int64_t id, int64_t *generation)
+{
+    FSTrunkFileInfo target;
+    FSTrunkFileInfo *trunk_info;
+
+    target.id_info.id = id;
+    PTHREAD_MUTEX_LOCK(&allocator->trunks.lock);
+    if ((trunk_info=(FSTrunkFileInfo *)uniq_skiplist_find(allocator->
+                    trunks.by_id.skiplist, &target)) != NULL)
+    {
+        *generation = trunk_info->generation;
+    }
+    PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
+
+    return trunk_info;
+}
+
+FSTrunkFileInfo *trunk_allocator_pin_trunk(FSTrunkAllocator *allocator,
+        const int64_t id, const int64_t generation,
+        const int64_t offset, const int64_t length)
+{
+    FSTrunkFileInfo target;
+    FSTrunkFileInfo *trunk_info;
+
+    target.id_info.id = id;
+    PTHREAD_MUTEX_LOCK(&allocator->trunks.lock);
+    if ((trunk_info=(FSTrunkFileInfo *)uniq_skiplist_find(allocator->
+                    trunks.by_id.skiplist, &target)) != NULL)
+    {
+        /* the status must be checked with the trunks lock
+           for the trunk reclaiming */
+        if (trunk_info->generation == generation &&
+                __sync_add_and_fetch(&trunk_info->status, 0) !=
+                FS_TRUNK_STATUS_RECLAIMING && is_space_referred(
+                    trunk_info, offset, offset + length))
+        {
+            trunk_info->dedup_pins++;
+        } else {
+            trunk_info = NULL;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
+
+    return trunk_info;
+}
+
+void trunk_allocator_unpin_trunk(FSTrunkAllocator *allocator,
+        FSTrunkFileInfo *trunk_info)
+{
+    PTHREAD_MUTEX_LOCK(&allocator->trunks.lock);
+    trunk_info->dedup_pins--;
+    PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
+}
+
+bool trunk_allocator_is_pinned(FSTrunkAllocator *allocator,
+        FSTrunkFileInfo *trunk_info)
+{
+    bool pinned;
+
+    PTHREAD_MUTEX_LOCK(&allocator->trunks.lock);
+    pinned = (trunk_info->dedup_pins > 0);
+    PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
+
+    return pinned;
+}
+
+int64_t trunk_allocator_discard_space(FSTrunkAllocator *allocator,
+        FSTrunkFileInfo *trunk_info, const int64_t generation,
+        const int64_t offset, const int64_t length,
+        fs_trunk_discard_space_func discard_func)
+{
+    UniqSkiplistNode *node;
+    FSTrunkSpaceSegment *segment;
+    int64_t end;
+    int64_t pos;
+    int64_t gap_end;
+    int64_t start_block;
+    int64_t end_block;
+    int64_t discard_bytes;
+
+    discard_bytes = 0;
+    end = offset + length;
+    PTHREAD_MUTEX_LOCK(&allocator->trunks.lock);
+    /* the trunk space maybe reused after the slices deleted, hold
+     * the freelist lock to prevent the trunk reuse during discard */
+    PTHREAD_MUTEX_LOCK(&allocator->freelist.lcp.lock);
+    do {
+        /* the deleted space of the pinned trunk maybe referred by
+           the in-progress dedup or clone slice again */
+        if (trunk_info->used.segments == NULL || trunk_info->generation !=
+                generation || trunk_info->dedup_pins > 0)
+        {
+            break;
+        }
+
+        pos = offset;
+        node = find_segment_node(trunk_info, offset);
+        while (pos < end) {
+            if (node == trunk_info->used.segments->factory->tail) {
+                segment = NULL;
+                gap_end = end;
+            } else {
+                segment = (FSTrunkSpaceSegment *)node->data;
+                gap_end = FC_MIN(segment->offset, end);
+            }
+
+            /* only release the whole blocks to avoid zeroing
+             * the partial blocks which shared with the alive slices */
+            start_block = MEM_ALIGN_CEIL(pos,
+                    allocator->path_info->block_size);
+            end_block = MEM_ALIGN_FLOOR(gap_end,
+                    allocator->path_info->block_size);
+            if (end_block > start_block && discard_func(trunk_info,
+                        start_block, end_block - start_block) == 0)
+            {
+                discard_bytes += end_block - start_block;
+            }
+
+            if (segment == NULL) {
+                break;
+            }
+            pos = FC_MAX(pos, segment->offset + segment->length);
+            node = UNIQ_SKIPLIST_LEVEL0_NEXT_NODE(node);
+        }
+    } while (0);
+    PTHREAD_MUTEX_UNLOCK(&allocator->freelist.lcp.lock);
+    PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
+
+    return discard_bytes;
+}
+
 FSTrunkFreelistType trunk_allocator_add_to_freelist(
         FSTrunkAllocator *allocator, FSTrunkFileInfo *trunk_info)
 {
@@ -204,7 +582,8 @@ FSTrunkFreelistType trunk_allocator_add_to_freelist(
         fs_freelist_type_reclaim;
 }
 
-int trunk_allocator_add_slice(FSTrunkAllocator *allocator, OBSliceEntry *slice)
+int trunk_allocator_add_slice(FSTrunkAllocator *allocator,
+        OBSliceEntry *slice, int64_t *inc_bytes)
 {
     int result;
     FSTrunkFileInfo target;
@@ -219,12 +598,14 @@ int trunk_allocator_add_slice(FSTrunkAllocator *allocator, OBSliceEntry *slice)
                 "store path index: %d, trunk id: %"PRId64" not exist",
                 __LINE__, allocator->path_info->store.index,
                 slice->space.id_info.id);
+        *inc_bytes = 0;
         result = ENOENT;
-    } else {
-        trunk_info->used.bytes += slice->space.size;
+    } else if ((result=add_space_ref(trunk_info, slice->space.offset,
+                    get_slice_space_end(slice), inc_bytes)) == 0)
+    {
+        trunk_info->used.bytes += *inc_bytes;
         trunk_info->used.count++;
         fc_list_add_tail(&slice->dlink, &trunk_info->used.slice_head);
-        result = 0;
     }
     PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
 
@@ -240,6 +621,7 @@ int trunk_allocator_batch_add_slices(OBSliceEntry **slices,
     OBSliceEntry **end;
     FSTrunkFileInfo target;
     FSTrunkFileInfo *trunk_info;
+    int64_t inc_bytes;
 
     if (count <= 0) {
         return 0;
@@ -258,6 +640,7 @@ int trunk_allocator_batch_add_slices(OBSliceEntry **slices,
                 slices[0]->space.id_info.id);
         result = ENOENT;
     } else {
+        result = 0;
         end = slices + count;
         for (slice=slices; slice<end; slice++) {
             /* for loading slice binlog */
@@ -268,12 +651,18 @@ int trunk_allocator_batch_add_slices(OBSliceEntry **slices,
                     (*slice)->space.size;
             }
 
-            trunk_info->used.bytes += (*slice)->space.size;
+            if ((result=add_space_ref(trunk_info, (*slice)->space.offset,
+                            get_slice_space_end(*slice), &inc_bytes)) != 0)
+            {
+                break;
+            }
+            trunk_info->used.bytes += inc_bytes;
             trunk_info->used.count++;
             fc_list_add_tail(&(*slice)->dlink, &trunk_info->used.slice_head);
+            if (inc_bytes > 0) {
+                fs_data_group_add_used_space(&(*slice)->ob->bkey, inc_bytes);
+            }
         }
-
-        result = 0;
     }
     PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
 
@@ -281,7 +670,7 @@ int trunk_allocator_batch_add_slices(OBSliceEntry **slices,
 }
 
 int trunk_allocator_delete_slice(FSTrunkAllocator *allocator,
-        OBSliceEntry *slice)
+        OBSliceEntry *slice, int64_t *dec_bytes)
 {
     int result;
     FSTrunkFileInfo target;
@@ -296,15 +685,17 @@ int trunk_allocator_delete_slice(FSTrunkAllocator *allocator,
                 "store path index: %d, trunk id: %"PRId64" not exist",
                 __LINE__, allocator->path_info->store.index,
                 slice->space.id_info.id);
+        *dec_bytes = 0;
         result = ENOENT;
     } else {
-        __sync_fetch_and_sub(&trunk_info->used.bytes, slice->space.size);
+        result = remove_space_ref(trunk_info, slice->space.offset,
+                get_slice_space_end(slice), dec_bytes);
+        __sync_fetch_and_sub(&trunk_info->used.bytes, *dec_bytes);
         trunk_info->used.count--;
         fc_list_del_init(&slice->dlink);
 
         push_trunk_util_change_event(allocator, trunk_info,
                 FS_TRUNK_UTIL_EVENT_UPDATE);
-        result = 0;
     }
     PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
 
@@ -329,6 +720,7 @@ static bool can_add_to_freelist(FSTrunkFileInfo *trunk_info)
         return true;
     } else if (trunk_info->used.bytes == 0) {
         trunk_info->free_start = 0;
+        trunk_info->generation++;
         return true;
     }
 
@@ -39,6 +39,9 @@
 
 #define FS_TRUNK_AVAIL_SPACE(trunk) ((trunk)->size - (trunk)->free_start)
 
+#define FS_TRUNK_SEGMENT_SKIPLIST_INIT_LEVEL_COUNT   2
+#define FS_TRUNK_SEGMENT_SKIPLIST_MAX_LEVEL_COUNT   12
+
 typedef enum {
     fs_freelist_type_none,
     fs_freelist_type_normal,
@@ -51,6 +54,17 @@ typedef struct {
     FSTrunkFileInfo **trunks;
 } FSTrunkInfoPtrArray;
 
+/* the live space range of the trunk, the overlapped space
+   (shared by the cloned, dedup or split slices) counted once */
+typedef struct fs_trunk_space_segment {
+    int64_t offset;
+    int64_t length;
+    int refs;   //the slice count which refer to this range
+} FSTrunkSpaceSegment;
+
+typedef int (*fs_trunk_discard_space_func)(FSTrunkFileInfo *trunk,
+        const int64_t offset, const int64_t length);
+
 typedef struct fs_trunk_allocator {
     FSStoragePathInfo *path_info;
     struct {
@@ -77,6 +91,8 @@ typedef struct fs_trunk_allocator {
 
 typedef struct {
     struct fast_mblock_man trunk_allocator;
+    struct fast_mblock_man segment_allocator; //element: FSTrunkSpaceSegment
+    UniqSkiplistFactory segment_factory;
 } TrunkAllocatorGlobalVars;
 
 #ifdef __cplusplus
@@ -101,18 +117,46 @@ extern "C" {
 
     int trunk_allocator_delete(FSTrunkAllocator *allocator, const int64_t id);
 
+    FSTrunkFileInfo *trunk_allocator_get_trunk(FSTrunkAllocator *allocator,
+            const int64_t id, int64_t *generation);
+
+    /* pin the trunk to avoid reclaiming or space discard before the dedup
+       (or cloned) slice being added to the trunk, return NULL when the
+       generation changed, the trunk is reclaiming or the space range
+       [offset, offset + length) is not referred by the alive slices */
+    FSTrunkFileInfo *trunk_allocator_pin_trunk(FSTrunkAllocator *allocator,
+            const int64_t id, const int64_t generation,
+            const int64_t offset, const int64_t length);
+
+    void trunk_allocator_unpin_trunk(FSTrunkAllocator *allocator,
+            FSTrunkFileInfo *trunk_info);
+
+    bool trunk_allocator_is_pinned(FSTrunkAllocator *allocator,
+            FSTrunkFileInfo *trunk_info);
+
+    /* discard the whole blocks within [offset, offset + length) which not
+       referred by the alive slices, the check and the discard are done
+       with the trunks lock, skip when the trunk generation changed or
+       the trunk is pinned, return the discarded bytes */
+    int64_t trunk_allocator_discard_space(FSTrunkAllocator *allocator,
+            FSTrunkFileInfo *trunk_info, const int64_t generation,
+            const int64_t offset, const int64_t length,
+            fs_trunk_discard_space_func discard_func);
+
     int trunk_allocator_free(FSTrunkAllocator *allocator,
             const int id, const int size);
 
+    /* inc_bytes: the increased used bytes of the trunk */
     int trunk_allocator_add_slice(FSTrunkAllocator *allocator,
-            OBSliceEntry *slice);
+            OBSliceEntry *slice, int64_t *inc_bytes);
 
     //the store path index and trunk id must be same
     int trunk_allocator_batch_add_slices(OBSliceEntry **slices,
             const int64_t count);
 
+    /* dec_bytes: the decreased used bytes of the trunk */
     int trunk_allocator_delete_slice(FSTrunkAllocator *allocator,
-            OBSliceEntry *slice);
+            OBSliceEntry *slice, int64_t *dec_bytes);
 
     FSTrunkFreelistType trunk_allocator_add_to_freelist(
             FSTrunkAllocator *allocator, FSTrunkFileInfo *trunk_info);
@@ -177,9 +177,10 @@ static int waiting_avail_trunk(struct fs_trunk_allocator *allocator,
     return result;
 }
 
-int trunk_freelist_alloc_space(struct fs_trunk_allocator *allocator,
+int trunk_freelist_alloc_space_ex(struct fs_trunk_allocator *allocator,
         FSTrunkFreelist *freelist, const uint32_t blk_hc, const int size,
-        FSTrunkSpaceWithVersion *spaces, int *count, const bool is_normal)
+        FSTrunkSpaceWithVersion *spaces, int *count,
+        const bool is_normal, const bool allow_split)
 {
     int aligned_size;
     int result;
@@ -187,7 +188,17 @@ int trunk_freelist_alloc_space(struct fs_trunk_allocator *allocator,
     FSTrunkSpaceWithVersion *space_info;
     FSTrunkFileInfo *trunk_info;
 
+#ifdef OS_LINUX
+    if (STORAGE_CFG.trunk_write.direct_io) {
+        //the file offset and length of O_DIRECT write must be aligned
+        aligned_size = MEM_ALIGN_CEIL(size, allocator->
+                path_info->block_size);
+    } else {
+        aligned_size = MEM_ALIGN_CEIL(size, FS_SPACE_ALIGN_SIZE);
+    }
+#else
     aligned_size = MEM_ALIGN_CEIL(size, FS_SPACE_ALIGN_SIZE);
+#endif
     space_info = spaces;
 
     PTHREAD_MUTEX_LOCK(&freelist->lcp.lock);
@@ -200,21 +211,25 @@ int trunk_freelist_alloc_space(struct fs_trunk_allocator *allocator,
                     result = EAGAIN;
                     break;
                 }
-                
-                if (remain_bytes <= 0) {
+
+                if (!allow_split) {
+                    trunk_freelist_remove(freelist);
+                    __sync_sub_and_fetch(&trunk_info->allocator->path_info->
+                            trunk_stat.avail, remain_bytes);
+                } else if (remain_bytes <= 0) {
                     logInfo("allocator: %p, trunk_info: %p, "
                             "trunk size: %"PRId64", free start: %"PRId64
                             ", remain_bytes: %d", trunk_info->allocator,
                             trunk_info, trunk_info->size,
                             trunk_info->free_start, remain_bytes);
                     abort();
-                }
-
-                TRUNK_ALLOC_SPACE(trunk_info, space_info, remain_bytes);
-                space_info++;
+                } else {
+                    TRUNK_ALLOC_SPACE(trunk_info, space_info, remain_bytes);
+                    space_info++;
 
-                aligned_size -= remain_bytes;
-                trunk_freelist_remove(freelist);
+                    aligned_size -= remain_bytes;
+                    trunk_freelist_remove(freelist);
+                }
             }
         }
 
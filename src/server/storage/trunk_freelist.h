@@ -40,9 +40,18 @@ extern "C" {
     void trunk_freelist_add(FSTrunkFreelist *freelist,
             FSTrunkFileInfo *trunk_info);
 
-    int trunk_freelist_alloc_space(struct fs_trunk_allocator *allocator,
+#define trunk_freelist_alloc_space(allocator, freelist, blk_hc, \
+        size, spaces, count, is_normal) \
+    trunk_freelist_alloc_space_ex(allocator, freelist, blk_hc, \
+            size, spaces, count, is_normal, true)
+
+    /* allow_split: if the space can be split into two trunks, the tail
+     * space of the trunk which less than the size is left for the trunk
+     * reclaiming when the split not allowed */
+    int trunk_freelist_alloc_space_ex(struct fs_trunk_allocator *allocator,
             FSTrunkFreelist *freelist, const uint32_t blk_hc, const int size,
-            FSTrunkSpaceWithVersion *spaces, int *count, const bool is_normal);
+            FSTrunkSpaceWithVersion *spaces, int *count,
+            const bool is_normal, const bool allow_split);
 
 #ifdef __cplusplus
 }
@@ -22,6 +22,7 @@
 #include "fastcommon/uniq_skiplist.h"
 #include "sf/sf_global.h"
 #include "../server_global.h"
+#include "raw_device.h"
 #include "trunk_id_info.h"
 
 #define TRUNK_ID_DATA_FILENAME  ".trunk_id.dat"
@@ -362,6 +363,19 @@ int trunk_id_info_generate(const int path_index, FSTrunkIdInfo *id_info)
 {
     SortedSubdirs *sorted_subdirs;
     StoreSubdirInfo *sd_info;
+    FSRawDevice *device;
+    int64_t index;
+    int result;
+
+    if ((device=FS_RAW_DEVICE_BY_PATH_INDEX(path_index)) != NULL) {
+        if ((result=raw_device_alloc_extent(device, &index)) != 0) {
+            return result;
+        }
+        id_info->subdir = FS_RAW_DEVICE_EXTENT_SUBDIR(index);
+        id_info->id = __sync_add_and_fetch(
+                &id_info_context.current_trunk_id, 1);
+        return 0;
+    }
 
     sorted_subdirs = id_info_context.subdir_array.subdirs + path_index;
     if (sorted_subdirs->all.skiplist == NULL) {
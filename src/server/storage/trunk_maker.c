@@ -21,6 +21,7 @@
 #include "fastcommon/fast_mblock.h"
 #include "fastcommon/fc_queue.h"
 #include "fastcommon/common_blocked_queue.h"
+#include "fastcommon/fc_atomic.h"
 #include "sf/sf_global.h"
 #include "sf/sf_func.h"
 #include "../server_global.h"
@@ -62,6 +63,13 @@ typedef struct trunk_maker_thread_array {
 typedef struct trunk_maker_context {
     volatile int running_count;
     TrunkMakerThreadArray thread_array;
+
+    struct {
+        volatile int reclaiming_count;
+        volatile int64_t success_count;
+        volatile int64_t fail_count;
+        volatile int64_t migrated_bytes;
+    } reclaim_stat;
 } TrunkMakerContext;
 
 static TrunkMakerContext tmaker_ctx;
@@ -277,12 +285,21 @@ static int do_reclaim_trunk(TrunkMakerThreadInfo *thread,
         return ENOENT;
     }
 
+    /* the status MUST be set before the pin check
+       for the in-progress slice dedups */
+    fs_set_trunk_status(trunk, FS_TRUNK_STATUS_RECLAIMING);
+    if (trunk_allocator_is_pinned(task->allocator, trunk)) {
+        fs_set_trunk_status(trunk, FS_TRUNK_STATUS_NONE); //rollback status
+        return EBUSY;
+    }
+
     if (used_bytes > 0) {
         int64_t start_time_us;
         start_time_us = get_current_time_us();
-        fs_set_trunk_status(trunk, FS_TRUNK_STATUS_RECLAIMING);
+        FC_ATOMIC_INC(tmaker_ctx.reclaim_stat.reclaiming_count);
         result = trunk_reclaim(task->allocator, trunk,
                 &thread->reclaim_ctx);
+        FC_ATOMIC_DEC(tmaker_ctx.reclaim_stat.reclaiming_count);
         time_used = (get_current_time_us() - start_time_us) / 1000;
     } else {
         time_used = 0;
@@ -300,13 +317,18 @@ static int do_reclaim_trunk(TrunkMakerThreadInfo *thread,
             (double)trunk->size, result, time_prompt);
 
     if (result == 0) {
+        FC_ATOMIC_INC(tmaker_ctx.reclaim_stat.success_count);
+        FC_ATOMIC_INC_EX(tmaker_ctx.reclaim_stat.migrated_bytes, used_bytes);
+
         PTHREAD_MUTEX_LOCK(&task->allocator->freelist.lcp.lock);
         trunk->free_start = 0;
+        trunk->generation++;  //for the pending space discard
         PTHREAD_MUTEX_UNLOCK(&task->allocator->freelist.lcp.lock);
 
         uniq_skiplist_delete(task->allocator->trunks.by_size.skiplist, trunk);
         *freelist_type = trunk_allocator_add_to_freelist(task->allocator, trunk);
     } else {
+        FC_ATOMIC_INC(tmaker_ctx.reclaim_stat.fail_count);
         fs_set_trunk_status(trunk, FS_TRUNK_STATUS_NONE); //rollback status
     }
 
@@ -496,3 +518,13 @@ int trunk_maker_allocate_ex(FSTrunkAllocator *allocator, const bool urgent,
     fc_queue_push(&thread->queue, task);
     return 0;
 }
+
+void trunk_maker_reclaim_stat(FSTrunkReclaimStat *stat)
+{
+    stat->reclaiming_count = FC_ATOMIC_GET(
+            tmaker_ctx.reclaim_stat.reclaiming_count);
+    stat->success_count = FC_ATOMIC_GET(tmaker_ctx.reclaim_stat.success_count);
+    stat->fail_count = FC_ATOMIC_GET(tmaker_ctx.reclaim_stat.fail_count);
+    stat->migrated_bytes = FC_ATOMIC_GET(
+            tmaker_ctx.reclaim_stat.migrated_bytes);
+}
@@ -26,6 +26,13 @@
 typedef void (*trunk_allocate_done_callback)(FSTrunkAllocator *allocator,
         const int result, const bool is_new_trunk, void *arg);
 
+typedef struct {
+    int reclaiming_count;   //the trunks in reclaiming
+    int64_t success_count;  //the reclaimed trunks
+    int64_t fail_count;
+    int64_t migrated_bytes; //the used bytes of the reclaimed trunks
+} FSTrunkReclaimStat;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,6 +46,8 @@ extern "C" {
 #define trunk_maker_allocate(allocator) \
     trunk_maker_allocate_ex(allocator, false, true, NULL, NULL)
 
+    void trunk_maker_reclaim_stat(FSTrunkReclaimStat *stat);
+
 #ifdef __cplusplus
 }
 #endif
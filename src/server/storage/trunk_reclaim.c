@@ -21,11 +21,13 @@
 #include "fastcommon/logger.h"
 #include "fastcommon/fast_mblock.h"
 #include "fastcommon/fc_queue.h"
+#include "fastcommon/fc_atomic.h"
 #include "fastcommon/common_blocked_queue.h"
 #include "sf/sf_global.h"
 #include "sf/sf_func.h"
 #include "../common/fs_func.h"
 #include "../server_global.h"
+#include "../background_throttle.h"
 #include "../binlog/binlog_types.h"
 #include "storage_allocator.h"
 #include "slice_op.h"
@@ -391,6 +393,11 @@ int trunk_reclaim(FSTrunkAllocator *allocator, FSTrunkFileInfo *trunk,
 {
     int result;
 
+    /* throttle before the blocks locked for reclaiming,
+     * because the locked blocks block the foreground operations */
+    background_throttle_acquire(BACKGROUND_THROTTLE_TYPE_RECLAIM,
+            FC_ATOMIC_GET(trunk->used.bytes));
+
     if ((result=convert_to_rs_array(allocator, trunk, &rctx->sarray)) != 0) {
         return result;
     }
@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+/* purge the replica binlog files of a data group, then check the snapshot
+ * of the live slices replaced the last purged file and the new slave
+ * (data version 0) starts the full recovery from the snapshot, the modules
+ * are linked with the stubbed global config as fs_server_bench */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "sf/sf_global.h"
+#include "common/fs_func.h"
+#include "../server_global.h"
+#include "../storage/object_block_index.h"
+#include "../binlog/binlog_types.h"
+#include "../binlog/binlog_func.h"
+#include "../binlog/binlog_reader.h"
+#include "../binlog/replica_binlog.h"
+#include "../binlog/binlog_retention.h"
+
+#define TEST_DATA_PATH         "/tmp/fs_test_replica_binlog_purge"
+#define TEST_DATA_GROUP_ID     1
+#define TEST_BINLOG_FILES      3
+#define TEST_RECORDS_PER_FILE  2
+#define TEST_SLICE_COUNT       2
+#define TEST_SLICE_LENGTH      (16 * 1024)
+
+static FSStoragePathInfo test_path_info;
+static FSStoragePathInfo *test_paths_by_index[1];
+
+static void setup_stub_globals()
+{
+    /* one store path without the trunk files */
+    test_path_info.store.index = 0;
+    FC_SET_STRING(test_path_info.store.path, TEST_DATA_PATH);
+    test_paths_by_index[0] = &test_path_info;
+    STORAGE_CFG.paths_by_index.paths = test_paths_by_index;
+    STORAGE_CFG.paths_by_index.count = 1;
+    STORAGE_CFG.max_store_path_index = 0;
+
+    STORAGE_CFG.space_discard.enabled = false;
+    STORAGE_CFG.object_block.shared_lock_count = 17;
+    STORAGE_CFG.object_block.shared_allocator_count = 7;
+    STORAGE_CFG.object_block.hashtable_capacity = 1361;
+
+    /* all blocks belong to the only data group */
+    FC_SET_STRING(DATA_PATH, TEST_DATA_PATH);
+    CLUSTER_CONFIG_CTX.data_groups.count = 1;
+
+    g_current_time = time(NULL);
+}
+
+static int make_binlog_path(char *subdir_name)
+{
+    char path[PATH_MAX];
+
+    replica_binlog_get_subdir_name(subdir_name, TEST_DATA_GROUP_ID);
+    snprintf(path, sizeof(path), "rm -rf %s", TEST_DATA_PATH);
+    if (system(path) != 0) {
+        return EACCES;
+    }
+
+    if (mkdir(TEST_DATA_PATH, 0775) != 0) {
+        return errno != 0 ? errno : EPERM;
+    }
+    snprintf(path, sizeof(path), "%s/%s", TEST_DATA_PATH,
+            FS_REPLICA_BINLOG_SUBDIR_NAME);
+    if (mkdir(path, 0775) != 0) {
+        return errno != 0 ? errno : EPERM;
+    }
+    snprintf(path, sizeof(path), "%s/%s", TEST_DATA_PATH, subdir_name);
+    if (mkdir(path, 0775) != 0) {
+        return errno != 0 ? errno : EPERM;
+    }
+
+    return 0;
+}
+
+/* the history of the writes to the block, a data version per record */
+static int write_binlog_files(const char *subdir_name, const FSBlockKey *bkey)
+{
+    char filename[PATH_MAX];
+    char buff[1024];
+    int64_t data_version;
+    int binlog_index;
+    int len;
+    int i;
+    int result;
+
+    data_version = 0;
+    for (binlog_index=0; binlog_index<TEST_BINLOG_FILES; binlog_index++) {
+        len = 0;
+        for (i=0; i<TEST_RECORDS_PER_FILE; i++) {
+            ++data_version;
+            len += sprintf(buff + len, "%"PRId64" %"PRId64" %c %c "
+                    "%"PRId64" %"PRId64" %d %d\n", (int64_t)g_current_time -
+                    86400 + data_version, data_version,
+                    BINLOG_SOURCE_RPC_MASTER, BINLOG_OP_TYPE_WRITE_SLICE,
+                    bkey->oid, bkey->offset, 0, TEST_SLICE_LENGTH);
+        }
+
+        binlog_reader_get_filename(subdir_name, binlog_index,
+                filename, sizeof(filename));
+        if ((result=safeWriteToFile(filename, buff, len)) != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int add_slices(const FSBlockKey *bkey)
+{
+    OBSliceEntry *slice;
+    int inc_alloc;
+    int result;
+    int i;
+
+    for (i=0; i<TEST_SLICE_COUNT; i++) {
+        if ((slice=ob_index_alloc_slice(bkey)) == NULL) {
+            return ENOMEM;
+        }
+
+        slice->type = OB_SLICE_TYPE_FILE;
+        slice->ssize.offset = i * TEST_SLICE_LENGTH;
+        slice->ssize.length = TEST_SLICE_LENGTH;
+        slice->space.store = &test_path_info.store;
+        slice->space.id_info.id = 1;
+        slice->space.id_info.subdir = 1;
+        slice->space.offset = i * TEST_SLICE_LENGTH;
+        slice->space.size = TEST_SLICE_LENGTH;
+        slice->checksum.valid = false;
+        slice->compress.type = FS_COMPRESS_TYPE_NONE;
+
+        result = ob_index_add_slice(slice, NULL, &inc_alloc, false);
+        ob_index_free_slice(slice);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int check_snapshot(const char *subdir_name, const int binlog_index,
+        const uint64_t data_version, const FSBlockKey *bkey)
+{
+    char filename[PATH_MAX];
+    char *content;
+    int64_t file_size;
+    string_t buffer;
+    ReplicaBinlogRecord records[TEST_SLICE_COUNT + 1];
+    int count;
+    int result;
+    int i;
+
+    binlog_reader_get_filename(subdir_name, binlog_index,
+            filename, sizeof(filename));
+    if ((result=getFileContent(filename, &content, &file_size)) != 0) {
+        return result;
+    }
+
+    buffer.str = content;
+    buffer.len = file_size;
+    result = replica_binlog_unpack_records(&buffer, records,
+            TEST_SLICE_COUNT + 1, &count);
+    free(content);
+    if (result != 0) {
+        return result;
+    }
+
+    if (count != TEST_SLICE_COUNT) {
+        fprintf(stderr, "snapshot record count: %d != expect: %d\n",
+                count, TEST_SLICE_COUNT);
+        return EINVAL;
+    }
+
+    for (i=0; i<count; i++) {
+        if (!(records[i].op_type == REPLICA_BINLOG_OP_TYPE_WRITE_SLICE &&
+                    records[i].data_version == data_version &&
+                    records[i].bs_key.block.oid == bkey->oid &&
+                    records[i].bs_key.block.offset == bkey->offset &&
+                    records[i].bs_key.slice.offset == i * TEST_SLICE_LENGTH &&
+                    records[i].bs_key.slice.length == TEST_SLICE_LENGTH))
+        {
+            fprintf(stderr, "snapshot record #%d mismatch, op type: %c, "
+                    "data version: %"PRId64", slice offset: %d, "
+                    "length: %d\n", i, records[i].op_type,
+                    records[i].data_version, records[i].bs_key.slice.offset,
+                    records[i].bs_key.slice.length);
+            return EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+static int check_purged(const char *subdir_name)
+{
+    char filename[PATH_MAX];
+    SFBinlogFilePosition pos;
+    int start_index;
+    int result;
+
+    start_index = binlog_get_start_index(subdir_name);
+    if (start_index != TEST_BINLOG_FILES - 2) {
+        fprintf(stderr, "start index: %d != expect: %d\n",
+                start_index, TEST_BINLOG_FILES - 2);
+        return EINVAL;
+    }
+
+    binlog_reader_get_filename(subdir_name, start_index - 1,
+            filename, sizeof(filename));
+    if (access(filename, F_OK) == 0) {
+        fprintf(stderr, "the purged binlog %s exists\n", filename);
+        return EINVAL;
+    }
+
+    /* the new slave starts from the snapshot without the writer */
+    if ((result=replica_binlog_get_position_by_dv(subdir_name,
+                    NULL, 0, &pos, false)) != 0)
+    {
+        return result;
+    }
+    if (!(pos.index == start_index && pos.offset == 0)) {
+        fprintf(stderr, "the position {index: %d, offset: %"PRId64"} "
+                "of the full recovery != expect {index: %d, offset: 0}\n",
+                pos.index, pos.offset, start_index);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    FSBlockKey bkey;
+    int result;
+
+    log_init();
+    setup_stub_globals();
+    if ((result=ob_index_init()) != 0) {
+        return result;
+    }
+
+    bkey.oid = 1;
+    bkey.offset = 0;
+    fs_calc_block_hashcode(&bkey);
+    if ((result=make_binlog_path(subdir_name)) != 0) {
+        return result;
+    }
+    if ((result=write_binlog_files(subdir_name, &bkey)) != 0) {
+        return result;
+    }
+    if ((result=add_slices(&bkey)) != 0) {
+        return result;
+    }
+
+    /* purge the first file and replace the second one with the snapshot
+     * which data version is the last of the second file */
+    if ((result=binlog_retention_purge_replica_files(TEST_DATA_GROUP_ID,
+                    0, TEST_BINLOG_FILES - 1)) == 0)
+    {
+        if ((result=check_snapshot(subdir_name, TEST_BINLOG_FILES - 2,
+                        (TEST_BINLOG_FILES - 1) * TEST_RECORDS_PER_FILE,
+                        &bkey)) == 0)
+        {
+            result = check_purged(subdir_name);
+        }
+    }
+
+    printf("%s: %s\n", argv[0], result == 0 ? "OK" : "FAIL");
+    return result == 0 ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* dump the object block index as the slice binlog checkpoint after part of
+ * a compressed slice overwritten, then reload the checkpoint and check the
+ * slices read back, the modules are linked with the stubbed global config
+ * as fs_server_bench */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "sf/sf_global.h"
+#include "common/fs_func.h"
+#include "../server_global.h"
+#include "../storage/object_block_index.h"
+#include "../binlog/binlog_types.h"
+#include "../binlog/slice_loader.h"
+
+#define TEST_SLICE_LENGTH      (64 * 1024)
+#define TEST_COMPRESS_LENGTH   (8 * 1024)
+#define TEST_OVERWRITE_OFFSET  (16 * 1024)
+#define TEST_OVERWRITE_LENGTH  (8 * 1024)
+#define TEST_CRC32C            0x1234ABCD
+
+static FSStoragePathInfo test_path_info;
+static FSStoragePathInfo *test_paths_by_index[1];
+
+static void setup_stub_globals()
+{
+    /* one store path without the trunk files */
+    test_path_info.store.index = 0;
+    FC_SET_STRING(test_path_info.store.path, "/tmp/fs_test_slice_checkpoint");
+    test_paths_by_index[0] = &test_path_info;
+    STORAGE_CFG.paths_by_index.paths = test_paths_by_index;
+    STORAGE_CFG.paths_by_index.count = 1;
+    STORAGE_CFG.max_store_path_index = 0;
+
+    STORAGE_CFG.space_discard.enabled = false;
+    STORAGE_CFG.object_block.shared_lock_count = 17;
+    STORAGE_CFG.object_block.shared_allocator_count = 7;
+    STORAGE_CFG.object_block.hashtable_capacity = 1361;
+
+    g_current_time = time(NULL);
+}
+
+static int add_slice(const FSBlockKey *bkey, const int offset,
+        const int length, const int trunk_id, const char compress_type)
+{
+    OBSliceEntry *slice;
+    int inc_alloc;
+    int result;
+
+    if ((slice=ob_index_alloc_slice(bkey)) == NULL) {
+        return ENOMEM;
+    }
+
+    slice->type = OB_SLICE_TYPE_FILE;
+    slice->ssize.offset = offset;
+    slice->ssize.length = length;
+    slice->space.store = &test_path_info.store;
+    slice->space.id_info.id = trunk_id;
+    slice->space.id_info.subdir = 1;
+    slice->space.offset = 0;
+    slice->checksum.valid = true;
+    slice->checksum.crc32c = TEST_CRC32C;
+    slice->compress.type = compress_type;
+    slice->compress.offset = 0;
+    if (compress_type == FS_COMPRESS_TYPE_NONE) {
+        slice->compress.length = 0;
+        slice->space.size = length;
+    } else {
+        slice->compress.length = TEST_COMPRESS_LENGTH;
+        slice->space.size = TEST_COMPRESS_LENGTH;
+    }
+
+    result = ob_index_add_slice(slice, NULL, &inc_alloc, false);
+    ob_index_free_slice(slice);
+    return result;
+}
+
+static int get_slices(const FSBlockKey *bkey, OBSlicePtrArray *sarray)
+{
+    FSBlockSliceKeyInfo bs_key;
+
+    bs_key.block = *bkey;
+    bs_key.slice.offset = 0;
+    bs_key.slice.length = TEST_SLICE_LENGTH;
+    return ob_index_get_slices(&bs_key, sarray, false);
+}
+
+static void free_slices(OBSlicePtrArray *sarray)
+{
+    int i;
+
+    for (i=0; i<sarray->count; i++) {
+        ob_index_free_slice(sarray->slices[i]);
+    }
+    sarray->count = 0;
+}
+
+static int compare_slice(const OBSliceEntry *expect,
+        const OBSliceEntry *actual, const int index)
+{
+    if (expect->type == actual->type &&
+            expect->ssize.offset == actual->ssize.offset &&
+            expect->ssize.length == actual->ssize.length &&
+            expect->space.id_info.id == actual->space.id_info.id &&
+            expect->space.offset == actual->space.offset &&
+            expect->space.size == actual->space.size &&
+            expect->checksum.valid == actual->checksum.valid &&
+            (!expect->checksum.valid || expect->checksum.crc32c ==
+             actual->checksum.crc32c) &&
+            expect->compress.type == actual->compress.type &&
+            expect->compress.length == actual->compress.length &&
+            expect->compress.offset == actual->compress.offset)
+    {
+        return 0;
+    }
+
+    fprintf(stderr, "slice #%d mismatch, expect {offset: %d, length: %d, "
+            "trunk id: %"PRId64", checksum valid: %d, compress type: %d, "
+            "length: %d, offset: %d}, actual {offset: %d, length: %d, "
+            "trunk id: %"PRId64", checksum valid: %d, compress type: %d, "
+            "length: %d, offset: %d}\n", index, expect->ssize.offset,
+            expect->ssize.length, expect->space.id_info.id,
+            expect->checksum.valid, expect->compress.type,
+            expect->compress.length, expect->compress.offset,
+            actual->ssize.offset, actual->ssize.length,
+            actual->space.id_info.id, actual->checksum.valid,
+            actual->compress.type, actual->compress.length,
+            actual->compress.offset);
+    return EINVAL;
+}
+
+static int reload_checkpoint(const char *filename, const FSBlockKey *bkey)
+{
+    BinlogReadThreadResult r;
+    int64_t file_size;
+    int64_t record_count;
+    int result;
+
+    if ((result=ob_index_delete_block_by_binlog(bkey)) != 0) {
+        return result;
+    }
+
+    memset(&r, 0, sizeof(r));
+    if ((result=getFileContent(filename, &r.buffer.buff, &file_size)) != 0) {
+        return result;
+    }
+    r.buffer.length = file_size;
+    result = slice_loader_parse_buffer_ex(&r, &record_count, true);
+    free(r.buffer.buff);
+    return result;
+}
+
+static int check_slices(OBSlicePtrArray *before, OBSlicePtrArray *after)
+{
+    int i;
+    int result;
+
+    if (before->count != after->count) {
+        fprintf(stderr, "slice count: %d != expect: %d\n",
+                after->count, before->count);
+        return EINVAL;
+    }
+
+    for (i=0; i<before->count; i++) {
+        if ((result=compare_slice(before->slices[i],
+                        after->slices[i], i)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = "/tmp/fs_test_slice_checkpoint.dat";
+    FSBlockKey bkey;
+    OBSlicePtrArray before;
+    OBSlicePtrArray after;
+    int64_t slice_count;
+    int result;
+
+    log_init();
+    setup_stub_globals();
+    if ((result=ob_index_init()) != 0) {
+        return result;
+    }
+
+    bkey.oid = 1;
+    bkey.offset = 0;
+    fs_calc_block_hashcode(&bkey);
+
+    /* the overwrite splits the compressed slice into two parts, and the
+     * tail part locates in the uncompressed data by the compress offset */
+    if ((result=add_slice(&bkey, 0, TEST_SLICE_LENGTH, 1,
+                    FS_COMPRESS_TYPE_LZ4)) != 0)
+    {
+        return result;
+    }
+    if ((result=add_slice(&bkey, TEST_OVERWRITE_OFFSET,
+                    TEST_OVERWRITE_LENGTH, 2, FS_COMPRESS_TYPE_NONE)) != 0)
+    {
+        return result;
+    }
+
+    ob_index_init_slice_ptr_array(&before);
+    ob_index_init_slice_ptr_array(&after);
+    if ((result=get_slices(&bkey, &before)) != 0) {
+        return result;
+    }
+    if (before.count != 3 || before.slices[2]->compress.offset !=
+            TEST_OVERWRITE_OFFSET + TEST_OVERWRITE_LENGTH ||
+            before.slices[2]->checksum.valid)
+    {
+        fprintf(stderr, "the compressed slice NOT split as expected\n");
+        return EINVAL;
+    }
+
+    if ((result=ob_index_dump_slices_to_file(filename,
+                    g_current_time, &slice_count)) != 0)
+    {
+        return result;
+    }
+    if ((result=reload_checkpoint(filename, &bkey)) != 0) {
+        return result;
+    }
+    unlink(filename);
+
+    if ((result=get_slices(&bkey, &after)) != 0) {
+        return result;
+    }
+    result = check_slices(&before, &after);
+    free_slices(&before);
+    free_slices(&after);
+    ob_index_free_slice_ptr_array(&before);
+    ob_index_free_slice_ptr_array(&after);
+
+    printf("%s: %s\n", argv[0], result == 0 ? "OK" : "FAIL");
+    return result == 0 ? 0 : 1;
+}